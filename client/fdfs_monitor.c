@@ -445,6 +445,9 @@ static int list_storages(FDFSGroupStat *pGroupStat)
 			"\t\tsuccess_file_read_count = "INT64_PRINTF_FORMAT"\n" \
 			"\t\ttotal_file_write_count = "INT64_PRINTF_FORMAT"\n" \
 			"\t\tsuccess_file_write_count = "INT64_PRINTF_FORMAT"\n" \
+			"\t\ttotal_cache_get_count = "INT64_PRINTF_FORMAT"\n" \
+			"\t\tsuccess_cache_get_count = "INT64_PRINTF_FORMAT"\n" \
+			"\t\tsuccess_cache_get_bytes = "INT64_PRINTF_FORMAT"\n" \
 			"\t\tlast_heart_beat_time = %s\n" \
 			"\t\tlast_source_update = %s\n" \
 			"\t\tlast_sync_update = %s\n"   \
@@ -504,6 +507,9 @@ static int list_storages(FDFSGroupStat *pGroupStat)
 			pStorageStat->success_file_read_count, \
 			pStorageStat->total_file_write_count, \
 			pStorageStat->success_file_write_count, \
+			pStorageStat->total_cache_get_count, \
+			pStorageStat->success_cache_get_count, \
+			pStorageStat->success_cache_get_bytes, \
 			formatDatetime(pStorageStat->last_heart_beat_time, \
 				"%Y-%m-%d %H:%M:%S", \
 				szLastHeartBeatTime, sizeof(szLastHeartBeatTime)), \
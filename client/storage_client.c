@@ -672,6 +672,196 @@ int storage_do_download_file_ex(ConnectionInfo *pTrackerServer, \
 	return result;
 }
 
+int storage_download_files_batch(ConnectionInfo *pTrackerServer, \
+		ConnectionInfo *pStorageServer, const char *group_name, \
+		FDFSDownloadBatchEntry *entries, const int entry_count)
+{
+	TrackerHeader *pHeader;
+	FDFSDownloadBatchEntry *pEntry;
+	ConnectionInfo storageServer;
+	char frame[STORAGE_PROTO_BATCH_DOWNLOAD_FRAME_SIZE];
+	char *out_buff;
+	char *p;
+	int64_t out_bytes;
+	int64_t in_bytes;
+	int64_t content_bytes;
+	int filename_len;
+	int index;
+	int status;
+	int i;
+	int result;
+	bool new_connection;
+
+	if (entry_count <= 0)
+	{
+		return EINVAL;
+	}
+
+	out_bytes = sizeof(TrackerHeader) + FDFS_GROUP_NAME_MAX_LEN + 4;
+	for (i=0; i<entry_count; i++)
+	{
+		entries[i].status = EIO;
+		entries[i].file_buff = NULL;
+		entries[i].file_size = 0;
+		out_bytes += 3 * FDFS_PROTO_PKG_LEN_SIZE + \
+				strlen(entries[i].remote_filename);
+	}
+
+	out_buff = (char *)malloc(out_bytes);
+	if (out_buff == NULL)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"malloc "INT64_PRINTF_FORMAT" bytes fail", \
+			__LINE__, out_bytes);
+		return errno != 0 ? errno : ENOMEM;
+	}
+
+	/**
+	send pkg format:
+	FDFS_GROUP_NAME_MAX_LEN bytes: group_name
+	4 bytes: file count
+	file count entries:
+		8 bytes: file offset
+		8 bytes: download file bytes
+		8 bytes: filename length
+		filename
+	**/
+	memset(out_buff, 0, sizeof(TrackerHeader) + FDFS_GROUP_NAME_MAX_LEN);
+	pHeader = (TrackerHeader *)out_buff;
+	p = out_buff + sizeof(TrackerHeader);
+	snprintf(p, FDFS_GROUP_NAME_MAX_LEN + 1, "%s", group_name);
+	p += FDFS_GROUP_NAME_MAX_LEN;
+	int2buff(entry_count, p);
+	p += 4;
+	for (i=0; i<entry_count; i++)
+	{
+		filename_len = strlen(entries[i].remote_filename);
+		long2buff(entries[i].file_offset, p);
+		p += FDFS_PROTO_PKG_LEN_SIZE;
+		long2buff(entries[i].download_bytes, p);
+		p += FDFS_PROTO_PKG_LEN_SIZE;
+		long2buff(filename_len, p);
+		p += FDFS_PROTO_PKG_LEN_SIZE;
+		memcpy(p, entries[i].remote_filename, filename_len);
+		p += filename_len;
+	}
+	long2buff(out_bytes - sizeof(TrackerHeader), pHeader->pkg_len);
+	pHeader->cmd = STORAGE_PROTO_CMD_DOWNLOAD_FILES_BATCH;
+
+	if ((result=storage_get_read_connection(pTrackerServer, \
+		&pStorageServer, group_name, entries[0].remote_filename, \
+		&storageServer, &new_connection)) != 0)
+	{
+		free(out_buff);
+		return result;
+	}
+
+	do
+	{
+	if ((result=tcpsenddata_nb(pStorageServer->sock, out_buff, \
+		out_bytes, g_fdfs_network_timeout)) != 0)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"send data to storage server %s:%d fail, " \
+			"errno: %d, error info: %s", __LINE__, \
+			pStorageServer->ip_addr, pStorageServer->port, \
+			result, STRERROR(result));
+		break;
+	}
+
+	if ((result=fdfs_recv_header(pStorageServer, &in_bytes)) != 0)
+	{
+		break;
+	}
+
+	/* the frames are in the read order of the storage server */
+	while (in_bytes > 0)
+	{
+		if (in_bytes < sizeof(frame))
+		{
+			result = EINVAL;
+			break;
+		}
+
+		if ((result=tcprecvdata_nb(pStorageServer->sock, frame, \
+			sizeof(frame), g_fdfs_network_timeout)) != 0)
+		{
+			break;
+		}
+		in_bytes -= sizeof(frame);
+
+		index = buff2int(frame);
+		status = (unsigned char)frame[4];
+		content_bytes = buff2long(frame + 5);
+		if (index < 0 || index >= entry_count || content_bytes < 0 \
+			|| content_bytes > in_bytes || \
+			entries[index].file_buff != NULL)
+		{
+			logError("file: "__FILE__", line: %d, " \
+				"storage server %s:%d, invalid frame, " \
+				"index: %d, content bytes: "INT64_PRINTF_FORMAT, \
+				__LINE__, pStorageServer->ip_addr, \
+				pStorageServer->port, index, content_bytes);
+			result = EINVAL;
+			break;
+		}
+
+		pEntry = entries + index;
+		pEntry->file_buff = (char *)malloc(content_bytes + 1);
+		if (pEntry->file_buff == NULL)
+		{
+			logError("file: "__FILE__", line: %d, " \
+				"malloc "INT64_PRINTF_FORMAT" bytes fail", \
+				__LINE__, content_bytes + 1);
+			result = errno != 0 ? errno : ENOMEM;
+			break;
+		}
+
+		if (content_bytes > 0 && (result=tcprecvdata_nb( \
+			pStorageServer->sock, pEntry->file_buff, \
+			content_bytes, g_fdfs_network_timeout)) != 0)
+		{
+			break;
+		}
+		in_bytes -= content_bytes;
+		*(pEntry->file_buff + content_bytes) = '\0';
+
+		pEntry->status = status;
+		if (status == 0)
+		{
+			pEntry->file_size = content_bytes;
+		}
+		else
+		{
+			free(pEntry->file_buff);
+			pEntry->file_buff = NULL;
+		}
+	}
+
+	if (result != 0)
+	{
+		for (i=0; i<entry_count; i++)
+		{
+			if (entries[i].file_buff != NULL)
+			{
+				free(entries[i].file_buff);
+				entries[i].file_buff = NULL;
+			}
+			entries[i].file_size = 0;
+			entries[i].status = result;
+		}
+	}
+	} while (0);
+
+	free(out_buff);
+	if (new_connection)
+	{
+		tracker_disconnect_server_ex(pStorageServer, result != 0);
+	}
+
+	return result;
+}
+
 int storage_download_file_to_file1(ConnectionInfo *pTrackerServer, \
 		ConnectionInfo *pStorageServer, \
 		const char *file_id, \
@@ -1020,6 +1210,193 @@ int storage_do_upload_file(ConnectionInfo *pTrackerServer, \
 	return result;
 }
 
+int storage_upload_files_batch(ConnectionInfo *pTrackerServer, \
+		ConnectionInfo *pStorageServer, const int store_path_index, \
+		FDFSUploadBatchEntry *entries, const int entry_count, \
+		char *group_name)
+{
+	TrackerHeader *pHeader;
+	ConnectionInfo storageServer;
+	char *out_buff;
+	char *in_buff;
+	char *p;
+	char *pEnd;
+	int64_t out_bytes;
+	int64_t in_bytes;
+	int64_t filename_len;
+	int file_ext_len;
+	int new_store_path;
+	int result;
+	int i;
+	bool new_connection;
+
+	if (entry_count <= 0)
+	{
+		return EINVAL;
+	}
+
+	out_bytes = sizeof(TrackerHeader) + 1 + 4;
+	for (i=0; i<entry_count; i++)
+	{
+		*(entries[i].remote_filename) = '\0';
+		out_bytes += FDFS_PROTO_PKG_LEN_SIZE + \
+			FDFS_FILE_EXT_NAME_MAX_LEN + entries[i].file_size;
+	}
+
+	out_buff = (char *)malloc(out_bytes);
+	if (out_buff == NULL)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"malloc "INT64_PRINTF_FORMAT" bytes fail", \
+			__LINE__, out_bytes);
+		return errno != 0 ? errno : ENOMEM;
+	}
+
+	new_store_path = store_path_index;
+	if ((result=storage_get_upload_connection(pTrackerServer, \
+		&pStorageServer, group_name, &storageServer, \
+		&new_store_path, &new_connection)) != 0)
+	{
+		*group_name = '\0';
+		free(out_buff);
+		return result;
+	}
+	*group_name = '\0';
+
+	/**
+	send pkg format:
+	1 byte: store path index
+	4 bytes: file count
+	file count entries:
+		8 bytes: file size
+		FDFS_FILE_EXT_NAME_MAX_LEN bytes: file ext name
+	file contents
+	**/
+	pHeader = (TrackerHeader *)out_buff;
+	p = out_buff + sizeof(TrackerHeader);
+	*p++ = (char)new_store_path;
+	int2buff(entry_count, p);
+	p += 4;
+	for (i=0; i<entry_count; i++)
+	{
+		long2buff(entries[i].file_size, p);
+		p += FDFS_PROTO_PKG_LEN_SIZE;
+		memset(p, 0, FDFS_FILE_EXT_NAME_MAX_LEN);
+		if (entries[i].file_ext_name != NULL)
+		{
+			file_ext_len = strlen(entries[i].file_ext_name);
+			if (file_ext_len > FDFS_FILE_EXT_NAME_MAX_LEN)
+			{
+				file_ext_len = FDFS_FILE_EXT_NAME_MAX_LEN;
+			}
+			memcpy(p, entries[i].file_ext_name, file_ext_len);
+		}
+		p += FDFS_FILE_EXT_NAME_MAX_LEN;
+	}
+	for (i=0; i<entry_count; i++)
+	{
+		memcpy(p, entries[i].file_buff, entries[i].file_size);
+		p += entries[i].file_size;
+	}
+	long2buff(out_bytes - sizeof(TrackerHeader), pHeader->pkg_len);
+	pHeader->cmd = STORAGE_PROTO_CMD_UPLOAD_FILES_BATCH;
+	pHeader->status = 0;
+
+	in_buff = NULL;
+	do
+	{
+	if ((result=tcpsenddata_nb(pStorageServer->sock, out_buff, \
+		out_bytes, g_fdfs_network_timeout)) != 0)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"send data to storage server %s:%d fail, " \
+			"errno: %d, error info: %s", __LINE__, \
+			pStorageServer->ip_addr, pStorageServer->port, \
+			result, STRERROR(result));
+		break;
+	}
+
+	if ((result=fdfs_recv_response(pStorageServer, \
+		&in_buff, 0, &in_bytes)) != 0)
+	{
+		break;
+	}
+
+	/**
+	response body:
+	FDFS_GROUP_NAME_MAX_LEN bytes: group_name
+	file count entries:
+		8 bytes: filename length
+		filename
+	**/
+	if (in_bytes <= FDFS_GROUP_NAME_MAX_LEN)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"storage server %s:%d response data " \
+			"length: "INT64_PRINTF_FORMAT" is invalid, " \
+			"should > %d", __LINE__, \
+			pStorageServer->ip_addr, pStorageServer->port, \
+			in_bytes, FDFS_GROUP_NAME_MAX_LEN);
+		result = EINVAL;
+		break;
+	}
+
+	p = in_buff + FDFS_GROUP_NAME_MAX_LEN;
+	pEnd = in_buff + in_bytes;
+	for (i=0; i<entry_count; i++)
+	{
+		if (pEnd - p < FDFS_PROTO_PKG_LEN_SIZE)
+		{
+			break;
+		}
+		filename_len = buff2long(p);
+		p += FDFS_PROTO_PKG_LEN_SIZE;
+		if (filename_len <= 0 || filename_len >= \
+			sizeof(entries[i].remote_filename) || \
+			filename_len > pEnd - p)
+		{
+			break;
+		}
+
+		memcpy(entries[i].remote_filename, p, filename_len);
+		*(entries[i].remote_filename + filename_len) = '\0';
+		p += filename_len;
+	}
+
+	if (i < entry_count || p != pEnd)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"storage server %s:%d response data " \
+			"length: "INT64_PRINTF_FORMAT" is invalid " \
+			"for file count: %d", __LINE__, \
+			pStorageServer->ip_addr, pStorageServer->port, \
+			in_bytes, entry_count);
+		for (i=0; i<entry_count; i++)
+		{
+			*(entries[i].remote_filename) = '\0';
+		}
+		result = EINVAL;
+		break;
+	}
+
+	memcpy(group_name, in_buff, FDFS_GROUP_NAME_MAX_LEN);
+	group_name[FDFS_GROUP_NAME_MAX_LEN] = '\0';
+	} while (0);
+
+	free(out_buff);
+	if (in_buff != NULL)
+	{
+		free(in_buff);
+	}
+
+	if (new_connection)
+	{
+		tracker_disconnect_server_ex(pStorageServer, result != 0);
+	}
+
+	return result;
+}
+
 int storage_upload_by_callback_ex(ConnectionInfo *pTrackerServer, \
 		ConnectionInfo *pStorageServer, const int store_path_index, \
 		const char cmd, UploadCallback callback, void *arg, \
@@ -23,6 +23,26 @@
 #define FDFS_FILE_ID_SEPERATOR		'/'
 #define FDFS_FILE_ID_SEPERATE_STR	"/"
 
+/* the file of the batch upload */
+typedef struct
+{
+	const char *file_buff;      //file content
+	int64_t file_size;          //file size (bytes)
+	const char *file_ext_name;  //file ext name, not include dot(.), can be NULL
+	char remote_filename[128];  //return the new created filename
+} FDFSUploadBatchEntry;
+
+/* the file of the batch download */
+typedef struct
+{
+	const char *remote_filename;  //filename on storage server
+	int64_t file_offset;     //the start offset to download
+	int64_t download_bytes;  //0 means from start offset to the file end
+	int status;              //return 0 for success, else the error code
+	char *file_buff;         //return file content, must be freed
+	int64_t file_size;       //return the downloaded bytes
+} FDFSDownloadBatchEntry;
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -155,6 +175,26 @@ int storage_upload_by_callback_ex(ConnectionInfo *pTrackerServer, \
 		const FDFSMetaData *meta_list, const int meta_count, \
 		char *group_name, char *remote_filename);
 
+/**
+* upload small files to storage server in one request, the files are
+* written contiguously and logged to the binlog together
+* params:
+*       pTrackerServer: tracker server
+*       pStorageServer: storage server
+*       store_path_index: the index of path on the storage server
+*	entries: the files to upload, return the remote filename of each file
+*	entry_count: the count of the files, the request size should
+*	          less than buff_size of the storage server
+*	group_name: if not empty, specify the group name.
+	 	    return the group name to store the files
+* return: 0 success, !=0 fail (none of the files are stored),
+*         return the error code
+**/
+int storage_upload_files_batch(ConnectionInfo *pTrackerServer, \
+		ConnectionInfo *pStorageServer, const int store_path_index, \
+		FDFSUploadBatchEntry *entries, const int entry_count, \
+		char *group_name);
+
 int storage_do_upload_file(ConnectionInfo *pTrackerServer, \
 	ConnectionInfo *pStorageServer, const int store_path_index, \
 	const char cmd, const int upload_type, const char *file_buff, \
@@ -206,6 +246,24 @@ int storage_delete_file(ConnectionInfo *pTrackerServer, \
 		download_type, group_name, remote_filename, \
 		0, 0, file_buff, arg, file_size);
 
+/**
+* download files from storage server in one request, the files
+* in the same trunk file are read in the offset order
+* params:
+*       pTrackerServer: tracker server
+*       pStorageServer: storage server, can be NULL
+*	group_name: the group name of storage server
+*	entries: the files to download, return the status and content
+*	          of each file
+*	entry_count: the count of the files, the request size should
+*	          less than buff_size of the storage server
+* return: 0 success (check the status of each entry), !=0 fail,
+*         return the error code
+**/
+int storage_download_files_batch(ConnectionInfo *pTrackerServer, \
+		ConnectionInfo *pStorageServer, const char *group_name, \
+		FDFSDownloadBatchEntry *entries, const int entry_count);
+
 /**
 * download file from storage server
 * params:
@@ -266,11 +266,13 @@ int tracker_list_servers(ConnectionInfo *pTrackerServer, \
 	TrackerStorageStat stats[FDFS_MAX_GROUPS];
 	char *pInBuff;
 	TrackerStorageStat *pSrc;
-	TrackerStorageStat *pEnd;
+	char *pRecord;
+	char *pEnd;
 	FDFSStorageStat *pStorageStat;
 	FDFSStorageInfo *pDest;
 	FDFSStorageStatBuff *pStatBuff;
 	int64_t in_bytes;
+	int record_size;
 
 	CHECK_CONNECTION(pTrackerServer, conn, result, new_connection);
 
@@ -330,7 +332,16 @@ int tracker_list_servers(ConnectionInfo *pTrackerServer, \
 		return result;
 	}
 
-	if (in_bytes % sizeof(TrackerStorageStat) != 0)
+	//tracker servers before V5.03 reply the stat without cache counters
+	if (in_bytes % sizeof(TrackerStorageStat) == 0)
+	{
+		record_size = sizeof(TrackerStorageStat);
+	}
+	else if (in_bytes % TRACKER_STORAGE_STAT_V502_SIZE == 0)
+	{
+		record_size = TRACKER_STORAGE_STAT_V502_SIZE;
+	}
+	else
 	{
 		logError("file: "__FILE__", line: %d, " \
 			"tracker server %s:%d response data " \
@@ -341,7 +352,7 @@ int tracker_list_servers(ConnectionInfo *pTrackerServer, \
 		return EINVAL;
 	}
 
-	*storage_count = in_bytes / sizeof(TrackerStorageStat);
+	*storage_count = in_bytes / record_size;
 	if (*storage_count > max_storages)
 	{
 		logError("file: "__FILE__", line: %d, " \
@@ -355,9 +366,10 @@ int tracker_list_servers(ConnectionInfo *pTrackerServer, \
 
 	memset(storage_infos, 0, sizeof(FDFSStorageInfo) * max_storages);
 	pDest = storage_infos;
-	pEnd = stats + (*storage_count);
-	for (pSrc=stats; pSrc<pEnd; pSrc++)
+	pEnd = (char *)stats + in_bytes;
+	for (pRecord=(char *)stats; pRecord<pEnd; pRecord+=record_size)
 	{
+		pSrc = (TrackerStorageStat *)pRecord;
 		pStatBuff = &(pSrc->stat_buff);
 		pStorageStat = &(pDest->stat);
 
@@ -465,7 +477,16 @@ int tracker_list_servers(ConnectionInfo *pTrackerServer, \
 			pStatBuff->sz_success_file_write_count);
 		pStorageStat->last_heart_beat_time = buff2long( \
 			pStatBuff->sz_last_heart_beat_time);
-		pDest->if_trunk_server = pSrc->if_trunk_server;
+		if (record_size == sizeof(TrackerStorageStat))
+		{
+			pStorageStat->total_cache_get_count = buff2long( \
+				pStatBuff->sz_total_cache_get_count);
+			pStorageStat->success_cache_get_count = buff2long( \
+				pStatBuff->sz_success_cache_get_count);
+			pStorageStat->success_cache_get_bytes = buff2long( \
+				pStatBuff->sz_success_cache_get_bytes);
+		}
+		pDest->if_trunk_server = pRecord[record_size - 1];
 		pDest++;
 	}
 
@@ -25,6 +25,7 @@ typedef int (*TaskFinishCallBack) (struct fast_task_info *pTask);
 typedef void (*TaskCleanUpCallBack) (struct fast_task_info *pTask);
 
 typedef void (*IOEventCallback) (int sock, short event, void *arg);
+typedef void (*ThreadNotifyCallback) (struct fast_task_info *pTask);
 
 typedef struct ioevent_entry
 {
@@ -37,8 +38,14 @@ struct nio_thread_data
 {
 	struct ioevent_puller ev_puller;
 	struct fast_timer timer;
-        int pipe_fds[2];
+	int notify_fds[2];  //eventfd in Linux (the same fd), pipe for others
 	struct fast_task_info *deleted_list;
+
+	/* lock-free task stack pushed by the other threads,
+	   drained in batch by this thread */
+	struct fast_task_info *notify_head;
+	int notify_signaled;  //if the thread is signaled or awake
+	ThreadNotifyCallback notify_callback;
 };
 
 struct fast_task_info
@@ -54,6 +61,7 @@ struct fast_task_info
 	TaskFinishCallBack finish_callback;
 	struct nio_thread_data *thread_data;
 	struct fast_task_info *next;
+	struct fast_task_info *notify_next;  //for the nio notify stack
 };
 
 struct fast_task_queue
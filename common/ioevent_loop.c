@@ -1,4 +1,10 @@
+#include <unistd.h>
+#include <fcntl.h>
+#ifdef OS_LINUX
+#include <sys/eventfd.h>
+#endif
 #include "sched_thread.h"
+#include "shared_func.h"
 #include "logger.h"
 #include "ioevent_loop.h"
 
@@ -37,8 +43,176 @@ static void deal_timeouts(FastTimerEntry *head)
 	}
 }
 
+int ioevent_notify_init(struct nio_thread_data *pThreadData)
+{
+	int result;
+
+	pThreadData->notify_head = NULL;
+	pThreadData->notify_signaled = 0;
+#ifdef OS_LINUX
+	pThreadData->notify_fds[0] = eventfd(0, EFD_NONBLOCK);
+	if (pThreadData->notify_fds[0] < 0)
+	{
+		result = errno != 0 ? errno : EPERM;
+		logError("file: "__FILE__", line: %d, " \
+			"call eventfd fail, " \
+			"errno: %d, error info: %s", \
+			__LINE__, result, STRERROR(result));
+		return result;
+	}
+	pThreadData->notify_fds[1] = pThreadData->notify_fds[0];
+#else
+	if (pipe(pThreadData->notify_fds) != 0)
+	{
+		result = errno != 0 ? errno : EPERM;
+		logError("file: "__FILE__", line: %d, " \
+			"call pipe fail, " \
+			"errno: %d, error info: %s", \
+			__LINE__, result, STRERROR(result));
+		return result;
+	}
+
+	if ((result=fd_add_flags(pThreadData->notify_fds[0], \
+			O_NONBLOCK)) != 0)
+	{
+		return result;
+	}
+#endif
+
+	return 0;
+}
+
+/* the task is on the notify stack already, so the wakeup can not fail:
+   retry the interrupted or full write, and clear the signaled flag for
+   the other errors so that the next push writes the wakeup again */
+static void ioevent_notify_wakeup(struct nio_thread_data *pThreadData)
+{
+#ifdef OS_LINUX
+	int64_t n;
+#else
+	char n;
+#endif
+	int result;
+
+	n = 1;
+	while (write(pThreadData->notify_fds[1], &n, sizeof(n)) != sizeof(n))
+	{
+		result = errno != 0 ? errno : EIO;
+		if (result == EINTR)
+		{
+			continue;
+		}
+		if (result == EAGAIN || result == EWOULDBLOCK)
+		{
+			usleep(1000);
+			continue;
+		}
+
+		logError("file: "__FILE__", line: %d, " \
+			"write to notify fd %d fail, " \
+			"errno: %d, error info: %s", __LINE__, \
+			pThreadData->notify_fds[1], result, STRERROR(result));
+		__atomic_store_n(&pThreadData->notify_signaled, 0,
+				__ATOMIC_SEQ_CST);
+		break;
+	}
+}
+
+void ioevent_notify_thread(struct nio_thread_data *pThreadData,
+	struct fast_task_info *pTask)
+{
+	struct fast_task_info *old_head;
+
+	old_head = __atomic_load_n(&pThreadData->notify_head, __ATOMIC_RELAXED);
+	do
+	{
+		pTask->notify_next = old_head;
+	} while (!__atomic_compare_exchange_n(&pThreadData->notify_head,
+			&old_head, pTask, true, __ATOMIC_SEQ_CST,
+			__ATOMIC_RELAXED));
+
+	/* only one wakeup until the consumer goes to sleep */
+	if (__atomic_exchange_n(&pThreadData->notify_signaled, 1,
+			__ATOMIC_SEQ_CST) != 0)
+	{
+		return;
+	}
+
+	ioevent_notify_wakeup(pThreadData);
+}
+
+/* pop all tasks in FIFO order */
+static struct fast_task_info *ioevent_notify_pop_all(
+	struct nio_thread_data *pThreadData)
+{
+	struct fast_task_info *pTask;
+	struct fast_task_info *pNext;
+	struct fast_task_info *pReversed;
+
+	pTask = __atomic_exchange_n(&pThreadData->notify_head, NULL,
+			__ATOMIC_ACQUIRE);
+	pReversed = NULL;
+	while (pTask != NULL)
+	{
+		pNext = pTask->notify_next;
+		pTask->notify_next = pReversed;
+		pReversed = pTask;
+		pTask = pNext;
+	}
+
+	return pReversed;
+}
+
+static void ioevent_notify_read(int sock, short event, void *arg)
+{
+	struct nio_thread_data *pThreadData;
+	struct fast_task_info *pTask;
+	struct fast_task_info *pNext;
+	char buff[64];
+	int bytes;
+
+	pThreadData = (struct nio_thread_data *)arg;
+	while ((bytes=read(sock, buff, sizeof(buff))) < 0 && errno == EINTR);
+	if (bytes < 0 && !(errno == EAGAIN || errno == EWOULDBLOCK))
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"call read failed, " \
+			"errno: %d, error info: %s", \
+			__LINE__, errno, STRERROR(errno));
+	}
+
+	while (1)
+	{
+		pTask = ioevent_notify_pop_all(pThreadData);
+		if (pTask == NULL)
+		{
+			/* go to sleep, recheck after the signaled flag cleared */
+			__atomic_store_n(&pThreadData->notify_signaled, 0,
+					__ATOMIC_SEQ_CST);
+			if (__atomic_load_n(&pThreadData->notify_head,
+				__ATOMIC_SEQ_CST) == NULL)
+			{
+				break;
+			}
+			if (__atomic_exchange_n(&pThreadData->notify_signaled,
+				1, __ATOMIC_SEQ_CST) != 0)
+			{
+				break;  //the producer has written the wakeup
+			}
+			continue;
+		}
+
+		while (pTask != NULL)
+		{
+			pNext = pTask->notify_next;
+			pThreadData->notify_callback(pTask);
+			pTask = pNext;
+		}
+	}
+}
+
 int ioevent_loop(struct nio_thread_data *pThreadData,
-	IOEventCallback recv_notify_callback, TaskCleanUpCallBack
+	ThreadNotifyCallback notify_callback, TaskCleanUpCallBack
 	clean_up_callback, volatile bool *continue_flag)
 {
 	int result;
@@ -48,11 +222,13 @@ int ioevent_loop(struct nio_thread_data *pThreadData,
 	time_t last_check_time;
 	int count;
 
+	pThreadData->notify_callback = notify_callback;
 	memset(&ev_notify, 0, sizeof(ev_notify));
-	ev_notify.fd = pThreadData->pipe_fds[0];
-	ev_notify.callback = recv_notify_callback;
+	ev_notify.fd = pThreadData->notify_fds[0];
+	ev_notify.callback = ioevent_notify_read;
+	ev_notify.timer.data = pThreadData;
 	if (ioevent_attach(&pThreadData->ev_puller,
-		pThreadData->pipe_fds[0], IOEVENT_READ,
+		pThreadData->notify_fds[0], IOEVENT_READ,
 		&ev_notify) != 0)
 	{
 		result = errno != 0 ? errno : ENOMEM;
@@ -7,10 +7,18 @@
 extern "C" {
 #endif
 
+/* notify_callback: deal the task pushed by ioevent_notify_thread */
 int ioevent_loop(struct nio_thread_data *pThreadData,
-	IOEventCallback recv_notify_callback, TaskCleanUpCallBack
+	ThreadNotifyCallback notify_callback, TaskCleanUpCallBack
 	clean_up_callback, volatile bool *continue_flag);
 
+int ioevent_notify_init(struct nio_thread_data *pThreadData);
+
+/* push the task to the nio thread, called by the other threads,
+   the task is always delivered, the caller must not free it */
+void ioevent_notify_thread(struct nio_thread_data *pThreadData,
+	struct fast_task_info *pTask);
+
 int ioevent_set(struct fast_task_info *pTask, struct nio_thread_data *pThread,
 	int sock, short event, IOEventCallback callback, const int timeout);
 
@@ -76,6 +76,9 @@ LIBS=''
 uname=$(uname)
 if [ "$uname" = "Linux" ]; then
   CFLAGS="$CFLAGS -DOS_LINUX -DIOEVENT_USE_EPOLL"
+  if [ -f /usr/include/linux/io_uring.h ] && grep -q IORING_OP_UNLINKAT /usr/include/linux/io_uring.h; then
+    CFLAGS="$CFLAGS -DWITH_IO_URING"
+  fi
 elif [ "$uname" = "FreeBSD" ]; then
   CFLAGS="$CFLAGS -DOS_FREEBSD -DIOEVENT_USE_KQUEUE"
 elif [ "$uname" = "SunOS" ]; then
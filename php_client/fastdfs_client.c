@@ -1071,6 +1071,18 @@ static void php_fdfs_tracker_list_groups_impl(INTERNAL_FUNCTION_PARAMETERS, \
 				"success_file_write_count", \
 				sizeof("success_file_write_count"), \
 				pStorageStat->success_file_write_count);
+			add_assoc_long_ex(server_info_array, \
+				"total_cache_get_count", \
+				sizeof("total_cache_get_count"), \
+				pStorageStat->total_cache_get_count);
+			add_assoc_long_ex(server_info_array, \
+				"success_cache_get_count", \
+				sizeof("success_cache_get_count"), \
+				pStorageStat->success_cache_get_count);
+			add_assoc_long_ex(server_info_array, \
+				"success_cache_get_bytes", \
+				sizeof("success_cache_get_bytes"), \
+				pStorageStat->success_cache_get_bytes);
 			add_assoc_long_ex(server_info_array, \
 				"last_heart_beat_time", \
 				sizeof("last_heart_beat_time"), \
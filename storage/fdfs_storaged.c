@@ -37,9 +37,14 @@
 #include "storage_service.h"
 #include "sched_thread.h"
 #include "storage_dio.h"
+#include "storage_file_cache.h"
 #include "trunk_mem.h"
 #include "trunk_sync.h"
+#include "trunk_client.h"
 #include "trunk_shared.h"
+#include "trunk_compactor.h"
+#include "trunk_snapshot.h"
+#include "trunk_fd_cache.h"
 
 #ifdef WITH_HTTPD
 #include "storage_httpd.h"
@@ -321,6 +326,39 @@ int main(int argc, char *argv[])
 		return result;
 	}
 
+	if ((result=trunk_compactor_start()) != 0)
+	{
+		logCrit("file: "__FILE__", line: %d, " \
+			"trunk_compactor_start fail, " \
+			"program exit!", __LINE__);
+		g_continue_flag = false;
+		storage_func_destroy();
+		log_destroy();
+		return result;
+	}
+
+	if ((result=storage_binlog_compactor_start()) != 0)
+	{
+		logCrit("file: "__FILE__", line: %d, " \
+			"storage_binlog_compactor_start fail, " \
+			"program exit!", __LINE__);
+		g_continue_flag = false;
+		storage_func_destroy();
+		log_destroy();
+		return result;
+	}
+
+	if ((result=trunk_checkpoint_start()) != 0)
+	{
+		logCrit("file: "__FILE__", line: %d, " \
+			"trunk_checkpoint_start fail, " \
+			"program exit!", __LINE__);
+		g_continue_flag = false;
+		storage_func_destroy();
+		log_destroy();
+		return result;
+	}
+
 	scheduleArray.entries = scheduleEntries;
 
 	memset(scheduleEntries, 0, sizeof(scheduleEntries));
@@ -414,6 +452,20 @@ int main(int argc, char *argv[])
 		return result;
 	}
 
+	if ((result=storage_file_cache_init()) != 0)
+	{
+		logCrit("exit abnormally!\n");
+		log_destroy();
+		return result;
+	}
+
+	if ((result=trunk_fd_cache_init()) != 0)
+	{
+		logCrit("exit abnormally!\n");
+		log_destroy();
+		return result;
+	}
+
 	if ((result=storage_dio_init()) != 0)
 	{
 		logCrit("exit abnormally!\n");
@@ -465,16 +517,26 @@ int main(int argc, char *argv[])
 		}
 	}
 
+	if (g_if_use_trunk_file)
+	{
+		trunk_client_lease_destroy();
+	}
+
 	tracker_report_destroy();
 	storage_service_destroy();
+	storage_binlog_compactor_destroy();
 	storage_sync_destroy();
+	storage_file_cache_destroy();
 	storage_func_destroy();
 
+	trunk_compactor_destroy();
+	trunk_checkpoint_destroy();
 	if (g_if_use_trunk_file)
 	{
 		trunk_sync_destroy();
 		storage_trunk_destroy();
 	}
+	trunk_fd_cache_destroy();
 
 	logInfo("exit normally.\n");
 	log_destroy();
@@ -24,24 +24,308 @@
 #include "pthread_func.h"
 #include "logger.h"
 #include "sockopt.h"
+#include "tracker_proto.h"
 #include "storage_dio.h"
+#include "storage_dio_uring.h"
 #include "storage_nio.h"
 #include "storage_service.h"
+#include "storage_stat.h"
 #include "trunk_mem.h"
+#include "trunk_fd_cache.h"
+#include "trunk_client.h"
 
 static pthread_mutex_t g_dio_thread_lock;
 static struct storage_dio_context *g_dio_contexts = NULL;
+static int g_dio_context_count = 0;
+
+#ifdef WITH_IO_URING
+static struct storage_uring_context *g_uring_contexts = NULL;
+#endif
 
 int g_dio_thread_count = 0;
 
 static void *dio_thread_entrance(void* arg);
- 
+static void dio_thread_exit();
+
+#ifdef WITH_IO_URING
+static void *dio_uring_thread_entrance(void* arg)
+{
+	storage_uring_loop((struct storage_uring_context *)arg);
+	dio_thread_exit();
+	return NULL;
+}
+
+static int storage_dio_uring_init(pthread_attr_t *thread_attr)
+{
+	int result;
+	int bytes;
+	struct storage_uring_context *pContext;
+	struct storage_uring_context *pContextEnd;
+	pthread_t tid;
+
+	bytes = sizeof(struct storage_uring_context) * g_fdfs_store_paths.count;
+	g_uring_contexts = (struct storage_uring_context *)malloc(bytes);
+	if (g_uring_contexts == NULL)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"malloc %d bytes fail, " \
+			"errno: %d, error info: %s", __LINE__, \
+			bytes, errno, STRERROR(errno));
+		return errno != 0 ? errno : ENOMEM;
+	}
+	memset(g_uring_contexts, 0, bytes);
+
+	/* one io_uring thread per store path */
+	g_dio_thread_count = 0;
+	pContextEnd = g_uring_contexts + g_fdfs_store_paths.count;
+	for (pContext=g_uring_contexts; pContext<pContextEnd; pContext++)
+	{
+		if ((result=storage_uring_init(pContext, \
+				g_io_uring_queue_depth)) != 0)
+		{
+			return result;
+		}
+
+		if ((result=pthread_create(&tid, thread_attr, \
+			dio_uring_thread_entrance, pContext)) != 0)
+		{
+			logError("file: "__FILE__", line: %d, " \
+				"create thread failed, " \
+				"startup threads: %d, " \
+				"errno: %d, error info: %s", \
+				__LINE__, g_dio_thread_count, \
+				result, STRERROR(result));
+			return result;
+		}
+
+		pthread_mutex_lock(&g_dio_thread_lock);
+		g_dio_thread_count++;
+		pthread_mutex_unlock(&g_dio_thread_lock);
+	}
+
+	return 0;
+}
+#endif
+
+static int dio_queue_init(struct storage_dio_context *pContext, \
+		const int capacity)
+{
+	int bytes;
+	int i;
+
+	bytes = sizeof(struct storage_dio_queue_cell) * capacity;
+	pContext->cells = (struct storage_dio_queue_cell *)malloc(bytes);
+	if (pContext->cells == NULL)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"malloc %d bytes fail, " \
+			"errno: %d, error info: %s", __LINE__, \
+			bytes, errno, STRERROR(errno));
+		return errno != 0 ? errno : ENOMEM;
+	}
+
+	for (i=0; i<capacity; i++)
+	{
+		pContext->cells[i].sequence = i;
+		pContext->cells[i].pTask = NULL;
+	}
+	pContext->mask = capacity - 1;
+	pContext->enqueue_pos = 0;
+	pContext->dequeue_pos = 0;
+	return 0;
+}
+
+/* bounded multi-producer multi-consumer queue: the sequence of a cell
+   equals the position when the cell is free for the producer, and
+   position + 1 when it is filled for the consumer */
+static int dio_queue_push(struct storage_dio_context *pContext, \
+		struct fast_task_info *pTask)
+{
+	struct storage_dio_queue_cell *pCell;
+	unsigned int pos;
+	int diff;
+
+	pos = __atomic_load_n(&(pContext->enqueue_pos), __ATOMIC_RELAXED);
+	while (1)
+	{
+		pCell = pContext->cells + (pos & pContext->mask);
+		diff = (int)(__atomic_load_n(&(pCell->sequence), \
+				__ATOMIC_ACQUIRE) - pos);
+		if (diff == 0)
+		{
+			if (__atomic_compare_exchange_n(&(pContext->enqueue_pos), \
+				&pos, pos + 1, true, __ATOMIC_RELAXED, \
+				__ATOMIC_RELAXED))
+			{
+				break;
+			}
+		}
+		else if (diff < 0)
+		{
+			return ENOSPC;
+		}
+		else
+		{
+			pos = __atomic_load_n(&(pContext->enqueue_pos), \
+					__ATOMIC_RELAXED);
+		}
+	}
+
+	pCell->pTask = pTask;
+	__atomic_store_n(&(pCell->sequence), pos + 1, __ATOMIC_RELEASE);
+	return 0;
+}
+
+static struct fast_task_info *dio_queue_pop( \
+		struct storage_dio_context *pContext)
+{
+	struct storage_dio_queue_cell *pCell;
+	struct fast_task_info *pTask;
+	unsigned int pos;
+	int diff;
+
+	pos = __atomic_load_n(&(pContext->dequeue_pos), __ATOMIC_RELAXED);
+	while (1)
+	{
+		pCell = pContext->cells + (pos & pContext->mask);
+		diff = (int)(__atomic_load_n(&(pCell->sequence), \
+				__ATOMIC_ACQUIRE) - (pos + 1));
+		if (diff == 0)
+		{
+			if (__atomic_compare_exchange_n(&(pContext->dequeue_pos), \
+				&pos, pos + 1, true, __ATOMIC_RELAXED, \
+				__ATOMIC_RELAXED))
+			{
+				break;
+			}
+		}
+		else if (diff < 0)
+		{
+			return NULL;
+		}
+		else
+		{
+			pos = __atomic_load_n(&(pContext->dequeue_pos), \
+					__ATOMIC_RELAXED);
+		}
+	}
+
+	pTask = pCell->pTask;
+	__atomic_store_n(&(pCell->sequence), pos + pContext->mask + 1, \
+			__ATOMIC_RELEASE);
+	return pTask;
+}
+
+static inline bool dio_queue_empty(struct storage_dio_context *pContext)
+{
+	return __atomic_load_n(&(pContext->enqueue_pos), __ATOMIC_RELAXED) == \
+		__atomic_load_n(&(pContext->dequeue_pos), __ATOMIC_RELAXED);
+}
+
+/* steal a task from the siblings of the same group */
+static struct fast_task_info *dio_steal_task( \
+		struct storage_dio_context *pContext)
+{
+	struct storage_dio_context *pSibling;
+	struct fast_task_info *pTask;
+	int self;
+	int i;
+
+	self = pContext - pContext->group;
+	for (i=1; i<pContext->group_count; i++)
+	{
+		pSibling = pContext->group + (self + i) % pContext->group_count;
+		if ((pTask=dio_queue_pop(pSibling)) != NULL)
+		{
+			return pTask;
+		}
+	}
+
+	return NULL;
+}
+
+static bool dio_group_empty(struct storage_dio_context *pContext)
+{
+	struct storage_dio_context *pSibling;
+	struct storage_dio_context *pEnd;
+
+	pEnd = pContext->group + pContext->group_count;
+	for (pSibling=pContext->group; pSibling<pEnd; pSibling++)
+	{
+		if (!dio_queue_empty(pSibling))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static void dio_thread_park(struct storage_dio_context *pContext)
+{
+	int result;
+
+	pthread_mutex_lock(&(pContext->lock));
+	__atomic_store_n(&(pContext->parked), 1, __ATOMIC_RELAXED);
+
+	/* the parked flag must be visible before checking the queues,
+	   pairs with the fence in storage_dio_queue_push */
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (g_continue_flag && dio_group_empty(pContext))
+	{
+		if ((result=pthread_cond_wait(&(pContext->cond), \
+			&(pContext->lock))) != 0)
+		{
+			logError("file: "__FILE__", line: %d, " \
+				"call pthread_cond_wait fail, " \
+				"errno: %d, error info: %s", \
+				__LINE__, result, STRERROR(result));
+		}
+	}
+	__atomic_store_n(&(pContext->parked), 0, __ATOMIC_RELAXED);
+	pthread_mutex_unlock(&(pContext->lock));
+}
+
+static void dio_thread_unpark(struct storage_dio_context *pContext)
+{
+	int result;
+
+	pthread_mutex_lock(&(pContext->lock));
+	if ((result=pthread_cond_signal(&(pContext->cond))) != 0)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"pthread_cond_signal fail, " \
+			"errno: %d, error info: %s", \
+			__LINE__, result, STRERROR(result));
+	}
+	pthread_mutex_unlock(&(pContext->lock));
+}
+
+static void dio_wakeup_idle_sibling(struct storage_dio_context *pContext)
+{
+	struct storage_dio_context *pSibling;
+	int self;
+	int i;
+
+	self = pContext - pContext->group;
+	for (i=1; i<pContext->group_count; i++)
+	{
+		pSibling = pContext->group + (self + i) % pContext->group_count;
+		if (__atomic_load_n(&(pSibling->parked), __ATOMIC_RELAXED))
+		{
+			dio_thread_unpark(pSibling);
+			return;
+		}
+	}
+}
+
 int storage_dio_init()
 {
 	int result;
 	int bytes;
 	int threads_count_per_path;
 	int context_count;
+	int queue_capacity;
 	struct storage_dio_thread_data *pThreadData;
 	struct storage_dio_thread_data *pDataEnd;
 	struct storage_dio_context *pContext;
@@ -61,6 +345,15 @@ int storage_dio_init()
 		return result;
 	}
 
+#ifdef WITH_IO_URING
+	if (g_disk_io_engine == STORAGE_DISK_IO_ENGINE_IO_URING)
+	{
+		result = storage_dio_uring_init(&thread_attr);
+		pthread_attr_destroy(&thread_attr);
+		return result;
+	}
+#endif
+
 	bytes = sizeof(struct storage_dio_thread_data) * g_fdfs_store_paths.count;
 	g_dio_thread_data = (struct storage_dio_thread_data *)malloc(bytes);
 	if (g_dio_thread_data == NULL)
@@ -85,6 +378,13 @@ int storage_dio_init()
 		return errno != 0 ? errno : ENOMEM;
 	}
 	memset(g_dio_contexts, 0, bytes);
+	g_dio_context_count = context_count;
+
+	queue_capacity = 2;
+	while (queue_capacity < g_max_connections)
+	{
+		queue_capacity *= 2;
+	}
 
 	g_dio_thread_count = 0;
 	pDataEnd = g_dio_thread_data + g_fdfs_store_paths.count;
@@ -100,11 +400,28 @@ int storage_dio_init()
 		for (pContext=pThreadData->contexts; pContext<pContextEnd; \
 			pContext++)
 		{
-			if ((result=task_queue_init(&(pContext->queue))) != 0)
+			if ((result=dio_queue_init(pContext, \
+					queue_capacity)) != 0)
 			{
 				return result;
 			}
 
+			if (!g_disk_rw_separated)
+			{
+				pContext->group = pThreadData->contexts;
+				pContext->group_count = pThreadData->count;
+			}
+			else if (pContext < pThreadData->writer)
+			{
+				pContext->group = pThreadData->reader;
+				pContext->group_count = g_disk_reader_threads;
+			}
+			else
+			{
+				pContext->group = pThreadData->writer;
+				pContext->group_count = g_disk_writer_threads;
+			}
+
 			if ((result=init_pthread_lock(&(pContext->lock))) != 0)
 			{
 				return result;
@@ -150,10 +467,28 @@ void storage_dio_terminate()
 	struct storage_dio_context *pContext;
 	struct storage_dio_context *pContextEnd;
 
-	pContextEnd = g_dio_contexts + g_dio_thread_count;
+#ifdef WITH_IO_URING
+	if (g_disk_io_engine == STORAGE_DISK_IO_ENGINE_IO_URING)
+	{
+		struct storage_uring_context *pURingContext;
+		struct storage_uring_context *pURingEnd;
+
+		pURingEnd = g_uring_contexts + g_fdfs_store_paths.count;
+		for (pURingContext=g_uring_contexts; pURingContext<pURingEnd; \
+			pURingContext++)
+		{
+			storage_uring_wakeup(pURingContext);
+		}
+		return;
+	}
+#endif
+
+	pContextEnd = g_dio_contexts + g_dio_context_count;
 	for (pContext=g_dio_contexts; pContext<pContextEnd; pContext++)
 	{
+		pthread_mutex_lock(&(pContext->lock));
 		pthread_cond_signal(&(pContext->cond));
+		pthread_mutex_unlock(&(pContext->lock));
 	}
 }
 
@@ -166,26 +501,45 @@ int storage_dio_queue_push(struct fast_task_info *pTask)
 
         pClientInfo = (StorageClientInfo *)pTask->arg;
 	pFileContext = &(pClientInfo->file_context);
-	pContext = g_dio_contexts + pFileContext->dio_thread_index;
-
 	pClientInfo->stage |= FDFS_STORAGE_STAGE_DIO_THREAD;
-	if ((result=task_queue_push(&(pContext->queue), pTask)) != 0)
+
+#ifdef WITH_IO_URING
+	if (g_disk_io_engine == STORAGE_DISK_IO_ENGINE_IO_URING)
 	{
-		add_to_deleted_list(pTask);
+		if ((result=storage_uring_queue_push(g_uring_contexts + \
+			pFileContext->dio_thread_index, pTask)) != 0)
+		{
+			add_to_deleted_list(pTask);
+		}
 		return result;
 	}
+#endif
 
-	if ((result=pthread_cond_signal(&(pContext->cond))) != 0)
+	pContext = g_dio_contexts + pFileContext->dio_thread_index;
+	if ((result=dio_queue_push(pContext, pTask)) != 0)
 	{
 		logError("file: "__FILE__", line: %d, " \
-			"pthread_cond_signal fail, " \
-			"errno: %d, error info: %s", \
-			__LINE__, result, STRERROR(result));
-
+			"dio queue of thread #%d is full, " \
+			"errno: %d, error info: %s", __LINE__, \
+			pFileContext->dio_thread_index, \
+			result, STRERROR(result));
 		add_to_deleted_list(pTask);
 		return result;
 	}
 
+	/* the push must be visible before checking the parked flag,
+	   pairs with the fence in dio_thread_park */
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&(pContext->parked), __ATOMIC_RELAXED))
+	{
+		dio_thread_unpark(pContext);
+	}
+	else
+	{
+		/* the owner is busy, wake up an idle sibling to steal it */
+		dio_wakeup_idle_sibling(pContext);
+	}
+
 	return 0;
 }
 
@@ -200,6 +554,13 @@ int storage_dio_get_thread_index(struct fast_task_info *pTask, \
 
 	pClientInfo = (StorageClientInfo *)pTask->arg;
 
+#ifdef WITH_IO_URING
+	if (g_disk_io_engine == STORAGE_DISK_IO_ENGINE_IO_URING)
+	{
+		return store_path_index;
+	}
+#endif
+
 	pThreadData = g_dio_thread_data + store_path_index;
 	if (g_disk_rw_separated)
 	{
@@ -280,6 +641,18 @@ int dio_discard_file(struct fast_task_info *pTask)
 	return 0;
 }
 
+void dio_stat_file_open(const int result)
+{
+	StorageStatShard *pStatShard;
+
+	pStatShard = STORAGE_STAT_SHARD();
+	pStatShard->stat.total_file_open_count++;
+	if (result == 0)
+	{
+		pStatShard->stat.success_file_open_count++;
+	}
+}
+
 int dio_open_file(StorageFileContext *pFileContext)
 {
 	int result;
@@ -305,63 +678,57 @@ int dio_open_file(StorageFileContext *pFileContext)
 		result = 0;
 	}
 
-	pthread_mutex_lock(&g_dio_thread_lock);
-	g_storage_stat.total_file_open_count++;
-	if (result == 0)
-	{
-		g_storage_stat.success_file_open_count++;
-	}
-	pthread_mutex_unlock(&g_dio_thread_lock);
+	dio_stat_file_open(result);
+	return result;
+}
 
-	if (result != 0)
-	{
-		return result;
-	}
+void dio_close_file(StorageFileContext *pFileContext)
+{
+	trunk_fd_cache_close(pFileContext->fd);
+	pFileContext->fd = -1;
+}
 
-	if (pFileContext->offset > 0 && lseek(pFileContext->fd, \
-		pFileContext->offset, SEEK_SET) < 0)
-	{
-		result = errno != 0 ? errno : EIO;
-		logError("file: "__FILE__", line: %d, " \
-			"lseek file: %s fail, " \
-			"errno: %d, error info: %s", \
-			__LINE__, pFileContext->filename, \
-			result, STRERROR(result));
-		return result;
-	}
+int dio_get_read_bytes(struct fast_task_info *pTask)
+{
+	StorageFileContext *pFileContext;
+	int64_t remain_bytes;
+	int capacity_bytes;
 
-	return 0;
+	pFileContext = &(((StorageClientInfo *)pTask->arg)->file_context);
+	remain_bytes = pFileContext->end - pFileContext->offset;
+	capacity_bytes = pTask->size - pTask->length;
+	return (capacity_bytes < remain_bytes) ? capacity_bytes : remain_bytes;
 }
 
 int dio_read_file(struct fast_task_info *pTask)
 {
 	StorageFileContext *pFileContext;
 	int result;
-	int64_t remain_bytes;
-	int capacity_bytes;
 	int read_bytes;
 
 	pFileContext = &(((StorageClientInfo *)pTask->arg)->file_context);
 
-	do
-	{
 	if ((result=dio_open_file(pFileContext)) != 0)
 	{
-		break;
+		/* file open error, close it */
+		if (pFileContext->fd > 0)
+		{
+			dio_close_file(pFileContext);
+		}
+
+		pFileContext->done_callback(pTask, result);
+		return result;
 	}
 
-	remain_bytes = pFileContext->end - pFileContext->offset;
-	capacity_bytes = pTask->size - pTask->length;
-	read_bytes = (capacity_bytes < remain_bytes) ? \
-				capacity_bytes : remain_bytes;
+	read_bytes = dio_get_read_bytes(pTask);
 
 	/*
 	logInfo("###before dio read bytes: %d, pTask->length=%d, file offset=%ld", \
 		read_bytes, pTask->length, pFileContext->offset);
 	*/
 
-	if (read(pFileContext->fd, pTask->data + pTask->length, \
-		read_bytes) != read_bytes)
+	if (pread(pFileContext->fd, pTask->data + pTask->length, \
+		read_bytes, pFileContext->offset) != read_bytes)
 	{
 		result = errno != 0 ? errno : EIO;
 		logError("file: "__FILE__", line: %d, " \
@@ -371,17 +738,59 @@ int dio_read_file(struct fast_task_info *pTask)
 			result, STRERROR(result));
 	}
 
-	pthread_mutex_lock(&g_dio_thread_lock);
-	g_storage_stat.total_file_read_count++;
-	if (result == 0)
+	return dio_read_file_complete(pTask, result, read_bytes);
+}
+
+/* the blocking open is done in the dio thread, the nio thread sends the
+   header and the file content by sendfile after notified */
+int dio_open_for_sendfile(struct fast_task_info *pTask)
+{
+	StorageFileContext *pFileContext;
+	int result;
+
+	pFileContext = &(((StorageClientInfo *)pTask->arg)->file_context);
+	if ((result=dio_open_file(pFileContext)) != 0)
 	{
-		g_storage_stat.success_file_read_count++;
+		if (pFileContext->fd > 0)
+		{
+			dio_close_file(pFileContext);
+		}
+
+		/* nothing sent, the done callback responds the error */
+		pFileContext->use_sendfile = false;
+		pFileContext->done_callback(pTask, result);
+		return result;
 	}
-	pthread_mutex_unlock(&g_dio_thread_lock);
 
-	if (result != 0)
+	storage_nio_notify(pTask);  //notify nio to send the file
+	return 0;
+}
+
+int dio_read_file_complete(struct fast_task_info *pTask, \
+		const int err_no, const int read_bytes)
+{
+	StorageFileContext *pFileContext;
+	StorageStatShard *pStatShard;
+
+	pFileContext = &(((StorageClientInfo *)pTask->arg)->file_context);
+
+	pStatShard = STORAGE_STAT_SHARD();
+	pStatShard->stat.total_file_read_count++;
+	if (err_no == 0)
 	{
-		break;
+		pStatShard->stat.success_file_read_count++;
+	}
+
+	if (err_no != 0)
+	{
+		/* file read error, close it */
+		if (pFileContext->fd > 0)
+		{
+			dio_close_file(pFileContext);
+		}
+
+		pFileContext->done_callback(pTask, err_no);
+		return err_no;
 	}
 
 	pTask->length += read_bytes;
@@ -399,26 +808,194 @@ int dio_read_file(struct fast_task_info *pTask)
 	else
 	{
 		/* file read done, close it */
-		close(pFileContext->fd);
-		pFileContext->fd = -1;
+		dio_close_file(pFileContext);
+
+		pFileContext->done_callback(pTask, err_no);
+	}
+
+	return 0;
+}
+
+/* fill the task buffer with the frames of the batch download entries
+   in the sorted order, the fd is kept when the next entry is in the
+   same file (such as the same trunk file) */
+int dio_read_files_batch(struct fast_task_info *pTask)
+{
+	StorageFileContext *pFileContext;
+	StorageBatchDownloadInfo *pBatch;
+	StorageBatchDownloadEntry *pEntry;
+	StorageStatShard *pStatShard;
+	char *p;
+	int64_t remain_bytes;
+	int read_bytes;
+	int result;
+
+	pFileContext = &(((StorageClientInfo *)pTask->arg)->file_context);
+	pBatch = &(pFileContext->batch);
+	result = 0;
+	while (pBatch->current < pBatch->count)
+	{
+		pEntry = pBatch->entries + pBatch->current;
+		if (!pBatch->frame_done)
+		{
+			if (pTask->size - pTask->length < \
+				STORAGE_PROTO_BATCH_DOWNLOAD_FRAME_SIZE)
+			{
+				break;
+			}
+
+			if (pEntry->status == 0 && pEntry->bytes > 0)
+			{
+				if (pFileContext->fd >= 0 && strcmp( \
+					pFileContext->filename, \
+					pEntry->filename) != 0)
+				{
+					dio_close_file(pFileContext);
+				}
+
+				pFileContext->offset = 0;
+				strcpy(pFileContext->filename, pEntry->filename);
+				if ((result=dio_open_file(pFileContext)) != 0)
+				{
+					/* the file is deleted after stat, the
+					   content bytes are sent as padding */
+					pEntry->status = result;
+					result = 0;
+				}
+			}
+
+			p = pTask->data + pTask->length;
+			int2buff(pEntry->index, p);
+			p += 4;
+			*p++ = pEntry->status;
+			long2buff(pEntry->bytes, p);
+			pTask->length += STORAGE_PROTO_BATCH_DOWNLOAD_FRAME_SIZE;
+			pBatch->frame_done = true;
+
+			pFileContext->offset = pEntry->offset;
+			pFileContext->end = pEntry->offset + pEntry->bytes;
+		}
+
+		remain_bytes = pFileContext->end - pFileContext->offset;
+		if (remain_bytes > 0)
+		{
+			read_bytes = pTask->size - pTask->length;
+			if (read_bytes == 0)
+			{
+				break;
+			}
+			if (read_bytes > remain_bytes)
+			{
+				read_bytes = remain_bytes;
+			}
+
+			if (pEntry->status != 0)
+			{
+				memset(pTask->data + pTask->length, 0, read_bytes);
+			}
+			else
+			{
+				pStatShard = STORAGE_STAT_SHARD();
+				pStatShard->stat.total_file_read_count++;
+				if (pread(pFileContext->fd, pTask->data + \
+					pTask->length, read_bytes, \
+					pFileContext->offset) != read_bytes)
+				{
+					result = errno != 0 ? errno : EIO;
+					logError("file: "__FILE__", line: %d, " \
+						"read from file: %s fail, " \
+						"errno: %d, error info: %s", \
+						__LINE__, pFileContext->filename, \
+						result, STRERROR(result));
+					break;
+				}
+				pStatShard->stat.success_file_read_count++;
+			}
+
+			pTask->length += read_bytes;
+			pFileContext->offset += read_bytes;
+			if (pFileContext->offset < pFileContext->end)
+			{
+				break;  //the buffer is full
+			}
+		}
+
+		pBatch->current++;
+		pBatch->frame_done = false;
+	}
+
+	if (result != 0 || pBatch->current == pBatch->count)
+	{
+		if (pFileContext->fd >= 0)
+		{
+			dio_close_file(pFileContext);
+		}
 
 		pFileContext->done_callback(pTask, result);
+		return result;
 	}
 
+	storage_nio_notify(pTask);  //notify nio to send the buffer
 	return 0;
+}
 
-	} while (0);
+#if defined(OS_LINUX)
+/* write the bytes spliced from the socket to the pipe by the nio thread */
+static int dio_splice_file(struct fast_task_info *pTask)
+{
+	StorageFileContext *pFileContext;
+	int result;
+	int write_bytes;
+	int written;
+	loff_t offset;
+	loff_t end;
 
-	/* file read error, close it */
-	if (pFileContext->fd > 0)
+	pFileContext = &(((StorageClientInfo *)pTask->arg)->file_context);
+	write_bytes = pFileContext->splice_bytes;
+	offset = pFileContext->offset;
+	end = pFileContext->offset + write_bytes;
+	result = 0;
+	while (offset < end)
 	{
-		close(pFileContext->fd);
-		pFileContext->fd = -1;
+		written = splice(pFileContext->splice_pipe_fds[0], NULL, \
+				pFileContext->fd, &offset, end - offset, \
+				SPLICE_F_MOVE);
+		if (written <= 0)
+		{
+			result = written < 0 && errno != 0 ? errno : EIO;
+			logError("file: "__FILE__", line: %d, " \
+				"splice to file: %s fail, fd=%d, " \
+				"errno: %d, error info: %s", \
+				__LINE__, pFileContext->filename, \
+				pFileContext->fd, result, STRERROR(result));
+			break;
+		}
 	}
+	pFileContext->splice_bytes = 0;
 
-	pFileContext->done_callback(pTask, result);
-	return result;
+	if (result == 0 && dio_need_fsync(pFileContext, write_bytes))
+	{
+		if (fsync(pFileContext->fd) != 0)
+		{
+			result = errno != 0 ? errno : EIO;
+			logError("file: "__FILE__", line: %d, " \
+				"fsync file: %s fail, " \
+				"errno: %d, error info: %s", \
+				__LINE__, pFileContext->filename, \
+				result, STRERROR(result));
+		}
+	}
+
+	/* the bytes left in the pipe are discarded when fail */
+	if (result != 0 || end >= pFileContext->end)
+	{
+		storage_splice_pipe_close(pFileContext);
+		pFileContext->use_splice = false;
+	}
+
+	return dio_write_file_complete(pTask, result, write_bytes);
 }
+#endif
 
 int dio_write_file(struct fast_task_info *pTask)
 {
@@ -431,29 +1008,41 @@ int dio_write_file(struct fast_task_info *pTask)
 	pClientInfo = (StorageClientInfo *)pTask->arg;
 	pFileContext = &(pClientInfo->file_context);
 	result = 0;
-	do
-	{
 	if (pFileContext->fd < 0)
 	{
 		if (pFileContext->extra_info.upload.before_open_callback!=NULL)
 		{
 			result = pFileContext->extra_info.upload. \
 					before_open_callback(pTask);
-			if (result != 0)
-			{
-				break;
-			}
 		}
 
-		if ((result=dio_open_file(pFileContext)) != 0)
+		if (result == 0)
 		{
-			break;
+			result = dio_open_file(pFileContext);
+		}
+
+		if (result != 0)
+		{
+			pClientInfo->clean_func(pTask);
+			if (pFileContext->done_callback != NULL)
+			{
+				pFileContext->done_callback(pTask, result);
+			}
+			return result;
 		}
 	}
 
+#if defined(OS_LINUX)
+	if (pFileContext->splice_bytes > 0)
+	{
+		return dio_splice_file(pTask);
+	}
+#endif
+
 	pDataBuff = pTask->data + pFileContext->buff_offset;
 	write_bytes = pTask->length - pFileContext->buff_offset;
-	if (write(pFileContext->fd, pDataBuff, write_bytes) != write_bytes)
+	if (pwrite(pFileContext->fd, pDataBuff, write_bytes, \
+		pFileContext->offset) != write_bytes)
 	{
 		result = errno != 0 ? errno : EIO;
 		logError("file: "__FILE__", line: %d, " \
@@ -464,19 +1053,62 @@ int dio_write_file(struct fast_task_info *pTask)
 			result, STRERROR(result));
 	}
 
-	pthread_mutex_lock(&g_dio_thread_lock);
-	g_storage_stat.total_file_write_count++;
-	if (result == 0)
+	else if (dio_need_fsync(pFileContext, write_bytes))
 	{
-		g_storage_stat.success_file_write_count++;
+		if (fsync(pFileContext->fd) != 0)
+		{
+			result = errno != 0 ? errno : EIO;
+			logError("file: "__FILE__", line: %d, " \
+				"fsync file: %s fail, " \
+				"errno: %d, error info: %s", \
+				__LINE__, pFileContext->filename, \
+				result, STRERROR(result));
+		}
 	}
-	pthread_mutex_unlock(&g_dio_thread_lock);
 
-	if (result != 0)
+	return dio_write_file_complete(pTask, result, write_bytes);
+}
+
+/* fsync when the last block of a big file written */
+bool dio_need_fsync(StorageFileContext *pFileContext, const int write_bytes)
+{
+	return g_fsync_after_written_bytes > 0 && \
+		pFileContext->offset + write_bytes >= pFileContext->end && \
+		pFileContext->end - pFileContext->start >= \
+		g_fsync_after_written_bytes;
+}
+
+int dio_write_file_complete(struct fast_task_info *pTask, \
+		const int err_no, const int write_bytes)
+{
+	StorageClientInfo *pClientInfo;
+	StorageFileContext *pFileContext;
+	StorageStatShard *pStatShard;
+	char *pDataBuff;
+	int result;
+
+	pClientInfo = (StorageClientInfo *)pTask->arg;
+	pFileContext = &(pClientInfo->file_context);
+
+	pStatShard = STORAGE_STAT_SHARD();
+	pStatShard->stat.total_file_write_count++;
+	if (err_no == 0)
 	{
-		break;
+		pStatShard->stat.success_file_write_count++;
 	}
 
+	if (err_no != 0)
+	{
+		pClientInfo->clean_func(pTask);
+
+		if (pFileContext->done_callback != NULL)
+		{
+			pFileContext->done_callback(pTask, err_no);
+		}
+		return err_no;
+	}
+
+	pDataBuff = pTask->data + pFileContext->buff_offset;
 	if (pFileContext->calc_crc32)
 	{
 		pFileContext->crc32 = CRC32_ex(pDataBuff, write_bytes, \
@@ -507,54 +1139,44 @@ int dio_write_file(struct fast_task_info *pTask)
 	{
 		pFileContext->buff_offset = 0;
 		storage_nio_notify(pTask);  //notify nio to deal
+		return 0;
 	}
-	else
-	{
-		if (pFileContext->calc_crc32)
-		{
-			pFileContext->crc32 = CRC32_FINAL( \
-						pFileContext->crc32);
-		}
 
-		if (pFileContext->calc_file_hash)
-		{
-			if (g_file_signature_method == STORAGE_FILE_SIGNATURE_METHOD_HASH)
-			{
-				FINISH_HASH_CODES4(pFileContext->file_hash_codes)
-			}
-			else
-			{
-				my_md5_final((unsigned char *)(pFileContext-> \
-				file_hash_codes), &pFileContext->md5_context);
-			}
-		}
+	if (pFileContext->calc_crc32)
+	{
+		pFileContext->crc32 = CRC32_FINAL( \
+					pFileContext->crc32);
+	}
 
-		if (pFileContext->extra_info.upload.before_close_callback != NULL)
+	if (pFileContext->calc_file_hash)
+	{
+		if (g_file_signature_method == STORAGE_FILE_SIGNATURE_METHOD_HASH)
 		{
-			result = pFileContext->extra_info.upload. \
-					before_close_callback(pTask);
+			FINISH_HASH_CODES4(pFileContext->file_hash_codes)
 		}
-
-		/* file write done, close it */
-		close(pFileContext->fd);
-		pFileContext->fd = -1;
-
-		if (pFileContext->done_callback != NULL)
+		else
 		{
-			pFileContext->done_callback(pTask, result);
+			my_md5_final((unsigned char *)(pFileContext-> \
+			file_hash_codes), &pFileContext->md5_context);
 		}
 	}
 
-	return 0;
-	} while (0);
+	result = 0;
+	if (pFileContext->extra_info.upload.before_close_callback != NULL)
+	{
+		result = pFileContext->extra_info.upload. \
+				before_close_callback(pTask);
+	}
 
-	pClientInfo->clean_func(pTask);
+	/* file write done, close it */
+	dio_close_file(pFileContext);
 
 	if (pFileContext->done_callback != NULL)
 	{
 		pFileContext->done_callback(pTask, result);
 	}
-	return result;
+
+	return 0;
 }
 
 int dio_truncate_file(struct fast_task_info *pTask)
@@ -606,8 +1228,7 @@ int dio_truncate_file(struct fast_task_info *pTask)
 	}
 
 	/* file write done, close it */
-	close(pFileContext->fd);
-	pFileContext->fd = -1;
+	dio_close_file(pFileContext);
 
 	if (pFileContext->done_callback != NULL)
 	{
@@ -633,8 +1254,24 @@ void dio_read_finish_clean_up(struct fast_task_info *pTask)
 	pFileContext = &(((StorageClientInfo *)pTask->arg)->file_context);
 	if (pFileContext->fd > 0)
 	{
-		close(pFileContext->fd);
-		pFileContext->fd = -1;
+		dio_close_file(pFileContext);
+	}
+}
+
+void dio_read_batch_finish_clean_up(struct fast_task_info *pTask)
+{
+	StorageFileContext *pFileContext;
+
+	pFileContext = &(((StorageClientInfo *)pTask->arg)->file_context);
+	if (pFileContext->fd >= 0)
+	{
+		dio_close_file(pFileContext);
+	}
+
+	if (pFileContext->batch.entries != NULL)
+	{
+		free(pFileContext->batch.entries);
+		pFileContext->batch.entries = NULL;
 	}
 }
 
@@ -645,8 +1282,7 @@ void dio_write_finish_clean_up(struct fast_task_info *pTask)
 	pFileContext = &(((StorageClientInfo *)pTask->arg)->file_context);
 	if (pFileContext->fd > 0)
 	{
-		close(pFileContext->fd);
-		pFileContext->fd = -1;
+		dio_close_file(pFileContext);
 
 		/* if file does not write to the end, delete it */
 		if (pFileContext->offset < pFileContext->end)
@@ -700,8 +1336,7 @@ void dio_append_finish_clean_up(struct fast_task_info *pTask)
 			}
 		}
 
-		close(pFileContext->fd);
-		pFileContext->fd = -1;
+		dio_close_file(pFileContext);
 	}
 }
 
@@ -723,21 +1358,23 @@ void dio_modify_finish_clean_up(struct fast_task_info *pTask)
 				pFileContext->filename);
 		}
 
-		close(pFileContext->fd);
-		pFileContext->fd = -1;
+		dio_close_file(pFileContext);
 	}
 }
 
 void dio_trunk_write_finish_clean_up(struct fast_task_info *pTask)
 {
+	StorageClientInfo *pClientInfo;
 	StorageFileContext *pFileContext;
+	FDFSTrunkFullInfo *pTrunkInfo;
 	int result;
 
-	pFileContext = &(((StorageClientInfo *)pTask->arg)->file_context);
+	pClientInfo = (StorageClientInfo *)pTask->arg;
+	pFileContext = &(pClientInfo->file_context);
+	pTrunkInfo = &(pFileContext->extra_info.upload.trunk_info);
 	if (pFileContext->fd > 0)
 	{
-		close(pFileContext->fd);
-		pFileContext->fd = -1;
+		dio_close_file(pFileContext);
 
 		/* if file does not write to the end, 
                    delete the appended contents 
@@ -746,8 +1383,19 @@ void dio_trunk_write_finish_clean_up(struct fast_task_info *pTask)
 		    pFileContext->offset < pFileContext->end)
 		{
 			if ((result=trunk_file_delete(pFileContext->filename, \
-			&(pFileContext->extra_info.upload.trunk_info))) != 0)
+				pTrunkInfo)) != 0)
+			{
+			}
+
+			/* the upload is broken by the disconnection, no done
+			   callback to give back the space carved from the
+			   lease, the dio errors are dealt by the callback */
+			if (pClientInfo->canceled && pTrunkInfo->status == \
+				FDFS_TRUNK_STATUS_LEASED)
 			{
+				trunk_client_trunk_free_space_async(pTask, \
+						pTrunkInfo);
+				trunk_client_request_submit(pTask);
 			}
 		}
 	}
@@ -755,30 +1403,29 @@ void dio_trunk_write_finish_clean_up(struct fast_task_info *pTask)
 
 static void *dio_thread_entrance(void* arg) 
 {
-	int result;
 	struct storage_dio_context *pContext; 
 	struct fast_task_info *pTask;
 
 	pContext = (struct storage_dio_context *)arg; 
-
-	pthread_mutex_lock(&(pContext->lock));
 	while (g_continue_flag)
 	{
-		if ((result=pthread_cond_wait(&(pContext->cond), \
-			&(pContext->lock))) != 0)
+		if ((pTask=dio_queue_pop(pContext)) == NULL && \
+			(pTask=dio_steal_task(pContext)) == NULL)
 		{
-		logError("file: "__FILE__", line: %d, " \
-			"call pthread_cond_wait fail, " \
-			"errno: %d, error info: %s", \
-			__LINE__, result, STRERROR(result));
+			dio_thread_park(pContext);
+			continue;
 		}
 
-		while ((pTask=task_queue_pop(&(pContext->queue))) != NULL)
-		{
-			((StorageClientInfo *)pTask->arg)->deal_func(pTask);
-		}
+		((StorageClientInfo *)pTask->arg)->deal_func(pTask);
 	}
-	pthread_mutex_unlock(&(pContext->lock));
+
+	dio_thread_exit();
+	return NULL;
+}
+
+static void dio_thread_exit()
+{
+	int result;
 
 	if ((result=pthread_mutex_lock(&g_dio_thread_lock)) != 0)
 	{
@@ -799,34 +1446,49 @@ static void *dio_thread_entrance(void* arg)
 	logDebug("file: "__FILE__", line: %d, " \
 		"dio thread exited, thread count: %d", \
 		__LINE__, g_dio_thread_count);
-
-	return NULL;
 }
 
-int dio_check_trunk_file_when_upload(struct fast_task_info *pTask)
+/* open the trunk file by the fd cache, the trunk file is checked
+   (created when not exists) only when its fd is not cached */
+static int dio_open_trunk_file(StorageFileContext *pFileContext)
 {
+	FDFSTrunkFullInfo *pTrunkInfo;
 	int result;
-	StorageFileContext *pFileContext;
 
-	pFileContext = &(((StorageClientInfo *)pTask->arg)->file_context);
-	if ((result=trunk_check_and_init_file(pFileContext->filename)) != 0)
+	pTrunkInfo = &(pFileContext->extra_info.upload.trunk_info);
+	if (!trunk_fd_cache_exists(pTrunkInfo))
 	{
-		return result;
-	}
-
-	if ((result=dio_open_file(pFileContext)) != 0)
-	{
-		return result;
+		if ((result=trunk_check_and_init_file( \
+				pFileContext->filename)) != 0)
+		{
+			return result;
+		}
 	}
 
-	if (lseek(pFileContext->fd, -FDFS_TRUNK_FILE_HEADER_SIZE, SEEK_CUR) < 0)
+	result = trunk_fd_cache_open(pTrunkInfo, pFileContext->filename, \
+			&pFileContext->fd);
+	if (result != 0)
 	{
-		result = errno != 0 ? errno : EIO;
 		logError("file: "__FILE__", line: %d, " \
-			"lseek file: %s fail, " \
+			"open file: %s fail, " \
 			"errno: %d, error info: %s", \
 			__LINE__, pFileContext->filename, \
 			result, STRERROR(result));
+		pFileContext->fd = -1;
+	}
+
+	dio_stat_file_open(result);
+	return result;
+}
+
+int dio_check_trunk_file_when_upload(struct fast_task_info *pTask)
+{
+	int result;
+	StorageFileContext *pFileContext;
+
+	pFileContext = &(((StorageClientInfo *)pTask->arg)->file_context);
+	if ((result=dio_open_trunk_file(pFileContext)) != 0)
+	{
 		return result;
 	}
 
@@ -839,7 +1501,7 @@ int dio_check_trunk_file_when_sync(struct fast_task_info *pTask)
 	StorageFileContext *pFileContext;
 
 	pFileContext = &(((StorageClientInfo *)pTask->arg)->file_context);
-	return trunk_check_and_init_file(pFileContext->filename);
+	return dio_open_trunk_file(pFileContext);
 }
 
 int dio_check_trunk_file_ex(int fd, const char *filename, const int64_t offset)
@@ -848,7 +1510,7 @@ int dio_check_trunk_file_ex(int fd, const char *filename, const int64_t offset)
 	char old_header[FDFS_TRUNK_FILE_HEADER_SIZE];
 	char expect_header[FDFS_TRUNK_FILE_HEADER_SIZE];
 
-	if (read(fd, old_header, FDFS_TRUNK_FILE_HEADER_SIZE) != 
+	if (pread(fd, old_header, FDFS_TRUNK_FILE_HEADER_SIZE, offset) != \
 		FDFS_TRUNK_FILE_HEADER_SIZE)
 	{
 		result = errno != 0 ? errno : EIO;
@@ -919,18 +1581,6 @@ int dio_write_chunk_header(struct fast_task_info *pTask)
 		sizeof(trunkHeader.formatted_ext_name), "%s", \
 		pFileContext->extra_info.upload.formatted_ext_name);
 
-	if (lseek(pFileContext->fd, pFileContext->start - \
-		FDFS_TRUNK_FILE_HEADER_SIZE, SEEK_SET) < 0)
-	{
-		result = errno != 0 ? errno : EIO;
-		logError("file: "__FILE__", line: %d, " \
-			"lseek file: %s fail, " \
-			"errno: %d, error info: %s", \
-			__LINE__, pFileContext->filename, \
-			result, STRERROR(result));
-		return result;
-	}
-
 	trunk_pack_header(&trunkHeader, header);
 	/*
 	{
@@ -944,7 +1594,8 @@ int dio_write_chunk_header(struct fast_task_info *pTask)
 	}
 	*/
 
-	if (write(pFileContext->fd, header, FDFS_TRUNK_FILE_HEADER_SIZE) != \
+	if (pwrite(pFileContext->fd, header, FDFS_TRUNK_FILE_HEADER_SIZE, \
+		pFileContext->start - FDFS_TRUNK_FILE_HEADER_SIZE) != \
 		FDFS_TRUNK_FILE_HEADER_SIZE)
 	{
 		result = errno != 0 ? errno : EIO;
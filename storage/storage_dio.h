@@ -17,11 +17,37 @@
 #include <pthread.h>
 #include "tracker_types.h"
 #include "fast_task_queue.h"
+#include "storage_nio.h"
 
+#define STORAGE_DIO_CACHE_LINE_SIZE  64
+
+/* bounded lock-free queue cell */
+struct storage_dio_queue_cell
+{
+	unsigned int sequence;
+	struct fast_task_info *pTask;
+};
+
+/* one dio thread, the tasks are pushed by the nio threads to its queue
+   and popped by itself, or stolen by the idle threads of the same group.
+   a task is in one queue at most, so the file ops of a task are in order */
 struct storage_dio_context
 {
-	struct fast_task_queue queue;
-	pthread_mutex_t lock;
+	struct storage_dio_queue_cell *cells;
+	unsigned int mask;   //queue capacity - 1
+	char pad1[STORAGE_DIO_CACHE_LINE_SIZE];
+	unsigned int enqueue_pos;
+	char pad2[STORAGE_DIO_CACHE_LINE_SIZE];
+	unsigned int dequeue_pos;
+	char pad3[STORAGE_DIO_CACHE_LINE_SIZE];
+
+	/* the threads of the same store path (and same read / write role
+	   when disk_rw_separated) to steal from */
+	struct storage_dio_context *group;
+	int group_count;
+
+	int parked;    //if the thread is parked (sleeping)
+	pthread_mutex_t lock;  //only for park and unpark
 	pthread_cond_t cond;
 };
 
@@ -49,14 +75,33 @@ int storage_dio_get_thread_index(struct fast_task_info *pTask, \
 		const int store_path_index, const char file_op);
 int storage_dio_queue_push(struct fast_task_info *pTask);
 
+void dio_stat_file_open(const int result);
+int dio_open_file(StorageFileContext *pFileContext);
+
+/* close the fd, the fd of the trunk file is released to the fd cache */
+void dio_close_file(StorageFileContext *pFileContext);
 int dio_read_file(struct fast_task_info *pTask);
+
+/* open the file to download by sendfile, then the nio thread sends */
+int dio_open_for_sendfile(struct fast_task_info *pTask);
+int dio_read_files_batch(struct fast_task_info *pTask);
 int dio_write_file(struct fast_task_info *pTask);
+
+/* the second half of dio_read_file / dio_write_file, shared by the dio engines
+   after the read / write done */
+int dio_get_read_bytes(struct fast_task_info *pTask);
+int dio_read_file_complete(struct fast_task_info *pTask, \
+		const int err_no, const int read_bytes);
+bool dio_need_fsync(StorageFileContext *pFileContext, const int write_bytes);
+int dio_write_file_complete(struct fast_task_info *pTask, \
+		const int err_no, const int write_bytes);
 int dio_truncate_file(struct fast_task_info *pTask);
 int dio_delete_normal_file(struct fast_task_info *pTask);
 int dio_delete_trunk_file(struct fast_task_info *pTask);
 int dio_discard_file(struct fast_task_info *pTask);
 
 void dio_read_finish_clean_up(struct fast_task_info *pTask);
+void dio_read_batch_finish_clean_up(struct fast_task_info *pTask);
 void dio_write_finish_clean_up(struct fast_task_info *pTask);
 void dio_append_finish_clean_up(struct fast_task_info *pTask);
 void dio_trunk_write_finish_clean_up(struct fast_task_info *pTask);
@@ -0,0 +1,815 @@
+/**
+* Copyright (C) 2008 Happy Fish / YuQing
+*
+* FastDFS may be copied only under the terms of the GNU General
+* Public License V3, which may be found in the FastDFS source kit.
+* Please visit the FastDFS Home Page http://www.csource.org/ for more detail.
+**/
+
+//storage_dio_uring.c, the io_uring disk io engine
+
+#ifdef WITH_IO_URING
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/eventfd.h>
+#include "shared_func.h"
+#include "logger.h"
+#include "storage_global.h"
+#include "storage_nio.h"
+#include "storage_dio.h"
+#include "storage_dio_uring.h"
+
+/* the pending op is stored in the low bits of the sqe user_data,
+   task address is 8 bytes aligned */
+#define URING_OP_NOTIFY  0
+#define URING_OP_OPEN    1
+#define URING_OP_READ    2
+#define URING_OP_WRITE   3
+#define URING_OP_FSYNC   4
+#define URING_OP_UNLINK  5
+#define URING_OP_MASK    7
+
+#define URING_USER_DATA(pTask, op)  ((__u64)(long)(pTask) | (op))
+#define URING_USER_TASK(user_data) \
+	((struct fast_task_info *)(long)((user_data) & ~(__u64)URING_OP_MASK))
+#define URING_USER_OP(user_data)   ((int)((user_data) & URING_OP_MASK))
+
+static int uring_setup(unsigned entries, struct io_uring_params *p)
+{
+	return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int uring_enter(int ring_fd, unsigned to_submit, \
+		unsigned min_complete, unsigned flags)
+{
+	return syscall(__NR_io_uring_enter, ring_fd, to_submit, \
+			min_complete, flags, NULL, 0);
+}
+
+static int uring_register(int ring_fd, unsigned opcode, \
+		void *arg, unsigned nr_args)
+{
+	return syscall(__NR_io_uring_register, ring_fd, opcode, arg, nr_args);
+}
+
+static int uring_probe_ops(StorageURing *ring)
+{
+	struct io_uring_probe *probe;
+	int bytes;
+	int result;
+
+	bytes = sizeof(struct io_uring_probe) + \
+		IORING_OP_LAST * sizeof(struct io_uring_probe_op);
+	probe = (struct io_uring_probe *)malloc(bytes);
+	if (probe == NULL)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"malloc %d bytes fail, errno: %d, error info: %s", \
+			__LINE__, bytes, errno, STRERROR(errno));
+		return errno != 0 ? errno : ENOMEM;
+	}
+	memset(probe, 0, bytes);
+
+	if (uring_register(ring->ring_fd, IORING_REGISTER_PROBE, \
+		probe, IORING_OP_LAST) < 0)
+	{
+		result = errno != 0 ? errno : EOPNOTSUPP;
+		logError("file: "__FILE__", line: %d, " \
+			"io_uring probe fail, the kernel is too old, " \
+			"errno: %d, error info: %s", \
+			__LINE__, result, STRERROR(result));
+		free(probe);
+		return result;
+	}
+
+#define URING_OP_SUPPORTED(op) ((op) <= probe->last_op && \
+		(probe->ops[op].flags & IO_URING_OP_SUPPORTED))
+
+	if (!(URING_OP_SUPPORTED(IORING_OP_READ) && \
+		URING_OP_SUPPORTED(IORING_OP_WRITE) && \
+		URING_OP_SUPPORTED(IORING_OP_FSYNC)))
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"io_uring read / write not supported, " \
+			"the kernel is too old", __LINE__);
+		free(probe);
+		return EOPNOTSUPP;
+	}
+
+	ring->op_open_supported = URING_OP_SUPPORTED(IORING_OP_OPENAT);
+	ring->op_unlink_supported = URING_OP_SUPPORTED(IORING_OP_UNLINKAT);
+	free(probe);
+	return 0;
+}
+
+static int uring_queue_init(StorageURing *ring, const unsigned entries)
+{
+	struct io_uring_params params;
+	int result;
+
+	memset(ring, 0, sizeof(StorageURing));
+	memset(&params, 0, sizeof(params));
+	ring->ring_fd = uring_setup(entries, &params);
+	if (ring->ring_fd < 0)
+	{
+		result = errno != 0 ? errno : EOPNOTSUPP;
+		logError("file: "__FILE__", line: %d, " \
+			"io_uring_setup fail, entries: %u, " \
+			"errno: %d, error info: %s", \
+			__LINE__, entries, result, STRERROR(result));
+		return result;
+	}
+
+	ring->sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+	ring->cq_size = params.cq_off.cqes + params.cq_entries * \
+			sizeof(struct io_uring_cqe);
+	if (params.features & IORING_FEAT_SINGLE_MMAP)
+	{
+		if (ring->cq_size > ring->sq_size)
+		{
+			ring->sq_size = ring->cq_size;
+		}
+		ring->cq_size = ring->sq_size;
+	}
+
+	ring->sq_ptr = mmap(NULL, ring->sq_size, PROT_READ | PROT_WRITE, \
+			MAP_SHARED | MAP_POPULATE, ring->ring_fd, \
+			IORING_OFF_SQ_RING);
+	if (ring->sq_ptr == MAP_FAILED)
+	{
+		result = errno != 0 ? errno : ENOMEM;
+		logError("file: "__FILE__", line: %d, " \
+			"mmap io_uring sq ring fail, " \
+			"errno: %d, error info: %s", \
+			__LINE__, result, STRERROR(result));
+		close(ring->ring_fd);
+		return result;
+	}
+
+	if (params.features & IORING_FEAT_SINGLE_MMAP)
+	{
+		ring->cq_ptr = ring->sq_ptr;
+	}
+	else
+	{
+		ring->cq_ptr = mmap(NULL, ring->cq_size, \
+				PROT_READ | PROT_WRITE, \
+				MAP_SHARED | MAP_POPULATE, ring->ring_fd, \
+				IORING_OFF_CQ_RING);
+		if (ring->cq_ptr == MAP_FAILED)
+		{
+			result = errno != 0 ? errno : ENOMEM;
+			logError("file: "__FILE__", line: %d, " \
+				"mmap io_uring cq ring fail, " \
+				"errno: %d, error info: %s", \
+				__LINE__, result, STRERROR(result));
+			munmap(ring->sq_ptr, ring->sq_size);
+			close(ring->ring_fd);
+			return result;
+		}
+	}
+
+	ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+	ring->sqes = (struct io_uring_sqe *)mmap(NULL, ring->sqes_size, \
+			PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, \
+			ring->ring_fd, IORING_OFF_SQES);
+	if (ring->sqes == MAP_FAILED)
+	{
+		result = errno != 0 ? errno : ENOMEM;
+		logError("file: "__FILE__", line: %d, " \
+			"mmap io_uring sqes fail, " \
+			"errno: %d, error info: %s", \
+			__LINE__, result, STRERROR(result));
+		if (ring->cq_ptr != ring->sq_ptr)
+		{
+			munmap(ring->cq_ptr, ring->cq_size);
+		}
+		munmap(ring->sq_ptr, ring->sq_size);
+		close(ring->ring_fd);
+		return result;
+	}
+
+	ring->sq_entries = params.sq_entries;
+	ring->sq_khead = (unsigned *)((char *)ring->sq_ptr + params.sq_off.head);
+	ring->sq_ktail = (unsigned *)((char *)ring->sq_ptr + params.sq_off.tail);
+	ring->sq_kmask = (unsigned *)((char *)ring->sq_ptr + \
+			params.sq_off.ring_mask);
+	ring->sq_array = (unsigned *)((char *)ring->sq_ptr + params.sq_off.array);
+	ring->cq_khead = (unsigned *)((char *)ring->cq_ptr + params.cq_off.head);
+	ring->cq_ktail = (unsigned *)((char *)ring->cq_ptr + params.cq_off.tail);
+	ring->cq_kmask = (unsigned *)((char *)ring->cq_ptr + \
+			params.cq_off.ring_mask);
+	ring->cqes = (struct io_uring_cqe *)((char *)ring->cq_ptr + \
+			params.cq_off.cqes);
+	ring->sq_tail = *ring->sq_ktail;
+	ring->sq_submitted = ring->sq_tail;
+
+	return uring_probe_ops(ring);
+}
+
+static void uring_queue_exit(StorageURing *ring)
+{
+	munmap(ring->sqes, ring->sqes_size);
+	if (ring->cq_ptr != ring->sq_ptr)
+	{
+		munmap(ring->cq_ptr, ring->cq_size);
+	}
+	munmap(ring->sq_ptr, ring->sq_size);
+	close(ring->ring_fd);
+}
+
+static int uring_submit(StorageURing *ring, const unsigned wait_nr)
+{
+	unsigned to_submit;
+	int result;
+
+	__atomic_store_n(ring->sq_ktail, ring->sq_tail, __ATOMIC_RELEASE);
+	to_submit = ring->sq_tail - ring->sq_submitted;
+	result = uring_enter(ring->ring_fd, to_submit, wait_nr, \
+			wait_nr > 0 ? IORING_ENTER_GETEVENTS : 0);
+	if (result < 0)
+	{
+		return errno != 0 ? errno : EIO;
+	}
+
+	ring->sq_submitted += result;
+	return 0;
+}
+
+static struct io_uring_sqe *uring_get_sqe(StorageURing *ring)
+{
+	struct io_uring_sqe *sqe;
+	unsigned head;
+	unsigned index;
+	int result;
+
+	head = __atomic_load_n(ring->sq_khead, __ATOMIC_ACQUIRE);
+	if (ring->sq_tail - head >= ring->sq_entries)
+	{
+		/* sq full, submit to the kernel */
+		if ((result=uring_submit(ring, 0)) != 0)
+		{
+			logError("file: "__FILE__", line: %d, " \
+				"io_uring_enter fail, " \
+				"errno: %d, error info: %s", \
+				__LINE__, result, STRERROR(result));
+		}
+
+		head = __atomic_load_n(ring->sq_khead, __ATOMIC_ACQUIRE);
+		if (ring->sq_tail - head >= ring->sq_entries)
+		{
+			return NULL;
+		}
+	}
+
+	index = ring->sq_tail & *ring->sq_kmask;
+	sqe = ring->sqes + index;
+	memset(sqe, 0, sizeof(struct io_uring_sqe));
+	ring->sq_array[index] = index;
+	ring->sq_tail++;
+	return sqe;
+}
+
+static int uring_prep(struct storage_uring_context *pContext, \
+		struct fast_task_info *pTask, const int op, \
+		const int opcode, const int fd, void *addr, \
+		const unsigned len, const int64_t offset)
+{
+	struct io_uring_sqe *sqe;
+
+	sqe = uring_get_sqe(&pContext->ring);
+	if (sqe == NULL)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"io_uring sq is full, entries: %u", \
+			__LINE__, pContext->ring.sq_entries);
+		return EBUSY;
+	}
+
+	sqe->opcode = opcode;
+	sqe->fd = fd;
+	sqe->addr = (__u64)(long)addr;
+	sqe->len = len;
+	sqe->off = offset;
+	sqe->user_data = URING_USER_DATA(pTask, op);
+	if (pTask != NULL)
+	{
+		pContext->inflight++;
+	}
+	return 0;
+}
+
+static int uring_prep_notify(struct storage_uring_context *pContext)
+{
+	return uring_prep(pContext, NULL, URING_OP_NOTIFY, IORING_OP_READ, \
+			pContext->notify_fd, &pContext->notify_value, \
+			sizeof(pContext->notify_value), 0);
+}
+
+static int uring_prep_open(struct storage_uring_context *pContext, \
+		struct fast_task_info *pTask)
+{
+	StorageFileContext *pFileContext;
+	struct io_uring_sqe *sqe;
+	int result;
+
+	pFileContext = &(((StorageClientInfo *)pTask->arg)->file_context);
+	if ((result=uring_prep(pContext, pTask, URING_OP_OPEN, \
+		IORING_OP_OPENAT, AT_FDCWD, pFileContext->filename, \
+		0644, 0)) != 0)
+	{
+		return result;
+	}
+
+	sqe = pContext->ring.sqes + ((pContext->ring.sq_tail - 1) & \
+			*pContext->ring.sq_kmask);
+	sqe->open_flags = pFileContext->open_flags;
+	return 0;
+}
+
+static int uring_prep_read(struct storage_uring_context *pContext, \
+		struct fast_task_info *pTask)
+{
+	StorageFileContext *pFileContext;
+
+	pFileContext = &(((StorageClientInfo *)pTask->arg)->file_context);
+	return uring_prep(pContext, pTask, URING_OP_READ, IORING_OP_READ, \
+			pFileContext->fd, pTask->data + pTask->length, \
+			dio_get_read_bytes(pTask), pFileContext->offset);
+}
+
+static int uring_prep_write(struct storage_uring_context *pContext, \
+		struct fast_task_info *pTask)
+{
+	StorageFileContext *pFileContext;
+
+	pFileContext = &(((StorageClientInfo *)pTask->arg)->file_context);
+	return uring_prep(pContext, pTask, URING_OP_WRITE, IORING_OP_WRITE, \
+			pFileContext->fd, pTask->data + pFileContext->buff_offset, \
+			pTask->length - pFileContext->buff_offset, \
+			pFileContext->offset);
+}
+
+static void uring_read_fail(struct fast_task_info *pTask, const int err_no)
+{
+	StorageFileContext *pFileContext;
+
+	pFileContext = &(((StorageClientInfo *)pTask->arg)->file_context);
+	if (pFileContext->fd > 0)
+	{
+		dio_close_file(pFileContext);
+	}
+
+	pFileContext->done_callback(pTask, err_no);
+}
+
+static void uring_write_fail(struct fast_task_info *pTask, const int err_no)
+{
+	StorageClientInfo *pClientInfo;
+	StorageFileContext *pFileContext;
+
+	pClientInfo = (StorageClientInfo *)pTask->arg;
+	pFileContext = &(pClientInfo->file_context);
+	pClientInfo->clean_func(pTask);
+	if (pFileContext->done_callback != NULL)
+	{
+		pFileContext->done_callback(pTask, err_no);
+	}
+}
+
+static void uring_start_read(struct storage_uring_context *pContext, \
+		struct fast_task_info *pTask)
+{
+	StorageFileContext *pFileContext;
+	int result;
+
+	pFileContext = &(((StorageClientInfo *)pTask->arg)->file_context);
+	if (pFileContext->fd < 0 && pContext->ring.op_open_supported)
+	{
+		result = uring_prep_open(pContext, pTask);
+	}
+	else if ((result=dio_open_file(pFileContext)) == 0)
+	{
+		result = uring_prep_read(pContext, pTask);
+	}
+
+	if (result != 0)
+	{
+		uring_read_fail(pTask, result);
+	}
+}
+
+static void uring_start_write(struct storage_uring_context *pContext, \
+		struct fast_task_info *pTask)
+{
+	StorageFileContext *pFileContext;
+	int result;
+
+	pFileContext = &(((StorageClientInfo *)pTask->arg)->file_context);
+	result = 0;
+	if (pFileContext->fd < 0)
+	{
+		if (pFileContext->extra_info.upload.before_open_callback!=NULL)
+		{
+			result = pFileContext->extra_info.upload. \
+					before_open_callback(pTask);
+		}
+	}
+
+	if (result == 0)
+	{
+		if (pFileContext->fd < 0 && pContext->ring.op_open_supported)
+		{
+			result = uring_prep_open(pContext, pTask);
+		}
+		else if ((result=dio_open_file(pFileContext)) == 0)
+		{
+			result = uring_prep_write(pContext, pTask);
+		}
+	}
+
+	if (result != 0)
+	{
+		uring_write_fail(pTask, result);
+	}
+}
+
+static void uring_start_unlink(struct storage_uring_context *pContext, \
+		struct fast_task_info *pTask)
+{
+	StorageFileContext *pFileContext;
+	int result;
+
+	pFileContext = &(((StorageClientInfo *)pTask->arg)->file_context);
+	if ((result=uring_prep(pContext, pTask, URING_OP_UNLINK, \
+		IORING_OP_UNLINKAT, AT_FDCWD, pFileContext->filename, \
+		0, 0)) != 0)
+	{
+		pFileContext->log_callback(pTask, result);
+		pFileContext->done_callback(pTask, result);
+	}
+}
+
+static void uring_start_task(struct storage_uring_context *pContext, \
+		struct fast_task_info *pTask)
+{
+	StorageClientInfo *pClientInfo;
+
+	pClientInfo = (StorageClientInfo *)pTask->arg;
+	if (pClientInfo->deal_func == dio_read_file)
+	{
+		uring_start_read(pContext, pTask);
+	}
+	else if (pClientInfo->deal_func == dio_write_file && \
+		pClientInfo->file_context.splice_bytes == 0)
+	{
+		uring_start_write(pContext, pTask);
+	}
+	else if (pClientInfo->deal_func == dio_delete_normal_file && \
+		pContext->ring.op_unlink_supported)
+	{
+		uring_start_unlink(pContext, pTask);
+	}
+	else
+	{
+		/* no async implementation, deal it directly */
+		pClientInfo->deal_func(pTask);
+	}
+}
+
+static void uring_open_done(struct storage_uring_context *pContext, \
+		struct fast_task_info *pTask, const int res)
+{
+	StorageClientInfo *pClientInfo;
+	StorageFileContext *pFileContext;
+	int result;
+
+	pClientInfo = (StorageClientInfo *)pTask->arg;
+	pFileContext = &(pClientInfo->file_context);
+	if (res < 0)
+	{
+		result = -1 * res;
+		logError("file: "__FILE__", line: %d, " \
+			"open file: %s fail, " \
+			"errno: %d, error info: %s", \
+			__LINE__, pFileContext->filename, \
+			result, STRERROR(result));
+	}
+	else
+	{
+		pFileContext->fd = res;
+		result = 0;
+	}
+	dio_stat_file_open(result);
+
+	if (pClientInfo->deal_func == dio_read_file)
+	{
+		if (result == 0)
+		{
+			result = uring_prep_read(pContext, pTask);
+		}
+		if (result != 0)
+		{
+			uring_read_fail(pTask, result);
+		}
+	}
+	else
+	{
+		if (result == 0)
+		{
+			result = uring_prep_write(pContext, pTask);
+		}
+		if (result != 0)
+		{
+			uring_write_fail(pTask, result);
+		}
+	}
+}
+
+static void uring_read_done(struct storage_uring_context *pContext, \
+		struct fast_task_info *pTask, const int res)
+{
+	StorageFileContext *pFileContext;
+	int read_bytes;
+	int result;
+
+	pFileContext = &(((StorageClientInfo *)pTask->arg)->file_context);
+	read_bytes = dio_get_read_bytes(pTask);
+	if (res == read_bytes)
+	{
+		result = 0;
+	}
+	else
+	{
+		result = res < 0 ? -1 * res : EIO;
+		logError("file: "__FILE__", line: %d, " \
+			"read from file: %s fail, read bytes: %d != %d, " \
+			"errno: %d, error info: %s", \
+			__LINE__, pFileContext->filename, res, read_bytes, \
+			result, STRERROR(result));
+	}
+
+	dio_read_file_complete(pTask, result, read_bytes);
+}
+
+static void uring_write_done(struct storage_uring_context *pContext, \
+		struct fast_task_info *pTask, const int res)
+{
+	StorageFileContext *pFileContext;
+	int write_bytes;
+	int result;
+
+	pFileContext = &(((StorageClientInfo *)pTask->arg)->file_context);
+	write_bytes = pTask->length - pFileContext->buff_offset;
+	if (res == write_bytes)
+	{
+		result = 0;
+	}
+	else
+	{
+		result = res < 0 ? -1 * res : EIO;
+		logError("file: "__FILE__", line: %d, " \
+			"write to file: %s fail, fd=%d, write_bytes=%d, " \
+			"written bytes: %d, errno: %d, error info: %s", \
+			__LINE__, pFileContext->filename, pFileContext->fd, \
+			write_bytes, res, result, STRERROR(result));
+	}
+
+	if (result == 0 && dio_need_fsync(pFileContext, write_bytes))
+	{
+		if ((result=uring_prep(pContext, pTask, URING_OP_FSYNC, \
+			IORING_OP_FSYNC, pFileContext->fd, NULL, 0, 0)) == 0)
+		{
+			return;
+		}
+	}
+
+	dio_write_file_complete(pTask, result, write_bytes);
+}
+
+static void uring_fsync_done(struct storage_uring_context *pContext, \
+		struct fast_task_info *pTask, const int res)
+{
+	StorageFileContext *pFileContext;
+	int result;
+
+	pFileContext = &(((StorageClientInfo *)pTask->arg)->file_context);
+	if (res < 0)
+	{
+		result = -1 * res;
+		logError("file: "__FILE__", line: %d, " \
+			"fsync file: %s fail, " \
+			"errno: %d, error info: %s", \
+			__LINE__, pFileContext->filename, \
+			result, STRERROR(result));
+	}
+	else
+	{
+		result = 0;
+	}
+
+	dio_write_file_complete(pTask, result, \
+			pTask->length - pFileContext->buff_offset);
+}
+
+static void uring_unlink_done(struct storage_uring_context *pContext, \
+		struct fast_task_info *pTask, const int res)
+{
+	StorageFileContext *pFileContext;
+	int result;
+
+	pFileContext = &(((StorageClientInfo *)pTask->arg)->file_context);
+	if (res < 0)
+	{
+		result = -1 * res;
+		pFileContext->log_callback(pTask, result);
+	}
+	else
+	{
+		result = 0;
+	}
+
+	pFileContext->done_callback(pTask, result);
+}
+
+static void uring_deal_notify(struct storage_uring_context *pContext)
+{
+	struct fast_task_info *pTask;
+	int result;
+
+	while ((pTask=task_queue_pop(&(pContext->queue))) != NULL)
+	{
+		uring_start_task(pContext, pTask);
+	}
+
+	if ((result=uring_prep_notify(pContext)) != 0)
+	{
+		logCrit("file: "__FILE__", line: %d, " \
+			"prepare io_uring notify read fail, " \
+			"errno: %d, error info: %s", \
+			__LINE__, result, STRERROR(result));
+	}
+}
+
+static void uring_deal_completions(struct storage_uring_context *pContext)
+{
+	StorageURing *ring;
+	struct io_uring_cqe *cqe;
+	struct fast_task_info *pTask;
+	unsigned head;
+	unsigned tail;
+	__u64 user_data;
+	int res;
+
+	ring = &pContext->ring;
+	head = *ring->cq_khead;
+	while (1)
+	{
+		tail = __atomic_load_n(ring->cq_ktail, __ATOMIC_ACQUIRE);
+		if (head == tail)
+		{
+			break;
+		}
+
+		cqe = ring->cqes + (head & *ring->cq_kmask);
+		user_data = cqe->user_data;
+		res = cqe->res;
+		head++;
+		__atomic_store_n(ring->cq_khead, head, __ATOMIC_RELEASE);
+
+		pTask = URING_USER_TASK(user_data);
+		if (pTask == NULL)
+		{
+			uring_deal_notify(pContext);
+			continue;
+		}
+
+		pContext->inflight--;
+		switch (URING_USER_OP(user_data))
+		{
+			case URING_OP_OPEN:
+				uring_open_done(pContext, pTask, res);
+				break;
+			case URING_OP_READ:
+				uring_read_done(pContext, pTask, res);
+				break;
+			case URING_OP_WRITE:
+				uring_write_done(pContext, pTask, res);
+				break;
+			case URING_OP_FSYNC:
+				uring_fsync_done(pContext, pTask, res);
+				break;
+			case URING_OP_UNLINK:
+				uring_unlink_done(pContext, pTask, res);
+				break;
+			default:
+				logError("file: "__FILE__", line: %d, " \
+					"invalid io_uring op: %d", __LINE__, \
+					URING_USER_OP(user_data));
+				break;
+		}
+	}
+}
+
+int storage_uring_init(struct storage_uring_context *pContext, \
+		const int queue_depth)
+{
+	int result;
+
+	memset(pContext, 0, sizeof(struct storage_uring_context));
+	if ((result=task_queue_init(&(pContext->queue))) != 0)
+	{
+		return result;
+	}
+
+	pContext->notify_fd = eventfd(0, EFD_CLOEXEC);
+	if (pContext->notify_fd < 0)
+	{
+		result = errno != 0 ? errno : EMFILE;
+		logError("file: "__FILE__", line: %d, " \
+			"call eventfd fail, " \
+			"errno: %d, error info: %s", \
+			__LINE__, result, STRERROR(result));
+		return result;
+	}
+
+	if ((result=uring_queue_init(&pContext->ring, queue_depth)) != 0)
+	{
+		close(pContext->notify_fd);
+		return result;
+	}
+
+	return uring_prep_notify(pContext);
+}
+
+void storage_uring_destroy(struct storage_uring_context *pContext)
+{
+	uring_queue_exit(&pContext->ring);
+	close(pContext->notify_fd);
+}
+
+void storage_uring_wakeup(struct storage_uring_context *pContext)
+{
+	int64_t n;
+
+	n = 1;
+	if (write(pContext->notify_fd, &n, sizeof(n)) != sizeof(n))
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"write to eventfd fail, " \
+			"errno: %d, error info: %s", \
+			__LINE__, errno, STRERROR(errno));
+	}
+}
+
+int storage_uring_queue_push(struct storage_uring_context *pContext, \
+		struct fast_task_info *pTask)
+{
+	int result;
+
+	if ((result=task_queue_push(&(pContext->queue), pTask)) != 0)
+	{
+		return result;
+	}
+
+	storage_uring_wakeup(pContext);
+	return 0;
+}
+
+int storage_uring_loop(struct storage_uring_context *pContext)
+{
+	int result;
+
+	while (g_continue_flag)
+	{
+		if ((result=uring_submit(&pContext->ring, 1)) != 0)
+		{
+			if (result == EINTR || result == EAGAIN || \
+				result == EBUSY)
+			{
+				continue;
+			}
+
+			logCrit("file: "__FILE__", line: %d, " \
+				"io_uring_enter fail, " \
+				"errno: %d, error info: %s", \
+				__LINE__, result, STRERROR(result));
+			return result;
+		}
+
+		uring_deal_completions(pContext);
+	}
+
+	return 0;
+}
+
+#endif
+
@@ -0,0 +1,84 @@
+/**
+* Copyright (C) 2008 Happy Fish / YuQing
+*
+* FastDFS may be copied only under the terms of the GNU General
+* Public License V3, which may be found in the FastDFS source kit.
+* Please visit the FastDFS Home Page http://www.csource.org/ for more detail.
+**/
+
+//storage_dio_uring.h
+
+#ifndef _STORAGE_DIO_URING_H
+#define _STORAGE_DIO_URING_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "common_define.h"
+#include "fast_task_queue.h"
+
+#ifdef WITH_IO_URING
+
+#include <linux/io_uring.h>
+
+typedef struct
+{
+	int ring_fd;
+	unsigned sq_entries;
+	unsigned sq_tail;       //local tail, published when submit
+	unsigned sq_submitted;  //the tail submitted to the kernel
+	unsigned *sq_khead;
+	unsigned *sq_ktail;
+	unsigned *sq_kmask;
+	unsigned *sq_array;
+	struct io_uring_sqe *sqes;
+
+	unsigned *cq_khead;
+	unsigned *cq_ktail;
+	unsigned *cq_kmask;
+	struct io_uring_cqe *cqes;
+
+	void *sq_ptr;
+	void *cq_ptr;
+	size_t sq_size;
+	size_t cq_size;
+	size_t sqes_size;
+
+	bool op_open_supported;   //IORING_OP_OPENAT, since Linux 5.6
+	bool op_unlink_supported; //IORING_OP_UNLINKAT, since Linux 5.11
+} StorageURing;
+
+/* one ring and one thread per store path */
+struct storage_uring_context
+{
+	StorageURing ring;
+	struct fast_task_queue queue;  //tasks pushed by the nio threads
+	int notify_fd;    //eventfd to wake up the ring thread
+	int64_t notify_value;
+	int inflight;     //tasks waiting for the completion
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int storage_uring_init(struct storage_uring_context *pContext, \
+		const int queue_depth);
+void storage_uring_destroy(struct storage_uring_context *pContext);
+
+int storage_uring_queue_push(struct storage_uring_context *pContext, \
+		struct fast_task_info *pTask);
+void storage_uring_wakeup(struct storage_uring_context *pContext);
+
+/* deal the tasks until g_continue_flag is false */
+int storage_uring_loop(struct storage_uring_context *pContext);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
+#endif
+
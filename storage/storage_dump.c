@@ -21,6 +21,7 @@
 #include "storage_global.h"
 #include "storage_service.h"
 #include "storage_sync.h"
+#include "storage_stat.h"
 #include "trunk_mem.h"
 #include "trunk_sync.h"
 
@@ -328,6 +329,7 @@ static int fdfs_dump_storage_stat(char *buff, const int buffSize)
 	char szSyncUpdTime[32];
 	char szSyncedTimestamp[32];
 
+	storage_stat_merge(&g_storage_stat);
 	total_len = snprintf(buff, buffSize,
 		"\ng_stat_change_count=%d\n"
 		"g_sync_change_count=%d\n"
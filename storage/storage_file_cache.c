@@ -0,0 +1,436 @@
+/**
+* Copyright (C) 2008 Happy Fish / YuQing
+*
+* FastDFS may be copied only under the terms of the GNU General
+* Public License V3, which may be found in the FastDFS source kit.
+* Please visit the FastDFS Home Page http://www.csource.org/ for more detail.
+**/
+
+//storage_file_cache.c
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include "shared_func.h"
+#include "pthread_func.h"
+#include "logger.h"
+#include "hash.h"
+#include "storage_global.h"
+#include "storage_file_cache.h"
+
+#define FILE_CACHE_AVG_FILE_SIZE     (8 * 1024)
+#define FILE_CACHE_MIN_WIDTH         1024
+#define FILE_CACHE_MAX_WIDTH         (1024 * 1024)
+#define FILE_CACHE_MAX_FREQUENCY     15
+
+/* reset the sketch after the sample size additions, let the old
+   frequency decay, as TinyLFU */
+#define FILE_CACHE_SAMPLE_FACTOR     10
+
+static StorageFileCacheShard *file_cache_shards = NULL;
+
+#define FILE_CACHE_SHARD(hash_code) (file_cache_shards + \
+	(hash_code) % STORAGE_FILE_CACHE_SHARD_COUNT)
+
+#define FILE_CACHE_VERSION(pShard, hash_code) \
+	((pShard)->versions[((hash_code) / STORAGE_FILE_CACHE_SHARD_COUNT) % \
+	 STORAGE_FILE_CACHE_VERSION_SLOTS])
+
+static unsigned int file_cache_round_up(const int64_t n, \
+		const unsigned int min_value, const unsigned int max_value)
+{
+	unsigned int value;
+
+	value = min_value;
+	while (value < n && value < max_value)
+	{
+		value *= 2;
+	}
+	return value;
+}
+
+static int file_cache_init_shard(StorageFileCacheShard *pShard, \
+		const int64_t capacity)
+{
+	int result;
+	int bytes;
+
+	if ((result=init_pthread_lock(&pShard->lock)) != 0)
+	{
+		return result;
+	}
+
+	pShard->capacity = capacity;
+	pShard->bucket_count = file_cache_round_up(capacity / \
+			FILE_CACHE_AVG_FILE_SIZE, 64, FILE_CACHE_MAX_WIDTH);
+	bytes = sizeof(StorageFileCacheEntry *) * pShard->bucket_count;
+	pShard->buckets = (StorageFileCacheEntry **)malloc(bytes);
+	if (pShard->buckets == NULL)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"malloc %d bytes fail, " \
+			"errno: %d, error info: %s", \
+			__LINE__, bytes, errno, STRERROR(errno));
+		return errno != 0 ? errno : ENOMEM;
+	}
+	memset(pShard->buckets, 0, bytes);
+
+	pShard->sketch_width = file_cache_round_up(capacity / \
+			FILE_CACHE_AVG_FILE_SIZE, FILE_CACHE_MIN_WIDTH, \
+			FILE_CACHE_MAX_WIDTH);
+	bytes = pShard->sketch_width * STORAGE_FILE_CACHE_SKETCH_DEPTH;
+	pShard->sketch = (unsigned char *)malloc(bytes);
+	if (pShard->sketch == NULL)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"malloc %d bytes fail, " \
+			"errno: %d, error info: %s", \
+			__LINE__, bytes, errno, STRERROR(errno));
+		return errno != 0 ? errno : ENOMEM;
+	}
+	memset(pShard->sketch, 0, bytes);
+
+	pShard->lru.prev = pShard->lru.next = &pShard->lru;
+	return 0;
+}
+
+int storage_file_cache_init()
+{
+	StorageFileCacheShard *pShard;
+	StorageFileCacheShard *pEnd;
+	int bytes;
+	int result;
+
+	if (g_file_cache_size <= 0)
+	{
+		return 0;
+	}
+
+	bytes = sizeof(StorageFileCacheShard) * STORAGE_FILE_CACHE_SHARD_COUNT;
+	file_cache_shards = (StorageFileCacheShard *)malloc(bytes);
+	if (file_cache_shards == NULL)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"malloc %d bytes fail, " \
+			"errno: %d, error info: %s", \
+			__LINE__, bytes, errno, STRERROR(errno));
+		return errno != 0 ? errno : ENOMEM;
+	}
+	memset(file_cache_shards, 0, bytes);
+
+	pEnd = file_cache_shards + STORAGE_FILE_CACHE_SHARD_COUNT;
+	for (pShard=file_cache_shards; pShard<pEnd; pShard++)
+	{
+		if ((result=file_cache_init_shard(pShard, g_file_cache_size / \
+				STORAGE_FILE_CACHE_SHARD_COUNT)) != 0)
+		{
+			return result;
+		}
+	}
+
+	return 0;
+}
+
+void storage_file_cache_destroy()
+{
+	StorageFileCacheShard *pShard;
+	StorageFileCacheShard *pEnd;
+	StorageFileCacheEntry *pEntry;
+	StorageFileCacheEntry *pDeleted;
+
+	if (file_cache_shards == NULL)
+	{
+		return;
+	}
+
+	pEnd = file_cache_shards + STORAGE_FILE_CACHE_SHARD_COUNT;
+	for (pShard=file_cache_shards; pShard<pEnd; pShard++)
+	{
+		pEntry = pShard->lru.next;
+		while (pEntry != &pShard->lru)
+		{
+			pDeleted = pEntry;
+			pEntry = pEntry->next;
+			free(pDeleted);
+		}
+
+		if (pShard->buckets != NULL)
+		{
+			free(pShard->buckets);
+		}
+		if (pShard->sketch != NULL)
+		{
+			free(pShard->sketch);
+		}
+		pthread_mutex_destroy(&pShard->lock);
+	}
+
+	free(file_cache_shards);
+	file_cache_shards = NULL;
+}
+
+static inline unsigned int file_cache_sketch_index( \
+		StorageFileCacheShard *pShard, const unsigned int hash_code, \
+		const int row)
+{
+	unsigned int h;
+
+	/* derive the row hash from the hash code, multiplicative hashing
+	   with different odd constants */
+	h = (hash_code ^ (hash_code >> 16)) * (0x9E3779B1U + 2 * row);
+	h ^= h >> 15;
+	return row * pShard->sketch_width + (h & (pShard->sketch_width - 1));
+}
+
+static void file_cache_sketch_increase(StorageFileCacheShard *pShard, \
+		const unsigned int hash_code)
+{
+	unsigned char *pCounter;
+	unsigned char *pEnd;
+	int row;
+
+	for (row=0; row<STORAGE_FILE_CACHE_SKETCH_DEPTH; row++)
+	{
+		pCounter = pShard->sketch + file_cache_sketch_index(pShard, \
+				hash_code, row);
+		if (*pCounter < FILE_CACHE_MAX_FREQUENCY)
+		{
+			(*pCounter)++;
+		}
+	}
+
+	if (++pShard->sketch_additions >= FILE_CACHE_SAMPLE_FACTOR * \
+			pShard->sketch_width)
+	{
+		pEnd = pShard->sketch + pShard->sketch_width * \
+			STORAGE_FILE_CACHE_SKETCH_DEPTH;
+		for (pCounter=pShard->sketch; pCounter<pEnd; pCounter++)
+		{
+			*pCounter >>= 1;
+		}
+		pShard->sketch_additions /= 2;
+	}
+}
+
+static int file_cache_sketch_frequency(StorageFileCacheShard *pShard, \
+		const unsigned int hash_code)
+{
+	int frequency;
+	int count;
+	int row;
+
+	frequency = FILE_CACHE_MAX_FREQUENCY;
+	for (row=0; row<STORAGE_FILE_CACHE_SKETCH_DEPTH; row++)
+	{
+		count = pShard->sketch[file_cache_sketch_index(pShard, \
+				hash_code, row)];
+		if (count < frequency)
+		{
+			frequency = count;
+		}
+	}
+
+	return frequency;
+}
+
+static StorageFileCacheEntry **file_cache_find(StorageFileCacheShard *pShard, \
+		const char *filename, const int filename_len, \
+		const unsigned int hash_code)
+{
+	StorageFileCacheEntry **ppEntry;
+
+	ppEntry = pShard->buckets + (hash_code / STORAGE_FILE_CACHE_SHARD_COUNT)\
+			% pShard->bucket_count;
+	while (*ppEntry != NULL)
+	{
+		if ((*ppEntry)->hash_code == hash_code && \
+			(*ppEntry)->key_len == filename_len && \
+			memcmp((*ppEntry)->key, filename, filename_len) == 0)
+		{
+			break;
+		}
+		ppEntry = &(*ppEntry)->hash_next;
+	}
+
+	return ppEntry;
+}
+
+static inline void file_cache_lru_remove(StorageFileCacheEntry *pEntry)
+{
+	pEntry->prev->next = pEntry->next;
+	pEntry->next->prev = pEntry->prev;
+}
+
+static inline void file_cache_lru_add_head(StorageFileCacheShard *pShard, \
+		StorageFileCacheEntry *pEntry)
+{
+	pEntry->prev = &pShard->lru;
+	pEntry->next = pShard->lru.next;
+	pShard->lru.next->prev = pEntry;
+	pShard->lru.next = pEntry;
+}
+
+static void file_cache_remove(StorageFileCacheShard *pShard, \
+		StorageFileCacheEntry **ppEntry)
+{
+	StorageFileCacheEntry *pEntry;
+
+	pEntry = *ppEntry;
+	*ppEntry = pEntry->hash_next;
+	file_cache_lru_remove(pEntry);
+	pShard->used_bytes -= pEntry->size;
+	free(pEntry);
+}
+
+int storage_file_cache_get(const char *filename, const int filename_len, \
+		const int64_t offset, int64_t *bytes, char *buff, \
+		int64_t *version)
+{
+	StorageFileCacheShard *pShard;
+	StorageFileCacheEntry *pEntry;
+	unsigned int hash_code;
+	int result;
+
+	hash_code = Time33Hash(filename, filename_len);
+	pShard = FILE_CACHE_SHARD(hash_code);
+
+	pthread_mutex_lock(&pShard->lock);
+	file_cache_sketch_increase(pShard, hash_code);
+	pEntry = *file_cache_find(pShard, filename, filename_len, hash_code);
+	if (pEntry == NULL)
+	{
+		*version = FILE_CACHE_VERSION(pShard, hash_code);
+		result = ENOENT;
+	}
+	else if (offset > pEntry->size || *bytes > pEntry->size - offset)
+	{
+		*version = FILE_CACHE_VERSION(pShard, hash_code);
+		result = ENOENT;  //let the caller report the error
+	}
+	else
+	{
+		if (*bytes == 0)
+		{
+			*bytes = pEntry->size - offset;
+		}
+		memcpy(buff, pEntry->content + offset, *bytes);
+
+		file_cache_lru_remove(pEntry);
+		file_cache_lru_add_head(pShard, pEntry);
+		result = 0;
+	}
+	pthread_mutex_unlock(&pShard->lock);
+
+	return result;
+}
+
+void storage_file_cache_set(const char *filename, const int filename_len, \
+		const char *content, const int size, const int64_t version)
+{
+	StorageFileCacheShard *pShard;
+	StorageFileCacheEntry *pEntry;
+	StorageFileCacheEntry *pVictim;
+	StorageFileCacheEntry **ppEntry;
+	unsigned int hash_code;
+	int frequency;
+	int bytes;
+
+	if (size > g_file_cache_max_file_size)
+	{
+		return;
+	}
+
+	hash_code = Time33Hash(filename, filename_len);
+	pShard = FILE_CACHE_SHARD(hash_code);
+	if (size > pShard->capacity)
+	{
+		return;
+	}
+
+	pthread_mutex_lock(&pShard->lock);
+	do
+	{
+		/* the file changed after read */
+		if (FILE_CACHE_VERSION(pShard, hash_code) != version)
+		{
+			break;
+		}
+
+		ppEntry = file_cache_find(pShard, filename, \
+				filename_len, hash_code);
+		if (*ppEntry != NULL)  //set by another reader
+		{
+			break;
+		}
+
+		/* admission: evict the LRU victims only if the new file
+		   is more frequent than them */
+		frequency = file_cache_sketch_frequency(pShard, hash_code);
+		while (pShard->used_bytes + size > pShard->capacity)
+		{
+			pVictim = pShard->lru.prev;
+			if (frequency <= file_cache_sketch_frequency(pShard, \
+					pVictim->hash_code))
+			{
+				break;
+			}
+
+			file_cache_remove(pShard, file_cache_find(pShard, \
+				pVictim->key, pVictim->key_len, \
+				pVictim->hash_code));
+		}
+		if (pShard->used_bytes + size > pShard->capacity)
+		{
+			break;
+		}
+
+		bytes = sizeof(StorageFileCacheEntry) + filename_len + size;
+		pEntry = (StorageFileCacheEntry *)malloc(bytes);
+		if (pEntry == NULL)
+		{
+			logError("file: "__FILE__", line: %d, " \
+				"malloc %d bytes fail, " \
+				"errno: %d, error info: %s", \
+				__LINE__, bytes, errno, STRERROR(errno));
+			break;
+		}
+
+		pEntry->hash_code = hash_code;
+		pEntry->key_len = filename_len;
+		pEntry->size = size;
+		pEntry->key = (char *)(pEntry + 1);
+		pEntry->content = pEntry->key + filename_len;
+		memcpy(pEntry->key, filename, filename_len);
+		memcpy(pEntry->content, content, size);
+
+		ppEntry = file_cache_find(pShard, filename, \
+				filename_len, hash_code);
+		pEntry->hash_next = NULL;
+		*ppEntry = pEntry;
+		file_cache_lru_add_head(pShard, pEntry);
+		pShard->used_bytes += size;
+	} while (0);
+	pthread_mutex_unlock(&pShard->lock);
+}
+
+void storage_file_cache_delete(const char *filename, const int filename_len)
+{
+	StorageFileCacheShard *pShard;
+	StorageFileCacheEntry **ppEntry;
+	unsigned int hash_code;
+
+	hash_code = Time33Hash(filename, filename_len);
+	pShard = FILE_CACHE_SHARD(hash_code);
+
+	pthread_mutex_lock(&pShard->lock);
+	FILE_CACHE_VERSION(pShard, hash_code)++;
+	ppEntry = file_cache_find(pShard, filename, filename_len, hash_code);
+	if (*ppEntry != NULL)
+	{
+		file_cache_remove(pShard, ppEntry);
+	}
+	pthread_mutex_unlock(&pShard->lock);
+}
+
@@ -0,0 +1,90 @@
+/**
+* Copyright (C) 2008 Happy Fish / YuQing
+*
+* FastDFS may be copied only under the terms of the GNU General
+* Public License V3, which may be found in the FastDFS source kit.
+* Please visit the FastDFS Home Page http://www.csource.org/ for more detail.
+**/
+
+//storage_file_cache.h
+
+#ifndef _STORAGE_FILE_CACHE_H
+#define _STORAGE_FILE_CACHE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "common_define.h"
+
+#define STORAGE_FILE_CACHE_SHARD_COUNT     16
+#define STORAGE_FILE_CACHE_SKETCH_DEPTH     4
+#define STORAGE_FILE_CACHE_VERSION_SLOTS   64
+
+/* the whole content of a small file, keyed by the logic filename */
+typedef struct storage_file_cache_entry
+{
+	struct storage_file_cache_entry *hash_next;
+	struct storage_file_cache_entry *prev;  //LRU list
+	struct storage_file_cache_entry *next;
+	unsigned int hash_code;
+	int key_len;
+	int size;       //file content bytes
+	char *key;      //allocated with the entry
+	char *content;  //allocated with the entry
+} StorageFileCacheEntry;
+
+/* LRU for eviction and TinyLFU for admission: a count-min sketch
+   records the access frequency of the filenames (hit or miss),
+   a new file is admitted only if it is accessed more frequently
+   than the LRU victims, so a scan can't flush the hot files */
+typedef struct
+{
+	pthread_mutex_t lock;
+	StorageFileCacheEntry **buckets;
+	unsigned int bucket_count;
+	StorageFileCacheEntry lru;  //lru.next is the most recently used
+	int64_t capacity;
+	int64_t used_bytes;
+
+	unsigned char *sketch;      //STORAGE_FILE_CACHE_SKETCH_DEPTH rows
+	unsigned int sketch_width;  //counters per row, power of 2
+	unsigned int sketch_additions;  //halve the counters when too many
+
+	/* increased when the files are changed, the content read
+	   before the change is not cached */
+	int64_t versions[STORAGE_FILE_CACHE_VERSION_SLOTS];
+} StorageFileCacheShard;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* init by g_file_cache_size and g_file_cache_max_file_size,
+   the cache is disabled when g_file_cache_size is 0 */
+int storage_file_cache_init();
+void storage_file_cache_destroy();
+
+/* copy the file content from the offset to buff
+   bytes: the bytes to copy, 0 means to the end of the file,
+          return the copied bytes
+   version: return the version when miss for storage_file_cache_set
+   return 0 for hit, ENOENT for miss
+*/
+int storage_file_cache_get(const char *filename, const int filename_len, \
+		const int64_t offset, int64_t *bytes, char *buff, \
+		int64_t *version);
+
+/* cache the whole content of the file read when version is unchanged */
+void storage_file_cache_set(const char *filename, const int filename_len, \
+		const char *content, const int size, const int64_t version);
+
+/* called when the file is created, changed or deleted */
+void storage_file_cache_delete(const char *filename, const int filename_len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
@@ -45,6 +45,7 @@
 #include "trunk_mem.h"
 #include "trunk_sync.h"
 #include "storage_disk_recovery.h"
+#include "storage_stat.h"
 #include "tracker_client.h"
 
 #ifdef WITH_HTTPD
@@ -104,6 +105,9 @@
 #define STAT_ITEM_SUCCESS_FILE_READ_COUNT  "success_file_read_count"
 #define STAT_ITEM_TOTAL_FILE_WRITE_COUNT   "total_file_write_count"
 #define STAT_ITEM_SUCCESS_FILE_WRITE_COUNT "success_file_write_count"
+#define STAT_ITEM_TOTAL_CACHE_GET_COUNT    "total_cache_get_count"
+#define STAT_ITEM_SUCCESS_CACHE_GET_COUNT  "success_cache_get_count"
+#define STAT_ITEM_SUCCESS_CACHE_GET_BYTES  "success_cache_get_bytes"
 
 #define STAT_ITEM_DIST_PATH_INDEX_HIGH	"dist_path_index_high"
 #define STAT_ITEM_DIST_PATH_INDEX_LOW	"dist_path_index_low"
@@ -345,6 +349,12 @@ static int storage_open_stat_file()
 				STAT_ITEM_TOTAL_FILE_WRITE_COUNT, &iniContext, 0);
 		g_storage_stat.success_file_write_count = iniGetInt64Value(NULL, \
 				STAT_ITEM_SUCCESS_FILE_WRITE_COUNT, &iniContext, 0);
+		g_storage_stat.total_cache_get_count = iniGetInt64Value(NULL, \
+				STAT_ITEM_TOTAL_CACHE_GET_COUNT, &iniContext, 0);
+		g_storage_stat.success_cache_get_count = iniGetInt64Value(NULL, \
+				STAT_ITEM_SUCCESS_CACHE_GET_COUNT, &iniContext, 0);
+		g_storage_stat.success_cache_get_bytes = iniGetInt64Value(NULL, \
+				STAT_ITEM_SUCCESS_CACHE_GET_BYTES, &iniContext, 0);
 		g_dist_path_index_high = iniGetIntValue(NULL, \
 				STAT_ITEM_DIST_PATH_INDEX_HIGH, &iniContext, 0);
 		g_dist_path_index_low = iniGetIntValue(NULL, \
@@ -359,6 +369,11 @@ static int storage_open_stat_file()
 		memset(&g_storage_stat, 0, sizeof(g_storage_stat));
 	}
 
+	if ((result=storage_stat_init(&g_storage_stat)) != 0)
+	{
+		return result;
+	}
+
 	storage_stat_fd = open(full_filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
 	if (storage_stat_fd < 0)
 	{
@@ -403,6 +418,7 @@ int storage_write_to_stat_file()
 	int result;
 	int write_ret;
 
+	storage_stat_merge(&g_storage_stat);
 	len = sprintf(buff, 
 		"%s="INT64_PRINTF_FORMAT"\n"  \
 		"%s="INT64_PRINTF_FORMAT"\n"  \
@@ -442,6 +458,9 @@ int storage_write_to_stat_file()
 		"%s="INT64_PRINTF_FORMAT"\n"  \
 		"%s="INT64_PRINTF_FORMAT"\n"  \
 		"%s="INT64_PRINTF_FORMAT"\n"  \
+		"%s="INT64_PRINTF_FORMAT"\n"  \
+		"%s="INT64_PRINTF_FORMAT"\n"  \
+		"%s="INT64_PRINTF_FORMAT"\n"  \
 		"%s=%d\n"  \
 		"%s=%d\n"  \
 		"%s=%d\n"  \
@@ -510,6 +529,12 @@ int storage_write_to_stat_file()
 		g_storage_stat.total_file_write_count, \
 		STAT_ITEM_SUCCESS_FILE_WRITE_COUNT, \
 		g_storage_stat.success_file_write_count, \
+		STAT_ITEM_TOTAL_CACHE_GET_COUNT, \
+		g_storage_stat.total_cache_get_count, \
+		STAT_ITEM_SUCCESS_CACHE_GET_COUNT, \
+		g_storage_stat.success_cache_get_count, \
+		STAT_ITEM_SUCCESS_CACHE_GET_BYTES, \
+		g_storage_stat.success_cache_get_bytes, \
 		STAT_ITEM_LAST_SOURCE_UPD, \
 		(int)g_storage_stat.last_source_update, \
 		STAT_ITEM_LAST_SYNC_UPD, (int)g_storage_stat.last_sync_update,\
@@ -965,10 +990,16 @@ int storage_func_init(const char *filename, \
 	char *pBindAddr;
 	char *pGroupName;
 	char *pRunByGroup;
+	char *pDiskIOEngine;
+	char *pBinlogFormat;
 	char *pRunByUser;
 	char *pFsyncAfterWrittenBytes;
 	char *pThreadStackSize;
 	char *pBuffSize;
+	char *pFileCacheSize;
+	char *pFileCacheMaxFileSize;
+	char *pTrunkLeaseSize;
+	char *pTrunkCompactRate;
 	char *pIfAliasPrefix;
 	char *pHttpDomain;
 	char *pRotateAccessLogSize;
@@ -978,6 +1009,9 @@ int storage_func_init(const char *filename, \
 	int64_t fsync_after_written_bytes;
 	int64_t thread_stack_size;
 	int64_t buff_size;
+	int64_t file_cache_max_file_size;
+	int64_t trunk_lease_size;
+	int64_t trunk_compact_rate;
 	int64_t rotate_access_log_size;
 	int64_t rotate_error_log_size;
 	ConnectionInfo *pServer;
@@ -1234,6 +1268,44 @@ int storage_func_init(const char *filename, \
                         break;
 		}
 
+		pFileCacheSize = iniGetStrValue(NULL, \
+			"file_cache_size", &iniContext);
+		if (pFileCacheSize == NULL)
+		{
+			g_file_cache_size = 0;
+		}
+		else if ((result=parse_bytes(pFileCacheSize, 1, \
+				&g_file_cache_size)) != 0)
+		{
+			break;
+		}
+
+		pFileCacheMaxFileSize = iniGetStrValue(NULL, \
+			"file_cache_max_file_size", &iniContext);
+		if (pFileCacheMaxFileSize == NULL)
+		{
+			file_cache_max_file_size = \
+				STORAGE_DEFAULT_FILE_CACHE_MAX_FILE_SIZE;
+		}
+		else if ((result=parse_bytes(pFileCacheMaxFileSize, 1, \
+				&file_cache_max_file_size)) != 0)
+		{
+			break;
+		}
+		if (file_cache_max_file_size > g_buff_size - \
+				(int)sizeof(TrackerHeader))
+		{
+			logWarning("file: "__FILE__", line: %d, " \
+				"item \"file_cache_max_file_size\": " \
+				INT64_PRINTF_FORMAT" is too large, " \
+				"change to %d", __LINE__, \
+				file_cache_max_file_size, g_buff_size - \
+				(int)sizeof(TrackerHeader));
+			file_cache_max_file_size = g_buff_size - \
+				sizeof(TrackerHeader);
+		}
+		g_file_cache_max_file_size = file_cache_max_file_size;
+
 		g_disk_rw_separated = iniGetBoolValue(NULL, \
 				"disk_rw_separated", &iniContext, true);
 
@@ -1298,6 +1370,209 @@ int storage_func_init(const char *filename, \
 				"disk_rw_direct", &iniContext, false);
 		*/
 
+#if defined(OS_LINUX)
+		g_use_sendfile = iniGetBoolValue(NULL, \
+				"use_sendfile", &iniContext, true);
+		g_use_splice = iniGetBoolValue(NULL, \
+				"use_splice", &iniContext, true);
+#else
+		g_use_sendfile = false;
+		g_use_splice = false;
+#endif
+
+		g_use_upload_pipeline = iniGetBoolValue(NULL, \
+				"use_upload_pipeline", &iniContext, true);
+
+		pDiskIOEngine = iniGetStrValue(NULL, \
+				"disk_io_engine", &iniContext);
+		if (pDiskIOEngine == NULL || *pDiskIOEngine == '\0' || \
+			strcasecmp(pDiskIOEngine, "thread") == 0)
+		{
+			g_disk_io_engine = STORAGE_DISK_IO_ENGINE_THREAD;
+		}
+		else if (strcasecmp(pDiskIOEngine, "io_uring") == 0)
+		{
+#ifdef WITH_IO_URING
+			g_disk_io_engine = STORAGE_DISK_IO_ENGINE_IO_URING;
+#else
+			logError("file: "__FILE__", line: %d, " \
+				"disk_io_engine: io_uring not supported, " \
+				"the program is compiled without io_uring", \
+				__LINE__);
+			result = EINVAL;
+			break;
+#endif
+		}
+		else
+		{
+			logError("file: "__FILE__", line: %d, " \
+				"invalid disk_io_engine: %s, " \
+				"it should be thread or io_uring", \
+				__LINE__, pDiskIOEngine);
+			result = EINVAL;
+			break;
+		}
+
+		g_io_uring_queue_depth = iniGetIntValue(NULL, \
+				"io_uring_queue_depth", &iniContext, \
+				STORAGE_DEFAULT_IO_URING_QUEUE_DEPTH);
+		if (g_io_uring_queue_depth <= 0)
+		{
+			g_io_uring_queue_depth = \
+				STORAGE_DEFAULT_IO_URING_QUEUE_DEPTH;
+		}
+
+		pTrunkLeaseSize = iniGetStrValue(NULL, \
+			"trunk_lease_size", &iniContext);
+		if (pTrunkLeaseSize == NULL)
+		{
+			trunk_lease_size = STORAGE_DEFAULT_TRUNK_LEASE_SIZE;
+		}
+		else if ((result=parse_bytes(pTrunkLeaseSize, 1, \
+				&trunk_lease_size)) != 0)
+		{
+			break;
+		}
+		if (trunk_lease_size < 0 || trunk_lease_size > 1024 * \
+				FDFS_ONE_MB)
+		{
+			logError("file: "__FILE__", line: %d, " \
+				"item \"trunk_lease_size\": " \
+				INT64_PRINTF_FORMAT" is invalid", \
+				__LINE__, trunk_lease_size);
+			result = EINVAL;
+			break;
+		}
+		g_trunk_lease_size = trunk_lease_size;
+
+		g_trunk_lease_ttl = iniGetIntValue(NULL, \
+				"trunk_lease_ttl", &iniContext, \
+				STORAGE_DEFAULT_TRUNK_LEASE_TTL);
+		if (g_trunk_lease_ttl <= 0)
+		{
+			g_trunk_lease_ttl = STORAGE_DEFAULT_TRUNK_LEASE_TTL;
+		}
+
+		g_trunk_compact_interval = iniGetIntValue(NULL, \
+				"trunk_compact_interval", &iniContext, 0);
+		if (g_trunk_compact_interval < 0)
+		{
+			g_trunk_compact_interval = 0;
+		}
+
+		g_trunk_compact_free_ratio = iniGetIntValue(NULL, \
+				"trunk_compact_free_ratio", &iniContext, \
+				STORAGE_DEFAULT_TRUNK_COMPACT_FREE_RATIO);
+		if (g_trunk_compact_free_ratio <= 0 || \
+			g_trunk_compact_free_ratio >= 100)
+		{
+			logError("file: "__FILE__", line: %d, " \
+				"item \"trunk_compact_free_ratio\": %d " \
+				"is invalid, it should be in (0, 100)", \
+				__LINE__, g_trunk_compact_free_ratio);
+			result = EINVAL;
+			break;
+		}
+
+		pTrunkCompactRate = iniGetStrValue(NULL, \
+			"trunk_compact_rate", &iniContext);
+		if (pTrunkCompactRate == NULL)
+		{
+			trunk_compact_rate = STORAGE_DEFAULT_TRUNK_COMPACT_RATE;
+		}
+		else if ((result=parse_bytes(pTrunkCompactRate, 1, \
+				&trunk_compact_rate)) != 0)
+		{
+			break;
+		}
+		if (trunk_compact_rate <= 0 || trunk_compact_rate > 1024 * \
+				FDFS_ONE_MB)
+		{
+			logError("file: "__FILE__", line: %d, " \
+				"item \"trunk_compact_rate\": " \
+				INT64_PRINTF_FORMAT" is invalid", \
+				__LINE__, trunk_compact_rate);
+			result = EINVAL;
+			break;
+		}
+		g_trunk_compact_rate = trunk_compact_rate;
+
+		g_trunk_compact_file_min_age = iniGetIntValue(NULL, \
+				"trunk_compact_file_min_age", &iniContext, \
+				STORAGE_DEFAULT_TRUNK_COMPACT_FILE_MIN_AGE);
+		if (g_trunk_compact_file_min_age < 0)
+		{
+			g_trunk_compact_file_min_age = \
+				STORAGE_DEFAULT_TRUNK_COMPACT_FILE_MIN_AGE;
+		}
+
+		g_trunk_checkpoint_interval = iniGetIntValue(NULL, \
+				"trunk_checkpoint_interval", &iniContext, \
+				STORAGE_DEFAULT_TRUNK_CHECKPOINT_INTERVAL);
+		if (g_trunk_checkpoint_interval < 0)
+		{
+			g_trunk_checkpoint_interval = 0;
+		}
+
+		g_trunk_init_load_threads = iniGetIntValue(NULL, \
+				"trunk_init_load_threads", &iniContext, 1);
+		if (g_trunk_init_load_threads <= 0)
+		{
+			g_trunk_init_load_threads = 1;
+		}
+
+		g_trunk_create_file_runway = iniGetIntValue(NULL, \
+				"trunk_create_file_runway", &iniContext, \
+				STORAGE_DEFAULT_TRUNK_CREATE_FILE_RUNWAY);
+		if (g_trunk_create_file_runway < 0)
+		{
+			g_trunk_create_file_runway = 0;
+		}
+
+		g_trunk_fd_cache_size = iniGetIntValue(NULL, \
+				"trunk_fd_cache_size", &iniContext, \
+				STORAGE_DEFAULT_TRUNK_FD_CACHE_SIZE);
+		if (g_trunk_fd_cache_size < 0)
+		{
+			g_trunk_fd_cache_size = 0;
+		}
+
+		pBinlogFormat = iniGetStrValue(NULL, \
+				"trunk_binlog_format", &iniContext);
+		if (pBinlogFormat == NULL || *pBinlogFormat == '\0' || \
+			strcasecmp(pBinlogFormat, "text") == 0)
+		{
+			g_trunk_binlog_format = STORAGE_BINLOG_FORMAT_TEXT;
+		}
+		else if (strcasecmp(pBinlogFormat, "binary") == 0)
+		{
+			g_trunk_binlog_format = STORAGE_BINLOG_FORMAT_BINARY;
+		}
+		else
+		{
+			logError("file: "__FILE__", line: %d, " \
+				"invalid trunk_binlog_format: %s, " \
+				"it should be text or binary", \
+				__LINE__, pBinlogFormat);
+			result = EINVAL;
+			break;
+		}
+
+		/* the old version skips the moved trunk files (op type M)
+		   and can't read the moved small files, so the compaction
+		   is not allowed by the text format for downgrade */
+		if (g_trunk_binlog_format == STORAGE_BINLOG_FORMAT_TEXT && \
+			g_trunk_compact_interval > 0)
+		{
+			logError("file: "__FILE__", line: %d, " \
+				"trunk_compact_interval: %d > 0, the trunk " \
+				"files are compacted only when " \
+				"trunk_binlog_format is binary", \
+				__LINE__, g_trunk_compact_interval);
+			result = EINVAL;
+			break;
+		}
+
 		pRunByGroup = iniGetStrValue(NULL, "run_by_group", &iniContext);
 		pRunByUser = iniGetStrValue(NULL, "run_by_user", &iniContext);
 		if (pRunByGroup == NULL)
@@ -1417,6 +1692,56 @@ int storage_func_init(const char *filename, \
 			g_write_mark_file_freq = FDFS_DEFAULT_SYNC_MARK_FILE_FREQ;
 		}
 
+		g_sync_window_size = iniGetIntValue(NULL, \
+				"sync_window_size", &iniContext, \
+				STORAGE_DEFAULT_SYNC_WINDOW_SIZE);
+		if (g_sync_window_size <= 0)
+		{
+			g_sync_window_size = 1;
+		}
+
+		g_sync_stream_count = iniGetIntValue(NULL, \
+				"sync_stream_count", &iniContext, \
+				STORAGE_DEFAULT_SYNC_STREAM_COUNT);
+		if (g_sync_stream_count <= 0)
+		{
+			g_sync_stream_count = 1;
+		}
+
+		pBinlogFormat = iniGetStrValue(NULL, \
+				"binlog_format", &iniContext);
+		if (pBinlogFormat == NULL || *pBinlogFormat == '\0' || \
+			strcasecmp(pBinlogFormat, "text") == 0)
+		{
+			g_binlog_format = STORAGE_BINLOG_FORMAT_TEXT;
+		}
+		else if (strcasecmp(pBinlogFormat, "binary") == 0)
+		{
+			g_binlog_format = STORAGE_BINLOG_FORMAT_BINARY;
+		}
+		else
+		{
+			logError("file: "__FILE__", line: %d, " \
+				"invalid binlog_format: %s, " \
+				"it should be text or binary", \
+				__LINE__, pBinlogFormat);
+			result = EINVAL;
+			break;
+		}
+
+		g_convert_text_binlog = iniGetBoolValue(NULL, \
+				"convert_text_binlog", &iniContext, false);
+
+		g_compact_binlog_on_startup = iniGetBoolValue(NULL, \
+				"compact_binlog_on_startup", &iniContext, false);
+
+		g_binlog_compact_interval = iniGetIntValue(NULL, \
+				"binlog_compact_interval", &iniContext, 0);
+		if (g_binlog_compact_interval < 0)
+		{
+			g_binlog_compact_interval = 0;
+		}
+
 
 		g_sync_stat_file_interval = iniGetIntValue(NULL, \
 				"sync_stat_file_interval", &iniContext, \
@@ -1670,12 +1995,29 @@ int storage_func_init(const char *filename, \
 			"max_connections=%d, accept_threads=%d, " \
 			"work_threads=%d, "    \
 			"disk_rw_separated=%d, disk_reader_threads=%d, " \
-			"disk_writer_threads=%d, " \
+			"disk_writer_threads=%d, use_sendfile=%d, " \
+			"use_upload_pipeline=%d, use_splice=%d, " \
+			"file_cache_size="INT64_PRINTF_FORMAT" MB, " \
+			"file_cache_max_file_size=%d KB, " \
+			"disk_io_engine=%s, io_uring_queue_depth=%d, " \
+			"trunk_lease_size=%d KB, trunk_lease_ttl=%ds, " \
+			"trunk_compact_interval=%ds, " \
+			"trunk_compact_free_ratio=%d%%, " \
+			"trunk_compact_rate=%d KB, " \
+			"trunk_compact_file_min_age=%ds, " \
+			"trunk_checkpoint_interval=%ds, " \
+			"trunk_init_load_threads=%d, " \
+			"trunk_create_file_runway=%ds, " \
+			"trunk_fd_cache_size=%d, trunk_binlog_format=%s, " \
 			"buff_size=%dKB, heart_beat_interval=%ds, " \
 			"stat_report_interval=%ds, tracker_server_count=%d, " \
 			"sync_wait_msec=%dms, sync_interval=%dms, " \
 			"sync_start_time=%02d:%02d, sync_end_time=%02d:%02d, "\
-			"write_mark_file_freq=%d, " \
+			"write_mark_file_freq=%d, sync_window_size=%d, " \
+			"sync_stream_count=%d, binlog_format=%s, " \
+			"convert_text_binlog=%d, " \
+			"compact_binlog_on_startup=%d, " \
+			"binlog_compact_interval=%ds, " \
 			"allow_ip_count=%d, " \
 			"file_distribute_path_mode=%d, " \
 			"file_distribute_rotate_count=%d, " \
@@ -1707,13 +2049,30 @@ int storage_func_init(const char *filename, \
 			g_client_bind_addr, g_max_connections, \
 			g_accept_threads, g_work_threads, g_disk_rw_separated, \
 			g_disk_reader_threads, g_disk_writer_threads, \
+			g_use_sendfile, g_use_upload_pipeline, g_use_splice, \
+			g_file_cache_size / FDFS_ONE_MB, \
+			g_file_cache_max_file_size / 1024, \
+			g_disk_io_engine == \
+			STORAGE_DISK_IO_ENGINE_IO_URING ? "io_uring" : "thread", \
+			g_io_uring_queue_depth, g_trunk_lease_size / 1024, \
+			g_trunk_lease_ttl, g_trunk_compact_interval, \
+			g_trunk_compact_free_ratio, g_trunk_compact_rate / 1024, \
+			g_trunk_compact_file_min_age, \
+			g_trunk_checkpoint_interval, g_trunk_init_load_threads, \
+			g_trunk_create_file_runway, g_trunk_fd_cache_size, \
+			g_trunk_binlog_format == STORAGE_BINLOG_FORMAT_TEXT ? \
+			"text" : "binary", \
 			g_buff_size / 1024, \
 			g_heart_beat_interval, g_stat_report_interval, \
 			g_tracker_group.server_count, g_sync_wait_usec / 1000, \
 			g_sync_interval / 1000, \
 			g_sync_start_time.hour, g_sync_start_time.minute, \
 			g_sync_end_time.hour, g_sync_end_time.minute, \
-			g_write_mark_file_freq, \
+			g_write_mark_file_freq, g_sync_window_size, \
+			g_sync_stream_count, g_binlog_format == \
+			STORAGE_BINLOG_FORMAT_TEXT ? "text" : "binary", \
+			g_convert_text_binlog, g_compact_binlog_on_startup, \
+			g_binlog_compact_interval, \
 			g_allow_ip_count, g_file_distribute_path_mode, \
 			g_file_distribute_rotate_count, \
 			g_fsync_after_written_bytes, g_sync_log_buff_interval, \
@@ -1844,6 +2203,7 @@ int storage_func_destroy()
 	}
 
 	close_ret = storage_close_stat_file();
+	storage_stat_destroy();
 
 	if (g_use_access_log)
 	{
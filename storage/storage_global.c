@@ -33,6 +33,24 @@ bool g_disk_rw_separated = true;
 int g_disk_reader_threads = DEFAULT_DISK_READER_THREADS;
 int g_disk_writer_threads = DEFAULT_DISK_WRITER_THREADS;
 int g_extra_open_file_flags = 0;
+bool g_use_sendfile = false;
+bool g_use_upload_pipeline = true;
+bool g_use_splice = false;
+int64_t g_file_cache_size = 0;
+int g_file_cache_max_file_size = STORAGE_DEFAULT_FILE_CACHE_MAX_FILE_SIZE;
+byte g_disk_io_engine = STORAGE_DISK_IO_ENGINE_THREAD;
+int g_io_uring_queue_depth = STORAGE_DEFAULT_IO_URING_QUEUE_DEPTH;
+int g_trunk_lease_size = STORAGE_DEFAULT_TRUNK_LEASE_SIZE;
+int g_trunk_lease_ttl = STORAGE_DEFAULT_TRUNK_LEASE_TTL;
+int g_trunk_compact_interval = 0;
+int g_trunk_compact_free_ratio = STORAGE_DEFAULT_TRUNK_COMPACT_FREE_RATIO;
+int g_trunk_compact_rate = STORAGE_DEFAULT_TRUNK_COMPACT_RATE;
+int g_trunk_compact_file_min_age = STORAGE_DEFAULT_TRUNK_COMPACT_FILE_MIN_AGE;
+int g_trunk_checkpoint_interval = STORAGE_DEFAULT_TRUNK_CHECKPOINT_INTERVAL;
+int g_trunk_init_load_threads = 1;
+int g_trunk_create_file_runway = STORAGE_DEFAULT_TRUNK_CREATE_FILE_RUNWAY;
+int g_trunk_fd_cache_size = STORAGE_DEFAULT_TRUNK_FD_CACHE_SIZE;
+byte g_trunk_binlog_format = STORAGE_BINLOG_FORMAT_TEXT;
 
 int g_file_distribute_path_mode = FDFS_FILE_DIST_PATH_ROUND_ROBIN;
 int g_file_distribute_rotate_count = FDFS_FILE_DIST_DEFAULT_ROTATE_COUNT;
@@ -60,6 +78,12 @@ bool g_sync_part_time = false;
 int g_sync_log_buff_interval = SYNC_LOG_BUFF_DEF_INTERVAL;
 int g_sync_binlog_buff_interval = SYNC_BINLOG_BUFF_DEF_INTERVAL;
 int g_write_mark_file_freq = FDFS_DEFAULT_SYNC_MARK_FILE_FREQ;
+int g_sync_window_size = STORAGE_DEFAULT_SYNC_WINDOW_SIZE;
+int g_sync_stream_count = STORAGE_DEFAULT_SYNC_STREAM_COUNT;
+byte g_binlog_format = STORAGE_BINLOG_FORMAT_TEXT;
+bool g_convert_text_binlog = false;
+bool g_compact_binlog_on_startup = false;
+int g_binlog_compact_interval = 0;
 int g_sync_stat_file_interval = DEFAULT_SYNC_STAT_FILE_INTERVAL;
 
 FDFSStorageStat g_storage_stat;
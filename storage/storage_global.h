@@ -41,6 +41,25 @@
 #define STORAGE_FILE_SIGNATURE_METHOD_HASH  1
 #define STORAGE_FILE_SIGNATURE_METHOD_MD5   2
 
+#define STORAGE_DISK_IO_ENGINE_THREAD    1
+#define STORAGE_DISK_IO_ENGINE_IO_URING  2
+
+#define STORAGE_BINLOG_FORMAT_TEXT    1
+#define STORAGE_BINLOG_FORMAT_BINARY  2
+
+#define STORAGE_DEFAULT_IO_URING_QUEUE_DEPTH  256
+#define STORAGE_DEFAULT_FILE_CACHE_MAX_FILE_SIZE  (64 * 1024)
+#define STORAGE_DEFAULT_TRUNK_LEASE_SIZE  (4 * 1024 * 1024)
+#define STORAGE_DEFAULT_TRUNK_LEASE_TTL   300
+#define STORAGE_DEFAULT_TRUNK_COMPACT_FREE_RATIO  30
+#define STORAGE_DEFAULT_TRUNK_COMPACT_RATE  (8 * 1024 * 1024)
+#define STORAGE_DEFAULT_TRUNK_COMPACT_FILE_MIN_AGE  3600
+#define STORAGE_DEFAULT_TRUNK_CHECKPOINT_INTERVAL   300
+#define STORAGE_DEFAULT_TRUNK_CREATE_FILE_RUNWAY    600
+#define STORAGE_DEFAULT_TRUNK_FD_CACHE_SIZE         256
+#define STORAGE_DEFAULT_SYNC_WINDOW_SIZE            16
+#define STORAGE_DEFAULT_SYNC_STREAM_COUNT           1
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -79,6 +98,24 @@ extern bool g_disk_rw_separated;  //if disk read / write separated
 extern int g_disk_reader_threads; //disk reader thread count per store base path
 extern int g_disk_writer_threads; //disk writer thread count per store base path
 extern int g_extra_open_file_flags; //extra open file flags
+extern bool g_use_sendfile;  //if send file content by sendfile (zero copy)
+extern bool g_use_upload_pipeline; //if recv next block while writing
+extern bool g_use_splice;  //if recv file content by splice (zero copy)
+extern int64_t g_file_cache_size;   //small file cache bytes, 0 for disabled
+extern int g_file_cache_max_file_size;  //max file size to cache
+extern byte g_disk_io_engine;   //thread or io_uring
+extern int g_io_uring_queue_depth; //io_uring entries per store path
+extern int g_trunk_lease_size;  //trunk space leased once, 0 for disabled
+extern int g_trunk_lease_ttl;   //return the unused leased space after seconds
+extern int g_trunk_compact_interval;  //seconds, 0 for disabled
+extern int g_trunk_compact_free_ratio;  //min free space percent to compact
+extern int g_trunk_compact_rate;  //max bytes per second to copy
+extern int g_trunk_compact_file_min_age; //only move files older than this
+extern int g_trunk_checkpoint_interval;  //seconds, 0 for disabled
+extern int g_trunk_init_load_threads;   //threads to load the trunk snapshot
+extern int g_trunk_create_file_runway;  //seconds, 0 for disabled
+extern int g_trunk_fd_cache_size;  //cached trunk fds per store path
+extern byte g_trunk_binlog_format;  //the format of the trunk binlog records
 
 extern int g_file_distribute_path_mode;
 extern int g_file_distribute_rotate_count;
@@ -105,9 +142,15 @@ extern bool g_sync_part_time; //true for part time, false for all time of a day
 extern int g_sync_log_buff_interval; //sync log buff to disk every interval seconds
 extern int g_sync_binlog_buff_interval; //sync binlog buff to disk every interval seconds
 extern int g_write_mark_file_freq;      //write to mark file after sync N files
+extern int g_sync_window_size;  //max in-flight sync requests per dest server
+extern int g_sync_stream_count; //sync threads (connections) per dest server
+extern byte g_binlog_format;    //the format of the binlog records written
+extern bool g_convert_text_binlog;  //convert the text binlog files at startup
+extern bool g_compact_binlog_on_startup;  //compact the binlog files at startup
+extern int g_binlog_compact_interval;  //seconds, 0 for disabled
 extern int g_sync_stat_file_interval;   //sync storage stat info to disk interval
 
-extern FDFSStorageStat g_storage_stat;
+extern FDFSStorageStat g_storage_stat;  //merged from the stat shards, see storage_stat.h
 extern int g_stat_change_count;
 extern int g_sync_change_count; //sync src timestamp change counter
 
@@ -19,8 +19,12 @@
 #include <sys/types.h>
 #include <sys/time.h>
 #include <sys/socket.h>
+#include <sys/ioctl.h>
 #include <netinet/in.h>
 #include <pthread.h>
+#if defined(OS_LINUX)
+#include <sys/sendfile.h>
+#endif
 #include "shared_func.h"
 #include "sched_thread.h"
 #include "logger.h"
@@ -34,9 +38,19 @@
 #include "storage_dio.h"
 #include "storage_nio.h"
 
+//max bytes per sendfile call, avoid one connection starving others
+#define STORAGE_SENDFILE_MAX_BYTES  (4 * 1024 * 1024)
+
 static void client_sock_read(int sock, short event, void *arg);
 static void client_sock_write(int sock, short event, void *arg);
+static void client_sock_paused(int sock, short event, void *arg);
+#if defined(OS_LINUX)
+static void client_sock_sendfile(int sock, short event, void *arg);
+static void client_sock_splice(int sock, short event, void *arg);
+static int storage_splice_pipe_open(StorageFileContext *pFileContext);
+#endif
 static int storage_nio_init(struct fast_task_info *pTask);
+static void client_recv_block_done(struct fast_task_info *pTask);
 
 void add_to_deleted_list(struct fast_task_info *pTask)
 {
@@ -48,13 +62,19 @@ void add_to_deleted_list(struct fast_task_info *pTask)
 void task_finish_clean_up(struct fast_task_info *pTask)
 {
 	StorageClientInfo *pClientInfo;
+	char *read_ahead_buff;
 
 	pClientInfo = (StorageClientInfo *)pTask->arg;
+	pClientInfo->canceled = true;  //the clean func knows the disconnection
 	if (pClientInfo->clean_func != NULL)
 	{
 		pClientInfo->clean_func(pTask);
 	}
 
+#if defined(OS_LINUX)
+	storage_splice_pipe_close(&(pClientInfo->file_context));
+#endif
+
 	ioevent_detach(&pTask->thread_data->ev_puller, pTask->event.fd);
 	close(pTask->event.fd);
 	pTask->event.fd = -1;
@@ -66,20 +86,33 @@ void task_finish_clean_up(struct fast_task_info *pTask)
 		pTask->event.timer.expires = 0;
 	}
 
+	/* give back the task buffer, keep the spare one for reuse */
+	if (pClientInfo->read_ahead.swapped)
+	{
+		read_ahead_buff = pTask->data;
+		pTask->data = pClientInfo->read_ahead.buff;
+	}
+	else
+	{
+		read_ahead_buff = pClientInfo->read_ahead.buff;
+	}
+
 	memset(pTask->arg, 0, sizeof(StorageClientInfo));
+	pClientInfo->read_ahead.buff = read_ahead_buff;
 	free_queue_push(pTask);
 }
 
-static int set_recv_event(struct fast_task_info *pTask)
+static int set_recv_event_ex(struct fast_task_info *pTask, \
+		IOEventCallback callback)
 {
 	int result;
 
-	if (pTask->event.callback == client_sock_read)
+	if (pTask->event.callback == callback)
 	{
 		return 0;
 	}
 
-	pTask->event.callback = client_sock_read;
+	pTask->event.callback = callback;
 	if (ioevent_modify(&pTask->thread_data->ev_puller,
 		pTask->event.fd, IOEVENT_READ, pTask) != 0)
 	{
@@ -95,16 +128,17 @@ static int set_recv_event(struct fast_task_info *pTask)
 	return 0;
 }
 
-static int set_send_event(struct fast_task_info *pTask)
+static int set_send_event_ex(struct fast_task_info *pTask, \
+		IOEventCallback callback)
 {
 	int result;
 
-	if (pTask->event.callback == client_sock_write)
+	if (pTask->event.callback == callback)
 	{
 		return 0;
 	}
 
-	pTask->event.callback = client_sock_write;
+	pTask->event.callback = callback;
 	if (ioevent_modify(&pTask->thread_data->ev_puller,
 		pTask->event.fd, IOEVENT_WRITE, pTask) != 0)
 	{
@@ -120,95 +154,231 @@ static int set_send_event(struct fast_task_info *pTask)
 	return 0;
 }
 
-void storage_recv_notify_read(int sock, short event, void *arg)
+#define set_recv_event(pTask) set_recv_event_ex(pTask, client_sock_read)
+#define set_send_event(pTask) set_send_event_ex(pTask, client_sock_write)
+
+/* start to read ahead the next block before pushing the current
+   block to the dio thread, the remain bytes come from the total length,
+   so the handlers must keep it as the length of the whole package */
+static void read_ahead_start(struct fast_task_info *pTask)
 {
-	struct fast_task_info *pTask;
 	StorageClientInfo *pClientInfo;
-	long task_addr;
 	int64_t remain_bytes;
-	int bytes;
-	int result;
 
-	while (1)
+	pClientInfo = (StorageClientInfo *)pTask->arg;
+	remain_bytes = pClientInfo->total_length - pClientInfo->total_offset;
+	if (!g_use_upload_pipeline || remain_bytes <= 0)
 	{
-		if ((bytes=read(sock, &task_addr, sizeof(task_addr))) < 0)
-		{
-			if (!(errno == EAGAIN || errno == EWOULDBLOCK))
-			{
-				logError("file: "__FILE__", line: %d, " \
-					"call read failed, " \
-					"errno: %d, error info: %s", \
-					__LINE__, errno, STRERROR(errno));
-			}
+		return;
+	}
 
-			break;
-		}
-		else if (bytes == 0)
+	if (pClientInfo->read_ahead.buff == NULL)
+	{
+		pClientInfo->read_ahead.buff = (char *)malloc(pTask->size);
+		if (pClientInfo->read_ahead.buff == NULL)
 		{
 			logError("file: "__FILE__", line: %d, " \
-				"call read failed, end of file", __LINE__);
-			break;
+				"malloc %d bytes fail, " \
+				"errno: %d, error info: %s", \
+				__LINE__, pTask->size, \
+				errno, STRERROR(errno));
+			return;
 		}
+	}
 
-		pTask = (struct fast_task_info *)task_addr;
-		pClientInfo = (StorageClientInfo *)pTask->arg;
+	pClientInfo->read_ahead.offset = 0;
+	pClientInfo->read_ahead.length = remain_bytes > pTask->size ? \
+					pTask->size : remain_bytes;
+	pClientInfo->read_ahead.err_no = 0;
+}
 
-		if (pTask->event.fd < 0)  //quit flag
-		{
-			return;
-		}
+static void client_sock_read_ahead(int sock, struct fast_task_info *pTask)
+{
+	StorageClientInfo *pClientInfo;
+	int bytes;
 
-		/* //logInfo("=====thread index: %d, pTask->event.fd=%d", \
-			pClientInfo->nio_thread_index, pTask->event.fd);
-		*/
+	pClientInfo = (StorageClientInfo *)pTask->arg;
+	if (pClientInfo->read_ahead.err_no != 0 || \
+		pClientInfo->read_ahead.offset >= \
+		pClientInfo->read_ahead.length)
+	{
+		return;  //wait for the dio thread
+	}
 
-		if (pClientInfo->stage & FDFS_STORAGE_STAGE_DIO_THREAD)
-		{
-			pClientInfo->stage &= ~FDFS_STORAGE_STAGE_DIO_THREAD;
-		}
-		switch (pClientInfo->stage)
-		{
-			case FDFS_STORAGE_STAGE_NIO_INIT:
-				result = storage_nio_init(pTask);
-				break;
-			case FDFS_STORAGE_STAGE_NIO_RECV:
-				pTask->offset = 0;
-				remain_bytes = pClientInfo->total_length - \
-					       pClientInfo->total_offset;
-				if (remain_bytes > pTask->size)
-				{
-					pTask->length = pTask->size;
-				}
-				else
-				{
-					pTask->length = remain_bytes;
-				}
+	fast_timer_modify(&pTask->thread_data->timer,
+		&pTask->event.timer, g_current_time +
+		g_fdfs_network_timeout);
+	bytes = recv(sock, pClientInfo->read_ahead.buff + \
+			pClientInfo->read_ahead.offset, \
+			pClientInfo->read_ahead.length - \
+			pClientInfo->read_ahead.offset, 0);
+	if (bytes > 0)
+	{
+		pClientInfo->read_ahead.offset += bytes;
+	}
+	else if (bytes == 0)
+	{
+		pClientInfo->read_ahead.err_no = ENOTCONN;
+	}
+	else if (!(errno == EAGAIN || errno == EWOULDBLOCK))
+	{
+		pClientInfo->read_ahead.err_no = errno != 0 ? errno : EIO;
+	}
+}
+
+/* the dio thread has written the current block,
+   switch to the buffer read ahead */
+static int read_ahead_done(struct fast_task_info *pTask)
+{
+	StorageClientInfo *pClientInfo;
+	char *buff;
+
+	pClientInfo = (StorageClientInfo *)pTask->arg;
+	pClientInfo->read_ahead.length = 0;
+	if (pClientInfo->read_ahead.err_no != 0)
+	{
+		logDebug("file: "__FILE__", line: %d, " \
+			"client ip: %s, recv failed, " \
+			"errno: %d, error info: %s", __LINE__, \
+			pTask->client_ip, pClientInfo->read_ahead.err_no, \
+			STRERROR(pClientInfo->read_ahead.err_no));
+		return pClientInfo->read_ahead.err_no;
+	}
+
+	/* the write failed and the error responsed,
+	   the rest of the file can't be skipped */
+	if (pClientInfo->total_offset == 0)
+	{
+		return EIO;
+	}
+
+	buff = pTask->data;
+	pTask->data = pClientInfo->read_ahead.buff;
+	pClientInfo->read_ahead.buff = buff;
+	pClientInfo->read_ahead.swapped = !pClientInfo->read_ahead.swapped;
+
+	pTask->offset = pClientInfo->read_ahead.offset;
+	pTask->length = pTask->size;
+	if (pClientInfo->total_length - pClientInfo->total_offset < \
+		pTask->length)
+	{
+		pTask->length = pClientInfo->total_length - \
+				pClientInfo->total_offset;
+	}
+
+	if (set_recv_event(pTask) != 0)
+	{
+		return 0;
+	}
+
+	if (pTask->offset >= pTask->length)
+	{
+		client_recv_block_done(pTask);
+	}
+	else
+	{
+		client_sock_read(pTask->event.fd, IOEVENT_READ, pTask);
+	}
+
+	return 0;
+}
+
+void storage_recv_notify_read(struct fast_task_info *pTask)
+{
+	StorageClientInfo *pClientInfo;
+	int64_t remain_bytes;
+	int result;
+
+	pClientInfo = (StorageClientInfo *)pTask->arg;
+	if (pTask->event.fd < 0)  //quit flag
+	{
+		return;
+	}
+
+	/* //logInfo("=====thread index: %d, pTask->event.fd=%d", \
+		pClientInfo->nio_thread_index, pTask->event.fd);
+	*/
+
+	if (pClientInfo->stage & FDFS_STORAGE_STAGE_DIO_THREAD)
+	{
+		pClientInfo->stage &= ~FDFS_STORAGE_STAGE_DIO_THREAD;
+	}
+	if (trunk_client_request_submit(pTask))
+	{
+		return;  //resumed by the callback of the trunk request
+	}
+	if (pClientInfo->stage != FDFS_STORAGE_STAGE_NIO_RECV)
+	{
+		pClientInfo->read_ahead.length = 0;
+	}
 
-				if (set_recv_event(pTask) == 0)
+	switch (pClientInfo->stage)
+	{
+		case FDFS_STORAGE_STAGE_NIO_INIT:
+			result = storage_nio_init(pTask);
+			break;
+		case FDFS_STORAGE_STAGE_NIO_RECV:
+#if defined(OS_LINUX)
+			if (pClientInfo->file_context.use_splice && \
+				pClientInfo->total_offset > 0 && \
+				(pClientInfo->file_context.splice_pipe_size > 0 \
+				 || storage_splice_pipe_open(&pClientInfo-> \
+					file_context) == 0))
+			{
+				if (set_recv_event_ex(pTask, \
+					client_sock_splice) == 0)
 				{
-					client_sock_read(pTask->event.fd,
+					client_sock_splice(pTask->event.fd,
 						IOEVENT_READ, pTask);
 				}
 				result = 0;
 				break;
-			case FDFS_STORAGE_STAGE_NIO_SEND:
-				result = storage_send_add_event(pTask);
-				break;
-			case FDFS_STORAGE_STAGE_NIO_CLOSE:
-				result = EIO;   //close this socket
-				break;
-			default:
-				logError("file: "__FILE__", line: %d, " \
-					"invalid stage: %d", __LINE__, \
-					pClientInfo->stage);
-				result = EINVAL;
+			}
+			pClientInfo->file_context.use_splice = false;
+#endif
+
+			if (pClientInfo->read_ahead.length > 0)
+			{
+				result = read_ahead_done(pTask);
 				break;
-		}
+			}
 
-		if (result != 0)
-		{
-			add_to_deleted_list(pTask);
-		}
+			pTask->offset = 0;
+			remain_bytes = pClientInfo->total_length - \
+				       pClientInfo->total_offset;
+			if (remain_bytes > pTask->size)
+			{
+				pTask->length = pTask->size;
+			}
+			else
+			{
+				pTask->length = remain_bytes;
+			}
+
+			if (set_recv_event(pTask) == 0)
+			{
+				client_sock_read(pTask->event.fd,
+					IOEVENT_READ, pTask);
+			}
+			result = 0;
+			break;
+		case FDFS_STORAGE_STAGE_NIO_SEND:
+			result = storage_send_add_event(pTask);
+			break;
+		case FDFS_STORAGE_STAGE_NIO_CLOSE:
+			result = EIO;   //close this socket
+			break;
+		default:
+			logError("file: "__FILE__", line: %d, " \
+				"invalid stage: %d", __LINE__, \
+				pClientInfo->stage);
+			result = EINVAL;
+			break;
+	}
+
+	if (result != 0)
+	{
+		add_to_deleted_list(pTask);
 	}
 }
 
@@ -236,6 +406,56 @@ int storage_send_add_event(struct fast_task_info *pTask)
 	return 0;
 }
 
+/* the bytes of the next block are pending when the read ahead buffer of
+   the upload pipeline is full (or the next request pipelined by the peer
+   such as the sync window), stop watching the readable event until the
+   current block is dealt, because the level triggered event spins the
+   nio thread. set_recv_event restores it */
+static void client_sock_pause_read(struct fast_task_info *pTask)
+{
+	pTask->event.callback = client_sock_paused;
+	if (ioevent_modify(&pTask->thread_data->ev_puller,
+		pTask->event.fd, 0, pTask) != 0)
+	{
+		logError("file: "__FILE__", line: %d, "\
+			"ioevent_modify fail, " \
+			"errno: %d, error info: %s", \
+			__LINE__, errno, STRERROR(errno));
+		pTask->event.callback = client_sock_read;
+	}
+}
+
+static void client_sock_paused(int sock, short event, void *arg)
+{
+	struct fast_task_info *pTask;
+
+	pTask = (struct fast_task_info *)arg;
+	if (((StorageClientInfo *)pTask->arg)->canceled)
+	{
+		return;
+	}
+
+	if (event & IOEVENT_TIMEOUT)
+	{
+		pTask->event.timer.expires = g_current_time +
+			g_fdfs_network_timeout;
+		fast_timer_add(&pTask->thread_data->timer,
+			&pTask->event.timer);
+	}
+	else if (event & IOEVENT_ERROR)
+	{
+		/* the hang up and the error are reported without watching
+		   any event, stop watching the socket, otherwise they spin
+		   the nio thread. the task can't be freed while the block
+		   is being dealt, it is cleaned up when the next event
+		   can't be set (the fd is not in the poller) */
+		logDebug("file: "__FILE__", line: %d, " \
+			"client ip: %s, error event: %d while paused", \
+			__LINE__, pTask->client_ip, event);
+		ioevent_detach(&pTask->thread_data->ev_puller, sock);
+	}
+}
+
 static void client_sock_read(int sock, short event, void *arg)
 {
 	int bytes;
@@ -258,6 +478,19 @@ static void client_sock_read(int sock, short event, void *arg)
 			fast_timer_add(&pTask->thread_data->timer,
 				&pTask->event.timer);
 		}
+		else if (pClientInfo->read_ahead.length > 0 && \
+			pClientInfo->read_ahead.err_no == 0 && \
+			pClientInfo->read_ahead.offset < \
+			pClientInfo->read_ahead.length)
+		{
+			//the read ahead buffer has room
+			client_sock_read_ahead(sock, pTask);
+		}
+		else if (event & IOEVENT_READ)
+		{
+			//the read ahead buffer is full or no read ahead
+			client_sock_pause_read(pTask);
+		}
 
 		return;
 	}
@@ -382,27 +615,7 @@ static void client_sock_read(int sock, short event, void *arg)
 		pTask->offset += bytes;
 		if (pTask->offset >= pTask->length) //recv current pkg done
 		{
-			if (pClientInfo->total_offset + pTask->length >= \
-					pClientInfo->total_length)
-			{
-				/* current req recv done */
-				pClientInfo->stage = FDFS_STORAGE_STAGE_NIO_SEND;
-				pTask->req_count++;
-			}
-
-			if (pClientInfo->total_offset == 0)
-			{
-				pClientInfo->total_offset = pTask->length;
-				storage_deal_task(pTask);
-			}
-			else
-			{
-				pClientInfo->total_offset += pTask->length;
-
-				/* continue write to file */
-				storage_dio_queue_push(pTask);
-			}
-
+			client_recv_block_done(pTask);
 			return;
 		}
 	}
@@ -410,6 +623,35 @@ static void client_sock_read(int sock, short event, void *arg)
 	return;
 }
 
+static void client_recv_block_done(struct fast_task_info *pTask)
+{
+        StorageClientInfo *pClientInfo;
+
+        pClientInfo = (StorageClientInfo *)pTask->arg;
+	if (pClientInfo->total_offset + pTask->length >= \
+			pClientInfo->total_length)
+	{
+		/* current req recv done */
+		pClientInfo->stage = FDFS_STORAGE_STAGE_NIO_SEND;
+		pTask->req_count++;
+	}
+
+	if (pClientInfo->total_offset == 0)
+	{
+		pClientInfo->total_offset = pTask->length;
+		storage_deal_task(pTask);
+	}
+	else
+	{
+		pClientInfo->total_offset += pTask->length;
+
+		/* continue write to file, and recv the next block
+		   to the read ahead buffer meanwhile */
+		read_ahead_start(pTask);
+		storage_dio_queue_push(pTask);
+	}
+}
+
 static void client_sock_write(int sock, short event, void *arg)
 {
 	int bytes;
@@ -513,6 +755,15 @@ static void client_sock_write(int sock, short event, void *arg)
 			{
 				pTask->length = 0;
 
+#if defined(OS_LINUX)
+				if (pClientInfo->file_context.use_sendfile)
+				{
+					/* zero copy from page cache to socket */
+					client_sock_sendfile(sock, event, pTask);
+					return;
+				}
+#endif
+
 				/* continue read from file */
 				storage_dio_queue_push(pTask);
 			}
@@ -522,3 +773,301 @@ static void client_sock_write(int sock, short event, void *arg)
 	}
 }
 
+
+#if defined(OS_LINUX)
+static void client_sock_sendfile(int sock, short event, void *arg)
+{
+	int bytes;
+	int result;
+	int64_t remain_bytes;
+	off_t offset;
+	struct fast_task_info *pTask;
+        StorageClientInfo *pClientInfo;
+	StorageFileContext *pFileContext;
+
+	pTask = (struct fast_task_info *)arg;
+        pClientInfo = (StorageClientInfo *)pTask->arg;
+	pFileContext = &(pClientInfo->file_context);
+	if (pClientInfo->canceled)
+	{
+		return;
+	}
+
+	if (event & IOEVENT_TIMEOUT)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"client ip: %s, send timeout", \
+			__LINE__, pTask->client_ip);
+
+		pFileContext->done_callback(pTask, ETIMEDOUT);
+		task_finish_clean_up(pTask);
+		return;
+	}
+
+	if (event & IOEVENT_ERROR)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"client ip: %s, send error event: %d, "
+			"close connection", __LINE__, pTask->client_ip, event);
+
+		pFileContext->done_callback(pTask, EIO);
+		task_finish_clean_up(pTask);
+		return;
+	}
+
+	while (1)
+	{
+		fast_timer_modify(&pTask->thread_data->timer,
+			&pTask->event.timer, g_current_time +
+			g_fdfs_network_timeout);
+
+		remain_bytes = pFileContext->end - pFileContext->offset;
+		if (remain_bytes > STORAGE_SENDFILE_MAX_BYTES)
+		{
+			remain_bytes = STORAGE_SENDFILE_MAX_BYTES;
+		}
+
+		offset = pFileContext->offset;
+		bytes = sendfile(sock, pFileContext->fd, &offset, remain_bytes);
+		if (bytes < 0)
+		{
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+			{
+				set_send_event_ex(pTask, client_sock_sendfile);
+				return;
+			}
+
+			result = errno != 0 ? errno : EIO;
+			logError("file: "__FILE__", line: %d, " \
+				"client ip: %s, sendfile %s fail, " \
+				"errno: %d, error info: %s", \
+				__LINE__, pTask->client_ip, \
+				pFileContext->filename, \
+				result, STRERROR(result));
+
+			pFileContext->done_callback(pTask, result);
+			task_finish_clean_up(pTask);
+			return;
+		}
+		else if (bytes == 0)
+		{
+			logError("file: "__FILE__", line: %d, " \
+				"client ip: %s, sendfile %s fail, " \
+				"unexpected end of file, offset: " \
+				INT64_PRINTF_FORMAT, __LINE__, \
+				pTask->client_ip, pFileContext->filename, \
+				pFileContext->offset);
+
+			pFileContext->done_callback(pTask, EIO);
+			task_finish_clean_up(pTask);
+			return;
+		}
+
+		pFileContext->offset += bytes;
+		pClientInfo->total_offset += bytes;
+		if (pFileContext->offset >= pFileContext->end)
+		{
+			break;
+		}
+	}
+
+	/* file send done, close it */
+	dio_close_file(pFileContext);
+	pFileContext->done_callback(pTask, 0);
+	pFileContext->use_sendfile = false;
+
+	if (set_recv_event(pTask) != 0)
+	{
+		return;
+	}
+
+	/*  reponse done, try to recv again */
+	pClientInfo->total_length = 0;
+	pClientInfo->total_offset = 0;
+	pTask->offset = 0;
+	pTask->length = 0;
+
+	pClientInfo->stage = FDFS_STORAGE_STAGE_NIO_RECV;
+}
+#endif
+
+#if defined(OS_LINUX)
+static int storage_splice_pipe_open(StorageFileContext *pFileContext)
+{
+	int result;
+
+	if (pipe(pFileContext->splice_pipe_fds) != 0)
+	{
+		result = errno != 0 ? errno : EMFILE;
+		logError("file: "__FILE__", line: %d, " \
+			"call pipe fail, " \
+			"errno: %d, error info: %s", \
+			__LINE__, result, STRERROR(result));
+		return result;
+	}
+
+	/* one buffer size per splice as the recv by buffer */
+	fcntl(pFileContext->splice_pipe_fds[1], F_SETPIPE_SZ, g_buff_size);
+	pFileContext->splice_pipe_size = fcntl( \
+			pFileContext->splice_pipe_fds[1], F_GETPIPE_SZ);
+	if (pFileContext->splice_pipe_size <= 0)
+	{
+		pFileContext->splice_pipe_size = 64 * 1024;
+	}
+	pFileContext->splice_bytes = 0;
+
+	return 0;
+}
+
+void storage_splice_pipe_close(StorageFileContext *pFileContext)
+{
+	if (pFileContext->splice_pipe_size == 0)
+	{
+		return;
+	}
+
+	close(pFileContext->splice_pipe_fds[0]);
+	close(pFileContext->splice_pipe_fds[1]);
+	pFileContext->splice_pipe_size = 0;
+	pFileContext->splice_bytes = 0;
+}
+
+/* the nio thread only moves the bytes from the socket to the pipe,
+   the dio thread moves them from the pipe to the file (dio_write_file),
+   so the disk write never blocks the nio thread. the pipe is pushed to
+   the dio thread only when it is full or the file content is done */
+static void client_sock_splice(int sock, short event, void *arg)
+{
+	int bytes;
+	int recv_bytes;
+	int pending_bytes;
+	bool pipe_full;
+	int64_t remain_bytes;
+	struct fast_task_info *pTask;
+        StorageClientInfo *pClientInfo;
+	StorageFileContext *pFileContext;
+
+	pTask = (struct fast_task_info *)arg;
+        pClientInfo = (StorageClientInfo *)pTask->arg;
+	pFileContext = &(pClientInfo->file_context);
+	if (pClientInfo->canceled)
+	{
+		return;
+	}
+
+	if (pClientInfo->stage != FDFS_STORAGE_STAGE_NIO_RECV)
+	{
+		if (event & IOEVENT_TIMEOUT) {
+			pTask->event.timer.expires = g_current_time +
+				g_fdfs_network_timeout;
+			fast_timer_add(&pTask->thread_data->timer,
+				&pTask->event.timer);
+		}
+		else if (event & IOEVENT_READ)
+		{
+			client_sock_pause_read(pTask);
+		}
+
+		return;
+	}
+
+	if (event & IOEVENT_TIMEOUT)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"client ip: %s, recv timeout, " \
+			"recv offset: "INT64_PRINTF_FORMAT", " \
+			"expect length: "INT64_PRINTF_FORMAT, \
+			__LINE__, pTask->client_ip, \
+			pClientInfo->total_offset, pClientInfo->total_length);
+
+		task_finish_clean_up(pTask);
+		return;
+	}
+
+	if (event & IOEVENT_ERROR)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"client ip: %s, recv error event: %d, "
+			"close connection", __LINE__, pTask->client_ip, event);
+
+		task_finish_clean_up(pTask);
+		return;
+	}
+
+	fast_timer_modify(&pTask->thread_data->timer,
+		&pTask->event.timer, g_current_time +
+		g_fdfs_network_timeout);
+	pipe_full = false;
+	while (pClientInfo->total_offset < pClientInfo->total_length && \
+		pFileContext->splice_bytes < pFileContext->splice_pipe_size)
+	{
+		remain_bytes = pClientInfo->total_length - \
+				pClientInfo->total_offset;
+		recv_bytes = pFileContext->splice_pipe_size - \
+				pFileContext->splice_bytes;
+		if (recv_bytes > remain_bytes)
+		{
+			recv_bytes = remain_bytes;
+		}
+
+		bytes = splice(sock, NULL, pFileContext->splice_pipe_fds[1], \
+			NULL, recv_bytes, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+		if (bytes < 0)
+		{
+			/* the socket is not readable or the pipe is full,
+			   the pipe may run out of its page buffers before
+			   the bytes reach the pipe size, so the pipe is full
+			   when the socket still has the bytes to read */
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+			{
+				pipe_full = ioctl(sock, FIONREAD, \
+					&pending_bytes) == 0 && \
+					pending_bytes > 0;
+				break;
+			}
+
+			logError("file: "__FILE__", line: %d, " \
+				"client ip: %s, recv failed, " \
+				"errno: %d, error info: %s", \
+				__LINE__, pTask->client_ip, \
+				errno, STRERROR(errno));
+
+			task_finish_clean_up(pTask);
+			return;
+		}
+		else if (bytes == 0)
+		{
+			logDebug("file: "__FILE__", line: %d, " \
+				"client ip: %s, recv failed, " \
+				"connection disconnected.", \
+				__LINE__, pTask->client_ip);
+
+			task_finish_clean_up(pTask);
+			return;
+		}
+
+		pFileContext->splice_bytes += bytes;
+		pClientInfo->total_offset += bytes;
+	}
+
+	if (pFileContext->splice_bytes == 0 || (!pipe_full && \
+		pFileContext->splice_bytes < pFileContext->splice_pipe_size \
+		&& pClientInfo->total_offset < pClientInfo->total_length))
+	{
+		return;  //wait for the next readable event to fill the pipe
+	}
+
+	if (pClientInfo->total_offset >= pClientInfo->total_length)
+	{
+		/* recv done, the dio thread writes the last bytes,
+		   then fsyncs and closes the file */
+		pClientInfo->stage = FDFS_STORAGE_STAGE_NIO_SEND;
+		pTask->req_count++;
+	}
+
+	pTask->length = 0;
+	pFileContext->buff_offset = 0;
+	storage_dio_queue_push(pTask);
+}
+#endif
+
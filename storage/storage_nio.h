@@ -21,6 +21,7 @@
 #include "storage_global.h"
 #include "fdht_types.h"
 #include "trunk_mem.h"
+#include "trunk_client.h"
 #include "md5.h"
 
 #define FDFS_STORAGE_STAGE_NIO_INIT   0
@@ -28,6 +29,7 @@
 #define FDFS_STORAGE_STAGE_NIO_SEND   2
 #define FDFS_STORAGE_STAGE_NIO_CLOSE  4  //close socket
 #define FDFS_STORAGE_STAGE_DIO_THREAD 8
+#define FDFS_STORAGE_STAGE_TRUNK_WAIT 16  //wait for the trunk server
 
 #define FDFS_STORAGE_FILE_OP_READ     'R'
 #define FDFS_STORAGE_FILE_OP_WRITE    'W'
@@ -78,6 +80,24 @@ typedef struct
 	int meta_bytes;
 } StorageSetMetaInfo;
 
+/* one file of the batch download */
+typedef struct
+{
+	int index;       //the index in the request
+	int status;      //0 for ok, the error no when stat fail
+	int64_t offset;  //the start offset of the full file
+	int64_t bytes;   //the bytes to send
+	char filename[MAX_PATH_SIZE + 128];  	//full filename
+} StorageBatchDownloadEntry;
+
+typedef struct
+{
+	StorageBatchDownloadEntry *entries;  //sorted by filename and offset
+	int count;
+	int current;       //the entry to send
+	bool frame_done;   //if the frame header of current entry is filled
+} StorageBatchDownloadInfo;
+
 typedef struct
 {
 	char filename[MAX_PATH_SIZE + 128];  	//full filename
@@ -89,6 +109,9 @@ typedef struct
 	char sync_flag;     //sync flag log to binlog
 	bool calc_crc32;    //if calculate file content hash code
 	bool calc_file_hash;      //if calculate file content hash code
+	bool use_sendfile;  //if send file content by sendfile in nio thread
+	bool use_splice;    //if recv file content by splice in nio thread
+	bool fill_cache;    //if put the file content read to the file cache
 	int open_flags;           //open file flags
 	int file_hash_codes[4];   //file hash code
 	int crc32;   //file content crc32 signature
@@ -100,15 +123,21 @@ typedef struct
 		StorageSetMetaInfo setmeta;
 	} extra_info;
 
+	StorageBatchDownloadInfo batch;  //for batch download
+
 	int dio_thread_index;		//dio thread index
 	int timestamp2log;		//timestamp to log
 	int delete_flag;     //delete file flag
 	int create_flag;    //create file flag
 	int buff_offset;    //buffer offset after recv to write to file
 	int fd;         //file description no
+	int splice_pipe_fds[2];  //the pipe to splice the file content
+	int splice_pipe_size;    //the pipe capacity, 0 for not created
+	int splice_bytes;   //the bytes in the pipe to write by dio thread
 	int64_t start;  //the start offset of file
 	int64_t end;    //the end offset of file
 	int64_t offset; //the current offset of file
+	int64_t cache_version;  //the file cache version when missed
 	FileDealDoneCallback done_callback;
 	DeleteFileLogCallback log_callback;
 
@@ -129,6 +158,19 @@ typedef struct
 
 	int64_t request_length;   //request pkg length for access log
 
+	/* upload pipeline, the nio thread receives the next block to
+	   the read ahead buffer while the dio thread writes pTask->data */
+	struct
+	{
+		char *buff;    //the spare buffer, kept when the task is reused
+		int offset;    //received bytes
+		int length;    //expect bytes, 0 for not reading ahead
+		int err_no;    //recv error when reading ahead
+		bool swapped;  //if pTask->data is the spare buffer
+	} read_ahead;
+
+	TrunkClientRequest trunk_request;  //the request to the trunk server
+
 	FDFSStorageServer *pSrcStorage;
 	TaskDealFunc deal_func;  //function pointer to deal this task
 	void *extra_arg;   //store extra arg, such as (BinLogReader *)
@@ -139,13 +181,19 @@ struct storage_nio_thread_data
 {
 	struct nio_thread_data thread_data;
 	GroupArray group_array;  //FastDHT group array
+	TrunkClientConnection trunk_conn;  //to the remote trunk server
 };
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-void storage_recv_notify_read(int sock, short event, void *arg);
+void storage_recv_notify_read(struct fast_task_info *pTask);
+
+#if defined(OS_LINUX)
+/* close the splice pipe of the task, the bytes left are discarded */
+void storage_splice_pipe_close(StorageFileContext *pFileContext);
+#endif
 int storage_send_add_event(struct fast_task_info *pTask);
 
 void task_finish_clean_up(struct fast_task_info *pTask);
@@ -42,10 +42,13 @@
 #include "storage_client.h"
 #include "storage_nio.h"
 #include "storage_dio.h"
+#include "storage_stat.h"
+#include "storage_file_cache.h"
 #include "storage_sync.h"
 #include "trunk_mem.h"
 #include "trunk_sync.h"
 #include "trunk_client.h"
+#include "trunk_fd_cache.h"
 #include "ioevent_loop.h"
 
 //storage access log actions
@@ -58,6 +61,8 @@
 #define ACCESS_LOG_ACTION_APPEND_FILE    "append"
 #define ACCESS_LOG_ACTION_TRUNCATE_FILE  "truncate"
 #define ACCESS_LOG_ACTION_QUERY_FILE     "status"
+#define ACCESS_LOG_ACTION_DOWNLOAD_BATCH "download_batch"
+#define ACCESS_LOG_ACTION_UPLOAD_BATCH   "upload_batch"
 
 
 pthread_mutex_t g_storage_thread_lock;
@@ -97,6 +102,9 @@ static int storage_read_from_file(struct fast_task_info *pTask, \
 
 static int storage_service_upload_file_done(struct fast_task_info *pTask);
 
+static void storage_send_response(struct fast_task_info *pTask, \
+		const int result);
+
 #define STORAGE_STATUE_DEAL_FILE	 123456   //status for read or write file
 
 #define FDHT_KEY_NAME_FILE_ID	"fid"
@@ -181,9 +189,10 @@ static FDFSStorageServer *get_storage_server(const char *storage_server_id)
 	}
 }
 
-#define CHECK_AND_WRITE_TO_STAT_FILE1  \
+/* the stat counters are updated in the stat shard of current thread,
+   stat_count_thread_lock only protects the sync src timestamp */
+#define STORAGE_STAT_SYNC_SRC_TIMESTAMP  \
 		pthread_mutex_lock(&stat_count_thread_lock); \
-\
 		if (pClientInfo->pSrcStorage == NULL) \
 		{ \
 			pClientInfo->pSrcStorage = get_storage_server( \
@@ -195,68 +204,72 @@ static FDFSStorageServer *get_storage_server(const char *storage_server_id)
 					pFileContext->timestamp2log; \
 			g_sync_change_count++; \
 		} \
-\
-		g_storage_stat.last_sync_update = g_current_time; \
-		++g_stat_change_count; \
 		pthread_mutex_unlock(&stat_count_thread_lock);
 
+#define CHECK_AND_WRITE_TO_STAT_FILE1  \
+		{ \
+		StorageStatShard *pStatShard; \
+		STORAGE_STAT_SYNC_SRC_TIMESTAMP \
+		pStatShard = STORAGE_STAT_SHARD(); \
+		pStatShard->stat.last_sync_update = g_current_time; \
+		pStatShard->change_count++; \
+		}
+
 #define CHECK_AND_WRITE_TO_STAT_FILE1_WITH_BYTES( \
 		total_bytes, success_bytes, bytes)  \
-		pthread_mutex_lock(&stat_count_thread_lock); \
-\
-		if (pClientInfo->pSrcStorage == NULL) \
 		{ \
-			pClientInfo->pSrcStorage = get_storage_server( \
-					pClientInfo->storage_server_id); \
-		} \
-		if (pClientInfo->pSrcStorage != NULL) \
-		{ \
-			pClientInfo->pSrcStorage->last_sync_src_timestamp = \
-					pFileContext->timestamp2log; \
-			g_sync_change_count++; \
-		} \
-\
-		g_storage_stat.last_sync_update = g_current_time; \
-		total_bytes += bytes; \
-		success_bytes += bytes; \
-		++g_stat_change_count; \
-		pthread_mutex_unlock(&stat_count_thread_lock);
+		StorageStatShard *pStatShard; \
+		STORAGE_STAT_SYNC_SRC_TIMESTAMP \
+		pStatShard = STORAGE_STAT_SHARD(); \
+		pStatShard->stat.last_sync_update = g_current_time; \
+		pStatShard->stat.total_bytes += bytes; \
+		pStatShard->stat.success_bytes += bytes; \
+		pStatShard->change_count++; \
+		}
 
 #define CHECK_AND_WRITE_TO_STAT_FILE2(total_count, success_count)  \
-		pthread_mutex_lock(&stat_count_thread_lock); \
-		total_count++; \
-		success_count++; \
-		++g_stat_change_count; \
-		pthread_mutex_unlock(&stat_count_thread_lock);
+		{ \
+		StorageStatShard *pStatShard; \
+		pStatShard = STORAGE_STAT_SHARD(); \
+		pStatShard->stat.total_count++; \
+		pStatShard->stat.success_count++; \
+		pStatShard->change_count++; \
+		}
 
 #define CHECK_AND_WRITE_TO_STAT_FILE2_WITH_BYTES(total_count, success_count, \
 		total_bytes, success_bytes, bytes)  \
-		pthread_mutex_lock(&stat_count_thread_lock); \
-		total_count++; \
-		success_count++; \
-		total_bytes += bytes; \
-		success_bytes += bytes; \
-		++g_stat_change_count; \
-		pthread_mutex_unlock(&stat_count_thread_lock);
+		{ \
+		StorageStatShard *pStatShard; \
+		pStatShard = STORAGE_STAT_SHARD(); \
+		pStatShard->stat.total_count++; \
+		pStatShard->stat.success_count++; \
+		pStatShard->stat.total_bytes += bytes; \
+		pStatShard->stat.success_bytes += bytes; \
+		pStatShard->change_count++; \
+		}
 
 #define CHECK_AND_WRITE_TO_STAT_FILE3(total_count, success_count, timestamp)  \
-		pthread_mutex_lock(&stat_count_thread_lock); \
-		total_count++; \
-		success_count++; \
-		timestamp = g_current_time; \
-		++g_stat_change_count;  \
-		pthread_mutex_unlock(&stat_count_thread_lock);
+		{ \
+		StorageStatShard *pStatShard; \
+		pStatShard = STORAGE_STAT_SHARD(); \
+		pStatShard->stat.total_count++; \
+		pStatShard->stat.success_count++; \
+		pStatShard->stat.timestamp = g_current_time; \
+		pStatShard->change_count++; \
+		}
 
 #define CHECK_AND_WRITE_TO_STAT_FILE3_WITH_BYTES(total_count, success_count, \
 		timestamp, total_bytes, success_bytes, bytes)  \
-		pthread_mutex_lock(&stat_count_thread_lock); \
-		total_count++; \
-		success_count++; \
-		timestamp = g_current_time; \
-		total_bytes += bytes; \
-		success_bytes += bytes; \
-		++g_stat_change_count;  \
-		pthread_mutex_unlock(&stat_count_thread_lock);
+		{ \
+		StorageStatShard *pStatShard; \
+		pStatShard = STORAGE_STAT_SHARD(); \
+		pStatShard->stat.total_count++; \
+		pStatShard->stat.success_count++; \
+		pStatShard->stat.timestamp = g_current_time; \
+		pStatShard->stat.total_bytes += bytes; \
+		pStatShard->stat.success_bytes += bytes; \
+		pStatShard->change_count++; \
+		}
 
 static void storage_log_access_log(struct fast_task_info *pTask, \
 		const char *action, const int status)
@@ -555,8 +568,8 @@ static void storage_sync_copy_file_done_callback(struct fast_task_info *pTask, \
 		if (result == 0)
 		{
 			CHECK_AND_WRITE_TO_STAT_FILE1_WITH_BYTES( \
-				g_storage_stat.total_sync_in_bytes, \
-				g_storage_stat.success_sync_in_bytes, \
+				total_sync_in_bytes, \
+				success_sync_in_bytes, \
 				pFileContext->end - pFileContext->start)
 		}
 	}
@@ -571,10 +584,8 @@ static void storage_sync_copy_file_done_callback(struct fast_task_info *pTask, \
 	}
 	if (result != 0)
 	{
-		pthread_mutex_lock(&stat_count_thread_lock);
-		g_storage_stat.total_sync_in_bytes += \
+		STORAGE_STAT_SHARD()->stat.total_sync_in_bytes += \
 				pClientInfo->total_offset;
-		pthread_mutex_unlock(&stat_count_thread_lock);
 	}
 
 	pClientInfo->total_length = sizeof(TrackerHeader);
@@ -612,8 +623,8 @@ static void storage_sync_modify_file_done_callback( \
 			    pFileContext->sync_flag, pFileContext->fname2log);
 
 			CHECK_AND_WRITE_TO_STAT_FILE1_WITH_BYTES( \
-				g_storage_stat.total_sync_in_bytes, \
-				g_storage_stat.success_sync_in_bytes, \
+				total_sync_in_bytes, \
+				success_sync_in_bytes, \
 				pFileContext->end - pFileContext->start)
 		}
 	}
@@ -649,10 +660,8 @@ static void storage_sync_modify_file_done_callback( \
 
 	if (result != 0)
 	{
-		pthread_mutex_lock(&stat_count_thread_lock);
-		g_storage_stat.total_sync_in_bytes += \
+		STORAGE_STAT_SHARD()->stat.total_sync_in_bytes += \
 				pClientInfo->total_offset;
-		pthread_mutex_unlock(&stat_count_thread_lock);
 	}
 
 	pClientInfo->total_length = sizeof(TrackerHeader);
@@ -676,16 +685,21 @@ do { \
 static void storage_get_metadata_done_callback(struct fast_task_info *pTask, \
 			const int err_no)
 {
+	StorageFileContext *pFileContext;
 	TrackerHeader *pHeader;
 
+	pFileContext = &(((StorageClientInfo *)pTask->arg)->file_context);
 	STORAGE_ACCESS_LOG(pTask, ACCESS_LOG_ACTION_GET_METADATA, \
 		err_no);
 
 	if (err_no != 0)
 	{
-		pthread_mutex_lock(&stat_count_thread_lock);
-		g_storage_stat.total_get_meta_count++;
-		pthread_mutex_unlock(&stat_count_thread_lock);
+		STORAGE_STAT_SHARD()->stat.total_get_meta_count++;
+
+		if (pFileContext->use_sendfile)
+		{
+			return;  //the nio thread will close the connection
+		}
 
 		if (pTask->length == sizeof(TrackerHeader)) //never response
 		{
@@ -701,10 +715,13 @@ static void storage_get_metadata_done_callback(struct fast_task_info *pTask, \
 	else
 	{
 		CHECK_AND_WRITE_TO_STAT_FILE2( \
-			g_storage_stat.total_get_meta_count, \
-			g_storage_stat.success_get_meta_count)
+			total_get_meta_count, \
+			success_get_meta_count)
 
-		storage_nio_notify(pTask);
+		if (!pFileContext->use_sendfile) //else sent by the nio thread
+		{
+			storage_nio_notify(pTask);
+		}
 	}
 }
 
@@ -720,11 +737,14 @@ static void storage_download_file_done_callback( \
 	pFileContext = &(((StorageClientInfo *)pTask->arg)->file_context);
 	if (err_no != 0)
 	{
-		pthread_mutex_lock(&stat_count_thread_lock);
-		g_storage_stat.total_download_count++;
-		g_storage_stat.total_download_bytes += \
+		STORAGE_STAT_SHARD()->stat.total_download_count++;
+		STORAGE_STAT_SHARD()->stat.total_download_bytes += \
 				pFileContext->offset - pFileContext->start;
-		pthread_mutex_unlock(&stat_count_thread_lock);
+
+		if (pFileContext->use_sendfile)
+		{
+			return;  //the nio thread will close the connection
+		}
 
 		if (pTask->length == sizeof(TrackerHeader)) //never response
 		{
@@ -740,12 +760,77 @@ static void storage_download_file_done_callback( \
 	else
 	{
 		CHECK_AND_WRITE_TO_STAT_FILE2_WITH_BYTES( \
-			g_storage_stat.total_download_count, \
-			g_storage_stat.success_download_count, \
-			g_storage_stat.total_download_bytes, \
-			g_storage_stat.success_download_bytes, \
+			total_download_count, \
+			success_download_count, \
+			total_download_bytes, \
+			success_download_bytes, \
 			pFileContext->end - pFileContext->start)
 
+		if (pFileContext->fill_cache && pTask->length == \
+			sizeof(TrackerHeader) + pFileContext->end - \
+			pFileContext->start)
+		{
+			storage_file_cache_set(pFileContext->fname2log, \
+				strlen(pFileContext->fname2log), \
+				pTask->data + sizeof(TrackerHeader), \
+				pFileContext->end - pFileContext->start, \
+				pFileContext->cache_version);
+		}
+		pFileContext->fill_cache = false;
+
+		if (!pFileContext->use_sendfile) //else sent by the nio thread
+		{
+			storage_nio_notify(pTask);
+		}
+	}
+}
+
+static void storage_download_files_batch_done_callback( \
+		struct fast_task_info *pTask, const int err_no)
+{
+	StorageFileContext *pFileContext;
+	StorageBatchDownloadInfo *pBatch;
+	StorageBatchDownloadEntry *pEntry;
+	StorageBatchDownloadEntry *pEnd;
+	StorageStatShard *pStatShard;
+	TrackerHeader *pHeader;
+
+	STORAGE_ACCESS_LOG(pTask, ACCESS_LOG_ACTION_DOWNLOAD_BATCH, \
+		err_no);
+
+	pFileContext = &(((StorageClientInfo *)pTask->arg)->file_context);
+	pBatch = &(pFileContext->batch);
+	pStatShard = STORAGE_STAT_SHARD();
+	pEnd = pBatch->entries + pBatch->count;
+	for (pEntry=pBatch->entries; pEntry<pEnd; pEntry++)
+	{
+		pStatShard->stat.total_download_count++;
+		if (err_no == 0 && pEntry->status == 0)
+		{
+			pStatShard->stat.success_download_count++;
+			pStatShard->stat.total_download_bytes += pEntry->bytes;
+			pStatShard->stat.success_download_bytes += \
+						pEntry->bytes;
+		}
+	}
+	pStatShard->change_count++;
+	dio_read_batch_finish_clean_up(pTask);
+
+	if (err_no != 0)
+	{
+		if (pTask->length == sizeof(TrackerHeader)) //never response
+		{
+			pHeader = (TrackerHeader *)pTask->data;
+			pHeader->status = err_no;
+			storage_nio_notify(pTask);
+		}
+		else
+		{
+			STORAGE_NIO_NOTIFY_CLOSE(pTask);
+		}
+	}
+	else
+	{
 		storage_nio_notify(pTask);
 	}
 }
@@ -1052,7 +1137,7 @@ static void storage_delete_fdfs_file_done_callback( \
 		if (pFileContext->extra_info.upload.file_type & \
 				_FILE_TYPE_TRUNK)
 		{
-			trunk_client_trunk_free_space( \
+			trunk_client_trunk_free_space_async(pTask, \
 				&(pFileContext->extra_info.upload.trunk_info));
 		}
 
@@ -1072,34 +1157,32 @@ static void storage_delete_fdfs_file_done_callback( \
 
 	if (result != 0)
 	{
-		pthread_mutex_lock(&stat_count_thread_lock);
 		if (pFileContext->delete_flag == STORAGE_DELETE_FLAG_NONE ||\
 				(pFileContext->delete_flag & STORAGE_DELETE_FLAG_FILE))
 		{
-			g_storage_stat.total_delete_count++;
+			STORAGE_STAT_SHARD()->stat.total_delete_count++;
 		}
 		if (pFileContext->delete_flag & STORAGE_DELETE_FLAG_LINK)
 		{
-			g_storage_stat.total_delete_link_count++;
+			STORAGE_STAT_SHARD()->stat.total_delete_link_count++;
 		}
-		pthread_mutex_unlock(&stat_count_thread_lock);
 	}
 	else
 	{
 		if (pFileContext->delete_flag & STORAGE_DELETE_FLAG_FILE)
 		{
 			CHECK_AND_WRITE_TO_STAT_FILE3( \
-					g_storage_stat.total_delete_count, \
-					g_storage_stat.success_delete_count, \
-					g_storage_stat.last_source_update)
+					total_delete_count, \
+					success_delete_count, \
+					last_source_update)
 		}
 
 		if (pFileContext->delete_flag & STORAGE_DELETE_FLAG_LINK)
 		{
 			CHECK_AND_WRITE_TO_STAT_FILE3( \
-					g_storage_stat.total_delete_link_count, \
-					g_storage_stat.success_delete_link_count, \
-					g_storage_stat.last_source_update)
+					total_delete_link_count, \
+					success_delete_link_count, \
+					last_source_update)
 		}
 
 	}
@@ -1118,12 +1201,31 @@ static void storage_delete_fdfs_file_done_callback( \
 	storage_nio_notify(pTask);
 }
 
+/* the trunk server responds the confirm, go on in the dio thread */
+static void storage_trunk_confirm_done_callback(struct fast_task_info *pTask, \
+			const int err_no)
+{
+	storage_dio_queue_push(pTask);
+}
+
+static void storage_upload_file_finish(struct fast_task_info *pTask, \
+			const int err_no);
+
+static int storage_upload_file_confirm_done(struct fast_task_info *pTask)
+{
+	TrunkClientRequest *pRequest;
+
+	pRequest = &(((StorageClientInfo *)pTask->arg)->trunk_request);
+	storage_upload_file_finish(pTask, pRequest->status != 0 ? \
+			pRequest->status : pRequest->result);
+	return 0;
+}
+
 static void storage_upload_file_done_callback(struct fast_task_info *pTask, \
 			const int err_no)
 {
 	StorageClientInfo *pClientInfo;
 	StorageFileContext *pFileContext;
-	TrackerHeader *pHeader;
 	int result;
 
 	pClientInfo = (StorageClientInfo *)pTask->arg;
@@ -1131,6 +1233,16 @@ static void storage_upload_file_done_callback(struct fast_task_info *pTask, \
 
 	if (pFileContext->extra_info.upload.file_type & _FILE_TYPE_TRUNK)
 	{
+		if (TRUNK_CLIENT_NEED_CONFIRM(&(pFileContext-> \
+				extra_info.upload.trunk_info)))
+		{
+			pClientInfo->deal_func = storage_upload_file_confirm_done;
+			trunk_client_trunk_alloc_confirm_async(pTask, \
+				&(pFileContext->extra_info.upload.trunk_info), \
+				err_no, storage_trunk_confirm_done_callback);
+			return;
+		}
+
 		result = trunk_client_trunk_alloc_confirm( \
 			&(pFileContext->extra_info.upload.trunk_info), err_no);
 		if (err_no != 0)
@@ -1143,6 +1255,21 @@ static void storage_upload_file_done_callback(struct fast_task_info *pTask, \
 		result = err_no;
 	}
 
+	storage_upload_file_finish(pTask, result);
+}
+
+static void storage_upload_file_finish(struct fast_task_info *pTask, \
+			const int err_no)
+{
+	StorageClientInfo *pClientInfo;
+	StorageFileContext *pFileContext;
+	TrackerHeader *pHeader;
+	int result;
+
+	pClientInfo = (StorageClientInfo *)pTask->arg;
+	pFileContext =  &(pClientInfo->file_context);
+
+	result = err_no;
 	if (result == 0)
 	{
 		result = storage_service_upload_file_done(pTask);
@@ -1166,11 +1293,11 @@ static void storage_upload_file_done_callback(struct fast_task_info *pTask, \
 		if (pFileContext->create_flag & STORAGE_CREATE_FLAG_FILE)
 		{
 			CHECK_AND_WRITE_TO_STAT_FILE3_WITH_BYTES( \
-				g_storage_stat.total_upload_count, \
-				g_storage_stat.success_upload_count, \
-				g_storage_stat.last_source_update, \
-				g_storage_stat.total_upload_bytes, \
-				g_storage_stat.success_upload_bytes, \
+				total_upload_count, \
+				success_upload_count, \
+				last_source_update, \
+				total_upload_bytes, \
+				success_upload_bytes, \
 				pFileContext->end - pFileContext->start)
 		}
 
@@ -1185,14 +1312,12 @@ static void storage_upload_file_done_callback(struct fast_task_info *pTask, \
 	}
 	else
 	{
-		pthread_mutex_lock(&stat_count_thread_lock);
 		if (pFileContext->create_flag & STORAGE_CREATE_FLAG_FILE)
 		{
-			g_storage_stat.total_upload_count++;
- 			g_storage_stat.total_upload_bytes += \
+			STORAGE_STAT_SHARD()->stat.total_upload_count++;
+ 			STORAGE_STAT_SHARD()->stat.total_upload_bytes += \
 				pClientInfo->total_offset;
 		}
-		pthread_mutex_unlock(&stat_count_thread_lock);
 
 		pClientInfo->total_length = sizeof(TrackerHeader);
 	}
@@ -1263,9 +1388,9 @@ static void storage_trunk_create_link_file_done_callback( \
 		char *p;
 
 		CHECK_AND_WRITE_TO_STAT_FILE3( \
-			g_storage_stat.total_create_link_count, \
-			g_storage_stat.success_create_link_count, \
-			g_storage_stat.last_source_update)
+			total_create_link_count, \
+			success_create_link_count, \
+			last_source_update)
 
 		filename_len = strlen(pFileContext->fname2log);
 		pClientInfo->total_length = sizeof(TrackerHeader) + \
@@ -1278,9 +1403,7 @@ static void storage_trunk_create_link_file_done_callback( \
 	}
 	else
 	{
-		pthread_mutex_lock(&stat_count_thread_lock);
-		g_storage_stat.total_create_link_count++;
-		pthread_mutex_unlock(&stat_count_thread_lock);
+		STORAGE_STAT_SHARD()->stat.total_create_link_count++;
 		pClientInfo->total_length = sizeof(TrackerHeader);
 	}
 
@@ -1343,19 +1466,17 @@ static void storage_append_file_done_callback(struct fast_task_info *pTask, \
 	if (result == 0)
 	{
 		CHECK_AND_WRITE_TO_STAT_FILE3_WITH_BYTES( \
-			g_storage_stat.total_append_count, \
-			g_storage_stat.success_append_count, \
-			g_storage_stat.last_source_update, \
-			g_storage_stat.total_append_bytes, \
-			g_storage_stat.success_append_bytes, \
+			total_append_count, \
+			success_append_count, \
+			last_source_update, \
+			total_append_bytes, \
+			success_append_bytes, \
 			pFileContext->end - pFileContext->start)
 	}
 	else
 	{
-		pthread_mutex_lock(&stat_count_thread_lock);
-		g_storage_stat.total_append_count++;
- 		g_storage_stat.total_append_bytes += pClientInfo->total_offset;
-		pthread_mutex_unlock(&stat_count_thread_lock);
+		STORAGE_STAT_SHARD()->stat.total_append_count++;
+ 		STORAGE_STAT_SHARD()->stat.total_append_bytes += pClientInfo->total_offset;
 	}
 
 	pClientInfo->total_length = sizeof(TrackerHeader);
@@ -1413,19 +1534,17 @@ static void storage_modify_file_done_callback(struct fast_task_info *pTask, \
 	if (result == 0)
 	{
 		CHECK_AND_WRITE_TO_STAT_FILE3_WITH_BYTES( \
-			g_storage_stat.total_modify_count, \
-			g_storage_stat.success_modify_count, \
-			g_storage_stat.last_source_update, \
-			g_storage_stat.total_modify_bytes, \
-			g_storage_stat.success_modify_bytes, \
+			total_modify_count, \
+			success_modify_count, \
+			last_source_update, \
+			total_modify_bytes, \
+			success_modify_bytes, \
 			pFileContext->end - pFileContext->start)
 	}
 	else
 	{
-		pthread_mutex_lock(&stat_count_thread_lock);
-		g_storage_stat.total_modify_count++;
- 		g_storage_stat.total_modify_bytes += pClientInfo->total_offset;
-		pthread_mutex_unlock(&stat_count_thread_lock);
+		STORAGE_STAT_SHARD()->stat.total_modify_count++;
+ 		STORAGE_STAT_SHARD()->stat.total_modify_bytes += pClientInfo->total_offset;
 	}
 
 	pClientInfo->total_length = sizeof(TrackerHeader);
@@ -1482,15 +1601,13 @@ static void storage_do_truncate_file_done_callback(struct fast_task_info *pTask,
 	if (result == 0)
 	{
 		CHECK_AND_WRITE_TO_STAT_FILE3( \
-			g_storage_stat.total_truncate_count, \
-			g_storage_stat.success_truncate_count, \
-			g_storage_stat.last_source_update)
+			total_truncate_count, \
+			success_truncate_count, \
+			last_source_update)
 	}
 	else
 	{
-		pthread_mutex_lock(&stat_count_thread_lock);
-		g_storage_stat.total_truncate_count++;
-		pthread_mutex_unlock(&stat_count_thread_lock);
+		STORAGE_STAT_SHARD()->stat.total_truncate_count++;
 	}
 
 	pClientInfo->total_length = sizeof(TrackerHeader);
@@ -1537,16 +1654,14 @@ static void storage_set_metadata_done_callback( \
 
 	if (result != 0)
 	{
-		pthread_mutex_lock(&stat_count_thread_lock);
-		g_storage_stat.total_set_meta_count++;
-		pthread_mutex_unlock(&stat_count_thread_lock);
+		STORAGE_STAT_SHARD()->stat.total_set_meta_count++;
 	}
 	else
 	{
 		CHECK_AND_WRITE_TO_STAT_FILE3( \
-				g_storage_stat.total_set_meta_count, \
-				g_storage_stat.success_set_meta_count, \
-				g_storage_stat.last_source_update)
+				total_set_meta_count, \
+				success_set_meta_count, \
+				last_source_update)
 	}
 
 	pClientInfo->total_length = sizeof(TrackerHeader);
@@ -1587,6 +1702,11 @@ int storage_service_init()
 		return result;
 	}
 
+	if ((result=trunk_client_lease_init()) != 0)
+	{
+		return result;
+	}
+
 	if ((result=init_pthread_attr(&thread_attr, g_thread_stack_size)) != 0)
 	{
 		logError("file: "__FILE__", line: %d, " \
@@ -1636,29 +1756,15 @@ int storage_service_init()
 			return result;
 		}
 
-		if (pipe(pThreadData->thread_data.pipe_fds) != 0)
-		{
-			result = errno != 0 ? errno : EPERM;
-			logError("file: "__FILE__", line: %d, " \
-				"call pipe fail, " \
-				"errno: %d, error info: %s", \
-				__LINE__, result, STRERROR(result));
-			break;
-		}
-
-#if defined(OS_LINUX)
-		if ((result=fd_add_flags(pThreadData->thread_data.pipe_fds[0], \
-				O_NONBLOCK | O_NOATIME)) != 0)
+		if ((result=ioevent_notify_init(&pThreadData->thread_data)) != 0)
 		{
 			break;
 		}
-#else
-		if ((result=fd_add_flags(pThreadData->thread_data.pipe_fds[0], \
-				O_NONBLOCK)) != 0)
+		if ((result=trunk_client_conn_init(&pThreadData->trunk_conn, \
+				&pThreadData->thread_data)) != 0)
 		{
 			break;
 		}
-#endif
 
 		if ((result=pthread_create(&tid, &thread_attr, \
 			work_thread_entrance, pThreadData)) != 0)
@@ -1692,7 +1798,8 @@ int storage_service_init()
 
 	pthread_attr_destroy(&thread_attr);
 
-	last_stat_change_count = g_stat_change_count;
+	last_stat_change_count = g_stat_change_count + \
+				storage_stat_change_count();
 
 	//DO NOT support direct IO !!!
 	//g_extra_open_file_flags = g_disk_rw_direct ? O_DIRECT : 0;
@@ -1718,7 +1825,6 @@ int storage_terminate_threads()
         struct storage_nio_thread_data *pDataEnd;
 	struct fast_task_info *pTask;
 	StorageClientInfo *pClientInfo;
-	long task_addr;
         int quit_sock;
 
 	if (g_nio_thread_data != NULL)
@@ -1744,15 +1850,7 @@ int storage_terminate_threads()
 			pTask->event.fd = quit_sock;
 			pClientInfo->nio_thread_index = pThreadData - g_nio_thread_data;
 
-			task_addr = (long)pTask;
-			if (write(pThreadData->thread_data.pipe_fds[1], &task_addr, \
-					sizeof(task_addr)) != sizeof(task_addr))
-			{
-				logError("file: "__FILE__", line: %d, " \
-					"call write failed, " \
-					"errno: %d, error info: %s", \
-					__LINE__, errno, STRERROR(errno));
-			}
+			ioevent_notify_thread(&pThreadData->thread_data, pTask);
 		}
 	}
 
@@ -1767,7 +1865,6 @@ static void *accept_thread_entrance(void* arg)
 	socklen_t sockaddr_len;
 	in_addr_t client_addr;
 	char szClientIp[IP_ADDRESS_SIZE];
-	long task_addr;
 	struct fast_task_info *pTask;
 	StorageClientInfo *pClientInfo;
 	struct storage_nio_thread_data *pThreadData;
@@ -1832,17 +1929,7 @@ static void *accept_thread_entrance(void* arg)
 
 		strcpy(pTask->client_ip, szClientIp);
 
-		task_addr = (long)pTask;
-		if (write(pThreadData->thread_data.pipe_fds[1], &task_addr, \
-			sizeof(task_addr)) != sizeof(task_addr))
-		{
-			close(incomesock);
-			free_queue_push(pTask);
-			logError("file: "__FILE__", line: %d, " \
-				"call write failed, " \
-				"errno: %d, error info: %s", \
-				__LINE__, errno, STRERROR(errno));
-		}
+		ioevent_notify_thread(&pThreadData->thread_data, pTask);
 	}
 
 	return NULL;
@@ -1889,23 +1976,10 @@ void storage_nio_notify(struct fast_task_info *pTask)
 {
 	StorageClientInfo *pClientInfo;
 	struct storage_nio_thread_data *pThreadData;
-	long task_addr;
 
 	pClientInfo = (StorageClientInfo *)pTask->arg;
 	pThreadData = g_nio_thread_data + pClientInfo->nio_thread_index;
-
-	task_addr = (long)pTask;
-	if (write(pThreadData->thread_data.pipe_fds[1], &task_addr, \
-		sizeof(task_addr)) != sizeof(task_addr))
-	{
-		int result;
-		result = errno != 0 ? errno : EIO;
-		logCrit("file: "__FILE__", line: %d, " \
-			"call write failed, " \
-			"errno: %d, error info: %s", \
-			__LINE__, result, STRERROR(result));
-		abort();
-	}
+	ioevent_notify_thread(&pThreadData->thread_data, pTask);
 }
 
 static void *work_thread_entrance(void* arg)
@@ -3382,6 +3456,7 @@ static int storage_server_trunk_sync_binlog(struct fast_task_info *pTask)
 	StorageClientInfo *pClientInfo;
 	char *binlog_buff;
 	int64_t nInPackLen;
+	int result;
 
 	pClientInfo = (StorageClientInfo *)pTask->arg;
 	nInPackLen = pClientInfo->total_length - sizeof(TrackerHeader);
@@ -3417,7 +3492,13 @@ static int storage_server_trunk_sync_binlog(struct fast_task_info *pTask)
 	}
 
 	binlog_buff = pTask->data + sizeof(TrackerHeader);
-	return trunk_binlog_write_buffer(binlog_buff, nInPackLen);
+	if ((result=trunk_binlog_write_buffer(binlog_buff, nInPackLen)) != 0)
+	{
+		return result;
+	}
+
+	trunk_binlog_apply(binlog_buff, nInPackLen);
+	return 0;
 }
 
 /**
@@ -3683,10 +3764,18 @@ static int storage_server_query_file_info(struct fast_task_info *pTask)
 		return EINVAL; \
 	}
 
+#define storage_server_trunk_alloc_space(pTask) \
+	storage_server_trunk_do_alloc(pTask, \
+		STORAGE_PROTO_CMD_TRUNK_ALLOC_SPACE)
+
+#define storage_server_trunk_alloc_lease(pTask) \
+	storage_server_trunk_do_alloc(pTask, \
+		STORAGE_PROTO_CMD_TRUNK_ALLOC_LEASE)
+
 /**
 request package format:
 FDFS_GROUP_NAME_MAX_LEN bytes: group_name
-4 bytes: file size
+4 bytes: file size (the lease size for TRUNK_ALLOC_LEASE)
 1 bytes: store_path_index
 
 response package format:
@@ -3696,8 +3785,10 @@ response package format:
 4 bytes: trunk file id
 4 bytes: trunk offset
 4 bytes: trunk size
+8 bytes: lease id (TRUNK_ALLOC_LEASE only)
 **/
-static int storage_server_trunk_alloc_space(struct fast_task_info *pTask)
+static int storage_server_trunk_do_alloc(struct fast_task_info *pTask, \
+		const int cmd)
 {
 	StorageClientInfo *pClientInfo;
 	FDFSTrunkInfoBuff *pApplyBody;
@@ -3705,6 +3796,7 @@ static int storage_server_trunk_alloc_space(struct fast_task_info *pTask)
 	char group_name[FDFS_GROUP_NAME_MAX_LEN + 1];
 	FDFSTrunkFullInfo trunkInfo;
 	int64_t nInPackLen;
+	int64_t lease_id;
 	int file_size;
 	int result;
 
@@ -3719,8 +3811,7 @@ static int storage_server_trunk_alloc_space(struct fast_task_info *pTask)
 		logError("file: "__FILE__", line: %d, " \
 			"cmd=%d, client ip: %s, package size " \
 			INT64_PRINTF_FORMAT" is not correct, " \
-			"expect length: %d", __LINE__, \
-			STORAGE_PROTO_CMD_TRUNK_ALLOC_SPACE, \
+			"expect length: %d", __LINE__, cmd, \
 			pTask->client_ip,  nInPackLen, \
 			FDFS_GROUP_NAME_MAX_LEN + 5);
 		return EINVAL;
@@ -3740,7 +3831,18 @@ static int storage_server_trunk_alloc_space(struct fast_task_info *pTask)
 	}
 
 	file_size = buff2int(in_buff + FDFS_GROUP_NAME_MAX_LEN);
-	if (file_size < 0 || !trunk_check_size(file_size))
+	if (cmd == STORAGE_PROTO_CMD_TRUNK_ALLOC_LEASE)
+	{
+		if (file_size < g_slot_min_size || \
+			file_size > g_trunk_file_size)
+		{
+			logError("file: "__FILE__", line: %d, " \
+				"client ip:%s, invalid lease size: %d", \
+				__LINE__, pTask->client_ip, file_size);
+			return EINVAL;
+		}
+	}
+	else if (file_size < 0 || !trunk_check_size(file_size))
 	{
 		logError("file: "__FILE__", line: %d, " \
 			"client ip:%s, invalid file size: %d", \
@@ -3749,7 +3851,24 @@ static int storage_server_trunk_alloc_space(struct fast_task_info *pTask)
 	}
 
 	trunkInfo.path.store_path_index = *(in_buff+FDFS_GROUP_NAME_MAX_LEN+4);
-	if ((result=trunk_alloc_space(file_size, &trunkInfo)) != 0)
+	if (trunkInfo.path.store_path_index >= g_fdfs_store_paths.count)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"client ip:%s, invalid store path index: %d", \
+			__LINE__, pTask->client_ip, \
+			trunkInfo.path.store_path_index);
+		return EINVAL;
+	}
+
+	if (cmd == STORAGE_PROTO_CMD_TRUNK_ALLOC_LEASE)
+	{
+		result = trunk_alloc_lease(file_size, &trunkInfo, &lease_id);
+	}
+	else
+	{
+		result = trunk_alloc_space(file_size, &trunkInfo);
+	}
+	if (result != 0)
 	{
 		return result;
 	}
@@ -3762,8 +3881,17 @@ static int storage_server_trunk_alloc_space(struct fast_task_info *pTask)
 	int2buff(trunkInfo.file.offset, pApplyBody->offset);
 	int2buff(trunkInfo.file.size, pApplyBody->size);
 
-	pClientInfo->total_length = sizeof(TrackerHeader) + \
+	if (cmd == STORAGE_PROTO_CMD_TRUNK_ALLOC_LEASE)
+	{
+		long2buff(lease_id, (char *)(pApplyBody + 1));
+		pClientInfo->total_length = sizeof(TrackerHeader) + \
+				STORAGE_TRUNK_ALLOC_LEASE_RESP_BODY_LEN;
+	}
+	else
+	{
+		pClientInfo->total_length = sizeof(TrackerHeader) + \
 				sizeof(FDFSTrunkInfoBuff);
+	}
 	return 0;
 }
 
@@ -3773,6 +3901,9 @@ static int storage_server_trunk_alloc_space(struct fast_task_info *pTask)
 #define storage_server_trunk_free_space(pTask) \
 	storage_server_trunk_confirm_or_free(pTask)
 
+#define storage_server_trunk_return_lease(pTask) \
+	storage_server_trunk_confirm_or_free(pTask)
+
 static int storage_server_trunk_get_binlog_size(struct fast_task_info *pTask)
 {
 	StorageClientInfo *pClientInfo;
@@ -3925,6 +4056,7 @@ request package format:
   4 bytes: trunk file id
   4 bytes: trunk offset
   4 bytes: trunk size
+  8 bytes: lease id (TRUNK_RETURN_LEASE only)
 **/
 static int storage_server_trunk_confirm_or_free(struct fast_task_info *pTask)
 {
@@ -3935,6 +4067,7 @@ static int storage_server_trunk_confirm_or_free(struct fast_task_info *pTask)
 	char group_name[FDFS_GROUP_NAME_MAX_LEN + 1];
 	FDFSTrunkFullInfo trunkInfo;
 	int64_t nInPackLen;
+	int expect_len;
 
 	pHeader = (TrackerHeader *)pTask->data;
 	pClientInfo = (StorageClientInfo *)pTask->arg;
@@ -3943,14 +4076,22 @@ static int storage_server_trunk_confirm_or_free(struct fast_task_info *pTask)
 
 	CHECK_TRUNK_SERVER(pTask)
 
-	if (nInPackLen != STORAGE_TRUNK_ALLOC_CONFIRM_REQ_BODY_LEN)
+	if (pHeader->cmd == STORAGE_PROTO_CMD_TRUNK_RETURN_LEASE)
+	{
+		expect_len = STORAGE_TRUNK_RETURN_LEASE_REQ_BODY_LEN;
+	}
+	else
+	{
+		expect_len = STORAGE_TRUNK_ALLOC_CONFIRM_REQ_BODY_LEN;
+	}
+	if (nInPackLen != expect_len)
 	{
 		logError("file: "__FILE__", line: %d, " \
 			"cmd=%d, client ip: %s, package size " \
 			INT64_PRINTF_FORMAT" is not correct, " \
 			"expect length: %d", __LINE__, \
 			pHeader->cmd, pTask->client_ip,  nInPackLen, \
-			(int)STORAGE_TRUNK_ALLOC_CONFIRM_REQ_BODY_LEN);
+			expect_len);
 		return EINVAL;
 	}
 
@@ -3979,6 +4120,11 @@ static int storage_server_trunk_confirm_or_free(struct fast_task_info *pTask)
 	{
 		return trunk_alloc_confirm(&trunkInfo, pHeader->status);
 	}
+	else if (pHeader->cmd == STORAGE_PROTO_CMD_TRUNK_RETURN_LEASE)
+	{
+		return trunk_return_lease(&trunkInfo, \
+			buff2long((char *)(pTrunkBuff + 1)));
+	}
 	else
 	{
 		return trunk_free_space(&trunkInfo, true);
@@ -4351,6 +4497,51 @@ static int storage_server_fetch_one_path_binlog(struct fast_task_info *pTask)
 FDFS_FILE_EXT_NAME_MAX_LEN bytes: file ext name, do not include dot (.)
 file size bytes: file content
 **/
+/* called by the nio thread when the trunk space is allocated */
+static void storage_upload_file_trunk_alloc_done(struct fast_task_info *pTask, \
+		const int err_no)
+{
+	StorageClientInfo *pClientInfo;
+	StorageFileContext *pFileContext;
+	FDFSTrunkFullInfo *pTrunkInfo;
+	int64_t file_bytes;
+	int result;
+
+	pClientInfo = (StorageClientInfo *)pTask->arg;
+	pFileContext =  &(pClientInfo->file_context);
+	pTrunkInfo = &(pFileContext->extra_info.upload.trunk_info);
+	if (err_no != 0)
+	{
+		pClientInfo->total_length = sizeof(TrackerHeader);
+		result = err_no;
+	}
+	else
+	{
+		file_bytes = buff2long(pTask->data + sizeof(TrackerHeader) + 1);
+		pFileContext->extra_info.upload.if_gen_filename = true;
+		trunk_get_full_filename(pTrunkInfo, pFileContext->filename, \
+				sizeof(pFileContext->filename));
+		pFileContext->extra_info.upload.before_open_callback = \
+					dio_check_trunk_file_when_upload;
+		pFileContext->extra_info.upload.before_close_callback = \
+					dio_write_chunk_header;
+		pFileContext->open_flags = O_RDWR | g_extra_open_file_flags;
+		result = storage_write_to_file(pTask, \
+			TRUNK_FILE_START_OFFSET((*pTrunkInfo)), file_bytes, \
+			sizeof(TrackerHeader) + 1 + FDFS_PROTO_PKG_LEN_SIZE + \
+			FDFS_FILE_EXT_NAME_MAX_LEN, dio_write_file, \
+			storage_upload_file_done_callback, \
+			dio_trunk_write_finish_clean_up, \
+			pTrunkInfo->path.store_path_index);
+	}
+
+	if (result != STORAGE_STATUE_DEAL_FILE)
+	{
+		STORAGE_ACCESS_LOG(pTask, ACCESS_LOG_ACTION_UPLOAD_FILE, result);
+		storage_send_response(pTask, result);
+	}
+}
+
 static int storage_upload_file(struct fast_task_info *pTask, bool bAppenderFile)
 {
 	StorageClientInfo *pClientInfo;
@@ -4471,27 +4662,13 @@ static int storage_upload_file(struct fast_task_info *pTask, bool bAppenderFile)
 
 	if (pFileContext->extra_info.upload.file_type & _FILE_TYPE_TRUNK)
 	{
-		FDFSTrunkFullInfo *pTrunkInfo;
-
+		/* go on in storage_upload_file_trunk_alloc_done */
 		pFileContext->extra_info.upload.if_sub_path_alloced = true;
-		pTrunkInfo = &(pFileContext->extra_info.upload.trunk_info);
-		if ((result=trunk_client_trunk_alloc_space( \
-			TRUNK_CALC_SIZE(file_bytes), pTrunkInfo)) != 0)
-		{
-			pClientInfo->total_length = sizeof(TrackerHeader);
-			return result;
-		}
-
-		clean_func = dio_trunk_write_finish_clean_up;
-		file_offset = TRUNK_FILE_START_OFFSET((*pTrunkInfo));
-    pFileContext->extra_info.upload.if_gen_filename = true;
-		trunk_get_full_filename(pTrunkInfo, pFileContext->filename, \
-				sizeof(pFileContext->filename));
-		pFileContext->extra_info.upload.before_open_callback = \
-					dio_check_trunk_file_when_upload;
-		pFileContext->extra_info.upload.before_close_callback = \
-					dio_write_chunk_header;
-		pFileContext->open_flags = O_RDWR | g_extra_open_file_flags;
+		trunk_client_trunk_alloc_space_async(pTask, \
+			TRUNK_CALC_SIZE(file_bytes), \
+			&(pFileContext->extra_info.upload.trunk_info), \
+			storage_upload_file_trunk_alloc_done);
+		return STORAGE_STATUE_DEAL_FILE;
 	}
 	else
 	{
@@ -4547,17 +4724,770 @@ static int storage_upload_file(struct fast_task_info *pTask, bool bAppenderFile)
 			clean_func, store_path_index);
 }
 
-static int storage_deal_active_test(struct fast_task_info *pTask)
+/* one small file of the batch upload */
+typedef struct
+{
+	char *content;      //point to the task buffer
+	int64_t file_size;
+	int crc32;
+	int alloc_size;     //the trunk slot size
+	char formatted_ext_name[FDFS_FILE_EXT_NAME_MAX_LEN + 2];
+	char fname2log[128];
+} StorageUploadBatchEntry;
+
+typedef struct
+{
+	bool use_trunk;
+	int count;
+	int alloc_bytes;  //the sum of the slot sizes
+	FDFSTrunkFullInfo trunk_info;  //the trunk space of all files
+	StorageUploadBatchEntry *entries;
+} StorageUploadBatchInfo;
+
+static void storage_upload_batch_clean_up(struct fast_task_info *pTask)
 {
 	StorageClientInfo *pClientInfo;
-	int64_t nInPackLen;
 
 	pClientInfo = (StorageClientInfo *)pTask->arg;
-	nInPackLen = pClientInfo->total_length - sizeof(TrackerHeader);
-	pClientInfo->total_length = sizeof(TrackerHeader);
-	if (nInPackLen != 0)
+	if (pClientInfo->extra_arg != NULL)
 	{
-		logError("file: "__FILE__", line: %d, " \
+		free(pClientInfo->extra_arg);
+		pClientInfo->extra_arg = NULL;
+	}
+}
+
+static void storage_upload_files_batch_finish( \
+		struct fast_task_info *pTask, const int err_no)
+{
+	StorageClientInfo *pClientInfo;
+	StorageFileContext *pFileContext;
+	StorageUploadBatchInfo *pBatch;
+	StorageUploadBatchEntry *pEntry;
+	StorageUploadBatchEntry *pEnd;
+	StorageStatShard *pStatShard;
+	TrackerHeader *pHeader;
+	char **fname2logs;
+	char *p;
+	int filename_len;
+	int result;
+	int i;
+
+	pClientInfo = (StorageClientInfo *)pTask->arg;
+	pFileContext =  &(pClientInfo->file_context);
+	pBatch = (StorageUploadBatchInfo *)pClientInfo->extra_arg;
+	pEnd = pBatch->entries + pBatch->count;
+
+	result = err_no;
+	if (result == 0)
+	{
+		fname2logs = (char **)malloc(sizeof(char *) * pBatch->count);
+		if (fname2logs == NULL)
+		{
+			result = errno != 0 ? errno : ENOMEM;
+			logError("file: "__FILE__", line: %d, " \
+				"malloc %d bytes fail, " \
+				"errno: %d, error info: %s", __LINE__, \
+				(int)sizeof(char *) * pBatch->count, \
+				result, STRERROR(result));
+		}
+		else
+		{
+			for (i=0; i<pBatch->count; i++)
+			{
+				fname2logs[i] = pBatch->entries[i].fname2log;
+			}
+
+			/* all records of the batch by one lock */
+			result = storage_binlog_write_batch( \
+				pFileContext->timestamp2log, \
+				STORAGE_OP_TYPE_SOURCE_CREATE_FILE, \
+				fname2logs, pBatch->count);
+			free(fname2logs);
+		}
+	}
+
+	pStatShard = STORAGE_STAT_SHARD();
+	for (pEntry=pBatch->entries; pEntry<pEnd; pEntry++)
+	{
+		pStatShard->stat.total_upload_count++;
+		pStatShard->stat.total_upload_bytes += pEntry->file_size;
+		if (result == 0)
+		{
+			pStatShard->stat.success_upload_count++;
+			pStatShard->stat.success_upload_bytes += \
+						pEntry->file_size;
+		}
+	}
+	if (result == 0)
+	{
+		pStatShard->stat.last_source_update = g_current_time;
+		pStatShard->change_count++;
+
+		p = pTask->data + sizeof(TrackerHeader);
+		memcpy(p, g_group_name, FDFS_GROUP_NAME_MAX_LEN);
+		p += FDFS_GROUP_NAME_MAX_LEN;
+		for (pEntry=pBatch->entries; pEntry<pEnd; pEntry++)
+		{
+			filename_len = strlen(pEntry->fname2log);
+			long2buff(filename_len, p);
+			p += FDFS_PROTO_PKG_LEN_SIZE;
+			memcpy(p, pEntry->fname2log, filename_len);
+			p += filename_len;
+		}
+		pClientInfo->total_length = p - pTask->data;
+
+		snprintf(pFileContext->fname2log, \
+			sizeof(pFileContext->fname2log), "%s", \
+			pBatch->entries[0].fname2log);
+	}
+	else
+	{
+		pClientInfo->total_length = sizeof(TrackerHeader);
+	}
+
+	storage_upload_batch_clean_up(pTask);
+	pClientInfo->clean_func = NULL;
+
+	STORAGE_ACCESS_LOG(pTask, ACCESS_LOG_ACTION_UPLOAD_BATCH, result);
+
+	pClientInfo->total_offset = 0;
+	pTask->length = pClientInfo->total_length;
+
+	pHeader = (TrackerHeader *)pTask->data;
+	pHeader->status = result;
+	pHeader->cmd = STORAGE_PROTO_CMD_RESP;
+	long2buff(pClientInfo->total_length - sizeof(TrackerHeader), \
+			pHeader->pkg_len);
+
+	storage_nio_notify(pTask);
+}
+
+/* write all files to the trunk space by one write, dealt by dio thread */
+static int storage_upload_batch_write_trunk(struct fast_task_info *pTask, \
+		StorageUploadBatchInfo *pBatch)
+{
+	StorageClientInfo *pClientInfo;
+	StorageFileContext *pFileContext;
+	StorageUploadBatchEntry *pEntry;
+	StorageUploadBatchEntry *pEnd;
+	FDFSTrunkFullInfo *pTrunkInfo;
+	FDFSTrunkHeader trunkHeader;
+	char trunk_buff[FDFS_TRUNK_FILE_INFO_LEN + 1];
+	char new_filename[128];
+	char new_full_filename[MAX_PATH_SIZE + 64];
+	char *buff;
+	char *p;
+	int64_t file_size_in_name;
+	int64_t offset;
+	int write_bytes;
+	int new_filename_len;
+	int fd;
+	int result;
+
+	pClientInfo = (StorageClientInfo *)pTask->arg;
+	pFileContext =  &(pClientInfo->file_context);
+	pEnd = pBatch->entries + pBatch->count;
+
+	write_bytes = 0;
+	for (pEntry=pBatch->entries; pEntry<pEnd; pEntry++)
+	{
+		write_bytes += pEntry->alloc_size;
+	}
+
+	buff = (char *)malloc(write_bytes);
+	if (buff == NULL)
+	{
+		result = errno != 0 ? errno : ENOMEM;
+		logError("file: "__FILE__", line: %d, " \
+			"malloc %d bytes fail, " \
+			"errno: %d, error info: %s", __LINE__, \
+			write_bytes, result, STRERROR(result));
+		return result;
+	}
+
+	/* the trunk header and the content of each file, back to back */
+	memset(buff, 0, write_bytes);
+	p = buff;
+	trunkHeader.file_type = FDFS_TRUNK_FILE_TYPE_REGULAR;
+	trunkHeader.mtime = pFileContext->extra_info.upload.start_time;
+	for (pEntry=pBatch->entries; pEntry<pEnd; pEntry++)
+	{
+		trunkHeader.alloc_size = pEntry->alloc_size;
+		trunkHeader.file_size = pEntry->file_size;
+		trunkHeader.crc32 = pEntry->crc32;
+		snprintf(trunkHeader.formatted_ext_name, \
+			sizeof(trunkHeader.formatted_ext_name), "%s", \
+			pEntry->formatted_ext_name);
+		trunk_pack_header(&trunkHeader, p);
+		memcpy(p + FDFS_TRUNK_FILE_HEADER_SIZE, pEntry->content, \
+			pEntry->file_size);
+		p += pEntry->alloc_size;
+	}
+
+	trunk_get_full_filename((&pBatch->trunk_info), \
+		pFileContext->filename, sizeof(pFileContext->filename));
+	if (!trunk_fd_cache_exists(&pBatch->trunk_info) && \
+		(result=trunk_check_and_init_file(pFileContext->filename)) != 0)
+	{
+		free(buff);
+		return result;
+	}
+
+	if ((result=trunk_fd_cache_open(&pBatch->trunk_info, \
+		pFileContext->filename, &fd)) != 0)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"open file: %s fail, " \
+			"errno: %d, error info: %s", \
+			__LINE__, pFileContext->filename, \
+			result, STRERROR(result));
+		dio_stat_file_open(result);
+		free(buff);
+		return result;
+	}
+	dio_stat_file_open(0);
+
+	do
+	{
+		if ((result=dio_check_trunk_file_ex(fd, pFileContext->filename,\
+			pBatch->trunk_info.file.offset)) != 0)
+		{
+			break;
+		}
+
+		STORAGE_STAT_SHARD()->stat.total_file_write_count++;
+		if (pwrite(fd, buff, write_bytes, pBatch->trunk_info. \
+			file.offset) != write_bytes)
+		{
+			result = errno != 0 ? errno : EIO;
+			logError("file: "__FILE__", line: %d, " \
+				"write to file: %s fail, " \
+				"errno: %d, error info: %s", \
+				__LINE__, pFileContext->filename, \
+				result, STRERROR(result));
+			break;
+		}
+		STORAGE_STAT_SHARD()->stat.success_file_write_count++;
+
+		if (g_fsync_after_written_bytes > 0 && fsync(fd) != 0)
+		{
+			result = errno != 0 ? errno : EIO;
+			logError("file: "__FILE__", line: %d, " \
+				"fsync file: %s fail, " \
+				"errno: %d, error info: %s", \
+				__LINE__, pFileContext->filename, \
+				result, STRERROR(result));
+			break;
+		}
+	} while (0);
+
+	trunk_fd_cache_close(fd);
+	free(buff);
+	if (result != 0)
+	{
+		return result;
+	}
+
+	/* the filename of each file with its own trunk slot */
+	pTrunkInfo = &(pFileContext->extra_info.upload.trunk_info);
+	memcpy(pTrunkInfo, &pBatch->trunk_info, sizeof(FDFSTrunkFullInfo));
+	pFileContext->extra_info.upload.if_sub_path_alloced = true;
+	offset = pBatch->trunk_info.file.offset;
+	for (pEntry=pBatch->entries; pEntry<pEnd; pEntry++)
+	{
+		pTrunkInfo->file.offset = offset;
+		pTrunkInfo->file.size = pEntry->alloc_size;
+		offset += pEntry->alloc_size;
+
+		COMBINE_RAND_FILE_SIZE(pEntry->file_size, file_size_in_name);
+		file_size_in_name |= FDFS_TRUNK_FILE_MARK_SIZE;
+		if ((result=storage_get_filename(pClientInfo, \
+			pFileContext->extra_info.upload.start_time, \
+			file_size_in_name, pEntry->crc32, \
+			pEntry->formatted_ext_name, new_filename, \
+			&new_filename_len, new_full_filename)) != 0)
+		{
+			return result;
+		}
+
+		trunk_file_info_encode(&(pTrunkInfo->file), trunk_buff);
+		sprintf(pEntry->fname2log, "%c"FDFS_STORAGE_DATA_DIR_FORMAT \
+			"/%s", FDFS_STORAGE_STORE_PATH_PREFIX_CHAR, \
+			pTrunkInfo->path.store_path_index, new_filename);
+		sprintf(pEntry->fname2log + FDFS_LOGIC_FILE_PATH_LEN + \
+			FDFS_FILENAME_BASE64_LENGTH, "%s%s", trunk_buff, \
+			new_filename + FDFS_TRUE_FILE_PATH_LEN + \
+			FDFS_FILENAME_BASE64_LENGTH);
+	}
+
+	return 0;
+}
+
+/* write each file to its own file, dealt by dio thread */
+static int storage_upload_batch_write_files(struct fast_task_info *pTask, \
+		StorageUploadBatchInfo *pBatch)
+{
+	StorageClientInfo *pClientInfo;
+	StorageFileContext *pFileContext;
+	StorageUploadBatchEntry *pEntry;
+	StorageUploadBatchEntry *pEnd;
+	char new_filename[128];
+	int new_filename_len;
+	int store_path_index;
+	int fd;
+	int result;
+
+	pClientInfo = (StorageClientInfo *)pTask->arg;
+	pFileContext =  &(pClientInfo->file_context);
+	store_path_index = pFileContext->extra_info.upload.trunk_info. \
+				path.store_path_index;
+	pEnd = pBatch->entries + pBatch->count;
+	result = 0;
+	for (pEntry=pBatch->entries; pEntry<pEnd; pEntry++)
+	{
+		pFileContext->extra_info.upload.if_sub_path_alloced = false;
+		if ((result=storage_get_filename(pClientInfo, \
+			pFileContext->extra_info.upload.start_time, \
+			pEntry->file_size, pEntry->crc32, \
+			pEntry->formatted_ext_name, new_filename, \
+			&new_filename_len, pFileContext->filename)) != 0)
+		{
+			break;
+		}
+
+		fd = open(pFileContext->filename, O_WRONLY | O_CREAT | \
+			O_EXCL | g_extra_open_file_flags, 0644);
+		if (fd < 0)
+		{
+			result = errno != 0 ? errno : EACCES;
+			logError("file: "__FILE__", line: %d, " \
+				"open file: %s fail, " \
+				"errno: %d, error info: %s", \
+				__LINE__, pFileContext->filename, \
+				result, STRERROR(result));
+			dio_stat_file_open(result);
+			break;
+		}
+		dio_stat_file_open(0);
+
+		STORAGE_STAT_SHARD()->stat.total_file_write_count++;
+		if (write(fd, pEntry->content, pEntry->file_size) != \
+			pEntry->file_size)
+		{
+			result = errno != 0 ? errno : EIO;
+			logError("file: "__FILE__", line: %d, " \
+				"write to file: %s fail, " \
+				"errno: %d, error info: %s", \
+				__LINE__, pFileContext->filename, \
+				result, STRERROR(result));
+		}
+		else if (g_fsync_after_written_bytes > 0 && fsync(fd) != 0)
+		{
+			result = errno != 0 ? errno : EIO;
+			logError("file: "__FILE__", line: %d, " \
+				"fsync file: %s fail, " \
+				"errno: %d, error info: %s", \
+				__LINE__, pFileContext->filename, \
+				result, STRERROR(result));
+		}
+		close(fd);
+
+		if (result != 0)
+		{
+			unlink(pFileContext->filename);
+			break;
+		}
+		STORAGE_STAT_SHARD()->stat.success_file_write_count++;
+
+		sprintf(pEntry->fname2log, "%c"FDFS_STORAGE_DATA_DIR_FORMAT \
+			"/%s", FDFS_STORAGE_STORE_PATH_PREFIX_CHAR, \
+			store_path_index, new_filename);
+	}
+
+	if (result != 0)  //remove the files written
+	{
+		for (pEnd=pEntry, pEntry=pBatch->entries; pEntry<pEnd; pEntry++)
+		{
+			snprintf(pFileContext->filename, \
+				sizeof(pFileContext->filename), "%s/data/%s",\
+				g_fdfs_store_paths.paths[store_path_index], \
+				pEntry->fname2log + FDFS_LOGIC_FILE_PATH_LEN \
+				- FDFS_TRUE_FILE_PATH_LEN);
+			unlink(pFileContext->filename);
+		}
+	}
+
+	return result;
+}
+
+static int storage_upload_files_batch_confirm_done( \
+		struct fast_task_info *pTask)
+{
+	TrunkClientRequest *pRequest;
+
+	pRequest = &(((StorageClientInfo *)pTask->arg)->trunk_request);
+	storage_upload_files_batch_finish(pTask, pRequest->status != 0 ? \
+			pRequest->status : pRequest->result);
+	return 0;
+}
+
+static void storage_upload_files_batch_done_callback( \
+		struct fast_task_info *pTask, const int err_no)
+{
+	StorageClientInfo *pClientInfo;
+	StorageUploadBatchInfo *pBatch;
+	int result;
+
+	pClientInfo = (StorageClientInfo *)pTask->arg;
+	pBatch = (StorageUploadBatchInfo *)pClientInfo->extra_arg;
+	if (pBatch->use_trunk)
+	{
+		if (TRUNK_CLIENT_NEED_CONFIRM(&pBatch->trunk_info))
+		{
+			pClientInfo->deal_func = \
+				storage_upload_files_batch_confirm_done;
+			trunk_client_trunk_alloc_confirm_async(pTask, \
+				&pBatch->trunk_info, err_no, \
+				storage_trunk_confirm_done_callback);
+			return;
+		}
+
+		result = trunk_client_trunk_alloc_confirm( \
+				&pBatch->trunk_info, err_no);
+		if (err_no != 0)
+		{
+			result = err_no;
+		}
+	}
+	else
+	{
+		result = err_no;
+	}
+
+	storage_upload_files_batch_finish(pTask, result);
+}
+
+static int storage_do_upload_files_batch(struct fast_task_info *pTask)
+{
+	StorageClientInfo *pClientInfo;
+	StorageUploadBatchInfo *pBatch;
+	StorageUploadBatchEntry *pEntry;
+	StorageUploadBatchEntry *pEnd;
+	int result;
+
+	pClientInfo = (StorageClientInfo *)pTask->arg;
+	pBatch = (StorageUploadBatchInfo *)pClientInfo->extra_arg;
+	pEnd = pBatch->entries + pBatch->count;
+	for (pEntry=pBatch->entries; pEntry<pEnd; pEntry++)
+	{
+		pEntry->crc32 = CRC32_FINAL(CRC32_ex(pEntry->content, \
+				pEntry->file_size, CRC32_XINIT));
+	}
+
+	if (pBatch->use_trunk)
+	{
+		result = storage_upload_batch_write_trunk(pTask, pBatch);
+	}
+	else
+	{
+		result = storage_upload_batch_write_files(pTask, pBatch);
+	}
+
+	storage_upload_files_batch_done_callback(pTask, result);
+	return result;
+}
+
+/* called by the nio thread when the trunk space is allocated */
+static void storage_upload_files_batch_trunk_alloc_done( \
+		struct fast_task_info *pTask, const int err_no)
+{
+	StorageClientInfo *pClientInfo;
+	StorageUploadBatchInfo *pBatch;
+	int result;
+
+	pClientInfo = (StorageClientInfo *)pTask->arg;
+	pBatch = (StorageUploadBatchInfo *)pClientInfo->extra_arg;
+	if ((result=err_no) == 0)
+	{
+		/* the rest of the trunk space belongs to the last file */
+		pBatch->entries[pBatch->count - 1].alloc_size += \
+			pBatch->trunk_info.file.size - pBatch->alloc_bytes;
+		if ((result=storage_dio_queue_push(pTask)) == 0)
+		{
+			return;
+		}
+
+		trunk_client_trunk_alloc_confirm_async(pTask, \
+				&pBatch->trunk_info, result, NULL);
+		trunk_client_request_submit(pTask);
+	}
+
+	storage_upload_batch_clean_up(pTask);
+	pClientInfo->clean_func = NULL;
+	pClientInfo->total_length = sizeof(TrackerHeader);
+	STORAGE_ACCESS_LOG(pTask, ACCESS_LOG_ACTION_UPLOAD_BATCH, result);
+	storage_send_response(pTask, result);
+}
+
+/**
+pkg format:
+Header
+1 byte: store path index
+4 bytes: file count
+file count entries:
+	8 bytes: file size
+	FDFS_FILE_EXT_NAME_MAX_LEN bytes: file ext name, do not include dot (.)
+file contents in the order of the entries
+response body:
+FDFS_GROUP_NAME_MAX_LEN bytes: group_name
+file count entries:
+	8 bytes: filename length
+	filename
+**/
+static int storage_server_upload_files_batch(struct fast_task_info *pTask)
+{
+	StorageClientInfo *pClientInfo;
+	StorageFileContext *pFileContext;
+	StorageUploadBatchInfo *pBatch;
+	StorageUploadBatchEntry *pEntry;
+	StorageUploadBatchEntry *pEnd;
+	char file_ext_name[FDFS_FILE_EXT_NAME_MAX_LEN + 1];
+	char *p;
+	char *pContent;
+	int64_t nInPackLen;
+	int64_t total_bytes;
+	int64_t alloc_bytes;
+	int file_count;
+	int store_path_index;
+	int bytes;
+	int result;
+
+	pClientInfo = (StorageClientInfo *)pTask->arg;
+	pFileContext =  &(pClientInfo->file_context);
+	nInPackLen = pClientInfo->total_length - sizeof(TrackerHeader);
+	if (pClientInfo->total_length > pTask->size)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"cmd=%d, client ip: %s, package size " \
+			INT64_PRINTF_FORMAT" is too large, " \
+			"expect length <= %d", __LINE__, \
+			STORAGE_PROTO_CMD_UPLOAD_FILES_BATCH, \
+			pTask->client_ip, nInPackLen, \
+			pTask->size - (int)sizeof(TrackerHeader));
+		pClientInfo->total_length = sizeof(TrackerHeader);
+		return EINVAL;
+	}
+	pClientInfo->total_length = sizeof(TrackerHeader);
+
+	if (nInPackLen < 1 + 4 + FDFS_PROTO_PKG_LEN_SIZE + \
+			FDFS_FILE_EXT_NAME_MAX_LEN)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"cmd=%d, client ip: %s, package size " \
+			INT64_PRINTF_FORMAT" is not correct, " \
+			"expect length >= %d", __LINE__, \
+			STORAGE_PROTO_CMD_UPLOAD_FILES_BATCH, \
+			pTask->client_ip,  nInPackLen, \
+			1 + 4 + FDFS_PROTO_PKG_LEN_SIZE + \
+			FDFS_FILE_EXT_NAME_MAX_LEN);
+		return EINVAL;
+	}
+
+	p = pTask->data + sizeof(TrackerHeader);
+	store_path_index = *p++;
+	if (store_path_index == -1)
+	{
+		if ((result=storage_get_storage_path_index( \
+			&store_path_index)) != 0)
+		{
+			logError("file: "__FILE__", line: %d, " \
+				"get_storage_path_index fail, " \
+				"errno: %d, error info: %s", __LINE__, \
+				result, STRERROR(result));
+			return result;
+		}
+	}
+	else if (store_path_index < 0 || store_path_index >= \
+		g_fdfs_store_paths.count)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"client ip: %s, store_path_index: %d " \
+			"is invalid", __LINE__, \
+			pTask->client_ip, store_path_index);
+		return EINVAL;
+	}
+
+	/* the response of the filenames should be in the task buffer */
+	file_count = buff2int(p);
+	p += 4;
+	if (file_count <= 0 || (int64_t)file_count * (FDFS_PROTO_PKG_LEN_SIZE \
+		+ FDFS_FILE_EXT_NAME_MAX_LEN) > nInPackLen - (1 + 4) || \
+		FDFS_GROUP_NAME_MAX_LEN + (int64_t)file_count * \
+		(FDFS_PROTO_PKG_LEN_SIZE + 128) > pTask->size - \
+		(int)sizeof(TrackerHeader))
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"client ip: %s, invalid file count: %d", \
+			__LINE__, pTask->client_ip, file_count);
+		return EINVAL;
+	}
+
+	pBatch = (StorageUploadBatchInfo *)malloc(sizeof( \
+		StorageUploadBatchInfo) + sizeof(StorageUploadBatchEntry) * \
+		file_count);
+	if (pBatch == NULL)
+	{
+		result = errno != 0 ? errno : ENOMEM;
+		logError("file: "__FILE__", line: %d, " \
+			"malloc %d bytes fail, " \
+			"errno: %d, error info: %s", __LINE__, \
+			(int)(sizeof(StorageUploadBatchInfo) + \
+			sizeof(StorageUploadBatchEntry) * file_count), \
+			result, STRERROR(result));
+		return result;
+	}
+	memset(pBatch, 0, sizeof(StorageUploadBatchInfo));
+	pBatch->count = file_count;
+	pBatch->entries = (StorageUploadBatchEntry *)(pBatch + 1);
+	pEnd = pBatch->entries + file_count;
+
+	pContent = p + (FDFS_PROTO_PKG_LEN_SIZE + FDFS_FILE_EXT_NAME_MAX_LEN) \
+			* file_count;
+	total_bytes = 0;
+	alloc_bytes = 0;
+	result = 0;
+	for (pEntry=pBatch->entries; pEntry<pEnd; pEntry++)
+	{
+		pEntry->file_size = buff2long(p);
+		p += FDFS_PROTO_PKG_LEN_SIZE;
+		memcpy(file_ext_name, p, FDFS_FILE_EXT_NAME_MAX_LEN);
+		*(file_ext_name + FDFS_FILE_EXT_NAME_MAX_LEN) = '\0';
+		p += FDFS_FILE_EXT_NAME_MAX_LEN;
+
+		if (pEntry->file_size < 0 || pEntry->file_size > nInPackLen)
+		{
+			logError("file: "__FILE__", line: %d, " \
+				"client ip: %s, invalid file bytes: " \
+				INT64_PRINTF_FORMAT, __LINE__, \
+				pTask->client_ip, pEntry->file_size);
+			result = EINVAL;
+			break;
+		}
+		if ((result=fdfs_validate_filename(file_ext_name)) != 0)
+		{
+			logError("file: "__FILE__", line: %d, " \
+				"client ip: %s, file_ext_name: %s " \
+				"is invalid!", __LINE__, \
+				pTask->client_ip, file_ext_name);
+			break;
+		}
+
+		storage_format_ext_name(file_ext_name, \
+				pEntry->formatted_ext_name);
+		pEntry->content = pContent + total_bytes;
+		total_bytes += pEntry->file_size;
+
+		/* the slot not less than slot_min_size to reuse when freed */
+		bytes = TRUNK_CALC_SIZE(pEntry->file_size);
+		pEntry->alloc_size = bytes > g_slot_min_size ? \
+					bytes : g_slot_min_size;
+		alloc_bytes += pEntry->alloc_size;
+	}
+
+	if (result == 0 && pContent + total_bytes != pTask->data + \
+		sizeof(TrackerHeader) + nInPackLen)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"client ip: %s, pkg length is not correct, " \
+			"total file bytes: "INT64_PRINTF_FORMAT \
+			", total body length: "INT64_PRINTF_FORMAT, \
+			__LINE__, pTask->client_ip, total_bytes, nInPackLen);
+		result = EINVAL;
+	}
+	if (result != 0)
+	{
+		free(pBatch);
+		return result;
+	}
+
+	pFileContext->calc_crc32 = true;
+	pFileContext->calc_file_hash = false;
+	pFileContext->extra_info.upload.start_time = g_current_time;
+	pFileContext->extra_info.upload.trunk_info.path. \
+				store_path_index = store_path_index;
+	pFileContext->extra_info.upload.file_type = _FILE_TYPE_REGULAR;
+	pFileContext->sync_flag = STORAGE_OP_TYPE_SOURCE_CREATE_FILE;
+	pFileContext->timestamp2log = pFileContext->extra_info.upload.start_time;
+	pFileContext->op = FDFS_STORAGE_FILE_OP_WRITE;
+	pFileContext->fd = -1;
+
+	pClientInfo->extra_arg = pBatch;
+	pClientInfo->deal_func = storage_do_upload_files_batch;
+	pClientInfo->clean_func = storage_upload_batch_clean_up;
+	pFileContext->dio_thread_index = storage_dio_get_thread_index( \
+		pTask, store_path_index, pFileContext->op);
+
+	/* one trunk space for all files, split to the slot of each file */
+	pBatch->use_trunk = g_if_use_trunk_file && trunk_check_size(alloc_bytes);
+	if (pBatch->use_trunk)
+	{
+		/* go on in storage_upload_files_batch_trunk_alloc_done */
+		pBatch->alloc_bytes = alloc_bytes;
+		pBatch->trunk_info.path.store_path_index = store_path_index;
+		pFileContext->extra_info.upload.file_type |= _FILE_TYPE_TRUNK;
+		trunk_client_trunk_alloc_space_async(pTask, alloc_bytes, \
+			&pBatch->trunk_info, \
+			storage_upload_files_batch_trunk_alloc_done);
+		return STORAGE_STATUE_DEAL_FILE;
+	}
+	else
+	{
+		char reserved_space_str[32];
+
+		if (!storage_check_reserved_space_path(g_path_space_list \
+			[store_path_index].total_mb, g_path_space_list \
+			[store_path_index].free_mb - (total_bytes/FDFS_ONE_MB), \
+			g_avg_storage_reserved_mb))
+		{
+			logError("file: "__FILE__", line: %d, " \
+				"no space to upload file, "
+				"free space: %d MB is too small, file bytes: " \
+				INT64_PRINTF_FORMAT", reserved space: %s", \
+				__LINE__, g_path_space_list[store_path_index].\
+				free_mb, total_bytes, \
+				fdfs_storage_reserved_space_to_string_ex( \
+				  g_storage_reserved_space.flag, \
+				  g_avg_storage_reserved_mb, \
+				  g_path_space_list[store_path_index]. \
+				  total_mb, g_storage_reserved_space.rs.ratio,\
+				  reserved_space_str));
+			storage_upload_batch_clean_up(pTask);
+			pClientInfo->clean_func = NULL;
+			return ENOSPC;
+		}
+	}
+
+	if ((result=storage_dio_queue_push(pTask)) != 0)
+	{
+		storage_upload_batch_clean_up(pTask);
+		pClientInfo->clean_func = NULL;
+		return result;
+	}
+
+	return STORAGE_STATUE_DEAL_FILE;
+}
+
+static int storage_deal_active_test(struct fast_task_info *pTask)
+{
+	StorageClientInfo *pClientInfo;
+	int64_t nInPackLen;
+
+	pClientInfo = (StorageClientInfo *)pTask->arg;
+	nInPackLen = pClientInfo->total_length - sizeof(TrackerHeader);
+	pClientInfo->total_length = sizeof(TrackerHeader);
+	if (nInPackLen != 0)
+	{
+		logError("file: "__FILE__", line: %d, " \
 			"cmd=%d, client ip: %s, package size " \
 			INT64_PRINTF_FORMAT" is not correct, " \
 			"expect length 0", __LINE__, \
@@ -4737,6 +5667,8 @@ static int storage_append_file(struct fast_task_info *pTask)
 	pFileContext->op = FDFS_STORAGE_FILE_OP_APPEND;
 	pFileContext->open_flags = O_WRONLY | O_APPEND | g_extra_open_file_flags;
 
+	/* the rest of the file content is still to be received */
+	pClientInfo->total_length = sizeof(TrackerHeader) + nInPackLen;
 	return storage_write_to_file(pTask, stat_buf.st_size, file_bytes, \
 			p - pTask->data, dio_write_file, \
 			storage_append_file_done_callback, \
@@ -4934,6 +5866,8 @@ static int storage_modify_file(struct fast_task_info *pTask)
 	pFileContext->op = FDFS_STORAGE_FILE_OP_WRITE;
 	pFileContext->open_flags = O_WRONLY | g_extra_open_file_flags;
 
+	/* the rest of the file content is still to be received */
+	pClientInfo->total_length = sizeof(TrackerHeader) + nInPackLen;
 	return storage_write_to_file(pTask, file_offset, file_bytes, \
 			p - pTask->data, dio_write_file, \
 			storage_modify_file_done_callback, \
@@ -5687,6 +6621,8 @@ static int storage_sync_copy_file(struct fast_task_info *pTask, \
 
 	if (have_file_content)
 	{
+		/* the rest of the file content is still to be received */
+		pClientInfo->total_length = sizeof(TrackerHeader) + nInPackLen;
 		return storage_write_to_file(pTask, file_offset, file_bytes, \
 			p - pTask->data, deal_func, \
 			storage_sync_copy_file_done_callback, \
@@ -5921,6 +6857,8 @@ static int storage_sync_append_file(struct fast_task_info *pTask)
 	pFileContext->extra_info.upload.before_open_callback = NULL;
 	pFileContext->extra_info.upload.before_close_callback = NULL;
 
+	/* the rest of the file content is still to be received */
+	pClientInfo->total_length = sizeof(TrackerHeader) + nInPackLen;
 	return storage_write_to_file(pTask, start_offset, append_bytes, \
 		p - pTask->data, deal_func, \
 		storage_sync_modify_file_done_callback, \
@@ -6124,6 +7062,8 @@ static int storage_sync_modify_file(struct fast_task_info *pTask)
 	pFileContext->extra_info.upload.before_open_callback = NULL;
 	pFileContext->extra_info.upload.before_close_callback = NULL;
 
+	/* the rest of the file content is still to be received */
+	pClientInfo->total_length = sizeof(TrackerHeader) + nInPackLen;
 	return storage_write_to_file(pTask, start_offset, modify_bytes, \
 		p - pTask->data, deal_func, \
 		storage_sync_modify_file_done_callback, \
@@ -6777,19 +7717,71 @@ static int storage_server_get_metadata(struct fast_task_info *pTask)
 		return result;
 	}
 
-	pFileContext->fd = -1;
-	return storage_read_from_file(pTask, 0, file_bytes, \
-			storage_get_metadata_done_callback, store_path_index);
+	pFileContext->fd = -1;
+	return storage_read_from_file(pTask, 0, file_bytes, \
+			storage_get_metadata_done_callback, store_path_index);
+}
+
+/**
+pkg format:
+Header
+8 bytes: file offset
+8 bytes: download file bytes
+FDFS_GROUP_NAME_MAX_LEN bytes: group_name
+filename
+**/
+/* serve the small file from the file cache in the nio thread,
+   return 0 for hit, ENOENT for miss */
+static int storage_download_from_cache(struct fast_task_info *pTask, \
+		const char *filename, const int filename_len, \
+		const int64_t file_offset, const int64_t download_bytes)
+{
+	StorageClientInfo *pClientInfo;
+	StorageFileContext *pFileContext;
+	StorageStatShard *pStatShard;
+	TrackerHeader *pHeader;
+	int64_t bytes;
+
+	pClientInfo = (StorageClientInfo *)pTask->arg;
+	pFileContext =  &(pClientInfo->file_context);
+
+	bytes = download_bytes;
+	pStatShard = STORAGE_STAT_SHARD();
+	pStatShard->stat.total_cache_get_count++;
+	if (download_bytes > pTask->size - (int)sizeof(TrackerHeader) || \
+		storage_file_cache_get(filename, filename_len, file_offset, \
+			&bytes, pTask->data + sizeof(TrackerHeader), \
+			&pFileContext->cache_version) != 0)
+	{
+		return ENOENT;
+	}
+
+	pStatShard->stat.success_cache_get_count++;
+	pStatShard->stat.success_cache_get_bytes += bytes;
+
+	pFileContext->start = file_offset;
+	pFileContext->end = file_offset + bytes;
+	CHECK_AND_WRITE_TO_STAT_FILE2_WITH_BYTES( \
+		total_download_count, \
+		success_download_count, \
+		total_download_bytes, \
+		success_download_bytes, \
+		bytes)
+	STORAGE_ACCESS_LOG(pTask, ACCESS_LOG_ACTION_DOWNLOAD_FILE, 0);
+
+	pClientInfo->total_length = sizeof(TrackerHeader) + bytes;
+	pClientInfo->total_offset = 0;
+	pTask->length = pClientInfo->total_length;
+
+	pHeader = (TrackerHeader *)pTask->data;
+	pHeader->status = 0;
+	pHeader->cmd = STORAGE_PROTO_CMD_RESP;
+	long2buff(bytes, pHeader->pkg_len);
+
+	storage_send_add_event(pTask);
+	return 0;
 }
 
-/**
-pkg format:
-Header
-8 bytes: file offset
-8 bytes: download file bytes
-FDFS_GROUP_NAME_MAX_LEN bytes: group_name
-filename
-**/
 static int storage_server_download_file(struct fast_task_info *pTask)
 {
 	StorageClientInfo *pClientInfo;
@@ -6882,6 +7874,24 @@ static int storage_server_download_file(struct fast_task_info *pTask)
 	STORAGE_ACCESS_STRCPY_FNAME2LOG(filename, filename_len, \
 			pClientInfo);
 
+	pFileContext->fill_cache = false;
+	if (g_file_cache_size > 0)
+	{
+		if (storage_download_from_cache(pTask, filename, filename_len, \
+			file_offset, download_bytes) == 0)
+		{
+			return STORAGE_STATUE_DEAL_FILE;
+		}
+
+		/* the logic filename as the key to fill the cache */
+		if (!g_use_access_log && filename_len < \
+			sizeof(pFileContext->fname2log))
+		{
+			memcpy(pFileContext->fname2log, filename, \
+				filename_len + 1);
+		}
+	}
+
 	if ((result=storage_split_filename_ex(filename, \
 		&filename_len, true_filename, &store_path_index)) != 0)
 	{
@@ -6898,9 +7908,7 @@ static int storage_server_download_file(struct fast_task_info *pTask)
 		&trunkInfo, &trunkHeader, &pFileContext->fd);
 	if (IS_TRUNK_FILE_BY_ID(trunkInfo))
 	{
-		pthread_mutex_lock(&stat_count_thread_lock);
-		g_storage_stat.total_file_open_count++;
-		pthread_mutex_unlock(&stat_count_thread_lock);
+		STORAGE_STAT_SHARD()->stat.total_file_open_count++;
 	}
 	if (result == 0)
 	{
@@ -6924,9 +7932,7 @@ static int storage_server_download_file(struct fast_task_info *pTask)
 
 	if (IS_TRUNK_FILE_BY_ID(trunkInfo))
 	{
-		pthread_mutex_lock(&stat_count_thread_lock);
-		g_storage_stat.success_file_open_count++;
-		pthread_mutex_unlock(&stat_count_thread_lock);
+		STORAGE_STAT_SHARD()->stat.success_file_open_count++;
 	}
 
 	if (download_bytes == 0)
@@ -6943,11 +7949,17 @@ static int storage_server_download_file(struct fast_task_info *pTask)
 			file_bytes - file_offset);
 		if (pFileContext->fd >= 0)
 		{
-			close(pFileContext->fd);
+			dio_close_file(pFileContext);
 		}
 		return EINVAL;
 	}
 
+	/* read the whole small file by the dio thread to fill the cache */
+	pFileContext->fill_cache = g_file_cache_size > 0 && \
+		file_offset == 0 && download_bytes == file_bytes && \
+		file_bytes <= g_file_cache_max_file_size && \
+		strlen(pFileContext->fname2log) > 0;
+
 	if (IS_TRUNK_FILE_BY_ID(trunkInfo))
 	{
 		trunk_get_full_filename((&trunkInfo), pFileContext->filename, \
@@ -6964,6 +7976,323 @@ static int storage_server_download_file(struct fast_task_info *pTask)
 			storage_download_file_done_callback, store_path_index);
 }
 
+static int storage_batch_download_entry_cmp(const void *p1, const void *p2)
+{
+	const StorageBatchDownloadEntry *pEntry1;
+	const StorageBatchDownloadEntry *pEntry2;
+	int result;
+
+	pEntry1 = (const StorageBatchDownloadEntry *)p1;
+	pEntry2 = (const StorageBatchDownloadEntry *)p2;
+	if ((result=strcmp(pEntry1->filename, pEntry2->filename)) != 0)
+	{
+		return result;
+	}
+
+	if (pEntry1->offset != pEntry2->offset)
+	{
+		return pEntry1->offset < pEntry2->offset ? -1 : 1;
+	}
+	return pEntry1->index - pEntry2->index;
+}
+
+/* stat the file of the batch download entry in the nio thread,
+   return the entry status */
+static int storage_batch_download_stat_file(struct fast_task_info *pTask, \
+		char *filename, int filename_len, const int64_t file_offset, \
+		const int64_t download_bytes, \
+		StorageBatchDownloadEntry *pEntry, int *store_path_index)
+{
+	char true_filename[128];
+	struct stat stat_buf;
+	FDFSTrunkFullInfo trunkInfo;
+	FDFSTrunkHeader trunkHeader;
+	int result;
+
+	if (file_offset < 0 || download_bytes < 0)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"client ip:%s, invalid file offset: " \
+			INT64_PRINTF_FORMAT" or download file bytes: " \
+			INT64_PRINTF_FORMAT,  __LINE__, pTask->client_ip, \
+			file_offset, download_bytes);
+		return EINVAL;
+	}
+
+	if ((result=storage_split_filename_ex(filename, \
+		&filename_len, true_filename, store_path_index)) != 0)
+	{
+		return result;
+	}
+	if ((result=fdfs_check_data_filename(true_filename, filename_len)) != 0)
+	{
+		return result;
+	}
+
+	if ((result=trunk_file_stat(*store_path_index, true_filename, \
+		filename_len, &stat_buf, &trunkInfo, &trunkHeader)) != 0)
+	{
+		STORAGE_STAT_FILE_FAIL_LOG(result, pTask->client_ip,
+			"logic", filename)
+		return result;
+	}
+
+	if (!S_ISREG(stat_buf.st_mode))
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"logic file %s is not a regular file", \
+			__LINE__, filename);
+		return EISDIR;
+	}
+
+	if (download_bytes == 0)
+	{
+		if (file_offset > stat_buf.st_size)
+		{
+			return EINVAL;
+		}
+		pEntry->bytes = stat_buf.st_size - file_offset;
+	}
+	else if (download_bytes > stat_buf.st_size - file_offset)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"client ip:%s, invalid download file bytes: " \
+			INT64_PRINTF_FORMAT" > file remain bytes: " \
+			INT64_PRINTF_FORMAT,  __LINE__, \
+			pTask->client_ip, download_bytes, \
+			stat_buf.st_size - file_offset);
+		return EINVAL;
+	}
+	else
+	{
+		pEntry->bytes = download_bytes;
+	}
+
+	if (IS_TRUNK_FILE_BY_ID(trunkInfo))
+	{
+		trunk_get_full_filename((&trunkInfo), pEntry->filename, \
+				sizeof(pEntry->filename));
+		pEntry->offset = file_offset + \
+				TRUNK_FILE_START_OFFSET(trunkInfo);
+	}
+	else
+	{
+		snprintf(pEntry->filename, sizeof(pEntry->filename), \
+			"%s/data/%s", g_fdfs_store_paths.paths[ \
+			*store_path_index], true_filename);
+		pEntry->offset = file_offset;
+	}
+
+	return 0;
+}
+
+/**
+pkg format:
+Header
+FDFS_GROUP_NAME_MAX_LEN bytes: group_name
+4 bytes: file count
+file count entries:
+	8 bytes: file offset
+	8 bytes: download file bytes, 0 means to the end of the file
+	8 bytes: filename length
+	filename
+response body, the frames of the files in the read order:
+	4 bytes: the index of the file in the request
+	1 byte: status, 0 for success
+	8 bytes: content length
+	content (padding when the status is not 0)
+**/
+static int storage_server_download_files_batch(struct fast_task_info *pTask)
+{
+	StorageClientInfo *pClientInfo;
+	StorageFileContext *pFileContext;
+	StorageBatchDownloadEntry *entries;
+	StorageBatchDownloadEntry *pEntry;
+	TrackerHeader *pHeader;
+	char group_name[FDFS_GROUP_NAME_MAX_LEN + 1];
+	char filename[128];
+	char *p;
+	char *pEnd;
+	int64_t nInPackLen;
+	int64_t file_offset;
+	int64_t download_bytes;
+	int64_t filename_len;
+	int64_t total_bytes;
+	int file_count;
+	int store_path_index;
+	int first_store_path_index;
+	int i;
+	int result;
+
+	pClientInfo = (StorageClientInfo *)pTask->arg;
+	pFileContext =  &(pClientInfo->file_context);
+
+	nInPackLen = pClientInfo->total_length - sizeof(TrackerHeader);
+	pClientInfo->total_length = sizeof(TrackerHeader);
+	if (nInPackLen <= FDFS_GROUP_NAME_MAX_LEN + 4)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"cmd=%d, client ip: %s, package size " \
+			INT64_PRINTF_FORMAT" is not correct, " \
+			"expect length > %d", __LINE__, \
+			STORAGE_PROTO_CMD_DOWNLOAD_FILES_BATCH, \
+			pTask->client_ip, nInPackLen, \
+			FDFS_GROUP_NAME_MAX_LEN + 4);
+		return EINVAL;
+	}
+
+	p = pTask->data + sizeof(TrackerHeader);
+	pEnd = p + nInPackLen;
+	memcpy(group_name, p, FDFS_GROUP_NAME_MAX_LEN);
+	*(group_name + FDFS_GROUP_NAME_MAX_LEN) = '\0';
+	p += FDFS_GROUP_NAME_MAX_LEN;
+	if (strcmp(group_name, g_group_name) != 0)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"client ip:%s, group_name: %s " \
+			"not correct, should be: %s", \
+			__LINE__, pTask->client_ip, \
+			group_name, g_group_name);
+		return EINVAL;
+	}
+
+	file_count = buff2int(p);
+	p += 4;
+	if (file_count <= 0 || file_count > (pEnd - p) / \
+		(3 * FDFS_PROTO_PKG_LEN_SIZE + 1))
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"client ip: %s, invalid file count: %d", \
+			__LINE__, pTask->client_ip, file_count);
+		return EINVAL;
+	}
+
+	entries = (StorageBatchDownloadEntry *)malloc( \
+			sizeof(StorageBatchDownloadEntry) * file_count);
+	if (entries == NULL)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"malloc %d bytes fail, " \
+			"errno: %d, error info: %s", __LINE__, \
+			(int)sizeof(StorageBatchDownloadEntry) * file_count, \
+			errno, STRERROR(errno));
+		return errno != 0 ? errno : ENOMEM;
+	}
+
+	first_store_path_index = 0;
+	total_bytes = 0;
+	for (i=0; i<file_count; i++)
+	{
+		if (pEnd - p < 3 * FDFS_PROTO_PKG_LEN_SIZE)
+		{
+			break;
+		}
+
+		file_offset = buff2long(p);
+		p += FDFS_PROTO_PKG_LEN_SIZE;
+		download_bytes = buff2long(p);
+		p += FDFS_PROTO_PKG_LEN_SIZE;
+		filename_len = buff2long(p);
+		p += FDFS_PROTO_PKG_LEN_SIZE;
+		if (filename_len <= 0 || filename_len > pEnd - p)
+		{
+			break;
+		}
+
+		pEntry = entries + i;
+		pEntry->index = i;
+		pEntry->offset = 0;
+		pEntry->bytes = 0;
+		*(pEntry->filename) = '\0';
+		if (filename_len >= sizeof(filename))
+		{
+			pEntry->status = EINVAL;
+		}
+		else
+		{
+			memcpy(filename, p, filename_len);
+			*(filename + filename_len) = '\0';
+			if (i == 0)
+			{
+				STORAGE_ACCESS_STRCPY_FNAME2LOG(filename, \
+					filename_len, pClientInfo);
+			}
+
+			pEntry->status = storage_batch_download_stat_file( \
+				pTask, filename, filename_len, file_offset, \
+				download_bytes, pEntry, &store_path_index);
+			if (pEntry->status == 0)
+			{
+				if (total_bytes == 0)
+				{
+					first_store_path_index = \
+						store_path_index;
+				}
+				total_bytes += pEntry->bytes;
+			}
+			else
+			{
+				pEntry->bytes = 0;
+			}
+		}
+		p += filename_len;
+		total_bytes += STORAGE_PROTO_BATCH_DOWNLOAD_FRAME_SIZE;
+	}
+
+	if (i < file_count || p != pEnd)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"client ip: %s, package size " \
+			INT64_PRINTF_FORMAT" is not correct " \
+			"for file count: %d", __LINE__, \
+			pTask->client_ip, nInPackLen, file_count);
+		free(entries);
+		return EINVAL;
+	}
+
+	/* read the files in the order of the filename and the offset,
+	   the entries in the same trunk file are read sequentially */
+	qsort(entries, file_count, sizeof(StorageBatchDownloadEntry), \
+		storage_batch_download_entry_cmp);
+
+	pClientInfo->deal_func = dio_read_files_batch;
+	pClientInfo->clean_func = dio_read_batch_finish_clean_up;
+	pClientInfo->total_length = sizeof(TrackerHeader) + total_bytes;
+	pClientInfo->total_offset = 0;
+
+	pFileContext->fd = -1;
+	pFileContext->op = FDFS_STORAGE_FILE_OP_READ;
+	pFileContext->open_flags = O_RDONLY | g_extra_open_file_flags;
+	pFileContext->use_sendfile = false;
+	pFileContext->fill_cache = false;
+	pFileContext->offset = 0;
+	pFileContext->start = 0;
+	pFileContext->end = 0;
+	pFileContext->batch.entries = entries;
+	pFileContext->batch.count = file_count;
+	pFileContext->batch.current = 0;
+	pFileContext->batch.frame_done = false;
+	pFileContext->dio_thread_index = storage_dio_get_thread_index( \
+		pTask, first_store_path_index, pFileContext->op);
+	pFileContext->done_callback = \
+		storage_download_files_batch_done_callback;
+
+	pTask->length = sizeof(TrackerHeader);
+	pHeader = (TrackerHeader *)pTask->data;
+	pHeader->status = 0;
+	pHeader->cmd = STORAGE_PROTO_CMD_RESP;
+	long2buff(total_bytes, pHeader->pkg_len);
+
+	if ((result=storage_dio_queue_push(pTask)) != 0)
+	{
+		dio_read_batch_finish_clean_up(pTask);
+		pClientInfo->total_length = sizeof(TrackerHeader);
+		return result;
+	}
+
+	return STORAGE_STATUE_DEAL_FILE;
+}
+
 static int storage_do_delete_file(struct fast_task_info *pTask, \
 		DeleteFileLogCallback log_callback, \
 		FileDealDoneCallback done_callback, \
@@ -7025,11 +8354,20 @@ static int storage_read_from_file(struct fast_task_info *pTask, \
 	pHeader->cmd = STORAGE_PROTO_CMD_RESP;
 	long2buff(download_bytes, pHeader->pkg_len);
 
+	pFileContext->use_sendfile = g_use_sendfile && download_bytes > 0 && \
+				!pFileContext->fill_cache;
+	if (pFileContext->use_sendfile)
+	{
+		/* the dio thread opens the file, then the nio thread
+		   sends the header and the content */
+		pClientInfo->deal_func = dio_open_for_sendfile;
+	}
+
 	if ((result=storage_dio_queue_push(pTask)) != 0)
 	{
 		if (pFileContext->fd >= 0)
 		{
-			close(pFileContext->fd);
+			dio_close_file(pFileContext);
 		}
 		pClientInfo->total_length = sizeof(TrackerHeader);
 		return result;
@@ -7080,6 +8418,15 @@ static int storage_write_to_file(struct fast_task_info *pTask, \
 		}
 	}
 
+	/* the first block is written by the dio thread, the nio thread
+	   splices the rest to the pipe, and the dio thread splices the
+	   pipe to the file */
+	pFileContext->use_splice = g_use_splice && \
+		deal_func == dio_write_file && \
+		!pFileContext->calc_crc32 && !pFileContext->calc_file_hash && \
+		(pFileContext->open_flags & O_APPEND) == 0 && \
+		upload_bytes > pTask->length - buff_offset;
+
 	if ((result=storage_dio_queue_push(pTask)) != 0)
 	{
 		pClientInfo->total_length = sizeof(TrackerHeader);
@@ -7614,15 +8961,13 @@ static int storage_create_link_core(struct fast_task_info *pTask, \
 	if (result == 0)
 	{
 		CHECK_AND_WRITE_TO_STAT_FILE3( \
-			g_storage_stat.total_create_link_count, \
-			g_storage_stat.success_create_link_count, \
-			g_storage_stat.last_source_update)
+			total_create_link_count, \
+			success_create_link_count, \
+			last_source_update)
 	}
 	else
 	{
-		pthread_mutex_lock(&stat_count_thread_lock);
-		g_storage_stat.total_create_link_count++;
-		pthread_mutex_unlock(&stat_count_thread_lock);
+		STORAGE_STAT_SHARD()->stat.total_create_link_count++;
 	}
 
 	return result;
@@ -7915,12 +9260,14 @@ static int storage_create_link(struct fast_task_info *pTask)
 int fdfs_stat_file_sync_func(void *args)
 {
 	int result;
+	int stat_change_count;
 
-	if (last_stat_change_count !=  g_stat_change_count)
+	stat_change_count = g_stat_change_count + storage_stat_change_count();
+	if (last_stat_change_count != stat_change_count)
 	{
 		if ((result=storage_write_to_stat_file()) == 0)
 		{
-			last_stat_change_count = g_stat_change_count;
+			last_stat_change_count = stat_change_count;
 		}
 
 		return result;
@@ -7945,6 +9292,24 @@ int fdfs_stat_file_sync_func(void *args)
 		} \
 	} while (0)
 
+static void storage_send_response(struct fast_task_info *pTask, \
+		const int result)
+{
+	StorageClientInfo *pClientInfo;
+	TrackerHeader *pHeader;
+
+	pClientInfo = (StorageClientInfo *)pTask->arg;
+	pClientInfo->total_offset = 0;
+	pTask->length = pClientInfo->total_length;
+
+	pHeader = (TrackerHeader *)pTask->data;
+	pHeader->status = result;
+	pHeader->cmd = STORAGE_PROTO_CMD_RESP;
+	long2buff(pClientInfo->total_length - sizeof(TrackerHeader), \
+			pHeader->pkg_len);
+	storage_send_add_event(pTask);
+}
+
 int storage_deal_task(struct fast_task_info *pTask)
 {
 	TrackerHeader *pHeader;
@@ -7963,6 +9328,13 @@ int storage_deal_task(struct fast_task_info *pTask)
 				ACCESS_LOG_ACTION_DOWNLOAD_FILE, \
 				result);
 			break;
+		case STORAGE_PROTO_CMD_DOWNLOAD_FILES_BATCH:
+			ACCESS_LOG_INIT_FIELDS();
+			result = storage_server_download_files_batch(pTask);
+			STORAGE_ACCESS_LOG(pTask, \
+				ACCESS_LOG_ACTION_DOWNLOAD_BATCH, \
+				result);
+			break;
 		case STORAGE_PROTO_CMD_GET_METADATA:
 			ACCESS_LOG_INIT_FIELDS();
 			result = storage_server_get_metadata(pTask);
@@ -7977,6 +9349,13 @@ int storage_deal_task(struct fast_task_info *pTask)
 				ACCESS_LOG_ACTION_UPLOAD_FILE, \
 				result);
 			break;
+		case STORAGE_PROTO_CMD_UPLOAD_FILES_BATCH:
+			ACCESS_LOG_INIT_FIELDS();
+			result = storage_server_upload_files_batch(pTask);
+			STORAGE_ACCESS_LOG(pTask, \
+				ACCESS_LOG_ACTION_UPLOAD_BATCH, \
+				result);
+			break;
 		case STORAGE_PROTO_CMD_UPLOAD_APPENDER_FILE:
 			ACCESS_LOG_INIT_FIELDS();
 			result = storage_upload_file(pTask, true);
@@ -8075,9 +9454,15 @@ int storage_deal_task(struct fast_task_info *pTask)
 		case STORAGE_PROTO_CMD_TRUNK_ALLOC_CONFIRM:
 			result = storage_server_trunk_alloc_confirm(pTask);
 			break;
+		case STORAGE_PROTO_CMD_TRUNK_ALLOC_LEASE:
+			result = storage_server_trunk_alloc_lease(pTask);
+			break;
 		case STORAGE_PROTO_CMD_TRUNK_FREE_SPACE:
 			result = storage_server_trunk_free_space(pTask);
 			break;
+		case STORAGE_PROTO_CMD_TRUNK_RETURN_LEASE:
+			result = storage_server_trunk_return_lease(pTask);
+			break;
 		case STORAGE_PROTO_CMD_TRUNK_SYNC_BINLOG:
 			result = storage_server_trunk_sync_binlog(pTask);
 			break;
@@ -8102,15 +9487,7 @@ int storage_deal_task(struct fast_task_info *pTask)
 
 	if (result != STORAGE_STATUE_DEAL_FILE)
 	{
-		pClientInfo->total_offset = 0;
-		pTask->length = pClientInfo->total_length;
-
-		pHeader = (TrackerHeader *)pTask->data;
-		pHeader->status = result;
-		pHeader->cmd = STORAGE_PROTO_CMD_RESP;
-		long2buff(pClientInfo->total_length - sizeof(TrackerHeader), \
-				pHeader->pkg_len);
-		storage_send_add_event(pTask);
+		storage_send_response(pTask, result);
 	}
 
 	return result;
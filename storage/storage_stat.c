@@ -0,0 +1,186 @@
+/**
+* Copyright (C) 2008 Happy Fish / YuQing
+*
+* FastDFS may be copied only under the terms of the GNU General
+* Public License V3, which may be found in the FastDFS source kit.
+* Please visit the FastDFS Home Page http://www.csource.org/ for more detail.
+**/
+
+//storage_stat.c
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <errno.h>
+#include <pthread.h>
+#include "shared_func.h"
+#include "pthread_func.h"
+#include "logger.h"
+#include "storage_stat.h"
+
+/* the int64_t counters before last_source_update */
+#define STORAGE_STAT_COUNTER_COUNT \
+	(offsetof(FDFSStorageStat, last_source_update) / sizeof(int64_t))
+
+/* padding to the cache line to avoid false sharing */
+#define STORAGE_STAT_SHARD_ALLOC_SIZE \
+	((sizeof(StorageStatShard) + STORAGE_STAT_CACHE_LINE_SIZE - 1) & \
+	 (~(STORAGE_STAT_CACHE_LINE_SIZE - 1)))
+
+__thread StorageStatShard *g_storage_stat_shard = NULL;
+
+static pthread_mutex_t stat_shard_lock;
+static pthread_key_t stat_shard_key;
+static StorageStatShard *stat_shard_head = NULL;
+static FDFSStorageStat stat_base;
+
+static void storage_stat_shard_release(void *arg)
+{
+	StorageStatShard *pShard;
+
+	/* keep the counters, the shard will be reused by a new thread */
+	pShard = (StorageStatShard *)arg;
+	pthread_mutex_lock(&stat_shard_lock);
+	pShard->in_use = false;
+	pthread_mutex_unlock(&stat_shard_lock);
+}
+
+int storage_stat_init(const FDFSStorageStat *pBase)
+{
+	int result;
+
+	memcpy(&stat_base, pBase, sizeof(FDFSStorageStat));
+	if ((result=init_pthread_lock(&stat_shard_lock)) != 0)
+	{
+		return result;
+	}
+
+	if ((result=pthread_key_create(&stat_shard_key, \
+			storage_stat_shard_release)) != 0)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"call pthread_key_create fail, " \
+			"errno: %d, error info: %s", \
+			__LINE__, result, STRERROR(result));
+		return result;
+	}
+
+	return 0;
+}
+
+void storage_stat_destroy()
+{
+	StorageStatShard *pShard;
+	StorageStatShard *pDeleted;
+
+	pthread_mutex_lock(&stat_shard_lock);
+	pShard = stat_shard_head;
+	while (pShard != NULL)
+	{
+		pDeleted = pShard;
+		pShard = pShard->next;
+		if (!pDeleted->in_use)
+		{
+			free(pDeleted);
+		}
+	}
+	stat_shard_head = NULL;
+	pthread_mutex_unlock(&stat_shard_lock);
+}
+
+StorageStatShard *storage_stat_shard_get()
+{
+	StorageStatShard *pShard;
+	int result;
+
+	pthread_mutex_lock(&stat_shard_lock);
+	pShard = stat_shard_head;
+	while (pShard != NULL && pShard->in_use)
+	{
+		pShard = pShard->next;
+	}
+
+	if (pShard == NULL)
+	{
+		if ((result=posix_memalign((void **)&pShard, \
+			STORAGE_STAT_CACHE_LINE_SIZE, \
+			STORAGE_STAT_SHARD_ALLOC_SIZE)) != 0)
+		{
+			pthread_mutex_unlock(&stat_shard_lock);
+			logCrit("file: "__FILE__", line: %d, " \
+				"malloc %d bytes fail, " \
+				"errno: %d, error info: %s, program exit!", \
+				__LINE__, (int)STORAGE_STAT_SHARD_ALLOC_SIZE, \
+				result, STRERROR(result));
+			abort();
+		}
+
+		memset(pShard, 0, STORAGE_STAT_SHARD_ALLOC_SIZE);
+		pShard->next = stat_shard_head;
+		stat_shard_head = pShard;
+	}
+	pShard->in_use = true;
+	pthread_mutex_unlock(&stat_shard_lock);
+
+	pthread_setspecific(stat_shard_key, pShard);
+	g_storage_stat_shard = pShard;
+	return pShard;
+}
+
+void storage_stat_merge(FDFSStorageStat *pStat)
+{
+	StorageStatShard *pShard;
+	int64_t counters[STORAGE_STAT_COUNTER_COUNT];
+	const int64_t *pSrc;
+	int64_t *pDest;
+	int64_t *pEnd;
+	time_t last_source_update;
+	time_t last_sync_update;
+
+	memcpy(counters, &stat_base, sizeof(counters));
+	last_source_update = stat_base.last_source_update;
+	last_sync_update = stat_base.last_sync_update;
+
+	pEnd = counters + STORAGE_STAT_COUNTER_COUNT;
+	pthread_mutex_lock(&stat_shard_lock);
+	for (pShard=stat_shard_head; pShard!=NULL; pShard=pShard->next)
+	{
+		pSrc = (const int64_t *)&pShard->stat;
+		for (pDest=counters; pDest<pEnd; pDest++)
+		{
+			*pDest += *pSrc++;
+		}
+
+		if (pShard->stat.last_source_update > last_source_update)
+		{
+			last_source_update = pShard->stat.last_source_update;
+		}
+		if (pShard->stat.last_sync_update > last_sync_update)
+		{
+			last_sync_update = pShard->stat.last_sync_update;
+		}
+	}
+
+	memcpy(pStat, counters, sizeof(counters));
+	pStat->last_source_update = last_source_update;
+	pStat->last_sync_update = last_sync_update;
+	pthread_mutex_unlock(&stat_shard_lock);
+}
+
+int storage_stat_change_count()
+{
+	StorageStatShard *pShard;
+	int change_count;
+
+	change_count = 0;
+	pthread_mutex_lock(&stat_shard_lock);
+	for (pShard=stat_shard_head; pShard!=NULL; pShard=pShard->next)
+	{
+		change_count += pShard->change_count;
+	}
+	pthread_mutex_unlock(&stat_shard_lock);
+
+	return change_count;
+}
+
@@ -0,0 +1,62 @@
+/**
+* Copyright (C) 2008 Happy Fish / YuQing
+*
+* FastDFS may be copied only under the terms of the GNU General
+* Public License V3, which may be found in the FastDFS source kit.
+* Please visit the FastDFS Home Page http://www.csource.org/ for more detail.
+**/
+
+//storage_stat.h
+
+#ifndef _STORAGE_STAT_H
+#define _STORAGE_STAT_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "common_define.h"
+#include "tracker_types.h"
+
+#define STORAGE_STAT_CACHE_LINE_SIZE  64
+
+/* per thread stat counters, no lock needed when update,
+   the shards are merged when write to stat file or heart beat */
+typedef struct storage_stat_shard
+{
+	FDFSStorageStat stat;  //the counters increased since startup
+	int change_count;      //stat change count since startup
+	bool in_use;           //if owned by a live thread
+	struct storage_stat_shard *next;
+} StorageStatShard;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern __thread StorageStatShard *g_storage_stat_shard;
+
+/* the stat shard of current thread */
+#define STORAGE_STAT_SHARD() (g_storage_stat_shard != NULL ? \
+		g_storage_stat_shard : storage_stat_shard_get())
+
+/* pBase: the stat loaded from the stat file */
+int storage_stat_init(const FDFSStorageStat *pBase);
+void storage_stat_destroy();
+
+/* alloc the stat shard for current thread */
+StorageStatShard *storage_stat_shard_get();
+
+/* merge the base and all shards to pStat, the timestamps
+   last_synced_timestamp and last_heart_beat_time are not changed */
+void storage_stat_merge(FDFSStorageStat *pStat);
+
+/* the sum of the change count of all shards */
+int storage_stat_change_count();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
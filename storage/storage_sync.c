@@ -9,6 +9,7 @@
 
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/time.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
@@ -19,6 +20,7 @@
 #include <string.h>
 #include <errno.h>
 #include <time.h>
+#include <dirent.h>
 #include "fdfs_define.h"
 #include "logger.h"
 #include "fdfs_global.h"
@@ -30,11 +32,14 @@
 #include "tracker_types.h"
 #include "tracker_proto.h"
 #include "storage_global.h"
+#include "storage_file_cache.h"
 #include "storage_func.h"
 #include "storage_ip_changed_dealer.h"
 #include "tracker_client_thread.h"
 #include "storage_client.h"
 #include "storage_sync.h"
+#include "storage_stat.h"
+#include "hash.h"
 #include "trunk_mem.h"
 
 #define SYNC_BINLOG_FILE_MAX_SIZE	1024 * 1024 * 1024
@@ -50,7 +55,12 @@
 #define MARK_ITEM_UNTIL_TIMESTAMP	"until_timestamp"
 #define MARK_ITEM_SCAN_ROW_COUNT	"scan_row_count"
 #define MARK_ITEM_SYNC_ROW_COUNT	"sync_row_count"
+#define MARK_ITEM_STREAM_COUNT		"stream_count"
 #define SYNC_BINLOG_WRITE_BUFF_SIZE	(16 * 1024)
+#define SYNC_BINLOG_TS_INDEX_FILENAME	SYNC_BINLOG_FILE_PREFIX"_timestamp.idx"
+#define SYNC_BINLOG_TS_INDEX_INTERVAL	(64 * 1024)
+#define SYNC_BINLOG_TS_ENTRY_SIZE	16
+#define SYNC_CONVERT_FILE_EXT		".convert"
 
 int g_binlog_fd = -1;
 int g_binlog_index = 0;
@@ -58,6 +68,7 @@ static int64_t binlog_file_size = 0;
 
 int g_storage_sync_thread_count = 0;
 static pthread_mutex_t sync_thread_lock;
+static pthread_cond_t binlog_write_cond;  //signaled when the binlog written
 static char *binlog_write_cache_buff = NULL;
 static int binlog_write_cache_len = 0;
 static int binlog_write_version = 1;
@@ -65,10 +76,338 @@ static int binlog_write_version = 1;
 /* save sync thread ids */
 static pthread_t *sync_tids = NULL;
 
+/* the sync threads (streams) to one dest server, the streams scan the
+   whole binlog and each stream sends the records of its files only */
+typedef struct
+{
+	FDFSStorageBrief *pStorage;
+	int stream_count;
+	int thread_count;   //the running stream threads, protected by
+			    //sync_thread_lock as well as sync_old_dones
+	bool *sync_old_dones;   //if the stream synced the old records
+	volatile int *timestamps;  //the timestamp of the binlog record
+				   //which the stream reached, -1 for idle
+} StorageSyncPeer;
+
+typedef struct
+{
+	StorageSyncPeer *pPeer;
+	int index;
+} StorageSyncStream;
+
+/* the entry of the sparse timestamp index of the binlog, the timestamp is
+   the max timestamp of the records before the binlog position, so the
+   timestamps of the entries are ascending even though the timestamps of
+   the replica records are not. the entry is stored as 4 bytes timestamp,
+   4 bytes binlog index and 8 bytes binlog offset */
+typedef struct
+{
+	int timestamp;
+	int binlog_index;
+	int64_t binlog_offset;
+} StorageBinLogTsEntry;
+
+static StorageBinLogTsEntry *binlog_ts_entries = NULL;
+static int binlog_ts_entry_count = 0;
+static int binlog_ts_entry_alloc = 0;
+static int binlog_ts_index_fd = -1;
+static int binlog_max_timestamp = 0;  //of the records in the binlog files
+static int binlog_cache_max_timestamp = 0; //of the records in write cache
+
+/* the mark file converted with the binlog file */
+typedef struct
+{
+	char filename[MAX_PATH_SIZE];
+	int binlog_index;
+	int64_t binlog_offset;
+	int64_t new_offset;  //the offset in the converted binlog file
+	bool converted;
+} StorageBinLogConvertMark;
+
+typedef struct
+{
+	int binlog_index;
+	int fd;
+	char *buff;    //the write buffer of the converted binlog file
+	int length;
+	int64_t offset;  //the offset in the converted binlog file
+	int changed_count;  //the converted or dropped records
+	StorageBinLogConvertMark *marks;
+	int mark_count;
+} StorageBinLogConverter;
+
+/* the history of the file in the binlog files to compact */
+typedef struct
+{
+	int create_index;   //the binlog position of the create record
+	int delete_index;   //the binlog position of the last delete record
+	int64_t create_offset;
+	int64_t delete_offset;
+	char status;
+} StorageBinLogCompactFile;
+
+#define SYNC_COMPACT_FILE_ALIVE		0  //created and not deleted
+#define SYNC_COMPACT_FILE_DELETED	1  //deleted after created
+#define SYNC_COMPACT_FILE_KEEP		2  //the records must be kept
+#define SYNC_COMPACT_FILE_DROP		3  //the records can be dropped
+
+/* the compactor drops the records of the files which created and deleted
+   (net-zero histories) from the binlog files before end_index */
+typedef struct
+{
+	StorageBinLogConverter converter;
+	HashArray files;
+	int end_index;
+	char *rewrite_flags;  //if the binlog file contains dropped records
+	int drop_file_count;
+
+	/* the timestamp index entries of the compacted binlog file */
+	StorageBinLogTsEntry *ts_entries;
+	int ts_entry_count;
+	int ts_entry_alloc;
+	int max_timestamp;
+} StorageBinLogCompactor;
+
+/* the readers of the binlog files, the online compactor only rewrites
+   the binlog files before the readers and the mark files */
+static pthread_mutex_t binlog_compact_lock;
+static StorageBinLogReader **binlog_readers = NULL;
+static int binlog_reader_count = 0;
+static int binlog_reader_alloc = 0;
+static int binlog_compacted_index = 0;  //the files before it compacted
+static bool compactor_continue_flag = true;
+static bool compactor_thread_running = false;
+
+/* called for each record of the binlog file, pRecord is NULL for the
+   invalid record or the incomplete record at the end of the file */
+typedef int (*storage_binlog_scan_func)(void *args, const char *buff, \
+		const int length, const StorageBinLogRecord *pRecord, \
+		const int64_t offset);
+
 static int storage_write_to_mark_file(StorageBinLogReader *pReader);
 static int storage_binlog_reader_skip(StorageBinLogReader *pReader);
 static int storage_binlog_fsync(const bool bNeedLock);
 static int storage_binlog_preread(StorageBinLogReader *pReader);
+static int storage_sync_copy_file(ConnectionInfo *pStorageServer, \
+	StorageBinLogReader *pReader, const StorageBinLogRecord *pRecord, \
+	char proto_cmd);
+
+static int storage_sync_window_init(StorageSyncWindow *pWindow)
+{
+	int bytes;
+
+	memset(pWindow, 0, sizeof(StorageSyncWindow));
+	pWindow->size = g_sync_window_size + 1;
+	bytes = sizeof(StorageSyncRequest) * pWindow->size;
+	pWindow->requests = (StorageSyncRequest *)malloc(bytes);
+	if (pWindow->requests == NULL)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"malloc %d bytes fail, " \
+			"errno: %d, error info: %s", \
+			__LINE__, bytes, errno, STRERROR(errno));
+		return errno != 0 ? errno : ENOMEM;
+	}
+
+	pWindow->next_seq = 1;
+	return 0;
+}
+
+static void storage_sync_window_destroy(StorageSyncWindow *pWindow)
+{
+	if (pWindow->requests != NULL)
+	{
+		free(pWindow->requests);
+		pWindow->requests = NULL;
+	}
+	pWindow->head = 0;
+	pWindow->count = 0;
+}
+
+/* the request is sent, its response will be received later */
+static void storage_sync_window_push(StorageBinLogReader *pReader, \
+	const StorageBinLogRecord *pRecord, const char cmd, \
+	const char status, const int64_t send_bytes)
+{
+	StorageSyncWindow *pWindow;
+	StorageSyncRequest *pRequest;
+
+	pWindow = pReader->window;
+	pRequest = pWindow->requests + (pWindow->head + pWindow->count) % \
+			pWindow->size;
+	pRequest->seq = pWindow->next_seq++;
+	pRequest->cmd = cmd;
+	pRequest->status = status;
+	pRequest->binlog_index = pWindow->binlog_index;
+	pRequest->binlog_offset = pWindow->binlog_offset;
+	pRequest->scan_row_count = pWindow->scan_row_count;
+	pRequest->send_bytes = send_bytes;
+	memcpy(&pRequest->record, pRecord, sizeof(StorageBinLogRecord));
+	pWindow->count++;
+}
+
+/* the earliest binlog position of the in-flight requests, the records
+   from this position should be synced again after reconnect */
+static bool storage_sync_window_get_mark(StorageSyncWindow *pWindow, \
+	int *binlog_index, int64_t *binlog_offset, int64_t *scan_row_count)
+{
+	StorageSyncRequest *pRequest;
+	StorageSyncRequest *pMin;
+	int i;
+
+	if (pWindow == NULL || pWindow->count == 0)
+	{
+		return false;
+	}
+
+	pMin = pWindow->requests + pWindow->head;
+	for (i=1; i<pWindow->count; i++)
+	{
+		pRequest = pWindow->requests + (pWindow->head + i) % \
+				pWindow->size;
+		if (pRequest->binlog_index < pMin->binlog_index || \
+			(pRequest->binlog_index == pMin->binlog_index && \
+			 pRequest->binlog_offset < pMin->binlog_offset))
+		{
+			pMin = pRequest;
+		}
+	}
+
+	*binlog_index = pMin->binlog_index;
+	*binlog_offset = pMin->binlog_offset;
+	*scan_row_count = pMin->scan_row_count;
+	return true;
+}
+
+static int storage_sync_request_done(ConnectionInfo *pStorageServer, \
+	StorageBinLogReader *pReader, StorageSyncRequest *pRequest, \
+	const int result)
+{
+	StorageSyncWindow *pWindow;
+	StorageStatShard *pStatShard;
+
+	if (result == 0 && pRequest->send_bytes > 0)
+	{
+		pStatShard = STORAGE_STAT_SHARD();
+		pStatShard->stat.success_sync_out_bytes += pRequest->send_bytes;
+	}
+
+	switch (pRequest->cmd)
+	{
+		case STORAGE_PROTO_CMD_SYNC_CREATE_FILE:
+		case STORAGE_PROTO_CMD_SYNC_UPDATE_FILE:
+			if (result == EEXIST)
+			{
+				if (pRequest->status == 0 && \
+					pRequest->record.op_type == \
+					STORAGE_OP_TYPE_SOURCE_CREATE_FILE)
+				{
+				logWarning("file: "__FILE__", line: %d, " \
+					"storage server ip: %s:%d, data " \
+					"file: %s already exists, maybe " \
+					"some mistake?", __LINE__, \
+					pStorageServer->ip_addr, \
+					pStorageServer->port, \
+					pRequest->record.filename);
+				}
+
+				pReader->last_file_exist = true;
+				return 0;
+			}
+			else if (result == 0)
+			{
+				pReader->last_file_exist = false;
+			}
+			return result;
+		case STORAGE_PROTO_CMD_SYNC_APPEND_FILE:
+		case STORAGE_PROTO_CMD_SYNC_MODIFY_FILE:
+			if (result == ENOENT)  //resync appender file
+			{
+				pWindow = pReader->window;
+				pWindow->binlog_index = pRequest->binlog_index;
+				pWindow->binlog_offset = pRequest->binlog_offset;
+				pWindow->scan_row_count = \
+						pRequest->scan_row_count;
+				return storage_sync_copy_file(pStorageServer, \
+					pReader, &pRequest->record, \
+					STORAGE_PROTO_CMD_SYNC_UPDATE_FILE);
+			}
+			return result == EEXIST ? 0 : result;
+		case STORAGE_PROTO_CMD_SYNC_TRUNCATE_FILE:
+			return result == EEXIST ? 0 : result;
+		case STORAGE_PROTO_CMD_SYNC_DELETE_FILE:
+		case STORAGE_PROTO_CMD_SYNC_CREATE_LINK:
+			return result == ENOENT ? 0 : result;
+		default:
+			return result;
+	}
+}
+
+/* recv the response of the oldest in-flight request */
+static int storage_sync_window_pop(ConnectionInfo *pStorageServer, \
+		StorageBinLogReader *pReader)
+{
+	StorageSyncWindow *pWindow;
+	StorageSyncRequest *pRequest;
+	char in_buff[1];
+	char *pBuff;
+	int64_t in_bytes;
+	int result;
+
+	pWindow = pReader->window;
+	pRequest = pWindow->requests + pWindow->head;
+
+	pBuff = in_buff;
+	result = fdfs_recv_response(pStorageServer, &pBuff, 0, &in_bytes);
+	if ((result=storage_sync_request_done(pStorageServer, pReader, \
+			pRequest, result)) != 0)
+	{
+		/* keep the request, the mark file should not pass it */
+		logDebug("file: "__FILE__", line: %d, " \
+			"sync request #"INT64_PRINTF_FORMAT" of file %s " \
+			"to storage server %s:%d fail, errno: %d", \
+			__LINE__, pRequest->seq, pRequest->record.filename, \
+			pStorageServer->ip_addr, pStorageServer->port, result);
+		return result;
+	}
+
+	pWindow->head = (pWindow->head + 1) % pWindow->size;
+	pWindow->count--;
+
+	pReader->sync_row_count++;
+	if (pReader->sync_row_count - pReader->last_sync_rows >= \
+		g_write_mark_file_freq)
+	{
+		if ((result=storage_write_to_mark_file(pReader)) != 0)
+		{
+			logCrit("file: "__FILE__", line: %d, " \
+				"storage_write_to_mark_file " \
+				"fail, program exit!", __LINE__);
+			g_continue_flag = false;
+			return result;
+		}
+	}
+
+	return 0;
+}
+
+/* wait for the responses of all in-flight requests */
+static int storage_sync_window_drain(ConnectionInfo *pStorageServer, \
+		StorageBinLogReader *pReader)
+{
+	int result;
+
+	while (pReader->window->count > 0)
+	{
+		if ((result=storage_sync_window_pop(pStorageServer, \
+				pReader)) != 0)
+		{
+			return result;
+		}
+	}
+
+	return 0;
+}
 
 /**
 8 bytes: filename bytes
@@ -84,16 +423,14 @@ static int storage_sync_copy_file(ConnectionInfo *pStorageServer, \
 {
 	TrackerHeader *pHeader;
 	char *p;
-	char *pBuff;
 	char full_filename[MAX_PATH_SIZE];
 	char out_buff[sizeof(TrackerHeader)+FDFS_GROUP_NAME_MAX_LEN+256];
-	char in_buff[1];
 	struct stat stat_buf;
 	FDFSTrunkFullInfo trunkInfo;
 	FDFSTrunkHeader trunkHeader;
 	int64_t file_offset;
-	int64_t in_bytes;
 	int64_t total_send_bytes;
+	StorageStatShard *pStatShard;
 	int result;
 	bool need_sync_file;
 
@@ -125,6 +462,18 @@ static int storage_sync_copy_file(ConnectionInfo *pStorageServer, \
 	}
 
 	need_sync_file = true;
+	if (pReader->last_file_exist && proto_cmd == \
+			STORAGE_PROTO_CMD_SYNC_CREATE_FILE)
+	{
+		/* the query can't be pipelined, and the responses
+		   of the in-flight requests may change last_file_exist */
+		if ((result=storage_sync_window_drain(pStorageServer, \
+				pReader)) != 0)
+		{
+			return result;
+		}
+	}
+
 	if (pReader->last_file_exist && proto_cmd == \
 			STORAGE_PROTO_CMD_SYNC_CREATE_FILE)
 	{
@@ -245,46 +594,13 @@ static int storage_sync_copy_file(ConnectionInfo *pStorageServer, \
 			break;
 		}
 
-		pBuff = in_buff;
-		if ((result=fdfs_recv_response(pStorageServer, \
-			&pBuff, 0, &in_bytes)) != 0)
-		{
-			break;
-		}
+		storage_sync_window_push(pReader, pRecord, proto_cmd, \
+			pHeader->status, total_send_bytes);
 	} while (0);
 
-	pthread_mutex_lock(&sync_thread_lock);
-	g_storage_stat.total_sync_out_bytes += total_send_bytes;
-	if (result == 0)
-	{
-		g_storage_stat.success_sync_out_bytes += total_send_bytes;
-	}
-	pthread_mutex_unlock(&sync_thread_lock);
-
-	if (result == EEXIST)
-	{
-		if (need_sync_file && pRecord->op_type == \
-			STORAGE_OP_TYPE_SOURCE_CREATE_FILE)
-		{
-			logWarning("file: "__FILE__", line: %d, " \
-				"storage server ip: %s:%d, data file: %s " \
-				"already exists, maybe some mistake?", \
-				__LINE__, pStorageServer->ip_addr, \
-				pStorageServer->port, pRecord->filename);
-		}
-
-		pReader->last_file_exist = true;
-		return 0;
-	}
-	else if (result == 0)
-	{
-		pReader->last_file_exist = false;
-		return 0;
-	}
-	else
-	{
-		return result;
-	}
+	pStatShard = STORAGE_STAT_SHARD();
+	pStatShard->stat.total_sync_out_bytes += total_send_bytes;
+	return result;
 }
 
 /**
@@ -303,14 +619,12 @@ static int storage_sync_modify_file(ConnectionInfo *pStorageServer, \
 #define FIELD_COUNT  3
 	TrackerHeader *pHeader;
 	char *p;
-	char *pBuff;
 	char *fields[FIELD_COUNT];
 	char full_filename[MAX_PATH_SIZE];
 	char out_buff[sizeof(TrackerHeader)+FDFS_GROUP_NAME_MAX_LEN+256];
-	char in_buff[1];
 	struct stat stat_buf;
-	int64_t in_bytes;
 	int64_t total_send_bytes;
+	StorageStatShard *pStatShard;
 	int64_t start_offset;
 	int64_t modify_length;
 	int result;
@@ -438,23 +752,13 @@ static int storage_sync_modify_file(ConnectionInfo *pStorageServer, \
 			break;
 		}
 
-		pBuff = in_buff;
-		if ((result=fdfs_recv_response(pStorageServer, \
-			&pBuff, 0, &in_bytes)) != 0)
-		{
-			break;
-		}
+		storage_sync_window_push(pReader, pRecord, cmd, \
+			0, total_send_bytes);
 	} while (0);
 
-	pthread_mutex_lock(&sync_thread_lock);
-	g_storage_stat.total_sync_out_bytes += total_send_bytes;
-	if (result == 0)
-	{
-		g_storage_stat.success_sync_out_bytes += total_send_bytes;
-	}
-	pthread_mutex_unlock(&sync_thread_lock);
-
-	return result == EEXIST ? 0 : result;
+	pStatShard = STORAGE_STAT_SHARD();
+	pStatShard->stat.total_sync_out_bytes += total_send_bytes;
+	return result;
 }
 
 /**
@@ -471,13 +775,10 @@ static int storage_sync_truncate_file(ConnectionInfo *pStorageServer, \
 #define FIELD_COUNT  3
 	TrackerHeader *pHeader;
 	char *p;
-	char *pBuff;
 	char *fields[FIELD_COUNT];
 	char full_filename[MAX_PATH_SIZE];
 	char out_buff[sizeof(TrackerHeader)+FDFS_GROUP_NAME_MAX_LEN+256];
-	char in_buff[1];
 	struct stat stat_buf;
-	int64_t in_bytes;
 	int64_t old_file_size;
 	int64_t new_file_size;
 	int result;
@@ -586,15 +887,11 @@ static int storage_sync_truncate_file(ConnectionInfo *pStorageServer, \
 			break;
 		}
 
-		pBuff = in_buff;
-		if ((result=fdfs_recv_response(pStorageServer, \
-			&pBuff, 0, &in_bytes)) != 0)
-		{
-			break;
-		}
+		storage_sync_window_push(pReader, pRecord, \
+			STORAGE_PROTO_CMD_SYNC_TRUNCATE_FILE, 0, 0);
 	} while (0);
 
-	return result == EEXIST ? 0 : result;
+	return result;
 }
 
 /**
@@ -604,16 +901,13 @@ FDFS_GROUP_NAME_MAX_LEN bytes: group_name
 remain bytes: filename
 **/
 static int storage_sync_delete_file(ConnectionInfo *pStorageServer, \
-			const StorageBinLogRecord *pRecord)
+	StorageBinLogReader *pReader, const StorageBinLogRecord *pRecord)
 {
 	TrackerHeader *pHeader;
 	char out_buff[sizeof(TrackerHeader)+FDFS_GROUP_NAME_MAX_LEN+256];
 	struct stat stat_buf;
 	FDFSTrunkFullInfo trunkInfo;
 	FDFSTrunkHeader trunkHeader;
-	char in_buff[1];
-	char *pBuff;
-	int64_t in_bytes;
 	int result;
 
 	if ((result=trunk_file_stat(pRecord->store_path_index, \
@@ -656,14 +950,9 @@ static int storage_sync_delete_file(ConnectionInfo *pStorageServer, \
 		return result;
 	}
 
-	pBuff = in_buff;
-	result = fdfs_recv_response(pStorageServer, &pBuff, 0, &in_bytes);
-	if (result == ENOENT)
-	{
-		result = 0;
-	}
-	
-	return result;
+	storage_sync_window_push(pReader, pRecord, \
+		STORAGE_PROTO_CMD_SYNC_DELETE_FILE, 0, 0);
+	return 0;
 }
 
 /**
@@ -710,18 +999,15 @@ dest filename length: dest filename
 source filename length: source filename
 **/
 static int storage_sync_link_file(ConnectionInfo *pStorageServer, \
-		StorageBinLogRecord *pRecord)
+	StorageBinLogReader *pReader, StorageBinLogRecord *pRecord)
 {
 	TrackerHeader *pHeader;
 	int result;
 	char out_buff[sizeof(TrackerHeader) + 2 * FDFS_PROTO_PKG_LEN_SIZE + \
 			4 + FDFS_GROUP_NAME_MAX_LEN + 256];
-	char in_buff[1];
 	FDFSTrunkFullInfo trunkInfo;
 	FDFSTrunkHeader trunkHeader;
 	int out_body_len;
-	int64_t in_bytes;
-	char *pBuff;
 	struct stat stat_buf;
 	int fd;
 
@@ -915,14 +1201,9 @@ static int storage_sync_link_file(ConnectionInfo *pStorageServer, \
 		return result;
 	}
 
-	pBuff = in_buff;
-	result = fdfs_recv_response(pStorageServer, &pBuff, 0, &in_bytes);
-	if (result == ENOENT)
-	{
-		result = 0;
-	}
-	
-	return result;
+	storage_sync_window_push(pReader, pRecord, \
+		STORAGE_PROTO_CMD_SYNC_CREATE_LINK, 0, 0);
+	return 0;
 }
 
 #define STARAGE_CHECK_IF_NEED_SYNC_OLD(pReader, pRecord) \
@@ -936,7 +1217,22 @@ static int storage_sync_data(StorageBinLogReader *pReader, \
 			ConnectionInfo *pStorageServer, \
 			StorageBinLogRecord *pRecord)
 {
+	StorageSyncWindow *pWindow;
 	int result;
+
+	pWindow = pReader->window;
+	while (pWindow->count >= g_sync_window_size)
+	{
+		if ((result=storage_sync_window_pop(pStorageServer, \
+				pReader)) != 0)
+		{
+			return result;
+		}
+	}
+
+	pWindow->binlog_index = pReader->binlog_index;
+	pWindow->binlog_offset = pReader->binlog_offset;
+	pWindow->scan_row_count = pReader->scan_row_count;
 	switch(pRecord->op_type)
 	{
 		case STORAGE_OP_TYPE_SOURCE_CREATE_FILE:
@@ -946,7 +1242,7 @@ static int storage_sync_data(StorageBinLogReader *pReader, \
 			break;
 		case STORAGE_OP_TYPE_SOURCE_DELETE_FILE:
 			result = storage_sync_delete_file( \
-					pStorageServer, pRecord);
+					pStorageServer, pReader, pRecord);
 			break;
 		case STORAGE_OP_TYPE_SOURCE_UPDATE_FILE:
 			result = storage_sync_copy_file(pStorageServer, \
@@ -957,23 +1253,11 @@ static int storage_sync_data(StorageBinLogReader *pReader, \
 			result = storage_sync_modify_file(pStorageServer, \
 					pReader, pRecord, \
 					STORAGE_PROTO_CMD_SYNC_APPEND_FILE);
-			if (result == ENOENT)  //resync appender file
-			{
-			result = storage_sync_copy_file(pStorageServer, \
-					pReader, pRecord, \
-					STORAGE_PROTO_CMD_SYNC_UPDATE_FILE);
-			}
 			break;
 		case STORAGE_OP_TYPE_SOURCE_MODIFY_FILE:
 			result = storage_sync_modify_file(pStorageServer, \
 					pReader, pRecord, \
 					STORAGE_PROTO_CMD_SYNC_MODIFY_FILE);
-			if (result == ENOENT)  //resync appender file
-			{
-			result = storage_sync_copy_file(pStorageServer, \
-					pReader, pRecord, \
-					STORAGE_PROTO_CMD_SYNC_UPDATE_FILE);
-			}
 			break;
 		case STORAGE_OP_TYPE_SOURCE_TRUNCATE_FILE:
 			result = storage_sync_truncate_file(pStorageServer, \
@@ -981,7 +1265,7 @@ static int storage_sync_data(StorageBinLogReader *pReader, \
 			break;
 		case STORAGE_OP_TYPE_SOURCE_CREATE_LINK:
 			result = storage_sync_link_file(pStorageServer, \
-					pRecord);
+					pReader, pRecord);
 			break;
 		case STORAGE_OP_TYPE_REPLICA_CREATE_FILE:
 			STARAGE_CHECK_IF_NEED_SYNC_OLD(pReader, pRecord)
@@ -992,7 +1276,7 @@ static int storage_sync_data(StorageBinLogReader *pReader, \
 		case STORAGE_OP_TYPE_REPLICA_DELETE_FILE:
 			STARAGE_CHECK_IF_NEED_SYNC_OLD(pReader, pRecord)
 			result = storage_sync_delete_file( \
-					pStorageServer, pRecord);
+					pStorageServer, pReader, pRecord);
 			break;
 		case STORAGE_OP_TYPE_REPLICA_UPDATE_FILE:
 			STARAGE_CHECK_IF_NEED_SYNC_OLD(pReader, pRecord)
@@ -1003,7 +1287,7 @@ static int storage_sync_data(StorageBinLogReader *pReader, \
 		case STORAGE_OP_TYPE_REPLICA_CREATE_LINK:
 			STARAGE_CHECK_IF_NEED_SYNC_OLD(pReader, pRecord)
 			result = storage_sync_link_file(pStorageServer, \
-					pRecord);
+					pReader, pRecord);
 			break;
 		case STORAGE_OP_TYPE_REPLICA_APPEND_FILE:
 			return 0;
@@ -1018,24 +1302,6 @@ static int storage_sync_data(StorageBinLogReader *pReader, \
 			return EINVAL;
 	}
 
-	if (result == 0)
-	{
-		pReader->sync_row_count++;
-
-		if (pReader->sync_row_count - pReader->last_sync_rows >= \
-			g_write_mark_file_freq)
-		{
-			if ((result=storage_write_to_mark_file(pReader)) != 0)
-			{
-				logCrit("file: "__FILE__", line: %d, " \
-					"storage_write_to_mark_file " \
-					"fail, program exit!", __LINE__);
-				g_continue_flag = false;
-				return result;
-			}
-		}
-	}
-
 	return result;
 }
 
@@ -1148,38 +1414,1724 @@ static int open_next_writable_binlog()
 	return 0;
 }
 
-int storage_sync_init()
+/* read the records of the binlog file from the offset one by one */
+static int storage_binlog_scan_file(const int binlog_index, \
+		const int64_t start_offset, storage_binlog_scan_func func, \
+		void *args)
 {
-	char data_path[MAX_PATH_SIZE];
-	char sync_path[MAX_PATH_SIZE];
 	char full_filename[MAX_PATH_SIZE];
-	char file_buff[64];
+	StorageBinLogRecord record;
+	char *buff;
+	char *p;
+	int64_t offset;
+	int fd;
+	int length;
 	int bytes;
+	int record_length;
 	int result;
-	int fd;
 
-	snprintf(data_path, sizeof(data_path), "%s/data", g_fdfs_base_path);
-	if (!fileExists(data_path))
+	get_writable_binlog_filename1(full_filename, binlog_index);
+	if ((fd=open(full_filename, O_RDONLY)) < 0)
 	{
-		if (mkdir(data_path, 0755) != 0)
+		result = errno != 0 ? errno : ENOENT;
+		if (result != ENOENT)
 		{
 			logError("file: "__FILE__", line: %d, " \
-				"mkdir \"%s\" fail, " \
+				"open file \"%s\" fail, " \
 				"errno: %d, error info: %s", \
-				__LINE__, data_path, \
-				errno, STRERROR(errno));
-			return errno != 0 ? errno : ENOENT;
+				__LINE__, full_filename, \
+				result, STRERROR(result));
 		}
+		return result;
+	}
 
-		STORAGE_CHOWN(data_path, geteuid(), getegid())
+	if (start_offset > 0 && lseek(fd, start_offset, SEEK_SET) < 0)
+	{
+		result = errno != 0 ? errno : ESPIPE;
+		logError("file: "__FILE__", line: %d, " \
+			"seek binlog file \"%s\" fail, file offset=" \
+			INT64_PRINTF_FORMAT", errno: %d, error info: %s", \
+			__LINE__, full_filename, start_offset, \
+			result, STRERROR(result));
+		close(fd);
+		return result;
 	}
 
-	snprintf(sync_path, sizeof(sync_path), \
-			"%s/"SYNC_DIR_NAME, data_path);
-	if (!fileExists(sync_path))
+	buff = (char *)malloc(STORAGE_BINLOG_BUFFER_SIZE);
+	if (buff == NULL)
 	{
-		if (mkdir(sync_path, 0755) != 0)
-		{
+		logError("file: "__FILE__", line: %d, " \
+			"malloc %d bytes fail, " \
+			"errno: %d, error info: %s", \
+			__LINE__, STORAGE_BINLOG_BUFFER_SIZE, \
+			errno, STRERROR(errno));
+		close(fd);
+		return errno != 0 ? errno : ENOMEM;
+	}
+
+	result = 0;
+	offset = start_offset;
+	length = 0;
+	while (1)
+	{
+		bytes = read(fd, buff + length, \
+			STORAGE_BINLOG_BUFFER_SIZE - length);
+		if (bytes < 0)
+		{
+			result = errno != 0 ? errno : EIO;
+			logError("file: "__FILE__", line: %d, " \
+				"read from binlog file \"%s\" fail, " \
+				"errno: %d, error info: %s", \
+				__LINE__, full_filename, \
+				result, STRERROR(result));
+			break;
+		}
+		if (bytes == 0)
+		{
+			break;
+		}
+
+		length += bytes;
+		p = buff;
+		while (length > 0)
+		{
+			result = storage_binlog_unpack_record(p, length, \
+					&record, &record_length);
+			if (result == EAGAIN)
+			{
+				if (!(p == buff && length == \
+					STORAGE_BINLOG_BUFFER_SIZE))
+				{
+					result = 0;
+					break;
+				}
+
+				//the whole buffer is not a record
+				record_length = length;
+				result = EINVAL;
+			}
+
+			if ((result=func(args, p, record_length, result == 0 ? \
+				&record : NULL, offset)) != 0)
+			{
+				break;
+			}
+
+			p += record_length;
+			length -= record_length;
+			offset += record_length;
+		}
+
+		if (result != 0)
+		{
+			break;
+		}
+
+		if (length > 0 && p != buff)
+		{
+			memmove(buff, p, length);
+		}
+	}
+
+	if (result == 0 && length > 0)  //the incomplete record at the end
+	{
+		result = func(args, buff, length, NULL, offset);
+	}
+
+	free(buff);
+	close(fd);
+	return result;
+}
+
+static char *get_binlog_ts_index_filename(char *full_filename)
+{
+	snprintf(full_filename, MAX_PATH_SIZE, \
+			"%s/data/"SYNC_DIR_NAME"/%s", g_fdfs_base_path, \
+			SYNC_BINLOG_TS_INDEX_FILENAME);
+	return full_filename;
+}
+
+static bool storage_binlog_ts_index_need(const int binlog_index, \
+		const int64_t binlog_offset)
+{
+	StorageBinLogTsEntry *pLast;
+
+	if (binlog_ts_entry_count == 0)
+	{
+		return true;
+	}
+
+	pLast = binlog_ts_entries + binlog_ts_entry_count - 1;
+	return binlog_index != pLast->binlog_index || binlog_offset - \
+		pLast->binlog_offset >= SYNC_BINLOG_TS_INDEX_INTERVAL;
+}
+
+static int storage_binlog_ts_index_add(const int timestamp, \
+		const int binlog_index, const int64_t binlog_offset)
+{
+	StorageBinLogTsEntry *pEntry;
+	char buff[SYNC_BINLOG_TS_ENTRY_SIZE];
+	int alloc_count;
+
+	if (binlog_ts_entry_count == binlog_ts_entry_alloc)
+	{
+		alloc_count = binlog_ts_entry_alloc == 0 ? 1024 : \
+				2 * binlog_ts_entry_alloc;
+		pEntry = (StorageBinLogTsEntry *)realloc(binlog_ts_entries, \
+				sizeof(StorageBinLogTsEntry) * alloc_count);
+		if (pEntry == NULL)
+		{
+			logError("file: "__FILE__", line: %d, " \
+				"realloc %d bytes fail", __LINE__, \
+				(int)sizeof(StorageBinLogTsEntry) * \
+				alloc_count);
+			return errno != 0 ? errno : ENOMEM;
+		}
+
+		binlog_ts_entries = pEntry;
+		binlog_ts_entry_alloc = alloc_count;
+	}
+
+	pEntry = binlog_ts_entries + binlog_ts_entry_count;
+	pEntry->timestamp = timestamp;
+	pEntry->binlog_index = binlog_index;
+	pEntry->binlog_offset = binlog_offset;
+	binlog_ts_entry_count++;
+
+	//the index is rebuilt from the binlog when the entry lost
+	int2buff(timestamp, buff);
+	int2buff(binlog_index, buff + 4);
+	long2buff(binlog_offset, buff + 8);
+	if (write(binlog_ts_index_fd, buff, SYNC_BINLOG_TS_ENTRY_SIZE) != \
+		SYNC_BINLOG_TS_ENTRY_SIZE)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"write to file \"%s\" fail, " \
+			"errno: %d, error info: %s", __LINE__, \
+			SYNC_BINLOG_TS_INDEX_FILENAME, \
+			errno, STRERROR(errno));
+	}
+
+	return 0;
+}
+
+static int storage_binlog_ts_index_scan_func(void *args, \
+		const char *buff, const int length, \
+		const StorageBinLogRecord *pRecord, const int64_t offset)
+{
+	int binlog_index;
+	int result;
+
+	if (pRecord == NULL)
+	{
+		return 0;
+	}
+
+	binlog_index = *((int *)args);
+	if (storage_binlog_ts_index_need(binlog_index, offset) && \
+		(result=storage_binlog_ts_index_add(binlog_max_timestamp, \
+			binlog_index, offset)) != 0)
+	{
+		return result;
+	}
+
+	if (pRecord->timestamp > binlog_max_timestamp)
+	{
+		binlog_max_timestamp = pRecord->timestamp;
+	}
+
+	return 0;
+}
+
+/* load the entries of the timestamp index and add the entries of the
+   records after the last entry by scanning the binlog files */
+static int storage_binlog_ts_index_init()
+{
+	char full_filename[MAX_PATH_SIZE];
+	char binlog_filename[MAX_PATH_SIZE];
+	StorageBinLogTsEntry entry;
+	StorageBinLogTsEntry *pLast;
+	struct stat stat_buf;
+	char *content;
+	int64_t file_size;
+	int64_t binlog_size;
+	int64_t offset;
+	int size_index;
+	int binlog_index;
+	int count;
+	int i;
+	int result;
+
+	get_binlog_ts_index_filename(full_filename);
+	if (fileExists(full_filename))
+	{
+		if ((result=getFileContent(full_filename, &content, \
+				&file_size)) != 0)
+		{
+			return result;
+		}
+
+		count = file_size / SYNC_BINLOG_TS_ENTRY_SIZE;
+		if (count > 0)
+		{
+			binlog_ts_entries = (StorageBinLogTsEntry *)malloc( \
+				sizeof(StorageBinLogTsEntry) * count);
+			if (binlog_ts_entries == NULL)
+			{
+				logError("file: "__FILE__", line: %d, " \
+					"malloc %d bytes fail", __LINE__, \
+					(int)sizeof(StorageBinLogTsEntry) * \
+					count);
+				free(content);
+				return errno != 0 ? errno : ENOMEM;
+			}
+			binlog_ts_entry_alloc = count;
+		}
+
+		size_index = -1;
+		binlog_size = 0;
+		pLast = NULL;
+		for (i=0; i<count; i++)
+		{
+			entry.timestamp = buff2int(content + \
+					SYNC_BINLOG_TS_ENTRY_SIZE * i);
+			entry.binlog_index = buff2int(content + \
+					SYNC_BINLOG_TS_ENTRY_SIZE * i + 4);
+			entry.binlog_offset = buff2long(content + \
+					SYNC_BINLOG_TS_ENTRY_SIZE * i + 8);
+			if (entry.binlog_index != size_index && \
+				entry.binlog_index >= 0 && \
+				entry.binlog_index <= g_binlog_index)
+			{
+				size_index = entry.binlog_index;
+				if (size_index == g_binlog_index)
+				{
+					binlog_size = binlog_file_size;
+				}
+				else if (stat(get_writable_binlog_filename1( \
+					binlog_filename, size_index), \
+					&stat_buf) == 0)
+				{
+					binlog_size = stat_buf.st_size;
+				}
+				else
+				{
+					binlog_size = -1;
+				}
+			}
+
+			if (entry.binlog_index != size_index || \
+				entry.binlog_offset > binlog_size || \
+				(pLast != NULL && (entry.timestamp < \
+				pLast->timestamp || entry.binlog_index < \
+				pLast->binlog_index || (entry.binlog_index \
+				== pLast->binlog_index && entry.binlog_offset \
+				<= pLast->binlog_offset))))
+			{
+				break;
+			}
+
+			binlog_ts_entries[i] = entry;
+			pLast = binlog_ts_entries + i;
+		}
+		binlog_ts_entry_count = i;
+		free(content);
+
+		if (file_size != SYNC_BINLOG_TS_ENTRY_SIZE * \
+				binlog_ts_entry_count)
+		{
+			logWarning("file: "__FILE__", line: %d, " \
+				"file \"%s\" is invalid after the entry " \
+				"%d, truncate it", __LINE__, full_filename, \
+				binlog_ts_entry_count);
+			if (truncate(full_filename, SYNC_BINLOG_TS_ENTRY_SIZE * \
+				binlog_ts_entry_count) != 0)
+			{
+				logError("file: "__FILE__", line: %d, " \
+					"truncate file \"%s\" fail, " \
+					"errno: %d, error info: %s", \
+					__LINE__, full_filename, \
+					errno, STRERROR(errno));
+				return errno != 0 ? errno : EIO;
+			}
+		}
+	}
+
+	binlog_ts_index_fd = open(full_filename, \
+			O_WRONLY | O_CREAT | O_APPEND, 0644);
+	if (binlog_ts_index_fd < 0)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"open file \"%s\" fail, " \
+			"errno: %d, error info: %s", \
+			__LINE__, full_filename, \
+			errno, STRERROR(errno));
+		return errno != 0 ? errno : EACCES;
+	}
+	STORAGE_FCHOWN(binlog_ts_index_fd, full_filename, \
+			geteuid(), getegid())
+
+	if (binlog_ts_entry_count > 0)
+	{
+		pLast = binlog_ts_entries + binlog_ts_entry_count - 1;
+		binlog_max_timestamp = pLast->timestamp;
+		binlog_index = pLast->binlog_index;
+		offset = pLast->binlog_offset;
+	}
+	else
+	{
+		binlog_max_timestamp = 0;
+		binlog_index = 0;
+		offset = 0;
+	}
+
+	count = binlog_ts_entry_count;
+	for (; binlog_index<=g_binlog_index; binlog_index++)
+	{
+		result = storage_binlog_scan_file(binlog_index, offset, \
+			storage_binlog_ts_index_scan_func, &binlog_index);
+		if (result != 0 && result != ENOENT)
+		{
+			return result;
+		}
+		offset = 0;
+	}
+
+	if (count == 0 && binlog_ts_entry_count > 0)
+	{
+		logInfo("file: "__FILE__", line: %d, " \
+			"build the timestamp index of the binlog, " \
+			"entry count: %d", __LINE__, binlog_ts_entry_count);
+	}
+
+	return 0;
+}
+
+/* add the entry of the write cache which written to the binlog file */
+static void storage_binlog_ts_index_append(const int64_t binlog_offset)
+{
+	if (storage_binlog_ts_index_need(g_binlog_index, binlog_offset))
+	{
+		storage_binlog_ts_index_add(binlog_max_timestamp, \
+			g_binlog_index, binlog_offset);
+	}
+
+	if (binlog_cache_max_timestamp > binlog_max_timestamp)
+	{
+		binlog_max_timestamp = binlog_cache_max_timestamp;
+	}
+	binlog_cache_max_timestamp = 0;
+}
+
+static void storage_binlog_ts_index_destroy()
+{
+	if (binlog_ts_index_fd >= 0)
+	{
+		close(binlog_ts_index_fd);
+		binlog_ts_index_fd = -1;
+	}
+
+	if (binlog_ts_entries != NULL)
+	{
+		free(binlog_ts_entries);
+		binlog_ts_entries = NULL;
+		binlog_ts_entry_count = 0;
+		binlog_ts_entry_alloc = 0;
+	}
+}
+
+static int storage_binlog_convert_write(StorageBinLogConverter *pConverter, \
+		const char *buff, const int length)
+{
+	int result;
+
+	if (pConverter->length + length > STORAGE_BINLOG_BUFFER_SIZE)
+	{
+		if (write(pConverter->fd, pConverter->buff, \
+			pConverter->length) != pConverter->length)
+		{
+			result = errno != 0 ? errno : EIO;
+			logError("file: "__FILE__", line: %d, " \
+				"write to file \"%s\" fail, " \
+				"errno: %d, error info: %s", __LINE__, \
+				SYNC_BINLOG_FILE_PREFIX SYNC_CONVERT_FILE_EXT, \
+				result, STRERROR(result));
+			return result;
+		}
+		pConverter->length = 0;
+	}
+
+	if (length > STORAGE_BINLOG_BUFFER_SIZE)
+	{
+		if (write(pConverter->fd, buff, length) != length)
+		{
+			result = errno != 0 ? errno : EIO;
+			logError("file: "__FILE__", line: %d, " \
+				"write to file \"%s\" fail, " \
+				"errno: %d, error info: %s", __LINE__, \
+				SYNC_BINLOG_FILE_PREFIX SYNC_CONVERT_FILE_EXT, \
+				result, STRERROR(result));
+			return result;
+		}
+	}
+	else if (length > 0)
+	{
+		memcpy(pConverter->buff + pConverter->length, buff, length);
+		pConverter->length += length;
+	}
+
+	pConverter->offset += length;
+	return 0;
+}
+
+/* the mark which points to the record points to the rewritten record */
+static void storage_binlog_convert_marks(StorageBinLogConverter *pConverter, \
+		const int64_t offset)
+{
+	StorageBinLogConvertMark *pMark;
+	StorageBinLogConvertMark *pMarkEnd;
+
+	pMarkEnd = pConverter->marks + pConverter->mark_count;
+	for (pMark=pConverter->marks; pMark<pMarkEnd; pMark++)
+	{
+		if (!pMark->converted && pMark->binlog_index == \
+			pConverter->binlog_index && \
+			pMark->binlog_offset <= offset)
+		{
+			pMark->new_offset = pConverter->offset;
+			pMark->converted = true;
+		}
+	}
+}
+
+/* the text record is packed to the binary record, the binary record and
+   the invalid record are kept as they are */
+static int storage_binlog_convert_func(void *args, const char *buff, \
+		const int length, const StorageBinLogRecord *pRecord, \
+		const int64_t offset)
+{
+	StorageBinLogConverter *pConverter;
+	char record[STORAGE_BINLOG_RECORD_MAX_SIZE];
+	int record_length;
+
+	pConverter = (StorageBinLogConverter *)args;
+	storage_binlog_convert_marks(pConverter, offset);
+
+	if (pRecord == NULL || *((unsigned char *)buff) == \
+			STORAGE_BINLOG_RECORD_MAGIC)
+	{
+		return storage_binlog_convert_write(pConverter, buff, length);
+	}
+
+	record_length = storage_binlog_pack_record(pRecord->timestamp, \
+			pRecord->op_type, pRecord->filename, \
+			pRecord->src_filename_len > 0 ? \
+			pRecord->src_filename : NULL, record);
+	if (record_length == 0)
+	{
+		return storage_binlog_convert_write(pConverter, buff, length);
+	}
+
+	pConverter->changed_count++;
+	return storage_binlog_convert_write(pConverter, record, record_length);
+}
+
+static int storage_binlog_convert_mark_file( \
+		const StorageBinLogConvertMark *pMark)
+{
+	char tmp_filename[MAX_PATH_SIZE];
+	char buff[1024];
+	IniContext iniContext;
+	IniItem *pItem;
+	IniItem *pItemEnd;
+	int len;
+	int result;
+
+	memset(&iniContext, 0, sizeof(IniContext));
+	if ((result=iniLoadFromFile(pMark->filename, &iniContext)) != 0)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"load from mark file \"%s\" fail, " \
+			"error code: %d", __LINE__, pMark->filename, result);
+		return result;
+	}
+
+	len = 0;
+	pItemEnd = iniContext.global.items + iniContext.global.count;
+	for (pItem=iniContext.global.items; pItem<pItemEnd; pItem++)
+	{
+		if (strcmp(pItem->name, MARK_ITEM_BINLOG_FILE_OFFSET) == 0)
+		{
+			len += snprintf(buff + len, sizeof(buff) - len, \
+				"%s="INT64_PRINTF_FORMAT"\n", \
+				pItem->name, pMark->new_offset);
+		}
+		else
+		{
+			len += snprintf(buff + len, sizeof(buff) - len, \
+				"%s=%s\n", pItem->name, pItem->value);
+		}
+
+		if (len >= sizeof(buff))
+		{
+			iniFreeContext(&iniContext);
+			return ENOSPC;
+		}
+	}
+	iniFreeContext(&iniContext);
+
+	snprintf(tmp_filename, sizeof(tmp_filename), "%s" \
+		SYNC_CONVERT_FILE_EXT, pMark->filename);
+	return writeToFile(tmp_filename, buff, len);
+}
+
+/* finish the conversion or the compaction broken by the crash */
+static int storage_binlog_convert_recover(const char *sync_path)
+{
+	char full_filename[MAX_PATH_SIZE];
+	char mark_filename[MAX_PATH_SIZE];
+	char tmp_binlog_filename[MAX_PATH_SIZE];
+	DIR *dir;
+	struct dirent *ent;
+	bool bBinlogConverted;
+	int name_len;
+	int ext_len;
+	int result;
+
+	if ((dir=opendir(sync_path)) == NULL)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"open dir \"%s\" fail, " \
+			"errno: %d, error info: %s", \
+			__LINE__, sync_path, errno, STRERROR(errno));
+		return errno != 0 ? errno : ENOENT;
+	}
+
+	//the mark files are converted after the binlog file renamed
+	snprintf(tmp_binlog_filename, sizeof(tmp_binlog_filename), \
+		"%s/"SYNC_BINLOG_FILE_PREFIX SYNC_CONVERT_FILE_EXT, sync_path);
+	bBinlogConverted = !fileExists(tmp_binlog_filename);
+	ext_len = strlen(SYNC_MARK_FILE_EXT SYNC_CONVERT_FILE_EXT);
+	while ((ent=readdir(dir)) != NULL)
+	{
+		name_len = strlen(ent->d_name);
+		if (!(name_len > ext_len && strcmp(ent->d_name + name_len - \
+			ext_len, SYNC_MARK_FILE_EXT SYNC_CONVERT_FILE_EXT) == 0))
+		{
+			continue;
+		}
+
+		snprintf(full_filename, sizeof(full_filename), \
+			"%s/%s", sync_path, ent->d_name);
+		if (!bBinlogConverted)
+		{
+			unlink(full_filename);
+			continue;
+		}
+
+		snprintf(mark_filename, sizeof(mark_filename), "%s/%.*s", \
+			sync_path, name_len - (int)strlen( \
+			SYNC_CONVERT_FILE_EXT), ent->d_name);
+		if (rename(full_filename, mark_filename) != 0)
+		{
+			result = errno != 0 ? errno : EPERM;
+			logError("file: "__FILE__", line: %d, " \
+				"rename file %s to %s fail, " \
+				"errno: %d, error info: %s", __LINE__, \
+				full_filename, mark_filename, \
+				result, STRERROR(result));
+			closedir(dir);
+			return result;
+		}
+	}
+	unlink(tmp_binlog_filename);
+
+	closedir(dir);
+	return 0;
+}
+
+/* load the binlog positions of the mark files */
+static int storage_binlog_convert_load_marks(const char *sync_path, \
+		StorageBinLogConverter *pConverter)
+{
+	StorageBinLogConvertMark *pMark;
+	IniContext iniContext;
+	DIR *dir;
+	struct dirent *ent;
+	int name_len;
+	int ext_len;
+	int alloc_count;
+	int result;
+
+	if ((dir=opendir(sync_path)) == NULL)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"open dir \"%s\" fail, " \
+			"errno: %d, error info: %s", \
+			__LINE__, sync_path, errno, STRERROR(errno));
+		return errno != 0 ? errno : ENOENT;
+	}
+
+	result = 0;
+	alloc_count = 0;
+	ext_len = strlen(SYNC_MARK_FILE_EXT);
+	while ((ent=readdir(dir)) != NULL)
+	{
+		name_len = strlen(ent->d_name);
+		if (!(name_len > ext_len && strcmp(ent->d_name + name_len - \
+			ext_len, SYNC_MARK_FILE_EXT) == 0))
+		{
+			continue;
+		}
+
+		if (pConverter->mark_count == alloc_count)
+		{
+			alloc_count = alloc_count == 0 ? 16 : 2 * alloc_count;
+			pMark = (StorageBinLogConvertMark *)realloc( \
+				pConverter->marks, alloc_count * \
+				sizeof(StorageBinLogConvertMark));
+			if (pMark == NULL)
+			{
+				logError("file: "__FILE__", line: %d, " \
+					"realloc %d bytes fail", __LINE__, \
+					alloc_count * (int)sizeof( \
+					StorageBinLogConvertMark));
+				result = errno != 0 ? errno : ENOMEM;
+				break;
+			}
+			pConverter->marks = pMark;
+		}
+
+		pMark = pConverter->marks + pConverter->mark_count;
+		memset(pMark, 0, sizeof(StorageBinLogConvertMark));
+		snprintf(pMark->filename, sizeof(pMark->filename), \
+			"%s/%s", sync_path, ent->d_name);
+
+		memset(&iniContext, 0, sizeof(IniContext));
+		if ((result=iniLoadFromFile(pMark->filename, \
+				&iniContext)) != 0)
+		{
+			logError("file: "__FILE__", line: %d, " \
+				"load from mark file \"%s\" fail, " \
+				"error code: %d", __LINE__, \
+				pMark->filename, result);
+			break;
+		}
+
+		pMark->binlog_index = iniGetIntValue(NULL, \
+				MARK_ITEM_BINLOG_FILE_INDEX, &iniContext, -1);
+		pMark->binlog_offset = iniGetInt64Value(NULL, \
+				MARK_ITEM_BINLOG_FILE_OFFSET, &iniContext, -1);
+		iniFreeContext(&iniContext);
+		if (pMark->binlog_index >= 0 && pMark->binlog_offset >= 0)
+		{
+			pConverter->mark_count++;
+		}
+	}
+
+	closedir(dir);
+	return result;
+}
+
+/* write the records of one binlog file to the temp file by func,
+   the temp file is removed when no record changed */
+static int storage_binlog_rewrite_file(const char *sync_path, \
+		StorageBinLogConverter *pConverter, const int binlog_index, \
+		storage_binlog_scan_func func, void *args)
+{
+	char tmp_binlog_filename[MAX_PATH_SIZE];
+	int result;
+
+	snprintf(tmp_binlog_filename, sizeof(tmp_binlog_filename), \
+		"%s/"SYNC_BINLOG_FILE_PREFIX SYNC_CONVERT_FILE_EXT, sync_path);
+	pConverter->fd = open(tmp_binlog_filename, \
+			O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (pConverter->fd < 0)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"open file \"%s\" fail, " \
+			"errno: %d, error info: %s", \
+			__LINE__, tmp_binlog_filename, \
+			errno, STRERROR(errno));
+		return errno != 0 ? errno : EACCES;
+	}
+
+	pConverter->binlog_index = binlog_index;
+	pConverter->length = 0;
+	pConverter->offset = 0;
+	pConverter->changed_count = 0;
+	result = storage_binlog_scan_file(binlog_index, 0, func, args);
+	if (result == 0 && pConverter->length > 0 && write(pConverter->fd, \
+		pConverter->buff, pConverter->length) != pConverter->length)
+	{
+		result = errno != 0 ? errno : EIO;
+		logError("file: "__FILE__", line: %d, " \
+			"write to file \"%s\" fail, " \
+			"errno: %d, error info: %s", __LINE__, \
+			tmp_binlog_filename, result, STRERROR(result));
+	}
+	if (result == 0 && pConverter->changed_count > 0 && \
+		fsync(pConverter->fd) != 0)
+	{
+		result = errno != 0 ? errno : EIO;
+		logError("file: "__FILE__", line: %d, " \
+			"sync to file \"%s\" fail, " \
+			"errno: %d, error info: %s", __LINE__, \
+			tmp_binlog_filename, result, STRERROR(result));
+	}
+	close(pConverter->fd);
+	pConverter->fd = -1;
+
+	if (result != 0 || pConverter->changed_count == 0)
+	{
+		unlink(tmp_binlog_filename);
+		pConverter->changed_count = 0;
+		return result == ENOENT ? 0 : result;
+	}
+
+	return 0;
+}
+
+/* the rewritten file replaces the binlog file, then the mark files which
+   point to the binlog file are replaced */
+static int storage_binlog_replace_file(const char *sync_path, \
+		StorageBinLogConverter *pConverter, int64_t *old_file_size)
+{
+	char binlog_filename[MAX_PATH_SIZE];
+	char tmp_binlog_filename[MAX_PATH_SIZE];
+	char mark_filename[MAX_PATH_SIZE];
+	StorageBinLogConvertMark *pMark;
+	StorageBinLogConvertMark *pMarkEnd;
+	struct stat stat_buf;
+	int result;
+
+	snprintf(tmp_binlog_filename, sizeof(tmp_binlog_filename), \
+		"%s/"SYNC_BINLOG_FILE_PREFIX SYNC_CONVERT_FILE_EXT, sync_path);
+	pMarkEnd = pConverter->marks + pConverter->mark_count;
+	for (pMark=pConverter->marks; pMark<pMarkEnd; pMark++)
+	{
+		if (pMark->binlog_index != pConverter->binlog_index)
+		{
+			continue;
+		}
+
+		if (!pMark->converted)  //beyond the end of the binlog file
+		{
+			pMark->new_offset = pConverter->offset;
+			pMark->converted = true;
+		}
+		if ((result=storage_binlog_convert_mark_file(pMark)) != 0)
+		{
+			unlink(tmp_binlog_filename);
+			return result;
+		}
+	}
+
+	get_writable_binlog_filename1(binlog_filename, \
+			pConverter->binlog_index);
+	if (stat(binlog_filename, &stat_buf) != 0)
+	{
+		stat_buf.st_size = 0;
+	}
+	*old_file_size = stat_buf.st_size;
+	if (rename(tmp_binlog_filename, binlog_filename) != 0)
+	{
+		result = errno != 0 ? errno : EPERM;
+		logError("file: "__FILE__", line: %d, " \
+			"rename file %s to %s fail, " \
+			"errno: %d, error info: %s", __LINE__, \
+			tmp_binlog_filename, binlog_filename, \
+			result, STRERROR(result));
+		return result;
+	}
+	STORAGE_CHOWN(binlog_filename, geteuid(), getegid())
+
+	for (pMark=pConverter->marks; pMark<pMarkEnd; pMark++)
+	{
+		if (pMark->binlog_index != pConverter->binlog_index)
+		{
+			continue;
+		}
+
+		snprintf(mark_filename, sizeof(mark_filename), "%s" \
+			SYNC_CONVERT_FILE_EXT, pMark->filename);
+		if (rename(mark_filename, pMark->filename) != 0)
+		{
+			result = errno != 0 ? errno : EPERM;
+			logError("file: "__FILE__", line: %d, " \
+				"rename file %s to %s fail, " \
+				"errno: %d, error info: %s", __LINE__, \
+				mark_filename, pMark->filename, \
+				result, STRERROR(result));
+			return result;
+		}
+	}
+
+	return 0;
+}
+
+/* convert the text records of one binlog file to the binary records */
+static int storage_binlog_convert_file(const char *sync_path, \
+		StorageBinLogConverter *pConverter, const int binlog_index)
+{
+	int64_t old_file_size;
+	int result;
+
+	if ((result=storage_binlog_rewrite_file(sync_path, pConverter, \
+		binlog_index, storage_binlog_convert_func, pConverter)) != 0 \
+		|| pConverter->changed_count == 0)
+	{
+		return result;
+	}
+
+	if ((result=storage_binlog_replace_file(sync_path, pConverter, \
+		&old_file_size)) != 0)
+	{
+		return result;
+	}
+
+	logInfo("file: "__FILE__", line: %d, " \
+		"convert binlog file \""SYNC_BINLOG_FILE_PREFIX \
+		SYNC_BINLOG_FILE_EXT_FMT"\" to the binary format, " \
+		"text record count: %d, file size: "INT64_PRINTF_FORMAT \
+		" => "INT64_PRINTF_FORMAT, __LINE__, binlog_index, \
+		pConverter->changed_count, old_file_size, pConverter->offset);
+	return 0;
+}
+
+static int storage_binlog_convert_init(const char *sync_path, \
+		StorageBinLogConverter *pConverter)
+{
+	memset(pConverter, 0, sizeof(StorageBinLogConverter));
+	pConverter->fd = -1;
+	pConverter->buff = (char *)malloc(STORAGE_BINLOG_BUFFER_SIZE);
+	if (pConverter->buff == NULL)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"malloc %d bytes fail, " \
+			"errno: %d, error info: %s", \
+			__LINE__, STORAGE_BINLOG_BUFFER_SIZE, \
+			errno, STRERROR(errno));
+		return errno != 0 ? errno : ENOMEM;
+	}
+
+	return storage_binlog_convert_load_marks(sync_path, pConverter);
+}
+
+static void storage_binlog_convert_destroy(StorageBinLogConverter *pConverter)
+{
+	if (pConverter->buff != NULL)
+	{
+		free(pConverter->buff);
+		pConverter->buff = NULL;
+	}
+	if (pConverter->marks != NULL)
+	{
+		free(pConverter->marks);
+		pConverter->marks = NULL;
+		pConverter->mark_count = 0;
+	}
+}
+
+static int storage_binlog_convert_files(const char *sync_path)
+{
+	char full_filename[MAX_PATH_SIZE];
+	StorageBinLogConverter converter;
+	int binlog_index;
+	int result;
+
+	if ((result=storage_binlog_convert_init(sync_path, &converter)) == 0)
+	{
+		for (binlog_index=0; binlog_index<=g_binlog_index; \
+			binlog_index++)
+		{
+			if ((result=storage_binlog_convert_file(sync_path, \
+				&converter, binlog_index)) != 0)
+			{
+				break;
+			}
+
+			//the offsets of the timestamp index are changed
+			if (converter.changed_count > 0)
+			{
+				unlink(get_binlog_ts_index_filename( \
+					full_filename));
+			}
+		}
+	}
+
+	storage_binlog_convert_destroy(&converter);
+	return result;
+}
+
+static int storage_binlog_reader_register(StorageBinLogReader *pReader)
+{
+	StorageBinLogReader **ppReader;
+	int alloc_count;
+	int result;
+	int i;
+
+	result = 0;
+	pthread_mutex_lock(&binlog_compact_lock);
+	for (i=0; i<binlog_reader_count; i++)
+	{
+		if (binlog_readers[i] == pReader)  //initialized again
+		{
+			pthread_mutex_unlock(&binlog_compact_lock);
+			return 0;
+		}
+	}
+
+	if (binlog_reader_count == binlog_reader_alloc)
+	{
+		alloc_count = binlog_reader_alloc == 0 ? 16 : \
+				2 * binlog_reader_alloc;
+		ppReader = (StorageBinLogReader **)realloc(binlog_readers, \
+				sizeof(StorageBinLogReader *) * alloc_count);
+		if (ppReader == NULL)
+		{
+			logError("file: "__FILE__", line: %d, " \
+				"realloc %d bytes fail", __LINE__, \
+				(int)sizeof(StorageBinLogReader *) * \
+				alloc_count);
+			result = errno != 0 ? errno : ENOMEM;
+		}
+		else
+		{
+			binlog_readers = ppReader;
+			binlog_reader_alloc = alloc_count;
+		}
+	}
+
+	if (result == 0)
+	{
+		binlog_readers[binlog_reader_count++] = pReader;
+	}
+	pthread_mutex_unlock(&binlog_compact_lock);
+	return result;
+}
+
+static void storage_binlog_reader_unregister(StorageBinLogReader *pReader)
+{
+	int i;
+
+	if (binlog_readers == NULL)
+	{
+		return;
+	}
+
+	pthread_mutex_lock(&binlog_compact_lock);
+	for (i=0; i<binlog_reader_count; i++)
+	{
+		if (binlog_readers[i] == pReader)
+		{
+			binlog_readers[i] = binlog_readers[--binlog_reader_count];
+			break;
+		}
+	}
+	pthread_mutex_unlock(&binlog_compact_lock);
+}
+
+/* the min binlog index of the readers, call with binlog_compact_lock */
+static int storage_binlog_reader_min_index(int binlog_index)
+{
+	int i;
+
+	for (i=0; i<binlog_reader_count; i++)
+	{
+		if (binlog_readers[i]->binlog_index < binlog_index)
+		{
+			binlog_index = binlog_readers[i]->binlog_index;
+		}
+	}
+
+	return binlog_index;
+}
+
+/* replace the timestamp index entries of the compacted binlog file,
+   the index file is rewritten, call with sync_thread_lock */
+static int storage_binlog_ts_index_replace(const int binlog_index, \
+		const StorageBinLogTsEntry *entries, const int count)
+{
+	char full_filename[MAX_PATH_SIZE];
+	char tmp_filename[MAX_PATH_SIZE];
+	StorageBinLogTsEntry *pEntry;
+	char *buff;
+	int start;
+	int end;
+	int new_count;
+	int bytes;
+	int i;
+	int fd;
+	int result;
+
+	for (start=0; start<binlog_ts_entry_count; start++)
+	{
+		if (binlog_ts_entries[start].binlog_index >= binlog_index)
+		{
+			break;
+		}
+	}
+	for (end=start; end<binlog_ts_entry_count; end++)
+	{
+		if (binlog_ts_entries[end].binlog_index > binlog_index)
+		{
+			break;
+		}
+	}
+	if (start == end)
+	{
+		return 0;
+	}
+
+	new_count = binlog_ts_entry_count - (end - start) + count;
+	if (new_count > binlog_ts_entry_alloc)
+	{
+		pEntry = (StorageBinLogTsEntry *)realloc(binlog_ts_entries, \
+				sizeof(StorageBinLogTsEntry) * new_count);
+		if (pEntry == NULL)
+		{
+			logError("file: "__FILE__", line: %d, " \
+				"realloc %d bytes fail", __LINE__, \
+				(int)sizeof(StorageBinLogTsEntry) * new_count);
+			return errno != 0 ? errno : ENOMEM;
+		}
+
+		binlog_ts_entries = pEntry;
+		binlog_ts_entry_alloc = new_count;
+	}
+
+	memmove(binlog_ts_entries + start + count, binlog_ts_entries + end, \
+		sizeof(StorageBinLogTsEntry) * (binlog_ts_entry_count - end));
+	memcpy(binlog_ts_entries + start, entries, \
+		sizeof(StorageBinLogTsEntry) * count);
+	binlog_ts_entry_count = new_count;
+
+	bytes = SYNC_BINLOG_TS_ENTRY_SIZE * binlog_ts_entry_count;
+	buff = (char *)malloc(bytes + 1);
+	if (buff == NULL)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"malloc %d bytes fail", __LINE__, bytes + 1);
+		result = errno != 0 ? errno : ENOMEM;
+	}
+	else
+	{
+		for (i=0; i<binlog_ts_entry_count; i++)
+		{
+			pEntry = binlog_ts_entries + i;
+			int2buff(pEntry->timestamp, buff + \
+				SYNC_BINLOG_TS_ENTRY_SIZE * i);
+			int2buff(pEntry->binlog_index, buff + \
+				SYNC_BINLOG_TS_ENTRY_SIZE * i + 4);
+			long2buff(pEntry->binlog_offset, buff + \
+				SYNC_BINLOG_TS_ENTRY_SIZE * i + 8);
+		}
+
+		get_binlog_ts_index_filename(full_filename);
+		snprintf(tmp_filename, sizeof(tmp_filename), "%s" \
+			SYNC_CONVERT_FILE_EXT, full_filename);
+		if ((result=writeToFile(tmp_filename, buff, bytes)) == 0 && \
+			rename(tmp_filename, full_filename) != 0)
+		{
+			result = errno != 0 ? errno : EPERM;
+			logError("file: "__FILE__", line: %d, " \
+				"rename file %s to %s fail, " \
+				"errno: %d, error info: %s", __LINE__, \
+				tmp_filename, full_filename, \
+				result, STRERROR(result));
+		}
+		free(buff);
+	}
+
+	if (result != 0)
+	{
+		//the index is rebuilt when the storage server starts
+		unlink(get_binlog_ts_index_filename(full_filename));
+		return result;
+	}
+
+	if ((fd=open(full_filename, O_WRONLY | O_APPEND)) < 0)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"open file \"%s\" fail, " \
+			"errno: %d, error info: %s", \
+			__LINE__, full_filename, \
+			errno, STRERROR(errno));
+		return errno != 0 ? errno : EACCES;
+	}
+	STORAGE_FCHOWN(fd, full_filename, geteuid(), getegid())
+
+	close(binlog_ts_index_fd);
+	binlog_ts_index_fd = fd;
+	return 0;
+}
+
+static int storage_binlog_compact_get_key(const char *filename, \
+		const int filename_len)
+{
+	const char *p;
+
+	p = (const char *)memchr(filename, ' ', filename_len);
+	return p != NULL ? p - filename : filename_len;
+}
+
+/* collect the history of each file, the file is created by the create
+   record or the link record, and the file referenced by the link record
+   as the src file is kept */
+static int storage_binlog_compact_scan_func(void *args, const char *buff, \
+		const int length, const StorageBinLogRecord *pRecord, \
+		const int64_t offset)
+{
+	StorageBinLogCompactor *pCompactor;
+	StorageBinLogCompactFile *pFile;
+	StorageBinLogCompactFile file;
+	bool bCreate;
+	bool bDelete;
+	int key_len;
+	int result;
+
+	if (!(g_continue_flag && compactor_continue_flag))
+	{
+		return EINTR;
+	}
+	if (pRecord == NULL)
+	{
+		return 0;
+	}
+
+	pCompactor = (StorageBinLogCompactor *)args;
+	bCreate = pRecord->op_type == STORAGE_OP_TYPE_SOURCE_CREATE_FILE || \
+		pRecord->op_type == STORAGE_OP_TYPE_REPLICA_CREATE_FILE || \
+		pRecord->op_type == STORAGE_OP_TYPE_SOURCE_CREATE_LINK || \
+		pRecord->op_type == STORAGE_OP_TYPE_REPLICA_CREATE_LINK;
+	bDelete = pRecord->op_type == STORAGE_OP_TYPE_SOURCE_DELETE_FILE || \
+		pRecord->op_type == STORAGE_OP_TYPE_REPLICA_DELETE_FILE;
+
+	key_len = storage_binlog_compact_get_key(pRecord->filename, \
+			pRecord->filename_len);
+	pFile = (StorageBinLogCompactFile *)hash_find(&pCompactor->files, \
+			pRecord->filename, key_len);
+	if (pFile == NULL)
+	{
+		memset(&file, 0, sizeof(file));
+		file.status = bCreate ? SYNC_COMPACT_FILE_ALIVE : \
+				SYNC_COMPACT_FILE_KEEP;
+		file.create_index = pCompactor->converter.binlog_index;
+		file.create_offset = offset;
+		if ((result=hash_insert_ex(&pCompactor->files, \
+			pRecord->filename, key_len, &file, \
+			sizeof(file), false)) < 0)
+		{
+			return -1 * result;
+		}
+	}
+	else if (pFile->status != SYNC_COMPACT_FILE_KEEP)
+	{
+		if (bCreate)  //created again
+		{
+			pFile->status = SYNC_COMPACT_FILE_KEEP;
+		}
+		else if (bDelete)
+		{
+			pFile->status = SYNC_COMPACT_FILE_DELETED;
+			pFile->delete_index = pCompactor->converter.binlog_index;
+			pFile->delete_offset = offset;
+		}
+		else if (pFile->status == SYNC_COMPACT_FILE_DELETED)
+		{
+			pFile->status = SYNC_COMPACT_FILE_KEEP;
+		}
+	}
+
+	if (pRecord->src_filename_len == 0)
+	{
+		return 0;
+	}
+
+	key_len = storage_binlog_compact_get_key(pRecord->src_filename, \
+			pRecord->src_filename_len);
+	pFile = (StorageBinLogCompactFile *)hash_find(&pCompactor->files, \
+			pRecord->src_filename, key_len);
+	if (pFile != NULL)
+	{
+		pFile->status = SYNC_COMPACT_FILE_KEEP;
+		return 0;
+	}
+
+	memset(&file, 0, sizeof(file));
+	file.status = SYNC_COMPACT_FILE_KEEP;
+	if ((result=hash_insert_ex(&pCompactor->files, \
+		pRecord->src_filename, key_len, &file, \
+		sizeof(file), false)) < 0)
+	{
+		return -1 * result;
+	}
+	return 0;
+}
+
+/* the records of the deleted file can be dropped unless a mark file points
+   between its create record and its delete record: the reader of the mark
+   file synced the create record and must sync the delete record */
+static int storage_binlog_compact_walk_func(const int index, \
+		const HashData *data, void *args)
+{
+	StorageBinLogCompactor *pCompactor;
+	StorageBinLogCompactFile *pFile;
+	StorageBinLogConvertMark *pMark;
+	StorageBinLogConvertMark *pMarkEnd;
+	int i;
+
+	pFile = (StorageBinLogCompactFile *)data->value;
+	if (pFile->status != SYNC_COMPACT_FILE_DELETED)
+	{
+		return 0;
+	}
+
+	pCompactor = (StorageBinLogCompactor *)args;
+	pMarkEnd = pCompactor->converter.marks + \
+			pCompactor->converter.mark_count;
+	for (pMark=pCompactor->converter.marks; pMark<pMarkEnd; pMark++)
+	{
+		if ((pMark->binlog_index > pFile->create_index || \
+			(pMark->binlog_index == pFile->create_index && \
+			 pMark->binlog_offset > pFile->create_offset)) && \
+			(pMark->binlog_index < pFile->delete_index || \
+			(pMark->binlog_index == pFile->delete_index && \
+			 pMark->binlog_offset <= pFile->delete_offset)))
+		{
+			pFile->status = SYNC_COMPACT_FILE_KEEP;
+			return 0;
+		}
+	}
+
+	pFile->status = SYNC_COMPACT_FILE_DROP;
+	pCompactor->drop_file_count++;
+	for (i=pFile->create_index; i<=pFile->delete_index; i++)
+	{
+		pCompactor->rewrite_flags[i] = 1;
+	}
+	return 0;
+}
+
+static int storage_binlog_compact_ts_add(StorageBinLogCompactor *pCompactor, \
+		const int64_t offset)
+{
+	StorageBinLogTsEntry *pEntry;
+	int alloc_count;
+
+	if (pCompactor->ts_entry_count > 0 && offset - pCompactor->ts_entries[ \
+		pCompactor->ts_entry_count - 1].binlog_offset < \
+		SYNC_BINLOG_TS_INDEX_INTERVAL)
+	{
+		return 0;
+	}
+
+	if (pCompactor->ts_entry_count == pCompactor->ts_entry_alloc)
+	{
+		alloc_count = pCompactor->ts_entry_alloc == 0 ? 1024 : \
+				2 * pCompactor->ts_entry_alloc;
+		pEntry = (StorageBinLogTsEntry *)realloc( \
+				pCompactor->ts_entries, \
+				sizeof(StorageBinLogTsEntry) * alloc_count);
+		if (pEntry == NULL)
+		{
+			logError("file: "__FILE__", line: %d, " \
+				"realloc %d bytes fail", __LINE__, \
+				(int)sizeof(StorageBinLogTsEntry) * \
+				alloc_count);
+			return errno != 0 ? errno : ENOMEM;
+		}
+
+		pCompactor->ts_entries = pEntry;
+		pCompactor->ts_entry_alloc = alloc_count;
+	}
+
+	pEntry = pCompactor->ts_entries + pCompactor->ts_entry_count++;
+	pEntry->timestamp = pCompactor->max_timestamp;
+	pEntry->binlog_index = pCompactor->converter.binlog_index;
+	pEntry->binlog_offset = offset;
+	return 0;
+}
+
+/* drop the records of the dropped files, the timestamp index entries of
+   the compacted binlog file are built at the same time */
+static int storage_binlog_compact_func(void *args, const char *buff, \
+		const int length, const StorageBinLogRecord *pRecord, \
+		const int64_t offset)
+{
+	StorageBinLogCompactor *pCompactor;
+	StorageBinLogConverter *pConverter;
+	StorageBinLogCompactFile *pFile;
+	int result;
+
+	if (!(g_continue_flag && compactor_continue_flag))
+	{
+		return EINTR;
+	}
+
+	pCompactor = (StorageBinLogCompactor *)args;
+	pConverter = &pCompactor->converter;
+	storage_binlog_convert_marks(pConverter, offset);
+	if (pRecord == NULL)
+	{
+		return storage_binlog_convert_write(pConverter, buff, length);
+	}
+
+	pFile = (StorageBinLogCompactFile *)hash_find(&pCompactor->files, \
+			pRecord->filename, storage_binlog_compact_get_key( \
+			pRecord->filename, pRecord->filename_len));
+	if (pFile != NULL && pFile->status == SYNC_COMPACT_FILE_DROP)
+	{
+		pConverter->changed_count++;
+		return 0;
+	}
+
+	if ((result=storage_binlog_compact_ts_add(pCompactor, \
+			pConverter->offset)) != 0)
+	{
+		return result;
+	}
+	if (pRecord->timestamp > pCompactor->max_timestamp)
+	{
+		pCompactor->max_timestamp = pRecord->timestamp;
+	}
+
+	return storage_binlog_convert_write(pConverter, buff, length);
+}
+
+/* the rewritten file replaces the binlog file when no reader reads it,
+   the readers only move forward, so the reader registered after the check
+   opens the compacted file */
+static int storage_binlog_compact_replace(const char *sync_path, \
+		StorageBinLogCompactor *pCompactor, const bool bOnline, \
+		int64_t *old_file_size)
+{
+	char tmp_binlog_filename[MAX_PATH_SIZE];
+	int binlog_index;
+	int result;
+
+	binlog_index = pCompactor->converter.binlog_index;
+	if (!bOnline)
+	{
+		return storage_binlog_replace_file(sync_path, \
+				&pCompactor->converter, old_file_size);
+	}
+
+	pthread_mutex_lock(&binlog_compact_lock);
+	if (storage_binlog_reader_min_index(pCompactor->end_index) <= \
+		binlog_index)
+	{
+		pthread_mutex_unlock(&binlog_compact_lock);
+		snprintf(tmp_binlog_filename, sizeof(tmp_binlog_filename), \
+			"%s/"SYNC_BINLOG_FILE_PREFIX SYNC_CONVERT_FILE_EXT, \
+			sync_path);
+		unlink(tmp_binlog_filename);
+		return EBUSY;
+	}
+
+	if ((result=storage_binlog_replace_file(sync_path, \
+		&pCompactor->converter, old_file_size)) == 0)
+	{
+		pthread_mutex_lock(&sync_thread_lock);
+		storage_binlog_ts_index_replace(binlog_index, \
+			pCompactor->ts_entries, pCompactor->ts_entry_count);
+		pthread_mutex_unlock(&sync_thread_lock);
+	}
+	pthread_mutex_unlock(&binlog_compact_lock);
+	return result;
+}
+
+static int storage_binlog_compact_file(const char *sync_path, \
+		StorageBinLogCompactor *pCompactor, const int binlog_index, \
+		const bool bOnline)
+{
+	int64_t old_file_size;
+	int i;
+	int result;
+
+	pCompactor->ts_entry_count = 0;
+	pCompactor->max_timestamp = 0;
+	if (bOnline)
+	{
+		//the max timestamp before the binlog file
+		pthread_mutex_lock(&sync_thread_lock);
+		for (i=0; i<binlog_ts_entry_count; i++)
+		{
+			if (binlog_ts_entries[i].binlog_index == binlog_index)
+			{
+				pCompactor->max_timestamp = \
+					binlog_ts_entries[i].timestamp;
+				break;
+			}
+		}
+		pthread_mutex_unlock(&sync_thread_lock);
+	}
+
+	if ((result=storage_binlog_rewrite_file(sync_path, \
+		&pCompactor->converter, binlog_index, \
+		storage_binlog_compact_func, pCompactor)) != 0 || \
+		pCompactor->converter.changed_count == 0)
+	{
+		return result;
+	}
+
+	if ((result=storage_binlog_compact_replace(sync_path, \
+		pCompactor, bOnline, &old_file_size)) != 0)
+	{
+		return result;
+	}
+
+	logInfo("file: "__FILE__", line: %d, " \
+		"compact binlog file \""SYNC_BINLOG_FILE_PREFIX \
+		SYNC_BINLOG_FILE_EXT_FMT"\", dropped record count: %d, " \
+		"file size: "INT64_PRINTF_FORMAT" => "INT64_PRINTF_FORMAT, \
+		__LINE__, binlog_index, pCompactor->converter.changed_count, \
+		old_file_size, pCompactor->converter.offset);
+	return 0;
+}
+
+/* drop the records of the files which created and deleted from the sealed
+   binlog files. the offline compactor (when the storage server starts)
+   compacts all sealed binlog files and converts the offsets of the mark
+   files. the online compactor only compacts the binlog files before the
+   mark files and the readers. the files are compacted in ascending order,
+   so the delete record is never dropped before the create record */
+static int storage_binlog_compact(const bool bOnline)
+{
+	char sync_path[MAX_PATH_SIZE];
+	char full_filename[MAX_PATH_SIZE];
+	StorageBinLogCompactor compactor;
+	StorageBinLogConvertMark *pMark;
+	StorageBinLogConvertMark *pMarkEnd;
+	int binlog_index;
+	int compact_count;
+	int result;
+
+	snprintf(sync_path, sizeof(sync_path), "%s/data/"SYNC_DIR_NAME, \
+		g_fdfs_base_path);
+	memset(&compactor, 0, sizeof(compactor));
+	if ((result=storage_binlog_convert_init(sync_path, \
+			&compactor.converter)) != 0)
+	{
+		storage_binlog_convert_destroy(&compactor.converter);
+		return result;
+	}
+
+	if (bOnline)
+	{
+		pthread_mutex_lock(&sync_thread_lock);
+		compactor.end_index = g_binlog_index;
+		pthread_mutex_unlock(&sync_thread_lock);
+
+		pMarkEnd = compactor.converter.marks + \
+				compactor.converter.mark_count;
+		for (pMark=compactor.converter.marks; pMark<pMarkEnd; pMark++)
+		{
+			if (pMark->binlog_index < compactor.end_index)
+			{
+				compactor.end_index = pMark->binlog_index;
+			}
+		}
+
+		pthread_mutex_lock(&binlog_compact_lock);
+		compactor.end_index = storage_binlog_reader_min_index( \
+				compactor.end_index);
+		pthread_mutex_unlock(&binlog_compact_lock);
+	}
+	else
+	{
+		compactor.end_index = g_binlog_index;
+	}
+
+	if (compactor.end_index <= binlog_compacted_index)
+	{
+		storage_binlog_convert_destroy(&compactor.converter);
+		return 0;
+	}
+
+	compactor.rewrite_flags = (char *)calloc(compactor.end_index, 1);
+	if (compactor.rewrite_flags == NULL)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"calloc %d bytes fail", __LINE__, compactor.end_index);
+		storage_binlog_convert_destroy(&compactor.converter);
+		return errno != 0 ? errno : ENOMEM;
+	}
+
+	if ((result=hash_init_ex(&compactor.files, PJWHash, 64 * 1024, \
+		0.75, 0, true)) != 0)
+	{
+		free(compactor.rewrite_flags);
+		storage_binlog_convert_destroy(&compactor.converter);
+		return result;
+	}
+
+	for (binlog_index=0; binlog_index<compactor.end_index; binlog_index++)
+	{
+		compactor.converter.binlog_index = binlog_index;
+		result = storage_binlog_scan_file(binlog_index, 0, \
+			storage_binlog_compact_scan_func, &compactor);
+		if (result != 0 && result != ENOENT)
+		{
+			break;
+		}
+		result = 0;
+	}
+
+	compact_count = 0;
+	if (result == 0)
+	{
+		hash_walk(&compactor.files, storage_binlog_compact_walk_func, \
+			&compactor);
+		for (binlog_index=0; binlog_index<compactor.end_index; \
+			binlog_index++)
+		{
+			if (!compactor.rewrite_flags[binlog_index])
+			{
+				continue;
+			}
+
+			if ((result=storage_binlog_compact_file(sync_path, \
+				&compactor, binlog_index, bOnline)) != 0)
+			{
+				break;
+			}
+
+			if (compactor.converter.changed_count > 0)
+			{
+				compact_count++;
+			}
+		}
+	}
+
+	if (!bOnline && compact_count > 0)
+	{
+		//the offsets of the timestamp index are changed
+		unlink(get_binlog_ts_index_filename(full_filename));
+	}
+
+	if (result == 0)
+	{
+		binlog_compacted_index = compactor.end_index;
+		logInfo("file: "__FILE__", line: %d, " \
+			"compact the binlog files before the index %d, " \
+			"dropped file count: %d, compacted binlog file " \
+			"count: %d", __LINE__, compactor.end_index, \
+			compactor.drop_file_count, compact_count);
+	}
+	else if (result == EBUSY)
+	{
+		result = 0;  //compact the other files later
+	}
+
+	hash_destroy(&compactor.files);
+	free(compactor.rewrite_flags);
+	if (compactor.ts_entries != NULL)
+	{
+		free(compactor.ts_entries);
+	}
+	storage_binlog_convert_destroy(&compactor.converter);
+	return result;
+}
+
+static void *storage_binlog_compactor_entrance(void *arg)
+{
+	time_t last_compact_time;
+
+	last_compact_time = g_current_time;
+	while (g_continue_flag && compactor_continue_flag)
+	{
+		sleep(1);
+		if (g_current_time - last_compact_time < \
+			g_binlog_compact_interval)
+		{
+			continue;
+		}
+
+		storage_binlog_compact(true);
+		last_compact_time = g_current_time;
+	}
+
+	compactor_thread_running = false;
+	return NULL;
+}
+
+int storage_binlog_compactor_start()
+{
+	pthread_t tid;
+	pthread_attr_t pattr;
+	int result;
+
+	if (g_binlog_compact_interval <= 0)
+	{
+		return 0;
+	}
+
+	if ((result=init_pthread_attr(&pattr, g_thread_stack_size)) != 0)
+	{
+		return result;
+	}
+
+	compactor_continue_flag = true;
+	compactor_thread_running = true;
+	if ((result=pthread_create(&tid, &pattr, \
+		storage_binlog_compactor_entrance, NULL)) != 0)
+	{
+		compactor_thread_running = false;
+		logError("file: "__FILE__", line: %d, " \
+			"create thread failed, errno: %d, " \
+			"error info: %s", __LINE__, \
+			result, STRERROR(result));
+	}
+
+	pthread_attr_destroy(&pattr);
+	return result;
+}
+
+void storage_binlog_compactor_destroy()
+{
+	int i;
+
+	compactor_continue_flag = false;
+	for (i=0; compactor_thread_running && i<300; i++)
+	{
+		usleep(10000);
+	}
+}
+
+int storage_sync_init()
+{
+	char data_path[MAX_PATH_SIZE];
+	char sync_path[MAX_PATH_SIZE];
+	char full_filename[MAX_PATH_SIZE];
+	char file_buff[64];
+	int bytes;
+	int result;
+	int fd;
+
+	snprintf(data_path, sizeof(data_path), "%s/data", g_fdfs_base_path);
+	if (!fileExists(data_path))
+	{
+		if (mkdir(data_path, 0755) != 0)
+		{
+			logError("file: "__FILE__", line: %d, " \
+				"mkdir \"%s\" fail, " \
+				"errno: %d, error info: %s", \
+				__LINE__, data_path, \
+				errno, STRERROR(errno));
+			return errno != 0 ? errno : ENOENT;
+		}
+
+		STORAGE_CHOWN(data_path, geteuid(), getegid())
+	}
+
+	snprintf(sync_path, sizeof(sync_path), \
+			"%s/"SYNC_DIR_NAME, data_path);
+	if (!fileExists(sync_path))
+	{
+		if (mkdir(sync_path, 0755) != 0)
+		{
 			logError("file: "__FILE__", line: %d, " \
 				"mkdir \"%s\" fail, " \
 				"errno: %d, error info: %s", \
@@ -1235,6 +3187,28 @@ int storage_sync_init()
 		}
 	}
 
+	if ((result=storage_binlog_convert_recover(sync_path)) != 0)
+	{
+		return result;
+	}
+
+	if (g_convert_text_binlog && \
+		g_binlog_format == STORAGE_BINLOG_FORMAT_BINARY)
+	{
+		if ((result=storage_binlog_convert_files(sync_path)) != 0)
+		{
+			return result;
+		}
+	}
+
+	if (g_compact_binlog_on_startup)
+	{
+		if ((result=storage_binlog_compact(false)) != 0)
+		{
+			return result;
+		}
+	}
+
 	get_writable_binlog_filename(full_filename);
 	g_binlog_fd = open(full_filename, O_WRONLY | O_CREAT | O_APPEND, 0644);
 	if (g_binlog_fd < 0)
@@ -1261,6 +3235,11 @@ int storage_sync_init()
 
 	STORAGE_FCHOWN(g_binlog_fd, full_filename, geteuid(), getegid())
 
+	if ((result=storage_binlog_ts_index_init()) != 0)
+	{
+		return result;
+	}
+
 	/*
 	//printf("full_filename=%s, binlog_file_size=%d\n", \
 			full_filename, binlog_file_size);
@@ -1271,6 +3250,20 @@ int storage_sync_init()
 		return result;
 	}
 
+	if ((result=init_pthread_lock(&binlog_compact_lock)) != 0)
+	{
+		return result;
+	}
+
+	if ((result=pthread_cond_init(&binlog_write_cond, NULL)) != 0)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"pthread_cond_init fail, " \
+			"errno: %d, error info: %s", \
+			__LINE__, result, STRERROR(result));
+		return result;
+	}
+
 	load_local_host_ip_addrs();
 
 	return 0;
@@ -1286,11 +3279,22 @@ int storage_sync_destroy()
 		close(g_binlog_fd);
 		g_binlog_fd = -1;
 	}
+	storage_binlog_ts_index_destroy();
+
+	if (binlog_readers != NULL)
+	{
+		free(binlog_readers);
+		binlog_readers = NULL;
+		binlog_reader_count = 0;
+		binlog_reader_alloc = 0;
+	}
 
 	if (binlog_write_cache_buff != NULL)
 	{
 		free(binlog_write_cache_buff);
 		binlog_write_cache_buff = NULL;
+		pthread_cond_destroy(&binlog_write_cond);
+		pthread_mutex_destroy(&binlog_compact_lock);
 		if ((result=pthread_mutex_destroy(&sync_thread_lock)) != 0)
 		{
 			logError("file: "__FILE__", line: %d, " \
@@ -1390,6 +3394,7 @@ static int storage_binlog_fsync(const bool bNeedLock)
 	}
 	else
 	{
+		storage_binlog_ts_index_append(binlog_file_size);
 		binlog_file_size += binlog_write_cache_len;
 		if (binlog_file_size >= SYNC_BINLOG_FILE_MAX_SIZE)
 		{
@@ -1415,27 +3420,253 @@ static int storage_binlog_fsync(const bool bNeedLock)
 			write_ret = 0;
 		}
 	}
-
-	binlog_write_version++;
-	binlog_write_cache_len = 0;  //reset cache buff
-
-	if (bNeedLock && (result=pthread_mutex_unlock(&sync_thread_lock)) != 0)
+
+	binlog_write_version++;
+	binlog_write_cache_len = 0;  //reset cache buff
+	pthread_cond_broadcast(&binlog_write_cond);
+
+	if (bNeedLock && (result=pthread_mutex_unlock(&sync_thread_lock)) != 0)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"call pthread_mutex_unlock fail, " \
+			"errno: %d, error info: %s", \
+			__LINE__, result, STRERROR(result));
+	}
+
+	return write_ret;
+}
+
+int storage_binlog_pack_record(const int timestamp, const char op_type, \
+		const char *filename, const char *extra, char *buff)
+{
+	char *p;
+	int filename_len;
+	int extra_len;
+	int record_length;
+
+	filename_len = strlen(filename);
+	extra_len = extra != NULL ? strlen(extra) : 0;
+	if (filename_len > STORAGE_BINLOG_FILENAME_MAX_LEN || \
+		extra_len > STORAGE_BINLOG_FILENAME_MAX_LEN)
+	{
+		return 0;
+	}
+
+	record_length = STORAGE_BINLOG_RECORD_HEADER_SIZE + \
+			filename_len + extra_len + 4;
+	p = buff;
+	*p++ = (char)STORAGE_BINLOG_RECORD_MAGIC;
+	*p++ = STORAGE_BINLOG_RECORD_VERSION;
+	*p++ = (record_length >> 8) & 0xFF;
+	*p++ = record_length & 0xFF;
+	int2buff(timestamp, p);
+	p += 4;
+	*p++ = op_type;
+	*p++ = filename_len;
+	*p++ = extra_len;
+	*p++ = 0;  //reserved
+	memcpy(p, filename, filename_len);
+	p += filename_len;
+	if (extra_len > 0)
+	{
+		memcpy(p, extra, extra_len);
+		p += extra_len;
+	}
+	int2buff(CRC32(buff, p - buff), p);
+
+	return record_length;
+}
+
+/* return the length of the record, 1 for the bad binary record,
+   0 when the record is incomplete */
+static int storage_binlog_record_length(const char *buff, const int length)
+{
+	const char *pLineEnd;
+	int record_length;
+
+	if (*((unsigned char *)buff) == STORAGE_BINLOG_RECORD_MAGIC)
+	{
+		if (length < 4)
+		{
+			return 0;
+		}
+
+		record_length = (*((unsigned char *)buff + 2) << 8) | \
+				*((unsigned char *)buff + 3);
+		if (record_length < STORAGE_BINLOG_RECORD_HEADER_SIZE + 5 || \
+			record_length > STORAGE_BINLOG_RECORD_MAX_SIZE)
+		{
+			return 1;
+		}
+
+		return length >= record_length ? record_length : 0;
+	}
+
+	pLineEnd = (const char *)memchr(buff, '\n', length);
+	return pLineEnd != NULL ? (pLineEnd - buff) + 1 : 0;
+}
+
+int storage_binlog_unpack_record(const char *buff, const int length, \
+		StorageBinLogRecord *pRecord, int *record_length)
+{
+	char line[STORAGE_BINLOG_LINE_SIZE];
+	char *cols[3];
+	char *p;
+	int extra_len;
+
+	if (length <= 0 || (*record_length=storage_binlog_record_length( \
+				buff, length)) == 0)
+	{
+		*record_length = 0;
+		return EAGAIN;
+	}
+
+	pRecord->timestamp = 0;
+	if (*((unsigned char *)buff) == STORAGE_BINLOG_RECORD_MAGIC)
+	{
+		if (*record_length == 1 || *(buff + 1) != \
+			STORAGE_BINLOG_RECORD_VERSION || \
+			buff2int(buff + *record_length - 4) != \
+			CRC32((void *)buff, *record_length - 4))
+		{
+			return EINVAL;
+		}
+
+		pRecord->filename_len = *((unsigned char *)buff + 9);
+		extra_len = *((unsigned char *)buff + 10);
+		if (pRecord->filename_len == 0 || pRecord->filename_len > \
+			STORAGE_BINLOG_FILENAME_MAX_LEN || extra_len > \
+			STORAGE_BINLOG_FILENAME_MAX_LEN || \
+			STORAGE_BINLOG_RECORD_HEADER_SIZE + \
+			pRecord->filename_len + extra_len + 4 != *record_length)
+		{
+			return EINVAL;
+		}
+
+		pRecord->timestamp = buff2int(buff + 4);
+		pRecord->op_type = *(buff + 8);
+		p = (char *)buff + STORAGE_BINLOG_RECORD_HEADER_SIZE;
+		memcpy(pRecord->filename, p, pRecord->filename_len);
+		*(pRecord->filename + pRecord->filename_len) = '\0';
+		if (pRecord->op_type == STORAGE_OP_TYPE_SOURCE_CREATE_LINK || \
+		    pRecord->op_type == STORAGE_OP_TYPE_REPLICA_CREATE_LINK)
+		{
+			memcpy(pRecord->src_filename, p + \
+				pRecord->filename_len, extra_len);
+			*(pRecord->src_filename + extra_len) = '\0';
+			pRecord->src_filename_len = extra_len;
+		}
+		else
+		{
+			//the fields follow the filename as the text line
+			if (extra_len > 0)
+			{
+			if (pRecord->filename_len + 1 + extra_len > \
+				sizeof(pRecord->filename) - 1)
+			{
+				return EINVAL;
+			}
+			*(pRecord->filename + pRecord->filename_len) = ' ';
+			memcpy(pRecord->filename + pRecord->filename_len + 1, \
+				p + pRecord->filename_len, extra_len);
+			pRecord->filename_len += 1 + extra_len;
+			*(pRecord->filename + pRecord->filename_len) = '\0';
+			}
+
+			*(pRecord->src_filename) = '\0';
+			pRecord->src_filename_len = 0;
+		}
+	}
+	else
+	{
+	//the text line of the old version
+	if (*record_length >= sizeof(line))
+	{
+		return EINVAL;
+	}
+	memcpy(line, buff, *record_length);
+	*(line + *record_length) = '\0';
+
+	if (splitEx(line, ' ', cols, 3) < 3)
+	{
+		return EINVAL;
+	}
+
+	pRecord->timestamp = atoi(cols[0]);
+	pRecord->op_type = *(cols[1]);
+	pRecord->filename_len = strlen(cols[2]) - 1; //need trim new line \n
+	if (pRecord->filename_len > sizeof(pRecord->filename) - 1)
+	{
+		return EINVAL;
+	}
+
+	memcpy(pRecord->filename, cols[2], pRecord->filename_len);
+	*(pRecord->filename + pRecord->filename_len) = '\0';
+	if (pRecord->op_type == STORAGE_OP_TYPE_SOURCE_CREATE_LINK || \
+	    pRecord->op_type == STORAGE_OP_TYPE_REPLICA_CREATE_LINK)
+	{
+		p = strchr(pRecord->filename, ' ');
+		if (p == NULL)
+		{
+			*(pRecord->src_filename) = '\0';
+			pRecord->src_filename_len = 0;
+		}
+		else
+		{
+			pRecord->src_filename_len = pRecord->filename_len - \
+						(p - pRecord->filename) - 1;
+			pRecord->filename_len = p - pRecord->filename;
+			*p = '\0';
+
+			memcpy(pRecord->src_filename, p + 1, \
+				pRecord->src_filename_len);
+			*(pRecord->src_filename + \
+				pRecord->src_filename_len) = '\0';
+		}
+	}
+	else
 	{
-		logError("file: "__FILE__", line: %d, " \
-			"call pthread_mutex_unlock fail, " \
-			"errno: %d, error info: %s", \
-			__LINE__, result, STRERROR(result));
+		*(pRecord->src_filename) = '\0';
+		pRecord->src_filename_len = 0;
+	}
 	}
 
-	return write_ret;
+	pRecord->true_filename_len = pRecord->filename_len;
+	return storage_split_filename_ex(pRecord->filename, \
+			&pRecord->true_filename_len, pRecord->true_filename, \
+			&pRecord->store_path_index);
 }
 
 int storage_binlog_write_ex(const int timestamp, const char op_type, \
 		const char *filename, const char *extra)
 {
+	char record[STORAGE_BINLOG_RECORD_MAX_SIZE];
+	int record_length;
 	int result;
 	int write_ret;
 
+	/* every change of the file is logged here, both source and replica */
+	if (g_file_cache_size > 0)
+	{
+		storage_file_cache_delete(filename, strlen(filename));
+	}
+
+	if (g_binlog_format == STORAGE_BINLOG_FORMAT_BINARY)
+	{
+		if ((record_length=storage_binlog_pack_record(timestamp, \
+			op_type, filename, extra, record)) == 0)
+		{
+			logError("file: "__FILE__", line: %d, " \
+				"filename: %s is too long to write to " \
+				"binlog", __LINE__, filename);
+			return EINVAL;
+		}
+	}
+	else
+	{
+		record_length = 0;
+	}
+
 	if ((result=pthread_mutex_lock(&sync_thread_lock)) != 0)
 	{
 		logError("file: "__FILE__", line: %d, " \
@@ -1444,7 +3675,13 @@ int storage_binlog_write_ex(const int timestamp, const char op_type, \
 			__LINE__, result, STRERROR(result));
 	}
 
-	if (extra != NULL)
+	if (record_length > 0)
+	{
+		memcpy(binlog_write_cache_buff + binlog_write_cache_len, \
+			record, record_length);
+		binlog_write_cache_len += record_length;
+	}
+	else if (extra != NULL)
 	{
 		binlog_write_cache_len += sprintf(binlog_write_cache_buff + \
 					binlog_write_cache_len, "%d %c %s %s\n",\
@@ -1456,14 +3693,22 @@ int storage_binlog_write_ex(const int timestamp, const char op_type, \
 					binlog_write_cache_len, "%d %c %s\n", \
 					timestamp, op_type, filename);
 	}
+	if (timestamp > binlog_cache_max_timestamp)
+	{
+		binlog_cache_max_timestamp = timestamp;
+	}
 
 	//check if buff full
-	if (SYNC_BINLOG_WRITE_BUFF_SIZE - binlog_write_cache_len < 256)
+	if (SYNC_BINLOG_WRITE_BUFF_SIZE - binlog_write_cache_len < \
+		STORAGE_BINLOG_RECORD_MAX_SIZE)
 	{
 		write_ret = storage_binlog_fsync(false);  //sync to disk
 	}
 	else
 	{
+		//the sync threads read the record from the write cache
+		binlog_write_version++;
+		pthread_cond_broadcast(&binlog_write_cond);
 		write_ret = 0;
 	}
 
@@ -1478,6 +3723,84 @@ int storage_binlog_write_ex(const int timestamp, const char op_type, \
 	return write_ret;
 }
 
+int storage_binlog_write_batch(const int timestamp, const char op_type, \
+		char **filenames, const int count)
+{
+	int record_length;
+	int result;
+	int write_ret;
+	int i;
+
+	if (g_file_cache_size > 0)
+	{
+		for (i=0; i<count; i++)
+		{
+			storage_file_cache_delete(filenames[i], \
+				strlen(filenames[i]));
+		}
+	}
+
+	if ((result=pthread_mutex_lock(&sync_thread_lock)) != 0)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"call pthread_mutex_lock fail, " \
+			"errno: %d, error info: %s", \
+			__LINE__, result, STRERROR(result));
+	}
+
+	write_ret = 0;
+	for (i=0; i<count; i++)
+	{
+		if (g_binlog_format == STORAGE_BINLOG_FORMAT_BINARY)
+		{
+			if ((record_length=storage_binlog_pack_record( \
+				timestamp, op_type, filenames[i], NULL, \
+				binlog_write_cache_buff + \
+				binlog_write_cache_len)) == 0)
+			{
+				logError("file: "__FILE__", line: %d, " \
+					"filename: %s is too long to write " \
+					"to binlog", __LINE__, filenames[i]);
+				write_ret = EINVAL;
+				break;
+			}
+			binlog_write_cache_len += record_length;
+		}
+		else
+		{
+		binlog_write_cache_len += sprintf(binlog_write_cache_buff + \
+					binlog_write_cache_len, "%d %c %s\n", \
+					timestamp, op_type, filenames[i]);
+		}
+		if (timestamp > binlog_cache_max_timestamp)
+		{
+			binlog_cache_max_timestamp = timestamp;
+		}
+
+		//check if buff full
+		if (SYNC_BINLOG_WRITE_BUFF_SIZE - binlog_write_cache_len < \
+			STORAGE_BINLOG_RECORD_MAX_SIZE)
+		{
+			if ((write_ret=storage_binlog_fsync(false)) != 0)
+			{
+				break;
+			}
+		}
+	}
+	binlog_write_version++;
+	pthread_cond_broadcast(&binlog_write_cond);
+
+	if ((result=pthread_mutex_unlock(&sync_thread_lock)) != 0)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"call pthread_mutex_unlock fail, " \
+			"errno: %d, error info: %s", \
+			__LINE__, result, STRERROR(result));
+	}
+
+	return write_ret;
+}
+
 static char *get_binlog_readable_filename(const void *pArg, \
 		char *full_filename)
 {
@@ -1537,19 +3860,32 @@ int storage_open_readable_binlog(StorageBinLogReader *pReader, \
 }
 
 static char *get_mark_filename_by_id_and_port(const char *storage_id, \
-		const int port, char *full_filename, const int filename_size)
+		const int port, const int stream_index, \
+		char *full_filename, const int filename_size)
 {
+	char stream_ext[16];
+
+	//the first stream uses the mark file of the old version
+	if (stream_index == 0)
+	{
+		*stream_ext = '\0';
+	}
+	else
+	{
+		sprintf(stream_ext, ".%d", stream_index);
+	}
+
 	if (g_use_storage_id)
 	{
 		snprintf(full_filename, filename_size, \
-			"%s/data/"SYNC_DIR_NAME"/%s%s", g_fdfs_base_path, \
-			storage_id, SYNC_MARK_FILE_EXT);
+			"%s/data/"SYNC_DIR_NAME"/%s%s%s", g_fdfs_base_path, \
+			storage_id, stream_ext, SYNC_MARK_FILE_EXT);
 	}
 	else
 	{
 		snprintf(full_filename, filename_size, \
-			"%s/data/"SYNC_DIR_NAME"/%s_%d%s", g_fdfs_base_path, \
-			storage_id, port, SYNC_MARK_FILE_EXT);
+			"%s/data/"SYNC_DIR_NAME"/%s_%d%s%s", g_fdfs_base_path, \
+			storage_id, port, stream_ext, SYNC_MARK_FILE_EXT);
 	}
 	return full_filename;
 }
@@ -1575,14 +3911,16 @@ char *get_mark_filename_by_reader(const void *pArg, char *full_filename)
 	}
 
 	return get_mark_filename_by_id_and_port(pReader->storage_id, \
-			g_server_port, full_filename, MAX_PATH_SIZE);
+			g_server_port, pReader->stream_index, \
+			full_filename, MAX_PATH_SIZE);
 }
 
 static char *get_mark_filename_by_id(const char *storage_id, \
-		char *full_filename, const int filename_size)
+		const int stream_index, char *full_filename, \
+		const int filename_size)
 {
 	return get_mark_filename_by_id_and_port(storage_id, g_server_port, \
-				full_filename, filename_size);
+			stream_index, full_filename, filename_size);
 }
 
 int storage_report_storage_status(const char *storage_id, \
@@ -1847,7 +4185,197 @@ static int storage_reader_sync_init_req(StorageBinLogReader *pReader)
 	return result;
 }
 
-int storage_reader_init(FDFSStorageBrief *pStorage, StorageBinLogReader *pReader)
+/* rename the mark file named by the ip address of the old version */
+static int storage_rename_ip_mark_file(const FDFSStorageBrief *pStorage, \
+		const char *full_filename, bool *bFileExist)
+{
+	char old_mark_filename[MAX_PATH_SIZE];
+
+	*bFileExist = false;
+	get_mark_filename_by_ip_and_port(pStorage->ip_addr, \
+		g_server_port, old_mark_filename, \
+		sizeof(old_mark_filename));
+	if (!fileExists(old_mark_filename))
+	{
+		return 0;
+	}
+
+	if (rename(old_mark_filename, full_filename) != 0)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"rename file %s to %s fail" \
+			", errno: %d, error info: %s", \
+			__LINE__, old_mark_filename, \
+			full_filename, errno, STRERROR(errno));
+		return errno != 0 ? errno : EACCES;
+	}
+
+	*bFileExist = true;
+	return 0;
+}
+
+/* when the sync stream count changed, the mark files of all the new
+   streams start from the min binlog position of the old streams.
+   the records synced already are synced again, the dest server
+   ignores the files which exist */
+static int storage_init_stream_mark_files(const FDFSStorageBrief *pStorage)
+{
+	char full_filename[MAX_PATH_SIZE];
+	IniContext iniContext;
+	StorageBinLogReader reader;
+	int old_stream_count;
+	int stream_index;
+	int binlog_index;
+	int64_t binlog_offset;
+	bool bFileExist;
+	bool sync_old_done;
+	int result;
+
+	get_mark_filename_by_id(pStorage->id, 0, \
+			full_filename, sizeof(full_filename));
+	bFileExist = fileExists(full_filename);
+	if (!bFileExist && g_use_storage_id)
+	{
+		if ((result=storage_rename_ip_mark_file(pStorage, \
+			full_filename, &bFileExist)) != 0)
+		{
+			return result;
+		}
+	}
+	if (!bFileExist)
+	{
+		return 0;
+	}
+
+	memset(&reader, 0, sizeof(reader));
+	reader.mark_fd = -1;
+	reader.binlog_fd = -1;
+	reader.binlog_index = -1;
+	strcpy(reader.storage_id, pStorage->id);
+
+	old_stream_count = 1;
+	sync_old_done = true;
+	for (stream_index=0; stream_index<old_stream_count; stream_index++)
+	{
+		get_mark_filename_by_id(pStorage->id, stream_index, \
+			full_filename, sizeof(full_filename));
+		if (stream_index > 0 && !fileExists(full_filename))
+		{
+			continue;
+		}
+
+		memset(&iniContext, 0, sizeof(IniContext));
+		if ((result=iniLoadFromFile(full_filename, &iniContext)) != 0)
+		{
+			logError("file: "__FILE__", line: %d, " \
+				"load from mark file \"%s\" fail, " \
+				"error code: %d", \
+				__LINE__, full_filename, result);
+			return result;
+		}
+
+		if (stream_index == 0)
+		{
+			old_stream_count = iniGetIntValue(NULL, \
+				MARK_ITEM_STREAM_COUNT, &iniContext, 1);
+			if (old_stream_count == g_sync_stream_count)
+			{
+				iniFreeContext(&iniContext);
+				return 0;
+			}
+		}
+
+		binlog_index = iniGetIntValue(NULL, \
+				MARK_ITEM_BINLOG_FILE_INDEX, &iniContext, -1);
+		binlog_offset = iniGetInt64Value(NULL, \
+				MARK_ITEM_BINLOG_FILE_OFFSET, &iniContext, -1);
+		if (binlog_index < 0 || binlog_offset < 0)
+		{
+			iniFreeContext(&iniContext);
+			logError("file: "__FILE__", line: %d, " \
+				"in mark file \"%s\", binlog_index: %d " \
+				"or binlog_offset: "INT64_PRINTF_FORMAT \
+				" < 0", __LINE__, full_filename, \
+				binlog_index, binlog_offset);
+			return EINVAL;
+		}
+
+		sync_old_done = sync_old_done && iniGetBoolValue(NULL, \
+				MARK_ITEM_SYNC_OLD_DONE, &iniContext, false);
+		if (reader.binlog_index < 0 || \
+			binlog_index < reader.binlog_index || \
+			(binlog_index == reader.binlog_index && \
+			 binlog_offset < reader.binlog_offset))
+		{
+			reader.binlog_index = binlog_index;
+			reader.binlog_offset = binlog_offset;
+			reader.need_sync_old = iniGetBoolValue(NULL, \
+				MARK_ITEM_NEED_SYNC_OLD, &iniContext, false);
+			reader.until_timestamp = iniGetIntValue(NULL, \
+				MARK_ITEM_UNTIL_TIMESTAMP, &iniContext, -1);
+			reader.scan_row_count = iniGetInt64Value(NULL, \
+				MARK_ITEM_SCAN_ROW_COUNT, &iniContext, 0);
+			reader.sync_row_count = iniGetInt64Value(NULL, \
+				MARK_ITEM_SYNC_ROW_COUNT, &iniContext, 0);
+		}
+
+		iniFreeContext(&iniContext);
+	}
+
+	reader.sync_old_done = sync_old_done;
+	reader.stream_count = g_sync_stream_count;
+	for (stream_index=0; stream_index<g_sync_stream_count; stream_index++)
+	{
+		reader.stream_index = stream_index;
+		get_mark_filename_by_reader(&reader, full_filename);
+		reader.mark_fd = open(full_filename, O_WRONLY | O_CREAT, 0644);
+		if (reader.mark_fd < 0)
+		{
+			logError("file: "__FILE__", line: %d, " \
+				"open mark file \"%s\" fail, " \
+				"error no: %d, error info: %s", \
+				__LINE__, full_filename, \
+				errno, STRERROR(errno));
+			return errno != 0 ? errno : ENOENT;
+		}
+		STORAGE_FCHOWN(reader.mark_fd, full_filename, \
+				geteuid(), getegid())
+
+		result = storage_write_to_mark_file(&reader);
+		close(reader.mark_fd);
+		if (result != 0)
+		{
+			return result;
+		}
+	}
+
+	for (stream_index=g_sync_stream_count; \
+		stream_index<old_stream_count; stream_index++)
+	{
+		get_mark_filename_by_id(pStorage->id, stream_index, \
+			full_filename, sizeof(full_filename));
+		if (unlink(full_filename) != 0 && errno != ENOENT)
+		{
+			logError("file: "__FILE__", line: %d, " \
+				"unlink file %s fail, " \
+				"errno: %d, error info: %s", __LINE__, \
+				full_filename, errno, STRERROR(errno));
+			return errno != 0 ? errno : EACCES;
+		}
+	}
+
+	logInfo("file: "__FILE__", line: %d, " \
+		"storage server %s:%d, sync stream count changed " \
+		"from %d to %d, sync from binlog index: %d, " \
+		"offset: "INT64_PRINTF_FORMAT, __LINE__, \
+		pStorage->ip_addr, g_server_port, old_stream_count, \
+		g_sync_stream_count, reader.binlog_index, \
+		reader.binlog_offset);
+	return 0;
+}
+
+int storage_reader_init_ex(FDFSStorageBrief *pStorage, \
+		const int stream_index, StorageBinLogReader *pReader)
 {
 	char full_filename[MAX_PATH_SIZE];
 	IniContext iniContext;
@@ -1858,6 +4386,9 @@ int storage_reader_init(FDFSStorageBrief *pStorage, StorageBinLogReader *pReader
 	memset(pReader, 0, sizeof(StorageBinLogReader));
 	pReader->mark_fd = -1;
 	pReader->binlog_fd = -1;
+	pReader->stream_index = stream_index;
+	pReader->stream_count = pStorage != NULL ? g_sync_stream_count : 1;
+	pReader->read_cache = true;
 
 	pReader->binlog_buff.buffer = (char *)malloc( \
 				STORAGE_BINLOG_BUFFER_SIZE);
@@ -1893,25 +4424,13 @@ int storage_reader_init(FDFSStorageBrief *pStorage, StorageBinLogReader *pReader
 	else
 	{
 		bFileExist = fileExists(full_filename);
-		if (!bFileExist && (g_use_storage_id && pStorage != NULL))
+		if (!bFileExist && (g_use_storage_id && pStorage != NULL) \
+			&& stream_index == 0)
 		{
-			char old_mark_filename[MAX_PATH_SIZE];
-			get_mark_filename_by_ip_and_port(pStorage->ip_addr, \
-				g_server_port, old_mark_filename, \
-				sizeof(old_mark_filename));
-			if (fileExists(old_mark_filename))
+			if ((result=storage_rename_ip_mark_file(pStorage, \
+				full_filename, &bFileExist)) != 0)
 			{
-				if (rename(old_mark_filename, full_filename)!=0)
-				{
-					logError("file: "__FILE__", line: %d, "\
-						"rename file %s to %s fail" \
-						", errno: %d, error info: %s", \
-						__LINE__, old_mark_filename, \
-						full_filename, errno, \
-						STRERROR(errno));
-					return errno != 0 ? errno : EACCES;
-				}
-				bFileExist = true;
+				return result;
 			}
 		}
 	}
@@ -2021,6 +4540,24 @@ int storage_reader_init(FDFSStorageBrief *pStorage, StorageBinLogReader *pReader
 	pReader->last_scan_rows = pReader->scan_row_count;
 	pReader->last_sync_rows = pReader->sync_row_count;
 
+	/* the records read from the write cache are not in the binlog file
+	   when the server crashed before the cache written */
+	pthread_mutex_lock(&sync_thread_lock);
+	if (pReader->binlog_index == g_binlog_index && \
+		pReader->binlog_offset > binlog_file_size + \
+					binlog_write_cache_len)
+	{
+		logWarning("file: "__FILE__", line: %d, " \
+			"binlog offset: "INT64_PRINTF_FORMAT" in mark file " \
+			"\"%s\" > binlog file size: "INT64_PRINTF_FORMAT \
+			", set to the file size", __LINE__, \
+			pReader->binlog_offset, full_filename, \
+			binlog_file_size + binlog_write_cache_len);
+		pReader->binlog_offset = binlog_file_size + \
+					binlog_write_cache_len;
+	}
+	pthread_mutex_unlock(&sync_thread_lock);
+
 	pReader->mark_fd = open(full_filename, O_WRONLY | O_CREAT, 0644);
 	if (pReader->mark_fd < 0)
 	{
@@ -2033,6 +4570,11 @@ int storage_reader_init(FDFSStorageBrief *pStorage, StorageBinLogReader *pReader
 	}
 	STORAGE_FCHOWN(pReader->mark_fd, full_filename, geteuid(), getegid())
 
+	if ((result=storage_binlog_reader_register(pReader)) != 0)
+	{
+		return result;
+	}
+
 	if ((result=storage_open_readable_binlog(pReader, \
 			get_binlog_readable_filename, pReader)) != 0)
 	{
@@ -2066,6 +4608,8 @@ int storage_reader_init(FDFSStorageBrief *pStorage, StorageBinLogReader *pReader
 
 void storage_reader_destroy(StorageBinLogReader *pReader)
 {
+	storage_binlog_reader_unregister(pReader);
+
 	if (pReader->mark_fd >= 0)
 	{
 		close(pReader->mark_fd);
@@ -2092,6 +4636,18 @@ static int storage_write_to_mark_file(StorageBinLogReader *pReader)
 	char buff[256];
 	int len;
 	int result;
+	int binlog_index;
+	int64_t binlog_offset;
+	int64_t scan_row_count;
+
+	/* only the records before the in-flight requests are synced */
+	if (!storage_sync_window_get_mark(pReader->window, &binlog_index, \
+			&binlog_offset, &scan_row_count))
+	{
+		binlog_index = pReader->binlog_index;
+		binlog_offset = pReader->binlog_offset;
+		scan_row_count = pReader->scan_row_count;
+	}
 
 	len = sprintf(buff, \
 		"%s=%d\n"  \
@@ -2100,19 +4656,21 @@ static int storage_write_to_mark_file(StorageBinLogReader *pReader)
 		"%s=%d\n"  \
 		"%s=%d\n"  \
 		"%s="INT64_PRINTF_FORMAT"\n"  \
-		"%s="INT64_PRINTF_FORMAT"\n", \
-		MARK_ITEM_BINLOG_FILE_INDEX, pReader->binlog_index, \
-		MARK_ITEM_BINLOG_FILE_OFFSET, pReader->binlog_offset, \
+		"%s="INT64_PRINTF_FORMAT"\n"  \
+		"%s=%d\n", \
+		MARK_ITEM_BINLOG_FILE_INDEX, binlog_index, \
+		MARK_ITEM_BINLOG_FILE_OFFSET, binlog_offset, \
 		MARK_ITEM_NEED_SYNC_OLD, pReader->need_sync_old, \
 		MARK_ITEM_SYNC_OLD_DONE, pReader->sync_old_done, \
 		MARK_ITEM_UNTIL_TIMESTAMP, (int)pReader->until_timestamp, \
-		MARK_ITEM_SCAN_ROW_COUNT, pReader->scan_row_count, \
-		MARK_ITEM_SYNC_ROW_COUNT, pReader->sync_row_count);
+		MARK_ITEM_SCAN_ROW_COUNT, scan_row_count, \
+		MARK_ITEM_SYNC_ROW_COUNT, pReader->sync_row_count, \
+		MARK_ITEM_STREAM_COUNT, pReader->stream_count);
 
 	if ((result=storage_write_to_fd(pReader->mark_fd, \
 		get_mark_filename_by_reader, pReader, buff, len)) == 0)
 	{
-		pReader->last_scan_rows = pReader->scan_row_count;
+		pReader->last_scan_rows = scan_row_count;
 		pReader->last_sync_rows = pReader->sync_row_count;
 	}
 
@@ -2124,18 +4682,92 @@ static int rewind_to_prev_rec_end(StorageBinLogReader *pReader)
 	if (lseek(pReader->binlog_fd, pReader->binlog_offset, SEEK_SET) < 0)
 	{
 		logError("file: "__FILE__", line: %d, " \
-			"seek binlog file \"%s\"fail, " \
+			"seek binlog file \"%s\"fail, " \
+			"file offset: "INT64_PRINTF_FORMAT", " \
+			"errno: %d, error info: %s", \
+			__LINE__, get_binlog_readable_filename(pReader, NULL), \
+			pReader->binlog_offset, \
+			errno, STRERROR(errno));
+		return errno != 0 ? errno : ENOENT;
+	}
+
+	pReader->binlog_buff.current = pReader->binlog_buff.buffer;
+	pReader->binlog_buff.length = 0;
+
+	return 0;
+}
+
+/* read the records in the write cache which follow the binlog file,
+   so the records are synced before the cache written to the file.
+   return EAGAIN when the cache written to the file after read */
+static int storage_binlog_read_cache(StorageBinLogReader *pReader, \
+		const int saved_binlog_write_version)
+{
+	int64_t file_offset;
+	int cache_offset;
+	int bytes;
+	int result;
+
+	file_offset = lseek(pReader->binlog_fd, 0, SEEK_CUR);
+	if (file_offset < 0)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"seek binlog file \"%s\" fail, " \
+			"errno: %d, error info: %s", __LINE__, \
+			get_binlog_readable_filename(pReader, NULL), \
+			errno, STRERROR(errno));
+		return errno != 0 ? errno : ESPIPE;
+	}
+
+	pthread_mutex_lock(&sync_thread_lock);
+	if (pReader->binlog_index != g_binlog_index)
+	{
+		pthread_mutex_unlock(&sync_thread_lock);
+		pReader->binlog_buff.version = saved_binlog_write_version;
+		return ENOENT;
+	}
+
+	if (file_offset < binlog_file_size)
+	{
+		pthread_mutex_unlock(&sync_thread_lock);
+		return EAGAIN;
+	}
+
+	cache_offset = file_offset - binlog_file_size;
+	bytes = binlog_write_cache_len - cache_offset;
+	if (bytes <= 0)
+	{
+		pReader->binlog_buff.version = binlog_write_version;
+		pthread_mutex_unlock(&sync_thread_lock);
+		return ENOENT;
+	}
+
+	if (bytes > STORAGE_BINLOG_BUFFER_SIZE - pReader->binlog_buff.length)
+	{
+		bytes = STORAGE_BINLOG_BUFFER_SIZE - pReader->binlog_buff.length;
+	}
+	else
+	{
+		pReader->binlog_buff.version = binlog_write_version;
+	}
+	memcpy(pReader->binlog_buff.buffer + pReader->binlog_buff.length, \
+		binlog_write_cache_buff + cache_offset, bytes);
+	pthread_mutex_unlock(&sync_thread_lock);
+
+	//skip the records in the file when the cache written to it
+	if (lseek(pReader->binlog_fd, file_offset + bytes, SEEK_SET) < 0)
+	{
+		result = errno != 0 ? errno : ESPIPE;
+		logError("file: "__FILE__", line: %d, " \
+			"seek binlog file \"%s\" fail, " \
 			"file offset: "INT64_PRINTF_FORMAT", " \
-			"errno: %d, error info: %s", \
-			__LINE__, get_binlog_readable_filename(pReader, NULL), \
-			pReader->binlog_offset, \
-			errno, STRERROR(errno));
-		return errno != 0 ? errno : ENOENT;
+			"errno: %d, error info: %s", __LINE__, \
+			get_binlog_readable_filename(pReader, NULL), \
+			file_offset + bytes, result, STRERROR(result));
+		return result;
 	}
 
-	pReader->binlog_buff.current = pReader->binlog_buff.buffer;
-	pReader->binlog_buff.length = 0;
-
+	pReader->binlog_buff.length += bytes;
 	return 0;
 }
 
@@ -2143,6 +4775,7 @@ static int storage_binlog_preread(StorageBinLogReader *pReader)
 {
 	int bytes_read;
 	int saved_binlog_write_version;
+	int result;
 
 	if (pReader->binlog_buff.version == binlog_write_version && \
 		pReader->binlog_buff.length == 0)
@@ -2163,9 +4796,24 @@ static int storage_binlog_preread(StorageBinLogReader *pReader)
 		pReader->binlog_buff.current = pReader->binlog_buff.buffer;
 	}
 
+	do
+	{
 	bytes_read = read(pReader->binlog_fd, pReader->binlog_buff.buffer \
 		+ pReader->binlog_buff.length, \
 		STORAGE_BINLOG_BUFFER_SIZE - pReader->binlog_buff.length);
+	if (bytes_read != 0 || !pReader->read_cache)
+	{
+		break;
+	}
+
+	result = storage_binlog_read_cache(pReader, \
+			saved_binlog_write_version);
+	if (result != EAGAIN)
+	{
+		return result;
+	}
+	} while (1);
+
 	if (bytes_read < 0)
 	{
 		logError("file: "__FILE__", line: %d, " \
@@ -2187,54 +4835,40 @@ static int storage_binlog_preread(StorageBinLogReader *pReader)
 	return 0;
 }
 
-static int storage_binlog_do_line_read(StorageBinLogReader *pReader, \
-		char *line, const int line_size, int *line_length)
+static int storage_binlog_do_record_read(StorageBinLogReader *pReader, \
+		StorageBinLogRecord *pRecord, int *record_length)
 {
-	char *pLineEnd;
-
-	if (pReader->binlog_buff.length == 0)
-	{
-		*line_length = 0;
-		return ENOENT;
-	}
+	int result;
 
-	pLineEnd = (char *)memchr(pReader->binlog_buff.current, '\n', \
-			pReader->binlog_buff.length);
-	if (pLineEnd == NULL)
+	result = storage_binlog_unpack_record(pReader->binlog_buff.current, \
+		pReader->binlog_buff.length, pRecord, record_length);
+	if (result == EAGAIN)
 	{
-		*line_length = 0;
 		return ENOENT;
 	}
 
-	*line_length = (pLineEnd - pReader->binlog_buff.current) + 1;
-	if (*line_length >= line_size)
+	pReader->binlog_buff.current += *record_length;
+	pReader->binlog_buff.length -= *record_length;
+	if (result != 0)
 	{
 		logError("file: "__FILE__", line: %d, " \
-			"read from binlog file \"%s\" fail, " \
+			"read data from binlog file \"%s\" fail, " \
 			"file offset: "INT64_PRINTF_FORMAT", " \
-			"line buffer size: %d is too small! " \
-			"<= line length: %d", __LINE__, \
+			"invalid record length: %d", __LINE__, \
 			get_binlog_readable_filename(pReader, NULL), \
-			pReader->binlog_offset, line_size, *line_length);
-		return ENOSPC;
+			pReader->binlog_offset, *record_length);
 	}
 
-	memcpy(line, pReader->binlog_buff.current, *line_length);
-	*(line + *line_length) = '\0';
-
-	pReader->binlog_buff.current = pLineEnd + 1;
-	pReader->binlog_buff.length -= *line_length;
-
-	return 0;
+	return result;
 }
 
-static int storage_binlog_read_line(StorageBinLogReader *pReader, \
-		char *line, const int line_size, int *line_length)
+static int storage_binlog_read_record(StorageBinLogReader *pReader, \
+		StorageBinLogRecord *pRecord, int *record_length)
 {
 	int result;
 
-	result = storage_binlog_do_line_read(pReader, line, \
-			line_size, line_length);
+	result = storage_binlog_do_record_read(pReader, pRecord, \
+			record_length);
 	if (result != ENOENT)
 	{
 		return result;
@@ -2246,21 +4880,40 @@ static int storage_binlog_read_line(StorageBinLogReader *pReader, \
 		return result;
 	}
 
-	return storage_binlog_do_line_read(pReader, line, \
-			line_size, line_length);
+	return storage_binlog_do_record_read(pReader, pRecord, \
+			record_length);
+}
+
+/* wait for the binlog records written after the reader reached the end
+   of the binlog, the writer signals the waiting readers */
+static void storage_binlog_wait(StorageBinLogReader *pReader, \
+		const int timeout_usec)
+{
+	struct timeval tv;
+	struct timespec ts;
+
+	gettimeofday(&tv, NULL);
+	ts.tv_sec = tv.tv_sec + (tv.tv_usec + timeout_usec) / 1000000;
+	ts.tv_nsec = ((tv.tv_usec + timeout_usec) % 1000000) * 1000;
+
+	pthread_mutex_lock(&sync_thread_lock);
+	if (pReader->binlog_buff.version == binlog_write_version)
+	{
+		pthread_cond_timedwait(&binlog_write_cond, \
+				&sync_thread_lock, &ts);
+	}
+	pthread_mutex_unlock(&sync_thread_lock);
 }
 
 int storage_binlog_read(StorageBinLogReader *pReader, \
 			StorageBinLogRecord *pRecord, int *record_length)
 {
-	char line[STORAGE_BINLOG_LINE_SIZE];
-	char *cols[3];
 	int result;
 
 	while (1)
 	{
-		result = storage_binlog_read_line(pReader, line, \
-				sizeof(line), record_length);
+		result = storage_binlog_read_record(pReader, pRecord, \
+				record_length);
 		if (result == 0)
 		{
 			break;
@@ -2278,8 +4931,9 @@ int storage_binlog_read(StorageBinLogReader *pReader, \
 		if (pReader->binlog_buff.length != 0)
 		{
 			logError("file: "__FILE__", line: %d, " \
-				"binlog file \"%s\" not ended by \\n, " \
-				"file offset: "INT64_PRINTF_FORMAT, __LINE__, \
+				"binlog file \"%s\" ended with an " \
+				"incomplete record, file offset: " \
+				INT64_PRINTF_FORMAT, __LINE__, \
 				get_binlog_readable_filename(pReader, NULL), \
 				pReader->binlog_offset);
 			return ENOENT;
@@ -2301,81 +4955,62 @@ int storage_binlog_read(StorageBinLogReader *pReader, \
 		}
 	}
 
-	if ((result=splitEx(line, ' ', cols, 3)) < 3)
-	{
-		logError("file: "__FILE__", line: %d, " \
-			"read data from binlog file \"%s\" fail, " \
-			"file offset: "INT64_PRINTF_FORMAT", " \
-			"read item count: %d < 3", \
-			__LINE__, get_binlog_readable_filename(pReader, NULL), \
-			pReader->binlog_offset, result);
-		return EINVAL;
-	}
+	/*
+	//printf("timestamp=%d, op_type=%c, filename=%s(%d), " \
+		"record length=%d, offset=%d\n", \
+		pRecord->timestamp, pRecord->op_type, \
+		pRecord->filename, strlen(pRecord->filename), \
+		*record_length, pReader->binlog_offset);
+	*/
 
-	pRecord->timestamp = atoi(cols[0]);
-	pRecord->op_type = *(cols[1]);
-	pRecord->filename_len = strlen(cols[2]) - 1; //need trim new line \n
-	if (pRecord->filename_len > sizeof(pRecord->filename) - 1)
-	{
-		logError("file: "__FILE__", line: %d, " \
-			"item \"filename\" in binlog " \
-			"file \"%s\" is invalid, file offset: " \
-			INT64_PRINTF_FORMAT", filename length: %d > %d", \
-			__LINE__, get_binlog_readable_filename(pReader, NULL), \
-			pReader->binlog_offset, \
-			pRecord->filename_len, (int)sizeof(pRecord->filename)-1);
-		return EINVAL;
-	}
+	return 0;
+}
 
-	memcpy(pRecord->filename, cols[2], pRecord->filename_len);
-	*(pRecord->filename + pRecord->filename_len) = '\0';
-	if (pRecord->op_type == STORAGE_OP_TYPE_SOURCE_CREATE_LINK || \
-	    pRecord->op_type == STORAGE_OP_TYPE_REPLICA_CREATE_LINK)
-	{
-		char *p;
+/* seek the reader to the position of the last index entry which
+   timestamp < until_timestamp, the records before the position are older
+   than until_timestamp, so only the records after it should be scanned */
+static int storage_binlog_ts_index_seek(StorageBinLogReader *pReader)
+{
+	StorageBinLogTsEntry entry;
+	bool bFound;
+	int low;
+	int high;
+	int mid;
 
-		p = strchr(pRecord->filename, ' ');
-		if (p == NULL)
+	bFound = false;
+	pthread_mutex_lock(&sync_thread_lock);
+	low = 0;
+	high = binlog_ts_entry_count - 1;
+	while (low <= high)
+	{
+		mid = (low + high) / 2;
+		if (binlog_ts_entries[mid].timestamp < pReader->until_timestamp)
 		{
-			*(pRecord->src_filename) = '\0';
-			pRecord->src_filename_len = 0;
+			entry = binlog_ts_entries[mid];
+			bFound = true;
+			low = mid + 1;
 		}
 		else
 		{
-			pRecord->src_filename_len = pRecord->filename_len - \
-						(p - pRecord->filename) - 1;
-			pRecord->filename_len = p - pRecord->filename;
-			*p = '\0';
-
-			memcpy(pRecord->src_filename, p + 1, \
-				pRecord->src_filename_len);
-			*(pRecord->src_filename + \
-				pRecord->src_filename_len) = '\0';
+			high = mid - 1;
 		}
 	}
-	else
-	{
-		*(pRecord->src_filename) = '\0';
-		pRecord->src_filename_len = 0;
-	}
+	pthread_mutex_unlock(&sync_thread_lock);
 
-	pRecord->true_filename_len = pRecord->filename_len;
-	if ((result=storage_split_filename_ex(pRecord->filename, \
-			&pRecord->true_filename_len, pRecord->true_filename, \
-			&pRecord->store_path_index)) != 0)
+	if (!bFound || entry.binlog_index < pReader->binlog_index || \
+		(entry.binlog_index == pReader->binlog_index && \
+		 entry.binlog_offset <= pReader->binlog_offset))
 	{
-		return result;
+		return 0;
 	}
 
-	/*
-	//printf("timestamp=%d, op_type=%c, filename=%s(%d), line length=%d, " \
-		"offset=%d\n", \
-		pRecord->timestamp, pRecord->op_type, \
-		pRecord->filename, strlen(pRecord->filename), \
-		*record_length, pReader->binlog_offset);
-	*/
-
-	return 0;
+	pReader->binlog_index = entry.binlog_index;
+	pReader->binlog_offset = entry.binlog_offset;
+	pReader->binlog_buff.current = pReader->binlog_buff.buffer;
+	pReader->binlog_buff.length = 0;
+	pReader->binlog_buff.version = 0;
+	return storage_open_readable_binlog(pReader, \
+			get_binlog_readable_filename, pReader);
 }
 
 static int storage_binlog_reader_skip(StorageBinLogReader *pReader)
@@ -2384,6 +5019,11 @@ static int storage_binlog_reader_skip(StorageBinLogReader *pReader)
 	int result;
 	int record_len;
 
+	if ((result=storage_binlog_ts_index_seek(pReader)) != 0)
+	{
+		return result;
+	}
+
 	while (1)
 	{
 		result = storage_binlog_read(pReader, \
@@ -2424,14 +5064,19 @@ int storage_unlink_mark_file(const char *storage_id)
 	char new_filename[MAX_PATH_SIZE];
 	time_t t;
 	struct tm tm;
+	int stream_index;
 
 	t = g_current_time;
 	localtime_r(&t, &tm);
 
-	get_mark_filename_by_id(storage_id, old_filename, sizeof(old_filename));
+	//the mark files of the streams are numbered continuously
+	for (stream_index=0; ; stream_index++)
+	{
+	get_mark_filename_by_id(storage_id, stream_index, \
+			old_filename, sizeof(old_filename));
 	if (!fileExists(old_filename))
 	{
-		return ENOENT;
+		return stream_index == 0 ? ENOENT : 0;
 	}
 
 	snprintf(new_filename, sizeof(new_filename), \
@@ -2447,6 +5092,7 @@ int storage_unlink_mark_file(const char *storage_id)
 			errno, STRERROR(errno));
 		return errno != 0 ? errno : EACCES;
 	}
+	}
 
 	return 0;
 }
@@ -2456,16 +5102,19 @@ int storage_rename_mark_file(const char *old_ip_addr, const int old_port, \
 {
 	char old_filename[MAX_PATH_SIZE];
 	char new_filename[MAX_PATH_SIZE];
+	int stream_index;
 
+	for (stream_index=0; ; stream_index++)
+	{
 	get_mark_filename_by_id_and_port(old_ip_addr, old_port, \
-			old_filename, sizeof(old_filename));
+			stream_index, old_filename, sizeof(old_filename));
 	if (!fileExists(old_filename))
 	{
-		return ENOENT;
+		return stream_index == 0 ? ENOENT : 0;
 	}
 
 	get_mark_filename_by_id_and_port(new_ip_addr, new_port, \
-			new_filename, sizeof(new_filename));
+			stream_index, new_filename, sizeof(new_filename));
 	if (fileExists(new_filename))
 	{
 		logWarning("file: "__FILE__", line: %d, " \
@@ -2484,6 +5133,7 @@ int storage_rename_mark_file(const char *old_ip_addr, const int old_port, \
 			errno, STRERROR(errno));
 		return errno != 0 ? errno : EACCES;
 	}
+	}
 
 	return 0;
 }
@@ -2521,6 +5171,169 @@ static void storage_sync_get_start_end_times(time_t current_time, \
 	*end_time = mktime(&tm_time);
 }
 
+/* the records of the same file are synced by the same stream in order,
+   the link file goes with its source file */
+static int storage_sync_get_stream_index(const StorageBinLogRecord *pRecord)
+{
+	if (g_sync_stream_count == 1)
+	{
+		return 0;
+	}
+
+	if (pRecord->src_filename_len > 0)
+	{
+		return (unsigned int)Time33Hash(pRecord->src_filename, \
+			pRecord->src_filename_len) % g_sync_stream_count;
+	}
+	else
+	{
+		return (unsigned int)Time33Hash(pRecord->filename, \
+			pRecord->filename_len) % g_sync_stream_count;
+	}
+}
+
+/* set the timestamp which the stream reached: the oldest record not
+   responsed or the record to send */
+static void storage_sync_stream_set_timestamp(StorageSyncStream *pStream, \
+		StorageBinLogReader *pReader, const time_t timestamp)
+{
+	StorageSyncWindow *pWindow;
+	StorageSyncRequest *pRequest;
+	int min_timestamp;
+	int i;
+
+	if (pStream->pPeer->stream_count == 1)
+	{
+		return;
+	}
+
+	min_timestamp = timestamp;
+	pWindow = pReader->window;
+	for (i=0; i<pWindow->count; i++)
+	{
+		pRequest = pWindow->requests + (pWindow->head + i) % \
+				pWindow->size;
+		if (pRequest->record.timestamp < min_timestamp)
+		{
+			min_timestamp = pRequest->record.timestamp;
+		}
+	}
+
+	pStream->pPeer->timestamps[pStream->index] = min_timestamp;
+}
+
+static bool storage_sync_stream_can_send(StorageSyncStream *pStream, \
+		const time_t timestamp)
+{
+	StorageSyncPeer *pPeer;
+	int stream_timestamp;
+	int i;
+
+	pPeer = pStream->pPeer;
+	for (i=0; i<pPeer->stream_count; i++)
+	{
+		stream_timestamp = pPeer->timestamps[i];
+		if (i != pStream->index && stream_timestamp >= 0 && \
+			stream_timestamp < timestamp)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/* the tracker server dispatches the download requests to the active dest
+   server by the timestamp of the last record synced to it, so a stream
+   can't sync the record newer than the records of the other streams
+   not synced yet when the dest server is active */
+static int storage_sync_stream_wait(StorageSyncStream *pStream, \
+		ConnectionInfo *pStorageServer, StorageBinLogReader *pReader, \
+		const StorageBinLogRecord *pRecord)
+{
+	FDFSStorageBrief *pStorage;
+	time_t last_keep_alive_time;
+	int result;
+
+	pStorage = pStream->pPeer->pStorage;
+	storage_sync_stream_set_timestamp(pStream, pReader, pRecord->timestamp);
+	if (pStream->pPeer->stream_count == 1 || \
+		pStorage->status != FDFS_STORAGE_STATUS_ACTIVE || \
+		storage_sync_stream_can_send(pStream, pRecord->timestamp))
+	{
+		return 0;
+	}
+
+	//the waiting stream should not block the others by its requests
+	if ((result=storage_sync_window_drain(pStorageServer, pReader)) != 0)
+	{
+		return result;
+	}
+	storage_sync_stream_set_timestamp(pStream, pReader, pRecord->timestamp);
+
+	last_keep_alive_time = g_current_time;
+	while (g_continue_flag && pStorage->status == \
+		FDFS_STORAGE_STATUS_ACTIVE && \
+		!storage_sync_stream_can_send(pStream, pRecord->timestamp))
+	{
+		if (g_current_time - last_keep_alive_time >= \
+			g_heart_beat_interval)
+		{
+			if ((result=fdfs_active_test(pStorageServer)) != 0)
+			{
+				return result;
+			}
+			last_keep_alive_time = g_current_time;
+		}
+
+		usleep(10 * 1000);
+	}
+
+	return 0;
+}
+
+/* set if the stream synced the old records,
+   return true when all the streams done */
+static bool storage_sync_stream_old_done(StorageSyncStream *pStream, \
+		const bool sync_old_done)
+{
+	StorageSyncPeer *pPeer;
+	bool all_done;
+	int i;
+
+	pPeer = pStream->pPeer;
+	pthread_mutex_lock(&sync_thread_lock);
+	pPeer->sync_old_dones[pStream->index] = sync_old_done;
+	all_done = true;
+	for (i=0; i<pPeer->stream_count; i++)
+	{
+		if (!pPeer->sync_old_dones[i])
+		{
+			all_done = false;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&sync_thread_lock);
+
+	return all_done;
+}
+
+/* return true for the last stream thread of the dest server */
+static bool storage_sync_stream_exit(StorageSyncStream *pStream)
+{
+	StorageSyncPeer *pPeer;
+	bool last;
+
+	pPeer = pStream->pPeer;
+	pthread_mutex_lock(&sync_thread_lock);
+	pPeer->thread_count--;
+	pPeer->timestamps[pStream->index] = -1;
+	last = pPeer->thread_count == 0;
+	pthread_mutex_unlock(&sync_thread_lock);
+
+	return last;
+}
+
 static void storage_sync_thread_exit(ConnectionInfo *pStorage)
 {
 	int result;
@@ -2567,9 +5380,11 @@ static void storage_sync_thread_exit(ConnectionInfo *pStorage)
 
 static void* storage_sync_thread_entrance(void* arg)
 {
+	StorageSyncStream *pStream;
 	FDFSStorageBrief *pStorage;
 	StorageBinLogReader reader;
 	StorageBinLogRecord record;
+	StorageSyncWindow window;
 	ConnectionInfo storage_server;
 	char local_ip_addr[IP_ADDRESS_SIZE];
 	int read_result;
@@ -2583,6 +5398,7 @@ static void* storage_sync_thread_entrance(void* arg)
 	time_t start_time;
 	time_t end_time;
 	time_t last_keep_alive_time;
+	bool all_old_done;
 	
 	memset(local_ip_addr, 0, sizeof(local_ip_addr));
 	memset(&reader, 0, sizeof(reader));
@@ -2594,15 +5410,25 @@ static void* storage_sync_thread_entrance(void* arg)
 	start_time = 0;
 	end_time = 0;
 
-	pStorage = (FDFSStorageBrief *)arg;
+	pStream = (StorageSyncStream *)arg;
+	pStorage = pStream->pPeer->pStorage;
 
 	strcpy(storage_server.ip_addr, pStorage->ip_addr);
 	storage_server.port = g_server_port;
 	storage_server.sock = -1;
 
 	logDebug("file: "__FILE__", line: %d, " \
-		"sync thread to storage server %s:%d started", \
-		__LINE__, storage_server.ip_addr, storage_server.port);
+		"sync thread to storage server %s:%d, stream: %d started", \
+		__LINE__, storage_server.ip_addr, storage_server.port, \
+		pStream->index);
+
+	if ((result=storage_sync_window_init(&window)) != 0)
+	{
+		logCrit("file: "__FILE__", line: %d, " \
+			"storage_sync_window_init fail, errno=%d, " \
+			"program exit!", __LINE__, result);
+		g_continue_flag = false;
+	}
 
 	while (g_continue_flag && \
 		pStorage->status != FDFS_STORAGE_STATUS_DELETED && \
@@ -2668,7 +5494,10 @@ static void* storage_sync_thread_entrance(void* arg)
 				socketBind(storage_server.sock, g_bind_addr, 0);
 			}
 
-			if (tcpsetnonblockopt(storage_server.sock) != 0)
+			//the small requests are sent without delay
+			if (tcpsetnonblockopt(storage_server.sock) != 0 || \
+				tcpsetnodelay(storage_server.sock, \
+					g_fdfs_network_timeout) != 0)
 			{
 				nContinuousFail++;
 				close(storage_server.sock);
@@ -2752,7 +5581,8 @@ static void* storage_sync_thread_entrance(void* arg)
 			continue;
 		}
 
-		if ((result=storage_reader_init(pStorage, &reader)) != 0)
+		if ((result=storage_reader_init_ex(pStorage, \
+				pStream->index, &reader)) != 0)
 		{
 			logCrit("file: "__FILE__", line: %d, " \
 				"storage_reader_init fail, errno=%d, " \
@@ -2761,6 +5591,9 @@ static void* storage_sync_thread_entrance(void* arg)
 			g_continue_flag = false;
 			break;
 		}
+		reader.window = &window;
+		all_old_done = storage_sync_stream_old_done(pStream, \
+			!reader.need_sync_old || reader.sync_old_done);
 
 		if (!reader.need_sync_old)
 		{
@@ -2820,7 +5653,8 @@ static void* storage_sync_thread_entrance(void* arg)
 
 		if (pStorage->status == FDFS_STORAGE_STATUS_SYNCING)
 		{
-			if (reader.need_sync_old && reader.sync_old_done)
+			if (reader.need_sync_old && reader.sync_old_done \
+				&& all_old_done)
 			{
 				pStorage->status = FDFS_STORAGE_STATUS_OFFLINE;
 				storage_report_storage_status(pStorage->id, \
@@ -2848,6 +5682,13 @@ static void* storage_sync_thread_entrance(void* arg)
 					&record, &record_len);
 			if (read_result == ENOENT)
 			{
+				if ((sync_result=storage_sync_window_drain( \
+					&storage_server, &reader)) != 0)
+				{
+					break;
+				}
+				pStream->pPeer->timestamps[pStream->index] = -1;
+
 				if (reader.need_sync_old && \
 					!reader.sync_old_done)
 				{
@@ -2862,7 +5703,8 @@ static void* storage_sync_thread_entrance(void* arg)
 					break;
 				}
 
-				if (pStorage->status == \
+				if (storage_sync_stream_old_done(pStream, \
+					true) && pStorage->status == \
 					FDFS_STORAGE_STATUS_SYNCING)
 				{
 					pStorage->status = \
@@ -2899,7 +5741,7 @@ static void* storage_sync_thread_entrance(void* arg)
 					last_keep_alive_time = current_time;
 				}
 
-				usleep(g_sync_wait_usec);
+				storage_binlog_wait(&reader, g_sync_wait_usec);
 				continue;
 			}
 
@@ -2925,7 +5767,16 @@ static void* storage_sync_thread_entrance(void* arg)
 				break;
 			}
 			}
-			else if ((sync_result=storage_sync_data(&reader, \
+			else if (storage_sync_get_stream_index(&record) != \
+				pStream->index)
+			{
+				//the record of the other stream
+				storage_sync_stream_set_timestamp(pStream, \
+					&reader, record.timestamp);
+			}
+			else if ((sync_result=storage_sync_stream_wait(pStream, \
+				&storage_server, &reader, &record)) != 0 || \
+				(sync_result=storage_sync_data(&reader, \
 				&storage_server, &record)) != 0)
 			{
 				logDebug("file: "__FILE__", line: %d, " \
@@ -2970,6 +5821,8 @@ static void* storage_sync_thread_entrance(void* arg)
 		close(storage_server.sock);
 		storage_server.sock = -1;
 		storage_reader_destroy(&reader);
+		window.head = 0;
+		window.count = 0;
 
 		if (!g_continue_flag)
 		{
@@ -2987,7 +5840,10 @@ static void* storage_sync_thread_entrance(void* arg)
 		close(storage_server.sock);
 	}
 	storage_reader_destroy(&reader);
+	storage_sync_window_destroy(&window);
 
+	if (storage_sync_stream_exit(pStream))
+	{
 	if (pStorage->status == FDFS_STORAGE_STATUS_DELETED
 	 || pStorage->status == FDFS_STORAGE_STATUS_IP_CHANGED)
 	{
@@ -2996,6 +5852,9 @@ static void* storage_sync_thread_entrance(void* arg)
 		pStorage->status = FDFS_STORAGE_STATUS_NONE;
 	}
 
+	free(pStream->pPeer);
+	}
+
 	storage_sync_thread_exit(&storage_server);
 
 	return NULL;
@@ -3004,8 +5863,12 @@ static void* storage_sync_thread_entrance(void* arg)
 int storage_sync_thread_start(const FDFSStorageBrief *pStorage)
 {
 	int result;
+	int bytes;
+	int stream_index;
 	pthread_attr_t pattr;
 	pthread_t tid;
+	StorageSyncPeer *pPeer;
+	StorageSyncStream *pStream;
 
 	if (pStorage->status == FDFS_STORAGE_STATUS_DELETED || \
 	    pStorage->status == FDFS_STORAGE_STATUS_IP_CHANGED || \
@@ -3027,8 +5890,35 @@ int storage_sync_thread_start(const FDFSStorageBrief *pStorage)
 		return 0;
 	}
 
+	if ((result=storage_init_stream_mark_files(pStorage)) != 0)
+	{
+		return result;
+	}
+
+	bytes = sizeof(StorageSyncPeer) + (sizeof(StorageSyncStream) + \
+		sizeof(int) + sizeof(bool)) * g_sync_stream_count;
+	pPeer = (StorageSyncPeer *)malloc(bytes);
+	if (pPeer == NULL)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"malloc %d bytes fail, " \
+			"errno: %d, error info: %s", \
+			__LINE__, bytes, errno, STRERROR(errno));
+		return errno != 0 ? errno : ENOMEM;
+	}
+	memset(pPeer, 0, bytes);
+
+	pStream = (StorageSyncStream *)(pPeer + 1);
+	pPeer->timestamps = (int *)(pStream + g_sync_stream_count);
+	pPeer->sync_old_dones = (bool *)(pPeer->timestamps + \
+					g_sync_stream_count);
+	pPeer->pStorage = (FDFSStorageBrief *)pStorage;
+	pPeer->stream_count = g_sync_stream_count;
+	pPeer->thread_count = g_sync_stream_count;
+
 	if ((result=init_pthread_attr(&pattr, g_thread_stack_size)) != 0)
 	{
+		free(pPeer);
 		return result;
 	}
 
@@ -3037,26 +5927,45 @@ int storage_sync_thread_start(const FDFSStorageBrief *pStorage)
 			pStorage->ip_addr, g_storage_sync_thread_count);
 	*/
 
+	for (stream_index=0; stream_index<g_sync_stream_count; stream_index++)
+	{
+	pStream->pPeer = pPeer;
+	pStream->index = stream_index;
+
+	if ((result=pthread_mutex_lock(&sync_thread_lock)) != 0)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"call pthread_mutex_lock fail, " \
+			"errno: %d, error info: %s", \
+			__LINE__, result, STRERROR(result));
+	}
+
 	if ((result=pthread_create(&tid, &pattr, storage_sync_thread_entrance, \
-		(void *)pStorage)) != 0)
+		(void *)pStream)) != 0)
 	{
 		logError("file: "__FILE__", line: %d, " \
 			"create thread failed, errno: %d, " \
 			"error info: %s", \
 			__LINE__, result, STRERROR(result));
 
+		//the streams not started do not block the others
+		while (stream_index < g_sync_stream_count)
+		{
+			pPeer->timestamps[stream_index] = -1;
+			pPeer->sync_old_dones[stream_index] = true;
+			pPeer->thread_count--;
+			stream_index++;
+		}
+		if (pPeer->thread_count == 0)
+		{
+			free(pPeer);
+		}
+
+		pthread_mutex_unlock(&sync_thread_lock);
 		pthread_attr_destroy(&pattr);
 		return result;
 	}
 
-	if ((result=pthread_mutex_lock(&sync_thread_lock)) != 0)
-	{
-		logError("file: "__FILE__", line: %d, " \
-			"call pthread_mutex_lock fail, " \
-			"errno: %d, error info: %s", \
-			__LINE__, result, STRERROR(result));
-	}
-
 	g_storage_sync_thread_count++;
 	sync_tids = (pthread_t *)realloc(sync_tids, sizeof(pthread_t) * \
 					g_storage_sync_thread_count);
@@ -3082,6 +5991,9 @@ int storage_sync_thread_start(const FDFSStorageBrief *pStorage)
 			__LINE__, result, STRERROR(result));
 	}
 
+	pStream++;
+	}
+
 	pthread_attr_destroy(&pattr);
 
 	return 0;
@@ -31,16 +31,73 @@
 #define STORAGE_BINLOG_BUFFER_SIZE		64 * 1024
 #define STORAGE_BINLOG_LINE_SIZE		256
 
+/* the binary record of the binlog (format version 1):
+     1 byte magic, 1 byte format version, 2 bytes record length,
+     4 bytes timestamp, 1 byte op type, 1 byte filename length,
+     1 byte extra length, 1 byte reserved, filename, extra,
+     4 bytes CRC32 of the bytes above
+   the extra is the src filename of the link, or the fields following
+   the filename (such as the offset and the length of the modify)
+   the magic is not a digit, so the text lines of the old version
+   (begin with the timestamp) can be read from the same binlog */
+#define STORAGE_BINLOG_RECORD_MAGIC		0xFA
+#define STORAGE_BINLOG_RECORD_VERSION		1
+#define STORAGE_BINLOG_RECORD_HEADER_SIZE	12
+#define STORAGE_BINLOG_FILENAME_MAX_LEN		127
+#define STORAGE_BINLOG_RECORD_MAX_SIZE	(STORAGE_BINLOG_RECORD_HEADER_SIZE \
+				+ 2 * STORAGE_BINLOG_FILENAME_MAX_LEN + 4)
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+typedef struct
+{
+	time_t timestamp;
+	char op_type;
+	char filename[128];  //filename with path index prefix which should be trimed
+	char true_filename[128]; //pure filename
+	char src_filename[128];  //src filename with path index prefix
+	int filename_len;
+	int true_filename_len;
+	int src_filename_len;
+	int store_path_index;
+} StorageBinLogRecord;
+
+/* the sync request sent to the dest server and not responsed yet,
+   the responses come back in the order of the requests */
+typedef struct
+{
+	int64_t seq;             //the sequence number of the request
+	char cmd;                //the sync command
+	char status;             //the status in the request header
+	int binlog_index;        //the binlog position of the record
+	int64_t binlog_offset;
+	int64_t scan_row_count;  //the scan row count before the record
+	int64_t send_bytes;      //the file content bytes sent
+	StorageBinLogRecord record;
+} StorageSyncRequest;
+
+typedef struct
+{
+	StorageSyncRequest *requests;  //the ring of the in-flight requests
+	int size;      //the ring size, the window size + 1 for resync
+	int head;      //the oldest in-flight request
+	int count;     //the in-flight request count
+	int64_t next_seq;
+
+	int binlog_index;        //the binlog position of the record to send
+	int64_t binlog_offset;
+	int64_t scan_row_count;
+} StorageSyncWindow;
+
 typedef struct
 {
 	char storage_id[FDFS_STORAGE_ID_MAX_SIZE];
 	bool need_sync_old;
 	bool sync_old_done;
 	bool last_file_exist;   //if the last file exist on the dest server
+	bool read_cache;        //if read the records in the binlog write cache
 	BinLogBuffer binlog_buff;
 	time_t until_timestamp;
 	int mark_fd;
@@ -52,20 +109,11 @@ typedef struct
 
 	int64_t last_scan_rows;  //for write to mark file
 	int64_t last_sync_rows;  //for write to mark file
-} StorageBinLogReader;
 
-typedef struct
-{
-	time_t timestamp;
-	char op_type;
-	char filename[128];  //filename with path index prefix which should be trimed
-	char true_filename[128]; //pure filename
-	char src_filename[128];  //src filename with path index prefix
-	int filename_len;
-	int true_filename_len;
-	int src_filename_len;
-	int store_path_index;
-} StorageBinLogRecord;
+	StorageSyncWindow *window;  //NULL when the records are not sent
+	int stream_index;  //the sync stream to the dest server, based 0
+	int stream_count;  //the sync stream count when the mark file written
+} StorageBinLogReader;
 
 extern int g_binlog_fd;
 extern int g_binlog_index;
@@ -81,9 +129,30 @@ int storage_sync_destroy();
 int storage_binlog_write_ex(const int timestamp, const char op_type, \
 		const char *filename, const char *extra);
 
+/* write the records of the files under one lock (group commit) */
+int storage_binlog_write_batch(const int timestamp, const char op_type, \
+		char **filenames, const int count);
+
 int storage_binlog_read(StorageBinLogReader *pReader, \
 			StorageBinLogRecord *pRecord, int *record_length);
 
+/* pack the binary record to buff, extra can be NULL,
+   return the record length, 0 for the filename too long */
+int storage_binlog_pack_record(const int timestamp, const char op_type, \
+		const char *filename, const char *extra, char *buff);
+
+/* unpack the binary record or the text line in buff,
+   return EAGAIN when the record is incomplete,
+   EINVAL for the bad record, record_length bytes should be skipped */
+int storage_binlog_unpack_record(const char *buff, const int length, \
+		StorageBinLogRecord *pRecord, int *record_length);
+
+/* the online compactor drops the records of the files which created and
+   deleted from the binlog files before the mark files every
+   binlog_compact_interval seconds */
+int storage_binlog_compactor_start();
+void storage_binlog_compactor_destroy();
+
 int storage_sync_thread_start(const FDFSStorageBrief *pStorage);
 int kill_storage_sync_threads();
 int fdfs_binlog_sync_func(void *args);
@@ -96,7 +165,11 @@ int storage_rename_mark_file(const char *old_ip_addr, const int old_port, \
 int storage_open_readable_binlog(StorageBinLogReader *pReader, \
 		get_filename_func filename_func, const void *pArg);
 
-int storage_reader_init(FDFSStorageBrief *pStorage, StorageBinLogReader *pReader);
+#define storage_reader_init(pStorage, pReader) \
+	storage_reader_init_ex(pStorage, 0, pReader)
+
+int storage_reader_init_ex(FDFSStorageBrief *pStorage, \
+		const int stream_index, StorageBinLogReader *pReader);
 void storage_reader_destroy(StorageBinLogReader *pReader);
 
 int storage_report_storage_status(const char *storage_id, \
@@ -34,9 +34,12 @@
 #include "tracker_client.h"
 #include "trunk_mem.h"
 #include "trunk_sync.h"
+#include "trunk_client.h"
 #include "storage_param_getter.h"
+#include "storage_stat.h"
 
 #define TRUNK_FILE_CREATOR_TASK_ID   88
+#define TRUNK_FILE_RUNWAY_TASK_ID    89
 
 static pthread_mutex_t reporter_thread_lock;
 
@@ -45,6 +48,10 @@ static pthread_t *report_tids = NULL;
 static int *src_storage_status = NULL; //returned by tracker server
 static signed char *my_report_status = NULL;  //returned by tracker server
 
+/* the stat buff size of the heart beat, the tracker server before V5.03
+   only accepts FDFS_STORAGE_STAT_BUFF_V502_SIZE, set by the join */
+static int *tracker_stat_buff_sizes = NULL;
+
 static int tracker_heart_beat(ConnectionInfo *pTrackerServer, \
 		int *pstat_chg_sync_count, bool *bServerPortChanged);
 static int tracker_report_df_stat(ConnectionInfo *pTrackerServer, \
@@ -1192,6 +1199,7 @@ static int tracker_check_response(ConnectionInfo *pTrackerServer, \
 			{
 				return result;
 			}
+			trunk_client_lease_recovery();
 
 			if (g_trunk_create_file_advance && \
 				g_trunk_create_file_interval > 0)
@@ -1210,6 +1218,23 @@ static int tracker_check_response(ConnectionInfo *pTrackerServer, \
 			sched_add_entries(&scheduleArray);
 			}
 
+			if (g_trunk_create_file_runway > 0)
+			{
+			ScheduleArray scheduleArray;
+			ScheduleEntry entries[1];
+
+			entries[0].id = TRUNK_FILE_RUNWAY_TASK_ID;
+			entries[0].time_base.hour = TIME_NONE;
+			entries[0].time_base.minute = TIME_NONE;
+			entries[0].interval = TRUNK_RUNWAY_SAMPLE_INTERVAL;
+			entries[0].task_func = trunk_create_file_by_runway;
+			entries[0].func_args = NULL;
+
+			scheduleArray.count = 1;
+			scheduleArray.entries = entries;
+			sched_add_entries(&scheduleArray);
+			}
+
 			trunk_sync_thread_start_all();
 			}
 		}
@@ -1261,7 +1286,14 @@ static int tracker_check_response(ConnectionInfo *pTrackerServer, \
 				{
 				sched_del_entry(TRUNK_FILE_CREATOR_TASK_ID);
 				}
+
+				if (g_trunk_create_file_runway > 0)
+				{
+				sched_del_entry(TRUNK_FILE_RUNWAY_TASK_ID);
+				}
 			}
+
+			trunk_client_lease_recovery();
 		}
 		}
 
@@ -1813,6 +1845,7 @@ int tracker_report_join(ConnectionInfo *pTrackerServer, \
 		return result;
 	}
 
+	memset(&respBody, 0, sizeof(respBody));
         pInBuff = (char *)&respBody;
 	result = fdfs_recv_response(pTrackerServer, \
 			&pInBuff, sizeof(respBody), &in_bytes);
@@ -1822,7 +1855,18 @@ int tracker_report_join(ConnectionInfo *pTrackerServer, \
 		return result;
 	}
 
-	if (in_bytes != sizeof(respBody))
+	//the tracker server of V5.03 or later responds its version
+	if (in_bytes == sizeof(respBody))
+	{
+		tracker_stat_buff_sizes[tracker_index] = \
+				sizeof(FDFSStorageStatBuff);
+	}
+	else if (in_bytes == TRACKER_STORAGE_JOIN_RESP_V502_SIZE)
+	{
+		tracker_stat_buff_sizes[tracker_index] = \
+				FDFS_STORAGE_STAT_BUFF_V502_SIZE;
+	}
+	else
 	{
 		logError("file: "__FILE__", line: %d, " \
 			"tracker server %s:%d, recv data fail, " \
@@ -2012,11 +2056,14 @@ static int tracker_heart_beat(ConnectionInfo *pTrackerServer, \
 	FDFSStorageStatBuff *pStatBuff;
 	int body_len;
 	int result;
+	int stat_change_count;
 
 	memset(out_buff, 0, sizeof(out_buff));
 	pHeader = (TrackerHeader *)out_buff;
-	if (*pstat_chg_sync_count != g_stat_change_count)
+	stat_change_count = g_stat_change_count + storage_stat_change_count();
+	if (*pstat_chg_sync_count != stat_change_count)
 	{
+		storage_stat_merge(&g_storage_stat);
 		pStatBuff = (FDFSStorageStatBuff *)( \
 				out_buff + sizeof(TrackerHeader));
 		long2buff(g_storage_stat.total_upload_count, \
@@ -2095,13 +2142,22 @@ static int tracker_heart_beat(ConnectionInfo *pTrackerServer, \
 			pStatBuff->sz_total_file_write_count);
 		long2buff(g_storage_stat.success_file_write_count, \
 			pStatBuff->sz_success_file_write_count);
+		long2buff(g_storage_stat.total_cache_get_count, \
+			pStatBuff->sz_total_cache_get_count);
+		long2buff(g_storage_stat.success_cache_get_count, \
+			pStatBuff->sz_success_cache_get_count);
+		long2buff(g_storage_stat.success_cache_get_bytes, \
+			pStatBuff->sz_success_cache_get_bytes);
 		long2buff(g_storage_stat.last_source_update, \
 			pStatBuff->sz_last_source_update);
 		long2buff(g_storage_stat.last_sync_update, \
 			pStatBuff->sz_last_sync_update);
 
-		*pstat_chg_sync_count = g_stat_change_count;
-		body_len = sizeof(FDFSStorageStatBuff);
+		*pstat_chg_sync_count = stat_change_count;
+
+		//the cache counters at the end are not sent to the old one
+		body_len = tracker_stat_buff_sizes[pTrackerServer - \
+				g_tracker_group.servers];
 	}
 	else
 	{
@@ -2280,6 +2336,7 @@ int tracker_report_thread_start()
 	pthread_attr_t pattr;
 	pthread_t tid;
 	int result;
+	int i;
 
 	if ((result=init_pthread_attr(&pattr, g_thread_stack_size)) != 0)
 	{
@@ -2325,6 +2382,22 @@ int tracker_report_thread_start()
 		return errno != 0 ? errno : ENOMEM;
 	}
 	memset(my_report_status, -1, sizeof(char)*g_tracker_group.server_count);
+
+	tracker_stat_buff_sizes = (int *)malloc(sizeof(int) * \
+					g_tracker_group.server_count);
+	if (tracker_stat_buff_sizes == NULL)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"malloc %d bytes fail, " \
+			"errno: %d, error info: %s", __LINE__, \
+			(int)sizeof(int) * g_tracker_group.server_count, \
+			errno, STRERROR(errno));
+		return errno != 0 ? errno : ENOMEM;
+	}
+	for (i=0; i<g_tracker_group.server_count; i++)
+	{
+		tracker_stat_buff_sizes[i] = FDFS_STORAGE_STAT_BUFF_V502_SIZE;
+	}
 	
 	g_tracker_reporter_count = 0;
 	pServerEnd = g_tracker_group.servers + g_tracker_group.server_count;
@@ -19,15 +19,45 @@
 #include <string.h>
 #include <errno.h>
 #include <time.h>
+#include <pthread.h>
 #include "fdfs_define.h"
 #include "logger.h"
 #include "fdfs_global.h"
 #include "sockopt.h"
 #include "shared_func.h"
+#include "sched_thread.h"
+#include "pthread_func.h"
 #include "tracker_proto.h"
 #include "storage_global.h"
+#include "storage_nio.h"
+#include "storage_service.h"
 #include "trunk_client.h"
 
+#define TRUNK_CLIENT_PKG_MAX_SIZE  (sizeof(TrackerHeader) + \
+		STORAGE_TRUNK_RETURN_LEASE_REQ_BODY_LEN)
+
+#define TRUNK_CLIENT_IS_ALLOC_CMD(cmd) \
+	((cmd) == STORAGE_PROTO_CMD_TRUNK_ALLOC_SPACE || \
+	 (cmd) == STORAGE_PROTO_CMD_TRUNK_ALLOC_LEASE)
+
+#define TRUNK_LEASE_FILENAME  "trunk_lease.dat"
+
+/* the lease file is rewritten when the used space passes the saved offset,
+   at most one step of the lease is lost when the storage crashes */
+#define TRUNK_LEASE_SAVE_STEP  (g_trunk_lease_size / 16)
+
+static pthread_mutex_t lease_file_lock;
+static pthread_mutex_t lease_recovery_lock;
+
+/* the leases loaded from the lease file to return */
+static FDFSTrunkLeaseInfo *recovery_leases = NULL;
+static int recovery_lease_count = 0;
+
+static void trunk_client_conn_sock_io(int sock, short event, void *arg);
+static void trunk_client_lease_timeout(int sock, short event, void *arg);
+static void trunk_client_lease_done(TrunkClientLease *pLease, \
+		const int result);
+
 static int trunk_client_trunk_do_alloc_space(ConnectionInfo *pTrunkServer, \
 		const int file_size, FDFSTrunkFullInfo *pTrunkInfo)
 {
@@ -128,22 +158,27 @@ int trunk_client_trunk_alloc_space(const int file_size, \
 
 #define trunk_client_trunk_do_alloc_confirm(pTrunkServer, pTrunkInfo, status) \
 	trunk_client_trunk_confirm_or_free(pTrunkServer, pTrunkInfo, \
-		STORAGE_PROTO_CMD_TRUNK_ALLOC_CONFIRM, status)
+		STORAGE_PROTO_CMD_TRUNK_ALLOC_CONFIRM, status, 0)
 
 #define trunk_client_trunk_do_free_space(pTrunkServer, pTrunkInfo) \
 	trunk_client_trunk_confirm_or_free(pTrunkServer, pTrunkInfo, \
-		STORAGE_PROTO_CMD_TRUNK_FREE_SPACE, 0)
+		STORAGE_PROTO_CMD_TRUNK_FREE_SPACE, 0, 0)
+
+#define trunk_client_trunk_do_return_lease(pTrunkServer, pLease) \
+	trunk_client_trunk_confirm_or_free(pTrunkServer, &((pLease)->trunk), \
+		STORAGE_PROTO_CMD_TRUNK_RETURN_LEASE, 0, (pLease)->lease_id)
 
 static int trunk_client_trunk_confirm_or_free(ConnectionInfo *pTrunkServer,\
 		const FDFSTrunkFullInfo *pTrunkInfo, const int cmd, \
-		const int status)
+		const int status, const int64_t lease_id)
 {
 	TrackerHeader *pHeader;
 	FDFSTrunkInfoBuff *pTrunkBuff;
 	int64_t in_bytes;
+	int body_len;
 	int result;
 	char out_buff[sizeof(TrackerHeader) \
-		+ STORAGE_TRUNK_ALLOC_CONFIRM_REQ_BODY_LEN];
+		+ STORAGE_TRUNK_RETURN_LEASE_REQ_BODY_LEN];
 
 	pHeader = (TrackerHeader *)out_buff;
 	pTrunkBuff = (FDFSTrunkInfoBuff *)(out_buff + sizeof(TrackerHeader) \
@@ -151,7 +186,16 @@ static int trunk_client_trunk_confirm_or_free(ConnectionInfo *pTrunkServer,\
 	memset(out_buff, 0, sizeof(out_buff));
 	snprintf(out_buff + sizeof(TrackerHeader), sizeof(out_buff) - \
 		sizeof(TrackerHeader),  "%s", g_group_name);
-	long2buff(STORAGE_TRUNK_ALLOC_CONFIRM_REQ_BODY_LEN, pHeader->pkg_len);
+	if (cmd == STORAGE_PROTO_CMD_TRUNK_RETURN_LEASE)
+	{
+		body_len = STORAGE_TRUNK_RETURN_LEASE_REQ_BODY_LEN;
+		long2buff(lease_id, (char *)(pTrunkBuff + 1));
+	}
+	else
+	{
+		body_len = STORAGE_TRUNK_ALLOC_CONFIRM_REQ_BODY_LEN;
+	}
+	long2buff(body_len, pHeader->pkg_len);
 	pHeader->cmd = cmd;
 	pHeader->status = status;
 
@@ -163,7 +207,8 @@ static int trunk_client_trunk_confirm_or_free(ConnectionInfo *pTrunkServer,\
 	int2buff(pTrunkInfo->file.size, pTrunkBuff->size);
 
 	if ((result=tcpsenddata_nb(pTrunkServer->sock, out_buff, \
-			sizeof(out_buff), g_fdfs_network_timeout)) != 0)
+			sizeof(TrackerHeader) + body_len, \
+			g_fdfs_network_timeout)) != 0)
 	{
 		logError("file: "__FILE__", line: %d, " \
 			"send data to storage server %s:%d fail, " \
@@ -199,6 +244,16 @@ int trunk_client_trunk_alloc_confirm(const FDFSTrunkFullInfo *pTrunkInfo, \
 	ConnectionInfo trunk_server;
 	ConnectionInfo *pTrunkServer;
 
+	if (pTrunkInfo->status == FDFS_TRUNK_STATUS_LEASED)
+	{
+		if (status == 0 || status == EEXIST)
+		{
+			return 0;
+		}
+
+		return trunk_client_trunk_free_space(pTrunkInfo);
+	}
+
 	if (g_if_trunker_self)
 	{
 		return trunk_alloc_confirm(pTrunkInfo, status);
@@ -257,3 +312,1291 @@ int trunk_client_trunk_free_space(const FDFSTrunkFullInfo *pTrunkInfo)
 	return result;
 }
 
+/* return ENOENT when the lease is returned or dropped already */
+static int trunk_client_trunk_return_lease(const FDFSTrunkLeaseInfo *pLease)
+{
+	int result;
+	ConnectionInfo trunk_server;
+	ConnectionInfo *pTrunkServer;
+
+	if (g_if_trunker_self)
+	{
+		return trunk_return_lease(&(pLease->trunk), pLease->lease_id);
+	}
+
+	if (*(g_trunk_server.ip_addr) == '\0')
+	{
+		return EAGAIN;
+	}
+
+	memcpy(&trunk_server, &g_trunk_server, sizeof(ConnectionInfo));
+	if ((pTrunkServer=tracker_connect_server(&trunk_server, &result)) == NULL)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"return trunk lease fail because connect to trunk " \
+			"server %s:%d fail, errno: %d", __LINE__, \
+			trunk_server.ip_addr, trunk_server.port, result);
+		return result;
+	}
+
+	result = trunk_client_trunk_do_return_lease(pTrunkServer, pLease);
+	tracker_disconnect_server_ex(pTrunkServer, result != 0 && \
+			result != ENOENT);
+	return result;
+}
+
+
+int trunk_client_conn_init(TrunkClientConnection *pConn, \
+		struct nio_thread_data *thread_data)
+{
+	TrunkClientLease *pLease;
+	int bytes;
+	int i;
+
+	memset(pConn, 0, sizeof(TrunkClientConnection));
+	pConn->event.fd = -1;
+	pConn->event.callback = trunk_client_conn_sock_io;
+	pConn->event.timer.data = pConn;
+	pConn->thread_data = thread_data;
+
+	if (g_trunk_lease_size <= 0)
+	{
+		return 0;
+	}
+
+	bytes = sizeof(TrunkClientLease) * g_fdfs_store_paths.count;
+	pConn->leases = (TrunkClientLease *)malloc(bytes);
+	if (pConn->leases == NULL)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"malloc %d bytes fail, errno: %d, error info: %s", \
+			__LINE__, bytes, errno, STRERROR(errno));
+		return errno != 0 ? errno : ENOMEM;
+	}
+
+	memset(pConn->leases, 0, bytes);
+	for (i=0; i<g_fdfs_store_paths.count; i++)
+	{
+		pLease = pConn->leases + i;
+		pLease->event.fd = -1;
+		pLease->event.callback = trunk_client_lease_timeout;
+		pLease->event.timer.data = pLease;
+		pLease->pConn = pConn;
+		pLease->trunk.path.store_path_index = i;
+		pLease->saved.trunk.path.store_path_index = i;
+		pLease->request.trunk_info.path.store_path_index = i;
+	}
+
+	return 0;
+}
+
+static void trunk_client_request_done(TrunkClientConnection *pConn, \
+		TrunkClientRequest *pRequest, const int result)
+{
+	char buff[256];
+
+	if (pRequest->cmd == STORAGE_PROTO_CMD_TRUNK_ALLOC_LEASE)
+	{
+		trunk_client_lease_done(pConn->leases + pRequest-> \
+			trunk_info.path.store_path_index, result);
+		return;
+	}
+
+	if (pRequest->pTask == NULL)  //free space or return lease
+	{
+		if (pRequest->cmd == STORAGE_PROTO_CMD_TRUNK_RETURN_LEASE)
+		{
+			if (result != 0 && result != ENOENT)
+			{
+			logError("file: "__FILE__", line: %d, " \
+				"return trunk lease "INT64_PRINTF_FORMAT \
+				" fail, trunk info: %s, errno: %d, " \
+				"error info: %s", __LINE__, pRequest->lease_id, \
+				trunk_info_dump(&(pRequest->trunk_info), \
+				buff, sizeof(buff)), result, STRERROR(result));
+			}
+		}
+		else if (result != 0)
+		{
+			logError("file: "__FILE__", line: %d, " \
+				"free trunk space fail, trunk info: %s, " \
+				"errno: %d, error info: %s", __LINE__, \
+				trunk_info_dump(&(pRequest->trunk_info), \
+				buff, sizeof(buff)), result, STRERROR(result));
+		}
+		free(pRequest);
+		return;
+	}
+
+	((StorageClientInfo *)pRequest->pTask->arg)->stage &= \
+				~FDFS_STORAGE_STAGE_TRUNK_WAIT;
+	pRequest->result = result;
+	pRequest->done_callback(pRequest->pTask, result);
+}
+
+static void trunk_client_conn_close(TrunkClientConnection *pConn, \
+		const int err_no)
+{
+	TrunkClientRequest *pRequest;
+	TrunkClientRequest *pNext;
+
+	if (pConn->event.fd >= 0)
+	{
+		ioevent_detach(&pConn->thread_data->ev_puller, pConn->event.fd);
+		close(pConn->event.fd);
+		pConn->event.fd = -1;
+	}
+
+	if (pConn->event.timer.expires > 0)
+	{
+		fast_timer_remove(&pConn->thread_data->timer, \
+				&pConn->event.timer);
+		pConn->event.timer.expires = 0;
+	}
+
+	pRequest = pConn->head;
+	pConn->head = NULL;
+	pConn->tail = NULL;
+	pConn->sending = NULL;
+	pConn->connected = false;
+	pConn->events = 0;
+	pConn->send_offset = 0;
+	pConn->send_length = 0;
+	pConn->recv_offset = 0;
+	pConn->recv_length = 0;
+
+	/* the callbacks may push new requests */
+	while (pRequest != NULL)
+	{
+		pNext = pRequest->next;
+		trunk_client_request_done(pConn, pRequest, err_no);
+		pRequest = pNext;
+	}
+}
+
+static int trunk_client_conn_connect(TrunkClientConnection *pConn)
+{
+	struct sockaddr_in addr;
+	int sock;
+	int result;
+
+	memcpy(&pConn->server, &g_trunk_server, sizeof(ConnectionInfo));
+	pConn->server.sock = -1;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(pConn->server.port);
+	if (inet_aton(pConn->server.ip_addr, &addr.sin_addr) == 0)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"invalid trunk server ip: %s", \
+			__LINE__, pConn->server.ip_addr);
+		return EINVAL;
+	}
+
+	sock = socket(AF_INET, SOCK_STREAM, 0);
+	if (sock < 0)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"socket create failed, errno: %d, " \
+			"error info: %s", __LINE__, errno, STRERROR(errno));
+		return errno != 0 ? errno : EPERM;
+	}
+
+	if ((result=tcpsetnonblockopt(sock)) != 0 || \
+		(result=tcpsetnodelay(sock, g_fdfs_network_timeout)) != 0)
+	{
+		close(sock);
+		return result;
+	}
+
+	pConn->connected = true;
+	if (connect(sock, (const struct sockaddr*)&addr, sizeof(addr)) < 0)
+	{
+		if (errno != EINPROGRESS)
+		{
+			result = errno != 0 ? errno : ECONNREFUSED;
+			logError("file: "__FILE__", line: %d, " \
+				"connect to trunk server %s:%d fail, " \
+				"errno: %d, error info: %s", __LINE__, \
+				pConn->server.ip_addr, pConn->server.port, \
+				result, STRERROR(result));
+			close(sock);
+			return result;
+		}
+
+		pConn->connected = false;  //wait for writable
+	}
+
+	pConn->events = IOEVENT_READ | IOEVENT_WRITE;
+	if (ioevent_attach(&pConn->thread_data->ev_puller, sock, \
+		pConn->events, pConn) != 0)
+	{
+		result = errno != 0 ? errno : ENOMEM;
+		logError("file: "__FILE__", line: %d, " \
+			"ioevent_attach fail, " \
+			"errno: %d, error info: %s", \
+			__LINE__, result, STRERROR(result));
+		close(sock);
+		return result;
+	}
+
+	pConn->event.fd = sock;
+	return 0;
+}
+
+static int trunk_client_conn_set_events(TrunkClientConnection *pConn, \
+		const short events)
+{
+	int result;
+
+	if (pConn->events == events)
+	{
+		return 0;
+	}
+
+	if (ioevent_modify(&pConn->thread_data->ev_puller, \
+		pConn->event.fd, events, pConn) != 0)
+	{
+		result = errno != 0 ? errno : ENOENT;
+		logError("file: "__FILE__", line: %d, " \
+			"ioevent_modify fail, " \
+			"errno: %d, error info: %s", \
+			__LINE__, result, STRERROR(result));
+		return result;
+	}
+
+	pConn->events = events;
+	return 0;
+}
+
+static int trunk_client_pack_request(TrunkClientRequest *pRequest, \
+		char *buff)
+{
+	TrackerHeader *pHeader;
+	FDFSTrunkInfoBuff *pTrunkBuff;
+	char *p;
+
+	pHeader = (TrackerHeader *)buff;
+	memset(buff, 0, TRUNK_CLIENT_PKG_MAX_SIZE);
+	p = buff + sizeof(TrackerHeader);
+	memcpy(p, g_group_name, strlen(g_group_name));
+	p += FDFS_GROUP_NAME_MAX_LEN;
+	if (TRUNK_CLIENT_IS_ALLOC_CMD(pRequest->cmd))
+	{
+		int2buff(pRequest->file_size, p);
+		p += 4;
+		*p++ = pRequest->pTrunkInfo->path.store_path_index;
+	}
+	else
+	{
+		pTrunkBuff = (FDFSTrunkInfoBuff *)p;
+		pTrunkBuff->store_path_index = \
+			pRequest->trunk_info.path.store_path_index;
+		pTrunkBuff->sub_path_high = \
+			pRequest->trunk_info.path.sub_path_high;
+		pTrunkBuff->sub_path_low = pRequest->trunk_info.path.sub_path_low;
+		int2buff(pRequest->trunk_info.file.id, pTrunkBuff->id);
+		int2buff(pRequest->trunk_info.file.offset, pTrunkBuff->offset);
+		int2buff(pRequest->trunk_info.file.size, pTrunkBuff->size);
+		p += sizeof(FDFSTrunkInfoBuff);
+		pHeader->status = pRequest->status;
+		if (pRequest->cmd == STORAGE_PROTO_CMD_TRUNK_RETURN_LEASE)
+		{
+			long2buff(pRequest->lease_id, p);
+			p += FDFS_PROTO_PKG_LEN_SIZE;
+		}
+	}
+
+	pHeader->cmd = pRequest->cmd;
+	long2buff((p - buff) - sizeof(TrackerHeader), pHeader->pkg_len);
+	return p - buff;
+}
+
+static int trunk_client_conn_send(TrunkClientConnection *pConn)
+{
+	int bytes;
+	int result;
+
+	while (1)
+	{
+		if (pConn->send_offset == pConn->send_length)
+		{
+			/* pack the pending requests to send by one call */
+			pConn->send_offset = 0;
+			pConn->send_length = 0;
+			while (pConn->sending != NULL && pConn->send_length + \
+				TRUNK_CLIENT_PKG_MAX_SIZE <= sizeof(pConn->send_buff))
+			{
+				pConn->send_length += trunk_client_pack_request( \
+					pConn->sending, pConn->send_buff + \
+					pConn->send_length);
+				pConn->sending = pConn->sending->next;
+			}
+
+			if (pConn->send_length == 0)
+			{
+				return trunk_client_conn_set_events(pConn, \
+						IOEVENT_READ);
+			}
+		}
+
+		bytes = send(pConn->event.fd, pConn->send_buff + \
+			pConn->send_offset, pConn->send_length - \
+			pConn->send_offset, 0);
+		if (bytes < 0)
+		{
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+			{
+				return trunk_client_conn_set_events(pConn, \
+						IOEVENT_READ | IOEVENT_WRITE);
+			}
+			else if (errno == EINTR)
+			{
+				continue;
+			}
+
+			result = errno != 0 ? errno : EIO;
+			logError("file: "__FILE__", line: %d, " \
+				"send data to trunk server %s:%d fail, " \
+				"errno: %d, error info: %s", __LINE__, \
+				pConn->server.ip_addr, pConn->server.port, \
+				result, STRERROR(result));
+			return result;
+		}
+
+		pConn->send_offset += bytes;
+	}
+}
+
+static int trunk_client_conn_recv(TrunkClientConnection *pConn)
+{
+	TrackerHeader *pHeader;
+	FDFSTrunkInfoBuff *pTrunkBuff;
+	TrunkClientRequest *pRequest;
+	FDFSTrunkFullInfo *pTrunkInfo;
+	int64_t body_len;
+	int expect_len;
+	int bytes;
+	int result;
+
+	pHeader = (TrackerHeader *)pConn->recv_buff;
+	while (1)
+	{
+		if (pConn->recv_length == 0)
+		{
+			pConn->recv_length = sizeof(TrackerHeader);
+		}
+
+		bytes = recv(pConn->event.fd, pConn->recv_buff + \
+			pConn->recv_offset, pConn->recv_length - \
+			pConn->recv_offset, 0);
+		if (bytes < 0)
+		{
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+			{
+				return 0;
+			}
+			else if (errno == EINTR)
+			{
+				continue;
+			}
+
+			result = errno != 0 ? errno : EIO;
+			logError("file: "__FILE__", line: %d, " \
+				"recv from trunk server %s:%d fail, " \
+				"errno: %d, error info: %s", __LINE__, \
+				pConn->server.ip_addr, pConn->server.port, \
+				result, STRERROR(result));
+			return result;
+		}
+		else if (bytes == 0)
+		{
+			logDebug("file: "__FILE__", line: %d, " \
+				"trunk server %s:%d closed the connection", \
+				__LINE__, pConn->server.ip_addr, \
+				pConn->server.port);
+			return ECONNRESET;
+		}
+
+		pConn->recv_offset += bytes;
+		if (pConn->recv_offset < pConn->recv_length)
+		{
+			continue;
+		}
+
+		pRequest = pConn->head;
+		if (pRequest == NULL || pRequest == pConn->sending)
+		{
+			logError("file: "__FILE__", line: %d, " \
+				"trunk server %s:%d, unexpected response", \
+				__LINE__, pConn->server.ip_addr, \
+				pConn->server.port);
+			return EINVAL;
+		}
+
+		if (pConn->recv_length == sizeof(TrackerHeader))
+		{
+			body_len = buff2long(pHeader->pkg_len);
+			if (pRequest->cmd == STORAGE_PROTO_CMD_TRUNK_ALLOC_LEASE \
+				&& pHeader->status == 0)
+			{
+				expect_len = STORAGE_TRUNK_ALLOC_LEASE_RESP_BODY_LEN;
+			}
+			else if (TRUNK_CLIENT_IS_ALLOC_CMD(pRequest->cmd) && \
+				pHeader->status == 0)
+			{
+				expect_len = sizeof(FDFSTrunkInfoBuff);
+			}
+			else
+			{
+				expect_len = 0;
+			}
+
+			if (body_len != expect_len)
+			{
+				logError("file: "__FILE__", line: %d, " \
+					"trunk server %s:%d, recv body length: " \
+					INT64_PRINTF_FORMAT" invalid, " \
+					"expect body length: %d", __LINE__, \
+					pConn->server.ip_addr, \
+					pConn->server.port, \
+					body_len, expect_len);
+				return EINVAL;
+			}
+
+			if (expect_len > 0)
+			{
+				pConn->recv_length += expect_len;
+				continue;
+			}
+		}
+
+		pConn->head = pRequest->next;
+		if (pConn->head == NULL)
+		{
+			pConn->tail = NULL;
+			fast_timer_remove(&pConn->thread_data->timer, \
+					&pConn->event.timer);
+			pConn->event.timer.expires = 0;
+		}
+		else
+		{
+			fast_timer_modify(&pConn->thread_data->timer, \
+				&pConn->event.timer, g_current_time + \
+				g_fdfs_network_timeout);
+		}
+
+		result = pHeader->status;
+		if (result == 0 && TRUNK_CLIENT_IS_ALLOC_CMD(pRequest->cmd))
+		{
+			pTrunkBuff = (FDFSTrunkInfoBuff *)(pConn->recv_buff + \
+					sizeof(TrackerHeader));
+			pTrunkInfo = pRequest->pTrunkInfo;
+			pTrunkInfo->path.store_path_index = \
+					pTrunkBuff->store_path_index;
+			pTrunkInfo->path.sub_path_high = pTrunkBuff->sub_path_high;
+			pTrunkInfo->path.sub_path_low = pTrunkBuff->sub_path_low;
+			pTrunkInfo->file.id = buff2int(pTrunkBuff->id);
+			pTrunkInfo->file.offset = buff2int(pTrunkBuff->offset);
+			pTrunkInfo->file.size = buff2int(pTrunkBuff->size);
+			pTrunkInfo->status = FDFS_TRUNK_STATUS_HOLD;
+			if (pRequest->cmd == STORAGE_PROTO_CMD_TRUNK_ALLOC_LEASE)
+			{
+				pRequest->lease_id = buff2long( \
+						(char *)(pTrunkBuff + 1));
+			}
+		}
+
+		pConn->recv_offset = 0;
+		pConn->recv_length = 0;
+		trunk_client_request_done(pConn, pRequest, result);
+	}
+}
+
+static void trunk_client_conn_sock_io(int sock, short event, void *arg)
+{
+	TrunkClientConnection *pConn;
+	socklen_t len;
+	int result;
+
+	pConn = (TrunkClientConnection *)arg;
+	if (event & IOEVENT_TIMEOUT)
+	{
+		pConn->event.timer.expires = 0;  //removed from the timer
+		logError("file: "__FILE__", line: %d, " \
+			"trunk server %s:%d response timeout", \
+			__LINE__, pConn->server.ip_addr, pConn->server.port);
+		trunk_client_conn_close(pConn, ETIMEDOUT);
+		return;
+	}
+
+	if ((event & IOEVENT_ERROR) || !pConn->connected)
+	{
+		result = 0;
+		len = sizeof(result);
+		if (getsockopt(sock, SOL_SOCKET, SO_ERROR, &result, &len) < 0)
+		{
+			result = errno != 0 ? errno : EIO;
+		}
+		else if (result == 0 && (event & IOEVENT_ERROR))
+		{
+			result = ECONNRESET;
+		}
+
+		if (result != 0)
+		{
+			logError("file: "__FILE__", line: %d, " \
+				"%s trunk server %s:%d fail, " \
+				"errno: %d, error info: %s", __LINE__, \
+				pConn->connected ? "connection to" : \
+				"connect to", pConn->server.ip_addr, \
+				pConn->server.port, result, STRERROR(result));
+			trunk_client_conn_close(pConn, result);
+			return;
+		}
+
+		pConn->connected = true;
+	}
+
+	if ((event & IOEVENT_READ) && \
+		(result=trunk_client_conn_recv(pConn)) != 0)
+	{
+		trunk_client_conn_close(pConn, result);
+		return;
+	}
+
+	if ((event & IOEVENT_WRITE) && \
+		(result=trunk_client_conn_send(pConn)) != 0)
+	{
+		trunk_client_conn_close(pConn, result);
+		return;
+	}
+}
+
+static void trunk_client_conn_push(TrunkClientConnection *pConn, \
+		TrunkClientRequest *pRequest)
+{
+	int result;
+
+	if (pConn->event.fd >= 0 && (pConn->server.port != \
+		g_trunk_server.port || strcmp(pConn->server.ip_addr, \
+		g_trunk_server.ip_addr) != 0))
+	{
+		logInfo("file: "__FILE__", line: %d, " \
+			"trunk server changed from %s:%d to %s:%d", \
+			__LINE__, pConn->server.ip_addr, pConn->server.port, \
+			g_trunk_server.ip_addr, g_trunk_server.port);
+		trunk_client_conn_close(pConn, EAGAIN);
+	}
+
+	if (pConn->event.fd < 0)
+	{
+		if (*(g_trunk_server.ip_addr) == '\0')
+		{
+			logError("file: "__FILE__", line: %d, " \
+				"no trunk server", __LINE__);
+			trunk_client_request_done(pConn, pRequest, EAGAIN);
+			return;
+		}
+
+		if ((result=trunk_client_conn_connect(pConn)) != 0)
+		{
+			trunk_client_request_done(pConn, pRequest, result);
+			return;
+		}
+	}
+
+	pRequest->next = NULL;
+	if (pConn->tail == NULL)
+	{
+		pConn->head = pRequest;
+		pConn->event.timer.expires = g_current_time + \
+					g_fdfs_network_timeout;
+		fast_timer_add(&pConn->thread_data->timer, \
+				&pConn->event.timer);
+	}
+	else
+	{
+		pConn->tail->next = pRequest;
+	}
+	pConn->tail = pRequest;
+	if (pConn->sending == NULL)
+	{
+		pConn->sending = pRequest;
+	}
+
+	if (pConn->connected && (result=trunk_client_conn_send(pConn)) != 0)
+	{
+		trunk_client_conn_close(pConn, result);
+	}
+}
+
+static char *trunk_client_get_lease_filename(char *full_filename)
+{
+	snprintf(full_filename, MAX_PATH_SIZE, "%s/data/%s", \
+		g_fdfs_base_path, TRUNK_LEASE_FILENAME);
+	return full_filename;
+}
+
+/* the line of the lease file: the trunk info and the lease id */
+static int trunk_client_lease_pack(const FDFSTrunkLeaseInfo *pLease, \
+		char *buff)
+{
+	if (pLease->trunk.file.size <= 0)
+	{
+		return 0;
+	}
+
+	return sprintf(buff, "%d %d %d %d %d %d "INT64_PRINTF_FORMAT"\n", \
+		pLease->trunk.path.store_path_index, \
+		pLease->trunk.path.sub_path_high, \
+		pLease->trunk.path.sub_path_low, pLease->trunk.file.id, \
+		pLease->trunk.file.offset, pLease->trunk.file.size, \
+		pLease->lease_id);
+}
+
+/* write the lease file, the caller should lock lease_file_lock */
+static int trunk_client_lease_write_file()
+{
+	char filename[MAX_PATH_SIZE];
+	FDFSTrunkLeaseInfo *pTrunkLease;
+	FDFSTrunkLeaseInfo *pEnd;
+	TrunkClientLease *pLease;
+	TrunkClientLease *pLeaseEnd;
+	bool has_leases;
+	char *buff;
+	char *p;
+	int count;
+	int result;
+	int i;
+
+	count = recovery_lease_count;
+	has_leases = g_nio_thread_data != NULL && \
+			g_nio_thread_data->trunk_conn.leases != NULL;
+	if (has_leases)
+	{
+		count += g_work_threads * g_fdfs_store_paths.count;
+	}
+
+	buff = (char *)malloc(96 * count + 1);
+	if (buff == NULL)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"malloc %d bytes fail, errno: %d, error info: %s", \
+			__LINE__, 96 * count + 1, errno, STRERROR(errno));
+		return errno != 0 ? errno : ENOMEM;
+	}
+
+	p = buff;
+	pEnd = recovery_leases + recovery_lease_count;
+	for (pTrunkLease=recovery_leases; pTrunkLease<pEnd; pTrunkLease++)
+	{
+		p += trunk_client_lease_pack(pTrunkLease, p);
+	}
+
+	for (i=0; has_leases && i<g_work_threads; i++)
+	{
+		pLease = g_nio_thread_data[i].trunk_conn.leases;
+		pLeaseEnd = pLease + g_fdfs_store_paths.count;
+		for (; pLease<pLeaseEnd; pLease++)
+		{
+			p += trunk_client_lease_pack(&(pLease->saved), p);
+		}
+	}
+
+	trunk_client_get_lease_filename(filename);
+	if ((result=safeWriteToFile(filename, buff, p - buff)) != 0)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"write to file \"%s\" fail, " \
+			"errno: %d, error info: %s", \
+			__LINE__, filename, result, STRERROR(result));
+	}
+
+	free(buff);
+	return result;
+}
+
+/* record the lease space from the offset to the end in the lease file,
+   the space before the offset is used or returned */
+static void trunk_client_lease_save(TrunkClientLease *pLease, \
+		const int offset)
+{
+	int end;
+
+	end = pLease->trunk.file.offset + pLease->trunk.file.size;
+	pthread_mutex_lock(&lease_file_lock);
+	pLease->saved.lease_id = pLease->lease_id;
+	memcpy(&(pLease->saved.trunk), &(pLease->trunk), \
+		sizeof(FDFSTrunkFullInfo));
+	pLease->saved.trunk.file.offset = offset < end ? offset : end;
+	pLease->saved.trunk.file.size = end - pLease->saved.trunk.file.offset;
+	trunk_client_lease_write_file();
+	pthread_mutex_unlock(&lease_file_lock);
+}
+
+static bool trunk_client_lease_carve(TrunkClientLease *pLease, \
+		const int file_size, FDFSTrunkFullInfo *pTrunkInfo)
+{
+	int size;
+
+	if (pLease->trunk.file.size < file_size)
+	{
+		return false;
+	}
+
+	/* the same as trunk_split of the trunk server */
+	if (pLease->trunk.file.size - file_size < g_slot_min_size)
+	{
+		size = pLease->trunk.file.size;
+	}
+	else
+	{
+		size = file_size;
+	}
+
+	memcpy(pTrunkInfo, &(pLease->trunk), sizeof(FDFSTrunkFullInfo));
+	pTrunkInfo->file.size = size;
+	pTrunkInfo->status = FDFS_TRUNK_STATUS_LEASED;
+	pLease->trunk.file.offset += size;
+	pLease->trunk.file.size -= size;
+
+	if (pLease->trunk.file.offset > pLease->saved.trunk.file.offset)
+	{
+		trunk_client_lease_save(pLease, pLease->trunk.file.offset + \
+				TRUNK_LEASE_SAVE_STEP);
+	}
+
+	return true;
+}
+
+/* return the unused space of the lease to the trunk server, the used
+   up lease is returned too, so the trunk server drops the lease */
+static void trunk_client_lease_return(TrunkClientLease *pLease)
+{
+	FDFSTrunkLeaseInfo lease;
+	TrunkClientRequest *pRequest;
+	char buff[256];
+
+	if (pLease->event.timer.expires > 0)
+	{
+		fast_timer_remove(&pLease->pConn->thread_data->timer, \
+				&pLease->event.timer);
+		pLease->event.timer.expires = 0;
+	}
+
+	if (pLease->lease_id == 0)
+	{
+		return;
+	}
+
+	/* remove from the lease file before returning, the space is
+	   lost rather than returned twice when the storage crashes */
+	lease.lease_id = pLease->lease_id;
+	memcpy(&lease.trunk, &(pLease->trunk), sizeof(FDFSTrunkFullInfo));
+	trunk_client_lease_save(pLease, lease.trunk.file.offset + \
+			lease.trunk.file.size);
+	pLease->trunk.file.size = 0;
+	pLease->lease_id = 0;
+
+	logDebug("file: "__FILE__", line: %d, " \
+		"return the trunk lease "INT64_PRINTF_FORMAT", trunk info: %s", \
+		__LINE__, lease.lease_id, trunk_info_dump(&lease.trunk, \
+		buff, sizeof(buff)));
+
+	if (g_if_trunker_self)
+	{
+		trunk_return_lease(&lease.trunk, lease.lease_id);
+		return;
+	}
+
+	pRequest = (TrunkClientRequest *)malloc(sizeof(TrunkClientRequest));
+	if (pRequest == NULL)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"malloc %d bytes fail, errno: %d, error info: %s", \
+			__LINE__, (int)sizeof(TrunkClientRequest), \
+			errno, STRERROR(errno));
+		return;
+	}
+
+	memset(pRequest, 0, sizeof(TrunkClientRequest));
+	memcpy(&(pRequest->trunk_info), &lease.trunk, sizeof(FDFSTrunkFullInfo));
+	pRequest->lease_id = lease.lease_id;
+	pRequest->cmd = STORAGE_PROTO_CMD_TRUNK_RETURN_LEASE;
+	trunk_client_conn_push(pLease->pConn, pRequest);
+}
+
+/* return the rest of the lease and lease the space from the trunk server,
+   the waiting requests are served when the trunk server responds */
+static void trunk_client_lease_renew(TrunkClientLease *pLease, \
+		const int file_size)
+{
+	TrunkClientRequest *pRequest;
+	int lease_size;
+
+	trunk_client_lease_return(pLease);
+
+	lease_size = g_trunk_lease_size > file_size ? \
+			g_trunk_lease_size : file_size;
+	if (lease_size > g_trunk_file_size)
+	{
+		lease_size = g_trunk_file_size;
+	}
+
+	pRequest = &(pLease->request);
+	pRequest->pTask = NULL;
+	pRequest->done_callback = NULL;
+	pRequest->pTrunkInfo = &(pLease->trunk);
+	pRequest->lease_id = 0;
+	pRequest->file_size = lease_size;
+	pRequest->status = 0;
+	pRequest->result = 0;
+	pRequest->cmd = STORAGE_PROTO_CMD_TRUNK_ALLOC_LEASE;
+
+	pLease->renewing = true;
+	trunk_client_conn_push(pLease->pConn, pRequest);
+}
+
+static void trunk_client_lease_done(TrunkClientLease *pLease, \
+		const int result)
+{
+	TrunkClientRequest *pRequest;
+	char buff[256];
+
+	pLease->renewing = false;
+	if (result == 0)
+	{
+		pLease->lease_id = pLease->request.lease_id;
+		logDebug("file: "__FILE__", line: %d, " \
+			"trunk lease "INT64_PRINTF_FORMAT" alloced, " \
+			"trunk info: %s", __LINE__, pLease->lease_id, \
+			trunk_info_dump(&(pLease->trunk), buff, sizeof(buff)));
+
+		trunk_client_lease_save(pLease, pLease->trunk.file.offset + \
+				TRUNK_LEASE_SAVE_STEP);
+		pLease->event.timer.expires = g_current_time + \
+					g_trunk_lease_ttl;
+		fast_timer_add(&pLease->pConn->thread_data->timer, \
+				&pLease->event.timer);
+	}
+	else
+	{
+		pLease->trunk.file.size = 0;
+		logError("file: "__FILE__", line: %d, " \
+			"lease trunk space fail, store path index: %d, " \
+			"errno: %d, error info: %s", __LINE__, \
+			pLease->trunk.path.store_path_index, \
+			result, STRERROR(result));
+	}
+
+	/* the callbacks may alloc again */
+	while ((pRequest=pLease->waiting_head) != NULL)
+	{
+		if (result == 0 && !trunk_client_lease_carve(pLease, \
+			pRequest->file_size, pRequest->pTrunkInfo))
+		{
+			trunk_client_lease_renew(pLease, pRequest->file_size);
+			return;
+		}
+
+		pLease->waiting_head = pRequest->next;
+		if (pLease->waiting_head == NULL)
+		{
+			pLease->waiting_tail = NULL;
+		}
+		trunk_client_request_done(pLease->pConn, pRequest, result);
+	}
+}
+
+static void trunk_client_lease_timeout(int sock, short event, void *arg)
+{
+	TrunkClientLease *pLease;
+
+	pLease = (TrunkClientLease *)arg;
+	pLease->event.timer.expires = 0;  //removed from the timer
+	trunk_client_lease_return(pLease);
+}
+
+static void trunk_client_lease_alloc(TrunkClientConnection *pConn, \
+		TrunkClientRequest *pRequest)
+{
+	StorageClientInfo *pClientInfo;
+	TrunkClientLease *pLease;
+
+	pLease = pConn->leases + pRequest->pTrunkInfo->path.store_path_index;
+	if (pLease->waiting_head == NULL && trunk_client_lease_carve(pLease, \
+		pRequest->file_size, pRequest->pTrunkInfo))
+	{
+		pRequest->done_callback(pRequest->pTask, 0);
+		return;
+	}
+
+	pClientInfo = (StorageClientInfo *)pRequest->pTask->arg;
+	pClientInfo->stage |= FDFS_STORAGE_STAGE_TRUNK_WAIT;
+	pRequest->next = NULL;
+	if (pLease->waiting_tail == NULL)
+	{
+		pLease->waiting_head = pRequest;
+	}
+	else
+	{
+		pLease->waiting_tail->next = pRequest;
+	}
+	pLease->waiting_tail = pRequest;
+
+	if (!pLease->renewing)
+	{
+		trunk_client_lease_renew(pLease, pRequest->file_size);
+	}
+}
+
+bool trunk_client_request_submit(struct fast_task_info *pTask)
+{
+	StorageClientInfo *pClientInfo;
+	TrunkClientConnection *pConn;
+	TrunkClientRequest *pRequest;
+
+	pClientInfo = (StorageClientInfo *)pTask->arg;
+	if ((pClientInfo->stage & FDFS_STORAGE_STAGE_TRUNK_WAIT) == 0)
+	{
+		return false;
+	}
+
+	pConn = &(g_nio_thread_data[pClientInfo->nio_thread_index].trunk_conn);
+	if (pClientInfo->trunk_request.pTask != NULL)
+	{
+		trunk_client_conn_push(pConn, &(pClientInfo->trunk_request));
+		return true;
+	}
+
+	/* the task goes on without the response */
+	pClientInfo->stage &= ~FDFS_STORAGE_STAGE_TRUNK_WAIT;
+	pRequest = (TrunkClientRequest *)malloc(sizeof(TrunkClientRequest));
+	if (pRequest == NULL)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"malloc %d bytes fail, errno: %d, error info: %s", \
+			__LINE__, (int)sizeof(TrunkClientRequest), \
+			errno, STRERROR(errno));
+		return false;
+	}
+
+	memcpy(pRequest, &(pClientInfo->trunk_request), \
+		sizeof(TrunkClientRequest));
+	trunk_client_conn_push(pConn, pRequest);
+	return false;
+}
+
+void trunk_client_trunk_alloc_space_async(struct fast_task_info *pTask, \
+		const int file_size, FDFSTrunkFullInfo *pTrunkInfo, \
+		TrunkClientDoneCallback done_callback)
+{
+	StorageClientInfo *pClientInfo;
+	TrunkClientConnection *pConn;
+	TrunkClientRequest *pRequest;
+
+	if (g_if_trunker_self)
+	{
+		done_callback(pTask, trunk_alloc_space(file_size, pTrunkInfo));
+		return;
+	}
+
+	pClientInfo = (StorageClientInfo *)pTask->arg;
+	pRequest = &(pClientInfo->trunk_request);
+	pRequest->pTask = pTask;
+	pRequest->done_callback = done_callback;
+	pRequest->pTrunkInfo = pTrunkInfo;
+	pRequest->file_size = file_size;
+	pRequest->status = 0;
+	pRequest->result = 0;
+	pRequest->cmd = STORAGE_PROTO_CMD_TRUNK_ALLOC_SPACE;
+
+	pConn = &(g_nio_thread_data[pClientInfo->nio_thread_index].trunk_conn);
+	if (pConn->leases != NULL && pTrunkInfo->path.store_path_index < \
+		g_fdfs_store_paths.count)
+	{
+		trunk_client_lease_alloc(pConn, pRequest);
+		return;
+	}
+
+	pClientInfo->stage |= FDFS_STORAGE_STAGE_TRUNK_WAIT;
+	trunk_client_request_submit(pTask);
+}
+
+static void trunk_client_request_init(struct fast_task_info *pTask, \
+		const FDFSTrunkFullInfo *pTrunkInfo, const int cmd, \
+		const int status, TrunkClientDoneCallback done_callback)
+{
+	StorageClientInfo *pClientInfo;
+	TrunkClientRequest *pRequest;
+
+	pClientInfo = (StorageClientInfo *)pTask->arg;
+	pRequest = &(pClientInfo->trunk_request);
+	pRequest->pTask = done_callback != NULL ? pTask : NULL;
+	pRequest->done_callback = done_callback;
+	pRequest->pTrunkInfo = NULL;
+	memcpy(&(pRequest->trunk_info), pTrunkInfo, sizeof(FDFSTrunkFullInfo));
+	pRequest->file_size = 0;
+	pRequest->status = status;
+	pRequest->result = 0;
+	pRequest->cmd = cmd;
+
+	pClientInfo->stage |= FDFS_STORAGE_STAGE_TRUNK_WAIT;
+}
+
+void trunk_client_trunk_alloc_confirm_async(struct fast_task_info *pTask, \
+		const FDFSTrunkFullInfo *pTrunkInfo, const int status, \
+		TrunkClientDoneCallback done_callback)
+{
+	if (pTrunkInfo->status == FDFS_TRUNK_STATUS_LEASED)
+	{
+		if (status != 0 && status != EEXIST)
+		{
+			trunk_client_trunk_free_space_async(pTask, pTrunkInfo);
+		}
+		return;
+	}
+
+	if (done_callback == NULL && g_if_trunker_self)
+	{
+		trunk_alloc_confirm(pTrunkInfo, status);
+		return;
+	}
+
+	trunk_client_request_init(pTask, pTrunkInfo, \
+		STORAGE_PROTO_CMD_TRUNK_ALLOC_CONFIRM, status, done_callback);
+	if (done_callback != NULL)
+	{
+		storage_nio_notify(pTask);
+	}
+}
+
+void trunk_client_trunk_free_space_async(struct fast_task_info *pTask, \
+		const FDFSTrunkFullInfo *pTrunkInfo)
+{
+	if (g_if_trunker_self)
+	{
+		trunk_free_space(pTrunkInfo, true);
+		return;
+	}
+
+	trunk_client_request_init(pTask, pTrunkInfo, \
+		STORAGE_PROTO_CMD_TRUNK_FREE_SPACE, 0, NULL);
+}
+
+int trunk_client_lease_init()
+{
+	char filename[MAX_PATH_SIZE];
+	FDFSTrunkLeaseInfo *pLease;
+	FDFSTrunkFullInfo *pTrunkInfo;
+	char *content;
+	char *line;
+	char *pNext;
+	int64_t file_size;
+	int store_path_index;
+	int sub_path_high;
+	int sub_path_low;
+	int count;
+	int len;
+	int result;
+
+	if ((result=init_pthread_lock(&lease_file_lock)) != 0 || \
+		(result=init_pthread_lock(&lease_recovery_lock)) != 0)
+	{
+		return result;
+	}
+
+	trunk_client_get_lease_filename(filename);
+	if (!fileExists(filename))
+	{
+		return 0;
+	}
+
+	if ((result=getFileContent(filename, &content, &file_size)) != 0)
+	{
+		return result;
+	}
+
+	count = 0;
+	for (line=content; (line=strchr(line, '\n')) != NULL; line++)
+	{
+		count++;
+	}
+
+	recovery_leases = (FDFSTrunkLeaseInfo *)malloc( \
+			sizeof(FDFSTrunkLeaseInfo) * (count + 1));
+	if (recovery_leases == NULL)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"malloc %d bytes fail, errno: %d, error info: %s", \
+			__LINE__, (int)sizeof(FDFSTrunkLeaseInfo) * (count + 1), \
+			errno, STRERROR(errno));
+		free(content);
+		return errno != 0 ? errno : ENOMEM;
+	}
+
+	/* the line without the lease id is written by the old version,
+	   the space can't be returned safely, it is skipped */
+	pLease = recovery_leases;
+	for (line=content; line != NULL && *line != '\0'; line=pNext)
+	{
+		pNext = strchr(line, '\n');
+		if (pNext != NULL)
+		{
+			*pNext++ = '\0';
+		}
+
+		memset(pLease, 0, sizeof(FDFSTrunkLeaseInfo));
+		pTrunkInfo = &(pLease->trunk);
+		len = 0;
+		if (sscanf(line, "%d %d %d %d %d %d%n", &store_path_index, \
+			&sub_path_high, &sub_path_low, \
+			&pTrunkInfo->file.id, &pTrunkInfo->file.offset, \
+			&pTrunkInfo->file.size, &len) == 6)
+		{
+			pLease->lease_id = strtoll(line + len, NULL, 10);
+		}
+		if (pLease->lease_id <= 0 || store_path_index < 0 || \
+			store_path_index >= g_fdfs_store_paths.count || \
+			pTrunkInfo->file.size <= 0)
+		{
+			logWarning("file: "__FILE__", line: %d, " \
+				"lease file \"%s\", invalid line: %s", \
+				__LINE__, filename, line);
+			continue;
+		}
+
+		pTrunkInfo->path.store_path_index = store_path_index;
+		pTrunkInfo->path.sub_path_high = sub_path_high;
+		pTrunkInfo->path.sub_path_low = sub_path_low;
+		pTrunkInfo->status = FDFS_TRUNK_STATUS_FREE;
+		pLease++;
+	}
+
+	free(content);
+	recovery_lease_count = pLease - recovery_leases;
+	if (recovery_lease_count > 0)
+	{
+		logInfo("file: "__FILE__", line: %d, " \
+			"%d trunk leases to return in the lease file: %s", \
+			__LINE__, recovery_lease_count, filename);
+	}
+
+	return 0;
+}
+
+int trunk_client_lease_recovery()
+{
+	FDFSTrunkLeaseInfo *pLease;
+	FDFSTrunkLeaseInfo *pEnd;
+	char buff[256];
+	int result;
+	int fail_count;
+
+	if (recovery_lease_count == 0)
+	{
+		return 0;
+	}
+
+	pthread_mutex_lock(&lease_recovery_lock);
+	fail_count = 0;
+	pEnd = recovery_leases + recovery_lease_count;
+	for (pLease=recovery_leases; pLease<pEnd; pLease++)
+	{
+		if (pLease->trunk.file.size == 0)
+		{
+			continue;
+		}
+
+		/* ENOENT: the trunk server returned the lease already
+		   or dropped it with the reclaimed trunk file */
+		result = trunk_client_trunk_return_lease(pLease);
+		if (result != 0 && result != ENOENT)
+		{
+			logError("file: "__FILE__", line: %d, " \
+				"return trunk lease "INT64_PRINTF_FORMAT \
+				" fail, trunk info: %s, errno: %d, " \
+				"error info: %s", __LINE__, pLease->lease_id, \
+				trunk_info_dump(&(pLease->trunk), buff, \
+				sizeof(buff)), result, STRERROR(result));
+			fail_count++;
+			continue;
+		}
+
+		pthread_mutex_lock(&lease_file_lock);
+		pLease->trunk.file.size = 0;
+		pthread_mutex_unlock(&lease_file_lock);
+	}
+
+	pthread_mutex_lock(&lease_file_lock);
+	if (fail_count == 0)
+	{
+		logInfo("file: "__FILE__", line: %d, " \
+			"%d trunk leases in the lease file returned", \
+			__LINE__, recovery_lease_count);
+		recovery_lease_count = 0;
+	}
+	result = trunk_client_lease_write_file();
+	pthread_mutex_unlock(&lease_file_lock);
+
+	pthread_mutex_unlock(&lease_recovery_lock);
+	return fail_count == 0 ? result : EAGAIN;
+}
+
+void trunk_client_lease_destroy()
+{
+	TrunkClientLease *pLease;
+	TrunkClientLease *pLeaseEnd;
+	FDFSTrunkLeaseInfo lease;
+	char buff[256];
+	int result;
+	int i;
+
+	if (g_nio_thread_data == NULL || \
+		g_nio_thread_data->trunk_conn.leases == NULL)
+	{
+		return;
+	}
+
+	for (i=0; i<g_work_threads; i++)
+	{
+		pLease = g_nio_thread_data[i].trunk_conn.leases;
+		pLeaseEnd = pLease + g_fdfs_store_paths.count;
+		for (; pLease<pLeaseEnd; pLease++)
+		{
+			if (pLease->lease_id == 0)
+			{
+				continue;
+			}
+
+			/* the whole unused space is kept in the lease file
+			   when the trunk server is not available, the lease
+			   returned already is skipped by the trunk server */
+			trunk_client_lease_save(pLease, \
+					pLease->trunk.file.offset);
+			lease.lease_id = pLease->lease_id;
+			memcpy(&lease.trunk, &(pLease->trunk), \
+				sizeof(FDFSTrunkFullInfo));
+			result = trunk_client_trunk_return_lease(&lease);
+			if (result != 0 && result != ENOENT)
+			{
+				logError("file: "__FILE__", line: %d, " \
+					"return trunk lease "INT64_PRINTF_FORMAT \
+					" fail, trunk info: %s, errno: %d, " \
+					"error info: %s", __LINE__, \
+					lease.lease_id, trunk_info_dump( \
+					&(pLease->trunk), buff, sizeof(buff)), \
+					result, STRERROR(result));
+				continue;
+			}
+
+			trunk_client_lease_save(pLease, \
+				pLease->trunk.file.offset + \
+				pLease->trunk.file.size);
+			pLease->trunk.file.size = 0;
+			pLease->lease_id = 0;
+		}
+	}
+}
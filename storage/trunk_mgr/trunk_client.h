@@ -13,8 +13,74 @@
 
 #include "common_define.h"
 #include "tracker_types.h"
+#include "tracker_proto.h"
+#include "fast_task_queue.h"
 #include "trunk_mem.h"
 
+/* called by the nio thread when the trunk server responds */
+typedef void (*TrunkClientDoneCallback)(struct fast_task_info *pTask, \
+		const int err_no);
+
+/* the request to the trunk server sent by the nio thread */
+typedef struct trunk_client_request
+{
+	struct fast_task_info *pTask;  //NULL for free space (no response)
+	TrunkClientDoneCallback done_callback;
+	FDFSTrunkFullInfo *pTrunkInfo; //the trunk info to alloc
+	FDFSTrunkFullInfo trunk_info;  //the trunk info to confirm or free
+	int64_t lease_id;  //the lease to return or the lease alloced
+	int file_size;  //the space size to alloc
+	int status;     //the write status to confirm
+	int result;     //the response status
+	char cmd;
+	struct trunk_client_request *next;
+} TrunkClientRequest;
+
+struct trunk_client_connection;
+
+/* the trunk space leased from the trunk server by the nio thread for one
+   store path, the small files are alloced from it without the round trip */
+typedef struct
+{
+	IOEventEntry event;   //the timer to return the unused space
+	struct trunk_client_connection *pConn;
+	FDFSTrunkFullInfo trunk;  //the unused space, file.size 0 for none
+	int64_t lease_id;         //0 for no lease
+	FDFSTrunkLeaseInfo saved; //the space recorded in the lease file
+	TrunkClientRequest request;  //the request to lease the space
+	TrunkClientRequest *waiting_head;  //wait for the lease request
+	TrunkClientRequest *waiting_tail;
+	bool renewing;  //if the lease request is sent
+} TrunkClientLease;
+
+/* one connection to the trunk server per nio thread, the requests are
+   pipelined and the trunk server responds them in order */
+typedef struct trunk_client_connection
+{
+	IOEventEntry event;   //fd is -1 when not connected
+	struct nio_thread_data *thread_data;
+	ConnectionInfo server;   //the trunk server connected to
+	bool connected;          //false when connecting
+	short events;            //the io events listened
+	TrunkClientRequest *head;  //the requests waiting for the response
+	TrunkClientRequest *tail;
+	TrunkClientRequest *sending;  //the first request not packed to send
+	int send_offset;
+	int send_length;
+	int recv_offset;
+	int recv_length;
+	TrunkClientLease *leases;  //one per store path, NULL for disabled
+	char send_buff[16 * (sizeof(TrackerHeader) + \
+			STORAGE_TRUNK_RETURN_LEASE_REQ_BODY_LEN)];
+	char recv_buff[sizeof(TrackerHeader) + \
+			STORAGE_TRUNK_ALLOC_LEASE_RESP_BODY_LEN];
+} TrunkClientConnection;
+
+/* the leased space is used by the storage, no confirm needed */
+#define TRUNK_CLIENT_NEED_CONFIRM(pTrunkInfo) \
+	(!g_if_trunker_self && (pTrunkInfo)->status != \
+	 FDFS_TRUNK_STATUS_LEASED)
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -27,6 +93,60 @@ int trunk_client_trunk_alloc_confirm(const FDFSTrunkFullInfo *pTrunkInfo, \
 
 int trunk_client_trunk_free_space(const FDFSTrunkFullInfo *pTrunkInfo);
 
+int trunk_client_conn_init(TrunkClientConnection *pConn, \
+		struct nio_thread_data *thread_data);
+
+/**
+* load the lease file, called before the nio threads start
+**/
+int trunk_client_lease_init();
+
+/**
+* return the leases to the trunk server, called after the nio threads exit
+**/
+void trunk_client_lease_destroy();
+
+/**
+* return the space of the leases recorded in the lease file when the
+* storage exited abnormally, called when the trunk server is known
+**/
+int trunk_client_lease_recovery();
+
+/**
+* alloc trunk space in the nio thread without blocking, the done_callback
+* is called by the nio thread when the trunk server responds, or at once
+* when this server is the trunk server or the space is alloced from
+* the lease of the nio thread
+**/
+void trunk_client_trunk_alloc_space_async(struct fast_task_info *pTask, \
+		const int file_size, FDFSTrunkFullInfo *pTrunkInfo, \
+		TrunkClientDoneCallback done_callback);
+
+/**
+* confirm the trunk space without blocking, called by the dio thread
+* when this server is not the trunk server, the request is sent by the
+* nio thread of the task and the done_callback is called by the nio thread.
+* when done_callback is NULL, the task goes on without the response and
+* the request is sent by trunk_client_request_submit
+**/
+void trunk_client_trunk_alloc_confirm_async(struct fast_task_info *pTask, \
+		const FDFSTrunkFullInfo *pTrunkInfo, const int status, \
+		TrunkClientDoneCallback done_callback);
+
+/**
+* free the trunk space without waiting for the response, called by the
+* dio thread before notifying the nio thread of the task, the request is
+* sent when the nio thread is notified
+**/
+void trunk_client_trunk_free_space_async(struct fast_task_info *pTask, \
+		const FDFSTrunkFullInfo *pTrunkInfo);
+
+/**
+* send the pending trunk request of the task, called by the nio thread
+* return true when the task waits for the response
+**/
+bool trunk_client_request_submit(struct fast_task_info *pTask);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,453 @@
+/**
+* Copyright (C) 2008 Happy Fish / YuQing
+*
+* FastDFS may be copied only under the terms of the GNU General
+* Public License V3, which may be found in the FastDFS source kit.
+* Please visit the FastDFS Home Page http://www.csource.org/ for more detail.
+**/
+
+//trunk_compactor.c
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include "fdfs_define.h"
+#include "logger.h"
+#include "shared_func.h"
+#include "pthread_func.h"
+#include "sched_thread.h"
+#include "storage_global.h"
+#include "trunk_mem.h"
+#include "trunk_redirect.h"
+#include "trunk_compactor.h"
+
+#define TRUNK_COMPACT_RETIRE_TIMEOUT  30
+
+typedef struct {
+	FDFSTrunkFullInfo src;     //the space in the compacted trunk file
+	FDFSTrunkFullInfo origin;  //the space in the filename
+	FDFSTrunkFullInfo dest;    //the new space
+	bool allocated;
+	bool published;
+} TrunkCompactMove;
+
+typedef struct {
+	TrunkCompactMove *moves;
+	int alloc;
+	int count;
+} TrunkCompactMoveArray;
+
+static bool compactor_continue_flag = true;
+static bool compactor_thread_running = false;
+static int compact_fail_file_id = 0;  //skipped at the next time
+
+static int64_t get_current_us()
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+static TrunkCompactMove *trunk_compact_new_move( \
+		TrunkCompactMoveArray *pArray)
+{
+	TrunkCompactMove *moves;
+	int alloc;
+
+	if (pArray->count >= pArray->alloc)
+	{
+		alloc = pArray->alloc == 0 ? 64 : 2 * pArray->alloc;
+		moves = (TrunkCompactMove *)realloc(pArray->moves, \
+				sizeof(TrunkCompactMove) * alloc);
+		if (moves == NULL)
+		{
+			logError("file: "__FILE__", line: %d, " \
+				"malloc %d bytes fail, " \
+				"errno: %d, error info: %s", __LINE__, \
+				(int)sizeof(TrunkCompactMove) * alloc, \
+				errno, STRERROR(errno));
+			return NULL;
+		}
+
+		pArray->moves = moves;
+		pArray->alloc = alloc;
+	}
+
+	memset(pArray->moves + pArray->count, 0, sizeof(TrunkCompactMove));
+	return pArray->moves + pArray->count++;
+}
+
+/* find the live files in the trunk file, they are between the free
+   blocks and each one starts with a valid header */
+static int trunk_compact_collect(const FDFSTrunkFullInfo *pTrunkInfo, \
+		const FDFSTrunkFullInfo *blocks, const int block_count, \
+		TrunkCompactMoveArray *pArray)
+{
+	char full_filename[MAX_PATH_SIZE];
+	char pack_buff[FDFS_TRUNK_FILE_HEADER_SIZE];
+	FDFSTrunkHeader trunkHeader;
+	TrunkCompactMove *pMove;
+	int64_t offset;
+	int64_t end_offset;
+	int fd;
+	int result;
+	int i;
+
+	trunk_get_full_filename(pTrunkInfo, full_filename, \
+			sizeof(full_filename));
+	if ((fd=open(full_filename, O_RDONLY)) < 0)
+	{
+		result = errno != 0 ? errno : ENOENT;
+		logError("file: "__FILE__", line: %d, " \
+			"open file %s fail, errno: %d, error info: %s", \
+			__LINE__, full_filename, result, STRERROR(result));
+		return result;
+	}
+
+	result = 0;
+	offset = 0;
+	i = 0;
+	while (offset < g_trunk_file_size)
+	{
+		if (i < block_count && blocks[i].file.offset == offset)
+		{
+			offset += blocks[i++].file.size;
+			continue;
+		}
+
+		end_offset = i < block_count ? blocks[i].file.offset : \
+				g_trunk_file_size;
+		if (pread(fd, pack_buff, FDFS_TRUNK_FILE_HEADER_SIZE, \
+			offset) != FDFS_TRUNK_FILE_HEADER_SIZE)
+		{
+			result = errno != 0 ? errno : EIO;
+			break;
+		}
+
+		trunk_unpack_header(pack_buff, &trunkHeader);
+		if (trunkHeader.alloc_size < FDFS_TRUNK_FILE_HEADER_SIZE || \
+			offset + trunkHeader.alloc_size > end_offset)
+		{
+			//such as the leased space not written yet
+			result = EAGAIN;
+			break;
+		}
+
+		if (trunkHeader.file_type == FDFS_TRUNK_FILE_TYPE_NONE)
+		{
+			//deleted, the space will be freed
+			offset += trunkHeader.alloc_size;
+			continue;
+		}
+
+		if (!(trunkHeader.file_type == FDFS_TRUNK_FILE_TYPE_REGULAR || \
+			trunkHeader.file_type == FDFS_TRUNK_FILE_TYPE_LINK) || \
+			trunkHeader.file_size < 0 || FDFS_TRUNK_FILE_HEADER_SIZE \
+			+ trunkHeader.file_size > trunkHeader.alloc_size)
+		{
+			result = EINVAL;
+			break;
+		}
+
+		//the new files may be not synced to the other storage servers
+		if (g_current_time - trunkHeader.mtime < \
+			g_trunk_compact_file_min_age)
+		{
+			result = EAGAIN;
+			break;
+		}
+
+		if ((pMove=trunk_compact_new_move(pArray)) == NULL)
+		{
+			result = ENOMEM;
+			break;
+		}
+
+		pMove->src = *pTrunkInfo;
+		pMove->src.file.offset = offset;
+		pMove->src.file.size = trunkHeader.alloc_size;
+		if (trunk_redirect_get_origin(&(pMove->src), \
+			&(pMove->origin)) != 0)
+		{
+			pMove->origin = pMove->src;
+		}
+		pMove->dest.path.store_path_index = \
+			pTrunkInfo->path.store_path_index;
+		pMove->dest.file.size = TRUNK_CALC_SIZE(trunkHeader.file_size);
+
+		offset += trunkHeader.alloc_size;
+	}
+
+	close(fd);
+	if (result != 0 && result != EAGAIN)
+	{
+		logWarning("file: "__FILE__", line: %d, " \
+			"invalid trunk file %s at offset: "INT64_PRINTF_FORMAT \
+			", errno: %d, error info: %s", __LINE__, \
+			full_filename, offset, result, STRERROR(result));
+	}
+	return result;
+}
+
+/* the new space is allocated from the free space of the other trunk
+   files, creating the new trunk file for the moved files is useless */
+static int trunk_compact_alloc(TrunkCompactMoveArray *pArray)
+{
+	TrunkCompactMove *pMove;
+	TrunkCompactMove *pEnd;
+	int result;
+
+	pEnd = pArray->moves + pArray->count;
+	for (pMove=pArray->moves; pMove<pEnd; pMove++)
+	{
+		if ((result=trunk_alloc_space_ex(pMove->dest.file.size, \
+			&(pMove->dest), false)) != 0)
+		{
+			return result;
+		}
+		pMove->allocated = true;
+	}
+
+	return 0;
+}
+
+/* copy the files to the new space under the rate limit */
+static int trunk_compact_copy(TrunkCompactMoveArray *pArray)
+{
+	TrunkCompactMove *pMove;
+	TrunkCompactMove *pEnd;
+	int64_t start_us;
+	int64_t expect_us;
+	int64_t used_us;
+	int64_t copied_bytes;
+	int result;
+
+	copied_bytes = 0;
+	start_us = get_current_us();
+	pEnd = pArray->moves + pArray->count;
+	for (pMove=pArray->moves; pMove<pEnd; pMove++)
+	{
+		if (!(g_continue_flag && compactor_continue_flag))
+		{
+			return EINTR;
+		}
+
+		if ((result=trunk_redirect_copy(&(pMove->src), \
+			&(pMove->dest))) != 0)
+		{
+			return result;
+		}
+
+		copied_bytes += pMove->dest.file.size;
+		expect_us = copied_bytes * 1000000 / g_trunk_compact_rate;
+		used_us = get_current_us() - start_us;
+		if (expect_us > used_us)
+		{
+			usleep(expect_us - used_us);
+		}
+	}
+
+	return 0;
+}
+
+/* the files deleted during copying are skipped, the redirect lock
+   keeps the spaces from freeing until the moves are published */
+static int trunk_compact_publish(TrunkCompactMoveArray *pArray, \
+		int *moved_count)
+{
+	TrunkCompactMove *pMove;
+	TrunkCompactMove *pEnd;
+	int result;
+
+	*moved_count = 0;
+	result = 0;
+	pEnd = pArray->moves + pArray->count;
+	trunk_redirect_lock();
+	for (pMove=pArray->moves; pMove<pEnd; pMove++)
+	{
+		if (trunk_compact_is_space_free(&(pMove->src)))
+		{
+			continue;
+		}
+
+		if ((result=trunk_redirect_add(&(pMove->origin), \
+			&(pMove->dest))) != 0)
+		{
+			break;
+		}
+
+		pMove->published = true;
+		trunk_alloc_confirm(&(pMove->dest), 0);
+		(*moved_count)++;
+	}
+	trunk_redirect_unlock();
+
+	return result;
+}
+
+int trunk_compact_one_file()
+{
+	FDFSTrunkFullInfo trunkInfo;
+	FDFSTrunkFullInfo *blocks;
+	TrunkCompactMoveArray moveArray;
+	TrunkCompactMove *pMove;
+	TrunkCompactMove *pEnd;
+	char buff[256];
+	int block_count;
+	int moved_count;
+	int result;
+
+	if ((result=trunk_compact_select_file(g_trunk_compact_free_ratio, \
+		compact_fail_file_id, &trunkInfo)) != 0)
+	{
+		compact_fail_file_id = 0;  //retry it at the next time
+		return result;
+	}
+
+	compact_fail_file_id = trunkInfo.file.id;
+	if ((result=trunk_compact_retire_file(&trunkInfo, \
+		TRUNK_COMPACT_RETIRE_TIMEOUT)) != 0)
+	{
+		return result;
+	}
+
+	if ((result=trunk_compact_get_free_blocks(&trunkInfo, \
+		&blocks, &block_count)) != 0)
+	{
+		trunk_compact_release_file(&trunkInfo, false);
+		return result;
+	}
+
+	memset(&moveArray, 0, sizeof(moveArray));
+	result = trunk_compact_collect(&trunkInfo, blocks, \
+			block_count, &moveArray);
+	free(blocks);
+	if (result == 0)
+	{
+		result = trunk_compact_alloc(&moveArray);
+	}
+	if (result == 0)
+	{
+		result = trunk_compact_copy(&moveArray);
+	}
+
+	moved_count = 0;
+	if (result == 0)
+	{
+		result = trunk_compact_publish(&moveArray, &moved_count);
+	}
+
+	pEnd = moveArray.moves + moveArray.count;
+	for (pMove=moveArray.moves; pMove<pEnd; pMove++)
+	{
+		if (pMove->allocated && !pMove->published)
+		{
+			trunk_alloc_confirm(&(pMove->dest), EIO);
+		}
+	}
+
+	trunk_info_dump(&trunkInfo, buff, sizeof(buff));
+	if (result == 0)
+	{
+		compact_fail_file_id = 0;
+		result = trunk_compact_release_file(&trunkInfo, true);
+		logInfo("file: "__FILE__", line: %d, " \
+			"trunk file compacted, %d files moved, " \
+			"trunk info: %s", __LINE__, moved_count, buff);
+	}
+	else
+	{
+		trunk_compact_release_file(&trunkInfo, false);
+		logDebug("file: "__FILE__", line: %d, " \
+			"trunk file can't be compacted now, trunk info: %s, " \
+			"errno: %d, error info: %s", __LINE__, buff, \
+			result, STRERROR(result));
+	}
+
+	if (moveArray.moves != NULL)
+	{
+		free(moveArray.moves);
+	}
+	return result;
+}
+
+static void *trunk_compactor_entrance(void *arg)
+{
+	time_t last_compact_time;
+
+	last_compact_time = g_current_time;
+	while (g_continue_flag && compactor_continue_flag)
+	{
+		sleep(1);
+		if (g_current_time - last_compact_time < \
+			g_trunk_compact_interval)
+		{
+			continue;
+		}
+		last_compact_time = g_current_time;
+
+		if (!(g_if_use_trunk_file && g_if_trunker_self))
+		{
+			continue;
+		}
+
+		while (g_continue_flag && compactor_continue_flag && \
+			trunk_compact_one_file() == 0)
+		{
+		}
+	}
+
+	compactor_thread_running = false;
+	return NULL;
+}
+
+int trunk_compactor_start()
+{
+	pthread_t tid;
+	pthread_attr_t pattr;
+	int result;
+
+	if (g_trunk_compact_interval <= 0)
+	{
+		return 0;
+	}
+
+	if ((result=init_pthread_attr(&pattr, g_thread_stack_size)) != 0)
+	{
+		return result;
+	}
+
+	compactor_continue_flag = true;
+	compactor_thread_running = true;
+	if ((result=pthread_create(&tid, &pattr, \
+		trunk_compactor_entrance, NULL)) != 0)
+	{
+		compactor_thread_running = false;
+		logError("file: "__FILE__", line: %d, " \
+			"create thread failed, errno: %d, " \
+			"error info: %s", __LINE__, \
+			result, STRERROR(result));
+	}
+
+	pthread_attr_destroy(&pattr);
+	return result;
+}
+
+void trunk_compactor_destroy()
+{
+	int i;
+
+	compactor_continue_flag = false;
+	for (i=0; compactor_thread_running && i<300; i++)
+	{
+		usleep(10000);
+	}
+}
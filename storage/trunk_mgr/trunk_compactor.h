@@ -0,0 +1,34 @@
+/**
+* Copyright (C) 2008 Happy Fish / YuQing
+*
+* FastDFS may be copied only under the terms of the GNU General
+* Public License V3, which may be found in the FastDFS source kit.
+* Please visit the FastDFS Home Page http://www.csource.org/ for more detail.
+**/
+
+//trunk_compactor.h
+
+#ifndef _TRUNK_COMPACTOR_H_
+#define _TRUNK_COMPACTOR_H_
+
+#include "common_define.h"
+#include "trunk_shared.h"
+
+/* the trunk server moves the small files out of the trunk file with
+   the most free space, then removes the trunk file */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int trunk_compactor_start();
+void trunk_compactor_destroy();
+
+/* compact one trunk file, return 0 for compacted, ENOENT for none */
+int trunk_compact_one_file();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,438 @@
+/**
+* Copyright (C) 2008 Happy Fish / YuQing
+*
+* FastDFS may be copied only under the terms of the GNU General
+* Public License V3, which may be found in the FastDFS source kit.
+* Please visit the FastDFS Home Page http://www.csource.org/ for more detail.
+**/
+
+//trunk_fd_cache.c
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include "fdfs_define.h"
+#include "logger.h"
+#include "shared_func.h"
+#include "pthread_func.h"
+#include "storage_global.h"
+#include "trunk_fd_cache.h"
+
+#define TRUNK_FD_CACHE_MAX_FD_COUNT  (256 * 1024)
+
+typedef struct trunk_fd_entry {
+	int id;          //the trunk file id
+	int fd;
+	int ref_count;   //the users of the fd
+	int store_path_index;
+	bool deleted;    //removed from the cache, closed when released
+	struct trunk_fd_entry *hash_next;
+	struct trunk_fd_entry *lru_prev;  //the head is the most recently used
+	struct trunk_fd_entry *lru_next;
+} TrunkFdEntry;
+
+typedef struct {
+	pthread_mutex_t lock;
+	TrunkFdEntry **buckets;
+	int count;       //the cached fds
+	TrunkFdEntry lru_head;
+} TrunkFdCachePath;
+
+static TrunkFdCachePath *fd_cache_paths = NULL;
+static int fd_cache_bucket_count = 0;
+
+/* the cached entries indexed by fd to release by the fd */
+static TrunkFdEntry **fd_entries = NULL;
+static int fd_entry_count = 0;
+
+static int trunk_fd_cache_do_open(const FDFSTrunkFullInfo *pTrunkInfo, \
+		const char *filename, int *fd)
+{
+	char full_filename[MAX_PATH_SIZE];
+	int result;
+
+	if (filename == NULL)
+	{
+		trunk_get_full_filename(pTrunkInfo, full_filename, \
+				sizeof(full_filename));
+		filename = full_filename;
+	}
+
+	*fd = open(filename, O_RDWR | g_extra_open_file_flags);
+	if (*fd < 0)
+	{
+		result = errno != 0 ? errno : EACCES;
+		if (result != ENOENT)
+		{
+			logError("file: "__FILE__", line: %d, " \
+				"open file: %s fail, " \
+				"errno: %d, error info: %s", \
+				__LINE__, filename, result, STRERROR(result));
+		}
+		return result;
+	}
+
+	return 0;
+}
+
+int trunk_fd_cache_init()
+{
+	struct rlimit limit;
+	int result;
+	int bytes;
+	int i;
+
+	if (g_trunk_fd_cache_size <= 0 || g_fdfs_store_paths.count <= 0)
+	{
+		return 0;
+	}
+
+	/* the cached fds should not take the fds of the connections */
+	set_rlimit(RLIMIT_NOFILE, g_max_connections + \
+		g_fdfs_store_paths.count * g_trunk_fd_cache_size + 64);
+	if (getrlimit(RLIMIT_NOFILE, &limit) != 0)
+	{
+		result = errno != 0 ? errno : EPERM;
+		logError("file: "__FILE__", line: %d, " \
+			"call getrlimit fail, " \
+			"errno: %d, error info: %s", \
+			__LINE__, result, STRERROR(result));
+		return result;
+	}
+
+	if (limit.rlim_cur == RLIM_INFINITY || \
+		limit.rlim_cur > TRUNK_FD_CACHE_MAX_FD_COUNT)
+	{
+		fd_entry_count = TRUNK_FD_CACHE_MAX_FD_COUNT;
+	}
+	else
+	{
+		fd_entry_count = limit.rlim_cur;
+	}
+
+	bytes = sizeof(TrunkFdEntry *) * fd_entry_count;
+	fd_entries = (TrunkFdEntry **)malloc(bytes);
+	if (fd_entries == NULL)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"malloc %d bytes fail", __LINE__, bytes);
+		return ENOMEM;
+	}
+	memset(fd_entries, 0, bytes);
+
+	fd_cache_bucket_count = g_trunk_fd_cache_size;
+	bytes = sizeof(TrunkFdCachePath) * g_fdfs_store_paths.count;
+	fd_cache_paths = (TrunkFdCachePath *)malloc(bytes);
+	if (fd_cache_paths == NULL)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"malloc %d bytes fail", __LINE__, bytes);
+		return ENOMEM;
+	}
+	memset(fd_cache_paths, 0, bytes);
+
+	bytes = sizeof(TrunkFdEntry *) * fd_cache_bucket_count;
+	for (i=0; i<g_fdfs_store_paths.count; i++)
+	{
+		if ((result=init_pthread_lock(&(fd_cache_paths[i].lock))) != 0)
+		{
+			return result;
+		}
+
+		fd_cache_paths[i].buckets = (TrunkFdEntry **)malloc(bytes);
+		if (fd_cache_paths[i].buckets == NULL)
+		{
+			logError("file: "__FILE__", line: %d, " \
+				"malloc %d bytes fail", __LINE__, bytes);
+			return ENOMEM;
+		}
+		memset(fd_cache_paths[i].buckets, 0, bytes);
+
+		fd_cache_paths[i].lru_head.lru_prev = \
+				&(fd_cache_paths[i].lru_head);
+		fd_cache_paths[i].lru_head.lru_next = \
+				&(fd_cache_paths[i].lru_head);
+	}
+
+	g_trunk_fd_open_func = trunk_fd_cache_open;
+	g_trunk_fd_close_func = trunk_fd_cache_close;
+	return 0;
+}
+
+void trunk_fd_cache_destroy()
+{
+	TrunkFdCachePath *pPath;
+	TrunkFdEntry *pEntry;
+	TrunkFdEntry *pNext;
+	int i;
+
+	if (fd_cache_paths == NULL)
+	{
+		return;
+	}
+
+	g_trunk_fd_open_func = NULL;
+	g_trunk_fd_close_func = NULL;
+	for (i=0; i<g_fdfs_store_paths.count; i++)
+	{
+		pPath = fd_cache_paths + i;
+		pEntry = pPath->lru_head.lru_next;
+		while (pEntry != &(pPath->lru_head))
+		{
+			pNext = pEntry->lru_next;
+			close(pEntry->fd);
+			free(pEntry);
+			pEntry = pNext;
+		}
+
+		free(pPath->buckets);
+		pthread_mutex_destroy(&(pPath->lock));
+	}
+
+	free(fd_cache_paths);
+	fd_cache_paths = NULL;
+	free(fd_entries);
+	fd_entries = NULL;
+	fd_entry_count = 0;
+}
+
+#define TRUNK_FD_BUCKET(pPath, id) \
+	((pPath)->buckets + ((unsigned int)(id)) % fd_cache_bucket_count)
+
+static TrunkFdEntry *trunk_fd_cache_find(TrunkFdCachePath *pPath, \
+		const int id)
+{
+	TrunkFdEntry *pEntry;
+
+	pEntry = *TRUNK_FD_BUCKET(pPath, id);
+	while (pEntry != NULL && pEntry->id != id)
+	{
+		pEntry = pEntry->hash_next;
+	}
+
+	return pEntry;
+}
+
+static void trunk_fd_cache_lru_remove(TrunkFdEntry *pEntry)
+{
+	pEntry->lru_prev->lru_next = pEntry->lru_next;
+	pEntry->lru_next->lru_prev = pEntry->lru_prev;
+}
+
+static void trunk_fd_cache_lru_add(TrunkFdCachePath *pPath, \
+		TrunkFdEntry *pEntry)
+{
+	pEntry->lru_prev = &(pPath->lru_head);
+	pEntry->lru_next = pPath->lru_head.lru_next;
+	pPath->lru_head.lru_next->lru_prev = pEntry;
+	pPath->lru_head.lru_next = pEntry;
+}
+
+/* remove from the hash and the lru list, caller should hold the lock */
+static void trunk_fd_cache_remove(TrunkFdCachePath *pPath, \
+		TrunkFdEntry *pEntry)
+{
+	TrunkFdEntry **ppEntry;
+
+	ppEntry = TRUNK_FD_BUCKET(pPath, pEntry->id);
+	while (*ppEntry != pEntry)
+	{
+		ppEntry = &((*ppEntry)->hash_next);
+	}
+	*ppEntry = pEntry->hash_next;
+
+	trunk_fd_cache_lru_remove(pEntry);
+	pPath->count--;
+}
+
+static void trunk_fd_cache_free(TrunkFdEntry *pEntry)
+{
+	fd_entries[pEntry->fd] = NULL;
+	close(pEntry->fd);
+	free(pEntry);
+}
+
+/* close the least recently used fds which are not in use */
+static void trunk_fd_cache_evict(TrunkFdCachePath *pPath)
+{
+	TrunkFdEntry *pEntry;
+	TrunkFdEntry *pPrev;
+
+	pEntry = pPath->lru_head.lru_prev;
+	while (pPath->count > g_trunk_fd_cache_size && \
+		pEntry != &(pPath->lru_head))
+	{
+		pPrev = pEntry->lru_prev;
+		if (pEntry->ref_count == 0)
+		{
+			trunk_fd_cache_remove(pPath, pEntry);
+			trunk_fd_cache_free(pEntry);
+		}
+		pEntry = pPrev;
+	}
+}
+
+int trunk_fd_cache_open(const FDFSTrunkFullInfo *pTrunkInfo, \
+		const char *filename, int *fd)
+{
+	TrunkFdCachePath *pPath;
+	TrunkFdEntry *pEntry;
+	int new_fd;
+	int result;
+
+	if (fd_cache_paths == NULL)
+	{
+		return trunk_fd_cache_do_open(pTrunkInfo, filename, fd);
+	}
+
+	pPath = fd_cache_paths + pTrunkInfo->path.store_path_index;
+	pthread_mutex_lock(&(pPath->lock));
+	pEntry = trunk_fd_cache_find(pPath, pTrunkInfo->file.id);
+	if (pEntry != NULL)
+	{
+		pEntry->ref_count++;
+		trunk_fd_cache_lru_remove(pEntry);
+		trunk_fd_cache_lru_add(pPath, pEntry);
+		*fd = pEntry->fd;
+		pthread_mutex_unlock(&(pPath->lock));
+		return 0;
+	}
+	pthread_mutex_unlock(&(pPath->lock));
+
+	if ((result=trunk_fd_cache_do_open(pTrunkInfo, filename, \
+			&new_fd)) != 0)
+	{
+		return result;
+	}
+
+	if (new_fd >= fd_entry_count)
+	{
+		*fd = new_fd;  //not cached
+		return 0;
+	}
+
+	pthread_mutex_lock(&(pPath->lock));
+	pEntry = trunk_fd_cache_find(pPath, pTrunkInfo->file.id);
+	if (pEntry != NULL)  //opened by another thread
+	{
+		pEntry->ref_count++;
+		*fd = pEntry->fd;
+		pthread_mutex_unlock(&(pPath->lock));
+
+		close(new_fd);
+		return 0;
+	}
+
+	pEntry = (TrunkFdEntry *)malloc(sizeof(TrunkFdEntry));
+	if (pEntry == NULL)
+	{
+		pthread_mutex_unlock(&(pPath->lock));
+		*fd = new_fd;  //not cached
+		return 0;
+	}
+
+	pEntry->id = pTrunkInfo->file.id;
+	pEntry->fd = new_fd;
+	pEntry->ref_count = 1;
+	pEntry->store_path_index = pTrunkInfo->path.store_path_index;
+	pEntry->deleted = false;
+	pEntry->hash_next = *TRUNK_FD_BUCKET(pPath, pEntry->id);
+	*TRUNK_FD_BUCKET(pPath, pEntry->id) = pEntry;
+	trunk_fd_cache_lru_add(pPath, pEntry);
+	pPath->count++;
+	fd_entries[new_fd] = pEntry;
+
+	if (pPath->count > g_trunk_fd_cache_size)
+	{
+		trunk_fd_cache_evict(pPath);
+	}
+	pthread_mutex_unlock(&(pPath->lock));
+
+	*fd = new_fd;
+	return 0;
+}
+
+bool trunk_fd_cache_exists(const FDFSTrunkFullInfo *pTrunkInfo)
+{
+	TrunkFdCachePath *pPath;
+	bool exists;
+
+	if (fd_cache_paths == NULL)
+	{
+		return false;
+	}
+
+	pPath = fd_cache_paths + pTrunkInfo->path.store_path_index;
+	pthread_mutex_lock(&(pPath->lock));
+	exists = trunk_fd_cache_find(pPath, pTrunkInfo->file.id) != NULL;
+	pthread_mutex_unlock(&(pPath->lock));
+
+	return exists;
+}
+
+void trunk_fd_cache_close(const int fd)
+{
+	TrunkFdCachePath *pPath;
+	TrunkFdEntry *pEntry;
+
+	/* the entry of the fd in use is not changed by the other threads */
+	if (fd < 0 || fd >= fd_entry_count || \
+		(pEntry=fd_entries[fd]) == NULL)
+	{
+		close(fd);
+		return;
+	}
+
+	pPath = fd_cache_paths + pEntry->store_path_index;
+	pthread_mutex_lock(&(pPath->lock));
+	pEntry->ref_count--;
+	if (pEntry->ref_count == 0)
+	{
+		if (pEntry->deleted)
+		{
+			trunk_fd_cache_free(pEntry);
+		}
+		else if (pPath->count > g_trunk_fd_cache_size)
+		{
+			trunk_fd_cache_evict(pPath);
+		}
+	}
+	pthread_mutex_unlock(&(pPath->lock));
+}
+
+void trunk_fd_cache_delete(const FDFSTrunkFullInfo *pTrunkInfo)
+{
+	TrunkFdCachePath *pPath;
+	TrunkFdEntry *pEntry;
+
+	if (fd_cache_paths == NULL)
+	{
+		return;
+	}
+
+	pPath = fd_cache_paths + pTrunkInfo->path.store_path_index;
+	pthread_mutex_lock(&(pPath->lock));
+	pEntry = trunk_fd_cache_find(pPath, pTrunkInfo->file.id);
+	if (pEntry != NULL)
+	{
+		trunk_fd_cache_remove(pPath, pEntry);
+		if (pEntry->ref_count == 0)
+		{
+			trunk_fd_cache_free(pEntry);
+		}
+		else
+		{
+			pEntry->deleted = true;
+		}
+	}
+	pthread_mutex_unlock(&(pPath->lock));
+}
+
@@ -0,0 +1,50 @@
+/**
+* Copyright (C) 2008 Happy Fish / YuQing
+*
+* FastDFS may be copied only under the terms of the GNU General
+* Public License V3, which may be found in the FastDFS source kit.
+* Please visit the FastDFS Home Page http://www.csource.org/ for more detail.
+**/
+
+//trunk_fd_cache.h
+
+#ifndef _TRUNK_FD_CACHE_H_
+#define _TRUNK_FD_CACHE_H_
+
+#include "common_define.h"
+#include "trunk_shared.h"
+
+/* the fds of the trunk files are kept open in the LRU cache of each
+   store path (at most trunk_fd_cache_size fds per path). the fd is shared
+   by the dio threads, so the small files in the trunk file must be read
+   and written by pread/pwrite. the fd is referenced by the users, the fd
+   of the deleted trunk file is closed when the last user releases it */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int trunk_fd_cache_init();
+void trunk_fd_cache_destroy();
+
+/* get the fd of the trunk file, open and cache it when not cached,
+   the fd should be closed by trunk_fd_cache_close,
+   filename can be NULL */
+int trunk_fd_cache_open(const FDFSTrunkFullInfo *pTrunkInfo, \
+		const char *filename, int *fd);
+
+/* if the fd of the trunk file is cached (the trunk file is ready) */
+bool trunk_fd_cache_exists(const FDFSTrunkFullInfo *pTrunkInfo);
+
+/* release the cached fd, or close the fd when it is not cached */
+void trunk_fd_cache_close(const int fd);
+
+/* called before the trunk file is removed */
+void trunk_fd_cache_delete(const FDFSTrunkFullInfo *pTrunkInfo);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
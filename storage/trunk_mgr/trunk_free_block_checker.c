@@ -18,6 +18,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
 #include <errno.h>
 #include <time.h>
 #include "fdfs_define.h"
@@ -28,9 +29,14 @@
 #include "storage_global.h"
 #include "trunk_free_block_checker.h"
 
-#define TRUNK_FREE_BLOCK_ARRAY_INIT_SIZE  32
+#define TRUNK_FREE_BLOCK_PAGE_INIT_SIZE        4
+#define TRUNK_FREE_BLOCK_PAGE_ARRAY_INIT_SIZE  4
 
-static AVLTreeInfo tree_info_by_id = {NULL, NULL, NULL}; //for unique block nodes
+//for unique block nodes, the trunk files are spread to the shards by id
+static AVLTreeInfo trees_by_id[TRUNK_FREE_BLOCK_SHARD_COUNT];
+
+#define TRUNK_FREE_BLOCK_TREE(pTrunkInfo) (trees_by_id + \
+	TRUNK_FREE_BLOCK_SHARD_INDEX((pTrunkInfo)->file.id))
 
 static int storage_trunk_node_compare_entry(void *p1, void *p2)
 {
@@ -39,17 +45,40 @@ static int storage_trunk_node_compare_entry(void *p1, void *p2)
 			sizeof(FDFSTrunkFileIdentifier));
 }
 
+static void trunk_free_block_free_file(void *ptr)
+{
+	FDFSBlockArray *pArray;
+	int i;
+
+	pArray = &(((FDFSTrunksById *)ptr)->block_array);
+	for (i=0; i<pArray->page_count; i++)
+	{
+		free(pArray->pages[i].page);
+	}
+	if (pArray->pages != NULL)
+	{
+		free(pArray->pages);
+	}
+	free(ptr);
+}
+
 int trunk_free_block_checker_init()
 {
 	int result;
-	if ((result=avl_tree_init(&tree_info_by_id, free, \
-			storage_trunk_node_compare_entry)) != 0)
+	int i;
+
+	for (i=0; i<TRUNK_FREE_BLOCK_SHARD_COUNT; i++)
 	{
-		logError("file: "__FILE__", line: %d, " \
-			"avl_tree_init fail, " \
-			"errno: %d, error info: %s", \
-			__LINE__, result, STRERROR(result));
-		return result;
+		if ((result=avl_tree_init(trees_by_id + i, \
+			trunk_free_block_free_file, \
+			storage_trunk_node_compare_entry)) != 0)
+		{
+			logError("file: "__FILE__", line: %d, " \
+				"avl_tree_init fail, " \
+				"errno: %d, error info: %s", \
+				__LINE__, result, STRERROR(result));
+			return result;
+		}
 	}
 
 	return 0;
@@ -57,12 +86,25 @@ int trunk_free_block_checker_init()
 
 void trunk_free_block_checker_destroy()
 {
-	avl_tree_destroy(&tree_info_by_id);
+	int i;
+
+	for (i=0; i<TRUNK_FREE_BLOCK_SHARD_COUNT; i++)
+	{
+		avl_tree_destroy(trees_by_id + i);
+	}
 }
 
 int trunk_free_block_tree_node_count()
 {
-	return avl_tree_count(&tree_info_by_id);
+	int count;
+	int i;
+
+	count = 0;
+	for (i=0; i<TRUNK_FREE_BLOCK_SHARD_COUNT; i++)
+	{
+		count += avl_tree_count(trees_by_id + i);
+	}
+	return count;
 }
 
 static int block_tree_count_walk_callback(void *data, void *args)
@@ -77,8 +119,14 @@ static int block_tree_count_walk_callback(void *data, void *args)
 int trunk_free_block_total_count()
 {
 	int count;
+	int i;
+
 	count = 0;
-	avl_tree_walk(&tree_info_by_id, block_tree_count_walk_callback, &count);
+	for (i=0; i<TRUNK_FREE_BLOCK_SHARD_COUNT; i++)
+	{
+		avl_tree_walk(trees_by_id + i, \
+			block_tree_count_walk_callback, &count);
+	}
 	return count;
 }
 
@@ -87,222 +135,511 @@ int trunk_free_block_total_count()
 	memcpy(&(target.path), &(pTrunkInfo->path), sizeof(FDFSTrunkPathInfo));\
 	target.id = pTrunkInfo->file.id;
 
-int trunk_free_block_check_duplicate(FDFSTrunkFullInfo *pTrunkInfo)
+static inline uint32_t trunk_free_block_page_delta( \
+		const FDFSBlockPage *pPage, const int index)
 {
-	FDFSTrunkFileIdentifier target;
-	FDFSTrunksById *pFound;
-	FDFSTrunkFullInfo **blocks;
-	int end_offset;
+	switch (pPage->width)
+	{
+		case 1:
+			return ((const uint8_t *)pPage->deltas)[index];
+		case 2:
+			return ((const uint16_t *)pPage->deltas)[index];
+		default:
+			return ((const uint32_t *)pPage->deltas)[index];
+	}
+}
+
+#define PAGE_ID(pPage, index) ((pPage)->base_id + \
+	trunk_free_block_page_delta(pPage, index))
+
+#define PAGE_BLOCK(pPage, index) \
+	(&(TRUNK_NODE_BY_ID(PAGE_ID(pPage, index))->trunk))
+
+/* get the position of the last block whose offset <= the offset,
+   the index is -1 when the offset is less than the first block */
+static void trunk_free_block_locate(const FDFSBlockArray *pArray, \
+		const int offset, int *page_index, int *index)
+{
+	FDFSBlockPage *pPage;
 	int left;
 	int right;
 	int mid;
-	int result;
 
-	/*
-	char buff[256];
+	*page_index = 0;
+	left = 1;
+	right = pArray->page_count - 1;
+	while (left <= right)
+	{
+		mid = (left + right) / 2;
+		if (pArray->pages[mid].offset <= offset)
+		{
+			*page_index = mid;
+			left = mid + 1;
+		}
+		else
+		{
+			right = mid - 1;
+		}
+	}
+
+	*index = -1;
+	pPage = pArray->pages[*page_index].page;
+	left = 0;
+	right = pPage->count - 1;
+	while (left <= right)
+	{
+		mid = (left + right) / 2;
+		if (PAGE_BLOCK(pPage, mid)->file.offset <= offset)
+		{
+			*index = mid;
+			left = mid + 1;
+		}
+		else
+		{
+			right = mid - 1;
+		}
+	}
+}
+
+/* get the block at the position, the position can be the end of the page */
+static FDFSTrunkFullInfo *trunk_free_block_at(const FDFSBlockArray *pArray, \
+		int page_index, int index)
+{
+	if (index >= pArray->pages[page_index].page->count)
+	{
+		if (++page_index >= pArray->page_count)
+		{
+			return NULL;
+		}
+		index = 0;
+	}
 
-	logWarning("file: "__FILE__", line: %d, " \
-		"trunk entry: %s", __LINE__, \
-		trunk_info_dump(pTrunkInfo, buff, sizeof(buff)));
-	*/
+	return PAGE_BLOCK(pArray->pages[page_index].page, index);
+}
+
+int trunk_free_block_check_duplicate(FDFSTrunkFullInfo *pTrunkInfo)
+{
+	FDFSTrunkFileIdentifier target;
+	FDFSTrunksById *pFound;
+	FDFSTrunkFullInfo *pBlock;
+	int end_offset;
+	int page_index;
+	int index;
+	char buff1[256];
+	char buff2[256];
 
 	FILL_FILE_IDENTIFIER(target, pTrunkInfo);
 
-	pFound = (FDFSTrunksById *)avl_tree_find(&tree_info_by_id, &target);
-	if (pFound == NULL)
+	pFound = (FDFSTrunksById *)avl_tree_find( \
+			TRUNK_FREE_BLOCK_TREE(pTrunkInfo), &target);
+	if (pFound == NULL || pFound->block_array.count == 0)
 	{
 		return 0;
 	}
 
-	/*
+	trunk_free_block_locate(&(pFound->block_array), \
+		pTrunkInfo->file.offset, &page_index, &index);
+	if (index >= 0)
 	{
-		logWarning("file: "__FILE__", line: %d, " \
-			"ARRAY COUNT: %d, trunk entry: %s", \
-			__LINE__, pFound->block_array.count, \
-			trunk_info_dump(pTrunkInfo, buff, sizeof(buff)));
-	}
-	*/
+		pBlock = PAGE_BLOCK(pFound->block_array.pages[page_index].page,\
+				index);
+		if (pBlock->file.offset == pTrunkInfo->file.offset && \
+			pBlock->file.size == pTrunkInfo->file.size)
+		{
+			logWarning("file: "__FILE__", line: %d, " \
+				"node already exist, trunk entry: %s", \
+				__LINE__, trunk_info_dump(pTrunkInfo, \
+				buff1, sizeof(buff1)));
+			return EEXIST;
+		}
 
-	if (pFound->block_array.count == 0)
-	{
-		return 0;
+		if (pTrunkInfo->file.offset < pBlock->file.offset + \
+				pBlock->file.size)
+		{
+			logWarning("file: "__FILE__", line: %d, " \
+				"node overlap, current trunk entry: %s, " \
+				"existed trunk entry: %s", __LINE__, \
+				trunk_info_dump(pTrunkInfo, buff1, \
+				sizeof(buff1)), trunk_info_dump(pBlock, \
+				buff2, sizeof(buff2)));
+			return EEXIST;
+		}
 	}
 
-	blocks = pFound->block_array.blocks;
 	end_offset = pTrunkInfo->file.offset + pTrunkInfo->file.size;
-	if (end_offset <= blocks[0]->file.offset)
+	pBlock = trunk_free_block_at(&(pFound->block_array), \
+			page_index, index + 1);
+	if (pBlock != NULL && pBlock->file.offset < end_offset)
 	{
-		return 0;
+		logWarning("file: "__FILE__", line: %d, " \
+			"node overlap, current trunk entry: %s, " \
+			"existed trunk entry: %s", __LINE__, \
+			trunk_info_dump(pTrunkInfo, buff1, sizeof(buff1)), \
+			trunk_info_dump(pBlock, buff2, sizeof(buff2)));
+		return EEXIST;
 	}
 
-	right = pFound->block_array.count - 1;
-	if (pTrunkInfo->file.offset >= blocks[right]->file.offset + \
-				blocks[right]->file.size)
+	return 0;
+}
+
+#define PAGE_DELTA_MAX(width) ((width) == 1 ? UCHAR_MAX : \
+	((width) == 2 ? USHRT_MAX : UINT_MAX))
+
+#define PAGE_DELTA_WIDTH(span) ((span) <= UCHAR_MAX ? 1 : \
+	((span) <= USHRT_MAX ? 2 : 4))
+
+/* the alloc id count for the page grows to hold more ids */
+#define PAGE_GROW_SIZE(count) ((count) + (count) / 4 + 4 < \
+	TRUNK_FREE_BLOCK_PAGE_SIZE ? (count) + (count) / 4 + 4 : \
+	TRUNK_FREE_BLOCK_PAGE_SIZE)
+
+static inline bool trunk_free_block_page_fit(const FDFSBlockPage *pPage, \
+		const uint32_t id)
+{
+	if (pPage->count == 0)
 	{
-		return 0;
+		return true;
 	}
 
+	return id >= pPage->base_id && \
+		id - pPage->base_id <= PAGE_DELTA_MAX(pPage->width);
+}
 
-	result = 0;
-	mid = 0;
-	left = 0;
-	while (left <= right)
+/* set the id at the index, the id must fit the page */
+static inline void trunk_free_block_page_set(FDFSBlockPage *pPage, \
+		const int index, const uint32_t id)
+{
+	switch (pPage->width)
 	{
-		mid = (left + right) / 2;
-		if (pTrunkInfo->file.offset < blocks[mid]->file.offset)
-		{
-			if (blocks[mid]->file.offset < end_offset)
-			{
-				result = EEXIST;
-				break;
-			}
+		case 1:
+			((uint8_t *)pPage->deltas)[index] = \
+				id - pPage->base_id;
+			break;
+		case 2:
+			((uint16_t *)pPage->deltas)[index] = \
+				id - pPage->base_id;
+			break;
+		default:
+			((uint32_t *)pPage->deltas)[index] = \
+				id - pPage->base_id;
+			break;
+	}
+}
 
-			right = mid - 1;
+/* build the page with the ids of the two pages, the new id is only
+   counted for the base id and the delta width, put it by the caller */
+static FDFSBlockPage *trunk_free_block_page_build(const FDFSBlockPage *pSrc1, \
+		const int start1, const int count1, \
+		const FDFSBlockPage *pSrc2, const int count2, \
+		const uint32_t *pNewId, const int alloc)
+{
+	FDFSBlockPage *pPage;
+	uint32_t min_id;
+	uint32_t max_id;
+	uint32_t id;
+	int width;
+	int bytes;
+	int i;
+
+	if (pNewId != NULL)
+	{
+		min_id = max_id = *pNewId;
+	}
+	else
+	{
+		min_id = UINT_MAX;
+		max_id = 0;
+	}
+	for (i=start1; i<start1 + count1; i++)
+	{
+		id = PAGE_ID(pSrc1, i);
+		if (id < min_id)
+		{
+			min_id = id;
 		}
-		else if (pTrunkInfo->file.offset == blocks[mid]->file.offset)
+		if (id > max_id)
 		{
-			if (pTrunkInfo->file.size == blocks[mid]->file.size)
-			{
-				char buff[256];
-				logWarning("file: "__FILE__", line: %d, " \
-					"node already exist, trunk entry: %s", \
-					__LINE__, trunk_info_dump(pTrunkInfo, \
-					buff, sizeof(buff)));
-				return EEXIST;
-			}
-
-			result = EEXIST;
-			break;
+			max_id = id;
 		}
-		else
+	}
+	for (i=0; i<count2; i++)
+	{
+		id = PAGE_ID(pSrc2, i);
+		if (id < min_id)
 		{
-			if (pTrunkInfo->file.offset < (blocks[mid]->file.offset + \
-						blocks[mid]->file.size))
-			{
-				result = EEXIST;
-				break;
-			}
+			min_id = id;
+		}
+		if (id > max_id)
+		{
+			max_id = id;
+		}
+	}
+	if (min_id > max_id)
+	{
+		min_id = max_id = 0;
+	}
 
-			left = mid + 1;
+	width = PAGE_DELTA_WIDTH(max_id - min_id);
+	bytes = sizeof(FDFSBlockPage) + width * alloc;
+	pPage = (FDFSBlockPage *)malloc(bytes);
+	if (pPage == NULL)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"malloc %d bytes fail, " \
+			"errno: %d, error info: %s", __LINE__, \
+			bytes, errno, STRERROR(errno));
+		return NULL;
+	}
+
+	pPage->alloc = alloc;
+	pPage->count = count1 + count2;
+	pPage->width = width;
+	pPage->base_id = min_id;
+	for (i=0; i<count1; i++)
+	{
+		trunk_free_block_page_set(pPage, i, PAGE_ID(pSrc1, start1 + i));
+	}
+	for (i=0; i<count2; i++)
+	{
+		trunk_free_block_page_set(pPage, count1 + i, PAGE_ID(pSrc2, i));
+	}
+	return pPage;
+}
+
+/* put the id at the index of the page which count is less than the page
+   size, return the new page and the old page is freed when changed */
+static FDFSBlockPage *trunk_free_block_page_put(FDFSBlockPage *pPage, \
+		const int index, const uint32_t id)
+{
+	FDFSBlockPage *pNewPage;
+	int new_alloc;
+	int bytes;
+
+	if (pPage->count == 0)
+	{
+		pPage->base_id = id;
+	}
+
+	new_alloc = pPage->count < pPage->alloc ? pPage->alloc : \
+			PAGE_GROW_SIZE(pPage->count);
+	if (!trunk_free_block_page_fit(pPage, id))
+	{
+		pNewPage = trunk_free_block_page_build(pPage, 0, \
+				pPage->count, NULL, 0, &id, new_alloc);
+		if (pNewPage == NULL)
+		{
+			return NULL;
 		}
+		free(pPage);
+		pPage = pNewPage;
 	}
+	else if (new_alloc != pPage->alloc)
+	{
+		bytes = sizeof(FDFSBlockPage) + pPage->width * new_alloc;
+		pNewPage = (FDFSBlockPage *)realloc(pPage, bytes);
+		if (pNewPage == NULL)
+		{
+			logError("file: "__FILE__", line: %d, " \
+				"malloc %d bytes fail, " \
+				"errno: %d, error info: %s", __LINE__, \
+				bytes, errno, STRERROR(errno));
+			return NULL;
+		}
+		pPage = pNewPage;
+		pPage->alloc = new_alloc;
+	}
+
+	memmove(pPage->deltas + pPage->width * (index + 1), \
+		pPage->deltas + pPage->width * index, \
+		pPage->width * (pPage->count - index));
+	trunk_free_block_page_set(pPage, index, id);
+	pPage->count++;
+	return pPage;
+}
+
+/* insert the page entry at the index of the page array */
+static int trunk_free_block_page_insert(FDFSBlockArray *pArray, \
+		const int page_index, FDFSBlockPage *pPage, const int offset)
+{
+	FDFSBlockPageEntry *pages;
+	int new_alloc;
+	int result;
 
-	if (result != 0)
+	if (pArray->page_count >= pArray->alloc)
 	{
-		char buff1[256];
-		char buff2[256];
+		new_alloc = pArray->alloc == 0 ? \
+			TRUNK_FREE_BLOCK_PAGE_ARRAY_INIT_SIZE : \
+			2 * pArray->alloc;
+		pages = (FDFSBlockPageEntry *)realloc(pArray->pages, \
+				sizeof(FDFSBlockPageEntry) * new_alloc);
+		if (pages == NULL)
+		{
+			result = errno != 0 ? errno : ENOMEM;
+			logError("file: "__FILE__", line: %d, " \
+				"malloc %d bytes fail, " \
+				"errno: %d, error info: %s", __LINE__, \
+				(int)sizeof(FDFSBlockPageEntry) * new_alloc, \
+				result, STRERROR(result));
+			return result;
+		}
 
-		logWarning("file: "__FILE__", line: %d, " \
-			"node overlap, current trunk entry: %s, " \
-			"existed trunk entry: %s", __LINE__, \
-			trunk_info_dump(pTrunkInfo, buff1, sizeof(buff1)), \
-			trunk_info_dump(blocks[mid], buff2, sizeof(buff2)));
+		pArray->pages = pages;
+		pArray->alloc = new_alloc;
 	}
 
-	return result;
+	memmove(pArray->pages + page_index + 1, pArray->pages + page_index, \
+		sizeof(FDFSBlockPageEntry) * (pArray->page_count - page_index));
+	pArray->pages[page_index].offset = offset;
+	pArray->pages[page_index].page = pPage;
+	pArray->page_count++;
+	return 0;
+}
+
+static void trunk_free_block_page_remove(FDFSBlockArray *pArray, \
+		const int page_index)
+{
+	free(pArray->pages[page_index].page);
+	pArray->page_count--;
+	memmove(pArray->pages + page_index, pArray->pages + page_index + 1, \
+		sizeof(FDFSBlockPageEntry) * (pArray->page_count - page_index));
 }
 
-static int trunk_free_block_realloc(FDFSBlockArray *pArray, const int new_alloc)
+/* add the block to the new page at the index of the page array */
+static int trunk_free_block_new_page(FDFSBlockArray *pArray, \
+		const int page_index, FDFSTrunkFullInfo *pTrunkInfo)
 {
-	FDFSTrunkFullInfo **blocks;
+	FDFSBlockPage *pPage;
+	uint32_t id;
 	int result;
 
-	blocks = (FDFSTrunkFullInfo **)realloc(pArray->blocks, \
-			new_alloc * sizeof(FDFSTrunkFullInfo *));
-	if (blocks == NULL)
+	//the trunk info is the first field of the node
+	id = ((FDFSTrunkNode *)pTrunkInfo)->id;
+	pPage = trunk_free_block_page_build(NULL, 0, 0, NULL, 0, &id, \
+			TRUNK_FREE_BLOCK_PAGE_INIT_SIZE);
+	if (pPage == NULL)
 	{
-		result = errno != 0 ? errno : ENOMEM;
-		logError("file: "__FILE__", line: %d, " \
-			"malloc %d bytes fail, " \
-			"errno: %d, error info: %s", __LINE__, \
-			(int)(new_alloc * sizeof(FDFSTrunkFullInfo *)),
-			result, STRERROR(result));
+		return errno != 0 ? errno : ENOMEM;
+	}
+
+	if ((result=trunk_free_block_page_insert(pArray, page_index, pPage, \
+			pTrunkInfo->file.offset)) != 0)
+	{
+		free(pPage);
 		return result;
 	}
 
-	pArray->alloc = new_alloc;
-	pArray->blocks = blocks;
+	trunk_free_block_page_put(pPage, 0, id);
+	pArray->count++;
 	return 0;
 }
 
-static int trunk_free_block_do_insert(FDFSTrunkFullInfo *pTrunkInfo, \
-		FDFSBlockArray *pArray)
+/* split the full page to two pages, the halves are rebuilt for
+   the narrower delta width */
+static int trunk_free_block_split_page(FDFSBlockArray *pArray, \
+		const int page_index)
 {
-	int left;
-	int right;
-	int mid;
-	int pos;
+	FDFSBlockPage *pPage;
+	FDFSBlockPage *pLeft;
+	FDFSBlockPage *pRight;
+	int half;
 	int result;
 
-	if (pArray->count >= pArray->alloc)
+	pPage = pArray->pages[page_index].page;
+	half = pPage->count / 2;
+	pLeft = trunk_free_block_page_build(pPage, 0, half, \
+			NULL, 0, NULL, PAGE_GROW_SIZE(half));
+	if (pLeft == NULL)
 	{
-		if ((result=trunk_free_block_realloc(pArray, \
-			pArray->alloc == 0 ? TRUNK_FREE_BLOCK_ARRAY_INIT_SIZE \
-						 : 2 * pArray->alloc)) != 0)
-		{
-			return result;
-		}
+		return errno != 0 ? errno : ENOMEM;
+	}
+	pRight = trunk_free_block_page_build(pPage, half, pPage->count - half, \
+			NULL, 0, NULL, PAGE_GROW_SIZE(pPage->count - half));
+	if (pRight == NULL)
+	{
+		free(pLeft);
+		return errno != 0 ? errno : ENOMEM;
 	}
 
-	if (pArray->count == 0)
+	if ((result=trunk_free_block_page_insert(pArray, page_index + 1, \
+		pRight, PAGE_BLOCK(pRight, 0)->file.offset)) != 0)
 	{
-		pArray->blocks[pArray->count++] = pTrunkInfo;
-		return 0;
+		free(pLeft);
+		free(pRight);
+		return result;
 	}
 
-	if (pTrunkInfo->file.offset < pArray->blocks[0]->file.offset)
+	free(pPage);
+	pArray->pages[page_index].page = pLeft;
+	return 0;
+}
+
+static int trunk_free_block_do_insert(FDFSTrunkFullInfo *pTrunkInfo, \
+		FDFSBlockArray *pArray)
+{
+	FDFSBlockPage *pPage;
+	int page_index;
+	int index;
+	int pos;
+	int result;
+	char buff[256];
+
+	if (pArray->page_count == 0)
 	{
-		memmove(&(pArray->blocks[1]), &(pArray->blocks[0]), \
-			pArray->count * sizeof(FDFSTrunkFullInfo *));
-		pArray->blocks[0] = pTrunkInfo;
-		pArray->count++;
-		return 0;
+		return trunk_free_block_new_page(pArray, 0, pTrunkInfo);
 	}
 
-	right = pArray->count - 1;
-	if (pTrunkInfo->file.offset > pArray->blocks[right]->file.offset)
+	trunk_free_block_locate(pArray, pTrunkInfo->file.offset, \
+			&page_index, &index);
+	pPage = pArray->pages[page_index].page;
+	if (index >= 0 && PAGE_BLOCK(pPage, index)->file.offset == \
+			pTrunkInfo->file.offset)
 	{
-		pArray->blocks[pArray->count++] = pTrunkInfo;
-		return 0;
+		logWarning("file: "__FILE__", line: %d, " \
+			"node already exist, trunk entry: %s", \
+			__LINE__, trunk_info_dump(pTrunkInfo, \
+			buff, sizeof(buff)));
+		return EEXIST;
 	}
 
-	left = 0;
-	mid = 0;
-	while (left <= right)
+	pos = index + 1;
+	if (pPage->count >= TRUNK_FREE_BLOCK_PAGE_SIZE)
 	{
-		mid = (left + right) / 2;
-		if (pArray->blocks[mid]->file.offset > pTrunkInfo->file.offset)
+		if (pos == pPage->count && \
+			page_index == pArray->page_count - 1)
 		{
-			right = mid - 1;
+			/* the blocks are loaded in the order of the offset,
+			   so keep the full page when appending */
+			return trunk_free_block_new_page(pArray, \
+					page_index + 1, pTrunkInfo);
 		}
-		else if (pArray->blocks[mid]->file.offset == \
-			pTrunkInfo->file.offset)
+
+		if ((result=trunk_free_block_split_page(pArray, \
+				page_index)) != 0)
 		{
-			char buff[256];
-			logWarning("file: "__FILE__", line: %d, " \
-				"node already exist, trunk entry: %s", \
-				__LINE__, trunk_info_dump(pTrunkInfo, \
-				buff, sizeof(buff)));
-			return EEXIST;
+			return result;
 		}
-		else
+
+		pPage = pArray->pages[page_index].page;
+		if (pos > pPage->count)
 		{
-			left = mid + 1;
+			pos -= pPage->count;
+			page_index++;
+			pPage = pArray->pages[page_index].page;
 		}
 	}
 
-	if (pTrunkInfo->file.offset < pArray->blocks[mid]->file.offset)
+	//the trunk info is the first field of the node
+	pPage = trunk_free_block_page_put(pPage, pos, \
+			((FDFSTrunkNode *)pTrunkInfo)->id);
+	if (pPage == NULL)
 	{
-		pos = mid;
+		return errno != 0 ? errno : ENOMEM;
 	}
-	else
+	pArray->pages[page_index].page = pPage;
+	if (pos == 0)
 	{
-		pos = mid + 1;
+		pArray->pages[page_index].offset = pTrunkInfo->file.offset;
 	}
-
-	memmove(&(pArray->blocks[pos + 1]), &(pArray->blocks[pos]), \
-			(pArray->count - pos) * sizeof(FDFSTrunkFullInfo *));
-	pArray->blocks[pos] = pTrunkInfo;
 	pArray->count++;
 	return 0;
 }
@@ -315,7 +652,8 @@ int trunk_free_block_insert(FDFSTrunkFullInfo *pTrunkInfo)
 
 	FILL_FILE_IDENTIFIER(target, pTrunkInfo);
 
-	pTrunksById = (FDFSTrunksById *)avl_tree_find(&tree_info_by_id, &target);
+	pTrunksById = (FDFSTrunksById *)avl_tree_find( \
+			TRUNK_FREE_BLOCK_TREE(pTrunkInfo), &target);
 	if (pTrunksById == NULL)
 	{
 		pTrunksById = (FDFSTrunksById *)malloc(sizeof(FDFSTrunksById));
@@ -333,13 +671,15 @@ int trunk_free_block_insert(FDFSTrunkFullInfo *pTrunkInfo)
 		memset(pTrunksById, 0, sizeof(FDFSTrunksById));
 		memcpy(&(pTrunksById->trunk_file_id), &target, \
 			sizeof(FDFSTrunkFileIdentifier));
-		if (avl_tree_insert(&tree_info_by_id, pTrunksById) != 1)
+		if (avl_tree_insert(TRUNK_FREE_BLOCK_TREE(pTrunkInfo), \
+			pTrunksById) != 1)
 		{
 			result = errno != 0 ? errno : ENOMEM;
 			logError("file: "__FILE__", line: %d, " \
 				"avl_tree_insert fail, " \
 				"errno: %d, error info: %s", \
 				__LINE__, result, STRERROR(result));
+			free(pTrunksById);
 			return result;
 		}
 	}
@@ -348,20 +688,70 @@ int trunk_free_block_insert(FDFSTrunkFullInfo *pTrunkInfo)
 				&(pTrunksById->block_array));
 }
 
+/* merge the page with the next page when both are less than half full,
+   or shrink the page, the page is rebuilt for the narrower delta width */
+static void trunk_free_block_pack_page(FDFSBlockArray *pArray, \
+		int page_index)
+{
+	FDFSBlockPage *pPage;
+	FDFSBlockPage *pNext;
+	FDFSBlockPage *pNewPage;
+	int new_alloc;
+
+	if (page_index == pArray->page_count - 1 && page_index > 0)
+	{
+		page_index--;
+	}
+
+	pPage = pArray->pages[page_index].page;
+	if (page_index + 1 < pArray->page_count)
+	{
+		pNext = pArray->pages[page_index + 1].page;
+		if (pPage->count + pNext->count <= \
+			TRUNK_FREE_BLOCK_PAGE_SIZE / 2)
+		{
+			pNewPage = trunk_free_block_page_build(pPage, 0, \
+				pPage->count, pNext, pNext->count, NULL, \
+				PAGE_GROW_SIZE(pPage->count + pNext->count));
+			if (pNewPage == NULL)
+			{
+				return;
+			}
+
+			free(pPage);
+			pArray->pages[page_index].page = pNewPage;
+			trunk_free_block_page_remove(pArray, page_index + 1);
+			return;
+		}
+	}
+
+	new_alloc = PAGE_GROW_SIZE(pPage->count);
+	if (pPage->count < pPage->alloc / 2 && new_alloc < pPage->alloc)
+	{
+		pNewPage = trunk_free_block_page_build(pPage, 0, pPage->count, \
+				NULL, 0, NULL, new_alloc);
+		if (pNewPage != NULL)
+		{
+			free(pPage);
+			pArray->pages[page_index].page = pNewPage;
+		}
+	}
+}
+
 int trunk_free_block_delete(FDFSTrunkFullInfo *pTrunkInfo)
 {
-	int result;
-	int left;
-	int right;
-	int mid;
-	int move_count;
 	FDFSTrunkFileIdentifier target;
 	FDFSTrunksById *pTrunksById;
+	FDFSBlockArray *pArray;
+	FDFSBlockPage *pPage;
+	int page_index;
+	int index;
 	char buff[256];
 
 	FILL_FILE_IDENTIFIER(target, pTrunkInfo);
 
-	pTrunksById = (FDFSTrunksById *)avl_tree_find(&tree_info_by_id, &target);
+	pTrunksById = (FDFSTrunksById *)avl_tree_find( \
+			TRUNK_FREE_BLOCK_TREE(pTrunkInfo), &target);
 	if (pTrunksById == NULL)
 	{
 		logWarning("file: "__FILE__", line: %d, " \
@@ -371,55 +761,36 @@ int trunk_free_block_delete(FDFSTrunkFullInfo *pTrunkInfo)
 		return ENOENT;
 	}
 
-	result = ENOENT;
-	mid = 0;
-	left = 0;
-	right = pTrunksById->block_array.count - 1;
-	while (left <= right)
+	pArray = &(pTrunksById->block_array);
+	index = -1;
+	if (pArray->page_count > 0)
 	{
-		mid = (left + right) / 2;
-		if (pTrunksById->block_array.blocks[mid]->file.offset > \
-				pTrunkInfo->file.offset)
-		{
-			right = mid - 1;
-		}
-		else if (pTrunksById->block_array.blocks[mid]->file.offset == \
-				pTrunkInfo->file.offset)
-		{
-			result = 0;
-			break;
-		}
-		else
-		{
-			left = mid + 1;
-		}
+		trunk_free_block_locate(pArray, pTrunkInfo->file.offset, \
+			&page_index, &index);
 	}
-
-	if (result == ENOENT)
+	if (index < 0 || PAGE_BLOCK(pArray->pages[page_index].page, \
+			index)->file.offset != pTrunkInfo->file.offset)
 	{
 		logWarning("file: "__FILE__", line: %d, " \
 			"trunk node NOT exist, trunk entry: %s", \
 			__LINE__, trunk_info_dump(pTrunkInfo, \
 			buff, sizeof(buff)));
-		return result;
+		return ENOENT;
 	}
 
-	move_count = pTrunksById->block_array.count - (mid + 1);
-	if (move_count > 0)
-	{
-		memmove(&(pTrunksById->block_array.blocks[mid]), \
-			&(pTrunksById->block_array.blocks[mid + 1]), \
-			move_count * sizeof(FDFSTrunkFullInfo *));
-	}
-	pTrunksById->block_array.count--;
+	pPage = pArray->pages[page_index].page;
+	pPage->count--;
+	memmove(pPage->deltas + pPage->width * index, \
+		pPage->deltas + pPage->width * (index + 1), \
+		pPage->width * (pPage->count - index));
+	pArray->count--;
 
-	if (pTrunksById->block_array.count == 0)
+	if (pArray->count == 0)
 	{
-		free(pTrunksById->block_array.blocks);
-		if (avl_tree_delete(&tree_info_by_id, pTrunksById) != 1)
+		if (avl_tree_delete(TRUNK_FREE_BLOCK_TREE(pTrunkInfo), \
+			pTrunksById) != 1)
 		{
-			memset(&(pTrunksById->block_array), 0, \
-				sizeof(FDFSBlockArray));
+			trunk_free_block_page_remove(pArray, page_index);
 			logWarning("file: "__FILE__", line: %d, " \
 				"can't delete block node, trunk info: %s", \
 				__LINE__, trunk_info_dump(pTrunkInfo, buff, \
@@ -427,96 +798,163 @@ int trunk_free_block_delete(FDFSTrunkFullInfo *pTrunkInfo)
 			return ENOENT;
 		}
 	}
+	else if (pPage->count == 0)
+	{
+		trunk_free_block_page_remove(pArray, page_index);
+	}
 	else
 	{
-		if ((pTrunksById->block_array.count < \
-			pTrunksById->block_array.alloc / 2) && \
-		    (pTrunksById->block_array.count > \
-			TRUNK_FREE_BLOCK_ARRAY_INIT_SIZE / 2)) //small the array
+		if (index == 0)
 		{
-			if ((result=trunk_free_block_realloc( \
-				&(pTrunksById->block_array), \
-				pTrunksById->block_array.alloc / 2)) != 0)
-			{
-				return result;
-			}
+			pArray->pages[page_index].offset = \
+				PAGE_BLOCK(pPage, 0)->file.offset;
 		}
+		trunk_free_block_pack_page(pArray, page_index);
 	}
 
 	return 0;
 }
 
-static int block_tree_print_walk_callback(void *data, void *args)
+void trunk_free_block_find_neighbours(const FDFSTrunkFullInfo *pTrunkInfo, \
+		FDFSTrunkFullInfo **ppLeft, FDFSTrunkFullInfo **ppRight)
 {
-	FILE *fp;
-	FDFSBlockArray *pArray;
-	FDFSTrunkFullInfo **pp;
-	FDFSTrunkFullInfo **ppEnd;
-
-	fp = (FILE *)args;
-	pArray = &(((FDFSTrunksById *)data)->block_array);
-
-	/*
+	FDFSTrunksById *pTrunksById;
+	FDFSTrunkFullInfo *pBlock;
+	int page_index;
+	int index;
+
+	*ppLeft = NULL;
+	*ppRight = NULL;
+	pTrunksById = trunk_free_block_get_file(pTrunkInfo);
+	if (pTrunksById == NULL || pTrunksById->block_array.count == 0)
 	{
-	FDFSTrunkFileIdentifier *pFileIdentifier;
-	pFileIdentifier = &(((FDFSTrunksById *)data)->trunk_file_id);
+		return;
+	}
 
-	fprintf(fp, "%d %d %d %d %d", \
-			pFileIdentifier->path.store_path_index, \
-			pFileIdentifier->path.sub_path_high, \
-			pFileIdentifier->path.sub_path_low, \
-			pFileIdentifier->id, pArray->count);
-	if (pArray->count > 0)
+	trunk_free_block_locate(&(pTrunksById->block_array), \
+		pTrunkInfo->file.offset, &page_index, &index);
+	if (index >= 0)
 	{
-		fprintf(fp, " %d", pArray->blocks[0]->file.offset);
-		if (pArray->count > 1)
+		pBlock = PAGE_BLOCK(pTrunksById->block_array.pages[ \
+				page_index].page, index);
+		if (pBlock->file.offset + pBlock->file.size == \
+			pTrunkInfo->file.offset)
 		{
-			fprintf(fp, " %d", pArray->blocks[pArray->count-1]-> \
-				file.offset + pArray->blocks[pArray->count-1]->\
-				file.size);
+			*ppLeft = pBlock;
 		}
 	}
-	fprintf(fp, "\n");
-	return 0;
-	}
-	*/
 
-	/*
-	{
-	FDFSTrunkFullInfo **ppPrevious;
-	if (pArray->count <= 1)
+	pBlock = trunk_free_block_at(&(pTrunksById->block_array), \
+			page_index, index + 1);
+	if (pBlock != NULL && pBlock->file.offset == \
+		pTrunkInfo->file.offset + pTrunkInfo->file.size)
 	{
-		return 0;
+		*ppRight = pBlock;
 	}
-	ppPrevious = pArray->blocks;
-	ppEnd = pArray->blocks + pArray->count;
-	for (pp=pArray->blocks + 1; pp<ppEnd; pp++)
+}
+
+FDFSTrunksById *trunk_free_block_get_file(const FDFSTrunkFullInfo *pTrunkInfo)
+{
+	FDFSTrunkFileIdentifier target;
+
+	FILL_FILE_IDENTIFIER(target, pTrunkInfo);
+	return (FDFSTrunksById *)avl_tree_find( \
+			TRUNK_FREE_BLOCK_TREE(pTrunkInfo), &target);
+}
+
+FDFSTrunkFullInfo *trunk_free_block_first(const FDFSTrunksById *pTrunksById, \
+		FDFSBlockIterator *pIterator)
+{
+	pIterator->pArray = &(pTrunksById->block_array);
+	pIterator->page_index = 0;
+	pIterator->index = -1;
+	return trunk_free_block_next(pIterator);
+}
+
+FDFSTrunkFullInfo *trunk_free_block_next(FDFSBlockIterator *pIterator)
+{
+	FDFSBlockPage *pPage;
+
+	pIterator->index++;
+	while (pIterator->page_index < pIterator->pArray->page_count)
 	{
-		if ((*ppPrevious)->file.offset >= (*pp)->file.offset)
+		pPage = pIterator->pArray->pages[pIterator->page_index].page;
+		if (pIterator->index < pPage->count)
 		{
-			fprintf(fp, "%d %d %d %d %d %d\n", \
-				(*ppPrevious)->path.store_path_index, \
-				(*ppPrevious)->path.sub_path_high, (*ppPrevious)->path.sub_path_low, \
-				(*ppPrevious)->file.id, (*ppPrevious)->file.offset, (*ppPrevious)->file.size);
-
-			fprintf(fp, "%d %d %d %d %d %d\n", \
-				(*pp)->path.store_path_index, \
-				(*pp)->path.sub_path_high, (*pp)->path.sub_path_low, \
-				(*pp)->file.id, (*pp)->file.offset, (*pp)->file.size);
+			return PAGE_BLOCK(pPage, pIterator->index);
 		}
-		ppPrevious = pp;
+
+		pIterator->page_index++;
+		pIterator->index = 0;
 	}
-	return 0;
+
+	return NULL;
+}
+
+FDFSTrunkFullInfo *trunk_free_block_find(const FDFSTrunkFullInfo *pTrunkInfo)
+{
+	FDFSTrunksById *pTrunksById;
+	FDFSTrunkFullInfo *pBlock;
+	int page_index;
+	int index;
+
+	pTrunksById = trunk_free_block_get_file(pTrunkInfo);
+	if (pTrunksById == NULL || pTrunksById->block_array.count == 0)
+	{
+		return NULL;
+	}
+
+	trunk_free_block_locate(&(pTrunksById->block_array), \
+		pTrunkInfo->file.offset, &page_index, &index);
+	if (index < 0)
+	{
+		return NULL;
 	}
-	*/
 
-	ppEnd = pArray->blocks + pArray->count;
-	for (pp=pArray->blocks; pp<ppEnd; pp++)
+	pBlock = PAGE_BLOCK(pTrunksById->block_array.pages[page_index].page, \
+			index);
+	return pBlock->file.offset == pTrunkInfo->file.offset ? pBlock : NULL;
+}
+
+struct block_walk_callback_args
+{
+	TrunkFreeBlockWalkFunc walk_func;
+	void *args;
+};
+
+static int block_tree_file_walk_callback(void *data, void *args)
+{
+	struct block_walk_callback_args *pWalkArgs;
+
+	pWalkArgs = (struct block_walk_callback_args *)args;
+	return pWalkArgs->walk_func((FDFSTrunksById *)data, pWalkArgs->args);
+}
+
+int trunk_free_block_walk_files(const int shard_index, \
+		TrunkFreeBlockWalkFunc walk_func, void *args)
+{
+	struct block_walk_callback_args walk_args;
+
+	walk_args.walk_func = walk_func;
+	walk_args.args = args;
+	return avl_tree_walk(trees_by_id + shard_index, \
+			block_tree_file_walk_callback, &walk_args);
+}
+
+static int block_tree_print_walk_callback(void *data, void *args)
+{
+	FILE *fp;
+	FDFSBlockIterator iterator;
+	FDFSTrunkFullInfo *pBlock;
+
+	fp = (FILE *)args;
+	for (pBlock=trunk_free_block_first((FDFSTrunksById *)data, &iterator);
+		pBlock!=NULL; pBlock=trunk_free_block_next(&iterator))
 	{
 		fprintf(fp, "%d %d %d %d %d %d\n", \
-			(*pp)->path.store_path_index, \
-			(*pp)->path.sub_path_high, (*pp)->path.sub_path_low, \
-			(*pp)->file.id, (*pp)->file.offset, (*pp)->file.size);
+			pBlock->path.store_path_index, \
+			pBlock->path.sub_path_high, pBlock->path.sub_path_low, \
+			pBlock->file.id, pBlock->file.offset, pBlock->file.size);
 	}
 
 	return 0;
@@ -526,6 +964,7 @@ int trunk_free_block_tree_print(const char *filename)
 {
 	FILE *fp;
 	int result;
+	int i;
 
 	fp = fopen(filename, "w");
 	if (fp == NULL)
@@ -538,8 +977,46 @@ int trunk_free_block_tree_print(const char *filename)
 		return result;
 	}
 
-	avl_tree_walk(&tree_info_by_id, block_tree_print_walk_callback, fp);
+	for (i=0; i<TRUNK_FREE_BLOCK_SHARD_COUNT; i++)
+	{
+		avl_tree_walk(trees_by_id + i, \
+			block_tree_print_walk_callback, fp);
+	}
 	fclose(fp);
 	return 0;
 }
 
+
+static int block_tree_memory_walk_callback(void *data, void *args)
+{
+	FDFSBlockArray *pArray;
+	int64_t *pBytes;
+	int i;
+
+	pArray = &(((FDFSTrunksById *)data)->block_array);
+	pBytes = (int64_t *)args;
+	*pBytes += sizeof(AVLTreeNode) + sizeof(FDFSTrunksById) + \
+		sizeof(FDFSBlockPageEntry) * pArray->alloc;
+	for (i=0; i<pArray->page_count; i++)
+	{
+		*pBytes += sizeof(FDFSBlockPage) + \
+			pArray->pages[i].page->width * \
+			pArray->pages[i].page->alloc;
+	}
+
+	return 0;
+}
+
+int64_t trunk_free_block_memory_usage()
+{
+	int64_t bytes;
+	int i;
+
+	bytes = 0;
+	for (i=0; i<TRUNK_FREE_BLOCK_SHARD_COUNT; i++)
+	{
+		avl_tree_walk(trees_by_id + i, \
+			block_tree_memory_walk_callback, &bytes);
+	}
+	return bytes;
+}
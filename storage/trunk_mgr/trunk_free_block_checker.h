@@ -19,6 +19,15 @@
 #include "fdfs_global.h"
 #include "tracker_types.h"
 #include "trunk_shared.h"
+#include "trunk_node_pool.h"
+
+/* the trunk files are spread to the shards by the file id, the blocks of
+   different shards can be changed at the same time, the caller should
+   hold the lock of the shard */
+#define TRUNK_FREE_BLOCK_SHARD_COUNT  16
+
+#define TRUNK_FREE_BLOCK_SHARD_INDEX(file_id) \
+	((unsigned int)(file_id) % TRUNK_FREE_BLOCK_SHARD_COUNT)
 
 #ifdef __cplusplus
 extern "C" {
@@ -29,12 +38,39 @@ typedef struct {
 	int id;                  //trunk file id
 } FDFSTrunkFileIdentifier;
 
+/* the blocks of a trunk file are kept in the pages sorted by the offset,
+   the page holds the ids of the nodes (see trunk_node_pool.h) as the
+   deltas to the min id of the page, the delta takes 1, 2 or 4 bytes by
+   the id span of the page. the page is rebuilt when split, merged or
+   shrunk, so the delta width does not depend on the insert order */
+#define TRUNK_FREE_BLOCK_PAGE_SIZE  256
+
+typedef struct {
+	uint16_t alloc;  //alloc id count
+	uint16_t count;  //id count
+	char width;      //the bytes of the delta: 1, 2 or 4
+	uint32_t base_id;  //the min id of the page
+	char deltas[0];  //id - base_id, sort by FDFSTrunkFullInfo.file.offset
+} FDFSBlockPage;
+
+typedef struct {
+	int offset;  //the offset of the first block in the page
+	FDFSBlockPage *page;
+} FDFSBlockPageEntry;
+
 typedef struct {
-	int alloc;  //alloc block count
-	int count;  //block count
-	FDFSTrunkFullInfo **blocks;   //sort by FDFSTrunkFullInfo.file.offset
+	int alloc;       //alloc page count
+	int page_count;  //page count
+	int count;       //block count
+	FDFSBlockPageEntry *pages;  //sort by the offset
 } FDFSBlockArray;
 
+typedef struct {
+	const FDFSBlockArray *pArray;
+	int page_index;
+	int index;
+} FDFSBlockIterator;
+
 typedef struct {
 	FDFSTrunkFileIdentifier trunk_file_id;
 	FDFSBlockArray block_array;
@@ -50,8 +86,35 @@ int trunk_free_block_check_duplicate(FDFSTrunkFullInfo *pTrunkInfo);
 int trunk_free_block_insert(FDFSTrunkFullInfo *pTrunkInfo);
 int trunk_free_block_delete(FDFSTrunkFullInfo *pTrunkInfo);
 
+/* find the free blocks just before and after the block in the same
+   trunk file, NULL when not found */
+void trunk_free_block_find_neighbours(const FDFSTrunkFullInfo *pTrunkInfo, \
+		FDFSTrunkFullInfo **ppLeft, FDFSTrunkFullInfo **ppRight);
+
+/* get the blocks of the trunk file, NULL when not found */
+FDFSTrunksById *trunk_free_block_get_file(const FDFSTrunkFullInfo *pTrunkInfo);
+
+/* iterate the blocks of the trunk file in the order of the offset,
+   NULL when no more block, the blocks can't be changed during the walk */
+FDFSTrunkFullInfo *trunk_free_block_first(const FDFSTrunksById *pTrunksById, \
+		FDFSBlockIterator *pIterator);
+FDFSTrunkFullInfo *trunk_free_block_next(FDFSBlockIterator *pIterator);
+
+/* get the block at the same offset, NULL when not found */
+FDFSTrunkFullInfo *trunk_free_block_find(const FDFSTrunkFullInfo *pTrunkInfo);
+
+typedef int (*TrunkFreeBlockWalkFunc)(FDFSTrunksById *pTrunksById, \
+		void *args);
+
+/* walk the trunk files of the shard */
+int trunk_free_block_walk_files(const int shard_index, \
+		TrunkFreeBlockWalkFunc walk_func, void *args);
+
 int trunk_free_block_tree_print(const char *filename);
 
+/* the memory bytes of the pages */
+int64_t trunk_free_block_memory_usage();
+
 #ifdef __cplusplus
 }
 #endif
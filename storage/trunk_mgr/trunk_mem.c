@@ -10,6 +10,7 @@
 
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/time.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
@@ -26,6 +27,7 @@
 #include "pthread_func.h"
 #include "sched_thread.h"
 #include "avl_tree.h"
+#include "hash.h"
 #include "tracker_types.h"
 #include "tracker_proto.h"
 #include "storage_global.h"
@@ -34,6 +36,11 @@
 #include "trunk_sync.h"
 #include "storage_dio.h"
 #include "trunk_free_block_checker.h"
+#include "trunk_redirect.h"
+#include "trunk_size_class.h"
+#include "trunk_node_pool.h"
+#include "trunk_snapshot.h"
+#include "trunk_fd_cache.h"
 #include "trunk_mem.h"
 
 #define STORAGE_TRUNK_DATA_FILENAME  "storage_trunk.dat"
@@ -66,13 +73,81 @@ int64_t g_trunk_create_file_space_threshold = 0;
 time_t g_trunk_last_compress_time = 0;
 
 static pthread_mutex_t trunk_file_lock;
-static pthread_mutex_t trunk_mem_lock;
-static struct fast_mblock_man free_blocks_man;
-static struct fast_mblock_man tree_nodes_man;
-
-static AVLTreeInfo *tree_info_by_sizes = NULL; //for block alloc
-
-static int trunk_create_next_file(FDFSTrunkFullInfo *pTrunkInfo);
+static pthread_mutex_t trunk_create_lock;  //the trunk file creation by alloc
+
+/* the snapshot is written by the checkpoint thread and at exit,
+   the lock is not destroyed as the checkpoint thread may be waiting */
+static pthread_mutex_t trunk_save_lock;
+static bool trunk_save_lock_inited = false;
+static int64_t trunk_saved_binlog_offset = -1;
+
+/* the trunk files are spread to the shards by the file id as the block
+   checker does, so the blocks of a trunk file (the merge, the split and
+   the compaction) are changed under the lock of one shard */
+typedef struct {
+	pthread_mutex_t lock;
+	FDFSTrunkSizeClasses *size_classes;  //the free blocks per store path
+	int alloc_running;  //the nodes taken by trunk_alloc_space
+
+	/* the free blocks of the trunk file being compacted are kept out of
+	   the size classes, so the space in this file can't be allocated */
+	bool compact_retired;
+	FDFSTrunkFullInfo compact_file;
+	HashArray lease_hash;   //trunk file id => the last lease time
+	HashArray leases;       //lease id => FDFSTrunkLeaseInfo
+} TrunkAllocShard;
+
+static TrunkAllocShard trunk_shards[TRUNK_FREE_BLOCK_SHARD_COUNT];
+
+/* the allocation rate of the store path is sampled every interval, the
+   free trunk space is kept to cover trunk_create_file_runway seconds at
+   the peak rate of the last samples, protected by trunk_file_lock */
+#define TRUNK_RUNWAY_SAMPLE_COUNT       60
+#define TRUNK_RUNWAY_CREATE_MAX_FILES    8  //the max files per round
+
+/* the allocation finding no free block while the other threads are
+   splitting the blocks taken out waits for the rest space of them,
+   the thread finished the split bumps the version and signals */
+#define TRUNK_ALLOC_WAIT_SPLIT_MS      10  //the max time to wait
+static pthread_mutex_t trunk_split_lock;
+static pthread_cond_t trunk_split_cond;
+static int64_t trunk_split_version = 0;
+static int trunk_split_waiters = 0;
+
+typedef struct {
+	int64_t free_space;   //the free trunk space of the store path
+	int64_t alloc_bytes;  //the allocated bytes since started
+	int64_t last_alloc_bytes;
+	time_t last_sample_time;
+	int rate_index;
+	int64_t peak_rate;    //bytes per second
+	int64_t rates[TRUNK_RUNWAY_SAMPLE_COUNT];
+} TrunkPathRunway;
+
+static TrunkPathRunway *trunk_path_runways = NULL;
+static time_t trunk_init_done_time = 0;
+
+/* the last lease id, the leases are recorded in the binlog (L and E)
+   and the snapshot, so the lease is returned only once */
+static int64_t trunk_lease_id = 0;
+
+/* the shard which the allocation of the thread starts from */
+static __thread int trunk_shard_hint = -1;
+static int trunk_shard_hint_seq = 0;
+
+#define TRUNK_SHARD(pTrunkInfo) (trunk_shards + \
+	TRUNK_FREE_BLOCK_SHARD_INDEX((pTrunkInfo)->file.id))
+
+#define TRUNK_SIZE_CLASSES(pShard, pTrunkInfo) \
+	((pShard)->size_classes + (pTrunkInfo)->path.store_path_index)
+
+#define TRUNK_IS_RETIRED_FILE(pShard, pTrunkInfo) \
+	((pShard)->compact_retired && (pTrunkInfo)->file.id == \
+	 (pShard)->compact_file.file.id && memcmp(&((pTrunkInfo)->path), \
+	 &((pShard)->compact_file.path), sizeof(FDFSTrunkPathInfo)) == 0)
+
+static int trunk_create_next_file(FDFSTrunkFullInfo *pTrunkInfo, \
+		const bool bPreallocate);
 static int trunk_add_free_block(FDFSTrunkNode *pNode, const bool bWriteBinLog);
 
 static int trunk_restore_node(const FDFSTrunkFullInfo *pTrunkInfo);
@@ -82,28 +157,34 @@ static int trunk_delete_space(const FDFSTrunkFullInfo *pTrunkInfo, \
 static int storage_trunk_save();
 static int storage_trunk_load();
 
+static int trunk_lease_restore(const FDFSTrunkLeaseInfo *pLease);
+static bool trunk_lease_remove(const FDFSTrunkFullInfo *pTrunkInfo, \
+		const int64_t lease_id);
+
+static void trunk_add_free_space(const FDFSTrunkFullInfo *pTrunk, \
+		const int64_t size)
+{
+	pthread_mutex_lock(&trunk_file_lock);
+	g_trunk_total_free_space += size;
+	trunk_path_runways[pTrunk->path.store_path_index].free_space += size;
+	pthread_mutex_unlock(&trunk_file_lock);
+}
+
 static int trunk_mem_binlog_write(const int timestamp, const char op_type, \
 		const FDFSTrunkFullInfo *pTrunk)
 {
-	pthread_mutex_lock(&trunk_file_lock);
 	if (op_type == TRUNK_OP_TYPE_ADD_SPACE)
 	{
-		g_trunk_total_free_space += pTrunk->file.size;
+		trunk_add_free_space(pTrunk, pTrunk->file.size);
 	}
 	else if (op_type == TRUNK_OP_TYPE_DEL_SPACE)
 	{
-		g_trunk_total_free_space -= pTrunk->file.size;
+		trunk_add_free_space(pTrunk, -1 * pTrunk->file.size);
 	}
-	pthread_mutex_unlock(&trunk_file_lock);
 
 	return trunk_binlog_write(timestamp, op_type, pTrunk);
 }
 
-static int storage_trunk_node_compare_size(void *p1, void *p2)
-{
-	return ((FDFSTrunkSlot *)p1)->size - ((FDFSTrunkSlot *)p2)->size;
-}
-
 static int storage_trunk_node_compare_offset(void *p1, void *p2)
 {
 	FDFSTrunkFullInfo *pTrunkInfo1;
@@ -153,10 +234,64 @@ char *storage_trunk_get_data_filename(char *full_filename)
 		} \
 	} while (0)
 
+static int trunk_alloc_shards_init()
+{
+	TrunkAllocShard *pShard;
+	int bytes;
+	int result;
+	int i;
+	int k;
+
+	memset(trunk_shards, 0, sizeof(trunk_shards));
+	bytes = sizeof(FDFSTrunkSizeClasses) * g_fdfs_store_paths.count;
+	for (i=0; i<TRUNK_FREE_BLOCK_SHARD_COUNT; i++)
+	{
+		pShard = trunk_shards + i;
+		if ((result=init_pthread_lock(&(pShard->lock))) != 0)
+		{
+			logError("file: "__FILE__", line: %d, " \
+				"init_pthread_lock fail, " \
+				"errno: %d, error info: %s", \
+				__LINE__, result, STRERROR(result));
+			return result;
+		}
+
+		pShard->size_classes = (FDFSTrunkSizeClasses *)malloc(bytes);
+		if (pShard->size_classes == NULL)
+		{
+			result = errno != 0 ? errno : ENOMEM;
+			logError("file: "__FILE__", line: %d, " \
+				"malloc %d bytes fail, " \
+				"errno: %d, error info: %s", \
+				__LINE__, bytes, result, STRERROR(result));
+			return result;
+		}
+
+		for (k=0; k<g_fdfs_store_paths.count; k++)
+		{
+			trunk_size_class_init(pShard->size_classes + k);
+		}
+
+		if ((result=hash_init_ex(&(pShard->lease_hash), PJWHash, \
+			128, 0.75, 0, true)) != 0 || \
+			(result=hash_init_ex(&(pShard->leases), PJWHash, \
+			128, 0.75, 0, true)) != 0)
+		{
+			logError("file: "__FILE__", line: %d, " \
+				"hash_init fail, errno: %d, error info: %s", \
+				__LINE__, result, STRERROR(result));
+			return result;
+		}
+	}
+
+	return 0;
+}
+
 int storage_trunk_init()
 {
 	int result;
 	int i;
+	int k;
 	int count;
 
 	if (!g_if_trunker_self)
@@ -188,7 +323,7 @@ int storage_trunk_init()
 		return result;
 	}
 
-	if ((result=init_pthread_lock(&trunk_mem_lock)) != 0)
+	if ((result=init_pthread_lock(&trunk_create_lock)) != 0)
 	{
 		logError("file: "__FILE__", line: %d, " \
 			"init_pthread_lock fail, " \
@@ -197,41 +332,67 @@ int storage_trunk_init()
 		return result;
 	}
 
-	if ((result=fast_mblock_init(&free_blocks_man, \
-			sizeof(FDFSTrunkNode), 0)) != 0)
-	{
-		return result;
-	}
-
-	if ((result=fast_mblock_init(&tree_nodes_man, \
-			sizeof(FDFSTrunkSlot), 0)) != 0)
+	if ((result=init_pthread_lock(&trunk_split_lock)) != 0)
 	{
+		logError("file: "__FILE__", line: %d, " \
+			"init_pthread_lock fail, " \
+			"errno: %d, error info: %s", \
+			__LINE__, result, STRERROR(result));
 		return result;
 	}
 
-	tree_info_by_sizes = (AVLTreeInfo *)malloc(sizeof(AVLTreeInfo) * \
-				g_fdfs_store_paths.count);
-	if (tree_info_by_sizes == NULL)
+	if ((result=pthread_cond_init(&trunk_split_cond, NULL)) != 0)
 	{
-		result = errno != 0 ? errno : ENOMEM;
 		logError("file: "__FILE__", line: %d, " \
-			"malloc %d bytes fail, errno: %d, error info: %s", \
-			__LINE__, (int)(sizeof(AVLTreeInfo) * \
-			g_fdfs_store_paths.count), result, STRERROR(result));
+			"pthread_cond_init fail, " \
+			"errno: %d, error info: %s", \
+			__LINE__, result, STRERROR(result));
 		return result;
 	}
 
-	for (i=0; i<g_fdfs_store_paths.count; i++)
+	if (!trunk_save_lock_inited)
 	{
-		if ((result=avl_tree_init(tree_info_by_sizes + i, NULL, \
-			storage_trunk_node_compare_size)) != 0)
+		if ((result=init_pthread_lock(&trunk_save_lock)) != 0)
 		{
 			logError("file: "__FILE__", line: %d, " \
-				"avl_tree_init fail, " \
+				"init_pthread_lock fail, " \
 				"errno: %d, error info: %s", \
 				__LINE__, result, STRERROR(result));
 			return result;
 		}
+		trunk_save_lock_inited = true;
+	}
+	trunk_saved_binlog_offset = -1;
+
+	/* not freed when destroyed, the space may be changed by
+	   the threads after the trunk server changed */
+	if (trunk_path_runways == NULL)
+	{
+		trunk_path_runways = (TrunkPathRunway *)malloc( \
+			sizeof(TrunkPathRunway) * g_fdfs_store_paths.count);
+		if (trunk_path_runways == NULL)
+		{
+			result = errno != 0 ? errno : ENOMEM;
+			logError("file: "__FILE__", line: %d, " \
+				"malloc %d bytes fail, " \
+				"errno: %d, error info: %s", __LINE__, \
+				(int)sizeof(TrunkPathRunway) * \
+				g_fdfs_store_paths.count, \
+				result, STRERROR(result));
+			return result;
+		}
+	}
+	memset(trunk_path_runways, 0, sizeof(TrunkPathRunway) * \
+			g_fdfs_store_paths.count);
+
+	if ((result=trunk_node_pool_init()) != 0)
+	{
+		return result;
+	}
+
+	if ((result=trunk_alloc_shards_init()) != 0)
+	{
+		return result;
 	}
 
 	if ((result=trunk_free_block_checker_init()) != 0)
@@ -239,24 +400,35 @@ int storage_trunk_init()
 		return result;
 	}
 
+	trunk_lease_id = 0;
 	if ((result=storage_trunk_load()) != 0)
 	{
 		return result;
 	}
 
+	/* the leases given by the previous trunk servers are loaded */
+	if (trunk_lease_id < ((int64_t)time(NULL) << 20))
+	{
+		trunk_lease_id = (int64_t)time(NULL) << 20;
+	}
+
 	count = 0;
-	for (i=0; i<g_fdfs_store_paths.count; i++)
+	for (i=0; i<TRUNK_FREE_BLOCK_SHARD_COUNT; i++)
 	{
-		count += avl_tree_count(tree_info_by_sizes + i);
+		for (k=0; k<g_fdfs_store_paths.count; k++)
+		{
+			count += trunk_shards[i].size_classes[k].count;
+		}
 	}
 
 	logInfo("file: "__FILE__", line: %d, " \
-		"tree by space size node count: %d, tree by trunk file id " \
-		"node count: %d, free block count: %d, " \
+		"size class node count: %d, tree by trunk file id " \
+		"node count: %d, free block count: %d, free block index " \
+		"memory: "INT64_PRINTF_FORMAT" bytes, " \
 		"trunk_total_free_space: "INT64_PRINTF_FORMAT, __LINE__, \
 		count, trunk_free_block_tree_node_count(), \
 		trunk_free_block_total_count(), \
-		g_trunk_total_free_space);
+		trunk_free_block_memory_usage(), g_trunk_total_free_space);
 
 	/*
 	{
@@ -266,6 +438,7 @@ int storage_trunk_init()
 	}
 	*/
 
+	trunk_init_done_time = g_current_time;
 	trunk_init_flag = STORAGE_TRUNK_INIT_FLAG_DONE;
 	return 0;
 }
@@ -282,7 +455,10 @@ int storage_trunk_destroy_ex(const bool bNeedSleep)
 		return 0;
 	}
 
+	//wait for the running checkpoint
+	pthread_mutex_lock(&trunk_save_lock);
 	trunk_init_flag = STORAGE_TRUNK_INIT_FLAG_DESTROYING;
+	pthread_mutex_unlock(&trunk_save_lock);
 	if (bNeedSleep)
 	{
 		sleep(1);
@@ -292,19 +468,21 @@ int storage_trunk_destroy_ex(const bool bNeedSleep)
 		"storage trunk destroy", __LINE__);
 	result = storage_trunk_save();
 
-	for (i=0; i<g_fdfs_store_paths.count; i++)
+	for (i=0; i<TRUNK_FREE_BLOCK_SHARD_COUNT; i++)
 	{
-		avl_tree_destroy(tree_info_by_sizes + i);
+		free(trunk_shards[i].size_classes);
+		trunk_shards[i].size_classes = NULL;
+		hash_destroy(&(trunk_shards[i].lease_hash));
+		hash_destroy(&(trunk_shards[i].leases));
+		pthread_mutex_destroy(&(trunk_shards[i].lock));
 	}
-	free(tree_info_by_sizes);
-	tree_info_by_sizes = NULL;
-
 	trunk_free_block_checker_destroy();
 
-	fast_mblock_destroy(&free_blocks_man);
-	fast_mblock_destroy(&tree_nodes_man);
+	trunk_node_pool_destroy();
 	pthread_mutex_destroy(&trunk_file_lock);
-	pthread_mutex_destroy(&trunk_mem_lock);
+	pthread_mutex_destroy(&trunk_create_lock);
+	pthread_cond_destroy(&trunk_split_cond);
+	pthread_mutex_destroy(&trunk_split_lock);
 
 	trunk_init_flag = STORAGE_TRUNK_INIT_FLAG_NONE;
 	return result;
@@ -341,55 +519,70 @@ struct walk_callback_args {
 	char *pCurrent;
 };
 
-static int tree_walk_callback(void *data, void *args)
+static int trunk_dump_write_node(struct walk_callback_args *pCallbackArgs, \
+		const char op_type, const FDFSTrunkFullInfo *pTrunkInfo, \
+		const int64_t lease_id)
 {
-	struct walk_callback_args *pCallbackArgs;
-	FDFSTrunkFullInfo *pTrunkInfo;
-	FDFSTrunkNode *pCurrent;
 	int len;
 	int result;
 
-	pCallbackArgs = (struct walk_callback_args *)args;
-	pCurrent = ((FDFSTrunkSlot *)data)->head;
-	while (pCurrent != NULL)
-	{
-		pTrunkInfo = &pCurrent->trunk;
-		len = sprintf(pCallbackArgs->pCurrent, \
-			"%d %c %d %d %d %d %d %d\n", \
-			(int)g_current_time, TRUNK_OP_TYPE_ADD_SPACE, \
-			pTrunkInfo->path.store_path_index, \
-			pTrunkInfo->path.sub_path_high, \
-			pTrunkInfo->path.sub_path_low,  \
-			pTrunkInfo->file.id, \
-			pTrunkInfo->file.offset, \
-			pTrunkInfo->file.size);
-		pCallbackArgs->pCurrent += len;
-		if (pCallbackArgs->pCurrent - pCallbackArgs->buff > \
-				sizeof(pCallbackArgs->buff) - 128)
-		{
-			if (write(pCallbackArgs->fd, pCallbackArgs->buff, \
-			    pCallbackArgs->pCurrent - pCallbackArgs->buff) \
-			      != pCallbackArgs->pCurrent - pCallbackArgs->buff)
-			{
-				result = errno != 0 ? errno : EIO;
-				logError("file: "__FILE__", line: %d, "\
-					"write to file %s fail, " \
-					"errno: %d, error info: %s", __LINE__, \
-					pCallbackArgs->temp_trunk_filename, \
-					result, STRERROR(result));
-				return result;
-			}
-
-			pCallbackArgs->pCurrent = pCallbackArgs->buff;
+	len = trunk_binlog_pack_record((int)g_current_time, op_type, \
+		pTrunkInfo, NULL, lease_id, pCallbackArgs->pCurrent);
+	pCallbackArgs->pCurrent += len;
+	if (pCallbackArgs->pCurrent - pCallbackArgs->buff > \
+			sizeof(pCallbackArgs->buff) - 128)
+	{
+		if (write(pCallbackArgs->fd, pCallbackArgs->buff, \
+		    pCallbackArgs->pCurrent - pCallbackArgs->buff) \
+		      != pCallbackArgs->pCurrent - pCallbackArgs->buff)
+		{
+			result = errno != 0 ? errno : EIO;
+			logError("file: "__FILE__", line: %d, "\
+				"write to file %s fail, " \
+				"errno: %d, error info: %s", __LINE__, \
+				pCallbackArgs->temp_trunk_filename, \
+				result, STRERROR(result));
+			return result;
 		}
 
-		pCurrent = pCurrent->next;
+		pCallbackArgs->pCurrent = pCallbackArgs->buff;
 	}
 
 	return 0;
 }
 
-static int storage_trunk_do_save()
+static int trunk_dump_file_callback(FDFSTrunksById *pTrunksById, void *args)
+{
+	FDFSBlockIterator iterator;
+	FDFSTrunkFullInfo *pBlock;
+	int result;
+
+	for (pBlock=trunk_free_block_first(pTrunksById, &iterator);
+		pBlock!=NULL; pBlock=trunk_free_block_next(&iterator))
+	{
+		if ((result=trunk_dump_write_node((struct walk_callback_args *) \
+			args, TRUNK_OP_TYPE_ADD_SPACE, pBlock, 0)) != 0)
+		{
+			return result;
+		}
+	}
+
+	return 0;
+}
+
+static int trunk_dump_lease_callback(const int index, const HashData *data, \
+		void *args)
+{
+	const FDFSTrunkLeaseInfo *pLease;
+
+	pLease = (const FDFSTrunkLeaseInfo *)data->value;
+	return trunk_dump_write_node((struct walk_callback_args *)args, \
+		TRUNK_OP_TYPE_LEASE, &(pLease->trunk), pLease->lease_id);
+}
+
+/* dump the blocks as the binlog records to the data file, it is merged
+   with the new binlog when the trunk binlog is compressed */
+static int storage_trunk_dump()
 {
 	int64_t trunk_binlog_size;
 	char trunk_data_filename[MAX_PATH_SIZE];
@@ -426,12 +619,20 @@ static int storage_trunk_do_save()
 			trunk_binlog_size);
 	callback_args.pCurrent += len;
 
+	/* the free and the holding blocks of all trunk files,
+	   and the leases held by the storage servers */
 	result = 0;
-	pthread_mutex_lock(&trunk_mem_lock);
-	for (i=0; i<g_fdfs_store_paths.count; i++)
+	for (i=0; i<TRUNK_FREE_BLOCK_SHARD_COUNT; i++)
 	{
-		result = avl_tree_walk(tree_info_by_sizes + i, \
-				tree_walk_callback, &callback_args);
+		pthread_mutex_lock(&(trunk_shards[i].lock));
+		result = trunk_free_block_walk_files(i, \
+				trunk_dump_file_callback, &callback_args);
+		if (result == 0)
+		{
+			result = hash_walk(&(trunk_shards[i].leases), \
+				trunk_dump_lease_callback, &callback_args);
+		}
+		pthread_mutex_unlock(&(trunk_shards[i].lock));
 		if (result != 0)
 		{
 			break;
@@ -474,7 +675,6 @@ static int storage_trunk_do_save()
 			__LINE__, callback_args.temp_trunk_filename, \
 			errno, STRERROR(errno));
 	}
-	pthread_mutex_unlock(&trunk_mem_lock);
 
 	if (result != 0)
 	{
@@ -495,10 +695,194 @@ static int storage_trunk_do_save()
 	return result;
 }
 
+static int trunk_save_file_callback(FDFSTrunksById *pTrunksById, void *args)
+{
+	FDFSBlockIterator iterator;
+	FDFSTrunkFullInfo *pBlock;
+	int result;
+
+	for (pBlock=trunk_free_block_first(pTrunksById, &iterator);
+		pBlock!=NULL; pBlock=trunk_free_block_next(&iterator))
+	{
+		if ((result=trunk_snapshot_write((FDFSTrunkSnapshotWriter *) \
+			args, pBlock)) != 0)
+		{
+			return result;
+		}
+	}
+
+	return 0;
+}
+
+static int trunk_save_lease_callback(const int index, const HashData *data, \
+		void *args)
+{
+	return trunk_snapshot_write_lease((FDFSTrunkSnapshotWriter *)args, \
+			(const FDFSTrunkLeaseInfo *)data->value);
+}
+
+/* the binlog size is got before the blocks, the records after it
+   may be in the snapshot already, they are skipped when replayed */
+static int storage_trunk_do_save()
+{
+	int64_t trunk_binlog_size;
+	char trunk_data_filename[MAX_PATH_SIZE];
+	char temp_trunk_filename[MAX_PATH_SIZE];
+	FDFSTrunkSnapshotWriter *pWriter;
+	int result;
+	int i;
+
+	trunk_binlog_size = storage_trunk_get_binlog_size();
+	if (trunk_binlog_size < 0)
+	{
+		return errno != 0 ? errno : EPERM;
+	}
+
+	pWriter = (FDFSTrunkSnapshotWriter *)malloc( \
+			sizeof(FDFSTrunkSnapshotWriter));
+	if (pWriter == NULL)
+	{
+		result = errno != 0 ? errno : ENOMEM;
+		logError("file: "__FILE__", line: %d, " \
+			"malloc %d bytes fail, " \
+			"errno: %d, error info: %s", __LINE__, \
+			(int)sizeof(FDFSTrunkSnapshotWriter), \
+			result, STRERROR(result));
+		return result;
+	}
+
+	sprintf(temp_trunk_filename, "%s/data/.%s.tmp", \
+		g_fdfs_base_path, STORAGE_TRUNK_DATA_FILENAME);
+	if ((result=trunk_snapshot_writer_init(pWriter, temp_trunk_filename, \
+		TRUNK_FREE_BLOCK_SHARD_COUNT, trunk_binlog_size)) != 0)
+	{
+		trunk_snapshot_writer_destroy(pWriter);
+		free(pWriter);
+		return result;
+	}
+
+	/* the free and the holding blocks of all trunk files,
+	   one section per shard */
+	for (i=0; i<TRUNK_FREE_BLOCK_SHARD_COUNT; i++)
+	{
+		trunk_snapshot_begin_section(pWriter, i);
+		pthread_mutex_lock(&(trunk_shards[i].lock));
+		result = trunk_free_block_walk_files(i, \
+				trunk_save_file_callback, pWriter);
+		pthread_mutex_unlock(&(trunk_shards[i].lock));
+		if (result != 0)
+		{
+			break;
+		}
+	}
+
+	if (result == 0)
+	{
+		trunk_snapshot_begin_leases(pWriter);
+		for (i=0; i<TRUNK_FREE_BLOCK_SHARD_COUNT; i++)
+		{
+			pthread_mutex_lock(&(trunk_shards[i].lock));
+			result = hash_walk(&(trunk_shards[i].leases), \
+				trunk_save_lease_callback, pWriter);
+			pthread_mutex_unlock(&(trunk_shards[i].lock));
+			if (result != 0)
+			{
+				break;
+			}
+		}
+	}
+
+	if (result == 0)
+	{
+		result = trunk_snapshot_writer_finish(pWriter);
+	}
+	trunk_snapshot_writer_destroy(pWriter);
+	free(pWriter);
+	if (result != 0)
+	{
+		return result;
+	}
+
+	storage_trunk_get_data_filename(trunk_data_filename);
+	if (rename(temp_trunk_filename, trunk_data_filename) != 0)
+	{
+		result = errno != 0 ? errno : EIO;
+		logError("file: "__FILE__", line: %d, "\
+			"rename file %s to %s fail, " \
+			"errno: %d, error info: %s", __LINE__, \
+			temp_trunk_filename, trunk_data_filename, \
+			result, STRERROR(result));
+		return result;
+	}
+
+	trunk_saved_binlog_offset = trunk_binlog_size;
+	return 0;
+}
+
+static int storage_trunk_do_save_compress();
+
+static int64_t get_current_ms()
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return (int64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
 static int storage_trunk_save()
 {
 	int result;
 
+	pthread_mutex_lock(&trunk_save_lock);
+	result = storage_trunk_do_save_compress();
+	pthread_mutex_unlock(&trunk_save_lock);
+	return result;
+}
+
+int storage_trunk_checkpoint()
+{
+	int64_t trunk_binlog_size;
+	int64_t start_time;
+	int result;
+
+	if (!trunk_save_lock_inited)
+	{
+		return 0;
+	}
+
+	pthread_mutex_lock(&trunk_save_lock);
+	if (trunk_init_flag != STORAGE_TRUNK_INIT_FLAG_DONE)
+	{
+		pthread_mutex_unlock(&trunk_save_lock);
+		return 0;
+	}
+
+	trunk_binlog_size = storage_trunk_get_binlog_size();
+	if (trunk_binlog_size == trunk_saved_binlog_offset)
+	{
+		pthread_mutex_unlock(&trunk_save_lock);
+		return 0;  //no change since the last snapshot
+	}
+
+	start_time = get_current_ms();
+	result = storage_trunk_do_save();
+	pthread_mutex_unlock(&trunk_save_lock);
+
+	if (result == 0)
+	{
+		logDebug("file: "__FILE__", line: %d, " \
+			"trunk checkpoint done, binlog offset: " \
+			INT64_PRINTF_FORMAT", time used: %d ms", __LINE__, \
+			trunk_saved_binlog_offset, \
+			(int)(get_current_ms() - start_time));
+	}
+	return result;
+}
+
+static int storage_trunk_do_save_compress()
+{
+	int result;
+
 	if (!(g_trunk_compress_binlog_min_interval > 0 && \
 		g_current_time - g_trunk_last_compress_time >
 		g_trunk_compress_binlog_min_interval))
@@ -512,7 +896,7 @@ static int storage_trunk_save()
 		return result;
 	}
 
-	if ((result=storage_trunk_do_save()) != 0)
+	if ((result=storage_trunk_dump()) != 0)
 	{
 		trunk_binlog_compress_rollback();
 		return result;
@@ -524,6 +908,12 @@ static int storage_trunk_save()
 		return result;
 	}
 
+	//the data file is merged to the binlog and removed
+	if ((result=storage_trunk_do_save()) != 0)
+	{
+		return result;
+	}
+
 	g_trunk_last_compress_time = g_current_time;
 	storage_write_to_sync_ini_file();
 
@@ -592,15 +982,6 @@ static int trunk_add_space_by_node(FDFSTrunkNode *pTrunkNode)
 {
 	int result;
 
-	if (pTrunkNode->trunk.file.size < g_slot_min_size)
-	{
-		logDebug("file: "__FILE__", line: %d, " \
-			"space: %d is too small, do not need recycle!", \
-			__LINE__, pTrunkNode->trunk.file.size);
-		fast_mblock_free(&free_blocks_man, pTrunkNode->pMblockNode);
-		return 0;
-	}
-
 	result = trunk_add_free_block(pTrunkNode, false);
 	if (result == 0)
 	{
@@ -608,7 +989,7 @@ static int trunk_add_space_by_node(FDFSTrunkNode *pTrunkNode)
 	}
 	else
 	{
-		fast_mblock_free(&free_blocks_man, pTrunkNode->pMblockNode);
+		trunk_node_free(pTrunkNode);
 		return (result == EEXIST) ? 0 : result;
 	}
 }
@@ -636,8 +1017,7 @@ static int storage_trunk_do_add_space(const FDFSTrunkFullInfo *pTrunkInfo)
 
 static void storage_trunk_free_node(void *ptr)
 {
-	fast_mblock_free(&free_blocks_man, \
-		((FDFSTrunkNode *)ptr)->pMblockNode);
+	trunk_node_free((FDFSTrunkNode *)ptr);
 }
 
 static int storage_trunk_add_free_blocks_callback(void *data, void *args)
@@ -663,9 +1043,9 @@ static int storage_trunk_restore(const int64_t restore_offset)
 	int record_length;
 	int result;
 	AVLTreeInfo tree_info_by_offset;
-	struct fast_mblock_node *pMblockNode;
 	FDFSTrunkNode *pTrunkNode;
 	FDFSTrunkNode trunkNode;
+	FDFSTrunkLeaseInfo lease;
 	bool trunk_init_reload_from_binlog;
 
 	trunk_binlog_size = storage_trunk_get_binlog_size();
@@ -676,6 +1056,7 @@ static int storage_trunk_restore(const int64_t restore_offset)
 
 	if (restore_offset == trunk_binlog_size)
 	{
+		trunk_saved_binlog_offset = trunk_binlog_size;
 		return 0;
 	}
 
@@ -757,8 +1138,8 @@ static int storage_trunk_restore(const int64_t restore_offset)
 
 			if (trunk_init_reload_from_binlog)
 			{
-				pMblockNode = fast_mblock_alloc(&free_blocks_man);
-				if (pMblockNode == NULL)
+				pTrunkNode = trunk_node_alloc();
+				if (pTrunkNode == NULL)
 				{
 					result = errno != 0 ? errno : EIO;
 					logError("file: "__FILE__", line: %d, "\
@@ -770,12 +1151,8 @@ static int storage_trunk_restore(const int64_t restore_offset)
 					return result;
 				}
 
-				pTrunkNode = (FDFSTrunkNode *)pMblockNode->data;
 				memcpy(&pTrunkNode->trunk, &(record.trunk), \
 					sizeof(FDFSTrunkFullInfo));
-
-				pTrunkNode->pMblockNode = pMblockNode;
-				pTrunkNode->next = NULL;
 				result = avl_tree_insert(&tree_info_by_offset,\
 							pTrunkNode);
 				if (result < 0) //error
@@ -846,7 +1223,21 @@ static int storage_trunk_restore(const int64_t restore_offset)
 				}
 			}
 		}
-
+		else if (record.op_type == TRUNK_OP_TYPE_LEASE)
+		{
+			lease.lease_id = record.lease_id;
+			memcpy(&lease.trunk, &record.trunk, \
+				sizeof(FDFSTrunkFullInfo));
+			if ((result=trunk_lease_restore(&lease)) != 0)
+			{
+				break;
+			}
+		}
+		else if (record.op_type == TRUNK_OP_TYPE_LEASE_END)
+		{
+			trunk_lease_remove(&record.trunk, record.lease_id);
+		}
+
 		reader.binlog_offset += record_length;
 	}
 
@@ -893,6 +1284,13 @@ static int storage_trunk_restore(const int64_t restore_offset)
 			INT64_PRINTF_FORMAT", recovery file size: " \
 			INT64_PRINTF_FORMAT, __LINE__, \
 			restore_offset, trunk_binlog_size - restore_offset);
+
+		/* the snapshot is written by the checkpoint thread later,
+		   the tail is replayed again when restart before it */
+		if (g_trunk_checkpoint_interval > 0 && restore_offset > 0)
+		{
+			return 0;
+		}
 		return storage_trunk_save();
 	}
 
@@ -923,6 +1321,34 @@ int storage_delete_trunk_data_file()
 	return result;
 }
 
+static int storage_trunk_load_snapshot(const char *trunk_data_filename)
+{
+	int64_t restore_offset;
+	int64_t record_count;
+	int64_t start_time;
+	int result;
+
+	start_time = get_current_ms();
+	if ((result=trunk_snapshot_load(trunk_data_filename, \
+		g_trunk_init_load_threads, storage_trunk_do_add_space, \
+		trunk_lease_restore, &restore_offset, &record_count)) != 0)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"load trunk snapshot %s fail, you can delete it " \
+			"to reload from the trunk binlog", \
+			__LINE__, trunk_data_filename);
+		return result;
+	}
+
+	logInfo("file: "__FILE__", line: %d, " \
+		"trunk snapshot loaded, record count: "INT64_PRINTF_FORMAT \
+		", binlog offset: "INT64_PRINTF_FORMAT", time used: %d ms", \
+		__LINE__, record_count, restore_offset, \
+		(int)(get_current_ms() - start_time));
+
+	return storage_trunk_restore(restore_offset);
+}
+
 static int storage_trunk_load()
 {
 #define TRUNK_DATA_NEW_FIELD_COUNT  8  // >= v5.01
@@ -995,6 +1421,14 @@ static int storage_trunk_load()
 		return result;
 	}
 
+	if (bytes >= TRUNK_SNAPSHOT_MAGIC_LEN && memcmp(buff, \
+		TRUNK_SNAPSHOT_MAGIC, TRUNK_SNAPSHOT_MAGIC_LEN) == 0)
+	{
+		close(fd);
+		return storage_trunk_load_snapshot(trunk_data_filename);
+	}
+
+	//the text data file before V5.03
 	*(buff + bytes) = '\0';
 	pLineEnd = strchr(buff, '\n');
 	if (pLineEnd == NULL)
@@ -1115,12 +1549,14 @@ static int storage_trunk_load()
 	return storage_trunk_restore(restore_offset);
 }
 
+static int trunk_free_node(const FDFSTrunkFullInfo *pTrunkInfo, \
+		const bool bWriteBinLog);
+
 int trunk_free_space(const FDFSTrunkFullInfo *pTrunkInfo, \
 		const bool bWriteBinLog)
 {
+	FDFSTrunkFullInfo trunkInfo;
 	int result;
-	struct fast_mblock_node *pMblockNode;
-	FDFSTrunkNode *pTrunkNode;
 
 	if (!g_if_trunker_self)
 	{
@@ -1139,7 +1575,31 @@ int trunk_free_space(const FDFSTrunkFullInfo *pTrunkInfo, \
 		}
 	}
 
-	if (pTrunkInfo->file.size < g_slot_min_size)
+	if (!bWriteBinLog)
+	{
+		return trunk_free_node(pTrunkInfo, bWriteBinLog);
+	}
+
+	/* the file may be moved by the compactor, hold the redirect lock
+	   until the space is freed, so the move can't be published between */
+	memcpy(&trunkInfo, pTrunkInfo, sizeof(FDFSTrunkFullInfo));
+	trunk_redirect_lock();
+	trunk_redirect_on_free(&trunkInfo);
+	result = trunk_free_node(&trunkInfo, bWriteBinLog);
+	trunk_redirect_unlock();
+
+	return result;
+}
+
+static int trunk_free_node(const FDFSTrunkFullInfo *pTrunkInfo, \
+		const bool bWriteBinLog)
+{
+	int result;
+	FDFSTrunkNode *pTrunkNode;
+
+	/* the space smaller than slot_min_size can't be allocated,
+	   but it is kept for merging with the adjacent free blocks */
+	if (pTrunkInfo->file.size <= 0)
 	{
 		logDebug("file: "__FILE__", line: %d, " \
 			"space: %d is too small, do not need recycle!", \
@@ -1147,8 +1607,8 @@ int trunk_free_space(const FDFSTrunkFullInfo *pTrunkInfo, \
 		return 0;
 	}
 
-	pMblockNode = fast_mblock_alloc(&free_blocks_man);
-	if (pMblockNode == NULL)
+	pTrunkNode = trunk_node_alloc();
+	if (pTrunkNode == NULL)
 	{
 		result = errno != 0 ? errno : EIO;
 		logError("file: "__FILE__", line: %d, " \
@@ -1159,225 +1619,274 @@ int trunk_free_space(const FDFSTrunkFullInfo *pTrunkInfo, \
 		return result;
 	}
 
-	pTrunkNode = (FDFSTrunkNode *)pMblockNode->data;
 	memcpy(&pTrunkNode->trunk, pTrunkInfo, sizeof(FDFSTrunkFullInfo));
-
-	pTrunkNode->pMblockNode = pMblockNode;
 	pTrunkNode->trunk.status = FDFS_TRUNK_STATUS_FREE;
-	pTrunkNode->next = NULL;
 	return trunk_add_free_block(pTrunkNode, bWriteBinLog);
 }
 
-static int trunk_add_free_block(FDFSTrunkNode *pNode, const bool bWriteBinLog)
+/* remove the node from the size classes and the block checker,
+   caller should hold the lock of the shard */
+static void trunk_remove_free_node(TrunkAllocShard *pShard, \
+		FDFSTrunkNode *pNode)
 {
-	int result;
-	struct fast_mblock_node *pMblockNode;
-	FDFSTrunkSlot target_slot;
-	FDFSTrunkSlot *chain;
-
-	pthread_mutex_lock(&trunk_mem_lock);
+	trunk_size_class_remove(TRUNK_SIZE_CLASSES(pShard, &(pNode->trunk)), \
+			pNode);
+	trunk_free_block_delete(&(pNode->trunk));
+}
 
-	if ((result=trunk_free_block_check_duplicate(&(pNode->trunk))) != 0)
-	{
-		pthread_mutex_unlock(&trunk_mem_lock);
-		return result;
-	}
+/* merge the free node with the free blocks just before and after it
+   in the same trunk file, the merged blocks are deleted from the binlog,
+   caller should hold the lock of the shard */
+static int trunk_merge_free_blocks(TrunkAllocShard *pShard, \
+		FDFSTrunkNode *pNode, bool *merged)
+{
+	FDFSTrunkFullInfo *neighbours[2];
+	FDFSTrunkNode *pNeighbour;
+	int result;
+	int i;
 
-	target_slot.size = pNode->trunk.file.size;
-	target_slot.head = NULL;
-	chain = (FDFSTrunkSlot *)avl_tree_find(tree_info_by_sizes +  \
-			pNode->trunk.path.store_path_index, &target_slot);
-	if (chain == NULL)
+	*merged = false;
+	result = 0;
+	trunk_free_block_find_neighbours(&(pNode->trunk), \
+			neighbours, neighbours + 1);
+	for (i=0; i<2; i++)
 	{
-		pMblockNode = fast_mblock_alloc(&tree_nodes_man);
-		if (pMblockNode == NULL)
+		if (neighbours[i] == NULL || \
+			neighbours[i]->status != FDFS_TRUNK_STATUS_FREE)
 		{
-			result = errno != 0 ? errno : EIO;
-			logError("file: "__FILE__", line: %d, " \
-				"malloc %d bytes fail, " \
-				"errno: %d, error info: %s", \
-				__LINE__, (int)sizeof(FDFSTrunkSlot), \
-				result, STRERROR(result));
-			pthread_mutex_unlock(&trunk_mem_lock);
-			return result;
+			continue;
 		}
 
-		chain = (FDFSTrunkSlot *)pMblockNode->data;
-		chain->pMblockNode = pMblockNode;
-		chain->size = pNode->trunk.file.size;
-		pNode->next = NULL;
-		chain->head = pNode;
+		//the trunk info is the first field of the node
+		pNeighbour = (FDFSTrunkNode *)neighbours[i];
+		trunk_remove_free_node(pShard, pNeighbour);
+		if (i == 0)
+		{
+			pNode->trunk.file.offset = pNeighbour->trunk.file.offset;
+		}
+		pNode->trunk.file.size += pNeighbour->trunk.file.size;
 
-		if (avl_tree_insert(tree_info_by_sizes + pNode->trunk. \
-				path.store_path_index, chain) != 1)
+		if (result == 0)
 		{
-			result = errno != 0 ? errno : ENOMEM;
-			logError("file: "__FILE__", line: %d, " \
-				"avl_tree_insert fail, " \
-				"errno: %d, error info: %s", \
-				__LINE__, result, STRERROR(result));
-			pthread_mutex_unlock(&trunk_mem_lock);
-			return result;
+			result = trunk_mem_binlog_write(g_current_time, \
+				TRUNK_OP_TYPE_DEL_SPACE, &(pNeighbour->trunk));
+		}
+		else
+		{
+			trunk_mem_binlog_write(g_current_time, \
+				TRUNK_OP_TYPE_DEL_SPACE, &(pNeighbour->trunk));
 		}
+
+		trunk_node_free(pNeighbour);
+		*merged = true;
 	}
-	else
+
+	return result;
+}
+
+/* the whole trunk file is free, remove it when the left free space
+   is enough, caller should hold the lock of the shard */
+static bool trunk_need_reclaim(TrunkAllocShard *pShard, \
+		const FDFSTrunkNode *pNode)
+{
+	TrunkPathRunway *pRunway;
+	bool need_reclaim;
+
+	if (!(pNode->trunk.file.offset == 0 && \
+		pNode->trunk.file.size == g_trunk_file_size))
 	{
-		pNode->next = chain->head;
-		chain->head = pNode;
+		return false;
 	}
 
-	if (bWriteBinLog)
+	if (TRUNK_IS_RETIRED_FILE(pShard, &(pNode->trunk)))
 	{
-		result = trunk_mem_binlog_write(g_current_time, \
-				TRUNK_OP_TYPE_ADD_SPACE, &(pNode->trunk));
+		return false;  //reclaimed by the compactor
 	}
-	else
+
+	if (!g_trunk_create_file_advance && g_trunk_create_file_runway <= 0)
 	{
-		pthread_mutex_lock(&trunk_file_lock);
-		g_trunk_total_free_space += pNode->trunk.file.size;
-		pthread_mutex_unlock(&trunk_file_lock);
-		result = 0;
+		return true;
 	}
 
-	if (result == 0)
+	pRunway = trunk_path_runways + pNode->trunk.path.store_path_index;
+	pthread_mutex_lock(&trunk_file_lock);
+	need_reclaim = true;
+	if (g_trunk_create_file_advance)
 	{
-		result = trunk_free_block_insert(&(pNode->trunk));
+		need_reclaim = g_trunk_total_free_space >= \
+			g_trunk_create_file_space_threshold;
 	}
-	else
+
+	//keep the free trunk files of the runway
+	if (need_reclaim && g_trunk_create_file_runway > 0)
 	{
-		trunk_free_block_insert(&(pNode->trunk));
+		need_reclaim = pRunway->free_space - g_trunk_file_size >= \
+			pRunway->peak_rate * g_trunk_create_file_runway;
 	}
+	pthread_mutex_unlock(&trunk_file_lock);
 
-	pthread_mutex_unlock(&trunk_mem_lock);
-
-	return result;
+	return need_reclaim;
 }
 
-static void trunk_delete_size_tree_entry(const int store_path_index, \
-		FDFSTrunkSlot *pSlot)
+void trunk_reclaim_file(const FDFSTrunkFullInfo *pTrunkInfo)
 {
-	if (avl_tree_delete(tree_info_by_sizes + store_path_index, pSlot) == 1)
-	{
-		fast_mblock_free(&tree_nodes_man, \
-				pSlot->pMblockNode);
-	}
-	else
+	char full_filename[MAX_PATH_SIZE];
+
+	trunk_fd_cache_delete(pTrunkInfo);
+	trunk_get_full_filename(pTrunkInfo, full_filename, \
+			sizeof(full_filename));
+	if (unlink(full_filename) != 0 && errno != ENOENT)
 	{
-		logWarning("file: "__FILE__", line: %d, " \
-			"can't delete slot entry, size: %d", \
-			__LINE__, pSlot->size);
+		logError("file: "__FILE__", line: %d, " \
+			"unlink free trunk file %s fail, " \
+			"errno: %d, error info: %s", __LINE__, \
+			full_filename, errno, STRERROR(errno));
+		return;
 	}
+
+	logInfo("file: "__FILE__", line: %d, " \
+		"free trunk file %s reclaimed", __LINE__, full_filename);
 }
 
-static int trunk_delete_space(const FDFSTrunkFullInfo *pTrunkInfo, \
-		const bool bWriteBinLog)
+static int trunk_add_free_block(FDFSTrunkNode *pNode, const bool bWriteBinLog)
 {
+	TrunkAllocShard *pShard;
 	int result;
-	FDFSTrunkSlot target_slot;
-	char buff[256];
-	FDFSTrunkSlot *pSlot;
-	FDFSTrunkNode *pPrevious;
-	FDFSTrunkNode *pCurrent;
+	bool merged;
+	FDFSTrunkFullInfo trunkInfo;
 
-	target_slot.size = pTrunkInfo->file.size;
-	target_slot.head = NULL;
+	pShard = TRUNK_SHARD(&(pNode->trunk));
+	pthread_mutex_lock(&(pShard->lock));
 
-	pthread_mutex_lock(&trunk_mem_lock);
-	pSlot = (FDFSTrunkSlot *)avl_tree_find(tree_info_by_sizes + \
-			pTrunkInfo->path.store_path_index, &target_slot);
-	if (pSlot == NULL)
+	if ((result=trunk_free_block_check_duplicate(&(pNode->trunk))) != 0)
 	{
-		pthread_mutex_unlock(&trunk_mem_lock);
-		logError("file: "__FILE__", line: %d, " \
-			"can't find trunk entry: %s", __LINE__, \
-			trunk_info_dump(pTrunkInfo, buff, sizeof(buff)));
-		return ENOENT;
+		pthread_mutex_unlock(&(pShard->lock));
+		return result;
 	}
 
-	pPrevious = NULL;
-	pCurrent = pSlot->head;
-	while (pCurrent != NULL && memcmp(&(pCurrent->trunk), pTrunkInfo, \
-		sizeof(FDFSTrunkFullInfo)) != 0)
+	/* only merge when the space freed by the trunk server self,
+	   the replayed binlog records are kept as they are */
+	if (bWriteBinLog && pNode->trunk.status == FDFS_TRUNK_STATUS_FREE)
 	{
-		pPrevious = pCurrent;
-		pCurrent = pCurrent->next;
+		result = trunk_merge_free_blocks(pShard, pNode, &merged);
+		if (merged && trunk_need_reclaim(pShard, pNode))
+		{
+			if (result == 0)
+			{
+				result = trunk_mem_binlog_write(g_current_time,\
+					TRUNK_OP_TYPE_RECLAIM, &(pNode->trunk));
+			}
+			pthread_mutex_unlock(&(pShard->lock));
+
+			memcpy(&trunkInfo, &(pNode->trunk), \
+				sizeof(FDFSTrunkFullInfo));
+			trunk_node_free(pNode);
+			trunk_reclaim_file(&trunkInfo);
+			return result;
+		}
 	}
 
-	if (pCurrent == NULL)
+	/* the holding blocks are only in the block checker, and the free
+	   space of the retired trunk file can't be allocated */
+	if (pNode->trunk.status == FDFS_TRUNK_STATUS_FREE && \
+		!TRUNK_IS_RETIRED_FILE(pShard, &(pNode->trunk)))
 	{
-		pthread_mutex_unlock(&trunk_mem_lock);
-		logError("file: "__FILE__", line: %d, " \
-			"can't find trunk entry: %s", __LINE__, \
-			trunk_info_dump(pTrunkInfo, buff, sizeof(buff)));
-		return ENOENT;
+		trunk_size_class_add(TRUNK_SIZE_CLASSES(pShard, \
+			&(pNode->trunk)), pNode);
+	}
+	else
+	{
+		pNode->prev = NULL;
+		pNode->next = NULL;
 	}
 
-	if (pPrevious == NULL)
+	if (bWriteBinLog)
 	{
-		pSlot->head = pCurrent->next;
-		if (pSlot->head == NULL)
+		if (result == 0)
+		{
+			result = trunk_mem_binlog_write(g_current_time, \
+				TRUNK_OP_TYPE_ADD_SPACE, &(pNode->trunk));
+		}
+		else
 		{
-			trunk_delete_size_tree_entry(pTrunkInfo->path. \
-					store_path_index, pSlot);
+			trunk_mem_binlog_write(g_current_time, \
+				TRUNK_OP_TYPE_ADD_SPACE, &(pNode->trunk));
 		}
 	}
 	else
 	{
-		pPrevious->next = pCurrent->next;
+		trunk_add_free_space(&(pNode->trunk), pNode->trunk.file.size);
 	}
 
-	trunk_free_block_delete(&(pCurrent->trunk));
-	pthread_mutex_unlock(&trunk_mem_lock);
-
-	if (bWriteBinLog)
+	if (result == 0)
 	{
-		result = trunk_mem_binlog_write(g_current_time, \
-				TRUNK_OP_TYPE_DEL_SPACE, &(pCurrent->trunk));
+		result = trunk_free_block_insert(&(pNode->trunk));
 	}
 	else
 	{
-		pthread_mutex_lock(&trunk_file_lock);
-		g_trunk_total_free_space -= pCurrent->trunk.file.size;
-		pthread_mutex_unlock(&trunk_file_lock);
-		result = 0;
+		trunk_free_block_insert(&(pNode->trunk));
 	}
 
-	fast_mblock_free(&free_blocks_man, pCurrent->pMblockNode);
+	pthread_mutex_unlock(&(pShard->lock));
+
 	return result;
 }
 
-static int trunk_restore_node(const FDFSTrunkFullInfo *pTrunkInfo)
+static int trunk_delete_space(const FDFSTrunkFullInfo *pTrunkInfo, \
+		const bool bWriteBinLog)
 {
-	FDFSTrunkSlot target_slot;
-	char buff[256];
-	FDFSTrunkSlot *pSlot;
+	TrunkAllocShard *pShard;
 	FDFSTrunkNode *pCurrent;
+	char buff[256];
+	int result;
 
-	target_slot.size = pTrunkInfo->file.size;
-	target_slot.head = NULL;
+	pShard = TRUNK_SHARD(pTrunkInfo);
+	pthread_mutex_lock(&(pShard->lock));
 
-	pthread_mutex_lock(&trunk_mem_lock);
-	pSlot = (FDFSTrunkSlot *)avl_tree_find(tree_info_by_sizes + \
-			pTrunkInfo->path.store_path_index, &target_slot);
-	if (pSlot == NULL)
+	//the trunk info is the first field of the node
+	pCurrent = (FDFSTrunkNode *)trunk_free_block_find(pTrunkInfo);
+	if (pCurrent == NULL || memcmp(&(pCurrent->trunk), pTrunkInfo, \
+		sizeof(FDFSTrunkFullInfo)) != 0)
 	{
-		pthread_mutex_unlock(&trunk_mem_lock);
+		pthread_mutex_unlock(&(pShard->lock));
 		logError("file: "__FILE__", line: %d, " \
 			"can't find trunk entry: %s", __LINE__, \
 			trunk_info_dump(pTrunkInfo, buff, sizeof(buff)));
 		return ENOENT;
 	}
 
-	pCurrent = pSlot->head;
-	while (pCurrent != NULL && memcmp(&(pCurrent->trunk), \
-		pTrunkInfo, sizeof(FDFSTrunkFullInfo)) != 0)
+	trunk_remove_free_node(pShard, pCurrent);
+	pthread_mutex_unlock(&(pShard->lock));
+
+	if (bWriteBinLog)
+	{
+		result = trunk_mem_binlog_write(g_current_time, \
+				TRUNK_OP_TYPE_DEL_SPACE, &(pCurrent->trunk));
+	}
+	else
 	{
-		pCurrent = pCurrent->next;
+		trunk_add_free_space(&(pCurrent->trunk), \
+				-1 * pCurrent->trunk.file.size);
+		result = 0;
 	}
 
-	if (pCurrent == NULL)
+	trunk_node_free(pCurrent);
+	return result;
+}
+
+static int trunk_restore_node(const FDFSTrunkFullInfo *pTrunkInfo)
+{
+	TrunkAllocShard *pShard;
+	FDFSTrunkNode *pCurrent;
+	char buff[256];
+
+	pShard = TRUNK_SHARD(pTrunkInfo);
+	pthread_mutex_lock(&(pShard->lock));
+	pCurrent = (FDFSTrunkNode *)trunk_free_block_find(pTrunkInfo);
+	if (pCurrent == NULL || memcmp(&(pCurrent->trunk), pTrunkInfo, \
+		sizeof(FDFSTrunkFullInfo)) != 0)
 	{
-		pthread_mutex_unlock(&trunk_mem_lock);
+		pthread_mutex_unlock(&(pShard->lock));
 
 		logError("file: "__FILE__", line: %d, " \
 			"can't find trunk entry: %s", __LINE__, \
@@ -1386,7 +1895,12 @@ static int trunk_restore_node(const FDFSTrunkFullInfo *pTrunkInfo)
 	}
 
 	pCurrent->trunk.status = FDFS_TRUNK_STATUS_FREE;
-	pthread_mutex_unlock(&trunk_mem_lock);
+	if (!TRUNK_IS_RETIRED_FILE(pShard, pTrunkInfo))
+	{
+		trunk_size_class_add(TRUNK_SIZE_CLASSES(pShard, pTrunkInfo), \
+				pCurrent);
+	}
+	pthread_mutex_unlock(&(pShard->lock));
 
 	return 0;
 }
@@ -1394,7 +1908,6 @@ static int trunk_restore_node(const FDFSTrunkFullInfo *pTrunkInfo)
 static int trunk_split(FDFSTrunkNode *pNode, const int size)
 {
 	int result;
-	struct fast_mblock_node *pMblockNode;
 	FDFSTrunkNode *pTrunkNode;
 
 	if (pNode->trunk.file.size - size < g_slot_min_size)
@@ -1403,8 +1916,8 @@ static int trunk_split(FDFSTrunkNode *pNode, const int size)
 			TRUNK_OP_TYPE_DEL_SPACE, &(pNode->trunk));
 	}
 
-	pMblockNode = fast_mblock_alloc(&free_blocks_man);
-	if (pMblockNode == NULL)
+	pTrunkNode = trunk_node_alloc();
+	if (pTrunkNode == NULL)
 	{
 		result = errno != 0 ? errno : EIO;
 		logError("file: "__FILE__", line: %d, " \
@@ -1419,18 +1932,15 @@ static int trunk_split(FDFSTrunkNode *pNode, const int size)
 			TRUNK_OP_TYPE_DEL_SPACE, &(pNode->trunk));
 	if (result != 0)
 	{
-		fast_mblock_free(&free_blocks_man, pMblockNode);
+		trunk_node_free(pTrunkNode);
 		return result;
 	}
 
-	pTrunkNode = (FDFSTrunkNode *)pMblockNode->data;
-	memcpy(pTrunkNode, pNode, sizeof(FDFSTrunkNode));
-
-	pTrunkNode->pMblockNode = pMblockNode;
+	memcpy(&(pTrunkNode->trunk), &(pNode->trunk), \
+		sizeof(FDFSTrunkFullInfo));
 	pTrunkNode->trunk.file.offset = pNode->trunk.file.offset + size;
 	pTrunkNode->trunk.file.size = pNode->trunk.file.size - size;
 	pTrunkNode->trunk.status = FDFS_TRUNK_STATUS_FREE;
-	pTrunkNode->next = NULL;
 
 	result = trunk_add_free_block(pTrunkNode, true);
 	if (result != 0)
@@ -1442,14 +1952,16 @@ static int trunk_split(FDFSTrunkNode *pNode, const int size)
 	return 0;
 }
 
+/* the trunk file created in advance (bPreCreate) is preallocated, and
+   it is not logged as the caller adds it to the free blocks by
+   trunk_add_free_block with the binlog */
 static FDFSTrunkNode *trunk_create_trunk_file(const int store_path_index, \
-			int *err_no)
+			const bool bPreCreate, int *err_no)
 {
 	FDFSTrunkNode *pTrunkNode;
-	struct fast_mblock_node *pMblockNode;
 
-	pMblockNode = fast_mblock_alloc(&free_blocks_man);
-	if (pMblockNode == NULL)
+	pTrunkNode = trunk_node_alloc();
+	if (pTrunkNode == NULL)
 	{
 		*err_no = errno != 0 ? errno : EIO;
 		logError("file: "__FILE__", line: %d, " \
@@ -1460,9 +1972,6 @@ static FDFSTrunkNode *trunk_create_trunk_file(const int store_path_index, \
 		return NULL;
 	}
 
-	pTrunkNode = (FDFSTrunkNode *)pMblockNode->data;
-	pTrunkNode->pMblockNode = pMblockNode;
-
 	if (store_path_index >= 0)
 	{
 		pTrunkNode->trunk.path.store_path_index = store_path_index;
@@ -1478,6 +1987,8 @@ static FDFSTrunkNode *trunk_create_trunk_file(const int store_path_index, \
 				"get_storage_path_index fail, " \
 				"errno: %d, error info: %s", __LINE__, \
 				result, STRERROR(result));
+			trunk_node_free(pTrunkNode);
+			*err_no = result;
 			return NULL;
 		}
 		pTrunkNode->trunk.path.store_path_index = new_store_path_index;
@@ -1486,118 +1997,250 @@ static FDFSTrunkNode *trunk_create_trunk_file(const int store_path_index, \
 	pTrunkNode->trunk.file.offset = 0;
 	pTrunkNode->trunk.file.size = g_trunk_file_size;
 	pTrunkNode->trunk.status = FDFS_TRUNK_STATUS_FREE;
+	pTrunkNode->prev = NULL;
 	pTrunkNode->next = NULL;
 
-	*err_no = trunk_create_next_file(&(pTrunkNode->trunk));
+	*err_no = trunk_create_next_file(&(pTrunkNode->trunk), bPreCreate);
 	if (*err_no != 0)
 	{
-		fast_mblock_free(&free_blocks_man, pMblockNode);
+		trunk_node_free(pTrunkNode);
 		return NULL;
 	}
 
+	if (bPreCreate)
+	{
+		return pTrunkNode;
+	}
+
 	*err_no = trunk_mem_binlog_write(g_current_time, \
 			TRUNK_OP_TYPE_ADD_SPACE, &(pTrunkNode->trunk));
 	return pTrunkNode;
 }
 
-int trunk_alloc_space(const int size, FDFSTrunkFullInfo *pResult)
+/* take a free block from the shards, start from the shard of the thread,
+   the shards without the block of the size are skipped without the lock,
+   and the shards locked by the other threads are skipped at first.
+   before failing, all shards are checked with the lock, because the
+   bitmaps read without the lock may be stale, and the count of the
+   blocks being split by the other threads is returned */
+static FDFSTrunkNode *trunk_take_free_node(const int store_path_index, \
+		const int size, TrunkAllocShard **ppShard, int *alloc_running)
 {
-	FDFSTrunkSlot target_slot;
-	FDFSTrunkSlot *pSlot;
-	FDFSTrunkNode *pPreviousNode;
+	TrunkAllocShard *pShard;
+	FDFSTrunkSizeClasses *pClasses;
 	FDFSTrunkNode *pTrunkNode;
-	int result;
-
-	STORAGE_TRUNK_CHECK_STATUS();
+	bool skipped;
+	int round;
+	int i;
 
-	target_slot.size = (size > g_slot_min_size) ? size : g_slot_min_size;
-	target_slot.head = NULL;
+	if (trunk_shard_hint < 0)
+	{
+		pthread_mutex_lock(&trunk_file_lock);
+		trunk_shard_hint = trunk_shard_hint_seq++ % \
+				TRUNK_FREE_BLOCK_SHARD_COUNT;
+		pthread_mutex_unlock(&trunk_file_lock);
+	}
 
-	pPreviousNode = NULL;
-	pTrunkNode = NULL;
-	pthread_mutex_lock(&trunk_mem_lock);
-	while (1)
+	skipped = false;
+	*alloc_running = 0;
+	for (round=0; round<3; round++)
 	{
-		pSlot = (FDFSTrunkSlot *)avl_tree_find_ge(tree_info_by_sizes \
-			 + pResult->path.store_path_index, &target_slot);
-		if (pSlot == NULL)
+		if (round == 1 && !skipped)
 		{
-			break;
+			continue;
 		}
 
-		pPreviousNode = NULL;
-		pTrunkNode = pSlot->head;
-		while (pTrunkNode != NULL && \
-			pTrunkNode->trunk.status == FDFS_TRUNK_STATUS_HOLD)
+		for (i=0; i<TRUNK_FREE_BLOCK_SHARD_COUNT; i++)
 		{
-			pPreviousNode = pTrunkNode;
-			pTrunkNode = pTrunkNode->next;
-		}
+			pShard = trunk_shards + (trunk_shard_hint + i) % \
+					TRUNK_FREE_BLOCK_SHARD_COUNT;
+			pClasses = pShard->size_classes + store_path_index;
+			if (round < 2 && !trunk_size_class_may_fit( \
+					pClasses, size))
+			{
+				continue;
+			}
 
-		if (pTrunkNode != NULL)
-		{
-			break;
-		}
+			if (round == 0)
+			{
+				if (pthread_mutex_trylock(&(pShard->lock)) != 0)
+				{
+					skipped = true;
+					continue;
+				}
+			}
+			else
+			{
+				pthread_mutex_lock(&(pShard->lock));
+			}
 
-		target_slot.size = pSlot->size + 1;
-	}
+			pTrunkNode = trunk_size_class_find(pClasses, size);
+			if (pTrunkNode != NULL)
+			{
+				trunk_remove_free_node(pShard, pTrunkNode);
+				pShard->alloc_running++;
+				pthread_mutex_unlock(&(pShard->lock));
 
-	if (pTrunkNode != NULL)
-	{
-		if (pPreviousNode == NULL)
-		{
-			pSlot->head = pTrunkNode->next;
-			if (pSlot->head == NULL)
+				*ppShard = pShard;
+				return pTrunkNode;
+			}
+			if (round == 2)
 			{
-				trunk_delete_size_tree_entry(pResult->path. \
-					store_path_index, pSlot);
+				*alloc_running += pShard->alloc_running;
 			}
-		}
-		else
-		{
-			pPreviousNode->next = pTrunkNode->next;
-		}
-
-		trunk_free_block_delete(&(pTrunkNode->trunk));
-	}
-	else
-	{
-		pTrunkNode = trunk_create_trunk_file(pResult->path. \
-					store_path_index, &result);
-		if (pTrunkNode == NULL)
-		{
-			pthread_mutex_unlock(&trunk_mem_lock);
-			return result;
+			pthread_mutex_unlock(&(pShard->lock));
 		}
 	}
-	pthread_mutex_unlock(&trunk_mem_lock);
 
-	result = trunk_split(pTrunkNode, size);
-	if (result != 0)
-	{
-		return result;
-	}
+	*ppShard = NULL;
+	return NULL;
+}
 
-	pTrunkNode->trunk.status = FDFS_TRUNK_STATUS_HOLD;
-	result = trunk_add_free_block(pTrunkNode, true);
-	if (result == 0)
+/* wait until the version is changed by the split done or timeout */
+static int trunk_wait_split(const int64_t version, const struct timespec *ts)
+{
+	int result;
+
+	result = 0;
+	pthread_mutex_lock(&trunk_split_lock);
+	__atomic_add_fetch(&trunk_split_waiters, 1, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&trunk_split_version, __ATOMIC_SEQ_CST) == version)
 	{
-		memcpy(pResult, &(pTrunkNode->trunk), \
-			sizeof(FDFSTrunkFullInfo));
+		result = pthread_cond_timedwait(&trunk_split_cond, \
+				&trunk_split_lock, ts);
 	}
+	__atomic_sub_fetch(&trunk_split_waiters, 1, __ATOMIC_SEQ_CST);
+	pthread_mutex_unlock(&trunk_split_lock);
 
 	return result;
 }
 
-int trunk_alloc_confirm(const FDFSTrunkFullInfo *pTrunkInfo, const int status)
+/* the rest space of the split block is in the shard, wake the waiting
+   threads, the lock is taken only when some thread is waiting */
+static void trunk_split_done()
 {
-	FDFSTrunkFullInfo target_trunk_info;
-
-	STORAGE_TRUNK_CHECK_STATUS();
+	__atomic_add_fetch(&trunk_split_version, 1, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&trunk_split_waiters, __ATOMIC_SEQ_CST) > 0)
+	{
+		pthread_mutex_lock(&trunk_split_lock);
+		pthread_cond_broadcast(&trunk_split_cond);
+		pthread_mutex_unlock(&trunk_split_lock);
+	}
+}
 
-	memset(&target_trunk_info, 0, sizeof(FDFSTrunkFullInfo));
-	target_trunk_info.status = FDFS_TRUNK_STATUS_HOLD;
-	target_trunk_info.path.store_path_index = \
+/* take a free block, when the other threads are splitting the blocks
+   taken out, wait for them up to TRUNK_ALLOC_WAIT_SPLIT_MS and retry.
+   the version is read before the shards are checked, so a split done
+   after the check is never missed */
+static FDFSTrunkNode *trunk_alloc_free_node(const int store_path_index, \
+		const int size, TrunkAllocShard **ppShard)
+{
+	FDFSTrunkNode *pTrunkNode;
+	struct timeval tv;
+	struct timespec ts;
+	int64_t version;
+	int alloc_running;
+	bool timeout;
+
+	timeout = false;
+	ts.tv_sec = 0;
+	while (1)
+	{
+		version = __atomic_load_n(&trunk_split_version, \
+				__ATOMIC_SEQ_CST);
+		pTrunkNode = trunk_take_free_node(store_path_index, size, \
+				ppShard, &alloc_running);
+		if (pTrunkNode != NULL || alloc_running == 0 || timeout)
+		{
+			return pTrunkNode;
+		}
+
+		if (ts.tv_sec == 0)
+		{
+			gettimeofday(&tv, NULL);
+			tv.tv_usec += TRUNK_ALLOC_WAIT_SPLIT_MS * 1000;
+			ts.tv_sec = tv.tv_sec + tv.tv_usec / 1000000;
+			ts.tv_nsec = (tv.tv_usec % 1000000) * 1000;
+		}
+		timeout = trunk_wait_split(version, &ts) == ETIMEDOUT;
+	}
+}
+
+int trunk_alloc_space_ex(const int size, FDFSTrunkFullInfo *pResult, \
+		const bool bCreateFile)
+{
+	TrunkAllocShard *pShard;
+	FDFSTrunkNode *pTrunkNode;
+	int alloc_running;
+	int result;
+
+	STORAGE_TRUNK_CHECK_STATUS();
+
+	pTrunkNode = trunk_alloc_free_node(pResult->path.store_path_index, \
+		(size > g_slot_min_size) ? size : g_slot_min_size, &pShard);
+	if (pTrunkNode == NULL)
+	{
+		if (!bCreateFile)
+		{
+			return ENOSPC;
+		}
+
+		/* only one thread creates the trunk file,
+		   the others alloc from the new file without waiting */
+		pthread_mutex_lock(&trunk_create_lock);
+		pTrunkNode = trunk_take_free_node(pResult->path. \
+			store_path_index, (size > g_slot_min_size) ? \
+			size : g_slot_min_size, &pShard, &alloc_running);
+		if (pTrunkNode == NULL)
+		{
+			pTrunkNode = trunk_create_trunk_file(pResult->path. \
+					store_path_index, false, &result);
+		}
+		pthread_mutex_unlock(&trunk_create_lock);
+
+		if (pTrunkNode == NULL)
+		{
+			return result;
+		}
+	}
+
+	result = trunk_split(pTrunkNode, size);
+	if (result == 0)
+	{
+		pTrunkNode->trunk.status = FDFS_TRUNK_STATUS_HOLD;
+		result = trunk_add_free_block(pTrunkNode, true);
+		if (result == 0)
+		{
+			memcpy(pResult, &(pTrunkNode->trunk), \
+				sizeof(FDFSTrunkFullInfo));
+
+			pthread_mutex_lock(&trunk_file_lock);
+			trunk_path_runways[pResult->path.store_path_index]. \
+				alloc_bytes += pResult->file.size;
+			pthread_mutex_unlock(&trunk_file_lock);
+		}
+	}
+
+	if (pShard != NULL)
+	{
+		pthread_mutex_lock(&(pShard->lock));
+		pShard->alloc_running--;
+		pthread_mutex_unlock(&(pShard->lock));
+		trunk_split_done();
+	}
+
+	return result;
+}
+
+int trunk_alloc_confirm(const FDFSTrunkFullInfo *pTrunkInfo, const int status)
+{
+	FDFSTrunkFullInfo target_trunk_info;
+
+	STORAGE_TRUNK_CHECK_STATUS();
+
+	memset(&target_trunk_info, 0, sizeof(FDFSTrunkFullInfo));
+	target_trunk_info.status = FDFS_TRUNK_STATUS_HOLD;
+	target_trunk_info.path.store_path_index = \
 			pTrunkInfo->path.store_path_index;
 	target_trunk_info.path.sub_path_high = pTrunkInfo->path.sub_path_high;
 	target_trunk_info.path.sub_path_low = pTrunkInfo->path.sub_path_low;
@@ -1626,7 +2269,604 @@ int trunk_alloc_confirm(const FDFSTrunkFullInfo *pTrunkInfo, const int status)
 	}
 }
 
-static int trunk_create_next_file(FDFSTrunkFullInfo *pTrunkInfo)
+/* add the lease to the lease table, the caller should lock the shard */
+static int trunk_lease_insert(TrunkAllocShard *pShard, \
+		const FDFSTrunkLeaseInfo *pLease)
+{
+	int result;
+
+	result = hash_insert_ex(&(pShard->leases), &(pLease->lease_id), \
+			sizeof(pLease->lease_id), (void *)pLease, \
+			sizeof(FDFSTrunkLeaseInfo), false);
+	if (result < 0)
+	{
+		result = -1 * result;
+		logError("file: "__FILE__", line: %d, " \
+			"insert the trunk lease fail, " \
+			"errno: %d, error info: %s", \
+			__LINE__, result, STRERROR(result));
+		return result;
+	}
+
+	return 0;
+}
+
+/* the lease loaded from the snapshot or the binlog */
+static int trunk_lease_restore(const FDFSTrunkLeaseInfo *pLease)
+{
+	TrunkAllocShard *pShard;
+	int result;
+
+	pShard = TRUNK_SHARD(&(pLease->trunk));
+	pthread_mutex_lock(&(pShard->lock));
+	result = trunk_lease_insert(pShard, pLease);
+	if (pLease->lease_id > trunk_lease_id)
+	{
+		trunk_lease_id = pLease->lease_id;
+	}
+	pthread_mutex_unlock(&(pShard->lock));
+
+	return result;
+}
+
+static bool trunk_lease_remove(const FDFSTrunkFullInfo *pTrunkInfo, \
+		const int64_t lease_id)
+{
+	TrunkAllocShard *pShard;
+	int result;
+
+	pShard = TRUNK_SHARD(pTrunkInfo);
+	pthread_mutex_lock(&(pShard->lock));
+	result = hash_delete(&(pShard->leases), &lease_id, sizeof(lease_id));
+	pthread_mutex_unlock(&(pShard->lock));
+
+	return (result == 0);
+}
+
+int trunk_alloc_lease(const int size, FDFSTrunkFullInfo *pResult, \
+		int64_t *lease_id)
+{
+	TrunkAllocShard *pShard;
+	FDFSTrunkLeaseInfo lease;
+	time_t lease_time;
+	int result;
+
+	if ((result=trunk_alloc_space(size, pResult)) != 0)
+	{
+		return result;
+	}
+
+	if ((result=trunk_alloc_confirm(pResult, 0)) != 0)
+	{
+		trunk_alloc_confirm(pResult, result);
+		return result;
+	}
+
+	lease.lease_id = __sync_add_and_fetch(&trunk_lease_id, 1);
+	memcpy(&lease.trunk, pResult, sizeof(FDFSTrunkFullInfo));
+
+	//the compactor skips the trunk files with the recent leases
+	lease_time = g_current_time;
+	pShard = TRUNK_SHARD(pResult);
+	pthread_mutex_lock(&(pShard->lock));
+	hash_insert_ex(&(pShard->lease_hash), &(pResult->file.id), \
+		sizeof(pResult->file.id), &lease_time, \
+		sizeof(lease_time), false);
+	result = trunk_lease_insert(pShard, &lease);
+	pthread_mutex_unlock(&(pShard->lock));
+
+	if (result == 0 && (result=trunk_binlog_write_lease(g_current_time, \
+		TRUNK_OP_TYPE_LEASE, pResult, lease.lease_id)) != 0)
+	{
+		trunk_lease_remove(pResult, lease.lease_id);
+	}
+
+	if (result != 0)
+	{
+		trunk_free_space(pResult, true);
+		return result;
+	}
+
+	*lease_id = lease.lease_id;
+	return 0;
+}
+
+int trunk_return_lease(const FDFSTrunkFullInfo *pTrunkInfo, \
+		const int64_t lease_id)
+{
+	TrunkAllocShard *pShard;
+	FDFSTrunkLeaseInfo *pLease;
+	char buff[256];
+	int result;
+
+	STORAGE_TRUNK_CHECK_STATUS();
+
+	pShard = TRUNK_SHARD(pTrunkInfo);
+	pthread_mutex_lock(&(pShard->lock));
+	pLease = (FDFSTrunkLeaseInfo *)hash_find(&(pShard->leases), \
+			&lease_id, sizeof(lease_id));
+	if (pLease == NULL)
+	{
+		result = ENOENT;
+	}
+	else if (memcmp(&(pTrunkInfo->path), &(pLease->trunk.path), \
+		sizeof(FDFSTrunkPathInfo)) != 0 || pTrunkInfo->file.id != \
+		pLease->trunk.file.id || pTrunkInfo->file.size < 0 || \
+		pTrunkInfo->file.offset < pLease->trunk.file.offset || \
+		pTrunkInfo->file.offset + pTrunkInfo->file.size != \
+		pLease->trunk.file.offset + pLease->trunk.file.size)
+	{
+		result = EINVAL;  //only the rest space of the lease
+	}
+	else
+	{
+		result = hash_delete(&(pShard->leases), \
+				&lease_id, sizeof(lease_id));
+	}
+	pthread_mutex_unlock(&(pShard->lock));
+
+	if (result != 0)
+	{
+		logWarning("file: "__FILE__", line: %d, " \
+			"return the trunk lease "INT64_PRINTF_FORMAT \
+			" fail, trunk info: %s, errno: %d, error info: %s", \
+			__LINE__, lease_id, trunk_info_dump(pTrunkInfo, \
+			buff, sizeof(buff)), result, STRERROR(result));
+		return result;
+	}
+
+	/* the lease is ended before the space is freed, the space
+	   is lost rather than freed twice when crashed between */
+	if ((result=trunk_binlog_write_lease(g_current_time, \
+		TRUNK_OP_TYPE_LEASE_END, pTrunkInfo, lease_id)) != 0)
+	{
+		return result;
+	}
+
+	if (pTrunkInfo->file.size == 0)
+	{
+		return 0;
+	}
+	return trunk_free_space(pTrunkInfo, true);
+}
+
+static int trunk_lease_find_by_file(const int index, const HashData *data, \
+		void *args)
+{
+	FDFSTrunkLeaseInfo *pFound;
+	const FDFSTrunkLeaseInfo *pLease;
+
+	pFound = (FDFSTrunkLeaseInfo *)args;
+	pLease = (const FDFSTrunkLeaseInfo *)data->value;
+	if (pLease->trunk.file.id == pFound->trunk.file.id && \
+		memcmp(&(pLease->trunk.path), &(pFound->trunk.path), \
+			sizeof(FDFSTrunkPathInfo)) == 0)
+	{
+		memcpy(pFound, pLease, sizeof(FDFSTrunkLeaseInfo));
+		return EEXIST;
+	}
+
+	return 0;
+}
+
+struct compact_select_args
+{
+	int min_free_ratio;
+	int skip_file_id;
+	int free_ratio;
+	int64_t total_free_space;
+	FDFSTrunkFullInfo *pTrunkInfo;
+};
+
+static int trunk_compact_select_callback(FDFSTrunksById *pTrunksById, \
+		void *args)
+{
+	struct compact_select_args *pSelectArgs;
+	FDFSBlockIterator iterator;
+	FDFSTrunkFullInfo *pBlock;
+	time_t *pLeaseTime;
+	int64_t free_space;
+	int free_ratio;
+
+	pSelectArgs = (struct compact_select_args *)args;
+	if (pTrunksById->block_array.count == 0 || \
+		pTrunksById->trunk_file_id.id == pSelectArgs->skip_file_id)
+	{
+		return 0;
+	}
+
+	free_space = 0;
+	for (pBlock=trunk_free_block_first(pTrunksById, &iterator);
+		pBlock!=NULL; pBlock=trunk_free_block_next(&iterator))
+	{
+		if (pBlock->status != FDFS_TRUNK_STATUS_FREE)
+		{
+			return 0;  //being allocated
+		}
+		free_space += pBlock->file.size;
+	}
+
+	//the whole free file is reclaimed when the space is enough
+	if (free_space >= g_trunk_file_size)
+	{
+		return 0;
+	}
+
+	/* the live files must be moved to the free space of the other
+	   trunk files, do not create the new trunk files for them */
+	if (g_trunk_file_size - free_space > (pSelectArgs->total_free_space \
+		- free_space) / 2)
+	{
+		return 0;
+	}
+
+	pLeaseTime = (time_t *)hash_find(&(trunk_shards[ \
+		TRUNK_FREE_BLOCK_SHARD_INDEX(pTrunksById->trunk_file_id.id)]. \
+		lease_hash), \
+		&(pTrunksById->trunk_file_id.id), \
+		sizeof(pTrunksById->trunk_file_id.id));
+	if (pLeaseTime != NULL && g_current_time - *pLeaseTime < \
+		2 * g_trunk_lease_ttl)
+	{
+		return 0;  //the leased space may be not written yet
+	}
+
+	free_ratio = (int)(free_space * 100 / g_trunk_file_size);
+	if (free_ratio < pSelectArgs->min_free_ratio || \
+		free_ratio <= pSelectArgs->free_ratio)
+	{
+		return 0;
+	}
+
+	pSelectArgs->free_ratio = free_ratio;
+	memset(pSelectArgs->pTrunkInfo, 0, sizeof(FDFSTrunkFullInfo));
+	pSelectArgs->pTrunkInfo->path = pTrunksById->trunk_file_id.path;
+	pSelectArgs->pTrunkInfo->file.id = pTrunksById->trunk_file_id.id;
+	pSelectArgs->pTrunkInfo->file.offset = 0;
+	pSelectArgs->pTrunkInfo->file.size = g_trunk_file_size;
+	return 0;
+}
+
+int trunk_compact_select_file(const int min_free_ratio, \
+		const int skip_file_id, FDFSTrunkFullInfo *pTrunkInfo)
+{
+	struct compact_select_args select_args;
+	int result;
+	int i;
+
+	STORAGE_TRUNK_CHECK_STATUS();
+
+	/* the leases alloced by the previous trunk server are unknown */
+	if (g_current_time - trunk_init_done_time < 2 * g_trunk_lease_ttl)
+	{
+		return ENOENT;
+	}
+
+	memset(&select_args, 0, sizeof(select_args));
+	select_args.min_free_ratio = min_free_ratio;
+	select_args.skip_file_id = skip_file_id;
+	select_args.pTrunkInfo = pTrunkInfo;
+	pthread_mutex_lock(&trunk_file_lock);
+	select_args.total_free_space = g_trunk_total_free_space;
+	pthread_mutex_unlock(&trunk_file_lock);
+
+	result = 0;
+	for (i=0; i<TRUNK_FREE_BLOCK_SHARD_COUNT; i++)
+	{
+		pthread_mutex_lock(&(trunk_shards[i].lock));
+		result = trunk_free_block_walk_files(i, \
+			trunk_compact_select_callback, &select_args);
+		pthread_mutex_unlock(&(trunk_shards[i].lock));
+		if (result != 0)
+		{
+			break;
+		}
+	}
+
+	if (result != 0)
+	{
+		return result;
+	}
+	return select_args.free_ratio > 0 ? 0 : ENOENT;
+}
+
+/* caller should hold the lock of the shard */
+static bool trunk_compact_file_busy(TrunkAllocShard *pShard)
+{
+	FDFSTrunksById *pTrunksById;
+	FDFSBlockIterator iterator;
+	FDFSTrunkFullInfo *pBlock;
+
+	if (pShard->alloc_running > 0)
+	{
+		return true;
+	}
+
+	pTrunksById = trunk_free_block_get_file(&(pShard->compact_file));
+	if (pTrunksById == NULL)
+	{
+		return false;
+	}
+
+	for (pBlock=trunk_free_block_first(pTrunksById, &iterator);
+		pBlock!=NULL; pBlock=trunk_free_block_next(&iterator))
+	{
+		if (pBlock->status != FDFS_TRUNK_STATUS_FREE)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+int trunk_compact_retire_file(const FDFSTrunkFullInfo *pTrunkInfo, \
+		const int timeout)
+{
+	TrunkAllocShard *pShard;
+	FDFSTrunksById *pTrunksById;
+	FDFSBlockIterator iterator;
+	FDFSTrunkFullInfo *pBlock;
+	bool busy;
+	int i;
+
+	STORAGE_TRUNK_CHECK_STATUS();
+
+	pShard = TRUNK_SHARD(pTrunkInfo);
+	pthread_mutex_lock(&(pShard->lock));
+	if (pShard->compact_retired)
+	{
+		pthread_mutex_unlock(&(pShard->lock));
+		return EBUSY;
+	}
+
+	pTrunksById = trunk_free_block_get_file(pTrunkInfo);
+	if (pTrunksById == NULL)
+	{
+		pthread_mutex_unlock(&(pShard->lock));
+		return ENOENT;
+	}
+
+	for (pBlock=trunk_free_block_first(pTrunksById, &iterator);
+		pBlock!=NULL; pBlock=trunk_free_block_next(&iterator))
+	{
+		if (pBlock->status != FDFS_TRUNK_STATUS_FREE)
+		{
+			pthread_mutex_unlock(&(pShard->lock));
+			return EBUSY;
+		}
+	}
+
+	for (pBlock=trunk_free_block_first(pTrunksById, &iterator);
+		pBlock!=NULL; pBlock=trunk_free_block_next(&iterator))
+	{
+		//the trunk info is the first field of the node
+		trunk_size_class_remove(TRUNK_SIZE_CLASSES(pShard, \
+			pTrunkInfo), (FDFSTrunkNode *)pBlock);
+	}
+
+	memcpy(&(pShard->compact_file), pTrunkInfo, sizeof(FDFSTrunkFullInfo));
+	pShard->compact_retired = true;
+	pthread_mutex_unlock(&(pShard->lock));
+
+	/* wait for the nodes taken from this file before it is retired */
+	for (i=0; i<timeout * 10; i++)
+	{
+		pthread_mutex_lock(&(pShard->lock));
+		busy = trunk_compact_file_busy(pShard);
+		pthread_mutex_unlock(&(pShard->lock));
+		if (!busy)
+		{
+			return 0;
+		}
+
+		usleep(100 * 1000);
+	}
+
+	trunk_compact_release_file(pTrunkInfo, false);
+	return ETIMEDOUT;
+}
+
+int trunk_compact_get_free_blocks(const FDFSTrunkFullInfo *pTrunkInfo, \
+		FDFSTrunkFullInfo **ppBlocks, int *count)
+{
+	TrunkAllocShard *pShard;
+	FDFSTrunksById *pTrunksById;
+	FDFSBlockIterator iterator;
+	FDFSTrunkFullInfo *pBlock;
+	int result;
+	int i;
+
+	*ppBlocks = NULL;
+	*count = 0;
+	STORAGE_TRUNK_CHECK_STATUS();
+
+	result = 0;
+	pShard = TRUNK_SHARD(pTrunkInfo);
+	pthread_mutex_lock(&(pShard->lock));
+	pTrunksById = trunk_free_block_get_file(pTrunkInfo);
+	if (pTrunksById != NULL && pTrunksById->block_array.count > 0)
+	{
+		*ppBlocks = (FDFSTrunkFullInfo *)malloc( \
+				sizeof(FDFSTrunkFullInfo) * \
+				pTrunksById->block_array.count);
+		if (*ppBlocks == NULL)
+		{
+			result = errno != 0 ? errno : ENOMEM;
+			logError("file: "__FILE__", line: %d, " \
+				"malloc %d bytes fail, " \
+				"errno: %d, error info: %s", __LINE__, \
+				(int)sizeof(FDFSTrunkFullInfo) * \
+				pTrunksById->block_array.count, \
+				result, STRERROR(result));
+		}
+		else
+		{
+			i = 0;
+			for (pBlock=trunk_free_block_first(pTrunksById, \
+				&iterator); pBlock!=NULL; \
+				pBlock=trunk_free_block_next(&iterator))
+			{
+				memcpy(*ppBlocks + i++, pBlock, \
+					sizeof(FDFSTrunkFullInfo));
+			}
+			*count = i;
+		}
+	}
+	pthread_mutex_unlock(&(pShard->lock));
+
+	return result;
+}
+
+bool trunk_compact_is_space_free(const FDFSTrunkFullInfo *pTrunkInfo)
+{
+	TrunkAllocShard *pShard;
+	FDFSTrunksById *pTrunksById;
+	FDFSBlockIterator iterator;
+	FDFSTrunkFullInfo *pBlock;
+	bool is_free;
+
+	if (trunk_init_flag != STORAGE_TRUNK_INIT_FLAG_DONE)
+	{
+		return false;
+	}
+
+	is_free = false;
+	pShard = TRUNK_SHARD(pTrunkInfo);
+	pthread_mutex_lock(&(pShard->lock));
+	pTrunksById = trunk_free_block_get_file(pTrunkInfo);
+	if (pTrunksById != NULL)
+	{
+		for (pBlock=trunk_free_block_first(pTrunksById, &iterator);
+			pBlock!=NULL; pBlock=trunk_free_block_next(&iterator))
+		{
+			if (pBlock->file.offset < pTrunkInfo->file.offset + \
+				pTrunkInfo->file.size && pTrunkInfo->file.offset \
+				< pBlock->file.offset + pBlock->file.size)
+			{
+				is_free = true;
+				break;
+			}
+		}
+	}
+	pthread_mutex_unlock(&(pShard->lock));
+
+	return is_free;
+}
+
+int trunk_compact_release_file(const FDFSTrunkFullInfo *pTrunkInfo, \
+		const bool bReclaim)
+{
+	TrunkAllocShard *pShard;
+	FDFSTrunksById *pTrunksById;
+	FDFSBlockIterator iterator;
+	FDFSTrunkNode *pNode;
+	FDFSTrunkLeaseInfo lease;
+	int result;
+
+	STORAGE_TRUNK_CHECK_STATUS();
+
+	result = 0;
+	pShard = TRUNK_SHARD(pTrunkInfo);
+	pthread_mutex_lock(&(pShard->lock));
+	if (!TRUNK_IS_RETIRED_FILE(pShard, pTrunkInfo))
+	{
+		pthread_mutex_unlock(&(pShard->lock));
+		return ENOENT;
+	}
+
+	if (bReclaim)
+	{
+		while ((pTrunksById=trunk_free_block_get_file(pTrunkInfo)) \
+			!= NULL && (pNode=(FDFSTrunkNode *) \
+			trunk_free_block_first(pTrunksById, &iterator)) != NULL)
+		{
+			trunk_free_block_delete(&(pNode->trunk));
+			if (result == 0)
+			{
+				result = trunk_mem_binlog_write(g_current_time,\
+					TRUNK_OP_TYPE_DEL_SPACE, &(pNode->trunk));
+			}
+			else
+			{
+				trunk_mem_binlog_write(g_current_time, \
+					TRUNK_OP_TYPE_DEL_SPACE, &(pNode->trunk));
+			}
+			trunk_node_free(pNode);
+		}
+
+		/* the leases not returned are dropped, the storage
+		   returning them later gets ENOENT */
+		memcpy(&lease.trunk, pTrunkInfo, sizeof(FDFSTrunkFullInfo));
+		while (hash_walk(&(pShard->leases), trunk_lease_find_by_file, \
+			&lease) == EEXIST)
+		{
+			hash_delete(&(pShard->leases), &(lease.lease_id), \
+				sizeof(lease.lease_id));
+			trunk_binlog_write_lease(g_current_time, \
+				TRUNK_OP_TYPE_LEASE_END, &(lease.trunk), \
+				lease.lease_id);
+		}
+
+		if (result == 0)
+		{
+			result = trunk_mem_binlog_write(g_current_time, \
+				TRUNK_OP_TYPE_RECLAIM, pTrunkInfo);
+		}
+		hash_delete(&(pShard->lease_hash), &(pTrunkInfo->file.id), \
+			sizeof(pTrunkInfo->file.id));
+	}
+	else
+	{
+		pTrunksById = trunk_free_block_get_file(pTrunkInfo);
+		pNode = pTrunksById != NULL ? (FDFSTrunkNode *) \
+			trunk_free_block_first(pTrunksById, &iterator) : NULL;
+		for (; pNode!=NULL; pNode=(FDFSTrunkNode *) \
+			trunk_free_block_next(&iterator))
+		{
+			if (pNode->trunk.status == FDFS_TRUNK_STATUS_FREE)
+			{
+				trunk_size_class_add(TRUNK_SIZE_CLASSES( \
+					pShard, pTrunkInfo), pNode);
+			}
+		}
+	}
+
+	pShard->compact_retired = false;
+	pthread_mutex_unlock(&(pShard->lock));
+
+	if (bReclaim)
+	{
+		trunk_reclaim_file(pTrunkInfo);
+	}
+
+	return result;
+}
+
+static void trunk_preallocate_file(const char *filename)
+{
+#if defined(OS_LINUX)
+	int fd;
+
+	if ((fd=open(filename, O_WRONLY)) < 0)
+	{
+		return;
+	}
+
+	//the blocks are reserved, so the writes don't extend the file
+	if (fallocate(fd, 0, 0, g_trunk_file_size) != 0)
+	{
+		logDebug("file: "__FILE__", line: %d, " \
+			"fallocate file %s fail, " \
+			"errno: %d, error info: %s", __LINE__, \
+			filename, errno, STRERROR(errno));
+	}
+	close(fd);
+#endif
+}
+
+static int trunk_create_next_file(FDFSTrunkFullInfo *pTrunkInfo, \
+		const bool bPreallocate)
 {
 	char buff[32];
 	int result;
@@ -1670,6 +2910,11 @@ static int trunk_create_next_file(FDFSTrunkFullInfo *pTrunkInfo)
 		return result;
 	}
 
+	if (bPreallocate)
+	{
+		trunk_preallocate_file(full_filename);
+	}
+
 	return 0;
 }
 
@@ -1858,22 +3103,15 @@ int trunk_file_delete(const char *trunk_filename, \
 {
 	char pack_buff[FDFS_TRUNK_FILE_HEADER_SIZE];
 	char buff[64 * 1024];
+	int64_t offset;
 	int fd;
 	int write_bytes;
 	int result;
 	int remain_bytes;
 	FDFSTrunkHeader trunkHeader;
 
-	fd = open(trunk_filename, O_WRONLY);
-	if (fd < 0)
-	{
-		return errno != 0 ? errno : EIO;
-	}
-
-	if (lseek(fd, pTrunkInfo->file.offset, SEEK_SET) < 0)
+	if ((result=trunk_fd_cache_open(pTrunkInfo, trunk_filename, &fd)) != 0)
 	{
-		result = errno != 0 ? errno : EIO;
-		close(fd);
 		return result;
 	}
 
@@ -1882,31 +3120,34 @@ int trunk_file_delete(const char *trunk_filename, \
 	trunkHeader.file_type = FDFS_TRUNK_FILE_TYPE_NONE;
 	trunk_pack_header(&trunkHeader, pack_buff);
 
-	write_bytes = write(fd, pack_buff, FDFS_TRUNK_FILE_HEADER_SIZE);
+	offset = pTrunkInfo->file.offset;
+	write_bytes = pwrite(fd, pack_buff, FDFS_TRUNK_FILE_HEADER_SIZE, offset);
 	if (write_bytes != FDFS_TRUNK_FILE_HEADER_SIZE)
 	{
 		result = errno != 0 ? errno : EIO;
-		close(fd);
+		trunk_fd_cache_close(fd);
 		return result;
 	}
 
 	memset(buff, 0, sizeof(buff));
 	result = 0;
+	offset += FDFS_TRUNK_FILE_HEADER_SIZE;
 	remain_bytes = pTrunkInfo->file.size - FDFS_TRUNK_FILE_HEADER_SIZE;
 	while (remain_bytes > 0)
 	{
 		write_bytes = remain_bytes > sizeof(buff) ? \
 				sizeof(buff) : remain_bytes;
-		if (write(fd, buff, write_bytes) != write_bytes)
+		if (pwrite(fd, buff, write_bytes, offset) != write_bytes)
 		{
 			result = errno != 0 ? errno : EIO;
 			break;
 		}
 
+		offset += write_bytes;
 		remain_bytes -= write_bytes;
 	}
 
-	close(fd);
+	trunk_fd_cache_close(fd);
 	return result;
 }
 
@@ -1963,14 +3204,15 @@ int trunk_create_trunk_file_advance(void *args)
 	file_count = alloc_space / g_trunk_file_size;
 	for (i=0; i<file_count; i++)
 	{
-		pTrunkNode = trunk_create_trunk_file(-1, &result);
-		if (pTrunkNode != NULL)
+		pTrunkNode = trunk_create_trunk_file(-1, true, &result);
+		if (pTrunkNode == NULL)
 		{
-			result = trunk_add_free_block(pTrunkNode, false);
-			if (result != 0)
-			{
-				break;
-			}
+			break;
+		}
+
+		if ((result=trunk_add_free_block(pTrunkNode, true)) != 0)
+		{
+			break;
 		}
 	}
 
@@ -1983,3 +3225,105 @@ int trunk_create_trunk_file_advance(void *args)
 	return result;
 }
 
+int trunk_create_file_by_runway(void *args)
+{
+	TrunkPathRunway *pRunway;
+	FDFSTrunkNode *pTrunkNode;
+	int64_t peak_rate;
+	int64_t runway_space;
+	int64_t free_space;
+	int elapsed;
+	int file_count;
+	int result;
+	int i;
+	int k;
+
+	if (!(g_if_trunker_self && trunk_init_flag == \
+		STORAGE_TRUNK_INIT_FLAG_DONE))
+	{
+		return 0;
+	}
+
+	result = 0;
+	for (i=0; i<g_fdfs_store_paths.count; i++)
+	{
+		pRunway = trunk_path_runways + i;
+		pthread_mutex_lock(&trunk_file_lock);
+		elapsed = g_current_time - pRunway->last_sample_time;
+		if (pRunway->last_sample_time == 0 || elapsed <= 0)
+		{
+			pRunway->last_sample_time = g_current_time;
+			pRunway->last_alloc_bytes = pRunway->alloc_bytes;
+			pthread_mutex_unlock(&trunk_file_lock);
+			continue;
+		}
+
+		pRunway->rates[pRunway->rate_index] = (pRunway->alloc_bytes - \
+				pRunway->last_alloc_bytes) / elapsed;
+		pRunway->rate_index = (pRunway->rate_index + 1) % \
+				TRUNK_RUNWAY_SAMPLE_COUNT;
+		pRunway->last_alloc_bytes = pRunway->alloc_bytes;
+		pRunway->last_sample_time = g_current_time;
+
+		peak_rate = 0;
+		for (k=0; k<TRUNK_RUNWAY_SAMPLE_COUNT; k++)
+		{
+			if (pRunway->rates[k] > peak_rate)
+			{
+				peak_rate = pRunway->rates[k];
+			}
+		}
+		pRunway->peak_rate = peak_rate;
+		free_space = pRunway->free_space;
+		pthread_mutex_unlock(&trunk_file_lock);
+
+		runway_space = peak_rate * g_trunk_create_file_runway;
+		if (free_space >= runway_space)
+		{
+			continue;
+		}
+
+		file_count = (runway_space - free_space + g_trunk_file_size \
+				- 1) / g_trunk_file_size;
+		if (file_count > TRUNK_RUNWAY_CREATE_MAX_FILES)
+		{
+			file_count = TRUNK_RUNWAY_CREATE_MAX_FILES;
+		}
+
+		if (!storage_check_reserved_space_path( \
+			g_path_space_list[i].total_mb, \
+			g_path_space_list[i].free_mb - (int64_t)file_count * \
+			g_trunk_file_size / FDFS_ONE_MB, \
+			g_avg_storage_reserved_mb))
+		{
+			logDebug("file: "__FILE__", line: %d, " \
+				"store path: %d, free space is not enough " \
+				"for the trunk runway", __LINE__, i);
+			continue;
+		}
+
+		for (k=0; k<file_count; k++)
+		{
+			pTrunkNode = trunk_create_trunk_file(i, true, &result);
+			if (pTrunkNode == NULL)
+			{
+				break;
+			}
+
+			if ((result=trunk_add_free_block(pTrunkNode, \
+					true)) != 0)
+			{
+				break;
+			}
+		}
+
+		logInfo("file: "__FILE__", line: %d, " \
+			"store path: %d, peak alloc rate: "INT64_PRINTF_FORMAT \
+			" KB/s, free trunk space: "INT64_PRINTF_FORMAT" MB, " \
+			"create trunk file count: %d", __LINE__, i, \
+			peak_rate / 1024, free_space / FDFS_ONE_MB, k);
+	}
+
+	return result;
+}
+
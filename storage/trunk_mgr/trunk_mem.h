@@ -49,27 +49,69 @@ extern time_t g_trunk_last_compress_time;
 
 typedef struct tagFDFSTrunkNode {
 	FDFSTrunkFullInfo trunk;    //trunk info
-	struct fast_mblock_node *pMblockNode;   //for free
+	uint32_t id;    //the node id in the node pool
+	struct tagFDFSTrunkNode *prev;  //the size class list
 	struct tagFDFSTrunkNode *next;
 } FDFSTrunkNode;
 
-typedef struct {
-	int size;
-	FDFSTrunkNode *head;
-	struct fast_mblock_node *pMblockNode;   //for free
-} FDFSTrunkSlot;
-
 int storage_trunk_init();
 int storage_trunk_destroy_ex(const bool bNeedSleep);
 
 #define storage_trunk_destroy() storage_trunk_destroy_ex(false)
 
-int trunk_alloc_space(const int size, FDFSTrunkFullInfo *pResult);
+/* write the snapshot of the trunk space when the binlog changed */
+int storage_trunk_checkpoint();
+
+#define trunk_alloc_space(size, pResult) \
+	trunk_alloc_space_ex(size, pResult, true)
+
+/* alloc from the free space only when bCreateFile is false,
+   return ENOSPC when no free block is large enough */
+int trunk_alloc_space_ex(const int size, FDFSTrunkFullInfo *pResult, \
+		const bool bCreateFile);
 int trunk_alloc_confirm(const FDFSTrunkFullInfo *pTrunkInfo, const int status);
 
+/* alloc and confirm the space at once, the lease is used by the storage,
+   the lease id is recorded in the binlog until the lease is returned */
+int trunk_alloc_lease(const int size, FDFSTrunkFullInfo *pResult, \
+		int64_t *lease_id);
+
+/* free the rest space of the lease (file.size 0 for none) and end the
+   lease, return ENOENT when the lease is returned or dropped already */
+int trunk_return_lease(const FDFSTrunkFullInfo *pTrunkInfo, \
+		const int64_t lease_id);
+
 int trunk_free_space(const FDFSTrunkFullInfo *pTrunkInfo, \
 		const bool bWriteBinLog);
 
+/* unlink the trunk file which all space is free */
+void trunk_reclaim_file(const FDFSTrunkFullInfo *pTrunkInfo);
+
+/* select the trunk file which free space ratio is the highest one
+   and not less than min_free_ratio (percent) for compaction,
+   skip_file_id is the trunk file failed to compact last time,
+   return 0 for found, ENOENT for none */
+int trunk_compact_select_file(const int min_free_ratio, \
+		const int skip_file_id, FDFSTrunkFullInfo *pTrunkInfo);
+
+/* keep the free space of the trunk file from allocating and wait for
+   the allocating blocks in it, only one trunk file can be retired */
+int trunk_compact_retire_file(const FDFSTrunkFullInfo *pTrunkInfo, \
+		const int timeout);
+
+/* get the free blocks of the trunk file sorted by offset,
+   the caller should free *ppBlocks */
+int trunk_compact_get_free_blocks(const FDFSTrunkFullInfo *pTrunkInfo, \
+		FDFSTrunkFullInfo **ppBlocks, int *count);
+
+/* if the space is freed (overlapped with a free block) */
+bool trunk_compact_is_space_free(const FDFSTrunkFullInfo *pTrunkInfo);
+
+/* reclaim the retired trunk file when all files are moved out,
+   or give its free space back for allocating */
+int trunk_compact_release_file(const FDFSTrunkFullInfo *pTrunkInfo, \
+		const bool bReclaim);
+
 bool trunk_check_size(const int64_t file_size);
 
 #define trunk_init_file(filename) \
@@ -87,6 +129,12 @@ int trunk_file_delete(const char *trunk_filename, \
 
 int trunk_create_trunk_file_advance(void *args);
 
+/* the interval seconds to sample the allocation rate of the store paths
+   and create the trunk files to keep the runway */
+#define TRUNK_RUNWAY_SAMPLE_INTERVAL  10
+
+int trunk_create_file_by_runway(void *args);
+
 int storage_delete_trunk_data_file();
 
 char *storage_trunk_get_data_filename(char *full_filename);
@@ -0,0 +1,153 @@
+/**
+* Copyright (C) 2008 Happy Fish / YuQing
+*
+* FastDFS may be copied only under the terms of the GNU General
+* Public License V3, which may be found in the FastDFS source kit.
+* Please visit the FastDFS Home Page http://www.csource.org/ for more detail.
+**/
+
+//trunk_node_pool.c
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "logger.h"
+#include "shared_func.h"
+#include "pthread_func.h"
+#include "trunk_node_pool.h"
+
+FDFSTrunkNodePool g_trunk_node_pool = {NULL, 0, 0, NULL};
+
+int trunk_node_pool_init()
+{
+	int result;
+	int bytes;
+
+	bytes = sizeof(FDFSTrunkNode *) * TRUNK_NODE_POOL_MAX_CHUNKS;
+	g_trunk_node_pool.chunks = (FDFSTrunkNode **)malloc(bytes);
+	if (g_trunk_node_pool.chunks == NULL)
+	{
+		result = errno != 0 ? errno : ENOMEM;
+		logError("file: "__FILE__", line: %d, " \
+			"malloc %d bytes fail, " \
+			"errno: %d, error info: %s", \
+			__LINE__, bytes, result, STRERROR(result));
+		return result;
+	}
+	memset(g_trunk_node_pool.chunks, 0, bytes);
+
+	g_trunk_node_pool.chunk_count = 0;
+	g_trunk_node_pool.used_count = 0;
+	g_trunk_node_pool.free_head = NULL;
+	if ((result=init_pthread_lock(&(g_trunk_node_pool.lock))) != 0)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"init_pthread_lock fail, " \
+			"errno: %d, error info: %s", \
+			__LINE__, result, STRERROR(result));
+		return result;
+	}
+
+	return 0;
+}
+
+void trunk_node_pool_destroy()
+{
+	int i;
+
+	if (g_trunk_node_pool.chunks == NULL)
+	{
+		return;
+	}
+
+	for (i=0; i<g_trunk_node_pool.chunk_count; i++)
+	{
+		free(g_trunk_node_pool.chunks[i]);
+	}
+	free(g_trunk_node_pool.chunks);
+	g_trunk_node_pool.chunks = NULL;
+	g_trunk_node_pool.chunk_count = 0;
+	g_trunk_node_pool.used_count = 0;
+	g_trunk_node_pool.free_head = NULL;
+
+	pthread_mutex_destroy(&(g_trunk_node_pool.lock));
+}
+
+static int trunk_node_pool_prealloc()
+{
+	FDFSTrunkNode *pChunk;
+	FDFSTrunkNode *pNode;
+	uint32_t base_id;
+	int bytes;
+	int i;
+
+	if (g_trunk_node_pool.chunk_count >= TRUNK_NODE_POOL_MAX_CHUNKS)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"trunk node chunk count exceeds: %d", \
+			__LINE__, TRUNK_NODE_POOL_MAX_CHUNKS);
+		return ENOSPC;
+	}
+
+	bytes = sizeof(FDFSTrunkNode) * TRUNK_NODE_POOL_CHUNK_SIZE;
+	pChunk = (FDFSTrunkNode *)malloc(bytes);
+	if (pChunk == NULL)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"malloc %d bytes fail, " \
+			"errno: %d, error info: %s", \
+			__LINE__, bytes, errno, STRERROR(errno));
+		return errno != 0 ? errno : ENOMEM;
+	}
+
+	/* chain the nodes in the order of the id */
+	base_id = (uint32_t)g_trunk_node_pool.chunk_count << \
+			TRUNK_NODE_POOL_CHUNK_BITS;
+	for (i=TRUNK_NODE_POOL_CHUNK_SIZE - 1; i>=0; i--)
+	{
+		pNode = pChunk + i;
+		pNode->id = base_id + i;
+		pNode->next = g_trunk_node_pool.free_head;
+		g_trunk_node_pool.free_head = pNode;
+	}
+
+	g_trunk_node_pool.chunks[g_trunk_node_pool.chunk_count++] = pChunk;
+	return 0;
+}
+
+FDFSTrunkNode *trunk_node_alloc()
+{
+	FDFSTrunkNode *pNode;
+	int result;
+
+	pthread_mutex_lock(&(g_trunk_node_pool.lock));
+	if (g_trunk_node_pool.free_head == NULL)
+	{
+		if ((result=trunk_node_pool_prealloc()) != 0)
+		{
+			pthread_mutex_unlock(&(g_trunk_node_pool.lock));
+			errno = result;
+			return NULL;
+		}
+	}
+
+	pNode = g_trunk_node_pool.free_head;
+	g_trunk_node_pool.free_head = pNode->next;
+	g_trunk_node_pool.used_count++;
+	pthread_mutex_unlock(&(g_trunk_node_pool.lock));
+
+	pNode->prev = NULL;
+	pNode->next = NULL;
+	return pNode;
+}
+
+void trunk_node_free(FDFSTrunkNode *pNode)
+{
+	pthread_mutex_lock(&(g_trunk_node_pool.lock));
+	pNode->next = g_trunk_node_pool.free_head;
+	g_trunk_node_pool.free_head = pNode;
+	g_trunk_node_pool.used_count--;
+	pthread_mutex_unlock(&(g_trunk_node_pool.lock));
+}
+
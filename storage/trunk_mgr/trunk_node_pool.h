@@ -0,0 +1,58 @@
+/**
+* Copyright (C) 2008 Happy Fish / YuQing
+*
+* FastDFS may be copied only under the terms of the GNU General
+* Public License V3, which may be found in the FastDFS source kit.
+* Please visit the FastDFS Home Page http://www.csource.org/ for more detail.
+**/
+
+//trunk_node_pool.h
+
+#ifndef _TRUNK_NODE_POOL_H_
+#define _TRUNK_NODE_POOL_H_
+
+#include <pthread.h>
+#include "common_define.h"
+#include "trunk_mem.h"
+
+/* the trunk nodes are allocated from the arrays of the fixed size, so the
+   node can be referred by the 32 bits id (the array index and the node
+   index in the array) instead of the pointer */
+
+#define TRUNK_NODE_POOL_CHUNK_BITS   16
+#define TRUNK_NODE_POOL_CHUNK_SIZE   (1 << TRUNK_NODE_POOL_CHUNK_BITS)
+#define TRUNK_NODE_POOL_MAX_CHUNKS   (1 << (32 - TRUNK_NODE_POOL_CHUNK_BITS))
+
+typedef struct {
+	FDFSTrunkNode **chunks;  //the node arrays
+	int chunk_count;
+	int used_count;          //the node count in use
+	FDFSTrunkNode *free_head;  //the free nodes chained by next
+	pthread_mutex_t lock;
+} FDFSTrunkNodePool;
+
+extern FDFSTrunkNodePool g_trunk_node_pool;
+
+/* the node of the id, the chunk of the node must be allocated */
+#define TRUNK_NODE_BY_ID(node_id) \
+	(g_trunk_node_pool.chunks[(uint32_t)(node_id) >> \
+	 TRUNK_NODE_POOL_CHUNK_BITS] + ((node_id) & \
+	 (TRUNK_NODE_POOL_CHUNK_SIZE - 1)))
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int trunk_node_pool_init();
+void trunk_node_pool_destroy();
+
+/* alloc the node with the id set, NULL for fail */
+FDFSTrunkNode *trunk_node_alloc();
+void trunk_node_free(FDFSTrunkNode *pNode);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
@@ -0,0 +1,863 @@
+/**
+* Copyright (C) 2008 Happy Fish / YuQing
+*
+* FastDFS may be copied only under the terms of the GNU General
+* Public License V3, which may be found in the FastDFS source kit.
+* Please visit the FastDFS Home Page http://www.csource.org/ for more detail.
+**/
+
+//trunk_redirect.c
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include "fdfs_define.h"
+#include "logger.h"
+#include "shared_func.h"
+#include "pthread_func.h"
+#include "sched_thread.h"
+#include "hash.h"
+#include "storage_global.h"
+#include "storage_func.h"
+#include "trunk_mem.h"
+#include "trunk_sync.h"
+#include "trunk_redirect.h"
+
+#define TRUNK_REDIRECT_FILENAME  "redirect.dat"
+#define TRUNK_REDIRECT_COPY_BUFF_SIZE  (256 * 1024)
+
+typedef struct {
+	FDFSTrunkPathInfo path;
+	char pad;
+	int id;
+	int offset;
+} TrunkRedirectKey;
+
+typedef struct {
+	FDFSTrunkFullInfo origin;   //the trunk space in the filename
+	FDFSTrunkFullInfo current;  //the trunk space of the file content
+} TrunkRedirectEntry;
+
+#define FILL_REDIRECT_KEY(key, pTrunkInfo) \
+	memset(&key, 0, sizeof(key)); \
+	key.path = (pTrunkInfo)->path; \
+	key.id = (pTrunkInfo)->file.id; \
+	key.offset = (pTrunkInfo)->file.offset
+
+#define IS_SAME_TRUNK_SPACE(pTrunkInfo1, pTrunkInfo2) \
+	(memcmp(&((pTrunkInfo1)->path), &((pTrunkInfo2)->path), \
+		sizeof(FDFSTrunkPathInfo)) == 0 && \
+	 (pTrunkInfo1)->file.id == (pTrunkInfo2)->file.id && \
+	 (pTrunkInfo1)->file.offset == (pTrunkInfo2)->file.offset)
+
+/* the moves and the reclaims synced from the trunk server are applied
+   by the apply thread in order, not by the nio thread */
+typedef struct trunk_redirect_op
+{
+	char op_type;
+	FDFSTrunkFullInfo origin;
+	FDFSTrunkFullInfo dest;
+	struct trunk_redirect_op *next;
+} TrunkRedirectOp;
+
+static pthread_mutex_t redirect_lock;
+static HashArray origin_hash;  //origin => TrunkRedirectEntry
+static HashArray space_hash;   //every space of the moved file => origin
+static int redirect_count = 0;
+static int redirect_fd = -1;
+static bool redirect_inited = false;
+
+static pthread_mutex_t apply_lock;
+static pthread_cond_t apply_cond;
+static TrunkRedirectOp *apply_head = NULL;
+static TrunkRedirectOp *apply_tail = NULL;
+static bool apply_continue_flag = true;
+static bool apply_thread_running = false;
+
+static int trunk_redirect_apply(const FDFSTrunkFullInfo *pOrigin, \
+		const FDFSTrunkFullInfo *pDest);
+
+static char *get_redirect_filename(char *full_filename)
+{
+	snprintf(full_filename, MAX_PATH_SIZE, "%s/data/trunk/" \
+		TRUNK_REDIRECT_FILENAME, g_fdfs_base_path);
+	return full_filename;
+}
+
+static int trunk_redirect_write_line(const int fd, const char op_type, \
+		const FDFSTrunkFullInfo *pOrigin, \
+		const FDFSTrunkFullInfo *pDest)
+{
+	char buff[TRUNK_BINLOG_LINE_SIZE];
+	int len;
+
+	if (fd < 0)  //to the trunk binlog
+	{
+		return trunk_binlog_write_ex((int)g_current_time, op_type, \
+				pOrigin, pDest, 0);
+	}
+
+	if (op_type == TRUNK_REDIRECT_OP_MOVE)
+	{
+		len = sprintf(buff, "%d %c %d %d %d %d %d %d %d %d %d %d %d\n", \
+			(int)g_current_time, op_type, \
+			pOrigin->path.store_path_index, \
+			pOrigin->path.sub_path_high, \
+			pOrigin->path.sub_path_low, \
+			pOrigin->file.id, pOrigin->file.offset, \
+			pOrigin->file.size, pDest->path.sub_path_high, \
+			pDest->path.sub_path_low, pDest->file.id, \
+			pDest->file.offset, pDest->file.size);
+	}
+	else
+	{
+		len = sprintf(buff, "%d %c %d %d %d %d %d %d\n", \
+			(int)g_current_time, op_type, \
+			pOrigin->path.store_path_index, \
+			pOrigin->path.sub_path_high, \
+			pOrigin->path.sub_path_low, \
+			pOrigin->file.id, pOrigin->file.offset, \
+			pOrigin->file.size);
+	}
+
+	if (write(fd, buff, len) != len)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"write to redirect file fail, " \
+			"errno: %d, error info: %s", \
+			__LINE__, errno, STRERROR(errno));
+		return errno != 0 ? errno : EIO;
+	}
+
+	return 0;
+}
+
+static int trunk_redirect_do_add(const FDFSTrunkFullInfo *pOrigin, \
+		const FDFSTrunkFullInfo *pDest)
+{
+	TrunkRedirectKey key;
+	TrunkRedirectEntry *pFound;
+	TrunkRedirectEntry entry;
+	int result;
+
+	memcpy(&entry.origin, pOrigin, sizeof(FDFSTrunkFullInfo));
+	memcpy(&entry.current, pDest, sizeof(FDFSTrunkFullInfo));
+	entry.origin.status = FDFS_TRUNK_STATUS_FREE;
+	entry.current.status = FDFS_TRUNK_STATUS_FREE;
+
+	FILL_REDIRECT_KEY(key, pOrigin);
+	pFound = (TrunkRedirectEntry *)hash_find(&origin_hash, \
+			&key, sizeof(key));
+	if (pFound != NULL)
+	{
+		FILL_REDIRECT_KEY(key, &(pFound->current));
+	}
+	if ((result=hash_insert_ex(&space_hash, &key, sizeof(key), \
+		&entry.origin, sizeof(FDFSTrunkFullInfo), false)) < 0)
+	{
+		return -1 * result;
+	}
+
+	FILL_REDIRECT_KEY(key, pDest);
+	if ((result=hash_insert_ex(&space_hash, &key, sizeof(key), \
+		&entry.origin, sizeof(FDFSTrunkFullInfo), false)) < 0)
+	{
+		return -1 * result;
+	}
+
+	FILL_REDIRECT_KEY(key, pOrigin);
+	if ((result=hash_insert_ex(&origin_hash, &key, sizeof(key), \
+		&entry, sizeof(TrunkRedirectEntry), false)) < 0)
+	{
+		return -1 * result;
+	}
+
+	redirect_count = hash_count(&origin_hash);
+	return 0;
+}
+
+static void trunk_redirect_do_delete(const FDFSTrunkFullInfo *pOrigin)
+{
+	TrunkRedirectKey key;
+	TrunkRedirectEntry *pEntry;
+
+	FILL_REDIRECT_KEY(key, pOrigin);
+	pEntry = (TrunkRedirectEntry *)hash_find(&origin_hash, \
+			&key, sizeof(key));
+	if (pEntry == NULL)
+	{
+		return;
+	}
+
+	FILL_REDIRECT_KEY(key, &(pEntry->current));
+	hash_delete(&space_hash, &key, sizeof(key));
+	FILL_REDIRECT_KEY(key, pOrigin);
+	hash_delete(&space_hash, &key, sizeof(key));
+	hash_delete(&origin_hash, &key, sizeof(key));
+	redirect_count = hash_count(&origin_hash);
+}
+
+static int trunk_redirect_load(const char *filename)
+{
+	FILE *fp;
+	char line[TRUNK_BINLOG_LINE_SIZE];
+	FDFSTrunkFullInfo origin;
+	FDFSTrunkFullInfo dest;
+	int timestamp;
+	char op_type;
+	int store_path_index;
+	int sub_path_high;
+	int sub_path_low;
+	int dest_sub_path_high;
+	int dest_sub_path_low;
+	int count;
+	int result;
+
+	if ((fp=fopen(filename, "r")) == NULL)
+	{
+		result = errno != 0 ? errno : EPERM;
+		if (result == ENOENT)
+		{
+			return 0;
+		}
+
+		logError("file: "__FILE__", line: %d, " \
+			"open file %s fail, errno: %d, error info: %s", \
+			__LINE__, filename, result, STRERROR(result));
+		return result;
+	}
+
+	result = 0;
+	memset(&origin, 0, sizeof(origin));
+	memset(&dest, 0, sizeof(dest));
+	while (fgets(line, sizeof(line), fp) != NULL)
+	{
+		count = sscanf(line, "%d %c %d %d %d %d %d %d %d %d %d %d %d", \
+			&timestamp, &op_type, &store_path_index, \
+			&sub_path_high, &sub_path_low, &origin.file.id, \
+			&origin.file.offset, &origin.file.size, \
+			&dest_sub_path_high, &dest_sub_path_low, \
+			&dest.file.id, &dest.file.offset, &dest.file.size);
+		if (count < 8)
+		{
+			continue;
+		}
+
+		origin.path.store_path_index = store_path_index;
+		origin.path.sub_path_high = sub_path_high;
+		origin.path.sub_path_low = sub_path_low;
+		if (op_type == TRUNK_REDIRECT_OP_DELETE)
+		{
+			trunk_redirect_do_delete(&origin);
+		}
+		else if (op_type == TRUNK_REDIRECT_OP_MOVE && count == 13)
+		{
+			dest.path.store_path_index = store_path_index;
+			dest.path.sub_path_high = dest_sub_path_high;
+			dest.path.sub_path_low = dest_sub_path_low;
+			if ((result=trunk_redirect_do_add(&origin, &dest)) != 0)
+			{
+				break;
+			}
+		}
+	}
+
+	fclose(fp);
+	return result;
+}
+
+static int redirect_save_walk_callback(const int index, \
+		const HashData *data, void *args)
+{
+	TrunkRedirectEntry *pEntry;
+
+	pEntry = (TrunkRedirectEntry *)data->value;
+	return trunk_redirect_write_line(*((int *)args), \
+		TRUNK_REDIRECT_OP_MOVE, &(pEntry->origin), &(pEntry->current));
+}
+
+/* drop the deleted moves and the middle spaces of the moved files */
+static int trunk_redirect_save(const char *filename)
+{
+	char tmp_filename[MAX_PATH_SIZE];
+	int fd;
+	int result;
+
+	snprintf(tmp_filename, sizeof(tmp_filename), "%s.tmp", filename);
+	if ((fd=open(tmp_filename, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0)
+	{
+		result = errno != 0 ? errno : EACCES;
+		logError("file: "__FILE__", line: %d, " \
+			"open file %s fail, errno: %d, error info: %s", \
+			__LINE__, tmp_filename, result, STRERROR(result));
+		return result;
+	}
+
+	result = hash_walk(&origin_hash, redirect_save_walk_callback, &fd);
+	if (result == 0 && fsync(fd) != 0)
+	{
+		result = errno != 0 ? errno : EIO;
+	}
+	close(fd);
+
+	if (result != 0)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"write to file %s fail, errno: %d, error info: %s", \
+			__LINE__, tmp_filename, result, STRERROR(result));
+		unlink(tmp_filename);
+		return result;
+	}
+
+	if (rename(tmp_filename, filename) != 0)
+	{
+		result = errno != 0 ? errno : EPERM;
+		logError("file: "__FILE__", line: %d, " \
+			"rename file %s to %s fail, " \
+			"errno: %d, error info: %s", __LINE__, \
+			tmp_filename, filename, result, STRERROR(result));
+		return result;
+	}
+
+	return 0;
+}
+
+static void *trunk_redirect_apply_entrance(void *arg)
+{
+	TrunkRedirectOp *pOp;
+
+	while (1)
+	{
+		pthread_mutex_lock(&apply_lock);
+		while (apply_head == NULL && apply_continue_flag)
+		{
+			pthread_cond_wait(&apply_cond, &apply_lock);
+		}
+
+		if (!apply_continue_flag)
+		{
+			pthread_mutex_unlock(&apply_lock);
+			break;
+		}
+
+		pOp = apply_head;
+		apply_head = pOp->next;
+		if (apply_head == NULL)
+		{
+			apply_tail = NULL;
+		}
+		pthread_mutex_unlock(&apply_lock);
+
+		if (pOp->op_type == TRUNK_OP_TYPE_MOVE)
+		{
+			trunk_redirect_apply(&(pOp->origin), &(pOp->dest));
+		}
+		else
+		{
+			trunk_reclaim_file(&(pOp->origin));
+		}
+		free(pOp);
+	}
+
+	apply_thread_running = false;
+	return NULL;
+}
+
+/* started when the first op is pushed, trunk_redirect_init is called
+   before the storage server runs as a daemon, caller should hold
+   apply_lock */
+static int trunk_redirect_start_apply_thread()
+{
+	pthread_t tid;
+	pthread_attr_t pattr;
+	int result;
+
+	if ((result=init_pthread_attr(&pattr, g_thread_stack_size)) != 0)
+	{
+		return result;
+	}
+
+	apply_thread_running = true;
+	if ((result=pthread_create(&tid, &pattr, \
+		trunk_redirect_apply_entrance, NULL)) != 0)
+	{
+		apply_thread_running = false;
+		logError("file: "__FILE__", line: %d, " \
+			"create thread failed, errno: %d, " \
+			"error info: %s", __LINE__, \
+			result, STRERROR(result));
+	}
+
+	pthread_attr_destroy(&pattr);
+	return result;
+}
+
+int trunk_redirect_push(const char op_type, \
+		const FDFSTrunkFullInfo *pTrunkInfo, \
+		const FDFSTrunkFullInfo *pDest)
+{
+	TrunkRedirectOp *pOp;
+
+	pOp = (TrunkRedirectOp *)malloc(sizeof(TrunkRedirectOp));
+	if (pOp == NULL)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"malloc %d bytes fail, " \
+			"errno: %d, error info: %s", __LINE__, \
+			(int)sizeof(TrunkRedirectOp), \
+			errno, STRERROR(errno));
+		return errno != 0 ? errno : ENOMEM;
+	}
+
+	pOp->op_type = op_type;
+	memcpy(&(pOp->origin), pTrunkInfo, sizeof(FDFSTrunkFullInfo));
+	if (pDest != NULL)
+	{
+		memcpy(&(pOp->dest), pDest, sizeof(FDFSTrunkFullInfo));
+	}
+	pOp->next = NULL;
+
+	pthread_mutex_lock(&apply_lock);
+	if (!apply_thread_running && apply_continue_flag && \
+		trunk_redirect_start_apply_thread() != 0)
+	{
+		pthread_mutex_unlock(&apply_lock);
+		free(pOp);
+		return EAGAIN;
+	}
+
+	if (apply_tail == NULL)
+	{
+		apply_head = pOp;
+	}
+	else
+	{
+		apply_tail->next = pOp;
+	}
+	apply_tail = pOp;
+	pthread_cond_signal(&apply_cond);
+	pthread_mutex_unlock(&apply_lock);
+
+	return 0;
+}
+
+int trunk_redirect_init()
+{
+	char filename[MAX_PATH_SIZE];
+	int result;
+
+	if (redirect_inited)
+	{
+		return 0;
+	}
+
+	if ((result=init_pthread_lock(&redirect_lock)) != 0 || \
+		(result=init_pthread_lock(&apply_lock)) != 0)
+	{
+		return result;
+	}
+
+	if ((result=pthread_cond_init(&apply_cond, NULL)) != 0)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"pthread_cond_init fail, " \
+			"errno: %d, error info: %s", \
+			__LINE__, result, STRERROR(result));
+		return result;
+	}
+	apply_continue_flag = true;
+
+	if ((result=hash_init_ex(&origin_hash, PJWHash, 1024, 0.75, \
+		0, true)) != 0 || (result=hash_init_ex(&space_hash, \
+		PJWHash, 1024, 0.75, 0, true)) != 0)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"hash_init fail, errno: %d, error info: %s", \
+			__LINE__, result, STRERROR(result));
+		return result;
+	}
+
+	get_redirect_filename(filename);
+	if ((result=trunk_redirect_load(filename)) != 0)
+	{
+		return result;
+	}
+
+	if (redirect_count > 0)
+	{
+		if ((result=trunk_redirect_save(filename)) != 0)
+		{
+			return result;
+		}
+
+		logInfo("file: "__FILE__", line: %d, " \
+			"%d moved trunk files loaded from %s", \
+			__LINE__, redirect_count, filename);
+	}
+
+	redirect_fd = open(filename, O_WRONLY | O_CREAT | O_APPEND, 0644);
+	if (redirect_fd < 0)
+	{
+		result = errno != 0 ? errno : EACCES;
+		logError("file: "__FILE__", line: %d, " \
+			"open file %s fail, errno: %d, error info: %s", \
+			__LINE__, filename, result, STRERROR(result));
+		return result;
+	}
+
+	STORAGE_FCHOWN(redirect_fd, filename, geteuid(), getegid())
+
+	g_trunk_redirect_func = trunk_redirect_get;
+	redirect_inited = true;
+	return 0;
+}
+
+void trunk_redirect_destroy()
+{
+	TrunkRedirectOp *pOp;
+	int i;
+
+	if (!redirect_inited)
+	{
+		return;
+	}
+
+	pthread_mutex_lock(&apply_lock);
+	apply_continue_flag = false;
+	pthread_cond_signal(&apply_cond);
+	pthread_mutex_unlock(&apply_lock);
+	for (i=0; apply_thread_running && i<300; i++)
+	{
+		usleep(10000);
+	}
+
+	while (apply_head != NULL)
+	{
+		pOp = apply_head;
+		apply_head = pOp->next;
+		free(pOp);
+	}
+	apply_tail = NULL;
+
+	redirect_inited = false;
+	g_trunk_redirect_func = NULL;
+	close(redirect_fd);
+	redirect_fd = -1;
+	hash_destroy(&origin_hash);
+	hash_destroy(&space_hash);
+	pthread_mutex_destroy(&redirect_lock);
+	pthread_cond_destroy(&apply_cond);
+	pthread_mutex_destroy(&apply_lock);
+}
+
+int trunk_redirect_count()
+{
+	return redirect_count;
+}
+
+void trunk_redirect_lock()
+{
+	pthread_mutex_lock(&redirect_lock);
+}
+
+void trunk_redirect_unlock()
+{
+	pthread_mutex_unlock(&redirect_lock);
+}
+
+bool trunk_redirect_get(FDFSTrunkFullInfo *pTrunkInfo)
+{
+	TrunkRedirectKey key;
+	TrunkRedirectEntry *pEntry;
+
+	if (redirect_count == 0)
+	{
+		return false;
+	}
+
+	FILL_REDIRECT_KEY(key, pTrunkInfo);
+	pthread_mutex_lock(&redirect_lock);
+	pEntry = (TrunkRedirectEntry *)hash_find(&origin_hash, \
+			&key, sizeof(key));
+	if (pEntry != NULL)
+	{
+		pTrunkInfo->path = pEntry->current.path;
+		pTrunkInfo->file = pEntry->current.file;
+	}
+	pthread_mutex_unlock(&redirect_lock);
+
+	return pEntry != NULL;
+}
+
+int trunk_redirect_get_origin(const FDFSTrunkFullInfo *pTrunkInfo, \
+		FDFSTrunkFullInfo *pOrigin)
+{
+	TrunkRedirectKey key;
+	FDFSTrunkFullInfo *pFound;
+	TrunkRedirectEntry *pEntry;
+	int result;
+
+	if (redirect_count == 0)
+	{
+		return ENOENT;
+	}
+
+	result = ENOENT;
+	FILL_REDIRECT_KEY(key, pTrunkInfo);
+	pthread_mutex_lock(&redirect_lock);
+	pFound = (FDFSTrunkFullInfo *)hash_find(&space_hash, \
+			&key, sizeof(key));
+	if (pFound != NULL)
+	{
+		FILL_REDIRECT_KEY(key, pFound);
+		pEntry = (TrunkRedirectEntry *)hash_find(&origin_hash, \
+				&key, sizeof(key));
+		if (pEntry != NULL && IS_SAME_TRUNK_SPACE( \
+				&(pEntry->current), pTrunkInfo))
+		{
+			memcpy(pOrigin, &(pEntry->origin), \
+				sizeof(FDFSTrunkFullInfo));
+			result = 0;
+		}
+	}
+	pthread_mutex_unlock(&redirect_lock);
+
+	return result;
+}
+
+int trunk_redirect_copy(const FDFSTrunkFullInfo *pSrc, \
+		const FDFSTrunkFullInfo *pDest)
+{
+	char src_filename[MAX_PATH_SIZE];
+	char dest_filename[MAX_PATH_SIZE];
+	char pack_buff[FDFS_TRUNK_FILE_HEADER_SIZE];
+	char *buff;
+	FDFSTrunkHeader trunkHeader;
+	int64_t src_offset;
+	int64_t dest_offset;
+	int remain_bytes;
+	int bytes;
+	int src_fd;
+	int dest_fd;
+	int result;
+
+	trunk_get_full_filename(pSrc, src_filename, sizeof(src_filename));
+	trunk_get_full_filename(pDest, dest_filename, sizeof(dest_filename));
+	if ((result=trunk_check_and_init_file(dest_filename)) != 0)
+	{
+		return result;
+	}
+
+	if ((src_fd=open(src_filename, O_RDONLY)) < 0)
+	{
+		return errno != 0 ? errno : ENOENT;
+	}
+
+	if (pread(src_fd, pack_buff, FDFS_TRUNK_FILE_HEADER_SIZE, \
+		pSrc->file.offset) != FDFS_TRUNK_FILE_HEADER_SIZE)
+	{
+		result = errno != 0 ? errno : EIO;
+		close(src_fd);
+		return result;
+	}
+
+	trunk_unpack_header(pack_buff, &trunkHeader);
+	if (!(trunkHeader.file_type == FDFS_TRUNK_FILE_TYPE_REGULAR || \
+		trunkHeader.file_type == FDFS_TRUNK_FILE_TYPE_LINK))
+	{
+		close(src_fd);
+		return ENOENT;
+	}
+
+	if (trunkHeader.file_size < 0 || trunkHeader.alloc_size != \
+		pSrc->file.size || FDFS_TRUNK_FILE_HEADER_SIZE + \
+		trunkHeader.file_size > pDest->file.size)
+	{
+		close(src_fd);
+		return EINVAL;
+	}
+
+	buff = (char *)malloc(TRUNK_REDIRECT_COPY_BUFF_SIZE);
+	if (buff == NULL)
+	{
+		close(src_fd);
+		return errno != 0 ? errno : ENOMEM;
+	}
+
+	if ((dest_fd=open(dest_filename, O_WRONLY)) < 0)
+	{
+		result = errno != 0 ? errno : ENOENT;
+		free(buff);
+		close(src_fd);
+		return result;
+	}
+
+	//the alloc size is checked when the file is accessed
+	trunkHeader.alloc_size = pDest->file.size;
+	trunk_pack_header(&trunkHeader, buff);
+
+	result = 0;
+	bytes = FDFS_TRUNK_FILE_HEADER_SIZE;
+	src_offset = pSrc->file.offset + FDFS_TRUNK_FILE_HEADER_SIZE;
+	dest_offset = pDest->file.offset;
+	remain_bytes = trunkHeader.file_size;
+	while (1)
+	{
+		if (pwrite(dest_fd, buff, bytes, dest_offset) != bytes)
+		{
+			result = errno != 0 ? errno : EIO;
+			break;
+		}
+		dest_offset += bytes;
+
+		if (remain_bytes == 0)
+		{
+			break;
+		}
+
+		bytes = remain_bytes > TRUNK_REDIRECT_COPY_BUFF_SIZE ? \
+			TRUNK_REDIRECT_COPY_BUFF_SIZE : remain_bytes;
+		if (pread(src_fd, buff, bytes, src_offset) != bytes)
+		{
+			result = errno != 0 ? errno : EIO;
+			break;
+		}
+		src_offset += bytes;
+		remain_bytes -= bytes;
+	}
+
+	if (result == 0 && fdatasync(dest_fd) != 0)
+	{
+		result = errno != 0 ? errno : EIO;
+	}
+
+	if (result != 0)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"copy trunk file from %s to %s fail, " \
+			"errno: %d, error info: %s", __LINE__, \
+			src_filename, dest_filename, result, STRERROR(result));
+	}
+
+	close(dest_fd);
+	close(src_fd);
+	free(buff);
+	return result;
+}
+
+int trunk_redirect_add(const FDFSTrunkFullInfo *pOrigin, \
+		const FDFSTrunkFullInfo *pDest)
+{
+	int result;
+
+	if ((result=trunk_redirect_do_add(pOrigin, pDest)) != 0)
+	{
+		return result;
+	}
+
+	if ((result=trunk_redirect_write_line(redirect_fd, \
+		TRUNK_REDIRECT_OP_MOVE, pOrigin, pDest)) != 0)
+	{
+		return result;
+	}
+
+	return trunk_redirect_write_line(-1, TRUNK_OP_TYPE_MOVE, \
+			pOrigin, pDest);
+}
+
+static int trunk_redirect_apply(const FDFSTrunkFullInfo *pOrigin, \
+		const FDFSTrunkFullInfo *pDest)
+{
+	FDFSTrunkFullInfo src;
+	int result;
+
+	memcpy(&src, pOrigin, sizeof(FDFSTrunkFullInfo));
+	trunk_redirect_get(&src);
+
+	/* the file is deleted or not synced yet, the origin is kept */
+	if ((result=trunk_redirect_copy(&src, pDest)) != 0)
+	{
+		char buff[256];
+		logWarning("file: "__FILE__", line: %d, " \
+			"copy moved trunk file %s fail, errno: %d, " \
+			"error info: %s", __LINE__, trunk_info_dump(&src, \
+			buff, sizeof(buff)), result, STRERROR(result));
+		return result;
+	}
+
+	pthread_mutex_lock(&redirect_lock);
+	if ((result=trunk_redirect_do_add(pOrigin, pDest)) == 0)
+	{
+		result = trunk_redirect_write_line(redirect_fd, \
+			TRUNK_REDIRECT_OP_MOVE, pOrigin, pDest);
+	}
+	pthread_mutex_unlock(&redirect_lock);
+
+	return result;
+}
+
+int trunk_redirect_on_free(FDFSTrunkFullInfo *pTrunkInfo)
+{
+	TrunkRedirectKey key;
+	FDFSTrunkFullInfo *pFound;
+	TrunkRedirectEntry *pEntry;
+	FDFSTrunkFullInfo origin;
+	FDFSTrunkFullInfo current;
+	char full_filename[MAX_PATH_SIZE];
+	char buff[256];
+	int result;
+
+	if (redirect_count == 0)
+	{
+		return 0;
+	}
+
+	FILL_REDIRECT_KEY(key, pTrunkInfo);
+	pFound = (FDFSTrunkFullInfo *)hash_find(&space_hash, \
+			&key, sizeof(key));
+	if (pFound == NULL)
+	{
+		return 0;
+	}
+
+	memcpy(&origin, pFound, sizeof(FDFSTrunkFullInfo));
+	FILL_REDIRECT_KEY(key, &origin);
+	pEntry = (TrunkRedirectEntry *)hash_find(&origin_hash, \
+			&key, sizeof(key));
+	if (pEntry == NULL || !(IS_SAME_TRUNK_SPACE(&(pEntry->origin), \
+		pTrunkInfo) || IS_SAME_TRUNK_SPACE(&(pEntry->current), \
+		pTrunkInfo)))
+	{
+		return 0;  //the space of a moved file is reused
+	}
+
+	memcpy(&current, &(pEntry->current), sizeof(FDFSTrunkFullInfo));
+	trunk_redirect_do_delete(&origin);
+	result = trunk_redirect_write_line(redirect_fd, \
+			TRUNK_REDIRECT_OP_DELETE, &origin, NULL);
+	if (IS_SAME_TRUNK_SPACE(&current, pTrunkInfo))
+	{
+		return result;
+	}
+
+	/* the file was deleted before the move is known by the deleter,
+	   delete the moved file and free its current space instead */
+	trunk_get_full_filename(&current, full_filename, \
+			sizeof(full_filename));
+	trunk_file_delete(full_filename, &current);
+
+	logDebug("file: "__FILE__", line: %d, " \
+		"free the moved trunk file: %s", __LINE__, \
+		trunk_info_dump(&current, buff, sizeof(buff)));
+
+	current.status = pTrunkInfo->status;
+	memcpy(pTrunkInfo, &current, sizeof(FDFSTrunkFullInfo));
+	return result;
+}
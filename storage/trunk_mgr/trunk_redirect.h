@@ -0,0 +1,68 @@
+/**
+* Copyright (C) 2008 Happy Fish / YuQing
+*
+* FastDFS may be copied only under the terms of the GNU General
+* Public License V3, which may be found in the FastDFS source kit.
+* Please visit the FastDFS Home Page http://www.csource.org/ for more detail.
+**/
+
+//trunk_redirect.h
+
+#ifndef _TRUNK_REDIRECT_H_
+#define _TRUNK_REDIRECT_H_
+
+#include "common_define.h"
+#include "trunk_shared.h"
+
+/* the small files moved by the trunk compactor keep their filenames,
+   the redirect table maps the trunk space in the filename (the origin)
+   to the trunk space where the file content is now */
+
+#define TRUNK_REDIRECT_OP_MOVE    'M'
+#define TRUNK_REDIRECT_OP_DELETE  'D'
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int trunk_redirect_init();
+void trunk_redirect_destroy();
+
+int trunk_redirect_count();
+
+/* replace the trunk info decoded from the filename by the current one,
+   return true when the trunk file is moved */
+bool trunk_redirect_get(FDFSTrunkFullInfo *pTrunkInfo);
+
+/* get the origin of the trunk file at this space,
+   return 0 for found, ENOENT for not moved */
+int trunk_redirect_get_origin(const FDFSTrunkFullInfo *pTrunkInfo, \
+		FDFSTrunkFullInfo *pOrigin);
+
+/* copy the trunk file (the header and the content) to the dest space */
+int trunk_redirect_copy(const FDFSTrunkFullInfo *pSrc, \
+		const FDFSTrunkFullInfo *pDest);
+
+/* publish the move by the trunk server, caller should hold the lock */
+int trunk_redirect_add(const FDFSTrunkFullInfo *pOrigin, \
+		const FDFSTrunkFullInfo *pDest);
+
+/* queue the move (pDest is the new space) or the reclaim (pDest is NULL)
+   synced from the trunk server, they are applied by the apply thread */
+int trunk_redirect_push(const char op_type, \
+		const FDFSTrunkFullInfo *pTrunkInfo, \
+		const FDFSTrunkFullInfo *pDest);
+
+/* called by the trunk server before freeing the space, the trunk info
+   is replaced when the file has been moved from this space,
+   caller should hold the lock */
+int trunk_redirect_on_free(FDFSTrunkFullInfo *pTrunkInfo);
+
+void trunk_redirect_lock();
+void trunk_redirect_unlock();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
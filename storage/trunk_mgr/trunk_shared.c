@@ -26,6 +26,9 @@
 
 FDFSStorePaths g_fdfs_store_paths = {0, NULL};
 struct base64_context g_fdfs_base64_context;
+trunk_redirect_func g_trunk_redirect_func = NULL;
+trunk_fd_open_func g_trunk_fd_open_func = NULL;
+trunk_fd_close_func g_trunk_fd_close_func = NULL;
 
 void trunk_shared_init()
 {
@@ -395,6 +398,35 @@ void trunk_file_info_decode(const char *str, FDFSTrunkFileInfo *pTrunkFile)
 	pTrunkFile->size = buff2int(buff + sizeof(int) * 2);
 }
 
+static int trunk_file_open(const FDFSTrunkFullInfo *pTrunkInfo, \
+		const char *filename, int *fd)
+{
+	if (g_trunk_fd_open_func != NULL)
+	{
+		return g_trunk_fd_open_func(pTrunkInfo, filename, fd);
+	}
+
+	*fd = open(filename, O_RDONLY);
+	if (*fd < 0)
+	{
+		return errno != 0 ? errno : EIO;
+	}
+
+	return 0;
+}
+
+void trunk_file_close(const int fd)
+{
+	if (g_trunk_fd_close_func != NULL)
+	{
+		g_trunk_fd_close_func(fd);
+	}
+	else
+	{
+		close(fd);
+	}
+}
+
 int trunk_file_get_content_ex(const FDFSStorePaths *pStorePaths, \
 		const FDFSTrunkFullInfo *pTrunkInfo, const int file_size, \
 		int *pfd, char *buff, const int buff_size)
@@ -417,22 +449,15 @@ int trunk_file_get_content_ex(const FDFSStorePaths *pStorePaths, \
 	{
 		trunk_get_full_filename_ex(pStorePaths, pTrunkInfo, \
 			full_filename, sizeof(full_filename));
-		fd = open(full_filename, O_RDONLY);
-		if (fd < 0)
-		{
-			return errno != 0 ? errno : EIO;
-		}
-
-		if (lseek(fd, pTrunkInfo->file.offset + \
-			FDFS_TRUNK_FILE_HEADER_SIZE, SEEK_SET) < 0)
+		if ((result=trunk_file_open(pTrunkInfo, full_filename, \
+				&fd)) != 0)
 		{
-			result = errno != 0 ? errno : EIO;
-			close(fd);
 			return result;
 		}
 	}
 
-	read_bytes = read(fd, buff, file_size);
+	read_bytes = pread(fd, buff, file_size, pTrunkInfo->file.offset + \
+			FDFS_TRUNK_FILE_HEADER_SIZE);
 	if (read_bytes == file_size)
 	{
 		result = 0;
@@ -444,7 +469,7 @@ int trunk_file_get_content_ex(const FDFSStorePaths *pStorePaths, \
 
 	if (pfd == NULL)
 	{
-		close(fd);
+		trunk_file_close(fd);
 	}
 
 	return result;
@@ -509,7 +534,7 @@ int trunk_file_stat_func_ex(const FDFSStorePaths *pStorePaths, \
 
 		if (pfd != NULL)
 		{
-			close(*pfd);
+			trunk_file_close(*pfd);
 			*pfd = -1;
 		}
 
@@ -521,7 +546,7 @@ int trunk_file_stat_func_ex(const FDFSStorePaths *pStorePaths, \
 
 	if (result != 0 && pfd != NULL && *pfd >= 0)
 	{
-		close(*pfd);
+		trunk_file_close(*pfd);
 		*pfd = -1;
 	}
 
@@ -610,23 +635,20 @@ int trunk_file_do_lstat_func_ex(const FDFSStorePaths *pStorePaths, \
 	pTrunkInfo->path.store_path_index = store_path_index;
 	pTrunkInfo->path.sub_path_high = strtol(true_filename, NULL, 16);
 	pTrunkInfo->path.sub_path_low = strtol(true_filename + 3, NULL, 16);
-
-	trunk_get_full_filename_ex(pStorePaths, pTrunkInfo, full_filename, \
-				sizeof(full_filename));
-	fd = open(full_filename, O_RDONLY);
-	if (fd < 0)
+	if (g_trunk_redirect_func != NULL && g_trunk_redirect_func(pTrunkInfo))
 	{
-		return errno != 0 ? errno : EIO;
+		pTrunkHeader->alloc_size = pTrunkInfo->file.size;
 	}
 
-	if (lseek(fd, pTrunkInfo->file.offset, SEEK_SET) < 0)
+	trunk_get_full_filename_ex(pStorePaths, pTrunkInfo, full_filename, \
+				sizeof(full_filename));
+	if ((result=trunk_file_open(pTrunkInfo, full_filename, &fd)) != 0)
 	{
-		result = errno != 0 ? errno : EIO;
-		close(fd);
 		return result;
 	}
 
-	read_bytes = read(fd, buff, FDFS_TRUNK_FILE_HEADER_SIZE);
+	read_bytes = pread(fd, buff, FDFS_TRUNK_FILE_HEADER_SIZE, \
+			pTrunkInfo->file.offset);
 	if (read_bytes == FDFS_TRUNK_FILE_HEADER_SIZE)
 	{
 		result = 0;
@@ -634,7 +656,7 @@ int trunk_file_do_lstat_func_ex(const FDFSStorePaths *pStorePaths, \
 	else
 	{
 		result = errno;
-		close(fd);
+		trunk_file_close(fd);
 		return result != 0 ? result : EINVAL;
 	}
 
@@ -650,12 +672,12 @@ int trunk_file_do_lstat_func_ex(const FDFSStorePaths *pStorePaths, \
 	}
 	else if (pTrunkHeader->file_type == FDFS_TRUNK_FILE_TYPE_NONE)
 	{
-		close(fd);
+		trunk_file_close(fd);
 		return ENOENT;
 	}
 	else
 	{
-		close(fd);
+		trunk_file_close(fd);
 		logError("file: "__FILE__", line: %d, " \
 			"Invalid file type: %d", __LINE__, \
 			pTrunkHeader->file_type);
@@ -686,7 +708,7 @@ int trunk_file_do_lstat_func_ex(const FDFSStorePaths *pStorePaths, \
 
 	if (memcmp(pack_buff, buff, FDFS_TRUNK_FILE_HEADER_SIZE) != 0)
 	{
-		close(fd);
+		trunk_file_close(fd);
 		return ENOENT;
 	}
 
@@ -699,7 +721,7 @@ int trunk_file_do_lstat_func_ex(const FDFSStorePaths *pStorePaths, \
 	}
 	else
 	{
-		close(fd);
+		trunk_file_close(fd);
 	}
 
 	return 0;
@@ -23,6 +23,7 @@
 
 #define FDFS_TRUNK_STATUS_FREE  0
 #define FDFS_TRUNK_STATUS_HOLD  1
+#define FDFS_TRUNK_STATUS_LEASED  2  //alloced from the lease, no confirm
 
 #define FDFS_TRUNK_FILE_TYPE_NONE     '\0'
 #define FDFS_TRUNK_FILE_TYPE_REGULAR  'F'
@@ -84,6 +85,28 @@ typedef struct tagFDFSTrunkFullInfo {
 	FDFSTrunkFileInfo file;
 } FDFSTrunkFullInfo;
 
+/* the trunk space leased to the storage server, the lease id is
+   given by the trunk server to return the space only once */
+typedef struct tagFDFSTrunkLeaseInfo {
+	int64_t lease_id;
+	FDFSTrunkFullInfo trunk;
+} FDFSTrunkLeaseInfo;
+
+/* find the trunk file moved by the trunk compactor, return true when
+   the trunk info is replaced by the current one */
+typedef bool (*trunk_redirect_func)(FDFSTrunkFullInfo *pTrunkInfo);
+
+extern trunk_redirect_func g_trunk_redirect_func;  //NULL for client
+
+/* open the trunk file by the fd cache of the storage server,
+   the fd should be closed by trunk_fd_close_func */
+typedef int (*trunk_fd_open_func)(const FDFSTrunkFullInfo *pTrunkInfo, \
+		const char *filename, int *fd);
+typedef void (*trunk_fd_close_func)(const int fd);
+
+extern trunk_fd_open_func g_trunk_fd_open_func;    //NULL for client
+extern trunk_fd_close_func g_trunk_fd_close_func;  //NULL for client
+
 char **storage_load_paths_from_conf_file_ex(IniContext *pItemContext, \
 	const char *szSectionName, const bool bUseBasePath, \
 	int *path_count, int *err_no);
@@ -114,6 +137,9 @@ char *trunk_get_full_filename_ex(const FDFSStorePaths *pStorePaths, \
 		const FDFSTrunkFullInfo *pTrunkInfo, \
 		char *full_filename, const int buff_size);
 
+/* close the fd got by trunk_file_stat_ex or trunk_file_lstat_ex */
+void trunk_file_close(const int fd);
+
 void trunk_pack_header(const FDFSTrunkHeader *pTrunkHeader, char *buff);
 void trunk_unpack_header(const char *buff, FDFSTrunkHeader *pTrunkHeader);
 
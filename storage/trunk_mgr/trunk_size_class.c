@@ -0,0 +1,180 @@
+/**
+* Copyright (C) 2008 Happy Fish / YuQing
+*
+* FastDFS may be copied only under the terms of the GNU General
+* Public License V3, which may be found in the FastDFS source kit.
+* Please visit the FastDFS Home Page http://www.csource.org/ for more detail.
+**/
+
+//trunk_size_class.c
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include "trunk_size_class.h"
+
+#define TRUNK_SIZE_CLASS_LOG2(size) (31 - __builtin_clz((unsigned int)(size)))
+
+static void trunk_size_class_mapping(const int size, int *fl, int *sl)
+{
+	int bits;
+
+	if (size < TRUNK_SIZE_CLASS_SL_COUNT)
+	{
+		*fl = 0;
+		*sl = size > 0 ? size : 0;
+		return;
+	}
+
+	bits = TRUNK_SIZE_CLASS_LOG2(size);
+	*fl = bits - TRUNK_SIZE_CLASS_SL_BITS + 1;
+	*sl = (size >> (bits - TRUNK_SIZE_CLASS_SL_BITS)) - \
+		TRUNK_SIZE_CLASS_SL_COUNT;
+}
+
+void trunk_size_class_init(FDFSTrunkSizeClasses *pClasses)
+{
+	memset(pClasses, 0, sizeof(FDFSTrunkSizeClasses));
+}
+
+void trunk_size_class_add(FDFSTrunkSizeClasses *pClasses, \
+		FDFSTrunkNode *pNode)
+{
+	int fl;
+	int sl;
+
+	trunk_size_class_mapping(pNode->trunk.file.size, &fl, &sl);
+	pNode->prev = NULL;
+	pNode->next = pClasses->heads[fl][sl];
+	if (pNode->next != NULL)
+	{
+		pNode->next->prev = pNode;
+	}
+	pClasses->heads[fl][sl] = pNode;
+	pClasses->sl_bitmaps[fl] |= 1U << sl;
+	pClasses->fl_bitmap |= 1U << fl;
+	pClasses->count++;
+}
+
+void trunk_size_class_remove(FDFSTrunkSizeClasses *pClasses, \
+		FDFSTrunkNode *pNode)
+{
+	int fl;
+	int sl;
+
+	trunk_size_class_mapping(pNode->trunk.file.size, &fl, &sl);
+	if (pNode->prev != NULL)
+	{
+		pNode->prev->next = pNode->next;
+	}
+	else if (pClasses->heads[fl][sl] == pNode)
+	{
+		pClasses->heads[fl][sl] = pNode->next;
+		if (pNode->next == NULL)
+		{
+			pClasses->sl_bitmaps[fl] &= ~(1U << sl);
+			if (pClasses->sl_bitmaps[fl] == 0)
+			{
+				pClasses->fl_bitmap &= ~(1U << fl);
+			}
+		}
+	}
+	else
+	{
+		return;  //not in the list
+	}
+
+	if (pNode->next != NULL)
+	{
+		pNode->next->prev = pNode->prev;
+	}
+	pNode->prev = NULL;
+	pNode->next = NULL;
+	pClasses->count--;
+}
+
+FDFSTrunkNode *trunk_size_class_find(FDFSTrunkSizeClasses *pClasses, \
+		const int size)
+{
+	FDFSTrunkNode *pNode;
+	FDFSTrunkNode *pBest;
+	uint32_t bitmap;
+	int rounded;
+	int fl;
+	int sl;
+	int i;
+
+	/* the blocks in the class of the size may be large enough,
+	   take the fit one to keep the larger blocks */
+	trunk_size_class_mapping(size, &fl, &sl);
+	pNode = pClasses->heads[fl][sl];
+	for (i=0; pNode != NULL && i < TRUNK_SIZE_CLASS_SCAN_COUNT; i++)
+	{
+		if (pNode->trunk.file.size >= size)
+		{
+			return pNode;
+		}
+		pNode = pNode->next;
+	}
+
+	/* round up to the next class, so any block of the class
+	   found is large enough */
+	rounded = size;
+	if (size >= TRUNK_SIZE_CLASS_SL_COUNT)
+	{
+		rounded += (1 << (TRUNK_SIZE_CLASS_LOG2(size) - \
+				TRUNK_SIZE_CLASS_SL_BITS)) - 1;
+		if (rounded < size)
+		{
+			rounded = INT_MAX;
+		}
+	}
+
+	trunk_size_class_mapping(rounded, &fl, &sl);
+	bitmap = pClasses->sl_bitmaps[fl] & (~0U << sl);
+	if (bitmap == 0)
+	{
+		bitmap = pClasses->fl_bitmap & (~0U << (fl + 1));
+		if (bitmap != 0)
+		{
+			fl = __builtin_ctz(bitmap);
+			bitmap = pClasses->sl_bitmaps[fl];
+		}
+	}
+
+	if (bitmap != 0)
+	{
+		return pClasses->heads[fl][__builtin_ctz(bitmap)];
+	}
+
+	/* the last chance before failing, take the best fit block of the
+	   class of the size, so the larger blocks of the class are kept */
+	pBest = NULL;
+	while (pNode != NULL)
+	{
+		if (pNode->trunk.file.size >= size && (pBest == NULL || \
+			pNode->trunk.file.size < pBest->trunk.file.size))
+		{
+			pBest = pNode;
+			if (pBest->trunk.file.size == size)
+			{
+				break;
+			}
+		}
+		pNode = pNode->next;
+	}
+
+	return pBest;
+}
+
+bool trunk_size_class_may_fit(const FDFSTrunkSizeClasses *pClasses, \
+		const int size)
+{
+	int fl;
+	int sl;
+
+	trunk_size_class_mapping(size, &fl, &sl);
+	return (pClasses->sl_bitmaps[fl] >> sl) != 0 || \
+		(pClasses->fl_bitmap >> (fl + 1)) != 0;
+}
@@ -0,0 +1,65 @@
+/**
+* Copyright (C) 2008 Happy Fish / YuQing
+*
+* FastDFS may be copied only under the terms of the GNU General
+* Public License V3, which may be found in the FastDFS source kit.
+* Please visit the FastDFS Home Page http://www.csource.org/ for more detail.
+**/
+
+//trunk_size_class.h
+
+#ifndef _TRUNK_SIZE_CLASS_H_
+#define _TRUNK_SIZE_CLASS_H_
+
+#include "common_define.h"
+#include "trunk_mem.h"
+
+/* the free blocks are kept in the segregated lists by the size class,
+   every power of 2 is split to TRUNK_SIZE_CLASS_SL_COUNT classes of the
+   same width, the bitmaps mark the classes which have blocks */
+
+#define TRUNK_SIZE_CLASS_SL_BITS   4
+#define TRUNK_SIZE_CLASS_SL_COUNT  (1 << TRUNK_SIZE_CLASS_SL_BITS)
+#define TRUNK_SIZE_CLASS_FL_COUNT  (32 - TRUNK_SIZE_CLASS_SL_BITS)
+
+/* the blocks scanned in the class of the request size before
+   taking the block of the larger classes */
+#define TRUNK_SIZE_CLASS_SCAN_COUNT  8
+
+typedef struct {
+	FDFSTrunkNode *heads[TRUNK_SIZE_CLASS_FL_COUNT] \
+		[TRUNK_SIZE_CLASS_SL_COUNT];
+	volatile uint32_t fl_bitmap;  //bit n is set when sl_bitmaps[n] != 0
+	volatile uint32_t sl_bitmaps[TRUNK_SIZE_CLASS_FL_COUNT];
+	int count;                    //the block count
+} FDFSTrunkSizeClasses;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void trunk_size_class_init(FDFSTrunkSizeClasses *pClasses);
+
+void trunk_size_class_add(FDFSTrunkSizeClasses *pClasses, \
+		FDFSTrunkNode *pNode);
+
+/* remove the node when it is in the list, the size of the node must not
+   be changed after it is added */
+void trunk_size_class_remove(FDFSTrunkSizeClasses *pClasses, \
+		FDFSTrunkNode *pNode);
+
+/* find the block for the size, NULL when not found, the node is not
+   removed from the list */
+FDFSTrunkNode *trunk_size_class_find(FDFSTrunkSizeClasses *pClasses, \
+		const int size);
+
+/* check if there may be a block for the size without the lock,
+   the result may be stale, so the caller should find again with the lock */
+bool trunk_size_class_may_fit(const FDFSTrunkSizeClasses *pClasses, \
+		const int size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
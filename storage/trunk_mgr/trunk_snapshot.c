@@ -0,0 +1,738 @@
+/**
+* Copyright (C) 2008 Happy Fish / YuQing
+*
+* FastDFS may be copied only under the terms of the GNU General
+* Public License V3, which may be found in the FastDFS source kit.
+* Please visit the FastDFS Home Page http://www.csource.org/ for more detail.
+**/
+
+//trunk_snapshot.c
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include "fdfs_define.h"
+#include "logger.h"
+#include "shared_func.h"
+#include "pthread_func.h"
+#include "sched_thread.h"
+#include "hash.h"
+#include "storage_global.h"
+#include "trunk_mem.h"
+#include "trunk_snapshot.h"
+
+#define TRUNK_SNAPSHOT_CRC_CHUNK  (64 * 1024 * 1024)
+
+typedef struct {
+	const char *filename;
+	const char *file_buff;
+	const FDFSTrunkSnapshotSection *sections;
+	int section_count;
+	int thread_index;
+	int thread_count;
+	trunk_snapshot_load_func load_func;
+	int result;
+} TrunkSnapshotLoadContext;
+
+static bool checkpoint_continue_flag = true;
+static bool checkpoint_thread_running = false;
+
+static int trunk_snapshot_write_buff(FDFSTrunkSnapshotWriter *pWriter, \
+		const char *buff, const int length, const int64_t offset)
+{
+	int bytes;
+	int done;
+	int result;
+
+	done = 0;
+	while (done < length)
+	{
+		bytes = pwrite(pWriter->fd, buff + done, length - done, \
+				offset + done);
+		if (bytes <= 0)
+		{
+			result = errno != 0 ? errno : EIO;
+			logError("file: "__FILE__", line: %d, "\
+				"write to file %s fail, " \
+				"errno: %d, error info: %s", __LINE__, \
+				pWriter->filename, result, STRERROR(result));
+			return result;
+		}
+		done += bytes;
+	}
+
+	return 0;
+}
+
+static int trunk_snapshot_flush(FDFSTrunkSnapshotWriter *pWriter)
+{
+	int result;
+
+	if (pWriter->buff_len == 0)
+	{
+		return 0;
+	}
+
+	if ((result=trunk_snapshot_write_buff(pWriter, pWriter->buff, \
+			pWriter->buff_len, pWriter->offset)) != 0)
+	{
+		return result;
+	}
+
+	//the buffer only holds the records of the current section
+	if (pWriter->pSection != NULL)
+	{
+		pWriter->pSection->crc32 = CRC32_ex(pWriter->buff, \
+			pWriter->buff_len, pWriter->pSection->crc32);
+	}
+	else
+	{
+		pWriter->header.lease_crc32 = CRC32_ex(pWriter->buff, \
+			pWriter->buff_len, pWriter->header.lease_crc32);
+	}
+	pWriter->offset += pWriter->buff_len;
+	pWriter->buff_len = 0;
+	return 0;
+}
+
+int trunk_snapshot_writer_init(FDFSTrunkSnapshotWriter *pWriter, \
+		const char *filename, const int section_count, \
+		const int64_t binlog_offset)
+{
+	int result;
+	int bytes;
+
+	memset(pWriter, 0, sizeof(FDFSTrunkSnapshotWriter));
+	snprintf(pWriter->filename, sizeof(pWriter->filename), \
+		"%s", filename);
+
+	bytes = sizeof(FDFSTrunkSnapshotSection) * section_count;
+	pWriter->sections = (FDFSTrunkSnapshotSection *)malloc(bytes);
+	if (pWriter->sections == NULL)
+	{
+		result = errno != 0 ? errno : ENOMEM;
+		logError("file: "__FILE__", line: %d, " \
+			"malloc %d bytes fail, " \
+			"errno: %d, error info: %s", \
+			__LINE__, bytes, result, STRERROR(result));
+		pWriter->fd = -1;
+		return result;
+	}
+	memset(pWriter->sections, 0, bytes);
+
+	pWriter->fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (pWriter->fd < 0)
+	{
+		result = errno != 0 ? errno : EIO;
+		logError("file: "__FILE__", line: %d, " \
+			"open file %s fail, " \
+			"errno: %d, error info: %s", \
+			__LINE__, filename, result, STRERROR(result));
+		return result;
+	}
+
+	memcpy(pWriter->header.magic, TRUNK_SNAPSHOT_MAGIC, \
+		TRUNK_SNAPSHOT_MAGIC_LEN);
+	pWriter->header.version = TRUNK_SNAPSHOT_VERSION;
+	pWriter->header.record_size = sizeof(FDFSTrunkFullInfo);
+	pWriter->header.section_count = section_count;
+	pWriter->header.create_time = g_current_time;
+	pWriter->header.binlog_offset = binlog_offset;
+
+	//the header and the section table are written at last
+	pWriter->offset = sizeof(FDFSTrunkSnapshotHeader) + bytes;
+	return 0;
+}
+
+void trunk_snapshot_begin_section(FDFSTrunkSnapshotWriter *pWriter, \
+		const int section_index)
+{
+	if (pWriter->pSection != NULL)
+	{
+		trunk_snapshot_flush(pWriter);
+	}
+
+	pWriter->pSection = pWriter->sections + section_index;
+	pWriter->pSection->section_index = section_index;
+	pWriter->pSection->crc32 = CRC32_XINIT;
+	pWriter->pSection->offset = pWriter->offset;
+}
+
+int trunk_snapshot_write(FDFSTrunkSnapshotWriter *pWriter, \
+		const FDFSTrunkFullInfo *pTrunkInfo)
+{
+	int result;
+
+	if (pWriter->buff_len + sizeof(FDFSTrunkFullInfo) > \
+		sizeof(pWriter->buff))
+	{
+		if ((result=trunk_snapshot_flush(pWriter)) != 0)
+		{
+			return result;
+		}
+	}
+
+	memcpy(pWriter->buff + pWriter->buff_len, pTrunkInfo, \
+		sizeof(FDFSTrunkFullInfo));
+	pWriter->buff_len += sizeof(FDFSTrunkFullInfo);
+	pWriter->pSection->count++;
+	pWriter->header.record_count++;
+	return 0;
+}
+
+void trunk_snapshot_begin_leases(FDFSTrunkSnapshotWriter *pWriter)
+{
+	trunk_snapshot_flush(pWriter);
+	pWriter->pSection = NULL;
+	pWriter->header.lease_crc32 = CRC32_XINIT;
+	pWriter->header.lease_offset = pWriter->offset;
+}
+
+int trunk_snapshot_write_lease(FDFSTrunkSnapshotWriter *pWriter, \
+		const FDFSTrunkLeaseInfo *pLease)
+{
+	int result;
+
+	if (pWriter->buff_len + sizeof(FDFSTrunkLeaseInfo) > \
+		sizeof(pWriter->buff))
+	{
+		if ((result=trunk_snapshot_flush(pWriter)) != 0)
+		{
+			return result;
+		}
+	}
+
+	memcpy(pWriter->buff + pWriter->buff_len, pLease, \
+		sizeof(FDFSTrunkLeaseInfo));
+	pWriter->buff_len += sizeof(FDFSTrunkLeaseInfo);
+	pWriter->header.lease_count++;
+	return 0;
+}
+
+int trunk_snapshot_writer_finish(FDFSTrunkSnapshotWriter *pWriter)
+{
+	int result;
+	int i;
+
+	if ((result=trunk_snapshot_flush(pWriter)) != 0)
+	{
+		return result;
+	}
+
+	if (pWriter->header.lease_offset == 0)
+	{
+		pWriter->header.lease_offset = pWriter->offset;
+		pWriter->header.lease_crc32 = CRC32_XINIT;
+	}
+	pWriter->header.lease_crc32 = CRC32_FINAL(pWriter->header.lease_crc32);
+
+	for (i=0; i<pWriter->header.section_count; i++)
+	{
+		pWriter->sections[i].section_index = i;
+		if (pWriter->sections[i].offset == 0)
+		{
+			pWriter->sections[i].offset = pWriter->offset;
+			pWriter->sections[i].crc32 = CRC32_XINIT;
+		}
+		pWriter->sections[i].crc32 = CRC32_FINAL( \
+				pWriter->sections[i].crc32);
+	}
+
+	if ((result=trunk_snapshot_write_buff(pWriter, \
+		(char *)pWriter->sections, sizeof(FDFSTrunkSnapshotSection) * \
+		pWriter->header.section_count, \
+		sizeof(FDFSTrunkSnapshotHeader))) != 0)
+	{
+		return result;
+	}
+
+	if ((result=trunk_snapshot_write_buff(pWriter, \
+		(char *)&(pWriter->header), sizeof(FDFSTrunkSnapshotHeader), \
+		0)) != 0)
+	{
+		return result;
+	}
+
+	if (fsync(pWriter->fd) != 0)
+	{
+		result = errno != 0 ? errno : EIO;
+		logError("file: "__FILE__", line: %d, "\
+			"fsync file %s fail, " \
+			"errno: %d, error info: %s", \
+			__LINE__, pWriter->filename, \
+			result, STRERROR(result));
+		return result;
+	}
+
+	result = close(pWriter->fd);
+	pWriter->fd = -1;
+	if (result != 0)
+	{
+		result = errno != 0 ? errno : EIO;
+		logError("file: "__FILE__", line: %d, "\
+			"close file %s fail, " \
+			"errno: %d, error info: %s", \
+			__LINE__, pWriter->filename, \
+			result, STRERROR(result));
+		return result;
+	}
+
+	return 0;
+}
+
+void trunk_snapshot_writer_destroy(FDFSTrunkSnapshotWriter *pWriter)
+{
+	if (pWriter->fd >= 0)
+	{
+		close(pWriter->fd);
+		pWriter->fd = -1;
+		unlink(pWriter->filename);
+	}
+
+	if (pWriter->sections != NULL)
+	{
+		free(pWriter->sections);
+		pWriter->sections = NULL;
+	}
+}
+
+static int trunk_snapshot_crc32(const char *buff, const int64_t bytes)
+{
+	const char *p;
+	int64_t remain;
+	int len;
+	int crc32;
+
+	crc32 = CRC32_XINIT;
+	p = buff;
+	remain = bytes;
+	while (remain > 0)
+	{
+		len = remain > TRUNK_SNAPSHOT_CRC_CHUNK ? \
+			TRUNK_SNAPSHOT_CRC_CHUNK : remain;
+		crc32 = CRC32_ex((void *)p, len, crc32);
+		p += len;
+		remain -= len;
+	}
+	return CRC32_FINAL(crc32);
+}
+
+static int trunk_snapshot_load_section(TrunkSnapshotLoadContext *pContext, \
+		const FDFSTrunkSnapshotSection *pSection)
+{
+	const FDFSTrunkFullInfo *pRecord;
+	const FDFSTrunkFullInfo *pEnd;
+	int crc32;
+	int result;
+
+	crc32 = trunk_snapshot_crc32(pContext->file_buff + pSection->offset, \
+			pSection->count * sizeof(FDFSTrunkFullInfo));
+	if (crc32 != pSection->crc32)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"file %s, section: %d, crc32: %d != %d", \
+			__LINE__, pContext->filename, \
+			pSection->section_index, crc32, pSection->crc32);
+		return EINVAL;
+	}
+
+	pRecord = (const FDFSTrunkFullInfo *)(pContext->file_buff + \
+			pSection->offset);
+	pEnd = pRecord + pSection->count;
+	for (; pRecord<pEnd; pRecord++)
+	{
+		if ((result=pContext->load_func(pRecord)) != 0)
+		{
+			return result;
+		}
+	}
+
+	return 0;
+}
+
+static int trunk_snapshot_load_leases(const char *filename, \
+		const char *file_buff, trunk_snapshot_lease_func lease_func)
+{
+	const FDFSTrunkSnapshotHeader *pHeader;
+	const FDFSTrunkLeaseInfo *pLease;
+	const FDFSTrunkLeaseInfo *pEnd;
+	int crc32;
+	int result;
+
+	pHeader = (const FDFSTrunkSnapshotHeader *)file_buff;
+	if (pHeader->version == 1)
+	{
+		return 0;
+	}
+
+	crc32 = trunk_snapshot_crc32(file_buff + pHeader->lease_offset, \
+			pHeader->lease_count * sizeof(FDFSTrunkLeaseInfo));
+	if (crc32 != pHeader->lease_crc32)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"file %s, lease crc32: %d != %d", __LINE__, \
+			filename, crc32, pHeader->lease_crc32);
+		return EINVAL;
+	}
+
+	pLease = (const FDFSTrunkLeaseInfo *)(file_buff + \
+			pHeader->lease_offset);
+	pEnd = pLease + pHeader->lease_count;
+	for (; pLease<pEnd; pLease++)
+	{
+		if ((result=lease_func(pLease)) != 0)
+		{
+			return result;
+		}
+	}
+
+	return 0;
+}
+
+static void *trunk_snapshot_load_entrance(void *arg)
+{
+	TrunkSnapshotLoadContext *pContext;
+	int i;
+
+	pContext = (TrunkSnapshotLoadContext *)arg;
+	for (i=pContext->thread_index; i<pContext->section_count; \
+		i+=pContext->thread_count)
+	{
+		if ((pContext->result=trunk_snapshot_load_section(pContext, \
+			pContext->sections + i)) != 0)
+		{
+			break;
+		}
+	}
+
+	return NULL;
+}
+
+/* the header of version 1 has no lease fields */
+static int trunk_snapshot_header_size(const FDFSTrunkSnapshotHeader *pHeader)
+{
+	return pHeader->version == 1 ? TRUNK_SNAPSHOT_V1_HEADER_SIZE : \
+		(int)sizeof(FDFSTrunkSnapshotHeader);
+}
+
+static int trunk_snapshot_check(const char *filename, const char *file_buff, \
+		const int64_t file_size)
+{
+	const FDFSTrunkSnapshotHeader *pHeader;
+	const FDFSTrunkSnapshotSection *pSection;
+	int64_t record_count;
+	int header_size;
+	int i;
+
+	pHeader = (const FDFSTrunkSnapshotHeader *)file_buff;
+	if (file_size < TRUNK_SNAPSHOT_V1_HEADER_SIZE || \
+		memcmp(pHeader->magic, TRUNK_SNAPSHOT_MAGIC, \
+			TRUNK_SNAPSHOT_MAGIC_LEN) != 0)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"file %s is not a trunk snapshot", \
+			__LINE__, filename);
+		return EINVAL;
+	}
+
+	if (pHeader->version < 1 || pHeader->version > \
+		TRUNK_SNAPSHOT_VERSION || pHeader->record_size != \
+		sizeof(FDFSTrunkFullInfo))
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"file %s, version: %d or record size: %d " \
+			"not supported", __LINE__, filename, \
+			pHeader->version, pHeader->record_size);
+		return EINVAL;
+	}
+
+	header_size = trunk_snapshot_header_size(pHeader);
+	if (pHeader->section_count < 0 || header_size + \
+		sizeof(FDFSTrunkSnapshotSection) * (int64_t)pHeader-> \
+		section_count > file_size)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"file %s, invalid section count: %d", \
+			__LINE__, filename, pHeader->section_count);
+		return EINVAL;
+	}
+
+	if (pHeader->version > 1 && (pHeader->lease_count < 0 || \
+		pHeader->lease_offset < 0 || pHeader->lease_offset + \
+		pHeader->lease_count * (int64_t)sizeof(FDFSTrunkLeaseInfo) \
+		> file_size))
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"file %s, invalid lease count: %d", \
+			__LINE__, filename, pHeader->lease_count);
+		return EINVAL;
+	}
+
+	record_count = 0;
+	pSection = (const FDFSTrunkSnapshotSection *)(file_buff + header_size);
+	for (i=0; i<pHeader->section_count; i++)
+	{
+		if (pSection[i].count < 0 || pSection[i].offset < 0 || \
+			pSection[i].offset + pSection[i].count * \
+			(int64_t)sizeof(FDFSTrunkFullInfo) > file_size)
+		{
+			logError("file: "__FILE__", line: %d, " \
+				"file %s, section: %d is invalid", \
+				__LINE__, filename, i);
+			return EINVAL;
+		}
+		record_count += pSection[i].count;
+	}
+
+	if (record_count != pHeader->record_count)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"file %s, record count: "INT64_PRINTF_FORMAT \
+			" != "INT64_PRINTF_FORMAT, __LINE__, filename, \
+			record_count, pHeader->record_count);
+		return EINVAL;
+	}
+
+	return 0;
+}
+
+int trunk_snapshot_load(const char *filename, const int thread_count, \
+		trunk_snapshot_load_func load_func, \
+		trunk_snapshot_lease_func lease_func, \
+		int64_t *binlog_offset, int64_t *record_count)
+{
+	const FDFSTrunkSnapshotHeader *pHeader;
+	TrunkSnapshotLoadContext *contexts;
+	pthread_t *tids;
+	pthread_attr_t pattr;
+	struct stat stat_buf;
+	char *file_buff;
+	int fd;
+	int count;
+	int created;
+	int result;
+	int i;
+
+	if ((fd=open(filename, O_RDONLY)) < 0)
+	{
+		result = errno != 0 ? errno : ENOENT;
+		logError("file: "__FILE__", line: %d, " \
+			"open file %s fail, " \
+			"errno: %d, error info: %s", \
+			__LINE__, filename, result, STRERROR(result));
+		return result;
+	}
+
+	if (fstat(fd, &stat_buf) != 0)
+	{
+		result = errno != 0 ? errno : EIO;
+		logError("file: "__FILE__", line: %d, " \
+			"stat file %s fail, " \
+			"errno: %d, error info: %s", \
+			__LINE__, filename, result, STRERROR(result));
+		close(fd);
+		return result;
+	}
+
+	if (stat_buf.st_size < TRUNK_SNAPSHOT_V1_HEADER_SIZE)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"file %s is not a trunk snapshot", \
+			__LINE__, filename);
+		close(fd);
+		return EINVAL;
+	}
+
+	file_buff = (char *)mmap(NULL, stat_buf.st_size, PROT_READ, \
+			MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (file_buff == MAP_FAILED)
+	{
+		result = errno != 0 ? errno : ENOMEM;
+		logError("file: "__FILE__", line: %d, " \
+			"mmap file %s fail, " \
+			"errno: %d, error info: %s", \
+			__LINE__, filename, result, STRERROR(result));
+		return result;
+	}
+	madvise(file_buff, stat_buf.st_size, MADV_SEQUENTIAL);
+
+	if ((result=trunk_snapshot_check(filename, file_buff, \
+			stat_buf.st_size)) != 0)
+	{
+		munmap(file_buff, stat_buf.st_size);
+		return result;
+	}
+
+	pHeader = (const FDFSTrunkSnapshotHeader *)file_buff;
+	count = thread_count < pHeader->section_count ? \
+		thread_count : pHeader->section_count;
+	if (count <= 0)
+	{
+		count = 1;
+	}
+
+	contexts = (TrunkSnapshotLoadContext *)malloc( \
+			(sizeof(TrunkSnapshotLoadContext) + \
+			 sizeof(pthread_t)) * count);
+	if (contexts == NULL)
+	{
+		result = errno != 0 ? errno : ENOMEM;
+		logError("file: "__FILE__", line: %d, " \
+			"malloc %d bytes fail, " \
+			"errno: %d, error info: %s", __LINE__, \
+			(int)(sizeof(TrunkSnapshotLoadContext) + \
+			sizeof(pthread_t)) * count, result, STRERROR(result));
+		munmap(file_buff, stat_buf.st_size);
+		return result;
+	}
+	tids = (pthread_t *)(contexts + count);
+
+	for (i=0; i<count; i++)
+	{
+		contexts[i].filename = filename;
+		contexts[i].file_buff = file_buff;
+		contexts[i].sections = (const FDFSTrunkSnapshotSection *) \
+			(file_buff + trunk_snapshot_header_size(pHeader));
+		contexts[i].section_count = pHeader->section_count;
+		contexts[i].thread_index = i;
+		contexts[i].thread_count = count;
+		contexts[i].load_func = load_func;
+		contexts[i].result = 0;
+	}
+
+	created = 0;
+	if (count > 1 && init_pthread_attr(&pattr, g_thread_stack_size) == 0)
+	{
+		//the threads are joined when the sections loaded
+		pthread_attr_setdetachstate(&pattr, PTHREAD_CREATE_JOINABLE);
+		for (; created<count; created++)
+		{
+			if ((result=pthread_create(tids + created, &pattr, \
+				trunk_snapshot_load_entrance, \
+				contexts + created)) != 0)
+			{
+				logError("file: "__FILE__", line: %d, " \
+					"create thread failed, errno: %d, " \
+					"error info: %s", __LINE__, \
+					result, STRERROR(result));
+				break;
+			}
+		}
+		pthread_attr_destroy(&pattr);
+	}
+
+	//the sections of the contexts without the thread are loaded here
+	for (i=created; i<count; i++)
+	{
+		trunk_snapshot_load_entrance(contexts + i);
+	}
+	for (i=0; i<created; i++)
+	{
+		pthread_join(tids[i], NULL);
+	}
+
+	result = 0;
+	for (i=0; i<count; i++)
+	{
+		if (contexts[i].result != 0)
+		{
+			result = contexts[i].result;
+			break;
+		}
+	}
+
+	if (result == 0)
+	{
+		result = trunk_snapshot_load_leases(filename, \
+				file_buff, lease_func);
+	}
+
+	if (result == 0)
+	{
+		*binlog_offset = pHeader->binlog_offset;
+		*record_count = pHeader->record_count;
+	}
+
+	free(contexts);
+	munmap(file_buff, stat_buf.st_size);
+	return result;
+}
+
+static void *trunk_checkpoint_entrance(void *arg)
+{
+	time_t last_checkpoint_time;
+
+	last_checkpoint_time = g_current_time;
+	while (g_continue_flag && checkpoint_continue_flag)
+	{
+		sleep(1);
+		if (g_current_time - last_checkpoint_time < \
+			g_trunk_checkpoint_interval)
+		{
+			continue;
+		}
+		last_checkpoint_time = g_current_time;
+
+		if (!(g_if_use_trunk_file && g_if_trunker_self))
+		{
+			continue;
+		}
+
+		storage_trunk_checkpoint();
+	}
+
+	checkpoint_thread_running = false;
+	return NULL;
+}
+
+int trunk_checkpoint_start()
+{
+	pthread_t tid;
+	pthread_attr_t pattr;
+	int result;
+
+	if (g_trunk_checkpoint_interval <= 0)
+	{
+		return 0;
+	}
+
+	if ((result=init_pthread_attr(&pattr, g_thread_stack_size)) != 0)
+	{
+		return result;
+	}
+
+	checkpoint_continue_flag = true;
+	checkpoint_thread_running = true;
+	if ((result=pthread_create(&tid, &pattr, \
+		trunk_checkpoint_entrance, NULL)) != 0)
+	{
+		checkpoint_thread_running = false;
+		logError("file: "__FILE__", line: %d, " \
+			"create thread failed, errno: %d, " \
+			"error info: %s", __LINE__, \
+			result, STRERROR(result));
+	}
+
+	pthread_attr_destroy(&pattr);
+	return result;
+}
+
+void trunk_checkpoint_destroy()
+{
+	int i;
+
+	checkpoint_continue_flag = false;
+	for (i=0; checkpoint_thread_running && i<300; i++)
+	{
+		usleep(10000);
+	}
+}
+
@@ -0,0 +1,111 @@
+/**
+* Copyright (C) 2008 Happy Fish / YuQing
+*
+* FastDFS may be copied only under the terms of the GNU General
+* Public License V3, which may be found in the FastDFS source kit.
+* Please visit the FastDFS Home Page http://www.csource.org/ for more detail.
+**/
+
+//trunk_snapshot.h
+
+#ifndef _TRUNK_SNAPSHOT_H_
+#define _TRUNK_SNAPSHOT_H_
+
+#include <stddef.h>
+#include "common_define.h"
+#include "trunk_shared.h"
+
+/* the binary snapshot of the trunk free space (storage_trunk.dat):
+   the header, the section table and the records of the sections,
+   a section holds the blocks of one allocator shard, so the sections
+   can be loaded by the threads in parallel. the records are the
+   FDFSTrunkFullInfo structures in the host byte order, so the file
+   can be mapped and loaded without parsing. the leases held by the
+   storage servers follow the sections since version 2 */
+
+#define TRUNK_SNAPSHOT_MAGIC      "FDFSTSNP"
+#define TRUNK_SNAPSHOT_MAGIC_LEN  8
+#define TRUNK_SNAPSHOT_VERSION    2
+
+#define TRUNK_SNAPSHOT_V1_HEADER_SIZE  \
+	((int)offsetof(FDFSTrunkSnapshotHeader, lease_offset))
+
+typedef struct {
+	char magic[TRUNK_SNAPSHOT_MAGIC_LEN];
+	int version;
+	int record_size;    //sizeof(FDFSTrunkFullInfo)
+	int section_count;
+	int create_time;
+	int64_t binlog_offset;  //the trunk binlog size when saved
+	int64_t record_count;
+	int64_t lease_offset;   //the file offset of the first lease
+	int lease_count;
+	int lease_crc32;        //the crc32 of the leases
+} FDFSTrunkSnapshotHeader;
+
+typedef struct {
+	int section_index;
+	int crc32;         //the crc32 of the records
+	int64_t offset;    //the file offset of the first record
+	int64_t count;     //the record count
+} FDFSTrunkSnapshotSection;
+
+typedef struct {
+	int fd;
+	char filename[MAX_PATH_SIZE];
+	FDFSTrunkSnapshotHeader header;
+	FDFSTrunkSnapshotSection *sections;
+	FDFSTrunkSnapshotSection *pSection;  //the current section or NULL
+	int64_t offset;   //the file offset to write
+	int buff_len;
+	char buff[64 * 1024];
+} FDFSTrunkSnapshotWriter;
+
+typedef int (*trunk_snapshot_load_func)(const FDFSTrunkFullInfo *pTrunkInfo);
+typedef int (*trunk_snapshot_lease_func)(const FDFSTrunkLeaseInfo *pLease);
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int trunk_snapshot_writer_init(FDFSTrunkSnapshotWriter *pWriter, \
+		const char *filename, const int section_count, \
+		const int64_t binlog_offset);
+
+/* the records after this call belong to the section */
+void trunk_snapshot_begin_section(FDFSTrunkSnapshotWriter *pWriter, \
+		const int section_index);
+
+int trunk_snapshot_write(FDFSTrunkSnapshotWriter *pWriter, \
+		const FDFSTrunkFullInfo *pTrunkInfo);
+
+/* the records after this call are the leases, after all sections */
+void trunk_snapshot_begin_leases(FDFSTrunkSnapshotWriter *pWriter);
+
+int trunk_snapshot_write_lease(FDFSTrunkSnapshotWriter *pWriter, \
+		const FDFSTrunkLeaseInfo *pLease);
+
+/* write the header and the section table then fsync the file */
+int trunk_snapshot_writer_finish(FDFSTrunkSnapshotWriter *pWriter);
+
+/* close the file and remove it when not finished */
+void trunk_snapshot_writer_destroy(FDFSTrunkSnapshotWriter *pWriter);
+
+/* map the snapshot and pass the records to the load func by the threads,
+   then the leases to the lease func, the sections and the leases are
+   checked by crc32 before loading */
+int trunk_snapshot_load(const char *filename, const int thread_count, \
+		trunk_snapshot_load_func load_func, \
+		trunk_snapshot_lease_func lease_func, \
+		int64_t *binlog_offset, int64_t *record_count);
+
+/* the thread to write the snapshot every trunk_checkpoint_interval */
+int trunk_checkpoint_start();
+void trunk_checkpoint_destroy();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
@@ -27,6 +27,7 @@
 #include "shared_func.h"
 #include "pthread_func.h"
 #include "sched_thread.h"
+#include "hash.h"
 #include "ini_file_reader.h"
 #include "tracker_types.h"
 #include "tracker_proto.h"
@@ -36,6 +37,7 @@
 #include "tracker_client_thread.h"
 #include "storage_client.h"
 #include "trunk_sync.h"
+#include "trunk_redirect.h"
 
 #define TRUNK_SYNC_BINLOG_FILENAME	"binlog"
 #define TRUNK_SYNC_BINLOG_ROLLBACK_EXT	".rollback"
@@ -51,17 +53,23 @@ static char *trunk_binlog_write_cache_buff = NULL;
 static int trunk_binlog_write_cache_len = 0;
 static int trunk_binlog_write_version = 1;
 
+/* group commit: the writer which finds the cache full becomes the leader,
+   it swaps the cache with the flush buffer, then writes and syncs the
+   batch with trunk_sync_thread_lock released, so the other writers keep
+   appending to the cache meanwhile. the failed batch is kept in the
+   flush buffer and written again by the next leader */
+static char *trunk_binlog_flush_buff = NULL;
+static int trunk_binlog_flush_len = 0;
+static bool trunk_binlog_flushing = false;
+static pthread_cond_t trunk_binlog_flush_cond;
+
 /* save sync thread ids */
 static pthread_t *trunk_sync_tids = NULL;
 
 static int trunk_write_to_mark_file(TrunkBinLogReader *pReader);
-static int trunk_binlog_fsync_ex(const bool bNeedLock, \
-		const char *buff, int *length);
+static int trunk_binlog_flush();
 static int trunk_binlog_preread(TrunkBinLogReader *pReader);
 
-#define trunk_binlog_fsync(bNeedLock) trunk_binlog_fsync_ex(bNeedLock, \
-	trunk_binlog_write_cache_buff, (&trunk_binlog_write_cache_len))
-
 char *get_trunk_binlog_filename(char *full_filename)
 {
 	snprintf(full_filename, MAX_PATH_SIZE, \
@@ -99,15 +107,12 @@ static int trunk_binlog_open_writer(const char *binlog_filename)
 	return 0;
 }
 
-static int trunk_binlog_close_writer(const bool needLock)
+static int trunk_binlog_close_writer()
 {
 	int result;
-	if (trunk_binlog_write_cache_len > 0)
+	if ((result=trunk_binlog_flush()) != 0)
 	{
-		if ((result=trunk_binlog_fsync(needLock)) != 0)
-		{
-			return result;
-		}
+		return result;
 	}
 	close(trunk_binlog_fd);
 	trunk_binlog_fd = -1;
@@ -155,16 +160,18 @@ int trunk_sync_init()
 	}
 
 	trunk_binlog_write_cache_buff = (char *)malloc( \
-					TRUNK_BINLOG_BUFFER_SIZE);
+					2 * TRUNK_BINLOG_BUFFER_SIZE);
 	if (trunk_binlog_write_cache_buff == NULL)
 	{
 		logError("file: "__FILE__", line: %d, " \
 			"malloc %d bytes fail, " \
 			"errno: %d, error info: %s", \
-			__LINE__, TRUNK_BINLOG_BUFFER_SIZE, \
+			__LINE__, 2 * TRUNK_BINLOG_BUFFER_SIZE, \
 			errno, STRERROR(errno));
 		return errno != 0 ? errno : ENOMEM;
 	}
+	trunk_binlog_flush_buff = trunk_binlog_write_cache_buff + \
+					TRUNK_BINLOG_BUFFER_SIZE;
 
 	get_trunk_binlog_filename(binlog_filename);
 	if ((result=trunk_binlog_open_writer(binlog_filename)) != 0)
@@ -177,20 +184,28 @@ int trunk_sync_init()
 		return result;
 	}
 
+	if ((result=pthread_cond_init(&trunk_binlog_flush_cond, NULL)) != 0)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"pthread_cond_init fail, " \
+			"errno: %d, error info: %s", \
+			__LINE__, result, STRERROR(result));
+		return result;
+	}
+
 	STORAGE_FCHOWN(trunk_binlog_fd, binlog_filename, geteuid(), getegid())
 
-	return 0;
+	return trunk_redirect_init();
 }
 
 int trunk_sync_destroy()
 {
 	if (trunk_binlog_fd >= 0)
 	{
-		trunk_binlog_fsync(true);
-		close(trunk_binlog_fd);
-		trunk_binlog_fd = -1;
+		trunk_binlog_close_writer();
 	}
 
+	trunk_redirect_destroy();
 	return 0;
 }
 
@@ -232,9 +247,9 @@ int kill_trunk_sync_threads()
 
 int trunk_binlog_sync_func(void *args)
 {
-	if (trunk_binlog_write_cache_len > 0)
+	if (trunk_binlog_write_cache_len > 0 || trunk_binlog_flush_len > 0)
 	{
-		return trunk_binlog_fsync(true);
+		return trunk_binlog_flush();
 	}
 	else
 	{
@@ -246,12 +261,9 @@ int trunk_binlog_truncate()
 {
 	int result;
 
-	if (trunk_binlog_write_cache_len > 0)
+	if ((result=trunk_binlog_flush()) != 0)
 	{
-		if ((result=trunk_binlog_fsync(true)) != 0)
-		{
-			return result;
-		}
+		return result;
 	}
 
 	if (ftruncate(trunk_binlog_fd, 0) != 0)
@@ -312,7 +324,7 @@ int trunk_binlog_compress_apply()
 		return 0;
 	}
 
-	if ((result=trunk_binlog_close_writer(true)) != 0)
+	if ((result=trunk_binlog_close_writer()) != 0)
 	{
 		return result;
 	}
@@ -479,7 +491,7 @@ int trunk_binlog_compress_commit()
 
 	if (need_open_binlog)
 	{
-		trunk_binlog_close_writer(true);
+		trunk_binlog_close_writer();
 	}
 
 	result = trunk_binlog_merge_file(data_fd);
@@ -569,7 +581,7 @@ int trunk_binlog_compress_rollback()
 		return 0;
 	}
 
-	if ((result=trunk_binlog_close_writer(true)) != 0)
+	if ((result=trunk_binlog_close_writer()) != 0)
 	{
 		return result;
 	}
@@ -603,67 +615,94 @@ int trunk_binlog_compress_rollback()
 	}
 }
 
-static int trunk_binlog_fsync_ex(const bool bNeedLock, \
-		const char *buff, int *length)
+static int trunk_binlog_write_file(const char *buff, const int length)
 {
 	int result;
-	int write_ret;
 	char full_filename[MAX_PATH_SIZE];
 
-	if (bNeedLock && (result=pthread_mutex_lock(&trunk_sync_thread_lock)) != 0)
-	{
-		logError("file: "__FILE__", line: %d, " \
-			"call pthread_mutex_lock fail, " \
-			"errno: %d, error info: %s", \
-			__LINE__, result, STRERROR(result));
-	}
-
-	if (*length == 0) //ignore
-	{
-		write_ret = 0;  //skip
-	}
-	else if (write(trunk_binlog_fd, buff, *length) != *length)
+	if (write(trunk_binlog_fd, buff, length) != length)
 	{
+		result = errno != 0 ? errno : EIO;
 		logError("file: "__FILE__", line: %d, " \
 			"write to binlog file \"%s\" fail, fd=%d, " \
 			"errno: %d, error info: %s",  \
 			__LINE__, get_trunk_binlog_filename(full_filename), \
-			trunk_binlog_fd, errno, STRERROR(errno));
-		write_ret = errno != 0 ? errno : EIO;
+			trunk_binlog_fd, result, STRERROR(result));
+		return result;
 	}
-	else if (fsync(trunk_binlog_fd) != 0)
+
+	if (fsync(trunk_binlog_fd) != 0)
 	{
+		result = errno != 0 ? errno : EIO;
 		logError("file: "__FILE__", line: %d, " \
 			"sync to binlog file \"%s\" fail, " \
 			"errno: %d, error info: %s",  \
 			__LINE__, get_trunk_binlog_filename(full_filename), \
-			errno, STRERROR(errno));
-		write_ret = errno != 0 ? errno : EIO;
+			result, STRERROR(result));
+		return result;
 	}
-	else
+
+	return 0;
+}
+
+/* write and sync the batch as the leader, the caller holds
+   trunk_sync_thread_lock and no other leader is flushing */
+static int trunk_binlog_write_batch(const char *buff, const int length)
+{
+	int result;
+
+	trunk_binlog_flushing = true;
+	pthread_mutex_unlock(&trunk_sync_thread_lock);
+
+	result = trunk_binlog_write_file(buff, length);
+
+	pthread_mutex_lock(&trunk_sync_thread_lock);
+	trunk_binlog_flushing = false;
+	if (result == 0)
 	{
-		write_ret = 0;
+		trunk_binlog_write_version++;
 	}
+	pthread_cond_broadcast(&trunk_binlog_flush_cond);
 
-	if (write_ret == 0)
+	return result;
+}
+
+/* the caller holds trunk_sync_thread_lock */
+static int trunk_binlog_do_flush()
+{
+	char *buff;
+	int result;
+
+	while (trunk_binlog_flushing)
 	{
-		trunk_binlog_write_version++;
-		*length = 0;  //reset cache buff
+		pthread_cond_wait(&trunk_binlog_flush_cond, \
+				&trunk_sync_thread_lock);
 	}
 
-	if (bNeedLock && (result=pthread_mutex_unlock(&trunk_sync_thread_lock)) != 0)
+	if (trunk_binlog_flush_len == 0)  //no failed batch
 	{
-		logError("file: "__FILE__", line: %d, " \
-			"call pthread_mutex_unlock fail, " \
-			"errno: %d, error info: %s", \
-			__LINE__, result, STRERROR(result));
+		if (trunk_binlog_write_cache_len == 0)
+		{
+			return 0;
+		}
+
+		buff = trunk_binlog_flush_buff;
+		trunk_binlog_flush_buff = trunk_binlog_write_cache_buff;
+		trunk_binlog_flush_len = trunk_binlog_write_cache_len;
+		trunk_binlog_write_cache_buff = buff;
+		trunk_binlog_write_cache_len = 0;
 	}
 
-	return write_ret;
+	if ((result=trunk_binlog_write_batch(trunk_binlog_flush_buff, \
+			trunk_binlog_flush_len)) == 0)
+	{
+		trunk_binlog_flush_len = 0;
+	}
+
+	return result;
 }
 
-int trunk_binlog_write(const int timestamp, const char op_type, \
-		const FDFSTrunkFullInfo *pTrunk)
+static int trunk_binlog_flush()
 {
 	int result;
 	int write_ret;
@@ -676,25 +715,11 @@ int trunk_binlog_write(const int timestamp, const char op_type, \
 			__LINE__, result, STRERROR(result));
 	}
 
-	trunk_binlog_write_cache_len += sprintf(trunk_binlog_write_cache_buff + \
-					trunk_binlog_write_cache_len, \
-					"%d %c %d %d %d %d %d %d\n", \
-					timestamp, op_type, \
-					pTrunk->path.store_path_index, \
-					pTrunk->path.sub_path_high, \
-					pTrunk->path.sub_path_low, \
-					pTrunk->file.id, \
-					pTrunk->file.offset, \
-					pTrunk->file.size);
-
-	//check if buff full
-	if (TRUNK_BINLOG_BUFFER_SIZE - trunk_binlog_write_cache_len < 128)
+	write_ret = trunk_binlog_do_flush();
+	if (write_ret == 0 && trunk_binlog_write_cache_len > 0)
 	{
-		write_ret = trunk_binlog_fsync(false);  //sync to disk
-	}
-	else
-	{
-		write_ret = 0;
+		//the failed batch written, or appended when flushing
+		write_ret = trunk_binlog_do_flush();
 	}
 
 	if ((result=pthread_mutex_unlock(&trunk_sync_thread_lock)) != 0)
@@ -708,54 +733,282 @@ int trunk_binlog_write(const int timestamp, const char op_type, \
 	return write_ret;
 }
 
-int trunk_binlog_write_buffer(const char *buff, const int length)
+/* the caller holds trunk_sync_thread_lock */
+static int trunk_binlog_do_write(const char *buff, const int length)
 {
 	int result;
-	int write_ret;
 
-	if ((result=pthread_mutex_lock(&trunk_sync_thread_lock)) != 0)
+	while (length > TRUNK_BINLOG_BUFFER_SIZE - trunk_binlog_write_cache_len)
 	{
-		logError("file: "__FILE__", line: %d, " \
-			"call pthread_mutex_lock fail, " \
-			"errno: %d, error info: %s", \
-			__LINE__, result, STRERROR(result));
+		if (length > TRUNK_BINLOG_BUFFER_SIZE && \
+			trunk_binlog_write_cache_len == 0 && \
+			trunk_binlog_flush_len == 0 && !trunk_binlog_flushing)
+		{
+			//too large for the cache, write directly
+			return trunk_binlog_write_batch(buff, length);
+		}
+
+		if ((result=trunk_binlog_do_flush()) != 0)
+		{
+			return result;
+		}
 	}
 
-	//check if buff full
-	if (TRUNK_BINLOG_BUFFER_SIZE - (trunk_binlog_write_cache_len + \
-			length) < 128)
+	memcpy(trunk_binlog_write_cache_buff + trunk_binlog_write_cache_len, \
+		buff, length);
+	trunk_binlog_write_cache_len += length;
+	return 0;
+}
+
+static void trunk_binlog_pack_trunk(const FDFSTrunkFullInfo *pTrunk, \
+		char *buff)
+{
+	*buff = (char)pTrunk->path.sub_path_high;
+	*(buff + 1) = (char)pTrunk->path.sub_path_low;
+	*(buff + 2) = '\0';
+	*(buff + 3) = '\0';
+	int2buff(pTrunk->file.id, buff + 4);
+	int2buff(pTrunk->file.offset, buff + 8);
+	int2buff(pTrunk->file.size, buff + 12);
+}
+
+static void trunk_binlog_unpack_trunk(const char *buff, \
+		const int store_path_index, FDFSTrunkFullInfo *pTrunk)
+{
+	pTrunk->path.store_path_index = store_path_index;
+	pTrunk->path.sub_path_high = *((unsigned char *)buff);
+	pTrunk->path.sub_path_low = *((unsigned char *)buff + 1);
+	pTrunk->file.id = buff2int(buff + 4);
+	pTrunk->file.offset = buff2int(buff + 8);
+	pTrunk->file.size = buff2int(buff + 12);
+}
+
+int trunk_binlog_pack_record(const int timestamp, const char op_type, \
+		const FDFSTrunkFullInfo *pTrunk, \
+		const FDFSTrunkFullInfo *pDest, const int64_t lease_id, \
+		char *buff)
+{
+	int length;
+
+	if (g_trunk_binlog_format == STORAGE_BINLOG_FORMAT_TEXT)
+	{
+		if (op_type == TRUNK_OP_TYPE_MOVE && pDest != NULL)
+		{
+			return sprintf(buff, "%d %c %d %d %d %d %d %d " \
+				"%d %d %d %d %d\n", timestamp, op_type, \
+				pTrunk->path.store_path_index, \
+				pTrunk->path.sub_path_high, \
+				pTrunk->path.sub_path_low, \
+				pTrunk->file.id, pTrunk->file.offset, \
+				pTrunk->file.size, pDest->path.sub_path_high, \
+				pDest->path.sub_path_low, pDest->file.id, \
+				pDest->file.offset, pDest->file.size);
+		}
+
+		if (TRUNK_OP_IS_LEASE(op_type))
+		{
+			return sprintf(buff, "%d %c %d %d %d %d %d %d " \
+				INT64_PRINTF_FORMAT"\n", timestamp, op_type, \
+				pTrunk->path.store_path_index, \
+				pTrunk->path.sub_path_high, \
+				pTrunk->path.sub_path_low, \
+				pTrunk->file.id, pTrunk->file.offset, \
+				pTrunk->file.size, lease_id);
+		}
+
+		return sprintf(buff, "%d %c %d %d %d %d %d %d\n", \
+			timestamp, op_type, pTrunk->path.store_path_index, \
+			pTrunk->path.sub_path_high, \
+			pTrunk->path.sub_path_low, pTrunk->file.id, \
+			pTrunk->file.offset, pTrunk->file.size);
+	}
+
+	if (op_type == TRUNK_OP_TYPE_MOVE && pDest != NULL)
 	{
-		write_ret = trunk_binlog_fsync(false);  //sync to disk
+		length = TRUNK_BINLOG_MOVE_RECORD_SIZE;
+	}
+	else if (TRUNK_OP_IS_LEASE(op_type))
+	{
+		length = TRUNK_BINLOG_LEASE_RECORD_SIZE;
 	}
 	else
 	{
-		write_ret = 0;
+		length = TRUNK_BINLOG_RECORD_SIZE;
 	}
 
-	if (write_ret == 0)
+	*((unsigned char *)buff) = TRUNK_BINLOG_RECORD_MAGIC;
+	*(buff + 1) = op_type;
+	*((unsigned char *)buff + 2) = length;
+	*((unsigned char *)buff + 3) = pTrunk->path.store_path_index;
+	int2buff(timestamp, buff + 4);
+	trunk_binlog_pack_trunk(pTrunk, buff + 8);
+	if (length == TRUNK_BINLOG_MOVE_RECORD_SIZE)
+	{
+		trunk_binlog_pack_trunk(pDest, buff + 8 + \
+				TRUNK_BINLOG_TRUNK_BYTES);
+	}
+	else if (length == TRUNK_BINLOG_LEASE_RECORD_SIZE)
 	{
-		if (length >= TRUNK_BINLOG_BUFFER_SIZE)
+		long2buff(lease_id, buff + 8 + TRUNK_BINLOG_TRUNK_BYTES);
+	}
+	int2buff(CRC32(buff, length - 4), buff + length - 4);
+
+	return length;
+}
+
+/* return the length of the record at buff, 0 when it is not complete,
+   the bad binary record is skipped byte by byte */
+static int trunk_binlog_record_length(const char *buff, const int length)
+{
+	const char *pLineEnd;
+	int record_length;
+
+	if (*((unsigned char *)buff) == TRUNK_BINLOG_RECORD_MAGIC)
+	{
+		if (length < 3)
 		{
-			if (trunk_binlog_write_cache_len > 0)
-			{
-				write_ret = trunk_binlog_fsync(false);
-			}
+			return 0;
+		}
 
-			if (write_ret == 0)
-			{
-				int len;
-				len = length;
-				write_ret = trunk_binlog_fsync_ex(false, \
-					buff, &len);
-			}
+		record_length = *((unsigned char *)buff + 2);
+		if (!(record_length == TRUNK_BINLOG_RECORD_SIZE || \
+			record_length == TRUNK_BINLOG_MOVE_RECORD_SIZE || \
+			record_length == TRUNK_BINLOG_LEASE_RECORD_SIZE))
+		{
+			return 1;
 		}
-		else
+
+		return length >= record_length ? record_length : 0;
+	}
+
+	pLineEnd = (const char *)memchr(buff, '\n', length);
+	return pLineEnd != NULL ? (pLineEnd - buff) + 1 : 0;
+}
+
+int trunk_binlog_unpack_record(const char *buff, const int length, \
+		TrunkBinLogRecord *pRecord, int *record_length)
+{
+	char line[TRUNK_BINLOG_LINE_SIZE];
+	int timestamp;
+	char op_type;
+	int store_path_index;
+	int sub_path_high;
+	int sub_path_low;
+	int dest_sub_path_high;
+	int dest_sub_path_low;
+	int count;
+	int len;
+	char *pEnd;
+
+	if (length <= 0 || (*record_length=trunk_binlog_record_length( \
+				buff, length)) == 0)
+	{
+		*record_length = 0;
+		return EAGAIN;
+	}
+
+	memset(pRecord, 0, sizeof(TrunkBinLogRecord));
+	if (*((unsigned char *)buff) == TRUNK_BINLOG_RECORD_MAGIC)
+	{
+		if (*record_length == 1 || buff2int(buff + *record_length - 4)
+			 != CRC32((void *)buff, *record_length - 4))
 		{
-			memcpy(trunk_binlog_write_cache_buff + \
-				trunk_binlog_write_cache_len, buff, length);
-			trunk_binlog_write_cache_len += length;
+			return EINVAL;
 		}
+
+		pRecord->timestamp = buff2int(buff + 4);
+		pRecord->op_type = *(buff + 1);
+		store_path_index = *((unsigned char *)buff + 3);
+		trunk_binlog_unpack_trunk(buff + 8, store_path_index, \
+				&(pRecord->trunk));
+		if (*record_length == TRUNK_BINLOG_MOVE_RECORD_SIZE)
+		{
+			trunk_binlog_unpack_trunk(buff + 8 + \
+				TRUNK_BINLOG_TRUNK_BYTES, store_path_index, \
+				&(pRecord->dest));
+		}
+		else if (*record_length == TRUNK_BINLOG_LEASE_RECORD_SIZE)
+		{
+			pRecord->lease_id = buff2long(buff + 8 + \
+					TRUNK_BINLOG_TRUNK_BYTES);
+		}
+		return 0;
 	}
+
+	//the text line of the old version
+	if (*record_length >= sizeof(line))
+	{
+		return EINVAL;
+	}
+	memcpy(line, buff, *record_length - 1);
+	*(line + *record_length - 1) = '\0';
+
+	len = 0;
+	count = sscanf(line, "%d %c %d %d %d %d %d %d%n", \
+		&timestamp, &op_type, &store_path_index, \
+		&sub_path_high, &sub_path_low, &(pRecord->trunk.file.id), \
+		&(pRecord->trunk.file.offset), &(pRecord->trunk.file.size), \
+		&len);
+	if (count < 8)
+	{
+		return EINVAL;
+	}
+
+	if (op_type == TRUNK_OP_TYPE_MOVE)
+	{
+		if (sscanf(line + len, "%d %d %d %d %d", \
+			&dest_sub_path_high, &dest_sub_path_low, \
+			&(pRecord->dest.file.id), &(pRecord->dest.file.offset), \
+			&(pRecord->dest.file.size)) != 5)
+		{
+			return EINVAL;
+		}
+	}
+	else if (TRUNK_OP_IS_LEASE(op_type))
+	{
+		pRecord->lease_id = strtoll(line + len, &pEnd, 10);
+		if (pEnd == line + len)
+		{
+			return EINVAL;
+		}
+	}
+
+	pRecord->timestamp = timestamp;
+	pRecord->op_type = op_type;
+	pRecord->trunk.path.store_path_index = store_path_index;
+	pRecord->trunk.path.sub_path_high = sub_path_high;
+	pRecord->trunk.path.sub_path_low = sub_path_low;
+	if (op_type == TRUNK_OP_TYPE_MOVE)
+	{
+		pRecord->dest.path.store_path_index = store_path_index;
+		pRecord->dest.path.sub_path_high = dest_sub_path_high;
+		pRecord->dest.path.sub_path_low = dest_sub_path_low;
+	}
+
+	return 0;
+}
+
+int trunk_binlog_write_ex(const int timestamp, const char op_type, \
+		const FDFSTrunkFullInfo *pTrunk, \
+		const FDFSTrunkFullInfo *pDest, const int64_t lease_id)
+{
+	char buff[TRUNK_BINLOG_LINE_SIZE];
+	int length;
+	int result;
+	int write_ret;
+
+	length = trunk_binlog_pack_record(timestamp, op_type, \
+			pTrunk, pDest, lease_id, buff);
+	if ((result=pthread_mutex_lock(&trunk_sync_thread_lock)) != 0)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"call pthread_mutex_lock fail, " \
+			"errno: %d, error info: %s", \
+			__LINE__, result, STRERROR(result));
+	}
+
+	write_ret = trunk_binlog_do_write(buff, length);
+
 	if ((result=pthread_mutex_unlock(&trunk_sync_thread_lock)) != 0)
 	{
 		logError("file: "__FILE__", line: %d, " \
@@ -767,6 +1020,90 @@ int trunk_binlog_write_buffer(const char *buff, const int length)
 	return write_ret;
 }
 
+int trunk_binlog_write_buffer(const char *buff, const int length)
+{
+	int result;
+	int write_ret;
+
+	if ((result=pthread_mutex_lock(&trunk_sync_thread_lock)) != 0)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"call pthread_mutex_lock fail, " \
+			"errno: %d, error info: %s", \
+			__LINE__, result, STRERROR(result));
+	}
+
+	write_ret = trunk_binlog_do_write(buff, length);
+
+	if ((result=pthread_mutex_unlock(&trunk_sync_thread_lock)) != 0)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"call pthread_mutex_unlock fail, " \
+			"errno: %d, error info: %s", \
+			__LINE__, result, STRERROR(result));
+	}
+
+	return write_ret;
+}
+
+void trunk_binlog_apply(const char *buff, const int length)
+{
+	TrunkBinLogRecord record;
+	const char *p;
+	const char *pEnd;
+	int record_length;
+	int result;
+
+	p = buff;
+	pEnd = buff + length;
+	while (p < pEnd)
+	{
+		result = trunk_binlog_unpack_record(p, pEnd - p, \
+				&record, &record_length);
+		if (result == EAGAIN)
+		{
+			break;
+		}
+
+		p += record_length;
+		if (result != 0)
+		{
+			logWarning("file: "__FILE__", line: %d, " \
+				"skip bad binlog record, length: %d", \
+				__LINE__, record_length);
+			continue;
+		}
+
+		if (!(record.op_type == TRUNK_OP_TYPE_RECLAIM || \
+			record.op_type == TRUNK_OP_TYPE_MOVE))
+		{
+			continue;
+		}
+
+		if (record.trunk.path.store_path_index >= \
+			g_fdfs_store_paths.count)
+		{
+			logWarning("file: "__FILE__", line: %d, " \
+				"invalid store path index: %d in binlog " \
+				"record, op type: %c", __LINE__, \
+				record.trunk.path.store_path_index, \
+				record.op_type);
+			continue;
+		}
+
+		if (record.op_type == TRUNK_OP_TYPE_MOVE)
+		{
+			trunk_redirect_push(record.op_type, \
+				&(record.trunk), &(record.dest));
+		}
+		else
+		{
+			trunk_redirect_push(record.op_type, \
+				&(record.trunk), NULL);
+		}
+	}
+}
+
 static char *get_binlog_readable_filename(const void *pArg, \
 		char *full_filename)
 {
@@ -1111,102 +1448,42 @@ static int trunk_binlog_preread(TrunkBinLogReader *pReader)
 	return 0;
 }
 
-static int trunk_binlog_do_line_read(TrunkBinLogReader *pReader, \
-		char *line, const int line_size, int *line_length)
-{
-	char *pLineEnd;
-
-	if (pReader->binlog_buff.length == 0)
-	{
-		return ENOENT;
-	}
-
-	pLineEnd = (char *)memchr(pReader->binlog_buff.current, '\n', \
-			pReader->binlog_buff.length);
-	if (pLineEnd == NULL)
-	{
-		return ENOENT;
-	}
-
-	*line_length = (pLineEnd - pReader->binlog_buff.current) + 1;
-	if (*line_length >= line_size)
-	{
-		logError("file: "__FILE__", line: %d, " \
-			"read from binlog file \"%s\" fail, " \
-			"file offset: "INT64_PRINTF_FORMAT", " \
-			"line buffer size: %d is too small! " \
-			"<= line length: %d", __LINE__, \
-			get_binlog_readable_filename(pReader, NULL), \
-			pReader->binlog_offset, line_size, *line_length);
-		return ENOSPC;
-	}
-
-	memcpy(line, pReader->binlog_buff.current, *line_length);
-	*(line + *line_length) = '\0';
-
-	pReader->binlog_buff.current = pLineEnd + 1;
-	pReader->binlog_buff.length -= *line_length;
-
-	return 0;
-}
-
-static int trunk_binlog_read_line(TrunkBinLogReader *pReader, \
-		char *line, const int line_size, int *line_length)
-{
-	int result;
-
-	result = trunk_binlog_do_line_read(pReader, line, \
-			line_size, line_length);
-	if (result != ENOENT)
-	{
-		return result;
-	}
-
-	result = trunk_binlog_preread(pReader);
-	if (result != 0)
-	{
-		return result;
-	}
-
-	return trunk_binlog_do_line_read(pReader, line, \
-			line_size, line_length);
-}
-
 int trunk_binlog_read(TrunkBinLogReader *pReader, \
 			TrunkBinLogRecord *pRecord, int *record_length)
 {
-#define COL_COUNT  8
-	char line[TRUNK_BINLOG_LINE_SIZE];
-	char *cols[COL_COUNT];
 	int result;
 
-	result = trunk_binlog_read_line(pReader, line, \
-				sizeof(line), record_length);
-	if (result != 0)
+	result = trunk_binlog_unpack_record(pReader->binlog_buff.current, \
+			pReader->binlog_buff.length, pRecord, record_length);
+	if (result == EAGAIN)
 	{
-		return result;
+		if ((result=trunk_binlog_preread(pReader)) != 0)
+		{
+			return result;
+		}
+
+		result = trunk_binlog_unpack_record( \
+			pReader->binlog_buff.current, \
+			pReader->binlog_buff.length, pRecord, record_length);
+		if (result == EAGAIN)  //the last record is not complete
+		{
+			return ENOENT;
+		}
 	}
 
-	if ((result=splitEx(line, ' ', cols, COL_COUNT)) < COL_COUNT)
+	pReader->binlog_buff.current += *record_length;
+	pReader->binlog_buff.length -= *record_length;
+	if (result != 0)
 	{
 		logError("file: "__FILE__", line: %d, " \
 			"read data from binlog file \"%s\" fail, " \
 			"file offset: "INT64_PRINTF_FORMAT", " \
-			"read item count: %d < %d", \
-			__LINE__, get_binlog_readable_filename(pReader, NULL), \
-			pReader->binlog_offset, result, COL_COUNT);
+			"bad record length: %d", __LINE__, \
+			get_binlog_readable_filename(pReader, NULL), \
+			pReader->binlog_offset, *record_length);
 		return ENOENT;
 	}
 
-	pRecord->timestamp = atoi(cols[0]);
-	pRecord->op_type = *(cols[1]);
-	pRecord->trunk.path.store_path_index = atoi(cols[2]);
-	pRecord->trunk.path.sub_path_high = atoi(cols[3]);
-	pRecord->trunk.path.sub_path_low = atoi(cols[4]);
-	pRecord->trunk.file.id = atoi(cols[5]);
-	pRecord->trunk.file.offset = atoi(cols[6]);
-	pRecord->trunk.file.size = atoi(cols[7]);
-
 	return 0;
 }
 
@@ -1329,29 +1606,29 @@ static int trunk_sync_data(TrunkBinLogReader *pReader, \
 		ConnectionInfo *pStorage)
 {
 	int length;
+	int record_length;
 	char *p;
+	char *pEnd;
 	int result;
 	TrackerHeader header;
 	char in_buff[1];
 	char *pBuff;
 	int64_t in_bytes;
 
-	p = pReader->binlog_buff.buffer + pReader->binlog_buff.length - 1;
-	while (p != pReader->binlog_buff.buffer && *p != '\n')
+	//ship the whole records in the buffer as one batch
+	p = pReader->binlog_buff.current;
+	pEnd = p + pReader->binlog_buff.length;
+	while (p < pEnd && (record_length=trunk_binlog_record_length( \
+				p, pEnd - p)) > 0)
 	{
-		p--;
+		p += record_length;
 	}
 
-	length = p - pReader->binlog_buff.buffer;
+	length = p - pReader->binlog_buff.current;
 	if (length == 0)
 	{
-		logWarning("FILE: "__FILE__", line: %d, " \
-			"no buffer to sync, buffer length: %d, " \
-			"should try again later", __LINE__, \
-			pReader->binlog_buff.length);
-		return ENOENT;
+		return ENOENT;  //the last record is being written
 	}
-	length++;
 
 	memset(&header, 0, sizeof(header));
 	long2buff(length, header.pkg_len);
@@ -1367,8 +1644,9 @@ static int trunk_sync_data(TrunkBinLogReader *pReader, \
 		return result;
 	}
 
-	if ((result=tcpsenddata_nb(pStorage->sock, pReader->binlog_buff.buffer,\
-		length, g_fdfs_network_timeout)) != 0)
+	if ((result=tcpsenddata_nb(pStorage->sock, \
+		pReader->binlog_buff.current, length, \
+		g_fdfs_network_timeout)) != 0)
 	{
 		logError("FILE: "__FILE__", line: %d, " \
 			"send data to storage server %s:%d fail, " \
@@ -1385,11 +1663,8 @@ static int trunk_sync_data(TrunkBinLogReader *pReader, \
 	}
 
 	pReader->binlog_offset += length;
+	pReader->binlog_buff.current += length;
 	pReader->binlog_buff.length -= length;
-	if (pReader->binlog_buff.length > 0)
-	{
-		pReader->binlog_buff.current = pReader->binlog_buff.buffer + length;
-	}
 
 	return 0;
 }
@@ -1635,6 +1910,12 @@ static void* trunk_sync_thread_entrance(void* arg)
 			if ((sync_result=trunk_sync_data(&reader, \
 				&storage_server)) != 0)
 			{
+				if (sync_result == ENOENT)
+				{
+					sync_result = 0;
+					usleep(g_sync_wait_usec);
+					continue;
+				}
 				break;
 			}
 
@@ -17,10 +17,38 @@
 
 #define TRUNK_OP_TYPE_ADD_SPACE		'A'
 #define TRUNK_OP_TYPE_DEL_SPACE		'D'
+#define TRUNK_OP_TYPE_RECLAIM		'R'  //the free trunk file removed
+#define TRUNK_OP_TYPE_MOVE		'M'  //the trunk file moved by compactor
+#define TRUNK_OP_TYPE_LEASE		'L'  //the space leased to the storage
+#define TRUNK_OP_TYPE_LEASE_END		'E'  //the lease returned or dropped
+
+#define TRUNK_OP_IS_LEASE(op_type) \
+	((op_type) == TRUNK_OP_TYPE_LEASE || (op_type) == TRUNK_OP_TYPE_LEASE_END)
 
 #define TRUNK_BINLOG_BUFFER_SIZE	(64 * 1024)
 #define TRUNK_BINLOG_LINE_SIZE		128
 
+/* the binary record of the trunk binlog:
+     1 byte magic, 1 byte op type, 1 byte record length,
+     1 byte store path index, 4 bytes timestamp,
+     16 bytes trunk: 1 byte sub path high, 1 byte sub path low,
+       2 bytes reserved, 4 bytes file id, 4 bytes offset, 4 bytes size
+     16 bytes dest trunk (TRUNK_OP_TYPE_MOVE only)
+     8 bytes lease id (TRUNK_OP_TYPE_LEASE and LEASE_END only)
+     4 bytes CRC32 of the bytes above
+   the magic is not a digit, so the text lines of the old version
+   (begin with the timestamp) can be read from the same binlog.
+   written only when trunk_binlog_format is binary, the old version
+   can't read the binary records. in the text format, the R, M, L and E
+   op types are the lines as the others, the old version skips them,
+   the lease id is the last column of the L and E lines */
+#define TRUNK_BINLOG_RECORD_MAGIC	0xFB
+#define TRUNK_BINLOG_TRUNK_BYTES	16
+#define TRUNK_BINLOG_RECORD_SIZE	(8 + TRUNK_BINLOG_TRUNK_BYTES + 4)
+#define TRUNK_BINLOG_MOVE_RECORD_SIZE	(TRUNK_BINLOG_RECORD_SIZE + \
+					TRUNK_BINLOG_TRUNK_BYTES)
+#define TRUNK_BINLOG_LEASE_RECORD_SIZE	(TRUNK_BINLOG_RECORD_SIZE + 8)
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -40,6 +68,8 @@ typedef struct
 	time_t timestamp;
 	char op_type;
 	FDFSTrunkFullInfo trunk;
+	FDFSTrunkFullInfo dest;  //for TRUNK_OP_TYPE_MOVE
+	int64_t lease_id;  //for TRUNK_OP_TYPE_LEASE and LEASE_END
 } TrunkBinLogRecord;
 
 extern int g_trunk_sync_thread_count;
@@ -49,8 +79,37 @@ int trunk_sync_destroy();
 
 int trunk_binlog_write_buffer(const char *buff, const int length);
 
-int trunk_binlog_write(const int timestamp, const char op_type, \
-		const FDFSTrunkFullInfo *pTrunk);
+/* move or remove the local trunk files as the trunk server did,
+   buff is the binlog records synced from the trunk server */
+void trunk_binlog_apply(const char *buff, const int length);
+
+/* the record is appended to the write cache, the cache is written and
+   synced as one batch (group commit) when it is full or by the timer,
+   pDest is the dest trunk of TRUNK_OP_TYPE_MOVE, can be NULL,
+   lease_id is for TRUNK_OP_TYPE_LEASE and LEASE_END */
+int trunk_binlog_write_ex(const int timestamp, const char op_type, \
+		const FDFSTrunkFullInfo *pTrunk, \
+		const FDFSTrunkFullInfo *pDest, const int64_t lease_id);
+
+#define trunk_binlog_write(timestamp, op_type, pTrunk) \
+	trunk_binlog_write_ex(timestamp, op_type, pTrunk, NULL, 0)
+
+#define trunk_binlog_write_lease(timestamp, op_type, pTrunk, lease_id) \
+	trunk_binlog_write_ex(timestamp, op_type, pTrunk, NULL, lease_id)
+
+/* pack the record to buff by trunk_binlog_format, the text line or
+   the binary record, buff size must >= TRUNK_BINLOG_LINE_SIZE,
+   return the record length */
+int trunk_binlog_pack_record(const int timestamp, const char op_type, \
+		const FDFSTrunkFullInfo *pTrunk, \
+		const FDFSTrunkFullInfo *pDest, const int64_t lease_id, \
+		char *buff);
+
+/* parse one binary record or text line from buff,
+   return 0 for success, EAGAIN when the record is not complete,
+   EINVAL for the bad record, record_length bytes should be skipped */
+int trunk_binlog_unpack_record(const char *buff, const int length, \
+		TrunkBinLogRecord *pRecord, int *record_length);
 
 int trunk_binlog_truncate();
 
@@ -0,0 +1,153 @@
+/**
+* Copyright (C) 2008 Happy Fish / YuQing
+*
+* FastDFS may be copied only under the terms of the GNU General
+* Public License V3, which may be found in the FastDFS source kit.
+* Please visit the FastDFS Home Page http://www.csource.org/ for more detail.
+**/
+
+//test_stat_shard.c, compare the stat counters updated under one mutex
+//with the per-thread stat shards, as the dio threads do per file io
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include "common_define.h"
+#include "logger.h"
+#include "storage_stat.h"
+
+#define DEFAULT_THREAD_COUNT  32
+#define DEFAULT_LOOP_COUNT    1000000
+
+static pthread_mutex_t stat_lock;
+static FDFSStorageStat mutex_stat;
+static int loop_count = DEFAULT_LOOP_COUNT;
+
+static void *mutex_thread_entrance(void *arg)
+{
+	int i;
+
+	for (i=0; i<loop_count; i++)
+	{
+		pthread_mutex_lock(&stat_lock);
+		mutex_stat.total_file_write_count++;
+		mutex_stat.success_file_write_count++;
+		pthread_mutex_unlock(&stat_lock);
+	}
+
+	return NULL;
+}
+
+static void *shard_thread_entrance(void *arg)
+{
+	StorageStatShard *pStatShard;
+	int i;
+
+	for (i=0; i<loop_count; i++)
+	{
+		pStatShard = STORAGE_STAT_SHARD();
+		pStatShard->stat.total_file_write_count++;
+		pStatShard->stat.success_file_write_count++;
+	}
+
+	return NULL;
+}
+
+static int64_t run_threads(void *(*entrance)(void *), const int thread_count)
+{
+	pthread_t *tids;
+	struct timeval tv_start;
+	struct timeval tv_end;
+	int result;
+	int i;
+
+	tids = (pthread_t *)malloc(sizeof(pthread_t) * thread_count);
+	if (tids == NULL)
+	{
+		printf("malloc fail, errno: %d\n", errno);
+		exit(ENOMEM);
+	}
+
+	gettimeofday(&tv_start, NULL);
+	for (i=0; i<thread_count; i++)
+	{
+		if ((result=pthread_create(tids + i, NULL, entrance, NULL)) != 0)
+		{
+			printf("pthread_create fail, errno: %d\n", result);
+			exit(result);
+		}
+	}
+
+	for (i=0; i<thread_count; i++)
+	{
+		pthread_join(tids[i], NULL);
+	}
+	gettimeofday(&tv_end, NULL);
+
+	free(tids);
+	return (int64_t)(tv_end.tv_sec - tv_start.tv_sec) * 1000000 + \
+		(tv_end.tv_usec - tv_start.tv_usec);
+}
+
+int main(int argc, char *argv[])
+{
+	FDFSStorageStat base;
+	FDFSStorageStat merged;
+	int64_t total_count;
+	int64_t mutex_us;
+	int64_t shard_us;
+	int thread_count;
+	int result;
+
+	thread_count = argc > 1 ? atoi(argv[1]) : DEFAULT_THREAD_COUNT;
+	if (argc > 2)
+	{
+		loop_count = atoi(argv[2]);
+	}
+	if (thread_count <= 0 || loop_count <= 0)
+	{
+		printf("Usage: %s [thread_count] [loop_count]\n", argv[0]);
+		return EINVAL;
+	}
+
+	log_init();
+	pthread_mutex_init(&stat_lock, NULL);
+	memset(&base, 0, sizeof(base));
+	if ((result=storage_stat_init(&base)) != 0)
+	{
+		return result;
+	}
+
+	total_count = (int64_t)thread_count * loop_count;
+	mutex_us = run_threads(mutex_thread_entrance, thread_count);
+	shard_us = run_threads(shard_thread_entrance, thread_count);
+
+	storage_stat_merge(&merged);
+	if (merged.success_file_write_count != total_count || \
+		mutex_stat.success_file_write_count != total_count)
+	{
+		printf("count mismatch, expect: "INT64_PRINTF_FORMAT \
+			", mutex: "INT64_PRINTF_FORMAT \
+			", shard: "INT64_PRINTF_FORMAT"\n", total_count, \
+			mutex_stat.success_file_write_count, \
+			merged.success_file_write_count);
+		return EINVAL;
+	}
+
+	printf("threads: %d, updates per thread: %d\n", \
+		thread_count, loop_count);
+	printf("global mutex: "INT64_PRINTF_FORMAT" ms, %.2f M updates/s\n", \
+		mutex_us / 1000, (double)total_count / (mutex_us > 0 ? \
+		mutex_us : 1));
+	printf("stat shards:  "INT64_PRINTF_FORMAT" ms, %.2f M updates/s\n", \
+		shard_us / 1000, (double)total_count / (shard_us > 0 ? \
+		shard_us : 1));
+
+	storage_stat_destroy();
+	log_destroy();
+	return 0;
+}
+
@@ -0,0 +1,313 @@
+/**
+* Copyright (C) 2008 Happy Fish / YuQing
+*
+* FastDFS may be copied only under the terms of the GNU General
+* Public License V3, which may be found in the FastDFS source kit.
+* Please visit the FastDFS Home Page http://www.csource.org/ for more detail.
+**/
+
+//test_trunk_alloc.c, the trunk space allocation of the trunk server
+//(trunk_alloc_space_ex of trunk_mem.c) by the threads, the trunk files
+//and the trunk binlog are created under the base path of the argument
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <sys/stat.h>
+#include "common_define.h"
+#include "shared_func.h"
+#include "logger.h"
+#include "base64.h"
+#include "sched_thread.h"
+#include "fdfs_global.h"
+#include "storage_global.h"
+#include "trunk_mem.h"
+#include "trunk_sync.h"
+
+#define DEFAULT_THREAD_COUNT      8
+#define DEFAULT_LOOP_COUNT        1000000
+#define DEFAULT_TRUNK_FILE_COUNT  64
+
+#define TRUNK_FILE_SIZE       (64 * 1024 * 1024)
+#define SLOT_MIN_SIZE         256
+#define HOLD_COUNT            1024  //the allocated blocks kept by a thread
+
+static int loop_count = DEFAULT_LOOP_COUNT;
+static int trunk_file_count = DEFAULT_TRUNK_FILE_COUNT;
+static int alloc_fail_count = 0;
+static int error_count = 0;
+
+static int make_dir(const char *path)
+{
+	if (mkdir(path, 0755) != 0 && errno != EEXIST)
+	{
+		printf("mkdir %s fail, errno: %d, error info: %s\n", \
+			path, errno, STRERROR(errno));
+		return errno != 0 ? errno : EPERM;
+	}
+	return 0;
+}
+
+/* the trunk server with one store path and one level of the sub dirs */
+static int init_trunk_server(const char *base_path)
+{
+	static char *store_paths[1];
+	char path[MAX_PATH_SIZE];
+	int result;
+
+	snprintf(g_fdfs_base_path, sizeof(g_fdfs_base_path), "%s", base_path);
+	store_paths[0] = g_fdfs_base_path;
+	g_fdfs_store_paths.count = 1;
+	g_fdfs_store_paths.paths = store_paths;
+	g_subdir_count_per_path = 1;
+
+	if ((result=make_dir(base_path)) != 0)
+	{
+		return result;
+	}
+	snprintf(path, sizeof(path), "%s/data", base_path);
+	if ((result=make_dir(path)) != 0)
+	{
+		return result;
+	}
+	snprintf(path, sizeof(path), "%s/data/00", base_path);
+	if ((result=make_dir(path)) != 0)
+	{
+		return result;
+	}
+	snprintf(path, sizeof(path), "%s/data/00/00", base_path);
+	if ((result=make_dir(path)) != 0)
+	{
+		return result;
+	}
+
+	base64_init_ex(&g_fdfs_base64_context, 0, '-', '_', '.');
+	g_current_time = time(NULL);
+	g_if_use_trunk_file = true;
+	g_if_trunker_self = true;
+	g_slot_min_size = SLOT_MIN_SIZE;
+	g_slot_max_size = TRUNK_FILE_SIZE / 2;
+	g_trunk_file_size = TRUNK_FILE_SIZE;
+
+	/* the free trunk files are never reclaimed, because the free space
+	   is kept below the threshold, the free space is checked at last */
+	g_trunk_create_file_advance = true;
+	g_trunk_create_file_space_threshold = (int64_t)trunk_file_count * \
+			TRUNK_FILE_SIZE + 1;
+
+	if ((result=trunk_sync_init()) != 0)
+	{
+		return result;
+	}
+	return storage_trunk_init();
+}
+
+/* take the whole trunk files and give them back as the free space */
+static int add_trunk_files()
+{
+	FDFSTrunkFullInfo *trunks;
+	int result;
+	int i;
+
+	trunks = (FDFSTrunkFullInfo *)calloc(trunk_file_count, \
+			sizeof(FDFSTrunkFullInfo));
+	if (trunks == NULL)
+	{
+		printf("malloc fail, errno: %d\n", errno);
+		return ENOMEM;
+	}
+
+	for (i=0; i<trunk_file_count; i++)
+	{
+		if ((result=trunk_alloc_space(TRUNK_FILE_SIZE, \
+				trunks + i)) != 0 || \
+			(result=trunk_alloc_confirm(trunks + i, 0)) != 0)
+		{
+			printf("alloc trunk file fail, errno: %d\n", result);
+			free(trunks);
+			return result;
+		}
+	}
+
+	for (i=0; i<trunk_file_count; i++)
+	{
+		if ((result=trunk_free_space(trunks + i, true)) != 0)
+		{
+			printf("free trunk file fail, errno: %d\n", result);
+			free(trunks);
+			return result;
+		}
+	}
+
+	free(trunks);
+	return 0;
+}
+
+/* the small files of 1KB to 128KB, the most allocated are
+   kept and freed in FIFO order */
+static void *alloc_thread_entrance(void *arg)
+{
+	FDFSTrunkFullInfo held[HOLD_COUNT];
+	unsigned int seed;
+	int base;
+	int index;
+	int result;
+	int i;
+
+	memset(held, 0, sizeof(held));
+	seed = (unsigned int)(long)arg;
+	for (i=0; i<loop_count; i++)
+	{
+		index = i % HOLD_COUNT;
+		if (held[index].file.size > 0)
+		{
+			if (trunk_free_space(held + index, true) != 0)
+			{
+				__sync_fetch_and_add(&error_count, 1);
+			}
+			held[index].file.size = 0;
+		}
+
+		base = 1024 << (rand_r(&seed) % 7);
+		held[index].path.store_path_index = 0;
+		result = trunk_alloc_space_ex(base + rand_r(&seed) % base, \
+				held + index, false);
+		if (result == 0)
+		{
+			if (trunk_alloc_confirm(held + index, 0) != 0)
+			{
+				__sync_fetch_and_add(&error_count, 1);
+				held[index].file.size = 0;
+			}
+		}
+		else
+		{
+			if (result == ENOSPC)
+			{
+				__sync_fetch_and_add(&alloc_fail_count, 1);
+			}
+			else
+			{
+				__sync_fetch_and_add(&error_count, 1);
+			}
+			held[index].file.size = 0;
+		}
+	}
+
+	for (i=0; i<HOLD_COUNT; i++)
+	{
+		if (held[i].file.size > 0 && \
+			trunk_free_space(held + i, true) != 0)
+		{
+			__sync_fetch_and_add(&error_count, 1);
+		}
+	}
+
+	return NULL;
+}
+
+static int64_t run_threads(const int thread_count)
+{
+	pthread_t *tids;
+	struct timeval tv_start;
+	struct timeval tv_end;
+	int result;
+	int i;
+
+	tids = (pthread_t *)malloc(sizeof(pthread_t) * thread_count);
+	if (tids == NULL)
+	{
+		printf("malloc fail, errno: %d\n", errno);
+		exit(ENOMEM);
+	}
+
+	gettimeofday(&tv_start, NULL);
+	for (i=0; i<thread_count; i++)
+	{
+		if ((result=pthread_create(tids + i, NULL, \
+			alloc_thread_entrance, (void *)(long)(i + 1))) != 0)
+		{
+			printf("pthread_create fail, errno: %d\n", result);
+			exit(result);
+		}
+	}
+
+	for (i=0; i<thread_count; i++)
+	{
+		pthread_join(tids[i], NULL);
+	}
+	gettimeofday(&tv_end, NULL);
+
+	free(tids);
+	return (int64_t)(tv_end.tv_sec - tv_start.tv_sec) * 1000000 + \
+		(tv_end.tv_usec - tv_start.tv_usec);
+}
+
+int main(int argc, char *argv[])
+{
+	int64_t total_count;
+	int64_t total_space;
+	int64_t used_us;
+	int thread_count;
+	int result;
+
+	if (argc < 2)
+	{
+		printf("Usage: %s <base_path> [thread_count] [loop_count] " \
+			"[trunk_file_count]\nthe base path should be empty, " \
+			"the less trunk files the more allocations fail\n", \
+			argv[0]);
+		return EINVAL;
+	}
+
+	thread_count = argc > 2 ? atoi(argv[2]) : DEFAULT_THREAD_COUNT;
+	if (argc > 3)
+	{
+		loop_count = atoi(argv[3]);
+	}
+	if (argc > 4)
+	{
+		trunk_file_count = atoi(argv[4]);
+	}
+	if (thread_count <= 0 || loop_count <= 0 || trunk_file_count <= 0)
+	{
+		printf("invalid thread count: %d, loop count: %d or " \
+			"trunk file count: %d\n", thread_count, \
+			loop_count, trunk_file_count);
+		return EINVAL;
+	}
+
+	log_init();
+	g_log_context.log_level = LOG_WARNING;
+	if ((result=init_trunk_server(argv[1])) != 0 || \
+		(result=add_trunk_files()) != 0)
+	{
+		return result;
+	}
+
+	total_count = (int64_t)thread_count * loop_count;
+	used_us = run_threads(thread_count);
+
+	total_space = (int64_t)trunk_file_count * TRUNK_FILE_SIZE;
+	printf("threads: %d, allocs per thread: %d, trunk files: %d\n", \
+		thread_count, loop_count, trunk_file_count);
+	printf("trunk_alloc_space: "INT64_PRINTF_FORMAT" ms, " \
+		"%.2f M allocs/s, fail: %d, error: %d\n", used_us / 1000, \
+		(double)total_count / (used_us > 0 ? used_us : 1), \
+		alloc_fail_count, error_count);
+	if (g_trunk_total_free_space != total_space)
+	{
+		printf("free space mismatch, expect: "INT64_PRINTF_FORMAT \
+			", real: "INT64_PRINTF_FORMAT"\n", total_space, \
+			g_trunk_total_free_space);
+		result = EINVAL;
+	}
+
+	storage_trunk_destroy();
+	log_destroy();
+	return result != 0 || error_count > 0 ? 1 : 0;
+}
@@ -0,0 +1,516 @@
+/**
+* Copyright (C) 2008 Happy Fish / YuQing
+*
+* FastDFS may be copied only under the terms of the GNU General
+* Public License V3, which may be found in the FastDFS source kit.
+* Please visit the FastDFS Home Page http://www.csource.org/ for more detail.
+**/
+
+//test_trunk_checker.c, compare the memory and the time of the free block
+//checker: the pointer arrays growing by doubling with the pages of node ids,
+//both checkers load 50M blocks in the offset order and the random order
+//by default
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include "common_define.h"
+#include "logger.h"
+#include "avl_tree.h"
+#include "trunk_free_block_checker.h"
+#include "trunk_node_pool.h"
+
+#define DEFAULT_BLOCK_COUNT   (50 * 1000 * 1000)
+
+#define BLOCK_STRIDE          1024  //the free blocks are 512 bytes apart
+#define BLOCK_SIZE            512
+#define BLOCKS_PER_FILE       (64 * 1024 * 1024 / BLOCK_STRIDE)
+
+typedef struct {
+	int (*check_func)(FDFSTrunkFullInfo *pTrunkInfo);
+	int (*insert_func)(FDFSTrunkFullInfo *pTrunkInfo);
+	int (*delete_func)(FDFSTrunkFullInfo *pTrunkInfo);
+} BlockChecker;
+
+/* the block checker as the trunk server did: the pointer array of the
+   blocks per trunk file, the array grows by doubling */
+typedef struct {
+	int id;
+	int alloc;
+	int count;
+	FDFSTrunkFullInfo **blocks;
+} OldBlockArray;
+
+static AVLTreeInfo old_tree;
+
+/* trunk_shared.c needs the storage globals, the checker only logs by it */
+char *trunk_info_dump(const FDFSTrunkFullInfo *pTrunkInfo, char *buff, \
+				const int buff_size)
+{
+	snprintf(buff, buff_size, "id=%d, offset=%d, size=%d", \
+		pTrunkInfo->file.id, pTrunkInfo->file.offset, \
+		pTrunkInfo->file.size);
+	return buff;
+}
+
+static int old_compare_file(void *p1, void *p2)
+{
+	return ((OldBlockArray *)p1)->id - ((OldBlockArray *)p2)->id;
+}
+
+static void old_free_file(void *ptr)
+{
+	free(((OldBlockArray *)ptr)->blocks);
+	free(ptr);
+}
+
+/* the index of the first block whose offset > the offset */
+static int old_search(OldBlockArray *pArray, const int offset)
+{
+	int left;
+	int right;
+	int mid;
+
+	left = 0;
+	right = pArray->count - 1;
+	while (left <= right)
+	{
+		mid = (left + right) / 2;
+		if (pArray->blocks[mid]->file.offset > offset)
+		{
+			right = mid - 1;
+		}
+		else
+		{
+			left = mid + 1;
+		}
+	}
+	return left;
+}
+
+static int old_check(FDFSTrunkFullInfo *pTrunkInfo)
+{
+	OldBlockArray target;
+	OldBlockArray *pArray;
+	FDFSTrunkFullInfo *pExisted;
+	int index;
+	char buff1[256];
+	char buff2[256];
+
+	target.id = pTrunkInfo->file.id;
+	pArray = (OldBlockArray *)avl_tree_find(&old_tree, &target);
+	if (pArray == NULL)
+	{
+		return 0;
+	}
+
+	index = old_search(pArray, pTrunkInfo->file.offset);
+	if (index > 0 && pArray->blocks[index - 1]->file.offset + \
+		pArray->blocks[index - 1]->file.size > pTrunkInfo->file.offset)
+	{
+		pExisted = pArray->blocks[index - 1];
+	}
+	else if (index < pArray->count && pArray->blocks[index]->file.offset < \
+		pTrunkInfo->file.offset + pTrunkInfo->file.size)
+	{
+		pExisted = pArray->blocks[index];
+	}
+	else
+	{
+		return 0;
+	}
+
+	//logged as the checker does
+	logWarning("file: "__FILE__", line: %d, " \
+		"node overlap, current trunk entry: %s, " \
+		"existed trunk entry: %s", __LINE__, \
+		trunk_info_dump(pTrunkInfo, buff1, sizeof(buff1)), \
+		trunk_info_dump(pExisted, buff2, sizeof(buff2)));
+	return EEXIST;
+}
+
+static int old_insert(FDFSTrunkFullInfo *pTrunkInfo)
+{
+	OldBlockArray target;
+	OldBlockArray *pArray;
+	FDFSTrunkFullInfo **blocks;
+	int new_alloc;
+	int index;
+
+	target.id = pTrunkInfo->file.id;
+	pArray = (OldBlockArray *)avl_tree_find(&old_tree, &target);
+	if (pArray == NULL)
+	{
+		pArray = (OldBlockArray *)malloc(sizeof(OldBlockArray));
+		if (pArray == NULL)
+		{
+			return ENOMEM;
+		}
+		memset(pArray, 0, sizeof(OldBlockArray));
+		pArray->id = pTrunkInfo->file.id;
+		avl_tree_insert(&old_tree, pArray);
+	}
+
+	if (pArray->count >= pArray->alloc)
+	{
+		new_alloc = pArray->alloc == 0 ? 32 : 2 * pArray->alloc;
+		blocks = (FDFSTrunkFullInfo **)realloc(pArray->blocks, \
+				sizeof(FDFSTrunkFullInfo *) * new_alloc);
+		if (blocks == NULL)
+		{
+			return ENOMEM;
+		}
+		pArray->blocks = blocks;
+		pArray->alloc = new_alloc;
+	}
+
+	index = old_search(pArray, pTrunkInfo->file.offset);
+	memmove(pArray->blocks + index + 1, pArray->blocks + index, \
+		sizeof(FDFSTrunkFullInfo *) * (pArray->count - index));
+	pArray->blocks[index] = pTrunkInfo;
+	pArray->count++;
+	return 0;
+}
+
+static int old_delete(FDFSTrunkFullInfo *pTrunkInfo)
+{
+	OldBlockArray target;
+	OldBlockArray *pArray;
+	int index;
+
+	target.id = pTrunkInfo->file.id;
+	pArray = (OldBlockArray *)avl_tree_find(&old_tree, &target);
+	if (pArray == NULL)
+	{
+		return ENOENT;
+	}
+
+	index = old_search(pArray, pTrunkInfo->file.offset) - 1;
+	if (index < 0 || pArray->blocks[index]->file.offset != \
+		pTrunkInfo->file.offset)
+	{
+		return ENOENT;
+	}
+
+	pArray->count--;
+	memmove(pArray->blocks + index, pArray->blocks + index + 1, \
+		sizeof(FDFSTrunkFullInfo *) * (pArray->count - index));
+	if (pArray->count == 0)
+	{
+		avl_tree_delete(&old_tree, pArray);
+	}
+	else if (pArray->count < pArray->alloc / 2 && pArray->count > 16)
+	{
+		pArray->blocks = (FDFSTrunkFullInfo **)realloc(pArray->blocks, \
+			sizeof(FDFSTrunkFullInfo *) * (pArray->alloc / 2));
+		pArray->alloc /= 2;
+	}
+	return 0;
+}
+
+static int64_t get_rss_bytes()
+{
+	FILE *fp;
+	long pages;
+	long rss;
+
+	fp = fopen("/proc/self/statm", "r");
+	if (fp == NULL)
+	{
+		return 0;
+	}
+	if (fscanf(fp, "%ld %ld", &pages, &rss) != 2)
+	{
+		rss = 0;
+	}
+	fclose(fp);
+	return (int64_t)rss * getpagesize();
+}
+
+static int64_t get_current_us()
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+typedef struct {
+	int64_t index_bytes;
+	int64_t insert_us;
+	int64_t check_us;
+	int64_t delete_us;
+	int fail_count;
+} BenchResult;
+
+static int run_bench(const bool use_old, const int block_count, \
+		const bool random_order, BenchResult *pResult)
+{
+	BlockChecker checker;
+	FDFSTrunkNode **nodes;
+	FDFSTrunkNode *pNode;
+	FDFSTrunkFullInfo probe;
+	int64_t rss_start;
+	int64_t start_us;
+	int overlap_count;
+	unsigned int seed;
+	int file_id;
+	int file_block_count;
+	int i;
+	int k;
+
+	memset(pResult, 0, sizeof(BenchResult));
+	if (trunk_node_pool_init() != 0)
+	{
+		return ENOMEM;
+	}
+
+	if (use_old)
+	{
+		avl_tree_init(&old_tree, old_free_file, old_compare_file);
+		checker.check_func = old_check;
+		checker.insert_func = old_insert;
+		checker.delete_func = old_delete;
+	}
+	else
+	{
+		trunk_free_block_checker_init();
+		checker.check_func = trunk_free_block_check_duplicate;
+		checker.insert_func = trunk_free_block_insert;
+		checker.delete_func = trunk_free_block_delete;
+	}
+
+	/* the nodes are same for both checkers, so alloc them at first */
+	nodes = (FDFSTrunkNode **)malloc(sizeof(FDFSTrunkNode *) * block_count);
+	if (nodes == NULL)
+	{
+		printf("malloc fail, errno: %d\n", errno);
+		return ENOMEM;
+	}
+	/* the trunk files have 1/2 to all of the blocks free */
+	seed = 1;
+	file_id = 0;
+	file_block_count = 0;
+	k = 0;
+	for (i=0; i<block_count; i++)
+	{
+		if (k == file_block_count)
+		{
+			file_id++;
+			file_block_count = BLOCKS_PER_FILE / 2 + \
+				rand_r(&seed) % (BLOCKS_PER_FILE / 2 + 1);
+			k = 0;
+		}
+
+		if ((pNode=trunk_node_alloc()) == NULL)
+		{
+			printf("malloc fail, errno: %d\n", errno);
+			return ENOMEM;
+		}
+		memset(&(pNode->trunk), 0, sizeof(FDFSTrunkFullInfo));
+		pNode->trunk.file.id = file_id;
+		pNode->trunk.file.offset = k++ * BLOCK_STRIDE;
+		pNode->trunk.file.size = BLOCK_SIZE;
+		nodes[i] = pNode;
+	}
+
+	/* the binlog replayed by the time is in the random order */
+	if (random_order)
+	{
+		for (i=block_count - 1; i>0; i--)
+		{
+			k = rand_r(&seed) % (i + 1);
+			pNode = nodes[i];
+			nodes[i] = nodes[k];
+			nodes[k] = pNode;
+		}
+	}
+
+	rss_start = get_rss_bytes();
+	start_us = get_current_us();
+	for (i=0; i<block_count; i++)
+	{
+		if (checker.check_func(&(nodes[i]->trunk)) != 0 || \
+			checker.insert_func(&(nodes[i]->trunk)) != 0)
+		{
+			pResult->fail_count++;
+		}
+	}
+	pResult->insert_us = get_current_us() - start_us;
+	pResult->index_bytes = get_rss_bytes() - rss_start;
+
+	/* half of the probes overlap the existing blocks */
+	overlap_count = 0;
+	memset(&probe, 0, sizeof(probe));
+	probe.file.size = BLOCK_SIZE;
+	start_us = get_current_us();
+	for (i=0; i<block_count; i++)
+	{
+		probe.file.id = nodes[i]->trunk.file.id;
+		probe.file.offset = nodes[i]->trunk.file.offset + \
+			(i % 2 == 0 ? BLOCK_SIZE / 2 : BLOCK_SIZE);
+		if (checker.check_func(&probe) != 0)
+		{
+			overlap_count++;
+		}
+	}
+	pResult->check_us = get_current_us() - start_us;
+	if (overlap_count != (block_count + 1) / 2)
+	{
+		printf("overlap count: %d != %d\n", overlap_count, \
+			(block_count + 1) / 2);
+		pResult->fail_count++;
+	}
+
+	start_us = get_current_us();
+	for (i=0; i<block_count; i++)
+	{
+		if (checker.delete_func(&(nodes[i]->trunk)) != 0)
+		{
+			pResult->fail_count++;
+		}
+	}
+	pResult->delete_us = get_current_us() - start_us;
+
+	return pResult->fail_count == 0 ? 0 : EINVAL;
+}
+
+/* run the bench in the child process, so every checker starts
+   with the clean heap and the RSS delta is its own */
+static int fork_bench(const bool use_old, const int block_count, \
+		const bool random_order, BenchResult *pResult)
+{
+	int fds[2];
+	pid_t pid;
+	int status;
+	int bytes;
+
+	if (pipe(fds) != 0)
+	{
+		printf("pipe fail, errno: %d\n", errno);
+		return errno != 0 ? errno : EMFILE;
+	}
+
+	fflush(stdout);
+	pid = fork();
+	if (pid < 0)
+	{
+		printf("fork fail, errno: %d\n", errno);
+		close(fds[0]);
+		close(fds[1]);
+		return errno != 0 ? errno : EAGAIN;
+	}
+
+	if (pid == 0)
+	{
+		close(fds[0]);
+		status = run_bench(use_old, block_count, random_order, pResult);
+		if (write(fds[1], pResult, sizeof(BenchResult)) != \
+			sizeof(BenchResult))
+		{
+			status = EIO;
+		}
+		close(fds[1]);
+		_exit(status);
+	}
+
+	close(fds[1]);
+	bytes = read(fds[0], pResult, sizeof(BenchResult));
+	close(fds[0]);
+	if (waitpid(pid, &status, 0) != pid)
+	{
+		return errno != 0 ? errno : ECHILD;
+	}
+
+	if (bytes != sizeof(BenchResult))
+	{
+		printf("the child process exit abnormally, status: %d\n", \
+			status);
+		return EIO;
+	}
+	return WIFEXITED(status) ? WEXITSTATUS(status) : EINTR;
+}
+
+static void print_result(const bool use_old, const int block_count, \
+		const bool random_order, const BenchResult *pResult)
+{
+	printf("%s checker, %d blocks in %s order, index memory: %.1f MB "
+		"(%.2f bytes per block), insert: %.3f s, check: %.3f s, "
+		"delete: %.3f s, fail count: %d\n", use_old ? "old" : "new", \
+		block_count, random_order ? "random" : "offset", \
+		pResult->index_bytes / (1024.0 * 1024.0), \
+		(double)pResult->index_bytes / block_count, \
+		pResult->insert_us / 1000000.0, \
+		pResult->check_us / 1000000.0, \
+		pResult->delete_us / 1000000.0, pResult->fail_count);
+}
+
+int main(int argc, char *argv[])
+{
+	BenchResult old_result;
+	BenchResult new_result;
+	int block_count;
+	int result;
+	int i;
+	bool random_order;
+
+	if (argc >= 2 && !(strcmp(argv[1], "old") == 0 || \
+			strcmp(argv[1], "new") == 0))
+	{
+		printf("Usage: %s [<old|new> [block_count] [seq|rand]]\n" \
+			"run both checkers with %d blocks in the offset order "
+			"and the random order without argument\n", \
+			argv[0], DEFAULT_BLOCK_COUNT);
+		return EINVAL;
+	}
+
+	log_init();
+	g_log_context.log_level = LOG_ERR;
+
+	block_count = argc > 2 ? atoi(argv[2]) : DEFAULT_BLOCK_COUNT;
+	if (block_count <= 0)
+	{
+		printf("invalid block count: %d\n", block_count);
+		return EINVAL;
+	}
+
+	if (argc >= 2)
+	{
+		random_order = argc > 3 && strcmp(argv[3], "rand") == 0;
+		result = run_bench(strcmp(argv[1], "old") == 0, block_count, \
+				random_order, &new_result);
+		print_result(strcmp(argv[1], "old") == 0, block_count, \
+				random_order, &new_result);
+		return result == 0 ? 0 : 1;
+	}
+
+	for (i=0; i<2; i++)
+	{
+		random_order = i == 1;
+		if ((result=fork_bench(true, block_count, random_order, \
+				&old_result)) != 0)
+		{
+			return 1;
+		}
+		print_result(true, block_count, random_order, &old_result);
+
+		if ((result=fork_bench(false, block_count, random_order, \
+				&new_result)) != 0)
+		{
+			return 1;
+		}
+		print_result(false, block_count, random_order, &new_result);
+
+		printf("%s order, index memory old / new: %.2f\n", \
+			random_order ? "random" : "offset", \
+			(double)old_result.index_bytes / \
+			(new_result.index_bytes > 0 ? \
+			 new_result.index_bytes : 1));
+	}
+
+	return 0;
+}
@@ -0,0 +1,254 @@
+/**
+* Copyright (C) 2008 Happy Fish / YuQing
+*
+* FastDFS may be copied only under the terms of the GNU General
+* Public License V3, which may be found in the FastDFS source kit.
+* Please visit the FastDFS Home Page http://www.csource.org/ for more detail.
+**/
+
+//test_upload_batch.c, compare the throughput of uploading small files
+//one by one with the batch upload command
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/time.h>
+#include "fdfs_client.h"
+#include "fdfs_global.h"
+#include "logger.h"
+
+#define DEFAULT_FILE_COUNT  10000
+#define DEFAULT_FILE_SIZE   1024
+#define DEFAULT_BATCH_SIZE  100
+
+static int file_count = DEFAULT_FILE_COUNT;
+static int file_size = DEFAULT_FILE_SIZE;
+static int batch_size = DEFAULT_BATCH_SIZE;
+
+static int64_t get_current_us()
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+static int upload_one_by_one(ConnectionInfo *pTrackerServer, \
+		ConnectionInfo *pStorageServer, const int store_path_index, \
+		const char *file_buff, char (*file_ids)[128])
+{
+	char group_name[FDFS_GROUP_NAME_MAX_LEN + 1];
+	int result;
+	int i;
+
+	for (i=0; i<file_count; i++)
+	{
+		*group_name = '\0';
+		if ((result=storage_upload_by_filebuff1(pTrackerServer, \
+			pStorageServer, store_path_index, file_buff, \
+			file_size, "dat", NULL, 0, group_name, \
+			file_ids[i])) != 0)
+		{
+			printf("upload file fail, error no: %d, " \
+				"error info: %s\n", result, STRERROR(result));
+			return result;
+		}
+	}
+
+	return 0;
+}
+
+static int upload_by_batch(ConnectionInfo *pTrackerServer, \
+		ConnectionInfo *pStorageServer, const int store_path_index, \
+		const char *file_buff, char (*file_ids)[128])
+{
+	FDFSUploadBatchEntry *entries;
+	char group_name[FDFS_GROUP_NAME_MAX_LEN + 1];
+	int count;
+	int result;
+	int i;
+	int k;
+
+	entries = (FDFSUploadBatchEntry *)malloc( \
+			sizeof(FDFSUploadBatchEntry) * batch_size);
+	if (entries == NULL)
+	{
+		printf("malloc fail, errno: %d\n", errno);
+		return ENOMEM;
+	}
+
+	for (k=0; k<batch_size; k++)
+	{
+		entries[k].file_buff = file_buff;
+		entries[k].file_size = file_size;
+		entries[k].file_ext_name = "dat";
+	}
+
+	result = 0;
+	for (i=0; i<file_count; i+=count)
+	{
+		count = file_count - i < batch_size ? file_count - i : batch_size;
+		*group_name = '\0';
+		if ((result=storage_upload_files_batch(pTrackerServer, \
+			pStorageServer, store_path_index, entries, count, \
+			group_name)) != 0)
+		{
+			printf("batch upload fail, error no: %d, " \
+				"error info: %s\n", result, STRERROR(result));
+			break;
+		}
+
+		for (k=0; k<count; k++)
+		{
+			sprintf(file_ids[i + k], "%s%c%s", group_name, \
+				FDFS_FILE_ID_SEPERATOR, \
+				entries[k].remote_filename);
+		}
+	}
+
+	free(entries);
+	return result;
+}
+
+static void delete_files(ConnectionInfo *pTrackerServer, \
+		ConnectionInfo *pStorageServer, char (*file_ids)[128])
+{
+	int i;
+
+	for (i=0; i<file_count; i++)
+	{
+		if (*file_ids[i] != '\0')
+		{
+			storage_delete_file1(pTrackerServer, pStorageServer, \
+				file_ids[i]);
+		}
+	}
+}
+
+static void print_result(const char *caption, const int64_t time_used)
+{
+	printf("%s "INT64_PRINTF_FORMAT" ms, %.2f files/s\n", caption, \
+		time_used / 1000, (double)file_count * 1000000 / \
+		(time_used > 0 ? time_used : 1));
+}
+
+int main(int argc, char *argv[])
+{
+	ConnectionInfo *pTrackerServer;
+	ConnectionInfo *pStorageServer;
+	ConnectionInfo storageServer;
+	char group_name[FDFS_GROUP_NAME_MAX_LEN + 1];
+	char (*file_ids)[128];
+	char *file_buff;
+	int64_t start_time;
+	int64_t single_us;
+	int64_t batch_us;
+	int store_path_index;
+	int result;
+	int i;
+
+	if (argc < 2)
+	{
+		printf("Usage: %s <config_file> [file_count] [file_size] " \
+			"[batch_size]\n", argv[0]);
+		return EINVAL;
+	}
+
+	if (argc > 2)
+	{
+		file_count = atoi(argv[2]);
+	}
+	if (argc > 3)
+	{
+		file_size = atoi(argv[3]);
+	}
+	if (argc > 4)
+	{
+		batch_size = atoi(argv[4]);
+	}
+	if (file_count <= 0 || file_size < 0 || batch_size <= 0)
+	{
+		printf("invalid file count, file size or batch size\n");
+		return EINVAL;
+	}
+
+	log_init();
+	g_log_context.log_level = LOG_ERR;
+	if ((result=fdfs_client_init(argv[1])) != 0)
+	{
+		return result;
+	}
+
+	pTrackerServer = tracker_get_connection();
+	if (pTrackerServer == NULL)
+	{
+		fdfs_client_destroy();
+		return errno != 0 ? errno : ECONNREFUSED;
+	}
+
+	*group_name = '\0';
+	if ((result=tracker_query_storage_store(pTrackerServer, \
+		&storageServer, group_name, &store_path_index)) != 0)
+	{
+		printf("tracker_query_storage fail, error no: %d, " \
+			"error info: %s\n", result, STRERROR(result));
+		fdfs_client_destroy();
+		return result;
+	}
+
+	if ((pStorageServer=tracker_connect_server(&storageServer, \
+		&result)) == NULL)
+	{
+		fdfs_client_destroy();
+		return result;
+	}
+
+	//the header and the content of one file are sent by two writes,
+	//disable the nagle algorithm to measure the server, not the stall
+	tcpsetnodelay(pStorageServer->sock, g_fdfs_network_timeout);
+
+	file_buff = (char *)malloc(file_size + 1);
+	file_ids = (char (*)[128])calloc(file_count, 128);
+	if (file_buff == NULL || file_ids == NULL)
+	{
+		printf("malloc fail, errno: %d\n", errno);
+		return ENOMEM;
+	}
+	for (i=0; i<file_size; i++)
+	{
+		file_buff[i] = 'a' + rand() % 26;
+	}
+
+	printf("files: %d, file size: %d, batch size: %d\n", \
+		file_count, file_size, batch_size);
+
+	start_time = get_current_us();
+	result = upload_one_by_one(pTrackerServer, pStorageServer, \
+			store_path_index, file_buff, file_ids);
+	single_us = get_current_us() - start_time;
+	delete_files(pTrackerServer, pStorageServer, file_ids);
+	if (result == 0)
+	{
+		memset(file_ids, 0, (size_t)file_count * 128);
+		start_time = get_current_us();
+		result = upload_by_batch(pTrackerServer, pStorageServer, \
+				store_path_index, file_buff, file_ids);
+		batch_us = get_current_us() - start_time;
+		delete_files(pTrackerServer, pStorageServer, file_ids);
+	}
+
+	if (result == 0)
+	{
+		print_result("one by one:", single_us);
+		print_result("batch:     ", batch_us);
+	}
+
+	free(file_buff);
+	free(file_ids);
+	tracker_disconnect_server_ex(pStorageServer, true);
+	tracker_disconnect_server_ex(pTrackerServer, true);
+	fdfs_client_destroy();
+	return result;
+}
+
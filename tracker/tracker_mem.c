@@ -101,6 +101,9 @@
 #define STORAGE_ITEM_SUCCESS_FILE_READ_COUNT   "success_file_read_count"
 #define STORAGE_ITEM_TOTAL_FILE_WRITE_COUNT    "total_file_write_count"
 #define STORAGE_ITEM_SUCCESS_FILE_WRITE_COUNT  "success_file_write_count"
+#define STORAGE_ITEM_TOTAL_CACHE_GET_COUNT     "total_cache_get_count"
+#define STORAGE_ITEM_SUCCESS_CACHE_GET_COUNT   "success_cache_get_count"
+#define STORAGE_ITEM_SUCCESS_CACHE_GET_BYTES   "success_cache_get_bytes"
 #define STORAGE_ITEM_LAST_SOURCE_UPDATE        "last_source_update"
 #define STORAGE_ITEM_LAST_SYNC_UPDATE          "last_sync_update"
 #define STORAGE_ITEM_LAST_SYNCED_TIMESTAMP     "last_synced_timestamp"
@@ -1319,6 +1322,12 @@ static int tracker_load_storages_new(FDFSGroups *pGroups, const char *data_path)
 			STORAGE_ITEM_TOTAL_FILE_WRITE_COUNT, &iniContext, 0);
 		pStat->success_file_write_count = iniGetInt64Value(section_name, \
 			STORAGE_ITEM_SUCCESS_FILE_WRITE_COUNT, &iniContext, 0);
+		pStat->total_cache_get_count = iniGetInt64Value(section_name, \
+			STORAGE_ITEM_TOTAL_CACHE_GET_COUNT, &iniContext, 0);
+		pStat->success_cache_get_count = iniGetInt64Value(section_name, \
+			STORAGE_ITEM_SUCCESS_CACHE_GET_COUNT, &iniContext, 0);
+		pStat->success_cache_get_bytes = iniGetInt64Value(section_name, \
+			STORAGE_ITEM_SUCCESS_CACHE_GET_BYTES, &iniContext, 0);
 		pStat->last_source_update = iniGetIntValue(section_name, \
 			STORAGE_ITEM_LAST_SOURCE_UPDATE, &iniContext, 0);
 		pStat->last_sync_update = iniGetIntValue(section_name, \
@@ -1951,6 +1960,9 @@ int tracker_save_storages()
 				"\t%s="INT64_PRINTF_FORMAT"\n" \
 				"\t%s="INT64_PRINTF_FORMAT"\n" \
 				"\t%s="INT64_PRINTF_FORMAT"\n" \
+				"\t%s="INT64_PRINTF_FORMAT"\n" \
+				"\t%s="INT64_PRINTF_FORMAT"\n" \
+				"\t%s="INT64_PRINTF_FORMAT"\n" \
 				"\t%s=%d\n" \
 				"\t%s=%d\n" \
 				"\t%s=%d\n" \
@@ -2048,6 +2060,12 @@ int tracker_save_storages()
 				pStorage->stat.total_file_write_count, \
 				STORAGE_ITEM_SUCCESS_FILE_WRITE_COUNT, \
 				pStorage->stat.success_file_write_count, \
+				STORAGE_ITEM_TOTAL_CACHE_GET_COUNT, \
+				pStorage->stat.total_cache_get_count, \
+				STORAGE_ITEM_SUCCESS_CACHE_GET_COUNT, \
+				pStorage->stat.success_cache_get_count, \
+				STORAGE_ITEM_SUCCESS_CACHE_GET_BYTES, \
+				pStorage->stat.success_cache_get_bytes, \
 				STORAGE_ITEM_LAST_SOURCE_UPDATE, \
 				(int)(pStorage->stat.last_source_update), \
 				STORAGE_ITEM_LAST_SYNC_UPDATE, \
@@ -74,82 +74,52 @@ void task_finish_clean_up(struct fast_task_info *pTask)
 	free_queue_push(pTask);
 }
 
-void recv_notify_read(int sock, short event, void *arg)
+void recv_notify_read(struct fast_task_info *pTask)
 {
-	int bytes;
 	int incomesock;
 	struct nio_thread_data *pThreadData;
-	struct fast_task_info *pTask;
 	char szClientIp[IP_ADDRESS_SIZE];
 	in_addr_t client_addr;
 
-	while (1)
+	incomesock = pTask->event.fd;
+	if (incomesock < 0)  //quit flag
 	{
-		if ((bytes=read(sock, &incomesock, sizeof(incomesock))) < 0)
-		{
-			if (!(errno == EAGAIN || errno == EWOULDBLOCK))
-			{
-				logError("file: "__FILE__", line: %d, " \
-					"call read failed, " \
-					"errno: %d, error info: %s", \
-					__LINE__, errno, STRERROR(errno));
-			}
+		free_queue_push(pTask);
+		return;
+	}
 
-			break;
-		}
-		else if (bytes == 0)
+	client_addr = getPeerIpaddr(incomesock, \
+			szClientIp, IP_ADDRESS_SIZE);
+	if (g_allow_ip_count >= 0)
+	{
+		if (bsearch(&client_addr, g_allow_ip_addrs, \
+				g_allow_ip_count, sizeof(in_addr_t), \
+				cmp_by_ip_addr_t) == NULL)
 		{
-			break;
-		}
+			logError("file: "__FILE__", line: %d, " \
+				"ip addr %s is not allowed to access", \
+				__LINE__, szClientIp);
 
-		if (incomesock < 0)
-		{
+			close(incomesock);
+			free_queue_push(pTask);
 			return;
 		}
+	}
 
-		client_addr = getPeerIpaddr(incomesock, \
-				szClientIp, IP_ADDRESS_SIZE);
-		if (g_allow_ip_count >= 0)
-		{
-			if (bsearch(&client_addr, g_allow_ip_addrs, \
-					g_allow_ip_count, sizeof(in_addr_t), \
-					cmp_by_ip_addr_t) == NULL)
-			{
-				logError("file: "__FILE__", line: %d, " \
-					"ip addr %s is not allowed to access", \
-					__LINE__, szClientIp);
-
-				close(incomesock);
-				continue;
-			}
-		}
-
-		if (tcpsetnonblockopt(incomesock) != 0)
-		{
-			close(incomesock);
-			continue;
-		}
+	if (tcpsetnonblockopt(incomesock) != 0)
+	{
+		close(incomesock);
+		free_queue_push(pTask);
+		return;
+	}
 
-		pTask = free_queue_pop();
-		if (pTask == NULL)
-		{
-			logError("file: "__FILE__", line: %d, " \
-				"malloc task buff failed, you should " \
-				"increase the parameter: max_connections", \
-				__LINE__);
-			close(incomesock);
-			continue;
-		}
+	strcpy(pTask->client_ip, szClientIp);
 
-		strcpy(pTask->client_ip, szClientIp);
-	
-		pThreadData = g_thread_data + incomesock % g_work_threads;
-		if (ioevent_set(pTask, pThreadData, incomesock, IOEVENT_READ,
-			client_sock_read, g_fdfs_network_timeout) != 0)
-		{
-			task_finish_clean_up(pTask);
-			continue;
-		}
+	pThreadData = g_thread_data + incomesock % g_work_threads;
+	if (ioevent_set(pTask, pThreadData, incomesock, IOEVENT_READ,
+		client_sock_read, g_fdfs_network_timeout) != 0)
+	{
+		task_finish_clean_up(pTask);
 	}
 }
 
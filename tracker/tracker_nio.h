@@ -20,7 +20,7 @@
 extern "C" {
 #endif
 
-void recv_notify_read(int sock, short event, void *arg);
+void recv_notify_read(struct fast_task_info *pTask);
 int send_add_event(struct fast_task_info *pTask);
 
 void task_finish_clean_up(struct fast_task_info *pTask);
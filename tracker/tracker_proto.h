@@ -92,6 +92,11 @@
 #define STORAGE_PROTO_CMD_TRUNCATE_FILE		     36  //since V3.08
 #define STORAGE_PROTO_CMD_SYNC_TRUNCATE_FILE	     37  //since V3.08
 
+#define STORAGE_PROTO_CMD_DOWNLOAD_FILES_BATCH	     38  //since V5.03
+#define STORAGE_PROTO_CMD_UPLOAD_FILES_BATCH	     39  //since V5.03
+#define STORAGE_PROTO_CMD_TRUNK_ALLOC_LEASE	     40  //since V5.03, storage to trunk server
+#define STORAGE_PROTO_CMD_TRUNK_RETURN_LEASE	     41  //since V5.03, storage to trunk server
+
 //for overwrite all old metadata
 #define STORAGE_SET_METADATA_FLAG_OVERWRITE	'O'
 #define STORAGE_SET_METADATA_FLAG_OVERWRITE_STR	"O"
@@ -103,6 +108,10 @@
 #define FDFS_PROTO_CMD_SIZE		1
 #define FDFS_PROTO_IP_PORT_SIZE		(IP_ADDRESS_SIZE + 6)
 
+/* the response frame of each file for STORAGE_PROTO_CMD_DOWNLOAD_FILES_BATCH:
+   4 bytes index in the request, 1 byte status, 8 bytes content length */
+#define STORAGE_PROTO_BATCH_DOWNLOAD_FRAME_SIZE	(4 + 1 + FDFS_PROTO_PKG_LEN_SIZE)
+
 #define TRACKER_QUERY_STORAGE_FETCH_BODY_LEN	(FDFS_GROUP_NAME_MAX_LEN \
 			+ IP_ADDRESS_SIZE - 1 + FDFS_PROTO_PKG_LEN_SIZE)
 #define TRACKER_QUERY_STORAGE_STORE_BODY_LEN	(FDFS_GROUP_NAME_MAX_LEN \
@@ -111,6 +120,12 @@
 #define STORAGE_TRUNK_ALLOC_CONFIRM_REQ_BODY_LEN  (FDFS_GROUP_NAME_MAX_LEN \
 			+ sizeof(FDFSTrunkInfoBuff))
 
+//the trunk info and the lease id
+#define STORAGE_TRUNK_ALLOC_LEASE_RESP_BODY_LEN  (sizeof(FDFSTrunkInfoBuff) \
+			+ FDFS_PROTO_PKG_LEN_SIZE)
+#define STORAGE_TRUNK_RETURN_LEASE_REQ_BODY_LEN  \
+	(STORAGE_TRUNK_ALLOC_CONFIRM_REQ_BODY_LEN + FDFS_PROTO_PKG_LEN_SIZE)
+
 typedef struct
 {
 	char pkg_len[FDFS_PROTO_PKG_LEN_SIZE];  //body length, not including header
@@ -138,8 +153,13 @@ typedef struct
 typedef struct
 {
 	char src_id[FDFS_STORAGE_ID_MAX_SIZE];  //src storage id
+	char version[FDFS_VERSION_SIZE];  //tracker version, since V5.03
 } TrackerStorageJoinBodyResp;
 
+/* the join response without the tracker version, sent by the tracker
+   server before V5.03 and sent to the storage server before V5.03 */
+#define TRACKER_STORAGE_JOIN_RESP_V502_SIZE  FDFS_STORAGE_ID_MAX_SIZE
+
 typedef struct
 {
 	char group_name[FDFS_GROUP_NAME_MAX_LEN + 1];
@@ -178,6 +198,10 @@ typedef struct
 	char if_trunk_server;
 } TrackerStorageStat;
 
+//the storage stat size replied by the tracker before V5.03
+#define TRACKER_STORAGE_STAT_V502_SIZE  (sizeof(TrackerStorageStat) - \
+	(sizeof(FDFSStorageStatBuff) - FDFS_STORAGE_STAT_BUFF_V502_SIZE))
+
 typedef struct
 {
 	char src_id[FDFS_STORAGE_ID_MAX_SIZE];   //src storage id
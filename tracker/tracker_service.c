@@ -119,29 +119,10 @@ int tracker_service_init()
 			return result;
 		}
 
-		if (pipe(pThreadData->pipe_fds) != 0)
-		{
-			result = errno != 0 ? errno : EPERM;
-			logError("file: "__FILE__", line: %d, " \
-				"call pipe fail, " \
-				"errno: %d, error info: %s", \
-				__LINE__, result, STRERROR(result));
-			break;
-		}
-
-#if defined(OS_LINUX)
-		if ((result=fd_add_flags(pThreadData->pipe_fds[0], \
-				O_NONBLOCK | O_NOATIME)) != 0)
-		{
-			break;
-		}
-#else
-		if ((result=fd_add_flags(pThreadData->pipe_fds[0], \
-				O_NONBLOCK)) != 0)
+		if ((result=ioevent_notify_init(pThreadData)) != 0)
 		{
 			break;
 		}
-#endif
 
 		if ((result=pthread_create(&tid, &thread_attr, \
 			work_thread_entrance, pThreadData)) != 0)
@@ -182,6 +163,7 @@ int tracker_terminate_threads()
 {
         struct nio_thread_data *pThreadData;
         struct nio_thread_data *pDataEnd;
+	struct fast_task_info *pTask;
         int quit_sock;
 
         if (g_thread_data != NULL)
@@ -192,14 +174,18 @@ int tracker_terminate_threads()
                         pThreadData++)
                 {
                         quit_sock--;
-                        if (write(pThreadData->pipe_fds[1], &quit_sock, \
-                                        sizeof(quit_sock)) != sizeof(quit_sock))
+			pTask = free_queue_pop();
+			if (pTask == NULL)
 			{
 				logError("file: "__FILE__", line: %d, " \
-					"write to pipe fail, " \
-					"errno: %d, error info: %s", \
-					__LINE__, errno, STRERROR(errno));
+					"malloc task buff failed, you should " \
+					"increase the parameter: max_connections",
+					__LINE__);
+				continue;
 			}
+
+			pTask->event.fd = quit_sock;
+			ioevent_notify_thread(pThreadData, pTask);
                 }
         }
 
@@ -230,6 +216,7 @@ static void *accept_thread_entrance(void* arg)
 	struct sockaddr_in inaddr;
 	socklen_t sockaddr_len;
 	struct nio_thread_data *pThreadData;
+	struct fast_task_info *pTask;
 
 	server_sock = (long)arg;
 	while (g_continue_flag)
@@ -249,16 +236,20 @@ static void *accept_thread_entrance(void* arg)
 			continue;
 		}
 
-		pThreadData = g_thread_data + incomesock % g_work_threads;
-		if (write(pThreadData->pipe_fds[1], &incomesock, \
-			sizeof(incomesock)) != sizeof(incomesock))
+		pTask = free_queue_pop();
+		if (pTask == NULL)
 		{
-			close(incomesock);
 			logError("file: "__FILE__", line: %d, " \
-				"call write failed, " \
-				"errno: %d, error info: %s", \
-				__LINE__, errno, STRERROR(errno));
+				"malloc task buff failed, you should " \
+				"increase the parameter: max_connections", \
+				__LINE__);
+			close(incomesock);
+			continue;
 		}
+
+		pTask->event.fd = incomesock;
+		pThreadData = g_thread_data + incomesock % g_work_threads;
+		ioevent_notify_thread(pThreadData, pTask);
 	}
 
 	return NULL;
@@ -1212,6 +1203,19 @@ static int tracker_deal_storage_report_status(struct fast_task_info *pTask)
 	return tracker_mem_sync_storages(pGroup, briefServers, 1);
 }
 
+/* the version string of the storage server such as "5.03" */
+static bool tracker_version_ge_503(const char *version)
+{
+	int major;
+	int minor;
+
+	if (sscanf(version, "%d.%d", &major, &minor) != 2)
+	{
+		return false;
+	}
+	return major > 5 || (major == 5 && minor >= 3);
+}
+
 static int tracker_deal_storage_join(struct fast_task_info *pTask)
 {
 	TrackerStorageJoinBodyResp *pJoinBodyResp;
@@ -1390,8 +1394,22 @@ static int tracker_deal_storage_join(struct fast_task_info *pTask)
 			pClientInfo->pStorage->psync_src_server->id);
 	}
 
-	pTask->length = sizeof(TrackerHeader) + \
-			sizeof(TrackerStorageJoinBodyResp);
+	/* the old storage server only accepts the response without the
+	   version, the new one sends the stat buff of the new size to the
+	   tracker server which responds the version */
+	if (tracker_version_ge_503(joinBody.version))
+	{
+		snprintf(pJoinBodyResp->version, \
+			sizeof(pJoinBodyResp->version), "%d.%02d", \
+			g_fdfs_version.major, g_fdfs_version.minor);
+		pTask->length = sizeof(TrackerHeader) + \
+				sizeof(TrackerStorageJoinBodyResp);
+	}
+	else
+	{
+		pTask->length = sizeof(TrackerHeader) + \
+				TRACKER_STORAGE_JOIN_RESP_V502_SIZE;
+	}
 	return 0;
 }
 
@@ -2229,6 +2247,12 @@ static int tracker_deal_server_list_group_storages(struct fast_task_info *pTask)
 				pStatBuff->sz_total_file_write_count);
 		long2buff(pStorageStat->success_file_write_count, \
 				pStatBuff->sz_success_file_write_count);
+		long2buff(pStorageStat->total_cache_get_count, \
+				pStatBuff->sz_total_cache_get_count);
+		long2buff(pStorageStat->success_cache_get_count, \
+				pStatBuff->sz_success_cache_get_count);
+		long2buff(pStorageStat->success_cache_get_bytes, \
+				pStatBuff->sz_success_cache_get_bytes);
 		long2buff(pStorageStat->last_heart_beat_time, \
 				pStatBuff->sz_last_heart_beat_time);
 		pDest->if_trunk_server = (pGroup->pTrunkServer == *ppServer);
@@ -3427,14 +3451,18 @@ static int tracker_deal_storage_beat(struct fast_task_info *pTask)
 			break;
 		}
 
-		if (nPkgLen != sizeof(FDFSStorageStatBuff))
+		//storage servers before V5.03 send the stat buff
+		//without the cache counters
+		if (nPkgLen != sizeof(FDFSStorageStatBuff) && \
+			nPkgLen != FDFS_STORAGE_STAT_BUFF_V502_SIZE)
 		{
 			logError("file: "__FILE__", line: %d, " \
 				"cmd=%d, client ip: %s, package size " \
 				PKG_LEN_PRINTF_FORMAT" is not correct, " \
-				"expect length: 0 or %d", __LINE__, \
+				"expect length: 0, %d or %d", __LINE__, \
 				TRACKER_PROTO_CMD_STORAGE_BEAT, \
 				pTask->client_ip, nPkgLen, 
+				(int)FDFS_STORAGE_STAT_BUFF_V502_SIZE, \
 				(int)sizeof(FDFSStorageStatBuff));
 			status = EINVAL;
 			break;
@@ -3524,6 +3552,15 @@ static int tracker_deal_storage_beat(struct fast_task_info *pTask)
 			buff2long(pStatBuff->sz_total_file_write_count);
 		pStat->success_file_write_count = \
 			buff2long(pStatBuff->sz_success_file_write_count);
+		if (nPkgLen == sizeof(FDFSStorageStatBuff))
+		{
+			pStat->total_cache_get_count = buff2long( \
+				pStatBuff->sz_total_cache_get_count);
+			pStat->success_cache_get_count = buff2long( \
+				pStatBuff->sz_success_cache_get_count);
+			pStat->success_cache_get_bytes = buff2long( \
+				pStatBuff->sz_success_cache_get_bytes);
+		}
 
 		if (++g_storage_stat_chg_count % TRACKER_SYNC_TO_FILE_FREQ == 0)
 		{
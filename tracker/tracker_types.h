@@ -189,6 +189,9 @@ typedef struct
 	int64_t success_file_read_count;
 	int64_t total_file_write_count;
 	int64_t success_file_write_count;
+	int64_t total_cache_get_count;    //file cache lookups, since V5.03
+	int64_t success_cache_get_count;  //file cache hits
+	int64_t success_cache_get_bytes;  //bytes served from file cache
 
 	/* last update timestamp as source server, 
            current server' timestamp
@@ -254,8 +257,14 @@ typedef struct
 	char sz_last_sync_update[8];
 	char sz_last_synced_timestamp[8];
 	char sz_last_heart_beat_time[8];
+	char sz_total_cache_get_count[8];   //since V5.03
+	char sz_success_cache_get_count[8];
+	char sz_success_cache_get_bytes[8];
 } FDFSStorageStatBuff;
 
+//the stat buff size before V5.03, without the cache counters
+#define FDFS_STORAGE_STAT_BUFF_V502_SIZE  (sizeof(FDFSStorageStatBuff) - 3 * 8)
+
 typedef struct StructFDFSStorageDetail
 {
 	char status;